@@ -1105,6 +1105,87 @@ crAddFile2A(
 #define crAddFile2 crAddFile2A
 #endif //UNICODE
 
+/*! \ingroup CrashRptAPI
+*  \brief Adds a file or files matching a search pattern to crash report, limiting their size.
+*
+*  \return This function returns zero if succeeded.
+*
+*  \param[in] pszFile       Absolute path to the file (or file search pattern) to add to crash report, required.
+*  \param[in] pszDestFile   Destination file name, optional.
+*  \param[in] pszDesc       File description (used in Error Report Details dialog), optional.
+*  \param[in] dwFlags       Flags, optional.
+*  \param[in] uMaxTotalSize Maximum total size of files matching the search pattern, in bytes, optional.
+*  \param[in] uMaxFileSize  Maximum size of a single file, in bytes, optional.
+*
+*    This function is the same as crAddFile2(), but allows to limit how much data
+*    the file or files take in the error report. This is useful for log files.
+*
+*    Besides the "*" and "?" wildcards, the file name and the directory names of \a pszFile
+*    may contain wildcards too. A "**" directory name matches any number of nested directories,
+*    for example "C:\\MyApp\\Logs\\**\\*.log" matches all .log files in the Logs folder and its subfolders.
+*    Files found in subfolders are named in the ZIP archive by their relative path, with
+*    directory separators replaced by underscores.
+*
+*    Files matching the search pattern are taken newest first (by last write time) until
+*    their total size reaches \a uMaxTotalSize. The file that doesn't fit is included partially,
+*    older files are not included.
+*
+*    If a file is larger than \a uMaxFileSize, only its last \a uMaxFileSize bytes (starting from
+*    a new line) are included. Such files are always copied to the error report folder.
+*
+*    Zero \a uMaxTotalSize or \a uMaxFileSize means no limit.
+*
+*    The crAddFile3W() and crAddFile3A() are wide-character and multibyte-character
+*    versions of crAddFile3() function. The crAddFile3() macro defines character set
+*    independent mapping.
+*
+*  Usage example:
+*
+*  \code
+*
+*  // Add up to 10 MB of the newest log files, found in the Logs folder and its subfolders.
+*  // Only the last megabyte of each log file is included.
+*  crAddFile3(_T("C:\\Program Files (x86)\\MyApp\\Logs\\**\\*.log"),
+*      NULL, _T("Log file"), CR_AF_MAKE_FILE_COPY, 10*1024*1024, 1024*1024);
+*
+*  \endcode
+*
+*  \sa crAddFile2(), crAddFile3W(), crAddFile3A(), crAddFile3()
+*/
+
+CRASHRPTAPI(int)
+crAddFile3W(
+            LPCWSTR pszFile,
+            LPCWSTR pszDestFile,
+            LPCWSTR pszDesc,
+            DWORD dwFlags,
+            ULONGLONG uMaxTotalSize,
+            ULONGLONG uMaxFileSize
+            );
+
+/*! \ingroup CrashRptAPI
+*  \copydoc crAddFile3W()
+*/
+
+CRASHRPTAPI(int)
+crAddFile3A(
+            LPCSTR pszFile,
+            LPCSTR pszDestFile,
+            LPCSTR pszDesc,
+            DWORD dwFlags,
+            ULONGLONG uMaxTotalSize,
+            ULONGLONG uMaxFileSize
+            );
+
+/*! \brief Character set-independent mapping of crAddFile3W() and crAddFile3A() functions.
+*  \ingroup CrashRptAPI
+*/
+#ifdef UNICODE
+#define crAddFile3 crAddFile3W
+#else
+#define crAddFile3 crAddFile3A
+#endif //UNICODE
+
 
 // Flags for crAddScreenshot function.
 #define CR_AS_VIRTUAL_SCREEN  0  //!< Take a screenshot of the virtual screen.
@@ -1113,6 +1194,7 @@ crAddFile2A(
 #define CR_AS_GRAYSCALE_IMAGE 4  //!< Make a grayscale image instead of a full-color one.
 #define CR_AS_USE_JPEG_FORMAT 8  //!< Store screenshots as JPG files.
 #define CR_AS_ALLOW_DELETE   16  //!< If this flag is specified, the file will be deletable from context menu of Error Report Details dialog.
+#define CR_AS_FAST_PNG_FORMAT 32 //!< Store screenshots as PNG files encoded for speed rather than the smallest size.
 
 /*! \ingroup DeprecatedAPI
 *  \brief Adds a screenshot to the crash report.
@@ -1207,6 +1289,10 @@ crAddScreenshot(
 *  This should be the number between 0 and 100, inclusively. The bigger the number, the better the quality and the bigger the JPEG file size.
 *  If you use PNG file format, this parameter is ignored.
 *
+*  You can specify the \ref CR_AS_FAST_PNG_FORMAT flag to encode PNG files several times faster.
+*  Screenshots of usual application windows are almost as small as with the default encoding
+*  and, unlike JPEG ones, keep text sharp. Images having at most 256 colors are saved with a palette.
+*
 *  In addition, you can specify the \ref CR_AS_GRAYSCALE_IMAGE flag to make a grayscale screenshot
 *  (by default color image is made). Grayscale image gives smaller file size.
 *
@@ -1299,18 +1385,18 @@ crAddScreenshot2(
 *
 *  When this function is called, CrashRpt launches another process named \b CrashSender.exe.
 *  The \b CrashSender.exe process then continuously captures the desktop screenshots in background
-*  mode and stores them to disk as image files. To avoid high CPU load, image files are stored
-*  in uncompressed state as raw bitmap (BMP) files. When the count of screenshot files exceeds
-*  the predefined maximum number, the old screenshot files are reused cyclically.
+*  mode, scales them down to the video frame size and keeps them in memory. To keep memory usage low,
+*  each frame is stored as a compressed difference from the previous frame. When the count of
+*  frames exceeds the predefined maximum number (or the frames take more memory than allowed,
+*  see \ref crSetVideoMemoryLimit()), the oldest frames are dropped.
 *
 *  If the client application does not crash and its main code or main window loop exits successfully,
-*  the captured desktop screenshot files are removed by the \ref crUninstall() function call and
+*  the recorded frames are discarded by the \ref crUninstall() function call and
 *  \b CrashSender.exe process is terminated.
 *
-*  If the client application crashes at some moment of time, the recorded screenshot files are compressed by
+*  If the client application crashes at some moment of time, the recorded frames are compressed by
 *  <a href="http://www.theora.org/">OGG Theora video codec</a> and written into an .OGG file. The
-*  uncompressed temporary screenshots are then removed, and the resulting
-*  OGG file is included into crash report archive.
+*  resulting OGG file is included into crash report archive.
 *
 *  The <a href="http://en.wikipedia.org/wiki/Ogg">OGG video format</a> is a widely used
 *  video container provided by the open-source OGG Project.
@@ -1318,7 +1404,7 @@ crAddScreenshot2(
 *  another video player understanding this format, like ffmpeg.
 *
 *  Use this function only when necessary, because it may cause end user's computer performance
-*  loss. It also requires some amount of free disk space.
+*  loss. It also requires some amount of memory.
 *
 *  The recorded video may contain user-identifying or private information. Always
 *  specify the purposes you will use collected information for in your Privacy Policy.
@@ -1348,7 +1434,7 @@ crAddScreenshot2(
 *  \endcode
 *
 *  \sa
-*   crAddFile2(), crAddScreenshot2(), crAddRegKey(), crUninstall().
+*   crAddFile2(), crAddScreenshot2(), crAddRegKey(), crUninstall(), crSetVideoMemoryLimit().
 */
 
 CRASHRPTAPI(int)
@@ -1360,6 +1446,31 @@ crAddVideo(
 			HWND hWndParent
             );
 
+/*! \ingroup CrashRptAPI
+*  \brief Limits the amount of memory used for keeping video frames recorded by crAddVideo().
+*
+*  \return This function returns zero if succeeded. Use \ref crGetLastErrorMsg() to retrieve the error message on failure.
+*
+*  \param[in] nMaxMemoryMB Memory limit (in megabytes). Zero means the default limit (64 MB).
+*
+*  \remarks
+*
+*  The limit can't be greater than 1024 MB. This function should be called before crAddVideo(),
+*  otherwise it fails.
+*
+*  When recorded frames take more memory than allowed, the oldest frames are dropped, so
+*  the video becomes shorter than the duration passed to crAddVideo(). How many frames fit into
+*  the limit depends on the video frame size and on how much the desktop changes between frames.
+*
+*  \sa
+*   crAddVideo().
+*/
+
+CRASHRPTAPI(int)
+crSetVideoMemoryLimit(
+            int nMaxMemoryMB
+            );
+
 /*! \ingroup CrashRptAPI
 *  \brief Adds a string property to the crash report.
 *
@@ -19,7 +19,7 @@ be found in the Authors.txt file in the root of the source tree.
 #include <map>
 #include "CrashDescReader.h"
 #include "MinidumpReader.h"
-#include "md5.h"
+#include "Hash.h"
 #include "Utility.h"
 #include "strconv.h"
 #include "unzip.h"
@@ -77,10 +77,10 @@ int CalcFileMD5Hash(CString sFileName, CString& sMD5Hash)
 {
     crpSetErrorMsg(_T("Unspecified error."));
 
-    BYTE buff[512];
-    MD5 md5;
-    MD5_CTX md5_ctx;
-    unsigned char md5_hash[16];
+    std::vector<BYTE> buff(64*1024); // Read buffer
+    CMD5 md5;
+    unsigned char md5_hash[MD5_DIGEST_SIZE];
+    char szHash[2*MD5_DIGEST_SIZE+1];
     FILE* f = NULL;
 
 #if _MSC_VER<1400
@@ -95,27 +95,20 @@ int CalcFileMD5Hash(CString sFileName, CString& sMD5Hash)
         return -1; // Couldn't open ZIP file
     }
 
-    md5.MD5Init(&md5_ctx);
-
     while(!feof(f))
     {
-        size_t count = fread(buff, 1, 512, f);
+        size_t count = fread(&buff[0], 1, buff.size(), f);
         if(count>0)
         {
-            md5.MD5Update(&md5_ctx, buff, (unsigned int)count);
+            md5.Update(&buff[0], count);
         }
     }
 
     fclose(f);
-    md5.MD5Final(md5_hash, &md5_ctx);
+    md5.Final(md5_hash);
 
-    int i;
-    for(i=0; i<16; i++)
-    {
-        CString number;
-        number.Format(_T("%02x"), md5_hash[i]);
-        sMD5Hash += number;
-    }
+    hash_to_hex(md5_hash, sizeof(md5_hash), szHash);
+    sMD5Hash += szHash;
 
     crpSetErrorMsg(_T("Success."));
     return 0;
@@ -13,7 +13,7 @@ be found in the Authors.txt file in the root of the source tree.
 #include <assert.h>
 #include "Utility.h"
 #include "strconv.h"
-#include "md5.h"
+#include "Hash.h"
 
 CMiniDumpReader* g_pMiniDumpReader = NULL;
 
@@ -789,19 +789,14 @@ int CMiniDumpReader::StackWalk(DWORD dwThreadId)
     {
         strconv_t strconv;
         LPCSTR szStackTrace = strconv.t2utf8(sStackTrace);
-        MD5 md5;
-        MD5_CTX md5_ctx;
-        unsigned char md5_hash[16];
-        md5.MD5Init(&md5_ctx);
-        md5.MD5Update(&md5_ctx, (unsigned char*)szStackTrace, (unsigned int)strlen(szStackTrace));
-        md5.MD5Final(md5_hash, &md5_ctx);
-
-        for(i=0; i<16; i++)
-        {
-            CString number;
-            number.Format(_T("%02x"), md5_hash[i]);
-            m_DumpData.m_Threads[nThreadIndex].m_sStackTraceMD5 += number;
-        }
+        CMD5 md5;
+        unsigned char md5_hash[MD5_DIGEST_SIZE];
+        char szHash[2*MD5_DIGEST_SIZE+1];
+        md5.Update(szStackTrace, strlen(szStackTrace));
+        md5.Final(md5_hash);
+
+        hash_to_hex(md5_hash, sizeof(md5_hash), szHash);
+        m_DumpData.m_Threads[nThreadIndex].m_sStackTraceMD5 += szHash;
     }
 
     m_DumpData.m_Threads[nThreadIndex].m_bStackWalk = TRUE;
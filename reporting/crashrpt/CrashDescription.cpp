@@ -0,0 +1,245 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+#include "CrashDescription.h"
+#include <string.h>
+
+// Fails to compile if the condition is false.
+#define CD_STATIC_ASSERT(cond, name) typedef char name[(cond) ? 1 : -1]
+
+// The layout must be the same for any compiler
+CD_STATIC_ASSERT(sizeof(GENERIC_HEADER)==8, check_generic_header_size);
+CD_STATIC_ASSERT(sizeof(STRING_DESC)==16, check_string_desc_size);
+CD_STATIC_ASSERT(sizeof(FILE_ITEM)==48, check_file_item_size);
+CD_STATIC_ASSERT(sizeof(REG_KEY)==24, check_reg_key_size);
+CD_STATIC_ASSERT(sizeof(CUSTOM_PROP)==16, check_custom_prop_size);
+CD_STATIC_ASSERT(sizeof(CRASH_DESCRIPTION)==240, check_crash_description_size);
+CD_STATIC_ASSERT(offsetof(CRASH_DESCRIPTION, m_pExceptionPtrs)==16, check_exception_ptrs_offset);
+CD_STATIC_ASSERT(offsetof(CRASH_DESCRIPTION, m_dwCrashRptVer)==32, check_crashrpt_ver_offset);
+CD_STATIC_ASSERT(offsetof(CRASH_DESCRIPTION, m_bClientAppCrashed)==232, check_client_app_crashed_offset);
+
+// Magic sequence of crash description.
+static const char g_szCrashDescMagic[] = "CRD2";
+
+// Returns size rounded up to a multiple of 8, or zero on overflow.
+static size_t AlignBlockSize(size_t uSize)
+{
+    size_t uAligned = (uSize+7)&~(size_t)7;
+    if(uAligned<uSize)
+        return 0;
+    return uAligned;
+}
+
+CCrashDescWriter::CCrashDescWriter()
+{
+    m_pBuffer = NULL;
+    m_uCapacity = 0;
+}
+
+CRASH_DESCRIPTION* CCrashDescWriter::Create(void* pBuffer, size_t uCapacity)
+{
+    m_pBuffer = NULL;
+    m_uCapacity = 0;
+
+    if(pBuffer==NULL || ((size_t)pBuffer&7)!=0 || uCapacity<sizeof(CRASH_DESCRIPTION))
+        return NULL;
+
+    // Offsets are 32-bit
+    if(uCapacity>0xFFFFFFF8u)
+        uCapacity = 0xFFFFFFF8u;
+
+    CRASH_DESCRIPTION* pDesc = (CRASH_DESCRIPTION*)pBuffer;
+    memset(pDesc, 0, sizeof(CRASH_DESCRIPTION));
+    memcpy(pDesc->m_uchMagic, g_szCrashDescMagic, 4);
+    pDesc->m_uSize = sizeof(CRASH_DESCRIPTION);
+    pDesc->m_uVersion = CRASH_DESC_VERSION;
+    pDesc->m_dwTotalSize = sizeof(CRASH_DESCRIPTION);
+
+    m_pBuffer = (unsigned char*)pBuffer;
+    m_uCapacity = uCapacity;
+    return pDesc;
+}
+
+CRASH_DESCRIPTION* CCrashDescWriter::Attach(void* pBuffer, size_t uCapacity)
+{
+    m_pBuffer = NULL;
+    m_uCapacity = 0;
+
+    if(pBuffer==NULL || ((size_t)pBuffer&7)!=0 || uCapacity<sizeof(CRASH_DESCRIPTION))
+        return NULL;
+
+    if(uCapacity>0xFFFFFFF8u)
+        uCapacity = 0xFFFFFFF8u;
+
+    CRASH_DESCRIPTION* pDesc = (CRASH_DESCRIPTION*)pBuffer;
+    if(memcmp(pDesc->m_uchMagic, g_szCrashDescMagic, 4)!=0 ||
+        pDesc->m_dwTotalSize>uCapacity)
+        return NULL;
+
+    m_pBuffer = (unsigned char*)pBuffer;
+    m_uCapacity = uCapacity;
+    return pDesc;
+}
+
+CRASH_DESCRIPTION* CCrashDescWriter::GetHeader() const
+{
+    return (CRASH_DESCRIPTION*)m_pBuffer;
+}
+
+void* CCrashDescWriter::GetBlock(unsigned uOffs) const
+{
+    if(m_pBuffer==NULL || uOffs==0)
+        return NULL;
+    return m_pBuffer+uOffs;
+}
+
+unsigned CCrashDescWriter::AddBlock(const char* szMagic, size_t uSize)
+{
+    if(m_pBuffer==NULL)
+        return 0;
+
+    CRASH_DESCRIPTION* pDesc = GetHeader();
+    size_t uAligned = AlignBlockSize(uSize);
+    if(uAligned<sizeof(GENERIC_HEADER) || uAligned>m_uCapacity-pDesc->m_dwTotalSize)
+        return 0; // No space left
+
+    unsigned uOffs = pDesc->m_dwTotalSize;
+    GENERIC_HEADER* pBlock = (GENERIC_HEADER*)(m_pBuffer+uOffs);
+    memset(pBlock, 0, uAligned);
+    memcpy(pBlock->m_uchMagic, szMagic, 4);
+    pBlock->m_uSize = (unsigned)uAligned;
+
+    pDesc->m_dwTotalSize += (unsigned)uAligned;
+    return uOffs;
+}
+
+unsigned CCrashDescWriter::AddString(const unsigned short* pStr, size_t uLength, size_t uCapacity)
+{
+    if(m_pBuffer==NULL)
+        return 0;
+
+    if(uCapacity<uLength)
+        uCapacity = uLength;
+    if(uCapacity>(m_uCapacity-sizeof(STRING_DESC))/sizeof(unsigned short))
+        return 0; // Can't fit anyway
+
+    unsigned uOffs = AddBlock("STR ", sizeof(STRING_DESC)+uCapacity*sizeof(unsigned short));
+    if(uOffs==0)
+        return 0;
+
+    STRING_DESC* pStrDesc = (STRING_DESC*)(m_pBuffer+uOffs);
+    if(uLength!=0)
+        memcpy(pStrDesc+1, pStr, uLength*sizeof(unsigned short));
+    pStrDesc->m_uLength = (unsigned)uLength;
+    return uOffs;
+}
+
+bool CCrashDescWriter::SetString(unsigned uOffs, const unsigned short* pStr, size_t uLength)
+{
+    if(m_pBuffer==NULL || uOffs<sizeof(CRASH_DESCRIPTION) || (uOffs&7)!=0 ||
+        uOffs>GetHeader()->m_dwTotalSize-sizeof(STRING_DESC))
+        return false;
+
+    STRING_DESC* pStrDesc = (STRING_DESC*)(m_pBuffer+uOffs);
+    if(memcmp(pStrDesc->m_uchMagic, "STR ", 4)!=0 ||
+        pStrDesc->m_uSize<sizeof(STRING_DESC) ||
+        pStrDesc->m_uSize>GetHeader()->m_dwTotalSize-uOffs ||
+        uLength>(pStrDesc->m_uSize-sizeof(STRING_DESC))/sizeof(unsigned short))
+        return false;
+
+    // Write characters first, so the string is never longer than its data
+    if(uLength<pStrDesc->m_uLength)
+        pStrDesc->m_uLength = (unsigned)uLength;
+    if(uLength!=0)
+        memcpy(pStrDesc+1, pStr, uLength*sizeof(unsigned short));
+    pStrDesc->m_uLength = (unsigned)uLength;
+    return true;
+}
+
+CCrashDescReader::CCrashDescReader()
+{
+    m_pData = NULL;
+    m_uSize = 0;
+}
+
+int CCrashDescReader::Init(const void* pData, size_t uSize)
+{
+    m_pData = NULL;
+    m_uSize = 0;
+
+    if(pData==NULL || uSize<sizeof(CRASH_DESCRIPTION) || ((size_t)pData&7)!=0)
+        return 3;
+
+    const CRASH_DESCRIPTION* pDesc = (const CRASH_DESCRIPTION*)pData;
+    if(memcmp(pDesc->m_uchMagic, g_szCrashDescMagic, 4)!=0)
+        return 1; // Invalid magic word
+
+    if(pDesc->m_uVersion!=CRASH_DESC_VERSION)
+        return 2; // Unsupported version
+
+    // A newer writer may add fields at the end of the header, but never remove them
+    if(pDesc->m_uSize<sizeof(CRASH_DESCRIPTION) || (pDesc->m_uSize&7)!=0 ||
+        pDesc->m_dwTotalSize<pDesc->m_uSize || pDesc->m_dwTotalSize>uSize)
+        return 3;
+
+    m_pData = (const unsigned char*)pData;
+    m_uSize = pDesc->m_dwTotalSize;
+    return 0;
+}
+
+const CRASH_DESCRIPTION* CCrashDescReader::GetHeader() const
+{
+    return (const CRASH_DESCRIPTION*)m_pData;
+}
+
+const GENERIC_HEADER* CCrashDescReader::GetBlock(unsigned uOffs, unsigned& uNextOffs) const
+{
+    uNextOffs = uOffs;
+
+    if(m_pData==NULL || uOffs<GetHeader()->m_uSize || (uOffs&7)!=0 ||
+        uOffs>=m_uSize || m_uSize-uOffs<sizeof(GENERIC_HEADER))
+        return NULL;
+
+    const GENERIC_HEADER* pBlock = (const GENERIC_HEADER*)(m_pData+uOffs);
+    if(pBlock->m_uSize<sizeof(GENERIC_HEADER) || (pBlock->m_uSize&7)!=0 ||
+        pBlock->m_uSize>m_uSize-uOffs)
+        return NULL; // Damaged block
+
+    uNextOffs = uOffs+pBlock->m_uSize;
+    return pBlock;
+}
+
+const void* CCrashDescReader::CheckBlock(const GENERIC_HEADER* pBlock, const char* szMagic, size_t uMinSize)
+{
+    if(pBlock==NULL || memcmp(pBlock->m_uchMagic, szMagic, 4)!=0 || pBlock->m_uSize<uMinSize)
+        return NULL;
+    return pBlock;
+}
+
+bool CCrashDescReader::GetString(unsigned uOffs, const unsigned short*& pStr, unsigned& uLength) const
+{
+    static const unsigned short szEmpty[1] = {0};
+    pStr = szEmpty;
+    uLength = 0;
+
+    if(uOffs==0)
+        return true; // No string
+
+    unsigned uNextOffs = 0;
+    const STRING_DESC* pStrDesc = (const STRING_DESC*)CheckBlock(
+        GetBlock(uOffs, uNextOffs), "STR ", sizeof(STRING_DESC));
+    if(pStrDesc==NULL ||
+        pStrDesc->m_uLength>(pStrDesc->m_uSize-sizeof(STRING_DESC))/sizeof(unsigned short))
+        return false;
+
+    pStr = (const unsigned short*)(pStrDesc+1);
+    uLength = pStrDesc->m_uLength;
+    return true;
+}
@@ -0,0 +1,216 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+// File: CrashDescription.h
+// Description: Binary format of crash description passed from CrashRpt.dll to CrashSender.exe.
+// This file doesn't depend on Windows headers, so it can be built and tested anywhere.
+
+#ifndef _CRASHDESCRIPTION_H
+#define _CRASHDESCRIPTION_H
+
+#include <stddef.h>
+
+// Version of the crash description format. Increase it each time the layout changes.
+#define CRASH_DESC_VERSION 3
+
+// The structures below consist of naturally aligned 32-bit and 64-bit fields only,
+// so their layout doesn't depend on compiler and is the same in 32-bit and 64-bit code.
+// Values are little-endian. Each block starts at an offset that is a multiple of 8.
+// Offsets are counted from the beginning of CRASH_DESCRIPTION; zero offset means "no string".
+
+// Generic block header.
+struct GENERIC_HEADER
+{
+    unsigned char m_uchMagic[4]; // Magic sequence.
+    unsigned int m_uSize;        // Total bytes occupied by this block.
+};
+
+// String block description.
+struct STRING_DESC
+{
+    unsigned char m_uchMagic[4]; // Magic sequence "STR ".
+    unsigned int m_uSize;        // Total bytes occupied by this block (may include room for a longer string).
+    unsigned int m_uLength;      // String length in UTF-16 characters.
+    unsigned int m_uReserved;    // Zero.
+    // This structure is followed by m_uLength UTF-16 characters (no zero terminator).
+};
+
+// File item entry.
+struct FILE_ITEM
+{
+    unsigned char m_uchMagic[4];    // Magic sequence "FIL ".
+    unsigned int m_uSize;           // Total bytes occupied by this block.
+    unsigned int m_dwSrcFilePathOffs; // Path to the original file.
+    unsigned int m_dwDstFileNameOffs; // Name of the destination file.
+    unsigned int m_dwDescriptionOffs; // File description.
+    int m_bMakeCopy;                // Should we make a copy of this file on crash?
+    int m_bAllowDelete;             // Should allow user to delete the file from crash report?
+    unsigned int m_uReserved;       // Zero.
+    unsigned long long m_uMaxTotalSize; // Size budget of files matching a search pattern (0 if none).
+    unsigned long long m_uMaxFileSize;  // Only the end of a larger file is taken (0 if no limit).
+};
+
+// Registry key entry.
+struct REG_KEY
+{
+    unsigned char m_uchMagic[4];    // Magic sequence "REG ".
+    unsigned int m_uSize;           // Total bytes occupied by this block.
+    int m_bAllowDelete;             // Should allow user to delete the file from crash report?
+    unsigned int m_dwRegKeyNameOffs;  // Registry key name.
+    unsigned int m_dwDstFileNameOffs; // Destination file name.
+    unsigned int m_uReserved;       // Zero.
+};
+
+// User-defined property.
+struct CUSTOM_PROP
+{
+    unsigned char m_uchMagic[4];    // Magic sequence "CPR ".
+    unsigned int m_uSize;           // Total bytes occupied by this block.
+    unsigned int m_dwNameOffs;      // Property name.
+    unsigned int m_dwValueOffs;     // Property value.
+};
+
+// Crash description. It is followed by string, file, registry key and property blocks.
+struct CRASH_DESCRIPTION
+{
+    unsigned char m_uchMagic[4];    // Magic sequence "CRD2".
+    unsigned int m_uSize;           // Bytes occupied by this structure.
+    unsigned int m_uVersion;        // Format version (CRASH_DESC_VERSION).
+    unsigned int m_dwTotalSize;     // Total size of the whole used shared mem.
+    unsigned long long m_pExceptionPtrs;  // Address of exception pointers in the crashed process.
+    unsigned long long m_hWndVideoParent; // Parent window for video recording dialog.
+    unsigned int m_dwCrashRptVer;   // Version of CrashRpt.
+    unsigned int m_uFileItems;      // Count of file item records.
+    unsigned int m_uRegKeyEntries;  // Count of registry key entries.
+    unsigned int m_uCustomProps;    // Count of user-defined properties.
+    unsigned int m_dwInstallFlags;  // Flags passed to crInstall() function.
+    int m_nSmtpPort;                // Smtp port.
+    int m_nSmtpProxyPort;           // Smtp proxy port.
+    unsigned int m_uPriorities[3];  // Delivery priorities.
+    unsigned int m_MinidumpType;    // Minidump type.
+    int m_bAddScreenshot;           // Add screenshot?
+    unsigned int m_dwScreenshotFlags; // Screenshot flags.
+    int m_nJpegQuality;             // Jpeg image quality.
+    unsigned int m_dwUrlOffs;       // Offset of recipient URL.
+    unsigned int m_dwAppNameOffs;   // Offset of application name.
+    unsigned int m_dwAppVersionOffs; // Offset of app version.
+    unsigned int m_dwLangFileNameOffs; // Offset of language INI file name.
+    unsigned int m_dwRestartCmdLineOffs; // Offset of app restart command line.
+    int m_nRestartTimeout;          // Restart timeout
+    int m_nMaxReportsPerDay;        // Maximum number of crash reports that will be sent per calendar day.
+    unsigned int m_dwEmailToOffs;   // Offset to E-mail recipient.
+    unsigned int m_dwCrashGUIDOffs; // Offset to crash GUID.
+    unsigned int m_dwUnsentCrashReportsFolderOffs; // Offset of folder name where error reports are stored.
+    unsigned int m_dwPrivacyPolicyURLOffs; // Offset of privacy policy URL.
+    unsigned int m_dwEmailSubjectOffs; // Offset of E-mail subject.
+    unsigned int m_dwEmailTextOffs; // Offset of E-mail text.
+    unsigned int m_dwSmtpProxyServerOffs; // Offset of SMTP proxy server name.
+    unsigned int m_dwPathToDebugHelpDllOffs; // Offset of dbghelp path.
+    unsigned int m_dwCustomSenderIconOffs; // Offset of custom Error Report dialog icon resource name.
+    unsigned int m_dwImageNameOffs; // Offset to image name.
+    unsigned int m_dwProcessId;     // Process ID.
+    unsigned int m_dwThreadId;      // Thread ID.
+    int m_nExceptionType;           // Exception type.
+    unsigned int m_dwExceptionCode; // SEH exception code.
+    unsigned int m_dwInvParamExprOffs; // Invalid parameter expression.
+    unsigned int m_dwInvParamFunctionOffs; // Invalid parameter function.
+    unsigned int m_dwInvParamFileOffs; // Invalid parameter file.
+    unsigned int m_uInvParamLine;   // Invalid parameter line.
+    unsigned int m_uFPESubcode;     // FPE subcode.
+    int m_bSendRecentReports;       // If TRUE, CrashSender.exe needs to send queued error reports.
+                                    // If FALSE, CrashSender.exe needs to send single report.
+    unsigned int m_dwSmtpLoginOffs; // Offset of SMTP login name.
+    unsigned int m_dwSmtpPasswordOffs; // Offset of SMTP password.
+    int m_bAddVideo;                // Wether to add video recording.
+    unsigned int m_dwVideoFlags;    // Flags for video recording.
+    int m_nVideoDuration;           // Video duration.
+    int m_nVideoFrameInterval;      // Video frame interval.
+    int m_nDesiredFrameWidth;       // Video frame width.
+    int m_nDesiredFrameHeight;      // Video frame height.
+    int m_nVideoMaxMemory;          // Memory limit for recorded video frames (in MB), zero means default.
+    int m_bClientAppCrashed;        // If TRUE, the client app has crashed; otherwise the client has exited without crash.
+    unsigned int m_uReserved;       // Zero.
+};
+
+// Writes crash description to a memory block (usually a shared memory view).
+// The used size is kept in the description itself, so several writers
+// may be attached to the same memory one after another.
+class CCrashDescWriter
+{
+public:
+
+    // Constructor.
+    CCrashDescWriter();
+
+    // Starts a new crash description in the given memory, which must be aligned
+    // to 8 bytes. Returns NULL if the memory is too small.
+    CRASH_DESCRIPTION* Create(void* pBuffer, size_t uCapacity);
+
+    // Continues writing to a crash description created before.
+    CRASH_DESCRIPTION* Attach(void* pBuffer, size_t uCapacity);
+
+    // Returns the crash description being written.
+    CRASH_DESCRIPTION* GetHeader() const;
+
+    // Returns the block at the given offset.
+    void* GetBlock(unsigned uOffs) const;
+
+    // Adds a zeroed block of the given type and size and returns its offset
+    // (zero if there is no space left).
+    unsigned AddBlock(const char* szMagic, size_t uSize);
+
+    // Adds a string block with room for at least uCapacity characters, so that
+    // the string can be replaced in place later. Returns its offset (zero if there is no space left).
+    unsigned AddString(const unsigned short* pStr, size_t uLength, size_t uCapacity = 0);
+
+    // Replaces the string at the given offset. Returns false if the new string doesn't fit.
+    bool SetString(unsigned uOffs, const unsigned short* pStr, size_t uLength);
+
+private:
+
+    unsigned char* m_pBuffer; // Memory being written.
+    size_t m_uCapacity;       // Size of the memory.
+};
+
+// Reads crash description in place, without copying anything. All offsets and sizes are
+// checked against the used size, so damaged data can't make the reader go out of bounds.
+class CCrashDescReader
+{
+public:
+
+    // Constructor.
+    CCrashDescReader();
+
+    // Checks the crash description in the given memory, which must be aligned to 8 bytes.
+    // Returns zero on success, 1 if magic is wrong, 2 if version is unsupported,
+    // 3 if the data is damaged.
+    int Init(const void* pData, size_t uSize);
+
+    // Returns the crash description.
+    const CRASH_DESCRIPTION* GetHeader() const;
+
+    // Returns the block at the given offset and the offset of the next block.
+    // Returns NULL at the end of data or if the block is damaged.
+    const GENERIC_HEADER* GetBlock(unsigned uOffs, unsigned& uNextOffs) const;
+
+    // Returns the block if it has the given type and is big enough, otherwise NULL.
+    static const void* CheckBlock(const GENERIC_HEADER* pBlock, const char* szMagic, size_t uMinSize);
+
+    // Returns the string at the given offset. Zero offset gives an empty string.
+    // Returns false if there is no valid string at the offset.
+    bool GetString(unsigned uOffs, const unsigned short*& pStr, unsigned& uLength) const;
+
+private:
+
+    const unsigned char* m_pData; // Crash description.
+    size_t m_uSize;               // Used size.
+};
+
+#endif //_CRASHDESCRIPTION_H
@@ -57,6 +57,7 @@ CCrashHandler::CCrashHandler()
 	m_DesiredFrameSize.cx = 0; // default video frame size
 	m_DesiredFrameSize.cy = 0;
 	m_hWndVideoParent = NULL;
+	m_nVideoMaxMemory = 0; // default memory limit
     m_hEvent = NULL;
 	m_hEvent2 = NULL;
     m_pCrashDesc = NULL;
@@ -452,7 +453,7 @@ int CCrashHandler::Init(
             return 1;
         }
 
-        m_pTmpCrashDesc = m_pCrashDesc;
+        m_pTmpCrashDesc = m_Writer.Attach(m_SharedMem.GetBase(), (size_t)m_SharedMem.GetSize());
         m_pTmpSharedMem = &m_SharedMem;
     }
 
@@ -530,9 +531,8 @@ CRASH_DESCRIPTION* CCrashHandler::PackCrashInfoIntoSharedMem(CSharedMem* pShared
 		}
 	}
 
-    // Create memory view.
-    m_pTmpCrashDesc =
-        (CRASH_DESCRIPTION*)pSharedMem->CreateView(0, sizeof(CRASH_DESCRIPTION));
+    // Map the whole shared memory once, records are then written directly to it.
+    m_pTmpCrashDesc = m_Writer.Create(pSharedMem->GetBase(), (size_t)pSharedMem->GetSize());
     if(m_pTmpCrashDesc==NULL)
     {
         ATLASSERT(0);
@@ -540,11 +540,11 @@ CRASH_DESCRIPTION* CCrashHandler::PackCrashInfoIntoSharedMem(CSharedMem* pShared
         return NULL;
     }
 
+    // Offsets of previously packed properties are not valid anymore
+    if(pSharedMem==&m_SharedMem)
+        m_PackedProps.clear();
+
     // Pack config information to shared memory
-    memset(m_pTmpCrashDesc, 0, sizeof(CRASH_DESCRIPTION));
-    memcpy(m_pTmpCrashDesc->m_uchMagic, "CRD", 3);
-    m_pTmpCrashDesc->m_wSize = sizeof(CRASH_DESCRIPTION);
-    m_pTmpCrashDesc->m_dwTotalSize = sizeof(CRASH_DESCRIPTION);
     m_pTmpCrashDesc->m_dwCrashRptVer = CRASHRPT_VER;
     m_pTmpCrashDesc->m_dwInstallFlags = m_dwFlags;
     m_pTmpCrashDesc->m_MinidumpType = m_MinidumpType;
@@ -555,7 +555,8 @@ CRASH_DESCRIPTION* CCrashHandler::PackCrashInfoIntoSharedMem(CSharedMem* pShared
 	m_pTmpCrashDesc->m_nJpegQuality = m_nJpegQuality;
     memcpy(m_pTmpCrashDesc->m_uPriorities, m_uPriorities, sizeof(UINT)*3);
 	m_pTmpCrashDesc->m_bAddVideo = m_bAddVideo;
-	m_pTmpCrashDesc->m_hWndVideoParent = m_hWndVideoParent;
+	m_pTmpCrashDesc->m_hWndVideoParent = (ULONG_PTR)m_hWndVideoParent;
+	m_pTmpCrashDesc->m_nVideoMaxMemory = m_nVideoMaxMemory;
 	m_pTmpCrashDesc->m_dwProcessId = GetCurrentProcessId();
 	m_pTmpCrashDesc->m_bClientAppCrashed = FALSE;
 	m_pTmpCrashDesc->m_nRestartTimeout = m_nRestartTimeout;
@@ -611,86 +612,109 @@ CRASH_DESCRIPTION* CCrashHandler::PackCrashInfoIntoSharedMem(CSharedMem* pShared
 }
 
 // Packs a string to shared memory
-DWORD CCrashHandler::PackString(CString str)
+DWORD CCrashHandler::PackString(CString str, int nCapacity)
 {
-    DWORD dwTotalSize = m_pTmpCrashDesc->m_dwTotalSize;
-    int nStrLen = str.GetLength()*sizeof(TCHAR);
-    WORD wLength = (WORD)(sizeof(STRING_DESC)+nStrLen);
-
-    LPBYTE pView = m_pTmpSharedMem->CreateView(dwTotalSize, wLength);
-    STRING_DESC* pStrDesc = (STRING_DESC*)pView;
-    memcpy(pStrDesc->m_uchMagic, "STR", 3);
-    pStrDesc->m_wSize = wLength;
-    memcpy(pView+sizeof(STRING_DESC), str.GetBuffer(0), nStrLen);
+    strconv_t strconv;
+    LPCWSTR szStr = strconv.t2w(str);
+    size_t uLength = wcslen(szStr);
 
-    m_pTmpCrashDesc->m_dwTotalSize += wLength;
-
-    m_pTmpSharedMem->DestroyView(pView);
-    return dwTotalSize;
+    DWORD dwOffs = m_Writer.AddString((const unsigned short*)szStr, uLength, nCapacity);
+    ATLASSERT(dwOffs!=0); // Out of shared memory
+    return dwOffs;
 }
 
 // Packs file item to shared memory
 DWORD CCrashHandler::PackFileItem(FileItem& fi)
 {
-    DWORD dwTotalSize = m_pTmpCrashDesc->m_dwTotalSize;
-    WORD wLength = sizeof(FILE_ITEM);
-    m_pTmpCrashDesc->m_dwTotalSize += wLength;
+    DWORD dwOffs = m_Writer.AddBlock("FIL ", sizeof(FILE_ITEM));
+    if(dwOffs==0)
+        return 0;
     m_pTmpCrashDesc->m_uFileItems++;
 
-    LPBYTE pView = m_pTmpSharedMem->CreateView(dwTotalSize, wLength);
-    FILE_ITEM* pFileItem = (FILE_ITEM*)pView;
+    // Strings follow the item, so the item is written through its offset
+    DWORD dwSrcFilePathOffs = PackString(fi.m_sSrcFilePath);
+    DWORD dwDstFileNameOffs = PackString(fi.m_sDstFileName);
+    DWORD dwDescriptionOffs = PackString(fi.m_sDescription);
 
-    memcpy(pFileItem->m_uchMagic, "FIL", 3);
-    pFileItem->m_dwSrcFilePathOffs = PackString(fi.m_sSrcFilePath);
-    pFileItem->m_dwDstFileNameOffs = PackString(fi.m_sDstFileName);
-    pFileItem->m_dwDescriptionOffs = PackString(fi.m_sDescription);
+    FILE_ITEM* pFileItem = (FILE_ITEM*)m_Writer.GetBlock(dwOffs);
+    pFileItem->m_dwSrcFilePathOffs = dwSrcFilePathOffs;
+    pFileItem->m_dwDstFileNameOffs = dwDstFileNameOffs;
+    pFileItem->m_dwDescriptionOffs = dwDescriptionOffs;
     pFileItem->m_bMakeCopy = fi.m_bMakeCopy;
 	pFileItem->m_bAllowDelete = fi.m_bAllowDelete;
-    pFileItem->m_wSize = (WORD)(m_pTmpCrashDesc->m_dwTotalSize-dwTotalSize);
+    pFileItem->m_uMaxTotalSize = fi.m_uMaxTotalSize;
+    pFileItem->m_uMaxFileSize = fi.m_uMaxFileSize;
 
-    m_pTmpSharedMem->DestroyView(pView);
-    return dwTotalSize;
+    return dwOffs;
 }
 
 // Packs custom property to shared memory
 DWORD CCrashHandler::PackProperty(CString sName, CString sValue)
 {
-    DWORD dwTotalSize = m_pTmpCrashDesc->m_dwTotalSize;
-    WORD wLength = sizeof(CUSTOM_PROP);
-    m_pTmpCrashDesc->m_dwTotalSize += wLength;
+    DWORD dwOffs = m_Writer.AddBlock("CPR ", sizeof(CUSTOM_PROP));
+    if(dwOffs==0)
+        return 0;
     m_pTmpCrashDesc->m_uCustomProps++;
 
-    LPBYTE pView = m_pTmpSharedMem->CreateView(dwTotalSize, wLength);
-    CUSTOM_PROP* pProp = (CUSTOM_PROP*)pView;
+    // Reserve room after the value, so it can be updated in place
+    int nCapacity = 2*sValue.GetLength();
+    if(nCapacity<CUSTOM_PROP_MIN_VALUE_LENGTH)
+        nCapacity = CUSTOM_PROP_MIN_VALUE_LENGTH;
+
+    DWORD dwNameOffs = PackString(sName);
+    DWORD dwValueOffs = PackString(sValue, nCapacity);
+
+    CUSTOM_PROP* pProp = (CUSTOM_PROP*)m_Writer.GetBlock(dwOffs);
+    pProp->m_dwNameOffs = dwNameOffs;
+    pProp->m_dwValueOffs = dwValueOffs;
+
+    if(m_pTmpSharedMem==&m_SharedMem)
+        m_PackedProps[sName] = dwOffs;
+
+    return dwOffs;
+}
+
+// Updates custom property in shared memory
+DWORD CCrashHandler::UpdateProperty(CString sName, CString sValue)
+{
+    std::map<CString, DWORD>::iterator it = m_PackedProps.find(sName);
+    if(it==m_PackedProps.end() || m_pTmpSharedMem!=&m_SharedMem)
+        return PackProperty(sName, sValue);
+
+    DWORD dwOffs = it->second;
+    CUSTOM_PROP* pProp = (CUSTOM_PROP*)m_Writer.GetBlock(dwOffs);
 
-    memcpy(pProp->m_uchMagic, "CPR", 3);
-    pProp->m_dwNameOffs = PackString(sName);
-    pProp->m_dwValueOffs = PackString(sValue);
-    pProp->m_wSize = (WORD)(m_pTmpCrashDesc->m_dwTotalSize-dwTotalSize);
+    // Overwrite the value if it fits into the room reserved for it
+    strconv_t strconv;
+    LPCWSTR szValue = strconv.t2w(sValue);
+    if(m_Writer.SetString(pProp->m_dwValueOffs, (const unsigned short*)szValue, wcslen(szValue)))
+        return dwOffs;
 
-    m_pTmpSharedMem->DestroyView(pView);
-    return dwTotalSize;
+    // Otherwise pack a new value with more room; the old one is left unreferenced
+    DWORD dwValueOffs = PackString(sValue, 2*sValue.GetLength());
+    if(dwValueOffs!=0)
+        pProp->m_dwValueOffs = dwValueOffs;
+
+    return dwOffs;
 }
 
 // Packs registry key to shared memory
 DWORD CCrashHandler::PackRegKey(CString sKeyName, RegKeyInfo& rki)
 {
-    DWORD dwTotalSize = m_pTmpCrashDesc->m_dwTotalSize;
-    WORD wLength = sizeof(REG_KEY);
-    m_pTmpCrashDesc->m_dwTotalSize += wLength;
+    DWORD dwOffs = m_Writer.AddBlock("REG ", sizeof(REG_KEY));
+    if(dwOffs==0)
+        return 0;
     m_pTmpCrashDesc->m_uRegKeyEntries++;
 
-    LPBYTE pView = m_pTmpSharedMem->CreateView(dwTotalSize, wLength);
-    REG_KEY* pKey = (REG_KEY*)pView;
+    DWORD dwRegKeyNameOffs = PackString(sKeyName);
+    DWORD dwDstFileNameOffs = PackString(rki.m_sDstFileName);
 
-    memcpy(pKey->m_uchMagic, "REG", 3);
+    REG_KEY* pKey = (REG_KEY*)m_Writer.GetBlock(dwOffs);
 	pKey->m_bAllowDelete = rki.m_bAllowDelete;
-    pKey->m_dwRegKeyNameOffs = PackString(sKeyName);
-	pKey->m_dwDstFileNameOffs = PackString(rki.m_sDstFileName);
-    pKey->m_wSize = (WORD)(m_pTmpCrashDesc->m_dwTotalSize-dwTotalSize);
+    pKey->m_dwRegKeyNameOffs = dwRegKeyNameOffs;
+	pKey->m_dwDstFileNameOffs = dwDstFileNameOffs;
 
-    m_pTmpSharedMem->DestroyView(pView);
-    return dwTotalSize;
+    return dwOffs;
 }
 
 // Returns TRUE if initialized, otherwise FALSE
@@ -1043,7 +1067,8 @@ int CCrashHandler::UnSetThreadExceptionHandlers()
 }
 
 // Adds a file item to the error report
-int CCrashHandler::AddFile(LPCTSTR pszFile, LPCTSTR pszDestFile, LPCTSTR pszDesc, DWORD dwFlags)
+int CCrashHandler::AddFile(LPCTSTR pszFile, LPCTSTR pszDestFile, LPCTSTR pszDesc, DWORD dwFlags,
+                           ULONGLONG uMaxTotalSize, ULONGLONG uMaxFileSize)
 {
     crSetErrorMsg(_T("Unspecified error."));
 
@@ -1089,6 +1114,7 @@ int CCrashHandler::AddFile(LPCTSTR pszFile, LPCTSTR pszDestFile, LPCTSTR pszDesc
 		fi.m_sSrcFilePath = pszFile;
 		fi.m_bMakeCopy = (dwFlags&CR_AF_MAKE_FILE_COPY)!=0;
 		fi.m_bAllowDelete = (dwFlags&CR_AF_ALLOW_DELETE)!=0;
+		fi.m_uMaxFileSize = uMaxFileSize;
 		if(pszDestFile!=NULL)
 		{
 			fi.m_sDstFileName = pszDestFile;
@@ -1127,6 +1153,8 @@ int CCrashHandler::AddFile(LPCTSTR pszFile, LPCTSTR pszDestFile, LPCTSTR pszDesc
 		fi.m_sDstFileName = Utility::GetFileName(pszFile);
 		fi.m_bMakeCopy = (dwFlags&CR_AF_MAKE_FILE_COPY)!=0;
 		fi.m_bAllowDelete = (dwFlags&CR_AF_ALLOW_DELETE)!=0;
+		fi.m_uMaxTotalSize = uMaxTotalSize;
+		fi.m_uMaxFileSize = uMaxFileSize;
 		m_files[fi.m_sDstFileName] = fi;
 
 		// Pack this file item into shared mem.
@@ -1151,7 +1179,7 @@ int CCrashHandler::AddProperty(CString sPropName, CString sPropValue)
 
     m_props[sPropName] = sPropValue;
 
-    PackProperty(sPropName, sPropValue);
+    UpdateProperty(sPropName, sPropValue);
 
     // OK.
     crSetErrorMsg(_T("Success."));
@@ -1244,8 +1272,10 @@ int CCrashHandler::AddVideo(DWORD dwFlags, int nDuration, int nFrameInterval,
     m_pTmpCrashDesc->m_dwVideoFlags = dwFlags;
 	m_pTmpCrashDesc->m_nVideoDuration = nDuration;
 	m_pTmpCrashDesc->m_nVideoFrameInterval = nFrameInterval;
-    m_pTmpCrashDesc->m_DesiredFrameSize = m_DesiredFrameSize;
-	m_pTmpCrashDesc->m_hWndVideoParent = m_hWndVideoParent;
+    m_pTmpCrashDesc->m_nDesiredFrameWidth = m_DesiredFrameSize.cx;
+    m_pTmpCrashDesc->m_nDesiredFrameHeight = m_DesiredFrameSize.cy;
+	m_pTmpCrashDesc->m_hWndVideoParent = (ULONG_PTR)m_hWndVideoParent;
+	m_pTmpCrashDesc->m_nVideoMaxMemory = m_nVideoMaxMemory;
 
 	// Create sync event (we will use it for synchronizing with CrashSender.exe).
 	CString sEventName;
@@ -1270,6 +1300,30 @@ int CCrashHandler::AddVideo(DWORD dwFlags, int nDuration, int nFrameInterval,
 	return 0;
 }
 
+int CCrashHandler::SetVideoMemoryLimit(int nMaxMemoryMB)
+{
+	// Check the limit - it should be less than 1 GB
+	if(nMaxMemoryMB<0 || nMaxMemoryMB>1024)
+	{
+		crSetErrorMsg(_T("Invalid video memory limit."));
+		return 2;
+	}
+
+	// The limit is passed to CrashSender.exe when video recording starts
+	if(m_bAddVideo==TRUE)
+	{
+		crSetErrorMsg(_T("Video recording has already been started."));
+		return 3;
+	}
+
+	m_nVideoMaxMemory = nMaxMemoryMB;
+	m_pTmpCrashDesc->m_nVideoMaxMemory = nMaxMemoryMB;
+
+	// OK
+	crSetErrorMsg(_T("Success."));
+	return 0;
+}
+
 // Generates error report
 int CCrashHandler::GenerateErrorReport(
         PCR_EXCEPTION_INFO pExceptionInfo)
@@ -1316,7 +1370,7 @@ int CCrashHandler::GenerateErrorReport(
 	// Save current process ID, thread ID and exception pointers address to shared mem.
     m_pCrashDesc->m_dwProcessId = GetCurrentProcessId();
     m_pCrashDesc->m_dwThreadId = GetCurrentThreadId();
-    m_pCrashDesc->m_pExceptionPtrs = pExceptionInfo->pexcptrs;
+    m_pCrashDesc->m_pExceptionPtrs = (ULONG_PTR)pExceptionInfo->pexcptrs;
     m_pCrashDesc->m_bSendRecentReports = FALSE;
     m_pCrashDesc->m_nExceptionType = pExceptionInfo->exctype;
 
@@ -50,6 +50,8 @@ struct FileItem
     {
         m_bMakeCopy = FALSE;
         m_bAllowDelete = FALSE;
+        m_uMaxTotalSize = 0;
+        m_uMaxFileSize = 0;
     }
 
     CString m_sSrcFilePath; // Path to the original file.
@@ -60,6 +62,8 @@ struct FileItem
                             // otherwise the file will be included from its original location (not guaranteing that file is the same it was
                             // at the moment of crash).
     BOOL m_bAllowDelete;    // Whether to allow user deleting the file from context menu of Error Report Details dialog.
+    ULONGLONG m_uMaxTotalSize; // Size budget of files matching a search pattern (0 if none).
+    ULONGLONG m_uMaxFileSize;  // Only the end of a larger file is included (0 if no limit).
 };
 
 // Contains information about a registry key included into a crash report.
@@ -143,7 +147,8 @@ public:
 
     // Adds a file to the crash report.
     int AddFile(__in_z LPCTSTR lpFile, __in_opt LPCTSTR lpDestFile,
-                __in_opt LPCTSTR lpDesc, DWORD dwFlags);
+                __in_opt LPCTSTR lpDesc, DWORD dwFlags,
+                ULONGLONG uMaxTotalSize=0, ULONGLONG uMaxFileSize=0);
 
     // Adds a named text property to the report.
     int AddProperty(CString sPropName, CString sPropValue);
@@ -155,6 +160,9 @@ public:
     // if crash will happen sometime, the video will be included into crash report.
     int AddVideo(DWORD dwFlags, int nDuration, int nFrameInterval, SIZE* pDesiredFrameSize, HWND hWndParent);
 
+    // Sets the limit of memory used for keeping recorded video frames.
+    int SetVideoMemoryLimit(int nMaxMemoryMB);
+
     // Adds a registry key to crash report.
     int AddRegKey(__in_z LPCTSTR szRegKey, __in_z LPCTSTR szDstFileName, DWORD dwFlags);
 
@@ -226,14 +234,16 @@ public:
 
     // Packs crash description into shared memory.
     CRASH_DESCRIPTION* PackCrashInfoIntoSharedMem(__in CSharedMem* pSharedMem, BOOL bTempMem);
-    // Packs a string.
-    DWORD PackString(CString str);
+    // Packs a string, reserving room for nCapacity characters.
+    DWORD PackString(CString str, int nCapacity = 0);
     // Packs a file item.
     DWORD PackFileItem(FileItem& fi);
     // Packs a custom user property.
     DWORD PackProperty(CString sName, CString sValue);
     // Packs a registry key.
     DWORD PackRegKey(CString sKeyName, RegKeyInfo& rki);
+    // Updates a packed custom property in place or packs it anew.
+    DWORD UpdateProperty(CString sName, CString sValue);
 
     // Launches the CrashSender.exe process.
     int LaunchCrashSender(
@@ -323,6 +333,7 @@ public:
     int   m_nVideoFrameInterval;   // Video frame interval.
     SIZE   m_DesiredFrameSize;     // Video frame size.
     HWND m_hWndVideoParent;        // Parent window for video recording dialog.
+    int   m_nVideoMaxMemory;       // Memory limit for recorded video frames (in MB).
     CString m_sCustomSenderIcon;   // Resource name that can be used as custom Error Report dialog icon.
     std::map<CString, FileItem> m_files; // File items to include.
     std::map<CString, CString> m_props;  // User-defined properties to include.
@@ -334,6 +345,8 @@ public:
     CRASH_DESCRIPTION* m_pCrashDesc; // Pointer to crash description shared mem view.
     CSharedMem* m_pTmpSharedMem;   // Used temporarily
     CRASH_DESCRIPTION* m_pTmpCrashDesc; // Used temporarily
+    CCrashDescWriter m_Writer;     // Writes crash description to m_pTmpSharedMem.
+    std::map<CString, DWORD> m_PackedProps; // Offsets of custom property records in m_SharedMem.
     HANDLE m_hSenderProcess;       // Handle to CrashSender.exe process.
     PFNCRASHCALLBACKW m_pfnCallback2W; // Client crash callback.
     PFNCRASHCALLBACKA m_pfnCallback2A; // Client crash callback.
@@ -474,6 +474,54 @@ crAddFile2A(PCSTR pszFile, PCSTR pszDestFile, PCSTR pszDesc, DWORD dwFlags)
     return crAddFile2W(pwszFile, pwszDestFile, pwszDesc, dwFlags);
 }
 
+CRASHRPTAPI(int)
+crAddFile3W(PCWSTR pszFile, PCWSTR pszDestFile, PCWSTR pszDesc, DWORD dwFlags,
+            ULONGLONG uMaxTotalSize, ULONGLONG uMaxFileSize)
+{
+    crSetErrorMsg(_T("Success."));
+
+    strconv_t strconv;
+
+    CCrashHandler *pCrashHandler =
+        CCrashHandler::GetCurrentProcessCrashHandler();
+
+    if(pCrashHandler==NULL)
+    {
+        crSetErrorMsg(_T("Crash handler wasn't previously installed for current process."));
+        return 1; // No handler installed for current process?
+    }
+
+    LPCTSTR lptszFile = strconv.w2t((LPWSTR)pszFile);
+    LPCTSTR lptszDestFile = strconv.w2t((LPWSTR)pszDestFile);
+    LPCTSTR lptszDesc = strconv.w2t((LPWSTR)pszDesc);
+
+    int nAddResult = pCrashHandler->AddFile(lptszFile, lptszDestFile, lptszDesc, dwFlags,
+        uMaxTotalSize, uMaxFileSize);
+    if(nAddResult!=0)
+    {
+        // Couldn't add file
+        return 2;
+    }
+
+    // OK.
+    return 0;
+}
+
+CRASHRPTAPI(int)
+crAddFile3A(PCSTR pszFile, PCSTR pszDestFile, PCSTR pszDesc, DWORD dwFlags,
+            ULONGLONG uMaxTotalSize, ULONGLONG uMaxFileSize)
+{
+    // Convert parameters to wide char
+
+    strconv_t strconv;
+
+    LPCWSTR pwszFile = strconv.a2w(pszFile);
+    LPCWSTR pwszDestFile = strconv.a2w(pszDestFile);
+    LPCWSTR pwszDesc = strconv.a2w(pszDesc);
+
+    return crAddFile3W(pwszFile, pwszDestFile, pwszDesc, dwFlags, uMaxTotalSize, uMaxFileSize);
+}
+
 CRASHRPTAPI(int)
 crAddScreenshot(
                 DWORD dwFlags
@@ -525,6 +573,25 @@ crAddVideo(
     return pCrashHandler->AddVideo(dwFlags, nDuration, nFrameInterval, pDesiredFrameSize, hWndParent);
 }
 
+CRASHRPTAPI(int)
+crSetVideoMemoryLimit(
+            int nMaxMemoryMB
+            )
+{
+    crSetErrorMsg(_T("Unspecified error."));
+
+    CCrashHandler *pCrashHandler =
+        CCrashHandler::GetCurrentProcessCrashHandler();
+
+    if(pCrashHandler==NULL)
+    {
+        crSetErrorMsg(_T("Crash handler wasn't previously installed for current process."));
+        return 1; // Invalid parameter?
+    }
+
+    return pCrashHandler->SetVideoMemoryLimit(nMaxMemoryMB);
+}
+
 CRASHRPTAPI(int)
 crAddPropertyW(
                LPCWSTR pszPropName,
@@ -16,6 +16,7 @@ CSharedMem::CSharedMem()
 	// Set internal variables to their default state
     m_uSize = 0;
     m_hFileMapping = NULL;
+    m_pBase = NULL;
 
 	// Determine memory granularity (needed for file mapping).
     SYSTEM_INFO si;
@@ -79,6 +80,12 @@ BOOL CSharedMem::Destroy()
     }
     m_aViewStartPtrs.clear();
 
+    if(m_pBase!=NULL)
+    {
+        UnmapViewOfFile(m_pBase);
+        m_pBase = NULL;
+    }
+
 	// Destroy file mapping
     if(m_hFileMapping!=NULL)
     {
@@ -128,4 +135,18 @@ void CSharedMem::DestroyView(LPBYTE pViewPtr)
     }
 }
 
+LPBYTE CSharedMem::GetBase()
+{
+	// Map the whole file mapping on first call
+    if(m_pBase==NULL && m_hFileMapping!=NULL)
+    {
+        m_pBase = (LPBYTE)MapViewOfFile(m_hFileMapping, FILE_MAP_READ|FILE_MAP_WRITE, 0, 0, (SIZE_T)m_uSize);
+
+        // The size of an opened file mapping is not known until it is mapped
+        MEMORY_BASIC_INFORMATION mbi;
+        if(m_pBase!=NULL && m_uSize==0 && VirtualQuery(m_pBase, &mbi, sizeof(mbi))!=0)
+            m_uSize = mbi.RegionSize;
+    }
 
+    return m_pBase;
+}
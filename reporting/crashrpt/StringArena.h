@@ -0,0 +1,282 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+// File: StringArena.h
+// Description: Bump allocator for converted strings and UTF-8/UTF-16 conversion routines.
+// This file doesn't depend on Windows headers, so it can be built and tested anywhere.
+
+#ifndef _STRINGARENA_H
+#define _STRINGARENA_H
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Size of the storage inside the arena object, used before anything is allocated on heap.
+#define STRING_ARENA_INLINE_SIZE 512
+// Size of the first heap block. Each next block is twice as big, up to STRING_ARENA_MAX_BLOCK_SIZE.
+#define STRING_ARENA_BLOCK_SIZE 4096
+#define STRING_ARENA_MAX_BLOCK_SIZE (256*1024)
+
+// Allocates memory by moving a pointer through big blocks. Memory is released
+// only all at once, when the arena is destroyed or freed.
+class CStringArena
+{
+public:
+
+    CStringArena()
+    {
+        m_pBlocks = NULL;
+        m_uNextBlockSize = STRING_ARENA_BLOCK_SIZE;
+        Reset();
+    }
+
+    ~CStringArena()
+    {
+        Free();
+    }
+
+    // Allocates uSize bytes aligned to 8 bytes. Returns NULL if out of memory.
+    void* Alloc(size_t uSize)
+    {
+        size_t uAligned = (uSize+7)&~(size_t)7;
+        if(uAligned<uSize)
+            return NULL;
+
+        if(uAligned>m_uLeft)
+        {
+            // Allocations bigger than a half of a block get their own block,
+            // the rest of the current block is still used for small ones
+            if(uAligned>m_uNextBlockSize/2)
+                return AllocBlock(uAligned);
+
+            char* pBlock = (char*)AllocBlock(m_uNextBlockSize);
+            if(pBlock==NULL)
+                return NULL;
+            m_pCur = pBlock;
+            m_uLeft = m_uNextBlockSize;
+            if(m_uNextBlockSize<STRING_ARENA_MAX_BLOCK_SIZE)
+                m_uNextBlockSize *= 2;
+        }
+
+        m_pLast = m_pCur;
+        m_pCur += uAligned;
+        m_uLeft -= uAligned;
+        return m_pLast;
+    }
+
+    // Shrinks the last allocation to uSize bytes, so the rest can be reused.
+    void Shrink(void* p, size_t uSize)
+    {
+        if(p==NULL || p!=m_pLast)
+            return;
+
+        size_t uAligned = (uSize+7)&~(size_t)7;
+        size_t uOld = m_pCur-m_pLast;
+        if(uAligned<uOld)
+        {
+            m_pCur = m_pLast+uAligned;
+            m_uLeft += uOld-uAligned;
+        }
+    }
+
+    // Releases all memory.
+    void Free()
+    {
+        while(m_pBlocks!=NULL)
+        {
+            Block* pNext = m_pBlocks->m_pNext;
+            free(m_pBlocks);
+            m_pBlocks = pNext;
+        }
+        m_uNextBlockSize = STRING_ARENA_BLOCK_SIZE;
+        Reset();
+    }
+
+private:
+
+    // Header of a heap block.
+    struct Block
+    {
+        Block* m_pNext;
+        double m_Align; // Keeps block data aligned
+    };
+
+    // Starts allocating from the inline storage.
+    void Reset()
+    {
+        m_pCur = m_Inline.m_Data;
+        m_uLeft = sizeof(m_Inline.m_Data);
+        m_pLast = NULL;
+    }
+
+    // Allocates a heap block and returns its data.
+    void* AllocBlock(size_t uSize)
+    {
+        Block* pBlock = (Block*)malloc(sizeof(Block)+uSize);
+        if(pBlock==NULL)
+            return NULL;
+        pBlock->m_pNext = m_pBlocks;
+        m_pBlocks = pBlock;
+        return pBlock+1;
+    }
+
+    // No copying.
+    CStringArena(const CStringArena&);
+    CStringArena& operator=(const CStringArena&);
+
+    union
+    {
+        char m_Data[STRING_ARENA_INLINE_SIZE];
+        double m_Align;
+    } m_Inline;                // Inline storage.
+    char* m_pCur;              // Next free byte.
+    size_t m_uLeft;            // Count of free bytes after m_pCur.
+    char* m_pLast;             // The last allocation (may be shrunk).
+    Block* m_pBlocks;          // List of heap blocks.
+    size_t m_uNextBlockSize;   // Size of the next heap block.
+};
+
+// Returns true if the first cch characters are 7-bit ASCII.
+inline bool str_is_ascii(const char* pStr, size_t cch)
+{
+    size_t i = 0;
+
+    // Check 8 characters at once
+    for(; i+8<=cch; i+=8)
+    {
+        unsigned long long u;
+        memcpy(&u, pStr+i, 8);
+        if(u&0x8080808080808080ull)
+            return false;
+    }
+
+    for(; i<cch; i++)
+    {
+        if(pStr[i]&0x80)
+            return false;
+    }
+
+    return true;
+}
+
+// Returns true if the first cch characters are 7-bit ASCII.
+inline bool str_is_ascii(const wchar_t* pStr, size_t cch)
+{
+    size_t i;
+    for(i=0; i<cch; i++)
+    {
+        if((unsigned)pStr[i]>=0x80)
+            return false;
+    }
+    return true;
+}
+
+// Converts cch bytes of UTF-8 text to UTF-16 (pDst must have room for cch characters).
+// Invalid bytes are replaced with U+FFFD, as MultiByteToWideChar does. Returns the count
+// of characters written; no zero terminator is added.
+inline size_t utf8_to_utf16(const char* pSrc, size_t cch, wchar_t* pDst)
+{
+    const unsigned char* p = (const unsigned char*)pSrc;
+    size_t i = 0;
+    size_t n = 0;
+
+    while(i<cch)
+    {
+        unsigned c = p[i];
+        if(c<0x80)
+        {
+            pDst[n++] = (wchar_t)c;
+            i++;
+            continue;
+        }
+
+        int nTrail = c>=0xC2 && c<0xE0 ? 1 : c>=0xE0 && c<0xF0 ? 2 : c>=0xF0 && c<0xF5 ? 3 : 0;
+        unsigned cp = c&(0x3F>>nTrail);
+        int j;
+        for(j=1; j<=nTrail; j++)
+        {
+            if(i+j>=cch || (p[i+j]&0xC0)!=0x80)
+                break;
+            cp = cp<<6 | (p[i+j]&0x3F);
+        }
+
+        if(nTrail==0 || j<=nTrail || (nTrail==2 && (cp<0x800 || (cp>=0xD800 && cp<0xE000))) ||
+            (nTrail==3 && (cp<0x10000 || cp>0x10FFFF)))
+        {
+            pDst[n++] = (wchar_t)0xFFFD;
+            i++;
+            continue;
+        }
+
+        if(cp>=0x10000)
+        {
+            cp -= 0x10000;
+            pDst[n++] = (wchar_t)(0xD800+(cp>>10));
+            pDst[n++] = (wchar_t)(0xDC00+(cp&0x3FF));
+        }
+        else
+            pDst[n++] = (wchar_t)cp;
+
+        i += nTrail+1;
+    }
+
+    return n;
+}
+
+// Converts cch characters of UTF-16 text to UTF-8 (pDst must have room for 3*cch bytes).
+// Unpaired surrogates are replaced with U+FFFD, as WideCharToMultiByte does. Returns the count
+// of bytes written; no zero terminator is added.
+inline size_t utf16_to_utf8(const wchar_t* pSrc, size_t cch, char* pDst)
+{
+    unsigned char* p = (unsigned char*)pDst;
+    size_t i;
+    size_t n = 0;
+
+    for(i=0; i<cch; i++)
+    {
+        unsigned c = (unsigned)pSrc[i]&0xFFFF;
+        if(c<0x80)
+        {
+            p[n++] = (unsigned char)c;
+        }
+        else if(c<0x800)
+        {
+            p[n++] = (unsigned char)(0xC0|(c>>6));
+            p[n++] = (unsigned char)(0x80|(c&0x3F));
+        }
+        else
+        {
+            if(c>=0xD800 && c<0xE000)
+            {
+                unsigned c2 = i+1<cch ? (unsigned)pSrc[i+1]&0xFFFF : 0;
+                if(c<0xDC00 && c2>=0xDC00 && c2<0xE000)
+                {
+                    unsigned cp = 0x10000+((c-0xD800)<<10)+(c2-0xDC00);
+                    p[n++] = (unsigned char)(0xF0|(cp>>18));
+                    p[n++] = (unsigned char)(0x80|((cp>>12)&0x3F));
+                    p[n++] = (unsigned char)(0x80|((cp>>6)&0x3F));
+                    p[n++] = (unsigned char)(0x80|(cp&0x3F));
+                    i++;
+                    continue;
+                }
+                c = 0xFFFD;
+            }
+
+            p[n++] = (unsigned char)(0xE0|(c>>12));
+            p[n++] = (unsigned char)(0x80|((c>>6)&0x3F));
+            p[n++] = (unsigned char)(0x80|(c&0x3F));
+        }
+    }
+
+    return n;
+}
+
+#endif //_STRINGARENA_H
@@ -17,60 +17,102 @@ be found in the Authors.txt file in the root of the source tree.
 #define _STRCONV_H
 
 #include "Prefastdef.h"
-#include <vector>
+#include "StringArena.h"
 
+// Converts strings between ANSI, UNICODE and UTF-8. Converted strings are kept
+// in a bump arena and stay valid until the object is destroyed. Functions taking
+// a length (cch=-1 means zero-terminated string) also return the length of
+// the result (in characters, without the zero terminator) if asked.
 class strconv_t
 {
 public:
-    strconv_t(){}
-    ~strconv_t()
+    strconv_t()
     {
-        unsigned i;
-        for(i=0; i<m_ConvertedStrings.size(); i++)
-        {
-            delete [] m_ConvertedStrings[i];
-        }
+        m_nMaxCharSize = 0;
     }
 
     LPCWSTR a2w(__in_opt LPCSTR lpsz)
+    {
+        return a2w(lpsz, -1);
+    }
+
+    LPCWSTR a2w(__in_opt LPCSTR lpsz, int cch, int* pcchResult=NULL)
     {
         if(lpsz==NULL)
             return NULL;
 
-        int count = MultiByteToWideChar(CP_ACP, MB_PRECOMPOSED, lpsz, -1, NULL, 0);
-        if(count==0)
+        size_t uLen = cch<0 ? strlen(lpsz) : cch;
+        LPWSTR pBuffer = (LPWSTR)m_Arena.Alloc((uLen+1)*sizeof(WCHAR));
+        if(pBuffer==NULL)
             return NULL;
 
-        void* pBuffer = (void*) new wchar_t[count];
-        int result = MultiByteToWideChar(CP_ACP, MB_PRECOMPOSED, lpsz, -1, (LPWSTR)pBuffer, count);
-        if(result==0)
+        size_t uResult = uLen;
+        if(str_is_ascii(lpsz, uLen))
         {
-            delete [] pBuffer;
-            return NULL;
+            size_t i;
+            for(i=0; i<uLen; i++)
+                pBuffer[i] = (WCHAR)lpsz[i];
+        }
+        else
+        {
+            // Each byte gives at most one wide character, so there is no need to ask for size
+            uResult = MultiByteToWideChar(CP_ACP, MB_PRECOMPOSED, lpsz, (int)uLen, pBuffer, (int)uLen);
+            if(uResult==0)
+                return NULL;
+            m_Arena.Shrink(pBuffer, (uResult+1)*sizeof(WCHAR));
         }
 
-        m_ConvertedStrings.push_back(pBuffer);
+        pBuffer[uResult] = 0;
+        if(pcchResult!=NULL)
+            *pcchResult = (int)uResult;
         return (LPCWSTR)pBuffer;
     }
 
     LPCSTR w2a(__in_opt LPCWSTR lpsz)
+    {
+        return w2a(lpsz, -1);
+    }
+
+    LPCSTR w2a(__in_opt LPCWSTR lpsz, int cch, int* pcchResult=NULL)
     {
         if(lpsz==NULL)
             return NULL;
 
-        int count = WideCharToMultiByte(CP_ACP, 0, lpsz, -1, NULL, 0, NULL, NULL);
-        if(count==0)
-            return NULL;
+        size_t uLen = cch<0 ? wcslen(lpsz) : cch;
+        size_t uResult = uLen;
+        LPSTR pBuffer = NULL;
 
-        void* pBuffer = (void*) new char[count];
-        int result = WideCharToMultiByte(CP_ACP, 0, lpsz, -1, (LPSTR)pBuffer, count, NULL, NULL);
-        if(result==0)
+        if(str_is_ascii(lpsz, uLen))
         {
-            delete [] pBuffer;
-            return NULL;
+            pBuffer = (LPSTR)m_Arena.Alloc(uLen+1);
+            if(pBuffer==NULL)
+                return NULL;
+            size_t i;
+            for(i=0; i<uLen; i++)
+                pBuffer[i] = (char)lpsz[i];
+        }
+        else
+        {
+            // Allocate for the longest character of the code page
+            if(m_nMaxCharSize==0)
+            {
+                CPINFO cpi;
+                m_nMaxCharSize = GetCPInfo(CP_ACP, &cpi) ? cpi.MaxCharSize : 4;
+            }
+
+            size_t uSize = uLen*m_nMaxCharSize;
+            pBuffer = (LPSTR)m_Arena.Alloc(uSize+1);
+            if(pBuffer==NULL)
+                return NULL;
+            uResult = WideCharToMultiByte(CP_ACP, 0, lpsz, (int)uLen, pBuffer, (int)uSize, NULL, NULL);
+            if(uResult==0)
+                return NULL;
+            m_Arena.Shrink(pBuffer, uResult+1);
         }
 
-        m_ConvertedStrings.push_back(pBuffer);
+        pBuffer[uResult] = 0;
+        if(pcchResult!=NULL)
+            *pcchResult = (int)uResult;
         return (LPCSTR)pBuffer;
     }
 
@@ -80,7 +122,10 @@ public:
         if(lpsz==NULL)
             return NULL;
 
-        WCHAR* pBuffer = new WCHAR[cch+1];
+        WCHAR* pBuffer = (WCHAR*)m_Arena.Alloc((cch+1)*sizeof(WCHAR));
+        if(pBuffer==NULL)
+            return NULL;
+
         UINT i;
         for(i=0; i<cch; i++)
         {
@@ -90,7 +135,6 @@ public:
 
         pBuffer[cch] = 0; // Zero terminator
 
-        m_ConvertedStrings.push_back((void*)pBuffer);
         return (LPCWSTR)pBuffer;
     }
 
@@ -99,113 +143,90 @@ public:
         if(lpsz==NULL)
             return NULL;
 
-        // 1. Convert input ANSI string to widechar using
-        // MultiByteToWideChar(CP_ACP, ...) function (CP_ACP
-        // is current Windows system Ansi code page)
-
-        // Calculate required buffer size
-        int count = MultiByteToWideChar(CP_ACP, MB_PRECOMPOSED, lpsz, -1, NULL, 0);
-        if(count==0)
-            return NULL;
-
-        // Convert ANSI->UNICODE
-        wchar_t* pBuffer = new wchar_t[count];
-        int result = MultiByteToWideChar(CP_ACP, MB_PRECOMPOSED, lpsz, -1, (LPWSTR)pBuffer, count);
-        if(result==0)
+        // ASCII text is the same in UTF-8
+        size_t uLen = strlen(lpsz);
+        if(str_is_ascii(lpsz, uLen))
         {
-            delete [] pBuffer;
-            return NULL;
+            LPSTR pBuffer = (LPSTR)m_Arena.Alloc(uLen+1);
+            if(pBuffer!=NULL)
+                memcpy(pBuffer, lpsz, uLen+1);
+            return pBuffer;
         }
 
-        // 2. Convert output widechar string from previous call to
-        // UTF-8 using WideCharToMultiByte(CP_UTF8, ...)  function
-
-        LPCSTR pszResult = (LPCSTR)w2utf8(pBuffer);
-        delete [] pBuffer;
-        return pszResult;
+        // Convert ANSI->UNICODE->UTF-8
+        int cchW = 0;
+        LPCWSTR pszW = a2w(lpsz, (int)uLen, &cchW);
+        return w2utf8(pszW, cchW);
     }
 
     LPCSTR w2utf8(__in_opt LPCWSTR lpsz)
+    {
+        return w2utf8(lpsz, -1);
+    }
+
+    LPCSTR w2utf8(__in_opt LPCWSTR lpsz, int cch, int* pcchResult=NULL)
     {
         if(lpsz==NULL)
             return NULL;
 
-        // Calculate required buffer size
-        int count = WideCharToMultiByte(CP_UTF8, 0, lpsz, -1, NULL, 0, NULL, NULL);
-        if(count==0)
-        {
+        // Each wide character gives at most 3 bytes
+        size_t uLen = cch<0 ? wcslen(lpsz) : cch;
+        LPSTR pBuffer = (LPSTR)m_Arena.Alloc(uLen*3+1);
+        if(pBuffer==NULL)
             return NULL;
-        }
 
-        // Convert UNICODE->UTF8
-        LPSTR pBuffer = new char[count];
-        int result = WideCharToMultiByte(CP_UTF8, 0, lpsz, -1, (LPSTR)pBuffer, count, NULL, NULL);
-        if(result==0)
-        {
-            delete [] pBuffer;
-            return NULL;
-        }
+        size_t uResult = utf16_to_utf8(lpsz, uLen, pBuffer);
+        pBuffer[uResult] = 0;
+        m_Arena.Shrink(pBuffer, uResult+1);
 
-        m_ConvertedStrings.push_back(pBuffer);
+        if(pcchResult!=NULL)
+            *pcchResult = (int)uResult;
         return (LPCSTR)pBuffer;
     }
 
     LPCWSTR utf82w(__in_opt LPCSTR lpsz)
     {
-        if(lpsz==NULL)
-            return NULL;
-
-        // Calculate required buffer size
-        int count = MultiByteToWideChar(CP_UTF8, 0, lpsz, -1, NULL, 0);
-        if(count==0)
-        {
-            return NULL;
-        }
-
-        // Convert UNICODE->UTF8
-        LPWSTR pBuffer = new wchar_t[count];
-        int result = MultiByteToWideChar(CP_UTF8, 0, lpsz, -1, (LPWSTR)pBuffer, count);
-        if(result==0)
-        {
-            delete [] pBuffer;
-            return NULL;
-        }
-
-        m_ConvertedStrings.push_back(pBuffer);
-        return (LPCWSTR)pBuffer;
+        return utf82w(lpsz, (UINT)-1);
     }
 
-    LPCWSTR utf82w(__in_opt LPCSTR pStr, UINT cch)
+    LPCWSTR utf82w(__in_opt LPCSTR pStr, UINT cch, int* pcchResult=NULL)
     {
         if(pStr==NULL)
             return NULL;
 
-        // Calculate required buffer size
-        int count = MultiByteToWideChar(CP_UTF8, 0, pStr, cch, NULL, 0);
-        if(count==0)
-        {
-            return NULL;
-        }
-
-        // Convert UNICODE->UTF8
-        LPWSTR pBuffer = new wchar_t[count+1];
-        int result = MultiByteToWideChar(CP_UTF8, 0, pStr, cch, (LPWSTR)pBuffer, count);
-        if(result==0)
-        {
-            delete [] pBuffer;
+        // Each byte gives at most one wide character
+        size_t uLen = cch==(UINT)-1 ? strlen(pStr) : cch;
+        LPWSTR pBuffer = (LPWSTR)m_Arena.Alloc((uLen+1)*sizeof(WCHAR));
+        if(pBuffer==NULL)
             return NULL;
-        }
 
-        // Zero-terminate
-        pBuffer[count]=0;
+        size_t uResult = utf8_to_utf16(pStr, uLen, pBuffer);
+        pBuffer[uResult] = 0;
+        m_Arena.Shrink(pBuffer, (uResult+1)*sizeof(WCHAR));
 
-        m_ConvertedStrings.push_back(pBuffer);
+        if(pcchResult!=NULL)
+            *pcchResult = (int)uResult;
         return (LPCWSTR)pBuffer;
     }
 
     LPCSTR utf82a(__in_opt LPCSTR lpsz)
     {
-        return w2a(utf82w(lpsz));
+        if(lpsz==NULL)
+            return NULL;
+
+        // ASCII text is the same in UTF-8
+        size_t uLen = strlen(lpsz);
+        if(str_is_ascii(lpsz, uLen))
+        {
+            LPSTR pBuffer = (LPSTR)m_Arena.Alloc(uLen+1);
+            if(pBuffer!=NULL)
+                memcpy(pBuffer, lpsz, uLen+1);
+            return pBuffer;
+        }
+
+        int cchW = 0;
+        LPCWSTR pszW = utf82w(lpsz, (UINT)uLen, &cchW);
+        return w2a(pszW, cchW);
     }
 
     LPCTSTR utf82t(__in_opt LPCSTR lpsz)
@@ -217,6 +238,17 @@ public:
 #endif
     }
 
+    LPCTSTR utf82t(__in_opt LPCSTR pStr, UINT cch, int* pcchResult=NULL)
+    {
+#ifdef UNICODE
+        return utf82w(pStr, cch, pcchResult);
+#else
+        int cchW = 0;
+        LPCWSTR pszW = utf82w(pStr, cch, &cchW);
+        return w2a(pszW, cchW, pcchResult);
+#endif
+    }
+
     LPCSTR t2a(__in_opt LPCTSTR lpsz)
     {
 #ifdef UNICODE
@@ -226,6 +258,17 @@ public:
 #endif
     }
 
+    LPCSTR t2a(__in_opt LPCTSTR lpsz, int cch, int* pcchResult=NULL)
+    {
+#ifdef UNICODE
+        return w2a(lpsz, cch, pcchResult);
+#else
+        if(pcchResult!=NULL && lpsz!=NULL)
+            *pcchResult = cch<0 ? (int)strlen(lpsz) : cch;
+        return lpsz;
+#endif
+    }
+
     LPCWSTR t2w(__in_opt LPCTSTR lpsz)
     {
 #ifdef UNICODE
@@ -262,10 +305,20 @@ public:
 #endif
     }
 
+    LPCSTR t2utf8(__in_opt LPCTSTR lpsz, int cch, int* pcchResult=NULL)
+    {
+#ifdef UNICODE
+        return w2utf8(lpsz, cch, pcchResult);
+#else
+        int cchW = 0;
+        LPCWSTR pszW = a2w(lpsz, cch, &cchW);
+        return w2utf8(pszW, cchW, pcchResult);
+#endif
+    }
+
 private:
-    std::vector<void*> m_ConvertedStrings;
+    CStringArena m_Arena; // Storage of converted strings.
+    UINT m_nMaxCharSize;  // Maximum size of ANSI code page character, in bytes.
 };
 
 #endif  //_STRCONV_H
-
-
@@ -0,0 +1,286 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+#include "stdafx.h"
+#include "BlobStore.h"
+#include "FileIO.h"
+#include "Utility.h"
+#include "Hash.h"
+
+// Temporary files older than this (in 100-ns units) are left over by crashed
+// CrashSender processes and are removed by the garbage collector.
+#define BLOB_STALE_TMP_AGE (24*60*60*10000000ULL)
+
+CBlobStore::CBlobStore()
+{
+}
+
+BOOL CBlobStore::Init(LPCTSTR szUnsentCrashReportsFolder)
+{
+    CString sFolder = szUnsentCrashReportsFolder;
+    sFolder += _T("\\Blobs");
+
+    if(!Utility::CreateFolder(sFolder))
+        return FALSE;
+
+    m_sFolder = sFolder;
+    return TRUE;
+}
+
+BOOL CBlobStore::IsInitialized()
+{
+    return !m_sFolder.IsEmpty();
+}
+
+BOOL CBlobStore::CopyAndHash(LPCTSTR szSrcFile, LPCTSTR szTmpFile, CString& sBlobName,
+                             AssyncNotification* pAssync, CString& sErrorMsg)
+{
+    BOOL bStatus = FALSE;
+    CFileReader reader;
+    HANDLE hDstFile = INVALID_HANDLE_VALUE;
+    CFastHash hash;
+    unsigned long long uHash[2];
+    ULONG64 uFileSize = 0;
+    ULONG64 uTotalWritten = 0;
+
+    if(!reader.Open(szSrcFile))
+    {
+        sErrorMsg = Utility::FormatErrorMsg(GetLastError());
+        goto cleanup;
+    }
+
+    uFileSize = reader.GetSize();
+
+    hDstFile = CreateFile(szTmpFile, GENERIC_WRITE, 0, NULL,
+        CREATE_ALWAYS, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if(hDstFile==INVALID_HANDLE_VALUE)
+    {
+        sErrorMsg = Utility::FormatErrorMsg(GetLastError());
+        goto cleanup;
+    }
+
+    hash.Init(0, true);
+
+    // Hash the data on its way to the temporary file, so the source is read only once.
+    for(;;)
+    {
+        if(pAssync!=NULL && pAssync->IsCancelled())
+        {
+            sErrorMsg = _T("Cancelled by user.");
+            goto cleanup;
+        }
+
+        const BYTE* pData = NULL;
+        DWORD dwBytesRead = 0;
+        if(!reader.Read(pData, dwBytesRead))
+        {
+            sErrorMsg = Utility::FormatErrorMsg(GetLastError());
+            goto cleanup;
+        }
+
+        if(dwBytesRead==0)
+            break;
+
+        hash.Update(pData, dwBytesRead);
+
+        DWORD dwBytesWritten = 0;
+        if(!WriteFile(hDstFile, pData, dwBytesRead, &dwBytesWritten, NULL) ||
+            dwBytesWritten!=dwBytesRead)
+        {
+            sErrorMsg = Utility::FormatErrorMsg(GetLastError());
+            goto cleanup;
+        }
+
+        uTotalWritten += dwBytesWritten;
+        if(pAssync!=NULL && uFileSize!=0)
+        {
+            ULONG64 uProgress = uTotalWritten<uFileSize ? uTotalWritten : uFileSize;
+            pAssync->SetProgress((int)(100*uProgress/uFileSize), false);
+        }
+    }
+
+    hash.Final128(uHash);
+
+    // Blob name is the content hash followed by the content size.
+    sBlobName.Format(_T("%016I64x%016I64x-%I64x"), uHash[0], uHash[1], uTotalWritten);
+
+    bStatus = TRUE;
+
+cleanup:
+
+    if(hDstFile!=INVALID_HANDLE_VALUE)
+        CloseHandle(hDstFile);
+
+    if(!bStatus)
+        DeleteFile(szTmpFile);
+
+    return bStatus;
+}
+
+BOOL CBlobStore::SameContent(LPCTSTR szFile1, LPCTSTR szFile2)
+{
+    CFileReader reader1;
+    CFileReader reader2;
+    const BYTE* pData1 = NULL;
+    const BYTE* pData2 = NULL;
+    DWORD dwLength1 = 0;
+    DWORD dwLength2 = 0;
+
+    if(!reader1.Open(szFile1) || !reader2.Open(szFile2))
+        return FALSE;
+
+    if(reader1.GetSize()!=reader2.GetSize())
+        return FALSE;
+
+    // The readers return portions of different lengths, so compare
+    // the overlapping part and refill whichever side runs out first.
+    for(;;)
+    {
+        if(dwLength1==0 && !reader1.Read(pData1, dwLength1))
+            return FALSE;
+        if(dwLength2==0 && !reader2.Read(pData2, dwLength2))
+            return FALSE;
+
+        if(dwLength1==0 || dwLength2==0)
+            return dwLength1==dwLength2;
+
+        DWORD dwCompare = dwLength1<dwLength2 ? dwLength1 : dwLength2;
+        if(memcmp(pData1, pData2, dwCompare)!=0)
+            return FALSE;
+
+        pData1 += dwCompare;
+        pData2 += dwCompare;
+        dwLength1 -= dwCompare;
+        dwLength2 -= dwCompare;
+    }
+}
+
+BOOL CBlobStore::AddFile(LPCTSTR szSrcFile, LPCTSTR szDstFile,
+                         AssyncNotification* pAssync, CString& sErrorMsg)
+{
+    sErrorMsg.Empty();
+
+    if(!IsInitialized())
+    {
+        sErrorMsg = _T("Blob store is not initialized.");
+        return FALSE;
+    }
+
+    CString sGUID;
+    Utility::GenerateGUID(sGUID);
+    CString sTmpFile = m_sFolder + _T("\\~") + sGUID + _T(".tmp");
+
+    CString sBlobName;
+    if(!CopyAndHash(szSrcFile, sTmpFile, sBlobName, pAssync, sErrorMsg))
+        return FALSE;
+
+    CString sBlobFile = m_sFolder + _T("\\") + sBlobName;
+
+    DeleteFile(szDstFile);
+
+    // If there is such blob already, just reference it. This may fail if another
+    // CrashSender has just garbage-collected the blob; then store our copy instead.
+    // The name is only a fast hash, so the content is compared before linking.
+    BOOL bHashCollision = FALSE;
+    if(GetFileAttributes(sBlobFile)!=INVALID_FILE_ATTRIBUTES)
+    {
+        if(SameContent(sTmpFile, sBlobFile))
+        {
+            if(CreateHardLink(szDstFile, sBlobFile, NULL))
+            {
+                DeleteFile(sTmpFile);
+                return TRUE;
+            }
+        }
+        else
+        {
+            bHashCollision = TRUE;
+        }
+    }
+
+    // Reference the new blob before publishing it under its hash name, so
+    // the garbage collector never sees it unreferenced.
+    if(!CreateHardLink(szDstFile, sTmpFile, NULL))
+    {
+        // The file system doesn't support hard links, use a plain copy.
+        if(!MoveFileEx(sTmpFile, szDstFile, MOVEFILE_REPLACE_EXISTING|MOVEFILE_COPY_ALLOWED))
+        {
+            sErrorMsg = Utility::FormatErrorMsg(GetLastError());
+            DeleteFile(sTmpFile);
+            return FALSE;
+        }
+
+        return TRUE;
+    }
+
+    // A blob with the same name but different content keeps its name; our copy
+    // stays referenced by the report only, as below.
+    if(bHashCollision || !MoveFile(sTmpFile, sBlobFile))
+    {
+        // Someone has published the same blob meanwhile. Our copy stays referenced
+        // by the report only and goes away together with the report.
+        DeleteFile(sTmpFile);
+    }
+
+    return TRUE;
+}
+
+int CBlobStore::CollectGarbage()
+{
+    if(!IsInitialized())
+        return 0;
+
+    int nRemoved = 0;
+
+    FILETIME ftNow;
+    GetSystemTimeAsFileTime(&ftNow);
+    ULONG64 uNow = ((ULONG64)ftNow.dwHighDateTime<<32)|ftNow.dwLowDateTime;
+
+    WIN32_FIND_DATA ffd;
+    HANDLE hFind = FindFirstFile(m_sFolder + _T("\\*"), &ffd);
+    if(hFind==INVALID_HANDLE_VALUE)
+        return 0;
+
+    do
+    {
+        if((ffd.dwFileAttributes&FILE_ATTRIBUTE_DIRECTORY)!=0)
+            continue;
+
+        CString sFile = m_sFolder + _T("\\") + ffd.cFileName;
+
+        if(ffd.cFileName[0]==_T('~'))
+        {
+            // Temporary file - remove it only if it was abandoned long ago.
+            ULONG64 uWriteTime = ((ULONG64)ffd.ftLastWriteTime.dwHighDateTime<<32)|
+                ffd.ftLastWriteTime.dwLowDateTime;
+            if(uNow>uWriteTime && uNow-uWriteTime>BLOB_STALE_TMP_AGE && DeleteFile(sFile))
+                nRemoved++;
+            continue;
+        }
+
+        HANDLE hFile = CreateFile(sFile, FILE_READ_ATTRIBUTES,
+            FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE, NULL, OPEN_EXISTING, 0, NULL);
+        if(hFile==INVALID_HANDLE_VALUE)
+            continue;
+
+        BY_HANDLE_FILE_INFORMATION fi;
+        BOOL bGetInfo = GetFileInformationByHandle(hFile, &fi);
+        CloseHandle(hFile);
+
+        // The only remaining link is the blob itself.
+        if(bGetInfo && fi.nNumberOfLinks<=1 && DeleteFile(sFile))
+            nRemoved++;
+    }
+    while(FindNextFile(hFind, &ffd));
+
+    FindClose(hFind);
+
+    return nRemoved;
+}
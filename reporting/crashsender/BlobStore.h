@@ -0,0 +1,56 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+// File: BlobStore.h
+// Description: Content-addressed store for files attached to queued error reports.
+
+#pragma once
+#include "stdafx.h"
+#include "AssyncNotification.h"
+
+// Stores a single copy of each distinct attached file under the Blobs subfolder
+// of the UnsentCrashReports folder. Blobs are named by the 128-bit fast hash and size of
+// their content. The fast hash isn't collision-resistant, so a blob is reused only
+// after its content has been compared with the new file. Error report folders reference a blob through a hard link, so the
+// file system keeps the reference count: a blob whose link count drops to one
+// is no longer used by any report and can be removed.
+class CBlobStore
+{
+public:
+
+    // Constructor.
+    CBlobStore();
+
+    // Creates the blob folder inside of the given folder.
+    BOOL Init(LPCTSTR szUnsentCrashReportsFolder);
+
+    // Returns TRUE if the store has been initialized.
+    BOOL IsInitialized();
+
+    // Copies the source file into the store (unless a blob with the same content
+    // already exists) and places a reference to the blob at szDstFile.
+    // If the file system doesn't support hard links, szDstFile receives a plain copy.
+    BOOL AddFile(LPCTSTR szSrcFile, LPCTSTR szDstFile,
+        AssyncNotification* pAssync, CString& sErrorMsg);
+
+    // Removes blobs not referenced by any error report. Returns count of removed blobs.
+    int CollectGarbage();
+
+private:
+
+    // Copies the file into a temporary file in the store and calculates its hash.
+    BOOL CopyAndHash(LPCTSTR szSrcFile, LPCTSTR szTmpFile, CString& sBlobName,
+        AssyncNotification* pAssync, CString& sErrorMsg);
+
+    // Returns TRUE if both files have the same size and content.
+    BOOL SameContent(LPCTSTR szFile1, LPCTSTR szFile2);
+
+    CString m_sFolder; // Path to the blob folder.
+};
@@ -0,0 +1,653 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+// File: ColorConv.cpp
+// Description: Conversion of video frames between RGB24 and YV12 color formats.
+
+#include "ColorConv.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define COLORCONV_SIMD
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define COLORCONV_TARGET_SSSE3
+#define COLORCONV_TARGET_AVX2
+#else
+#include <cpuid.h>
+#define COLORCONV_TARGET_SSSE3 __attribute__((target("ssse3")))
+#define COLORCONV_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+static inline
+unsigned char CLAMP(int x)
+{
+   return  (unsigned char)((x > 255) ? 255 : (x < 0) ? 0 : x);
+}
+
+//-----------------------------------------------
+// Scalar conversion
+//-----------------------------------------------
+
+// Converts pixels [nFrom, nTo) of a row to luma.
+static void rgb24_to_y_row_scalar(const unsigned char* pRGBRow, unsigned char* pYRow,
+                                  int nFrom, int nTo)
+{
+    int x;
+    for(x=nFrom; x<nTo; x++)
+    {
+        unsigned char B = pRGBRow[x*3+0];
+        unsigned char G = pRGBRow[x*3+1];
+        unsigned char R = pRGBRow[x*3+2];
+
+        float y = (float)( R*66 + G*129 + B*25 + 128 ) / 256 + 16;
+
+        pYRow[x] = (unsigned char)y;
+    }
+}
+
+// Converts 2x2 blocks [nFrom, nTo) of a row pair to chroma,
+// taking the top-left pixel of each block.
+static void rgb24_to_uv_row_scalar(const unsigned char* pRGBRow, unsigned char* pURow,
+                                   unsigned char* pVRow, int nFrom, int nTo)
+{
+    int x;
+    for(x=nFrom; x<nTo; x++)
+    {
+        unsigned char B = pRGBRow[x*6+0];
+        unsigned char G = pRGBRow[x*6+1];
+        unsigned char R = pRGBRow[x*6+2];
+
+        float u = (float)( R*-38 + G*-74 + B*112 + 128 ) / 256 + 128;
+        float v = (float)( R*112 + G*-94 + B*-18 + 128 ) / 256 + 128;
+
+        pURow[x] = (unsigned char)u;
+        pVRow[x] = (unsigned char)v;
+    }
+}
+
+// Converts pixels [nFrom, nTo) of a row to RGB.
+static void yv12_to_rgb24_row_scalar(unsigned char* pRGBRow, const unsigned char* pYRow,
+                                     const unsigned char* pURow, const unsigned char* pVRow,
+                                     int nFrom, int nTo)
+{
+    int x;
+    for(x=nFrom; x<nTo; x++)
+    {
+        float Y = pYRow[x];
+        float U = pURow[x/2];
+        float V = pVRow[x/2];
+
+        pRGBRow[x*3+0] = CLAMP((int)(1.164*(Y - 16) + 2.018*(U - 128)));
+        pRGBRow[x*3+1] = CLAMP((int)(1.164*(Y - 16) - 0.813*(V - 128) - 0.391*(U - 128)));
+        pRGBRow[x*3+2] = CLAMP((int)(1.164*(Y - 16) + 1.596*(V - 128)));
+    }
+}
+
+#ifdef COLORCONV_SIMD
+
+//-----------------------------------------------
+// Vector conversion
+//
+// RGB to YV12 conversion is done in integer arithmetic. The scalar code computes
+// (n/256 + c) in float, where n is an integer, which is exact, so truncating it
+// gives the same result as (n + 256*c) >> 8.
+//
+// YV12 to RGB conversion is done in double precision, with the same operations
+// in the same order as the scalar code, so the result is the same too.
+//-----------------------------------------------
+
+// Byte shuffle masks moving pixel channels between 3-byte pixels and planes.
+static struct CColorConvMasks
+{
+    CColorConvMasks()
+    {
+        int c, k, i;
+        for(c=0; c<3; c++)
+        {
+            for(k=0; k<3; k++)
+            {
+                for(i=0; i<16; i++)
+                {
+                    int nOffs = i*3 + c - k*16;
+                    m_aGather[c][k][i] = (signed char)((nOffs>=0 && nOffs<16) ? nOffs : 0x80);
+
+                    nOffs = i*6 + c - k*16;
+                    m_aGatherEven[c][k][i] = (signed char)((nOffs>=0 && nOffs<16) ? nOffs : 0x80);
+
+                    int nPos = k*16 + i;
+                    m_aScatter[c][k][i] = (signed char)(nPos%3==c ? nPos/3 : 0x80);
+                }
+            }
+        }
+    }
+
+    // Channel c of 16 pixels from the k-th 16-byte chunk of 48 bytes.
+    signed char m_aGather[3][3][16];
+    // Channel c of 8 even pixels from the k-th 16-byte chunk of 48 bytes.
+    signed char m_aGatherEven[3][3][16];
+    // Channel c of 16 pixels to the k-th 16-byte chunk of 48 bytes.
+    signed char m_aScatter[3][3][16];
+} g_ColorConvMasks;
+
+// Returns a constant of two 16-bit values repeated through the vector.
+COLORCONV_TARGET_SSSE3
+static inline __m128i pair_epi16(short nLo, short nHi)
+{
+    return _mm_set1_epi32((int)(((unsigned int)(unsigned short)nHi<<16) | (unsigned short)nLo));
+}
+
+// Loads 3x3 shuffle masks.
+COLORCONV_TARGET_SSSE3
+static inline void load_masks(__m128i aMask[3][3], const signed char aSrc[3][3][16])
+{
+    int c, k;
+    for(c=0; c<3; c++)
+        for(k=0; k<3; k++)
+            aMask[c][k] = _mm_loadu_si128((const __m128i*)aSrc[c][k]);
+}
+
+// Gathers a channel from 48 bytes of pixels.
+COLORCONV_TARGET_SSSE3
+static inline __m128i gather_channel(__m128i in0, __m128i in1, __m128i in2, const __m128i* pMask)
+{
+    return _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(in0, pMask[0]),
+        _mm_shuffle_epi8(in1, pMask[1])), _mm_shuffle_epi8(in2, pMask[2]));
+}
+
+// Computes (B*kB + G*kG + R*kR + nBias) >> 8 for 16 pixels, saturated to bytes.
+COLORCONV_TARGET_SSSE3
+static inline __m128i weigh_bgr(__m128i B, __m128i G, __m128i R,
+                                __m128i kBG, __m128i kR, __m128i bias)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i aLo[2] = { _mm_unpacklo_epi8(B, zero), _mm_unpacklo_epi8(G, zero) };
+    __m128i aHi[2] = { _mm_unpackhi_epi8(B, zero), _mm_unpackhi_epi8(G, zero) };
+    __m128i RLo = _mm_unpacklo_epi8(R, zero);
+    __m128i RHi = _mm_unpackhi_epi8(R, zero);
+
+    __m128i s0 = _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(aLo[0], aLo[1]), kBG),
+        _mm_madd_epi16(_mm_unpacklo_epi16(RLo, zero), kR));
+    __m128i s1 = _mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(aLo[0], aLo[1]), kBG),
+        _mm_madd_epi16(_mm_unpackhi_epi16(RLo, zero), kR));
+    __m128i s2 = _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(aHi[0], aHi[1]), kBG),
+        _mm_madd_epi16(_mm_unpacklo_epi16(RHi, zero), kR));
+    __m128i s3 = _mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(aHi[0], aHi[1]), kBG),
+        _mm_madd_epi16(_mm_unpackhi_epi16(RHi, zero), kR));
+
+    s0 = _mm_srai_epi32(_mm_add_epi32(s0, bias), 8);
+    s1 = _mm_srai_epi32(_mm_add_epi32(s1, bias), 8);
+    s2 = _mm_srai_epi32(_mm_add_epi32(s2, bias), 8);
+    s3 = _mm_srai_epi32(_mm_add_epi32(s3, bias), 8);
+
+    return _mm_packus_epi16(_mm_packs_epi32(s0, s1), _mm_packs_epi32(s2, s3));
+}
+
+COLORCONV_TARGET_SSSE3
+static void rgb24_to_y_row_ssse3(const unsigned char* pRGBRow, unsigned char* pYRow,
+                                 int nFrom, int nTo)
+{
+    __m128i aMask[3][3];
+    load_masks(aMask, g_ColorConvMasks.m_aGather);
+    const __m128i kBG = pair_epi16(25, 129);
+    const __m128i kR = pair_epi16(66, 0);
+    const __m128i bias = _mm_set1_epi32(128+16*256);
+
+    int x;
+    for(x=nFrom; x+16<=nTo; x+=16)
+    {
+        const unsigned char* p = pRGBRow+x*3;
+        __m128i in0 = _mm_loadu_si128((const __m128i*)p);
+        __m128i in1 = _mm_loadu_si128((const __m128i*)(p+16));
+        __m128i in2 = _mm_loadu_si128((const __m128i*)(p+32));
+
+        __m128i Y = weigh_bgr(gather_channel(in0, in1, in2, aMask[0]),
+            gather_channel(in0, in1, in2, aMask[1]),
+            gather_channel(in0, in1, in2, aMask[2]), kBG, kR, bias);
+
+        _mm_storeu_si128((__m128i*)(pYRow+x), Y);
+    }
+
+    rgb24_to_y_row_scalar(pRGBRow, pYRow, x, nTo);
+}
+
+COLORCONV_TARGET_SSSE3
+static void rgb24_to_uv_row_ssse3(const unsigned char* pRGBRow, unsigned char* pURow,
+                                  unsigned char* pVRow, int nFrom, int nTo)
+{
+    __m128i aMask[3][3];
+    load_masks(aMask, g_ColorConvMasks.m_aGatherEven);
+    const __m128i kBG_U = pair_epi16(112, -74);
+    const __m128i kR_U = pair_epi16(-38, 0);
+    const __m128i kBG_V = pair_epi16(-18, -94);
+    const __m128i kR_V = pair_epi16(112, 0);
+    const __m128i bias = _mm_set1_epi32(128+128*256);
+
+    // 16 pixels give 8 chroma samples
+    int x;
+    for(x=nFrom; x+8<=nTo; x+=8)
+    {
+        const unsigned char* p = pRGBRow+x*6;
+        __m128i in0 = _mm_loadu_si128((const __m128i*)p);
+        __m128i in1 = _mm_loadu_si128((const __m128i*)(p+16));
+        __m128i in2 = _mm_loadu_si128((const __m128i*)(p+32));
+
+        __m128i B = gather_channel(in0, in1, in2, aMask[0]);
+        __m128i G = gather_channel(in0, in1, in2, aMask[1]);
+        __m128i R = gather_channel(in0, in1, in2, aMask[2]);
+
+        _mm_storel_epi64((__m128i*)(pURow+x), weigh_bgr(B, G, R, kBG_U, kR_U, bias));
+        _mm_storel_epi64((__m128i*)(pVRow+x), weigh_bgr(B, G, R, kBG_V, kR_V, bias));
+    }
+
+    rgb24_to_uv_row_scalar(pRGBRow, pURow, pVRow, x, nTo);
+}
+
+// Converts 2 pixels to RGB, returning channel values as 32-bit integers in low half of vectors.
+COLORCONV_TARGET_SSSE3
+static inline void yuv_to_bgr_pd(__m128d Y, __m128d U, __m128d V,
+                                 __m128i& B, __m128i& G, __m128i& R)
+{
+    __m128d a = _mm_mul_pd(_mm_set1_pd(1.164), _mm_sub_pd(Y, _mm_set1_pd(16)));
+    __m128d u = _mm_sub_pd(U, _mm_set1_pd(128));
+    __m128d v = _mm_sub_pd(V, _mm_set1_pd(128));
+
+    B = _mm_cvttpd_epi32(_mm_add_pd(a, _mm_mul_pd(_mm_set1_pd(2.018), u)));
+    G = _mm_cvttpd_epi32(_mm_sub_pd(_mm_sub_pd(a, _mm_mul_pd(_mm_set1_pd(0.813), v)),
+        _mm_mul_pd(_mm_set1_pd(0.391), u)));
+    R = _mm_cvttpd_epi32(_mm_add_pd(a, _mm_mul_pd(_mm_set1_pd(1.596), v)));
+}
+
+// Converts 4 pixels given as 32-bit integers to RGB.
+COLORCONV_TARGET_SSSE3
+static inline void yuv_to_bgr_4(__m128i Y, __m128i U, __m128i V,
+                                __m128i& B, __m128i& G, __m128i& R)
+{
+    __m128i B0, G0, R0, B1, G1, R1;
+    yuv_to_bgr_pd(_mm_cvtepi32_pd(Y), _mm_cvtepi32_pd(U), _mm_cvtepi32_pd(V), B0, G0, R0);
+    yuv_to_bgr_pd(_mm_cvtepi32_pd(_mm_srli_si128(Y, 8)), _mm_cvtepi32_pd(_mm_srli_si128(U, 8)),
+        _mm_cvtepi32_pd(_mm_srli_si128(V, 8)), B1, G1, R1);
+    B = _mm_unpacklo_epi64(B0, B1);
+    G = _mm_unpacklo_epi64(G0, G1);
+    R = _mm_unpacklo_epi64(R0, R1);
+}
+
+// Interleaves 16 bytes of each channel into 48 bytes of pixels.
+COLORCONV_TARGET_SSSE3
+static inline void scatter_bgr(unsigned char* p, __m128i B, __m128i G, __m128i R, __m128i aMask[3][3])
+{
+    int k;
+    for(k=0; k<3; k++)
+    {
+        __m128i out = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(B, aMask[0][k]),
+            _mm_shuffle_epi8(G, aMask[1][k])), _mm_shuffle_epi8(R, aMask[2][k]));
+        _mm_storeu_si128((__m128i*)(p+k*16), out);
+    }
+}
+
+COLORCONV_TARGET_SSSE3
+static void yv12_to_rgb24_row_ssse3(unsigned char* pRGBRow, const unsigned char* pYRow,
+                                    const unsigned char* pURow, const unsigned char* pVRow,
+                                    int nFrom, int nTo)
+{
+    __m128i aMask[3][3];
+    load_masks(aMask, g_ColorConvMasks.m_aScatter);
+    const __m128i zero = _mm_setzero_si128();
+
+    // nFrom is even, so each pair of pixels shares chroma
+    int x;
+    for(x=nFrom; x+16<=nTo; x+=16)
+    {
+        __m128i Y8 = _mm_loadu_si128((const __m128i*)(pYRow+x));
+        __m128i U8 = _mm_loadl_epi64((const __m128i*)(pURow+x/2));
+        __m128i V8 = _mm_loadl_epi64((const __m128i*)(pVRow+x/2));
+        U8 = _mm_unpacklo_epi8(U8, U8);
+        V8 = _mm_unpacklo_epi8(V8, V8);
+
+        __m128i aY[2] = { _mm_unpacklo_epi8(Y8, zero), _mm_unpackhi_epi8(Y8, zero) };
+        __m128i aU[2] = { _mm_unpacklo_epi8(U8, zero), _mm_unpackhi_epi8(U8, zero) };
+        __m128i aV[2] = { _mm_unpacklo_epi8(V8, zero), _mm_unpackhi_epi8(V8, zero) };
+
+        __m128i aB[4], aG[4], aR[4];
+        int i;
+        for(i=0; i<2; i++)
+        {
+            yuv_to_bgr_4(_mm_unpacklo_epi16(aY[i], zero), _mm_unpacklo_epi16(aU[i], zero),
+                _mm_unpacklo_epi16(aV[i], zero), aB[i*2], aG[i*2], aR[i*2]);
+            yuv_to_bgr_4(_mm_unpackhi_epi16(aY[i], zero), _mm_unpackhi_epi16(aU[i], zero),
+                _mm_unpackhi_epi16(aV[i], zero), aB[i*2+1], aG[i*2+1], aR[i*2+1]);
+        }
+
+        // Saturation does the same as CLAMP()
+        __m128i B = _mm_packus_epi16(_mm_packs_epi32(aB[0], aB[1]), _mm_packs_epi32(aB[2], aB[3]));
+        __m128i G = _mm_packus_epi16(_mm_packs_epi32(aG[0], aG[1]), _mm_packs_epi32(aG[2], aG[3]));
+        __m128i R = _mm_packus_epi16(_mm_packs_epi32(aR[0], aR[1]), _mm_packs_epi32(aR[2], aR[3]));
+
+        scatter_bgr(pRGBRow+x*3, B, G, R, aMask);
+    }
+
+    yv12_to_rgb24_row_scalar(pRGBRow, pYRow, pURow, pVRow, x, nTo);
+}
+
+// 256-bit versions process two 128-bit lanes the same way as the 128-bit versions do.
+
+// Loads 48 bytes of pixels to each lane.
+COLORCONV_TARGET_AVX2
+static inline __m256i load_2x128(const unsigned char* p0, const unsigned char* p1)
+{
+    return _mm256_inserti128_si256(_mm256_castsi128_si256(
+        _mm_loadu_si128((const __m128i*)p0)), _mm_loadu_si128((const __m128i*)p1), 1);
+}
+
+COLORCONV_TARGET_AVX2
+static inline __m256i gather_channel_avx2(__m256i in0, __m256i in1, __m256i in2, const __m256i* pMask)
+{
+    return _mm256_or_si256(_mm256_or_si256(_mm256_shuffle_epi8(in0, pMask[0]),
+        _mm256_shuffle_epi8(in1, pMask[1])), _mm256_shuffle_epi8(in2, pMask[2]));
+}
+
+COLORCONV_TARGET_AVX2
+static inline __m256i weigh_bgr_avx2(__m256i B, __m256i G, __m256i R,
+                                     __m256i kBG, __m256i kR, __m256i bias)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i aLo[2] = { _mm256_unpacklo_epi8(B, zero), _mm256_unpacklo_epi8(G, zero) };
+    __m256i aHi[2] = { _mm256_unpackhi_epi8(B, zero), _mm256_unpackhi_epi8(G, zero) };
+    __m256i RLo = _mm256_unpacklo_epi8(R, zero);
+    __m256i RHi = _mm256_unpackhi_epi8(R, zero);
+
+    __m256i s0 = _mm256_add_epi32(_mm256_madd_epi16(_mm256_unpacklo_epi16(aLo[0], aLo[1]), kBG),
+        _mm256_madd_epi16(_mm256_unpacklo_epi16(RLo, zero), kR));
+    __m256i s1 = _mm256_add_epi32(_mm256_madd_epi16(_mm256_unpackhi_epi16(aLo[0], aLo[1]), kBG),
+        _mm256_madd_epi16(_mm256_unpackhi_epi16(RLo, zero), kR));
+    __m256i s2 = _mm256_add_epi32(_mm256_madd_epi16(_mm256_unpacklo_epi16(aHi[0], aHi[1]), kBG),
+        _mm256_madd_epi16(_mm256_unpacklo_epi16(RHi, zero), kR));
+    __m256i s3 = _mm256_add_epi32(_mm256_madd_epi16(_mm256_unpackhi_epi16(aHi[0], aHi[1]), kBG),
+        _mm256_madd_epi16(_mm256_unpackhi_epi16(RHi, zero), kR));
+
+    s0 = _mm256_srai_epi32(_mm256_add_epi32(s0, bias), 8);
+    s1 = _mm256_srai_epi32(_mm256_add_epi32(s1, bias), 8);
+    s2 = _mm256_srai_epi32(_mm256_add_epi32(s2, bias), 8);
+    s3 = _mm256_srai_epi32(_mm256_add_epi32(s3, bias), 8);
+
+    return _mm256_packus_epi16(_mm256_packs_epi32(s0, s1), _mm256_packs_epi32(s2, s3));
+}
+
+COLORCONV_TARGET_AVX2
+static void load_masks_avx2(__m256i aMask[3][3], const signed char aSrc[3][3][16])
+{
+    int c, k;
+    for(c=0; c<3; c++)
+        for(k=0; k<3; k++)
+            aMask[c][k] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)aSrc[c][k]));
+}
+
+COLORCONV_TARGET_AVX2
+static void rgb24_to_y_row_avx2(const unsigned char* pRGBRow, unsigned char* pYRow,
+                                int nFrom, int nTo)
+{
+    __m256i aMask[3][3];
+    load_masks_avx2(aMask, g_ColorConvMasks.m_aGather);
+    const __m256i kBG = _mm256_broadcastsi128_si256(pair_epi16(25, 129));
+    const __m256i kR = _mm256_broadcastsi128_si256(pair_epi16(66, 0));
+    const __m256i bias = _mm256_set1_epi32(128+16*256);
+
+    int x;
+    for(x=nFrom; x+32<=nTo; x+=32)
+    {
+        const unsigned char* p = pRGBRow+x*3;
+        __m256i in0 = load_2x128(p, p+48);
+        __m256i in1 = load_2x128(p+16, p+64);
+        __m256i in2 = load_2x128(p+32, p+80);
+
+        __m256i Y = weigh_bgr_avx2(gather_channel_avx2(in0, in1, in2, aMask[0]),
+            gather_channel_avx2(in0, in1, in2, aMask[1]),
+            gather_channel_avx2(in0, in1, in2, aMask[2]), kBG, kR, bias);
+
+        _mm256_storeu_si256((__m256i*)(pYRow+x), Y);
+    }
+
+    _mm256_zeroupper();
+    rgb24_to_y_row_ssse3(pRGBRow, pYRow, x, nTo);
+}
+
+COLORCONV_TARGET_AVX2
+static void rgb24_to_uv_row_avx2(const unsigned char* pRGBRow, unsigned char* pURow,
+                                 unsigned char* pVRow, int nFrom, int nTo)
+{
+    __m256i aMask[3][3];
+    load_masks_avx2(aMask, g_ColorConvMasks.m_aGatherEven);
+    const __m256i kBG_U = _mm256_broadcastsi128_si256(pair_epi16(112, -74));
+    const __m256i kR_U = _mm256_broadcastsi128_si256(pair_epi16(-38, 0));
+    const __m256i kBG_V = _mm256_broadcastsi128_si256(pair_epi16(-18, -94));
+    const __m256i kR_V = _mm256_broadcastsi128_si256(pair_epi16(112, 0));
+    const __m256i bias = _mm256_set1_epi32(128+128*256);
+
+    // 32 pixels give 16 chroma samples, 8 in the low half of each lane
+    int x;
+    for(x=nFrom; x+16<=nTo; x+=16)
+    {
+        const unsigned char* p = pRGBRow+x*6;
+        __m256i in0 = load_2x128(p, p+48);
+        __m256i in1 = load_2x128(p+16, p+64);
+        __m256i in2 = load_2x128(p+32, p+80);
+
+        __m256i B = gather_channel_avx2(in0, in1, in2, aMask[0]);
+        __m256i G = gather_channel_avx2(in0, in1, in2, aMask[1]);
+        __m256i R = gather_channel_avx2(in0, in1, in2, aMask[2]);
+
+        __m256i U = _mm256_permute4x64_epi64(weigh_bgr_avx2(B, G, R, kBG_U, kR_U, bias), _MM_SHUFFLE(3, 1, 2, 0));
+        __m256i V = _mm256_permute4x64_epi64(weigh_bgr_avx2(B, G, R, kBG_V, kR_V, bias), _MM_SHUFFLE(3, 1, 2, 0));
+
+        _mm_storeu_si128((__m128i*)(pURow+x), _mm256_castsi256_si128(U));
+        _mm_storeu_si128((__m128i*)(pVRow+x), _mm256_castsi256_si128(V));
+    }
+
+    _mm256_zeroupper();
+    rgb24_to_uv_row_ssse3(pRGBRow, pURow, pVRow, x, nTo);
+}
+
+// Converts 4 pixels given as bytes in the low 32 bits of vectors to RGB.
+COLORCONV_TARGET_AVX2
+static inline void yuv_to_bgr_avx2(__m128i Y, __m128i U, __m128i V,
+                                   __m128i& B, __m128i& G, __m128i& R)
+{
+    __m256d a = _mm256_mul_pd(_mm256_set1_pd(1.164),
+        _mm256_sub_pd(_mm256_cvtepi32_pd(_mm_cvtepu8_epi32(Y)), _mm256_set1_pd(16)));
+    __m256d u = _mm256_sub_pd(_mm256_cvtepi32_pd(_mm_cvtepu8_epi32(U)), _mm256_set1_pd(128));
+    __m256d v = _mm256_sub_pd(_mm256_cvtepi32_pd(_mm_cvtepu8_epi32(V)), _mm256_set1_pd(128));
+
+    B = _mm256_cvttpd_epi32(_mm256_add_pd(a, _mm256_mul_pd(_mm256_set1_pd(2.018), u)));
+    G = _mm256_cvttpd_epi32(_mm256_sub_pd(_mm256_sub_pd(a, _mm256_mul_pd(_mm256_set1_pd(0.813), v)),
+        _mm256_mul_pd(_mm256_set1_pd(0.391), u)));
+    R = _mm256_cvttpd_epi32(_mm256_add_pd(a, _mm256_mul_pd(_mm256_set1_pd(1.596), v)));
+}
+
+COLORCONV_TARGET_AVX2
+static void yv12_to_rgb24_row_avx2(unsigned char* pRGBRow, const unsigned char* pYRow,
+                                   const unsigned char* pURow, const unsigned char* pVRow,
+                                   int nFrom, int nTo)
+{
+    __m128i aMask[3][3];
+    load_masks(aMask, g_ColorConvMasks.m_aScatter);
+
+    int x;
+    for(x=nFrom; x+16<=nTo; x+=16)
+    {
+        __m128i Y8 = _mm_loadu_si128((const __m128i*)(pYRow+x));
+        __m128i U8 = _mm_loadl_epi64((const __m128i*)(pURow+x/2));
+        __m128i V8 = _mm_loadl_epi64((const __m128i*)(pVRow+x/2));
+        U8 = _mm_unpacklo_epi8(U8, U8);
+        V8 = _mm_unpacklo_epi8(V8, V8);
+
+        __m128i B0, G0, R0, B1, G1, R1, B2, G2, R2, B3, G3, R3;
+        yuv_to_bgr_avx2(Y8, U8, V8, B0, G0, R0);
+        yuv_to_bgr_avx2(_mm_srli_si128(Y8, 4), _mm_srli_si128(U8, 4), _mm_srli_si128(V8, 4), B1, G1, R1);
+        yuv_to_bgr_avx2(_mm_srli_si128(Y8, 8), _mm_srli_si128(U8, 8), _mm_srli_si128(V8, 8), B2, G2, R2);
+        yuv_to_bgr_avx2(_mm_srli_si128(Y8, 12), _mm_srli_si128(U8, 12), _mm_srli_si128(V8, 12), B3, G3, R3);
+
+        __m128i B = _mm_packus_epi16(_mm_packs_epi32(B0, B1), _mm_packs_epi32(B2, B3));
+        __m128i G = _mm_packus_epi16(_mm_packs_epi32(G0, G1), _mm_packs_epi32(G2, G3));
+        __m128i R = _mm_packus_epi16(_mm_packs_epi32(R0, R1), _mm_packs_epi32(R2, R3));
+
+        scatter_bgr(pRGBRow+x*3, B, G, R, aMask);
+    }
+
+    _mm256_zeroupper();
+    yv12_to_rgb24_row_scalar(pRGBRow, pYRow, pURow, pVRow, x, nTo);
+}
+
+#endif // COLORCONV_SIMD
+
+//-----------------------------------------------
+// Dispatch
+//-----------------------------------------------
+
+static int colorconv_detect_isa()
+{
+    int nIsa = COLORCONV_ISA_SCALAR;
+
+#ifdef COLORCONV_SIMD
+    unsigned int nMaxLeaf, ecx1, ebx7 = 0;
+    unsigned long long xcr0 = 0;
+
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    nMaxLeaf = info[0];
+    __cpuid(info, 1);
+    ecx1 = info[2];
+    if(nMaxLeaf>=7)
+    {
+        __cpuidex(info, 7, 0);
+        ebx7 = info[1];
+    }
+    if(ecx1 & (1<<27)) // OSXSAVE
+        xcr0 = _xgetbv(0);
+#else
+    unsigned int eax, ebx, ecx, edx;
+    nMaxLeaf = __get_cpuid_max(0, NULL);
+    if(!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+        return nIsa;
+    ecx1 = ecx;
+    if(nMaxLeaf>=7)
+    {
+        __cpuid_count(7, 0, eax, ebx, ecx, edx);
+        ebx7 = ebx;
+    }
+    if(ecx1 & (1<<27)) // OSXSAVE
+    {
+        unsigned int lo, hi;
+        __asm__ __volatile__("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+        xcr0 = ((unsigned long long)hi<<32) | lo;
+    }
+#endif
+
+    if(ecx1 & (1<<9))
+        nIsa = COLORCONV_ISA_SSSE3;
+
+    // AVX2 also needs the OS to save YMM registers
+    if((ebx7 & (1<<5)) && (ecx1 & (1<<28)) && (xcr0 & 6)==6)
+        nIsa = COLORCONV_ISA_AVX2;
+#endif
+
+    return nIsa;
+}
+
+static const int g_nBestColorConvIsa = colorconv_detect_isa();
+static int g_nColorConvIsa = g_nBestColorConvIsa;
+
+int colorconv_get_best_isa()
+{
+    return g_nBestColorConvIsa;
+}
+
+int colorconv_get_isa()
+{
+    return g_nColorConvIsa;
+}
+
+int colorconv_set_isa(int nIsa)
+{
+    if(nIsa<COLORCONV_ISA_SCALAR || nIsa>g_nBestColorConvIsa)
+        nIsa = g_nBestColorConvIsa;
+    g_nColorConvIsa = nIsa;
+    return nIsa;
+}
+
+void rgb24_to_yv12(const unsigned char* pRGBData, int nFrameWidth,
+                   int nFrameHeight, int nRGBStride, unsigned char* pFullYPlane,
+                   unsigned char* pDownsampledUPlane, unsigned char* pDownsampledVPlane)
+{
+    int nIsa = g_nColorConvIsa;
+    int halfHeight = nFrameHeight/2;
+    int halfWidth = nFrameWidth/2;
+    int y;
+
+    // Luma of every pixel
+    for(y=0; y<nFrameHeight; y++)
+    {
+        const unsigned char* pRGBRow = pRGBData+y*nRGBStride;
+        unsigned char* pYRow = pFullYPlane+y*nFrameWidth;
+
+#ifdef COLORCONV_SIMD
+        if(nIsa==COLORCONV_ISA_AVX2)
+            rgb24_to_y_row_avx2(pRGBRow, pYRow, 0, nFrameWidth);
+        else if(nIsa==COLORCONV_ISA_SSSE3)
+            rgb24_to_y_row_ssse3(pRGBRow, pYRow, 0, nFrameWidth);
+        else
+#endif
+            rgb24_to_y_row_scalar(pRGBRow, pYRow, 0, nFrameWidth);
+    }
+
+    // Chroma of every 2x2 block
+    for(y=0; y<halfHeight; y++)
+    {
+        const unsigned char* pRGBRow = pRGBData+y*2*nRGBStride;
+        unsigned char* pURow = pDownsampledUPlane+y*halfWidth;
+        unsigned char* pVRow = pDownsampledVPlane+y*halfWidth;
+
+#ifdef COLORCONV_SIMD
+        if(nIsa==COLORCONV_ISA_AVX2)
+            rgb24_to_uv_row_avx2(pRGBRow, pURow, pVRow, 0, halfWidth);
+        else if(nIsa==COLORCONV_ISA_SSSE3)
+            rgb24_to_uv_row_ssse3(pRGBRow, pURow, pVRow, 0, halfWidth);
+        else
+#endif
+            rgb24_to_uv_row_scalar(pRGBRow, pURow, pVRow, 0, halfWidth);
+    }
+}
+
+void yv12_to_rgb24(unsigned char* pRGBData, int nFrameWidth, int nFrameHeight, int nRGBStride,
+                   const unsigned char* pYPlane, int nYStride,
+                   const unsigned char* pUPlane, int nUStride,
+                   const unsigned char* pVPlane, int nVStride)
+{
+    int nIsa = g_nColorConvIsa;
+    int y;
+
+    for(y=0; y<nFrameHeight; y++)
+    {
+        unsigned char* pRGBRow = pRGBData+y*nRGBStride;
+        const unsigned char* pYRow = pYPlane+y*nYStride;
+        const unsigned char* pURow = pUPlane+y/2*nUStride;
+        const unsigned char* pVRow = pVPlane+y/2*nVStride;
+
+#ifdef COLORCONV_SIMD
+        if(nIsa==COLORCONV_ISA_AVX2)
+            yv12_to_rgb24_row_avx2(pRGBRow, pYRow, pURow, pVRow, 0, nFrameWidth);
+        else if(nIsa==COLORCONV_ISA_SSSE3)
+            yv12_to_rgb24_row_ssse3(pRGBRow, pYRow, pURow, pVRow, 0, nFrameWidth);
+        else
+#endif
+            yv12_to_rgb24_row_scalar(pRGBRow, pYRow, pURow, pVRow, 0, nFrameWidth);
+    }
+}
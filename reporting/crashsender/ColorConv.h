@@ -0,0 +1,45 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+// File: ColorConv.h
+// Description: Conversion of video frames between RGB24 and YV12 color formats.
+// Vector versions of conversion routines are selected at run time depending
+// on CPU. They give exactly the same result as the scalar ones.
+// This file doesn't depend on Windows headers, so it can be built and tested anywhere.
+
+#pragma once
+
+// Instruction sets color conversion routines may use.
+#define COLORCONV_ISA_SCALAR    0  // Plain C++ code.
+#define COLORCONV_ISA_SSSE3     1  // SSE2 arithmetic, SSSE3 byte shuffles.
+#define COLORCONV_ISA_AVX2      2  // AVX2.
+
+// Returns the best instruction set supported by CPU and OS.
+int colorconv_get_best_isa();
+
+// Returns the instruction set currently used.
+int colorconv_get_isa();
+
+// Selects the instruction set to use (used by tests and benchmarks). If the CPU
+// doesn't support it, the best supported one is selected. Returns the selected one.
+int colorconv_set_isa(int nIsa);
+
+// Converts an RGB24 image (BGR byte order, as in Windows DIBs) to a YV12 image.
+// Y plane row stride is nFrameWidth, U and V plane row stride is nFrameWidth/2.
+// Chroma is taken from the top-left pixel of each 2x2 block.
+void rgb24_to_yv12(const unsigned char* pRGBData, int nFrameWidth,
+                   int nFrameHeight, int nRGBStride, unsigned char* pFullYPlane,
+                   unsigned char* pDownsampledUPlane, unsigned char* pDownsampledVPlane);
+
+// Converts a YV12 image to an RGB24 image (BGR byte order).
+void yv12_to_rgb24(unsigned char* pRGBData, int nFrameWidth, int nFrameHeight, int nRGBStride,
+                   const unsigned char* pYPlane, int nYStride,
+                   const unsigned char* pUPlane, int nUStride,
+                   const unsigned char* pVPlane, int nVStride);
@@ -18,6 +18,7 @@ be found in the Authors.txt file in the root of the source tree.
 #include "CrashInfoReader.h"
 #include "strconv.h"
 #include "tinyxml.h"
+#include "XmlWriter.h"
 #include "Utility.h"
 #include "SharedMem.h"
 
@@ -69,6 +70,7 @@ CErrorReportInfo::CErrorReportInfo()
     m_dwGuiResources = 0;
     m_dwProcessHandleCount = 0;
     m_uTotalSize = 0;
+    m_bTotalSizeKnown = FALSE;
 	m_dwExceptionAddress = 0;
 	m_dwExceptionModuleBase = 0;
 }
@@ -121,7 +123,13 @@ CString CErrorReportInfo::GetSystemTimeUTC()
 
 ULONG64 CErrorReportInfo::GetTotalSize()
 {
-	m_uTotalSize = CalcUncompressedReportSize();
+	// The size is calculated once, after the file list has been built. Reports
+	// loaded from the queue index come with the size stored in the index.
+	if(!m_bTotalSizeKnown)
+	{
+		m_uTotalSize = CalcUncompressedReportSize();
+		m_bTotalSizeKnown = TRUE;
+	}
 	return m_uTotalSize;
 }
 
@@ -240,6 +248,11 @@ ERIFileItem* CErrorReportInfo::GetFileItemByIndex(int nItem)
 	return NULL;
 }
 
+std::map<CString, ERIFileItem>& CErrorReportInfo::GetFileItems()
+{
+	return m_FileItems;
+}
+
 ERIFileItem* CErrorReportInfo::GetFileItemByName(LPCTSTR szName)
 {
 	return &m_FileItems[szName];
@@ -249,6 +262,7 @@ void CErrorReportInfo::AddFileItem(ERIFileItem* pfi)
 {
 	// Kaneva - Bug Fix - Use Source File Full Path
 	m_FileItems[pfi->m_sSrcFile] = *pfi;
+	m_bTotalSizeKnown = FALSE;
 }
 
 BOOL CErrorReportInfo::DeleteFileItemByIndex(int nItem)
@@ -260,6 +274,7 @@ BOOL CErrorReportInfo::DeleteFileItemByIndex(int nItem)
 		return FALSE;
 
 	m_FileItems.erase(p);
+	m_bTotalSizeKnown = FALSE;
 	return TRUE;
 }
 
@@ -269,6 +284,11 @@ int CErrorReportInfo::GetPropCount()
 	return (int)m_Props.size();
 }
 
+std::map<CString, CString>& CErrorReportInfo::GetProps()
+{
+	return m_Props;
+}
+
 // Method that retrieves a property by zero-based index.
 BOOL CErrorReportInfo::GetPropByIndex(int nItem, CString& sName, CString& sVal)
 {
@@ -400,6 +420,7 @@ CCrashInfoReader::CCrashInfoReader()
 	m_DesiredFrameSize.cx = 0;
 	m_DesiredFrameSize.cy = 0;
 	m_hWndVideoParent = NULL;
+	m_nVideoMaxMemory = 0;
 	m_bClientAppCrashed = FALSE;
 	m_bQueueEnabled = FALSE;
 	m_dwProcessId = 0;
@@ -433,8 +454,6 @@ int CCrashInfoReader::Init(LPCTSTR szFileMappingName)
 	}
 
 	// Unpack crash description from shared memory
-    m_pCrashDesc = (CRASH_DESCRIPTION*)m_SharedMem.CreateView(0, sizeof(CRASH_DESCRIPTION));
-
     int nUnpack = UnpackCrashDescription(eri);
     if(0!=nUnpack)
     {
@@ -450,6 +469,12 @@ int CCrashInfoReader::Init(LPCTSTR szFileMappingName)
 	// Save path to INI file storing settings
     m_sINIFile = m_sUnsentCrashReportsFolder + _T("\\~CrashRpt.ini");
 
+    // Open the store of files shared by queued reports
+    m_BlobStore.Init(m_sUnsentCrashReportsFolder);
+
+    // Open the index of queued reports
+    m_QueueIndex.Init(m_sUnsentCrashReportsFolder);
+
     if(!m_bSendRecentReports) // We should send report immediately
     {
         CollectMiscCrashInfo(eri);
@@ -468,51 +493,93 @@ int CCrashInfoReader::Init(LPCTSTR szFileMappingName)
         if(hEvent!=NULL)
             SetEvent(hEvent);
 
-        // Look for pending error reports and add them to the list
-        CString sSearchPattern = m_sUnsentCrashReportsFolder + _T("\\*");
-        CFindFile find;
-        BOOL bFound = find.FindFile(sSearchPattern);
-        while(bFound)
+        // Read the list of pending error reports from the queue index
+        std::vector<CErrorReportInfo> aIndexed;
+        std::set<CString> aIndexedDirs;
+        if(m_QueueIndex.Load(aIndexed))
         {
-            if(find.IsDirectory() && !find.IsDots()) // Process directories only
+            size_t i;
+            for(i=0; i<aIndexed.size(); i++)
             {
-                CString sErrorReportDirName = m_sUnsentCrashReportsFolder + _T("\\") +
-                    find.GetFileName();
-                CString sFileName = sErrorReportDirName + _T("\\crashrpt.xml");
-                CErrorReportInfo eri2;
-                eri2.m_sErrorReportDirName = sErrorReportDirName;
-				// Read crash description XML from the directory
-                if(0==ParseCrashDescription(sFileName, TRUE, eri2))
-                {
-					// Calculate crash report size
-                    eri2.m_uTotalSize = GetUncompressedReportSize(eri2);
-					// Add report to the list
-                    m_Reports.push_back(eri2);
-                }
+                // Skip reports whose folder has been removed behind our back
+                DWORD dwAttrs = GetFileAttributes(aIndexed[i].m_sErrorReportDirName);
+                if(dwAttrs!=INVALID_FILE_ATTRIBUTES && (dwAttrs&FILE_ATTRIBUTE_DIRECTORY)!=0)
+                    m_Reports.push_back(aIndexed[i]);
+
+                CString sDirName = Utility::GetFileName(aIndexed[i].m_sErrorReportDirName);
+                sDirName.MakeLower();
+                aIndexedDirs.insert(sDirName);
             }
-
-            bFound = find.FindNextFile();
         }
+        else
+        {
+            // There is no index yet (or it is damaged), so rebuild it from report folders
+            m_QueueIndex.Create();
+        }
+
+        // A report may lack its index record, if the sender couldn't append it
+        // (the index was locked for too long, or the sender crashed before that).
+        // Listing folder names is cheap, only the reports missing in the index are read.
+        AddUnindexedReports(aIndexedDirs);
     }
 
 	// Done
     return 0;
 }
 
+void CCrashInfoReader::AddUnindexedReports(const std::set<CString>& aIndexed)
+{
+    // Look for pending error reports and add them to the list
+    CString sSearchPattern = m_sUnsentCrashReportsFolder + _T("\\*");
+    CFindFile find;
+    BOOL bFound = find.FindFile(sSearchPattern);
+    while(bFound)
+    {
+        CString sDirName = find.GetFileName();
+        sDirName.MakeLower();
+
+        if(find.IsDirectory() && !find.IsDots() &&
+            sDirName!=_T("blobs") && sDirName!=_T("logs") && // Process report directories only
+            aIndexed.find(sDirName)==aIndexed.end())
+        {
+            CString sErrorReportDirName = m_sUnsentCrashReportsFolder + _T("\\") +
+                find.GetFileName();
+            CString sFileName = sErrorReportDirName + _T("\\crashrpt.xml");
+            CErrorReportInfo eri;
+            eri.m_sErrorReportDirName = sErrorReportDirName;
+            // Read crash description XML from the directory
+            if(0==ParseCrashDescription(sFileName, TRUE, eri))
+            {
+                // Calculate crash report size
+                eri.m_uTotalSize = GetUncompressedReportSize(eri);
+                eri.m_bTotalSizeKnown = TRUE;
+                // Add report to the list
+                m_Reports.push_back(eri);
+                m_QueueIndex.AddReport(eri);
+            }
+        }
+
+        bFound = find.FindNextFile();
+    }
+}
+
 int CCrashInfoReader::UnpackCrashDescription(CErrorReportInfo& eri)
 {
 	// This method unpacks crash description data from shared memory.
+	// Strings are read in place from the single view of the shared memory.
 
-    if(memcmp(m_pCrashDesc->m_uchMagic, "CRD", 3)!=0)
-        return 1; // Invalid magic word
+    int nInit = m_CrashDesc.Init(m_SharedMem.GetBase(), (size_t)m_SharedMem.GetSize());
+    if(nInit!=0)
+        return nInit; // Invalid magic word, format version or damaged data
 
+    m_pCrashDesc = m_CrashDesc.GetHeader();
     if(m_pCrashDesc->m_dwCrashRptVer!=CRASHRPT_VER)
         return 2; // Invalid CrashRpt version
 
     // Unpack process ID, thread ID and exception pointers address.
     m_dwProcessId = m_pCrashDesc->m_dwProcessId;
     m_dwThreadId = m_pCrashDesc->m_dwThreadId;
-    m_pExInfo = m_pCrashDesc->m_pExceptionPtrs;
+    m_pExInfo = (PEXCEPTION_POINTERS)(ULONG_PTR)m_pCrashDesc->m_pExceptionPtrs;
     m_bSendRecentReports = m_pCrashDesc->m_bSendRecentReports;
     m_nExceptionType = m_pCrashDesc->m_nExceptionType;
     m_dwExceptionCode = m_pCrashDesc->m_dwExceptionCode;
@@ -546,7 +613,7 @@ int CCrashInfoReader::UnpackCrashDescription(CErrorReportInfo& eri)
     m_bAppRestart = (dwInstallFlags&CR_INST_APP_RESTART)!=0;
     m_bGenerateMinidump = (dwInstallFlags&CR_INST_NO_MINIDUMP)==0;
     m_bQueueEnabled = (dwInstallFlags&CR_INST_SEND_QUEUED_REPORTS)!=0;
-    m_MinidumpType = m_pCrashDesc->m_MinidumpType;
+    m_MinidumpType = (MINIDUMP_TYPE)m_pCrashDesc->m_MinidumpType;
     UnpackString(m_pCrashDesc->m_dwRestartCmdLineOffs, m_sRestartCmdLine);
 	m_nRestartTimeout = m_pCrashDesc->m_nRestartTimeout;
     m_nMaxReportsPerDay = m_pCrashDesc->m_nMaxReportsPerDay;
@@ -572,52 +639,48 @@ int CCrashInfoReader::UnpackCrashDescription(CErrorReportInfo& eri)
     m_dwVideoFlags = m_pCrashDesc->m_dwVideoFlags;
 	m_nVideoDuration = m_pCrashDesc->m_nVideoDuration;
 	m_nVideoFrameInterval = m_pCrashDesc->m_nVideoFrameInterval;
-    m_DesiredFrameSize = m_pCrashDesc->m_DesiredFrameSize;
-	m_hWndVideoParent = m_pCrashDesc->m_hWndVideoParent;
+    m_DesiredFrameSize.cx = m_pCrashDesc->m_nDesiredFrameWidth;
+    m_DesiredFrameSize.cy = m_pCrashDesc->m_nDesiredFrameHeight;
+	m_hWndVideoParent = (HWND)(ULONG_PTR)m_pCrashDesc->m_hWndVideoParent;
+	m_nVideoMaxMemory = m_pCrashDesc->m_nVideoMaxMemory;
 	m_bClientAppCrashed = m_pCrashDesc->m_bClientAppCrashed;
 
-    DWORD dwOffs = m_pCrashDesc->m_wSize;
-    while(dwOffs<m_pCrashDesc->m_dwTotalSize)
+    unsigned uOffs = m_pCrashDesc->m_uSize;
+    const GENERIC_HEADER* pHeader = NULL;
+    while((pHeader = m_CrashDesc.GetBlock(uOffs, uOffs))!=NULL)
     {
-        LPBYTE pView = m_SharedMem.CreateView(dwOffs, sizeof(GENERIC_HEADER));
-        GENERIC_HEADER* pHeader = (GENERIC_HEADER*)pView;
+        const FILE_ITEM* pFileItem = (const FILE_ITEM*)CCrashDescReader::CheckBlock(pHeader, "FIL ", sizeof(FILE_ITEM));
+        const CUSTOM_PROP* pProp = (const CUSTOM_PROP*)CCrashDescReader::CheckBlock(pHeader, "CPR ", sizeof(CUSTOM_PROP));
+        const REG_KEY* pKey = (const REG_KEY*)CCrashDescReader::CheckBlock(pHeader, "REG ", sizeof(REG_KEY));
 
-        if(memcmp(pHeader->m_uchMagic, "FIL", 3)==0)
+        if(pFileItem!=NULL)
         {
             // File item entry
-            FILE_ITEM* pFileItem = (FILE_ITEM*)m_SharedMem.CreateView(dwOffs, pHeader->m_wSize);
-
             ERIFileItem fi;
             UnpackString(pFileItem->m_dwSrcFilePathOffs, fi.m_sSrcFile);
             UnpackString(pFileItem->m_dwDstFileNameOffs, fi.m_sDestFile);
             UnpackString(pFileItem->m_dwDescriptionOffs, fi.m_sDesc);
             fi.m_bMakeCopy = pFileItem->m_bMakeCopy;
 			fi.m_bAllowDelete = pFileItem->m_bAllowDelete;
+            fi.m_uMaxTotalSize = pFileItem->m_uMaxTotalSize;
+            fi.m_uMaxFileSize = pFileItem->m_uMaxFileSize;
 
 			// Kaneva - Bug Fix - Use Source File Full Path
             eri.m_FileItems[fi.m_sSrcFile] = fi;
-
-            m_SharedMem.DestroyView((LPBYTE)pFileItem);
         }
-        else if(memcmp(pHeader->m_uchMagic, "CPR",3 )==0)
+        else if(pProp!=NULL)
         {
             // Custom prop entry
-            CUSTOM_PROP* pProp = (CUSTOM_PROP*)m_SharedMem.CreateView(dwOffs, pHeader->m_wSize);
-
             CString sName;
             CString sValue;
             UnpackString(pProp->m_dwNameOffs, sName);
             UnpackString(pProp->m_dwValueOffs, sValue);
 
             eri.m_Props[sName] = sValue;
-
-            m_SharedMem.DestroyView((LPBYTE)pProp);
         }
-        else if(memcmp(pHeader->m_uchMagic, "REG", 3)==0)
+        else if(pKey!=NULL)
         {
             // Reg key entry
-            REG_KEY* pKey = (REG_KEY*)m_SharedMem.CreateView(dwOffs, pHeader->m_wSize);
-
             CString sKeyName;
             ERIRegKey rki;
 			rki.m_bAllowDelete = pKey->m_bAllowDelete!=0;
@@ -625,22 +688,15 @@ int CCrashInfoReader::UnpackCrashDescription(CErrorReportInfo& eri)
 			UnpackString(pKey->m_dwDstFileNameOffs, rki.m_sDstFileName);
 
             eri.m_RegKeys[sKeyName] = rki;
-
-            m_SharedMem.DestroyView((LPBYTE)pKey);
-        }
-        else if(memcmp(pHeader->m_uchMagic, "STR", 3)==0)
-        {
-            // Skip string
-        }
-        else
-        {
-            ATLASSERT(0); // Unknown header
-            return 1;
         }
 
-        dwOffs += pHeader->m_wSize;
+        // Strings and blocks of unknown types are skipped
+    }
 
-        m_SharedMem.DestroyView(pView);
+    if(uOffs!=m_pCrashDesc->m_dwTotalSize)
+    {
+        ATLASSERT(0); // Damaged block
+        return 3;
     }
 
     // Success
@@ -649,20 +705,12 @@ int CCrashInfoReader::UnpackCrashDescription(CErrorReportInfo& eri)
 
 int CCrashInfoReader::UnpackString(DWORD dwOffset, CString& str)
 {
-    STRING_DESC* pStrDesc = (STRING_DESC*)m_SharedMem.CreateView(dwOffset, sizeof(STRING_DESC));
-    if(memcmp(pStrDesc, "STR", 3)!=0)
+    const unsigned short* pStr = NULL;
+    unsigned uLength = 0;
+    if(!m_CrashDesc.GetString(dwOffset, pStr, uLength))
         return 1;
 
-    WORD wLength = pStrDesc->m_wSize;
-    if(wLength<=sizeof(STRING_DESC))
-        return 2;
-
-    WORD wStrLen = wLength-sizeof(STRING_DESC);
-
-    m_SharedMem.DestroyView((LPBYTE)pStrDesc);
-    LPBYTE pStrData = m_SharedMem.CreateView(dwOffset+sizeof(STRING_DESC), wStrLen);
-    str = CString((LPCTSTR)pStrData, wStrLen/sizeof(TCHAR));
-    m_SharedMem.DestroyView(pStrData);
+    str = CString((LPCWSTR)pStr, uLength);
 
     return 0;
 }
@@ -689,6 +737,10 @@ void CCrashInfoReader::DeleteReport(int nIndex)
 
 	// Delete from list
 	m_Reports[nIndex].m_DeliveryStatus = DELETED;
+	m_QueueIndex.RemoveReport(m_Reports[nIndex].m_sCrashGUID);
+
+	// Remove files no other report refers to
+	m_BlobStore.CollectGarbage();
 }
 
 void CCrashInfoReader::DeleteAllReports()
@@ -700,7 +752,11 @@ void CCrashInfoReader::DeleteAllReports()
 		Utility::RecycleFile(m_Reports[i].m_sErrorReportDirName, TRUE);
 
 		m_Reports[i].m_DeliveryStatus = DELETED;
+		m_QueueIndex.RemoveReport(m_Reports[i].m_sCrashGUID);
 	}
+
+	// Remove files no other report refers to
+	m_BlobStore.CollectGarbage();
 }
 
 void CCrashInfoReader::CollectMiscCrashInfo(CErrorReportInfo& eri)
@@ -1079,97 +1135,106 @@ BOOL CCrashInfoReader::UpdateUserInfo(CString sEmail, CString sDesc)
 	return bResult;
 }
 
+// Returns the offset of the last occurrence of a string in data, or -1 if there is none.
+static int FindLast(const char* pData, int nSize, const char* szWhat)
+{
+    int nLen = (int)strlen(szWhat);
+    int i;
+    for(i=nSize-nLen; i>=0; i--)
+    {
+        if(pData[i]==szWhat[0] && memcmp(pData+i, szWhat, nLen)==0)
+            return i;
+    }
+    return -1;
+}
+
 BOOL CCrashInfoReader::AddUserInfoToCrashDescriptionXML(CString sEmail, CString sDesc)
 {
+    BOOL bStatus = FALSE;
     strconv_t strconv;
-
-    TiXmlDocument doc;
-
     CString sFileName = m_Reports[0].m_sErrorReportDirName + _T("\\crashrpt.xml");
+    HANDLE hFile = INVALID_HANDLE_VALUE;
+    LARGE_INTEGER lFileSize;
+    LARGE_INTEGER lPos;
+    std::vector<char> aTail;
+    int nTail = 4096;
+    int nCut = -1;
+    DWORD dwBytesRead = 0;
+    DWORD dwBytesWritten = 0;
+    CXmlWriter xml;
+
+    // The file is not rewritten, only its end after the file list is replaced.
+    // User info written before, if any, is there too.
+    hFile = CreateFile(sFileName, GENERIC_READ|GENERIC_WRITE, FILE_SHARE_READ, NULL,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(hFile==INVALID_HANDLE_VALUE)
+        goto cleanup;
 
-    FILE* f = NULL;
-#if _MSC_VER<1400
-    f = _tfopen(sFileName, _T("rb"));
-#else
-    _tfopen_s(&f, sFileName, _T("rb"));
-#endif
-
-    if(f==NULL)
-        return FALSE;
-
-    bool bLoad = doc.LoadFile(f);
-    fclose(f);
-    if(!bLoad)
-    {
-        return FALSE;
-    }
+    if(!GetFileSizeEx(hFile, &lFileSize))
+        goto cleanup;
 
-    TiXmlNode* root = doc.FirstChild("CrashRpt");
-    if(!root)
+    // Read a bigger piece of the file end only if the user info written before is long
+    for(;;)
     {
-        return FALSE;
-    }
-
-    // Write user e-mail
+        if(nTail>lFileSize.QuadPart)
+            nTail = (int)lFileSize.QuadPart;
+
+        aTail.resize(nTail+1);
+        lPos.QuadPart = lFileSize.QuadPart-nTail;
+        if(!SetFilePointerEx(hFile, lPos, NULL, FILE_BEGIN) ||
+            !ReadFile(hFile, &aTail[0], nTail, &dwBytesRead, NULL) ||
+            dwBytesRead!=(DWORD)nTail)
+            goto cleanup;
+
+        if(FindLast(&aTail[0], nTail, "</CrashRpt>")<0)
+            goto cleanup; // Not a crash description
+
+        int nPos = FindLast(&aTail[0], nTail, "</FileList>");
+        if(nPos>=0)
+            nCut = nPos+11;
+        else
+        {
+            nPos = FindLast(&aTail[0], nTail, "<FileList />");
+            if(nPos>=0)
+                nCut = nPos+12;
+        }
 
-    TiXmlHandle hEmail = NULL;
+        if(nCut>=0)
+            break;
 
-	hEmail = root->FirstChild("UserEmail");
-	if(hEmail.ToElement()==NULL)
-	{
-		hEmail = new TiXmlElement("UserEmail");
-		root->LinkEndChild(hEmail.ToElement());
-	}
+        if(lPos.QuadPart==0 || nTail>=0x10000000)
+            goto cleanup; // There is no file list
 
-	TiXmlText* email_text = NULL;
-	if(hEmail.FirstChild().ToText()!=NULL)
-	{
-		email_text = hEmail.FirstChild().ToText();
-		email_text->SetValue(strconv.w2utf8(sEmail));
-	}
-	else
-	{
-		email_text = new TiXmlText(strconv.t2utf8(sEmail));
-		hEmail.ToElement()->LinkEndChild(email_text);
-	}
+        nTail *= 4;
+    }
 
-    // Write problem description
+    // Keep the line end of the file list
+    if(nCut<nTail && aTail[nCut]=='\r')
+        nCut++;
+    if(nCut<nTail && aTail[nCut]=='\n')
+        nCut++;
 
-    TiXmlHandle hDesc = NULL;
+    xml.Attach(NULL);
+    xml.ResumeElement("CrashRpt");
+    xml.WriteElement("UserEmail", strconv.t2utf8(sEmail));
+    xml.WriteElement("ProblemDescription", strconv.t2utf8(sDesc));
+    xml.EndElement();
 
-	hDesc = root->FirstChild("ProblemDescription");
-	if(hDesc.ToElement()==NULL)
-	{
-		hDesc = new TiXmlElement("ProblemDescription");
-		root->LinkEndChild(hDesc.ToElement());
-	}
+    lPos.QuadPart = lFileSize.QuadPart-nTail+nCut;
+    if(!SetFilePointerEx(hFile, lPos, NULL, FILE_BEGIN) ||
+        !WriteFile(hFile, xml.GetData(), (DWORD)xml.GetSize(), &dwBytesWritten, NULL) ||
+        dwBytesWritten!=(DWORD)xml.GetSize() ||
+        !SetEndOfFile(hFile))
+        goto cleanup;
 
-    TiXmlText* desc_text = NULL;
-	if(hDesc.FirstChild().ToText()!=NULL)
-	{
-		desc_text = hDesc.FirstChild().ToText();
-		desc_text->SetValue(strconv.w2utf8(sDesc));
-	}
-	else
-	{
-		desc_text = new TiXmlText(strconv.t2utf8(sDesc));
-		hDesc.ToElement()->LinkEndChild(desc_text);
-	}
+    bStatus = TRUE;
 
-#if _MSC_VER<1400
-    f = _tfopen(sFileName, _T("w"));
-#else
-    _tfopen_s(&f, sFileName, _T("w"));
-#endif
+cleanup:
 
-    if(f==NULL)
-        return FALSE;
+    if(hFile!=INVALID_HANDLE_VALUE)
+        CloseHandle(hFile);
 
-    bool bSave = doc.SaveFile(f);
-    fclose(f);
-    if(!bSave)
-        return FALSE;
-    return TRUE;
+    return bStatus;
 }
 
 BOOL CCrashInfoReader::AddFilesToCrashReport(int nReport, std::vector<ERIFileItem> FilesToAdd)
@@ -1238,6 +1303,8 @@ BOOL CCrashInfoReader::AddFilesToCrashReport(int nReport, std::vector<ERIFileIte
 			// Kaneva - Bug Fix - Use Source File Full Path
    			m_Reports[nReport].m_FileItems[FilesToAdd[i].m_sSrcFile].m_sSrcFile = sDestPath;
 		}
+
+        m_Reports[nReport].m_bTotalSizeKnown = FALSE;
     }
 
 #if _MSC_VER<1400
@@ -1253,6 +1320,9 @@ BOOL CCrashInfoReader::AddFilesToCrashReport(int nReport, std::vector<ERIFileIte
     if(!bSave)
         return FALSE;
     fclose(f);
+
+    // Keep the queue index in sync with crash description
+    m_QueueIndex.AddReport(m_Reports[nReport]);
     return TRUE;
 }
 
@@ -1320,6 +1390,7 @@ BOOL CCrashInfoReader::RemoveFilesFromCrashReport(int nReport, std::vector<CStri
 		Utility::RecycleFile(m_Reports[nReport].m_sErrorReportDirName + _T("\\") + it->second.m_sDestFile, TRUE);
 
 		m_Reports[nReport].m_FileItems.erase(it);
+		m_Reports[nReport].m_bTotalSizeKnown = FALSE;
     }
 
 #if _MSC_VER<1400
@@ -1335,6 +1406,9 @@ BOOL CCrashInfoReader::RemoveFilesFromCrashReport(int nReport, std::vector<CStri
     if(!bSave)
         return FALSE;
     fclose(f);
+
+    // Keep the queue index in sync with crash description
+    m_QueueIndex.AddReport(m_Reports[nReport]);
     return TRUE;
 }
 
@@ -1571,3 +1645,18 @@ void CCrashInfoReader::SetDailyReportCount(int nReports)
     Utility::SetINIString(m_sINIFile, _T("General"), _T("DailyReportDate"), sDate);
     Utility::SetINIString(m_sINIFile, _T("General"), _T("DailyReportCount"), sReports);
 }
+
+CBlobStore* CCrashInfoReader::GetBlobStore()
+{
+    return &m_BlobStore;
+}
+
+void CCrashInfoReader::UpdateQueueIndex(CErrorReportInfo* eri)
+{
+    m_QueueIndex.AddReport(*eri);
+}
+
+void CCrashInfoReader::RemoveFromQueueIndex(CErrorReportInfo* eri)
+{
+    m_QueueIndex.RemoveReport(eri->m_sCrashGUID);
+}
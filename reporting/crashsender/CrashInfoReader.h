@@ -18,6 +18,8 @@ be found in the Authors.txt file in the root of the source tree.
 #include "tinyxml.h"
 #include "SharedMem.h"
 #include "ScreenCap.h"
+#include "BlobStore.h"
+#include "ReportQueueIndex.h"
 
 // The structure describing a file item contained in crash report.
 struct ERIFileItem
@@ -27,6 +29,8 @@ struct ERIFileItem
     {
         m_bMakeCopy = FALSE;
 		m_bAllowDelete = FALSE;
+        m_uMaxTotalSize = 0;
+        m_uMaxFileSize = 0;
     }
 
     CString m_sDestFile;    // Destination file name as it appears in ZIP archive (not including directory name).
@@ -35,6 +39,8 @@ struct ERIFileItem
     BOOL m_bMakeCopy;       // Should we copy source file to error report folder?
 	BOOL m_bAllowDelete;    // Should allow user to delete the file from crash report?
     CString m_sErrorStatus; // Empty if OK, non-empty if error occurred.
+    ULONG64 m_uMaxTotalSize; // Size budget of files matching a search pattern (0 if none).
+    ULONG64 m_uMaxFileSize;  // Only the end of a larger file is taken (0 if no limit).
 
 	// Retrieves file information, such as type and size.
 	BOOL GetFileInfo(HICON& hIcon, CString& sTypeName, LONGLONG& lSize);
@@ -65,6 +71,7 @@ enum DELIVERY_STATUS
 class CErrorReportInfo
 {
 	friend class CCrashInfoReader;
+	friend class CReportQueueIndex;
 
 public:
 
@@ -90,6 +97,9 @@ public:
 	// Removes an item.
 	BOOL DeleteFileItemByIndex(int nItem);
 
+	// Returns all file items (faster than retrieving them by index one by one).
+	std::map<CString, ERIFileItem>& GetFileItems();
+
 	// Returns count of custom properties in error report.
 	int GetPropCount();
 
@@ -99,6 +109,9 @@ public:
 	// Adds/replaces a property in crash report.
 	void AddProp(LPCTSTR szName, LPCTSTR szVal);
 
+	// Returns all properties (faster than retrieving them by index one by one).
+	std::map<CString, CString>& GetProps();
+
 	// Returns count of registry keys in error report.
 	int GetRegKeyCount();
 
@@ -219,6 +232,7 @@ private:
     CString         m_sGeoLocation;        // Geographic location.
     ScreenshotInfo  m_ScreenshotInfo;      // Screenshot info.
 	ULONG64         m_uTotalSize;          // Summary size of this (uncompressed) report.
+    BOOL            m_bTotalSizeKnown;     // Is m_uTotalSize up to date with the file list?
     BOOL            m_bSelected;           // Is this report selected for delivery or not?
     DELIVERY_STATUS m_DeliveryStatus;      // Error report delivery status.
 
@@ -285,6 +299,7 @@ public:
 	int         m_nVideoQuality;        // Video quality.
 	SIZE        m_DesiredFrameSize;     // Desired video frame size.
 	HWND        m_hWndVideoParent;      // Video recording dialog parent.
+	int         m_nVideoMaxMemory;      // Memory limit for recorded video frames (in MB).
 	BOOL        m_bClientAppCrashed;    // If TRUE, the client app has crashed; otherwise the client app exited successfully.
 	BOOL        m_bQueueEnabled;        // Can reports be sent later or not (queue enabled)?
 	// Below are exception information fields.
@@ -356,6 +371,15 @@ public:
     // Sets the number of crash reports sent per calendar day.
     void SetDailyReportCount(int nReports);
 
+    // Returns the store of files shared by queued error reports.
+    CBlobStore* GetBlobStore();
+
+    // Records the current state of the report in the queue index.
+    void UpdateQueueIndex(CErrorReportInfo* eri);
+
+    // Removes the report from the queue index.
+    void RemoveFromQueueIndex(CErrorReportInfo* eri);
+
 private:
 
     // Retrieves some crash info from crash description XML.
@@ -388,10 +412,17 @@ private:
     // Calculates size of an uncompressed error report.
     LONG64 GetUncompressedReportSize(CErrorReportInfo& eri);
 
+    // Adds reports from report folders not listed in aIndexed (lower case folder
+    // names) to the list and to the queue index.
+    void AddUnindexedReports(const std::set<CString>& aIndexed);
+
     std::vector<CErrorReportInfo> m_Reports; // Array of error reports.
     CString m_sINIFile;                     // Path to ~CrashRpt.ini file.
     CSharedMem m_SharedMem;                 // Shared memory
-    CRASH_DESCRIPTION* m_pCrashDesc;        // Pointer to crash descritpion
+    CCrashDescReader m_CrashDesc;           // Reader of crash description in shared memory
+    const CRASH_DESCRIPTION* m_pCrashDesc;  // Pointer to crash descritpion
 	CString m_sErrorMsg;                    // Last error message.
+    CBlobStore m_BlobStore;                 // Files shared by queued error reports.
+    CReportQueueIndex m_QueueIndex;         // Index of queued error reports.
 };
 
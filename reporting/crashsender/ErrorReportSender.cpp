@@ -14,18 +14,21 @@ be found in the Authors.txt file in the root of the source tree.
 #include "smtpclient.h"
 #include "HttpRequestSender.h"
 #include "CrashRpt.h"
-#include "md5.h"
+#include "Hash.h"
+#include "XmlWriter.h"
+#include "RegKeyDump.h"
+#include "FileGlob.h"
 #include "Utility.h"
 #include "zip.h"
 #include "CrashInfoReader.h"
 #include "strconv.h"
 #include "ScreenCap.h"
-#include "base64.h"
 #include <sys/stat.h>
 #include "dbghelp.h"
 #include "VideoRec.h"
 #include "VideoRecDlg.h"
 #include "iowin32.h"
+#include "FileIO.h"
 
 CErrorReportSender* CErrorReportSender::m_pInstance = NULL;
 
@@ -39,14 +42,37 @@ CErrorReportSender::CErrorReportSender() :
     m_bExport(FALSE),
     m_MailClientConfirm(NOT_CONFIRMED_YET),
     m_bSendingNow(FALSE),
-    m_bErrors(FALSE)
+    m_bErrors(FALSE),
+    m_nBatchMaxCount(0),
+    m_uBatchMaxSize(0)
 {
+    m_hTransportSlots[CR_HTTP] = CreateSemaphore(NULL, MAX_HTTP_DELIVERIES, MAX_HTTP_DELIVERIES, NULL);
+    m_hTransportSlots[CR_SMTP] = CreateSemaphore(NULL, MAX_SMTP_DELIVERIES, MAX_SMTP_DELIVERIES, NULL);
+    m_hTransportSlots[CR_SMAPI] = CreateSemaphore(NULL, MAX_SMAPI_DELIVERIES, MAX_SMAPI_DELIVERIES, NULL);
 }
 
 // Destructor
 CErrorReportSender::~CErrorReportSender()
 {
     Finalize();
+
+    int i;
+    for(i=0; i<3; i++)
+    {
+        if(m_hTransportSlots[i]!=NULL)
+            CloseHandle(m_hTransportSlots[i]);
+    }
+}
+
+DeliveryJob::DeliveryJob() :
+    m_nReport(-1),
+    m_uZipSize(0),
+    m_pAssync(NULL),
+    m_pHttpSender(NULL),
+    m_pOwner(NULL),
+    m_hThread(NULL),
+    m_nStatus(1)
+{
 }
 
 CErrorReportSender* CErrorReportSender::GetInstance()
@@ -81,8 +107,11 @@ BOOL CErrorReportSender::Init(LPCTSTR szFileMappingName)
         }
     }
 
+    // Parse the lang file once instead of reading it for every string
+    LoadLangFile();
+
     // Check window mirroring settings
-    CString sRTL = Utility::GetINIString(m_CrashInfo.m_sLangFileName, _T("Settings"), _T("RTLReading"));
+    CString sRTL = GetLangStr(_T("Settings"), _T("RTLReading"));
     if(sRTL.CompareNoCase(_T("1"))==0)
     {
         // Set Right-to-Left reading order
@@ -97,7 +126,7 @@ BOOL CErrorReportSender::Init(LPCTSTR szFileMappingName)
         BOOL bRec = RecordVideo();
         if(!bRec)
         {
-            // Clean up temp files
+            // Free recorded frames
             m_VideoRec.Destroy();
             return FALSE;
         }
@@ -116,7 +145,7 @@ BOOL CErrorReportSender::Init(LPCTSTR szFileMappingName)
             // Let the parent process to continue its work
             UnblockParentProcess();
 
-            // Clean up temp files
+            // Free recorded frames
             m_VideoRec.Destroy();
 
             return FALSE;
@@ -399,6 +428,10 @@ BOOL CErrorReportSender::DoWork(int Action)
         // Create crash description XML
         CreateCrashDescriptionXML(*pReport);
 
+        // Make the report visible to later resend sessions
+        if(m_CrashInfo.m_bQueueEnabled)
+            m_CrashInfo.UpdateQueueIndex(pReport);
+
         // Add a message to log
         m_Assync.SetProgress(_T("[confirm_send_report]"), 100, false);
     }
@@ -489,6 +522,7 @@ BOOL CErrorReportSender::Finalize()
         if (!pReport) return FALSE;
 
         // Remove report files if queue disabled (or if client app not crashed).
+        m_CrashInfo.RemoveFromQueueIndex(pReport);
         Utility::RecycleFile(pReport->GetErrorReportDirName(), true);
     }
 
@@ -541,6 +575,8 @@ BOOL CErrorReportSender::TakeDesktopScreenshot()
 
     if((dwFlags&CR_AS_USE_JPEG_FORMAT)!=0)
         fmt = SCREENSHOT_FORMAT_JPG; // Use JPEG format
+    else if((dwFlags&CR_AS_FAST_PNG_FORMAT)!=0)
+        fmt = SCREENSHOT_FORMAT_PNG_FAST; // Use PNG format, encode for speed
 
     // Determine what to use - color or grayscale image
     BOOL bGrayscale = (dwFlags&CR_AS_GRAYSCALE_IMAGE)!=0;
@@ -587,7 +623,7 @@ BOOL CErrorReportSender::TakeDesktopScreenshot()
         ERIFileItem fi;
         fi.m_sSrcFile = sFileName;
         fi.m_sDestFile = sDestFile;
-        fi.m_sDesc = Utility::GetINIString(m_CrashInfo.m_sLangFileName, _T("DetailDlg"), _T("DescScreenshot"));
+        fi.m_sDesc = GetLangStr(_T("DetailDlg"), _T("DescScreenshot"));
         fi.m_bAllowDelete = bAllowDelete;
         pReport->AddFileItem(&fi);
     }
@@ -844,7 +880,7 @@ cleanup:
 
     // Add the minidump file to error report
     fi.m_bMakeCopy = false;
-    fi.m_sDesc = Utility::GetINIString(m_CrashInfo.m_sLangFileName, _T("DetailDlg"), _T("DescCrashDump"));
+    fi.m_sDesc = GetLangStr(_T("DetailDlg"), _T("DescCrashDump"));
     fi.m_sDestFile = _T("crashdump.dmp");
     fi.m_sSrcFile = sMinidumpFile;
     fi.m_sErrorStatus = sErrorMsg;
@@ -911,16 +947,6 @@ Cleanup:
     return fSuccess;
 }
 
-// This method adds an element to XML file
-void CErrorReportSender::AddElemToXML(CString sName, CString sValue, TiXmlNode* root)
-{
-    strconv_t strconv;
-    TiXmlHandle hElem = new TiXmlElement(strconv.t2utf8(sName));
-    root->LinkEndChild(hElem.ToNode());
-    TiXmlText* text = new TiXmlText(strconv.t2utf8(sValue));
-    hElem.ToElement()->LinkEndChild(text);
-}
-
 // This method generates an XML file describing the crash
 BOOL CErrorReportSender::CreateCrashDescriptionXML(CErrorReportInfo& eri)
 {
@@ -929,229 +955,191 @@ BOOL CErrorReportSender::CreateCrashDescriptionXML(CErrorReportInfo& eri)
     CString sFileName = eri.GetErrorReportDirName() + _T("\\crashrpt.xml");
     CString sErrorMsg;
     strconv_t strconv;
-    TiXmlDocument doc;
+    CXmlWriter xml;
     FILE* f = NULL;
     CString sNum;
-    CString sCrashRptVer;
-    CString sOSIs64Bit;
-    CString sExceptionType;
 
     fi.m_bMakeCopy = false;
-    fi.m_sDesc = Utility::GetINIString(m_CrashInfo.m_sLangFileName, _T("DetailDlg"), _T("DescXML"));
+    fi.m_sDesc = GetLangStr(_T("DetailDlg"), _T("DescXML"));
     fi.m_sDestFile = _T("crashrpt.xml");
     fi.m_sSrcFile = sFileName;
     fi.m_sErrorStatus = sErrorMsg;
     // Add this file to the list
     eri.AddFileItem(&fi);
 
-    TiXmlNode* root = root = new TiXmlElement("CrashRpt");
-    doc.LinkEndChild(root);
-    sCrashRptVer.Format(_T("%d"), CRASHRPT_VER);
-    TiXmlHandle(root).ToElement()->SetAttribute("version", strconv.t2utf8(sCrashRptVer));
-
-    TiXmlDeclaration * decl = new TiXmlDeclaration( "1.0", "UTF-8", "" );
-    doc.InsertBeforeChild(root, *decl);
+#if _MSC_VER<1400
+    f = _tfopen(sFileName, _T("wb"));
+#else
+    _tfopen_s(&f, sFileName, _T("wb"));
+#endif
 
-    AddElemToXML(_T("CrashGUID"), eri.GetCrashGUID(), root);
-    AddElemToXML(_T("AppName"), eri.GetAppName(), root);
-    AddElemToXML(_T("AppVersion"), eri.GetAppVersion(), root);
-    AddElemToXML(_T("ImageName"), eri.GetImageName(), root);
-    AddElemToXML(_T("OperatingSystem"), eri.GetOSName(), root);
+    if(f==NULL)
+    {
+        sErrorMsg = _T("Error opening file for writing");
+        goto cleanup;
+    }
 
+    // Elements are written to the file as they are added
+    xml.Attach(f);
+    xml.WriteDeclaration(true);
 
-    sOSIs64Bit.Format(_T("%d"), eri.IsOS64Bit());
-    AddElemToXML(_T("OSIs64Bit"), sOSIs64Bit, root);
+    xml.StartElement("CrashRpt");
+    xml.AddAttribute("version", CRASHRPT_VER);
 
-    AddElemToXML(_T("GeoLocation"), eri.GetGeoLocation(), root);
-    AddElemToXML(_T("SystemTimeUTC"), eri.GetSystemTimeUTC(), root);
+    xml.WriteElement("CrashGUID", strconv.t2utf8(eri.GetCrashGUID()));
+    xml.WriteElement("AppName", strconv.t2utf8(eri.GetAppName()));
+    xml.WriteElement("AppVersion", strconv.t2utf8(eri.GetAppVersion()));
+    xml.WriteElement("ImageName", strconv.t2utf8(eri.GetImageName()));
+    xml.WriteElement("OperatingSystem", strconv.t2utf8(eri.GetOSName()));
+    xml.WriteElement("OSIs64Bit", eri.IsOS64Bit());
+    xml.WriteElement("GeoLocation", strconv.t2utf8(eri.GetGeoLocation()));
+    xml.WriteElement("SystemTimeUTC", strconv.t2utf8(eri.GetSystemTimeUTC()));
 
     if(eri.GetExceptionAddress()!=0)
     {
         sNum.Format(_T("0x%I64x"), eri.GetExceptionAddress());
-        AddElemToXML(_T("ExceptionAddress"), sNum, root);
+        xml.WriteElement("ExceptionAddress", strconv.t2utf8(sNum));
 
-        AddElemToXML(_T("ExceptionModule"), eri.GetExceptionModule(), root);
+        xml.WriteElement("ExceptionModule", strconv.t2utf8(eri.GetExceptionModule()));
 
         sNum.Format(_T("0x%I64x"), eri.GetExceptionModuleBase());
-        AddElemToXML(_T("ExceptionModuleBase"), sNum, root);
+        xml.WriteElement("ExceptionModuleBase", strconv.t2utf8(sNum));
 
-        AddElemToXML(_T("ExceptionModuleVersion"), eri.GetExceptionModuleVersion(), root);
+        xml.WriteElement("ExceptionModuleVersion", strconv.t2utf8(eri.GetExceptionModuleVersion()));
     }
 
-    sExceptionType.Format(_T("%d"), m_CrashInfo.m_nExceptionType);
-    AddElemToXML(_T("ExceptionType"), sExceptionType, root);
-
-    CString sExceptionCode;
-    sExceptionCode.Format(_T("%d"), m_CrashInfo.m_dwExceptionCode);
-    AddElemToXML(_T("ExceptionCode"), sExceptionCode, root);
+    xml.WriteElement("ExceptionType", m_CrashInfo.m_nExceptionType);
+    xml.WriteElement("ExceptionCode", (int)m_CrashInfo.m_dwExceptionCode);
 
     if(m_CrashInfo.m_nExceptionType==CR_CPP_SIGFPE)
     {
-        CString sFPESubcode;
-        sFPESubcode.Format(_T("%d"), m_CrashInfo.m_uFPESubcode);
-        AddElemToXML(_T("FPESubcode"), sFPESubcode, root);
+        xml.WriteElement("FPESubcode", (int)m_CrashInfo.m_uFPESubcode);
     }
     else if(m_CrashInfo.m_nExceptionType==CR_CPP_INVALID_PARAMETER)
     {
-        AddElemToXML(_T("InvParamExpression"), m_CrashInfo.m_sInvParamExpr, root);
-        AddElemToXML(_T("InvParamFunction"), m_CrashInfo.m_sInvParamFunction, root);
-        AddElemToXML(_T("InvParamFile"), m_CrashInfo.m_sInvParamFile, root);
-
-        CString sInvParamLine;
-        sInvParamLine.Format(_T("%d"), m_CrashInfo.m_uInvParamLine);
-        AddElemToXML(_T("InvParamLine"), sInvParamLine, root);
+        xml.WriteElement("InvParamExpression", strconv.t2utf8(m_CrashInfo.m_sInvParamExpr));
+        xml.WriteElement("InvParamFunction", strconv.t2utf8(m_CrashInfo.m_sInvParamFunction));
+        xml.WriteElement("InvParamFile", strconv.t2utf8(m_CrashInfo.m_sInvParamFile));
+        xml.WriteElement("InvParamLine", (int)m_CrashInfo.m_uInvParamLine);
     }
 
-    CString sGuiResources;
-    sGuiResources.Format(_T("%d"), eri.GetGuiResourceCount());
-    AddElemToXML(_T("GUIResourceCount"), sGuiResources, root);
-
-    CString sProcessHandleCount;
-    sProcessHandleCount.Format(_T("%d"), eri.GetProcessHandleCount());
-    AddElemToXML(_T("OpenHandleCount"), sProcessHandleCount, root);
-
-    AddElemToXML(_T("MemoryUsageKbytes"), eri.GetMemUsage(), root);
+    xml.WriteElement("GUIResourceCount", (int)eri.GetGuiResourceCount());
+    xml.WriteElement("OpenHandleCount", (int)eri.GetProcessHandleCount());
+    xml.WriteElement("MemoryUsageKbytes", strconv.t2utf8(eri.GetMemUsage()));
 
     if(eri.GetScreenshotInfo().m_bValid)
     {
-        TiXmlHandle hScreenshotInfo = new TiXmlElement("ScreenshotInfo");
-        root->LinkEndChild(hScreenshotInfo.ToNode());
-
-        TiXmlHandle hVirtualScreen = new TiXmlElement("VirtualScreen");
-
-        sNum.Format(_T("%d"), eri.GetScreenshotInfo().m_rcVirtualScreen.left);
-        hVirtualScreen.ToElement()->SetAttribute("left", strconv.t2utf8(sNum));
+        ScreenshotInfo& si = eri.GetScreenshotInfo();
 
-        sNum.Format(_T("%d"), eri.GetScreenshotInfo().m_rcVirtualScreen.top);
-        hVirtualScreen.ToElement()->SetAttribute("top", strconv.t2utf8(sNum));
+        xml.StartElement("ScreenshotInfo");
 
-        sNum.Format(_T("%d"), eri.GetScreenshotInfo().m_rcVirtualScreen.Width());
-        hVirtualScreen.ToElement()->SetAttribute("width", strconv.t2utf8(sNum));
+        xml.StartElement("VirtualScreen");
+        xml.AddAttribute("left", si.m_rcVirtualScreen.left);
+        xml.AddAttribute("top", si.m_rcVirtualScreen.top);
+        xml.AddAttribute("width", si.m_rcVirtualScreen.Width());
+        xml.AddAttribute("height", si.m_rcVirtualScreen.Height());
+        xml.EndElement();
 
-        sNum.Format(_T("%d"), eri.GetScreenshotInfo().m_rcVirtualScreen.Height());
-        hVirtualScreen.ToElement()->SetAttribute("height", strconv.t2utf8(sNum));
-
-        hScreenshotInfo.ToNode()->LinkEndChild(hVirtualScreen.ToNode());
-
-        TiXmlHandle hMonitors = new TiXmlElement("Monitors");
-        hScreenshotInfo.ToElement()->LinkEndChild(hMonitors.ToNode());
+        xml.StartElement("Monitors");
 
         size_t i;
-        for(i=0; i<eri.GetScreenshotInfo().m_aMonitors.size(); i++)
+        for(i=0; i<si.m_aMonitors.size(); i++)
         {
-            MonitorInfo& mi = eri.GetScreenshotInfo().m_aMonitors[i];
-            TiXmlHandle hMonitor = new TiXmlElement("Monitor");
-
-            sNum.Format(_T("%d"), mi.m_rcMonitor.left);
-            hMonitor.ToElement()->SetAttribute("left", strconv.t2utf8(sNum));
-
-            sNum.Format(_T("%d"), mi.m_rcMonitor.top);
-            hMonitor.ToElement()->SetAttribute("top", strconv.t2utf8(sNum));
-
-            sNum.Format(_T("%d"), mi.m_rcMonitor.Width());
-            hMonitor.ToElement()->SetAttribute("width", strconv.t2utf8(sNum));
-
-            sNum.Format(_T("%d"), mi.m_rcMonitor.Height());
-            hMonitor.ToElement()->SetAttribute("height", strconv.t2utf8(sNum));
-
-            hMonitor.ToElement()->SetAttribute("file", strconv.t2utf8(Utility::GetFileName(mi.m_sFileName)));
-
-            hMonitors.ToElement()->LinkEndChild(hMonitor.ToNode());
+            MonitorInfo& mi = si.m_aMonitors[i];
+
+            xml.StartElement("Monitor");
+            xml.AddAttribute("left", mi.m_rcMonitor.left);
+            xml.AddAttribute("top", mi.m_rcMonitor.top);
+            xml.AddAttribute("width", mi.m_rcMonitor.Width());
+            xml.AddAttribute("height", mi.m_rcMonitor.Height());
+            xml.AddAttribute("file", strconv.t2utf8(Utility::GetFileName(mi.m_sFileName)));
+            xml.EndElement();
         }
 
-        TiXmlHandle hWindows = new TiXmlElement("Windows");
-        hScreenshotInfo.ToElement()->LinkEndChild(hWindows.ToNode());
-
-        for(i=0; i<eri.GetScreenshotInfo().m_aWindows.size(); i++)
-        {
-            WindowInfo& wi = eri.GetScreenshotInfo().m_aWindows[i];
-            TiXmlHandle hWindow = new TiXmlElement("Window");
-
-            sNum.Format(_T("%d"), wi.m_rcWnd.left);
-            hWindow.ToElement()->SetAttribute("left", strconv.t2utf8(sNum));
-
-            sNum.Format(_T("%d"), wi.m_rcWnd.top);
-            hWindow.ToElement()->SetAttribute("top", strconv.t2utf8(sNum));
+        xml.EndElement(); // Monitors
 
-            sNum.Format(_T("%d"), wi.m_rcWnd.Width());
-            hWindow.ToElement()->SetAttribute("width", strconv.t2utf8(sNum));
+        xml.StartElement("Windows");
 
-            sNum.Format(_T("%d"), wi.m_rcWnd.Height());
-            hWindow.ToElement()->SetAttribute("height", strconv.t2utf8(sNum));
-
-            hWindow.ToElement()->SetAttribute("title", strconv.t2utf8(wi.m_sTitle));
-
-            hWindows.ToElement()->LinkEndChild(hWindow.ToNode());
+        for(i=0; i<si.m_aWindows.size(); i++)
+        {
+            WindowInfo& wi = si.m_aWindows[i];
+
+            xml.StartElement("Window");
+            xml.AddAttribute("left", wi.m_rcWnd.left);
+            xml.AddAttribute("top", wi.m_rcWnd.top);
+            xml.AddAttribute("width", wi.m_rcWnd.Width());
+            xml.AddAttribute("height", wi.m_rcWnd.Height());
+            xml.AddAttribute("title", strconv.t2utf8(wi.m_sTitle));
+            xml.EndElement();
         }
+
+        xml.EndElement(); // Windows
+        xml.EndElement(); // ScreenshotInfo
     }
 
-    TiXmlHandle hCustomProps = new TiXmlElement("CustomProps");
-    root->LinkEndChild(hCustomProps.ToNode());
+    // Properties and file items are walked directly, as there may be thousands of them
+    xml.StartElement("CustomProps");
 
-    int i;
-    for(i=0; i<eri.GetPropCount(); i++)
     {
-        CString sName;
-        CString sVal;
-        eri.GetPropByIndex(i, sName, sVal);
+        std::map<CString, CString>::iterator it;
+        for(it=eri.GetProps().begin(); it!=eri.GetProps().end(); it++)
+        {
+            strconv_t strconv_prop;
+            xml.StartElement("Prop");
+            xml.AddAttribute("name", strconv_prop.t2utf8(it->first));
+            xml.AddAttribute("value", strconv_prop.t2utf8(it->second));
+            xml.EndElement();
+        }
+    }
 
-        TiXmlHandle hProp = new TiXmlElement("Prop");
+    xml.EndElement(); // CustomProps
 
-        hProp.ToElement()->SetAttribute("name", strconv.t2utf8(sName));
-        hProp.ToElement()->SetAttribute("value", strconv.t2utf8(sVal));
+    xml.StartElement("FileList");
 
-        hCustomProps.ToElement()->LinkEndChild(hProp.ToNode());
+    {
+        std::map<CString, ERIFileItem>::iterator it;
+        for(it=eri.GetFileItems().begin(); it!=eri.GetFileItems().end(); it++)
+        {
+            ERIFileItem* rfi = &it->second;
+            strconv_t strconv_item;
+
+            xml.StartElement("FileItem");
+            xml.AddAttribute("name", strconv_item.t2utf8(rfi->m_sDestFile));
+            xml.AddAttribute("description", strconv_item.t2utf8(rfi->m_sDesc));
+            if(rfi->m_bAllowDelete)
+                xml.AddAttribute("optional", "1");
+            if(!rfi->m_sErrorStatus.IsEmpty())
+                xml.AddAttribute("error", strconv_item.t2utf8(rfi->m_sErrorStatus));
+            xml.EndElement();
+        }
     }
 
-    TiXmlHandle hFileItems = new TiXmlElement("FileList");
-    root->LinkEndChild(hFileItems.ToNode());
+    xml.EndElement(); // FileList
+    xml.EndElement(); // CrashRpt
 
-    for(i=0; i<eri.GetFileItemCount(); i++)
+    if(!xml.Flush())
     {
-        ERIFileItem* rfi = eri.GetFileItemByIndex(i);
-        TiXmlHandle hFileItem = new TiXmlElement("FileItem");
-
-        hFileItem.ToElement()->SetAttribute("name", strconv.t2utf8(rfi->m_sDestFile));
-        hFileItem.ToElement()->SetAttribute("description", strconv.t2utf8(rfi->m_sDesc));
-        if(rfi->m_bAllowDelete)
-            hFileItem.ToElement()->SetAttribute("optional", "1");
-        if(!rfi->m_sErrorStatus.IsEmpty())
-            hFileItem.ToElement()->SetAttribute("error", strconv.t2utf8(rfi->m_sErrorStatus));
-
-        hFileItems.ToElement()->LinkEndChild(hFileItem.ToNode());
+        sErrorMsg = _T("Error writing file");
+        goto cleanup;
     }
 
-#if _MSC_VER<1400
-    f = _tfopen(sFileName, _T("w"));
-#else
-    _tfopen_s(&f, sFileName, _T("w"));
-#endif
-
+    if(fclose(f)!=0)
     {
-        if(f==NULL)
-        {
-            sErrorMsg = _T("Error opening file for writing");
-            goto cleanup;
-        }
-
-        doc.useMicrosoftBOM = true;
-        bool bSave = doc.SaveFile(f);
-        if(!bSave)
-        {
-            sErrorMsg = doc.ErrorDesc();
-            goto cleanup;
-        }
-
-        fclose(f);
         f = NULL;
+        sErrorMsg = _T("Error writing file");
+        goto cleanup;
     }
+    f = NULL;
 
     bStatus = TRUE;
 
 cleanup:
 
     if(f)
+    {
+        xml.Attach(NULL);
         fclose(f);
+    }
 
     if(!bStatus)
     {
@@ -1175,6 +1163,7 @@ BOOL CErrorReportSender::CollectCrashFiles()
     CString sSrcFile;
     CString sDestFile;
     std::vector<ERIFileItem> file_list;
+    std::vector<ERIFileItem*> aCopyItems;
 
     // Copy application-defined files that should be copied on crash
     m_Assync.SetProgress(_T("[copying_files]"), 0, false);
@@ -1195,9 +1184,17 @@ BOOL CErrorReportSender::CollectCrashFiles()
             if(bSearchPattern)
                 CollectFilesBySearchTemplate(pfi, file_list);
             else
-                CollectSingleFile(pfi);
+                aCopyItems.push_back(pfi);
         }
 
+        // Copy all files at once, as copying a file waits mostly for the disk
+        for(i=0; i<(int)file_list.size(); i++)
+            aCopyItems.push_back(&file_list[i]);
+        CollectFilesInParallel(aCopyItems);
+
+        if(m_Assync.IsCancelled())
+            goto cleanup;
+
         // Add newly collected files to the list of file items
         for(i=0; i<(int)file_list.size(); i++)
         {
@@ -1261,7 +1258,7 @@ BOOL CErrorReportSender::CollectCrashFiles()
             ERIFileItem fi;
             fi.m_sSrcFile = sFilePath;
             fi.m_sDestFile = rki.m_sDstFileName;
-            fi.m_sDesc = Utility::GetINIString(m_CrashInfo.m_sLangFileName, _T("DetailDlg"), _T("DescRegKey"));
+            fi.m_sDesc = GetLangStr(_T("DetailDlg"), _T("DescRegKey"));
             fi.m_bMakeCopy = FALSE;
             fi.m_bAllowDelete = rki.m_bAllowDelete;
             fi.m_sErrorStatus = sErrorMsg;
@@ -1289,463 +1286,434 @@ BOOL CErrorReportSender::CollectSingleFile(ERIFileItem* pfi)
     auto pReport = GetReport();
     if (!pReport) return FALSE;
 
-    BOOL bStatus = false;
     CString str;
-    HANDLE hSrcFile = INVALID_HANDLE_VALUE;
-    HANDLE hDestFile = INVALID_HANDLE_VALUE;
-    BOOL bGetSize = FALSE;
-    LARGE_INTEGER lFileSize;
-    LARGE_INTEGER lTotalWritten;
     CString sDestFile;
-    BOOL bRead = FALSE;
-    BOOL bWrite = FALSE;
-    LPBYTE buffer[1024];
+    CString sErrorMsg;
+    FileCopyMethod method = FILECOPY_FAILED;
 
     CString sErrorReportDir = pReport->GetErrorReportDirName();
+    BOOL bTail = FALSE;
 
     str.Format(_T("CErrorReportSender::CollectSingleFile - '%s'"), (LPCTSTR)pfi->m_sSrcFile);
     m_Assync.SetProgress(str, 0, false);
 
-    // Open source file with read/write sharing permissions.
-    hSrcFile = CreateFile(pfi->m_sSrcFile, GENERIC_READ,
-        FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, 0, NULL);
-    if(hSrcFile==INVALID_HANDLE_VALUE)
+    // Only the end of a large file is included, that requires a copy.
+    if(pfi->m_uMaxFileSize!=0)
     {
-        pfi->m_sErrorStatus = Utility::FormatErrorMsg(GetLastError());
-        str.Format(_T("CErrorReportSender::CollectSingleFile - Error opening file %s."), (LPCTSTR)pfi->m_sSrcFile);
-        m_Assync.SetProgress(str, 0, false);
-        goto cleanup;
+        WIN32_FILE_ATTRIBUTE_DATA fad;
+        if(GetFileAttributesEx(pfi->m_sSrcFile, GetFileExInfoStandard, &fad) &&
+            (((ULONG64)fad.nFileSizeHigh<<32)|fad.nFileSizeLow)>pfi->m_uMaxFileSize)
+            bTail = TRUE;
     }
 
-    // If we should make a copy of the file
-    if(pfi->m_bMakeCopy)
+    // If we shouldn't make a copy, just check the file is accessible.
+    if(!pfi->m_bMakeCopy && !bTail)
     {
-        str.Format(_T("Copying file %s."), (LPCTSTR) pfi->m_sSrcFile);
-        m_Assync.SetProgress(str, 0, false);
-
-        bGetSize = GetFileSizeEx(hSrcFile, &lFileSize);
-        if(!bGetSize)
-        {
-            pfi->m_sErrorStatus = Utility::FormatErrorMsg(GetLastError());
-            str.Format(_T("Couldn't get file size of %s"), (LPCTSTR) pfi->m_sSrcFile);
-            m_Assync.SetProgress(str, 0, false);
-            CloseHandle(hSrcFile);
-            hSrcFile = INVALID_HANDLE_VALUE;
-            goto cleanup;
-        }
-
-        sDestFile = sErrorReportDir + _T("\\") + pfi->m_sDestFile;
-
-        str.Format(_T(" ... '%s' -> '%s'"), (LPCTSTR)pfi->m_sSrcFile, (LPCTSTR)sDestFile);
-        m_Assync.SetProgress(str, 0, false);
-
-        hDestFile = CreateFile(sDestFile, GENERIC_WRITE,
-            FILE_SHARE_READ, NULL, CREATE_ALWAYS, 0, NULL);
-        if(hDestFile==INVALID_HANDLE_VALUE)
+        CFileReader reader;
+        if(!reader.Open(pfi->m_sSrcFile))
         {
             pfi->m_sErrorStatus = Utility::FormatErrorMsg(GetLastError());
-            str.Format(_T("CErrorReportSender::CollectSingleFile - Error creating file %s."), (LPCTSTR)sDestFile);
+            str.Format(_T("CErrorReportSender::CollectSingleFile - Error opening file %s."), (LPCTSTR)pfi->m_sSrcFile);
             m_Assync.SetProgress(str, 0, false);
-            CloseHandle(hSrcFile);
-            hSrcFile = INVALID_HANDLE_VALUE;
-            goto cleanup;
+            return FALSE;
         }
 
-        lTotalWritten.QuadPart = 0;
-
-        for(;;)
-        {
-            if(m_Assync.IsCancelled())
-                goto cleanup;
-
-            DWORD dwBytesRead = 0;
-            bRead = ReadFile(hSrcFile, buffer, 1024, &dwBytesRead, NULL);
-            if(!bRead || dwBytesRead==0)
-                break;
+        return TRUE;
+    }
 
-            DWORD dwBytesWritten = 0;
-            bWrite = WriteFile(hDestFile, buffer, dwBytesRead, &dwBytesWritten, NULL);
-            if(!bWrite || dwBytesRead!=dwBytesWritten)
-                break;
+    str.Format(_T("Copying file %s."), (LPCTSTR) pfi->m_sSrcFile);
+    m_Assync.SetProgress(str, 0, false);
 
-            lTotalWritten.QuadPart += dwBytesWritten;
-            int nProgress = (int)(100.0f*lTotalWritten.QuadPart/lFileSize.QuadPart);
-            m_Assync.SetProgress(nProgress, false);
-        }
+    sDestFile = sErrorReportDir + _T("\\") + pfi->m_sDestFile;
 
-        CloseHandle(hSrcFile);
-        hSrcFile = INVALID_HANDLE_VALUE;
-        CloseHandle(hDestFile);
-        hDestFile = INVALID_HANDLE_VALUE;
+    str.Format(_T(" ... '%s' -> '%s'"), (LPCTSTR)pfi->m_sSrcFile, (LPCTSTR)sDestFile);
+    m_Assync.SetProgress(str, 0, false);
 
-        // Use the copy for display and zipping.
-        pfi->m_sSrcFile = sDestFile;
+    // Queued reports keep their files until delivered, so share identical
+    // files between them. Otherwise clone or copy the file, whatever
+    // is cheapest on this file system.
+    if(bTail)
+    {
+        method = FileIO::CopyFileTail(pfi->m_sSrcFile, sDestFile, pfi->m_uMaxFileSize, &m_Assync, sErrorMsg);
+    }
+    else if(m_CrashInfo.m_bQueueEnabled && m_CrashInfo.GetBlobStore()->IsInitialized())
+    {
+        if(m_CrashInfo.GetBlobStore()->AddFile(pfi->m_sSrcFile, sDestFile, &m_Assync, sErrorMsg))
+            method = FILECOPY_STREAM;
+    }
+    else
+    {
+        method = FileIO::CopyReportFile(pfi->m_sSrcFile, sDestFile, &m_Assync, sErrorMsg);
     }
 
-    bStatus = true;
-
-cleanup:
-
-    if(hSrcFile!=INVALID_HANDLE_VALUE)
-        CloseHandle(hSrcFile);
+    if(method==FILECOPY_FAILED)
+    {
+        pfi->m_sErrorStatus = sErrorMsg;
+        str.Format(_T("CErrorReportSender::CollectSingleFile - Error copying file %s: %s"),
+            (LPCTSTR)pfi->m_sSrcFile, (LPCTSTR)sErrorMsg);
+        m_Assync.SetProgress(str, 0, false);
+        return FALSE;
+    }
 
-    if(hDestFile!=INVALID_HANDLE_VALUE)
-        CloseHandle(hDestFile);
+    if(method==FILECOPY_CLONE)
+        m_Assync.SetProgress(_T(" ... cloned"), 100, false);
+    else if(bTail)
+        m_Assync.SetProgress(_T(" ... end of file only"), 100, false);
 
+    // Use the copy for display and zipping.
+    pfi->m_sSrcFile = sDestFile;
 
-    return bStatus;
+    return TRUE;
 }
 
 BOOL CErrorReportSender::CollectFilesBySearchTemplate(ERIFileItem* pfi, std::vector<ERIFileItem>& file_list)
 {
+    strconv_t strconv;
+    std::wstring sBaseDir;
+    std::wstring sRelPattern;
+    std::vector<GlobFile> aFiles;
+    std::vector<CString> aDirs; // Directories left to search, relative to the base one
     CString sMsg;
+    size_t i;
+
     sMsg.Format(_T("CErrorReportSender::CollectFilesBySearchTemplate - '%s'"), (LPCTSTR)pfi->m_sSrcFile);
     m_Assync.SetProgress(sMsg, 0);
 
-    // Look for files matching search pattern
-    WIN32_FIND_DATA ffd;
-    HANDLE hFind = FindFirstFile(pfi->m_sSrcFile, &ffd);
-    if (hFind == INVALID_HANDLE_VALUE)
-    {
-        // Nothing found
-        m_Assync.SetProgress(_T("Could not find any files matching the search template."), 0);
-        return FALSE;
-    }
-    else
+    glob_split(strconv.t2w(pfi->m_sSrcFile), sBaseDir, sRelPattern);
+    CString sBase = sBaseDir.c_str();
+    if(!sBase.IsEmpty())
+        sBase += _T("\\");
+
+    // Look for files matching search pattern. Only directories that may contain
+    // matching files are searched, a single directory for a pattern like "*.log".
+    aDirs.push_back(CString());
+    while(!aDirs.empty())
     {
-        // Get owning directory name
-        int nPos = pfi->m_sSrcFile.ReverseFind(_T('\\'));
-        CString sDir = pfi->m_sSrcFile.Mid(0, nPos);
+        if(m_Assync.IsCancelled())
+            return FALSE;
+
+        CString sDir = aDirs.back();
+        aDirs.pop_back();
+
+        WIN32_FIND_DATA ffd;
+        HANDLE hFind = FindFirstFile(sBase + sDir + _T("*"), &ffd);
+        if(hFind==INVALID_HANDLE_VALUE)
+            continue;
 
-        // Enumerate matching files
-        BOOL bFound = TRUE;
-        int nFileCount = 0;
-        while(bFound)
+        do
         {
-            if(m_Assync.IsCancelled())
-                break;
+            if(_tcscmp(ffd.cFileName, _T("."))==0 || _tcscmp(ffd.cFileName, _T(".."))==0)
+                continue;
 
-            if((ffd.dwFileAttributes&FILE_ATTRIBUTE_DIRECTORY)==0)
+            CString sPath = sDir + ffd.cFileName;
+            if((ffd.dwFileAttributes&FILE_ATTRIBUTE_DIRECTORY)!=0)
+            {
+                // Don't follow junctions and symbolic links, they may form loops
+                if((ffd.dwFileAttributes&FILE_ATTRIBUTE_REPARSE_POINT)==0 &&
+                    glob_match_dir(sRelPattern.c_str(), strconv.t2w(sPath)))
+                    aDirs.push_back(sPath + _T("\\"));
+            }
+            else if(glob_match(sRelPattern.c_str(), strconv.t2w(sPath)))
             {
-                CString sFile = sDir + _T("\\");
-                sFile += ffd.cFileName;
+                GlobFile file;
+                file.m_sPath = strconv.t2w(sPath);
+                file.m_uSize = ((ULONG64)ffd.nFileSizeHigh<<32)|ffd.nFileSizeLow;
+                file.m_uTime = ((ULONG64)ffd.ftLastWriteTime.dwHighDateTime<<32)|ffd.ftLastWriteTime.dwLowDateTime;
+                file.m_uCopySize = 0;
+                aFiles.push_back(file);
+            }
+        }
+        while(FindNextFile(hFind, &ffd));
 
-                // Add file to file list.
-                ERIFileItem fi;
-                fi.m_sSrcFile = sFile;
-                fi.m_sDestFile = ffd.cFileName;
-                fi.m_sDesc = pfi->m_sDesc;
-                fi.m_bMakeCopy = pfi->m_bMakeCopy;
-                fi.m_bAllowDelete = pfi->m_bAllowDelete;
+        FindClose(hFind);
+    }
 
-                CollectSingleFile(&fi);
+    if(aFiles.empty())
+    {
+        // Nothing found
+        m_Assync.SetProgress(_T("Could not find any files matching the search template."), 0);
+        return FALSE;
+    }
 
-                // Kaneva - Bug Fix - Moved After CollectSingleFile()
-                file_list.push_back(fi);
+    // Take the newest files within the size budget
+    size_t uFound = aFiles.size();
+    glob_select(aFiles, pfi->m_uMaxTotalSize, pfi->m_uMaxFileSize);
 
-                nFileCount++;
-            }
+    if(aFiles.size()<uFound)
+    {
+        sMsg.Format(_T("Found %d files, %d newest of them are included."), (int)uFound, (int)aFiles.size());
+        m_Assync.SetProgress(sMsg, 0);
+    }
 
-            // Go to next file
-            bFound = FindNextFile(hFind, &ffd);
+    // Names of matched files are flattened, so they may coincide with each other
+    // or with names of other files in the report
+    std::set<std::wstring> aTaken;
+    for(i=0; i<file_list.size(); i++)
+        glob_unique_name(strconv.t2w(file_list[i].m_sDestFile), aTaken);
+    auto pReport = GetReport();
+    if(pReport)
+    {
+        int j;
+        for(j=0; j<pReport->GetFileItemCount(); j++)
+        {
+            ERIFileItem* pItem = pReport->GetFileItemByIndex(j);
+            if(!Utility::IsFileSearchPattern(pItem->m_sSrcFile))
+                glob_unique_name(strconv.t2w(pItem->m_sDestFile), aTaken);
         }
+    }
 
-        // Clean up
-        FindClose(hFind);
+    for(i=0; i<aFiles.size(); i++)
+    {
+        // Add file to file list. It is copied later, together with other files.
+        ERIFileItem fi;
+        fi.m_sSrcFile = sBase + CString(aFiles[i].m_sPath.c_str());
+        fi.m_sDesc = pfi->m_sDesc;
+        fi.m_bMakeCopy = pfi->m_bMakeCopy;
+        fi.m_bAllowDelete = pfi->m_bAllowDelete;
+        if(pfi->m_uMaxTotalSize!=0 || pfi->m_uMaxFileSize!=0)
+        {
+            // The file was empty; zero size limit would mean no limit at all
+            if(aFiles[i].m_uCopySize==0)
+                continue;
+
+            // The file may grow until it is copied, but the copy won't exceed the budget
+            fi.m_uMaxFileSize = aFiles[i].m_uCopySize;
+        }
+        fi.m_sDestFile = glob_unique_name(glob_dest_name(aFiles[i].m_sPath.c_str()), aTaken).c_str();
+        file_list.push_back(fi);
     }
 
     // Done
     return TRUE;
 }
 
-// This method dumps a registry key contents to an XML file
-int CErrorReportSender::DumpRegKey(CString sRegKey, CString sDestFile, CString& sErrorMsg)
+void CErrorReportSender::CollectFilesInParallel(std::vector<ERIFileItem*>& aItems)
 {
-    strconv_t strconv;
-    TiXmlDocument document;
+    FileCopyQueue queue;
+    HANDLE hThreads[MAX_FILE_COPY_THREADS];
+    int nThreads = 0;
+    int i;
 
-    // Load document if file already exists
-    // otherwise create new document.
+    queue.m_pSender = this;
+    queue.m_aItems = aItems;
+    queue.m_nNext = 0;
 
-    FILE* f = NULL;
-#if _MSC_VER<1400
-    f = _tfopen(sDestFile, _T("rb"));
-#else
-    _tfopen_s(&f, sDestFile, _T("rb"));
-#endif
-    if(f!=NULL)
+    // The current thread copies files too
+    int nMaxThreads = (int)aItems.size()<MAX_FILE_COPY_THREADS ? (int)aItems.size() : MAX_FILE_COPY_THREADS;
+    for(i=1; i<nMaxThreads; i++)
     {
-        document.LoadFile(f);
-        fclose(f);
-        f = NULL;
+        hThreads[nThreads] = CreateThread(NULL, 0, FileCopyThread, &queue, 0, NULL);
+        if(hThreads[nThreads]!=NULL)
+            nThreads++;
     }
 
-    TiXmlHandle hdoc(&document);
+    FileCopyThread(&queue);
+
+    if(nThreads!=0)
+        WaitForMultipleObjects(nThreads, hThreads, TRUE, INFINITE);
+
+    for(i=0; i<nThreads; i++)
+        CloseHandle(hThreads[i]);
+}
 
-    TiXmlElement* registry = document.RootElement();
+DWORD WINAPI CErrorReportSender::FileCopyThread(LPVOID lpParam)
+{
+    FileCopyQueue* pQueue = (FileCopyQueue*)lpParam;
 
-    if(registry==NULL)
+    for(;;)
     {
-        registry = new TiXmlElement("registry");
-        document.LinkEndChild(registry);
+        LONG nIndex = InterlockedIncrement(&pQueue->m_nNext)-1;
+        if(nIndex>=(LONG)pQueue->m_aItems.size() || pQueue->m_pSender->m_Assync.IsCancelled())
+            break;
+
+        pQueue->m_pSender->CollectSingleFile(pQueue->m_aItems[nIndex]);
     }
 
-    TiXmlNode* declaration = hdoc.Child(0).ToNode();
-    if(declaration==NULL || declaration->Type()!=TiXmlNode::TINYXML_DECLARATION)
+    return 0;
+}
+
+// Reads the Windows registry for CRegKeyDumper.
+class CRegistrySource : public CRegKeySource
+{
+public:
+
+    void* OpenKey(void* hParent, const wchar_t* szName, std::string& sError)
     {
-        TiXmlDeclaration * decl = new TiXmlDeclaration( "1.0", "UTF-8", "" );
-        document.InsertBeforeChild(registry, *decl);
-    }
+        HKEY hKey = NULL;
+
+        if(hParent==NULL)
+        {
+            if(wcscmp(szName, L"HKEY_LOCAL_MACHINE")==0)
+                return HKEY_LOCAL_MACHINE;
+            if(wcscmp(szName, L"HKEY_CURRENT_USER")==0)
+                return HKEY_CURRENT_USER;
+            return NULL;
+        }
 
-    DumpRegKey(NULL, sRegKey, registry);
+        LONG lResult = RegOpenKeyExW((HKEY)hParent, szName, 0, GENERIC_READ, &hKey);
+        if(lResult!=ERROR_SUCCESS)
+        {
+            strconv_t strconv;
+            sError = strconv.t2utf8(Utility::FormatErrorMsg(lResult));
+            return NULL;
+        }
 
-#if _MSC_VER<1400
-    f = _tfopen(sDestFile, _T("wb"));
-#else
-    _tfopen_s(&f, sDestFile, _T("wb"));
-#endif
-    if(f==NULL)
+        return hKey;
+    }
+
+    void CloseKey(void* hKey)
     {
-        sErrorMsg = _T("Error opening file for writing.");
-        return 1;
+        if(hKey!=HKEY_LOCAL_MACHINE && hKey!=HKEY_CURRENT_USER)
+            RegCloseKey((HKEY)hKey);
     }
 
-    bool bSave = document.SaveFile(f);
+    bool QueryKey(void* hKey, RegKeyInfo& info)
+    {
+        DWORD dwSubKeys = 0;
+        DWORD dwMaxSubKeyLen = 0;
+        DWORD dwValues = 0;
+        DWORD dwMaxValueNameLen = 0;
+        DWORD dwMaxValueLen = 0;
+        LONG lResult = RegQueryInfoKeyW((HKEY)hKey, NULL, 0, 0, &dwSubKeys, &dwMaxSubKeyLen,
+            0, &dwValues, &dwMaxValueNameLen, &dwMaxValueLen, NULL, NULL);
+        if(lResult!=ERROR_SUCCESS)
+            return false;
 
-    fclose(f);
+        info.m_uSubKeys = dwSubKeys;
+        info.m_uMaxSubKeyLen = dwMaxSubKeyLen;
+        info.m_uValues = dwValues;
+        info.m_uMaxValueNameLen = dwMaxValueNameLen;
+        info.m_uMaxValueLen = dwMaxValueLen;
+        return true;
+    }
 
-    if(!bSave)
+    bool EnumKey(void* hKey, unsigned uIndex, wchar_t* szName, unsigned& uNameLen)
     {
-        sErrorMsg = _T("Error saving XML document to file: ");
-        sErrorMsg += document.ErrorDesc();
+        DWORD dwLen = uNameLen;
+        LONG lResult = RegEnumKeyExW((HKEY)hKey, uIndex, szName, &dwLen, 0, NULL, 0, NULL);
+        uNameLen = dwLen;
+        return lResult==ERROR_SUCCESS;
     }
 
-    return (bSave==true)?0:1;
-}
+    bool EnumValue(void* hKey, unsigned uIndex, wchar_t* szName, unsigned& uNameLen,
+        unsigned& uType, unsigned char* pData, unsigned& uDataSize)
+    {
+        DWORD dwNameLen = uNameLen;
+        DWORD dwType = 0;
+        DWORD dwDataSize = uDataSize;
+        LONG lResult = RegEnumValueW((HKEY)hKey, uIndex, szName, &dwNameLen, 0, &dwType,
+            pData, &dwDataSize);
+        uNameLen = dwNameLen;
+        uType = dwType;
+        uDataSize = dwDataSize;
+        return lResult==ERROR_SUCCESS;
+    }
+};
 
-int CErrorReportSender::DumpRegKey(HKEY hParentKey, CString sSubKey, TiXmlElement* elem)
+// This method dumps a registry key contents to an XML file
+int CErrorReportSender::DumpRegKey(CString sRegKey, CString sDestFile, CString& sErrorMsg)
 {
     strconv_t strconv;
-    HKEY hKey = NULL;
+    CRegistrySource source;
+    CRegKeyDumper dumper;
+    CXmlWriter xml;
+    FILE* f = NULL;
+    char szTail[4096];
+    int nResult = 1;
 
-    if(hParentKey==NULL)
+    // If the file already exists (several keys are dumped to the same file),
+    // the new key is appended to it: only the end tag of the root is overwritten.
+#if _MSC_VER<1400
+    f = _tfopen(sDestFile, _T("r+b"));
+#else
+    _tfopen_s(&f, sDestFile, _T("r+b"));
+#endif
+    if(f!=NULL)
     {
-        int nSkip = 0;
-        if(sSubKey.Left(19).Compare(_T("HKEY_LOCAL_MACHINE\\"))==0)
-        {
-            hKey = HKEY_LOCAL_MACHINE;
-            nSkip = 18;
-        }
-        else if(sSubKey.Left(18).Compare(_T("HKEY_CURRENT_USER\\"))==0)
+        long nSize = 0;
+        int nTail = 0;
+        int i;
+        bool bResume = false;
+
+        if(fseek(f, 0, SEEK_END)==0 && (nSize = ftell(f))>0)
         {
-            hKey = HKEY_CURRENT_USER;
-            nSkip = 17;
+            nTail = nSize<(long)sizeof(szTail) ? (int)nSize : (int)sizeof(szTail);
+            if(fseek(f, nSize-nTail, SEEK_SET)!=0 ||
+                fread(szTail, 1, nTail, f)!=(size_t)nTail)
+                nTail = 0;
         }
-        else
+
+        for(i=nTail-11; i>=0; i--)
         {
-            return 1; // Invalid key.
+            if(memcmp(szTail+i, "</registry>", 11)==0)
+            {
+                bResume = true;
+                break;
+            }
+            if(i<=nTail-12 && memcmp(szTail+i, "<registry />", 12)==0)
+                break;
         }
 
-        CString sKey = sSubKey.Mid(0, nSkip);
-        LPCSTR szKey = strconv.t2utf8(sKey);
-        sSubKey = sSubKey.Mid(nSkip+1);
-
-        TiXmlHandle key_node = elem->FirstChild(szKey);
-        if(key_node.ToElement()==NULL)
+        if(i<0)
         {
-            key_node = new TiXmlElement("k");
-            elem->LinkEndChild(key_node.ToNode());
-            key_node.ToElement()->SetAttribute("name", szKey);
+            sErrorMsg = _T("Error appending to file: the file is not a registry dump.");
+            fclose(f);
+            return 1;
         }
 
-        DumpRegKey(hKey, sSubKey, key_node.ToElement());
+        fseek(f, nSize-nTail+i, SEEK_SET);
+        xml.Attach(f);
+        if(bResume)
+            xml.ResumeElement("registry");
+        else
+            xml.StartElement("registry");
     }
     else
     {
-        int pos = sSubKey.Find('\\');
-        CString sKey = sSubKey;
-        if(pos>0)
-            sKey = sSubKey.Mid(0, pos);
-        LPCSTR szKey = strconv.t2utf8(sKey);
-
-        TiXmlHandle key_node = elem->FirstChild(szKey);
-        if(key_node.ToElement()==NULL)
-        {
-            key_node = new TiXmlElement("k");
-            elem->LinkEndChild(key_node.ToNode());
-            key_node.ToElement()->SetAttribute("name", szKey);
-        }
-
-        if(ERROR_SUCCESS==RegOpenKeyEx(hParentKey, sKey, 0, GENERIC_READ, &hKey))
-        {
-            if(pos>0)
-            {
-                sSubKey = sSubKey.Mid(pos+1);
-                DumpRegKey(hKey, sSubKey, key_node.ToElement());
-            }
-            else
-            {
-                DWORD dwSubKeys = 0;
-                DWORD dwMaxSubKey = 0;
-                DWORD dwValues = 0;
-                DWORD dwMaxValueNameLen = 0;
-                DWORD dwMaxValueLen = 0;
-                LONG lResult = RegQueryInfoKey(hKey, NULL, 0, 0, &dwSubKeys, &dwMaxSubKey,
-                    0, &dwValues, &dwMaxValueNameLen, &dwMaxValueLen, NULL, NULL);
-                if(lResult==ERROR_SUCCESS)
-                {
-                    // Enumerate and dump subkeys
-                    int i;
-                    for(i=0; i<(int)dwSubKeys; i++)
-                    {
-                        LPWSTR szName = new WCHAR[dwMaxSubKey + 1];
-                        DWORD dwLen = dwMaxSubKey + 1;
-                        lResult = RegEnumKeyEx(hKey, i, szName, &dwLen, 0, NULL, 0, NULL);
-                        if(lResult==ERROR_SUCCESS)
-                        {
-                            DumpRegKey(hKey, CString(szName), key_node.ToElement());
-                        }
-
-                        delete [] szName;
-                    }
-
-                    // Dump key values
-                    for(i=0; i<(int)dwValues; i++)
-                    {
-                        LPWSTR szName = new WCHAR[dwMaxValueNameLen + 1];
-                        LPBYTE pData = new BYTE[dwMaxValueLen];
-                        DWORD dwNameLen = dwMaxValueNameLen + 1;
-                        DWORD dwValueLen = dwMaxValueLen;
-                        DWORD dwType = 0;
-
-                        lResult = RegEnumValue(hKey, i, szName, &dwNameLen, 0, &dwType, pData, &dwValueLen);
-                        if(lResult==ERROR_SUCCESS)
-                        {
-                            TiXmlHandle val_node = key_node.ToElement()->FirstChild(strconv.w2utf8(szName));
-                            if(val_node.ToElement()==NULL)
-                            {
-                                val_node = new TiXmlElement("v");
-                                key_node.ToElement()->LinkEndChild(val_node.ToNode());
-                            }
-
-                            val_node.ToElement()->SetAttribute("name", strconv.w2utf8(szName));
-
-                            char str[128] = "";
-                            LPCSTR szType = NULL;
-                            if(dwType==REG_BINARY)
-                                szType = "REG_BINARY";
-                            else if(dwType==REG_DWORD)
-                                szType = "REG_DWORD";
-                            else if(dwType==REG_EXPAND_SZ)
-                                szType = "REG_EXPAND_SZ";
-                            else if(dwType==REG_MULTI_SZ)
-                                szType = "REG_MULTI_SZ";
-                            else if(dwType==REG_QWORD)
-                                szType = "REG_QWORD";
-                            else if(dwType==REG_SZ)
-                                szType = "REG_SZ";
-                            else
-                            {
-#if _MSC_VER<1400
-                                sprintf(str, "Unknown type (0x%08x)", dwType);
-#else
-                                sprintf_s(str, 128, "Unknown type (0x%08x)", dwType);
-#endif
-                                szType = str;
-                            }
-
-                            val_node.ToElement()->SetAttribute("type", szType);
-
-                            if(dwType==REG_BINARY)
-                            {
-                                std::string str2;
-                                int j;
-                                for(j=0; j<(int)dwValueLen; j++)
-                                {
-                                    char num[10];
 #if _MSC_VER<1400
-                                    sprintf(num, "%02X", pData[j]);
+        f = _tfopen(sDestFile, _T("wb"));
 #else
-                                    sprintf_s(num, 10, "%02X", pData[j]);
+        _tfopen_s(&f, sDestFile, _T("wb"));
 #endif
-                                    str2 += num;
-                                    if(j<(int)dwValueLen)
-                                        str2 += " ";
-                                }
-
-                                val_node.ToElement()->SetAttribute("value", str2.c_str());
-                            }
-                            else if(dwType==REG_DWORD)
-                            {
-                                LPDWORD pdwValue = (LPDWORD)pData;
-                                char str3[64]="";
-#if _MSC_VER<1400
-                                sprintf(str3, "0x%08x (%lu)", *pdwValue, *pdwValue);
-#else
-                                sprintf_s(str3, 64, "0x%08x (%lu)", *pdwValue, *pdwValue);
-#endif
-                                val_node.ToElement()->SetAttribute("value", str3);
-                            }
-                            else if(dwType==REG_SZ || dwType==REG_EXPAND_SZ)
-                            {
-                                LPCSTR szValue = strconv.t2utf8((LPCTSTR)pData);
-                                val_node.ToElement()->SetAttribute("value", szValue);
-                            }
-                            else if(dwType==REG_MULTI_SZ)
-                            {
-                                LPCTSTR szValues = (LPCTSTR)pData;
-                                int prev = 0;
-                                int pos2 = 0;
-                                for(;;)
-                                {
-                                    if(szValues[pos2]==0)
-                                    {
-                                        CString sValue = CString(szValues+prev, pos2-prev);
-                                        LPCSTR szValue = strconv.t2utf8(sValue);
-
-                                        TiXmlHandle str_node = new TiXmlElement("str");
-                                        val_node.ToElement()->LinkEndChild(str_node.ToNode());
-                                        str_node.ToElement()->SetAttribute("value", szValue);
-
-                                        prev = pos2+1;
-                                    }
-
-                                    if(szValues[pos2]==0 && szValues[pos2+1]==0)
-                                        break; // Double-null
-
-                                    pos2++;
-                                }
-                            }
-                        }
-
-                        delete [] szName;
-                        delete [] pData;
-                    }
-                }
-            }
-
-            RegCloseKey(hKey);
-        }
-        else
+        if(f==NULL)
         {
-            CString sErrMsg = Utility::FormatErrorMsg(GetLastError());
-            LPCSTR szErrMsg = strconv.t2utf8(sErrMsg);
-            key_node.ToElement()->SetAttribute("error", szErrMsg);
+            sErrorMsg = _T("Error opening file for writing.");
+            return 1;
         }
+
+        xml.Attach(f);
+        xml.WriteDeclaration(false);
+        xml.StartElement("registry");
     }
 
-    return 0;
+    // Values are written while they are enumerated, so the dump is never kept in memory
+    dumper.SetLimits(REGDUMP_MAX_DEPTH, REGDUMP_MAX_SIZE);
+    int nDump = dumper.Dump(&source, strconv.t2w(sRegKey), xml);
+
+    xml.EndElement();
+    if(!xml.Flush())
+        sErrorMsg = _T("Error writing XML document to file.");
+    else if(nDump==REGDUMP_INVALID_KEY)
+        sErrorMsg = _T("Invalid registry key.");
+    else
+    {
+        if(nDump==REGDUMP_TRUNCATED)
+            sErrorMsg = _T("Registry key dump is truncated because the key is too big.");
+        nResult = 0;
+    }
+
+    fclose(f);
+
+    return nResult;
 }
 
 // This method calculates an MD5 hash for the file
 int CErrorReportSender::CalcFileMD5Hash(CString sFileName, CString& sMD5Hash)
 {
-    FILE* f = NULL;  // Handle to file
-    BYTE buff[512];  // Read buffer
-    MD5 md5;         // MD5 hash
-    MD5_CTX md5_ctx; // MD5 context
-    unsigned char md5_hash[16]; // MD5 hash as sequence of bytes
-    int i;
+    CFileReader reader; // File reader
+    CMD5 md5;           // MD5 hash
+    unsigned char md5_hash[MD5_DIGEST_SIZE]; // MD5 hash as sequence of bytes
+    char szHash[2*MD5_DIGEST_SIZE+1];        // MD5 hash as hex string
 
     // Clear output
     sMD5Hash.Empty();
@@ -1755,42 +1723,32 @@ int CErrorReportSender::CalcFileMD5Hash(CString sFileName, CString& sMD5Hash)
     m_Assync.SetProgress(sMsg, 0);
 
     // Open file
-#if _MSC_VER<1400
-    f = _tfopen(sFileName.GetBuffer(0), _T("rb"));
-#else
-    _tfopen_s(&f, sFileName.GetBuffer(0), _T("rb"));
-#endif
-
-    // Check if file has been opened
-    if(f==NULL)
+    if(!reader.Open(sFileName))
         return -1;
 
-    // Init MD5 context
-    md5.MD5Init(&md5_ctx);
-
     // Read file contents and update MD5 hash as each portion is being read
-    while(!feof(f))
+    for(;;)
     {
-        size_t count = fread(buff, 1, 512, f);
-        if(count>0)
-        {
-            md5.MD5Update(&md5_ctx, buff, (unsigned int)count);
-        }
+        const BYTE* pData = NULL;
+        DWORD dwBytesRead = 0;
+        if(!reader.Read(pData, dwBytesRead))
+            return -1;
+
+        if(dwBytesRead==0)
+            break;
+
+        md5.Update(pData, dwBytesRead);
     }
 
     // Close file
-    fclose(f);
+    reader.Close();
 
     // Finalize MD5 hash calculation
-    md5.MD5Final(md5_hash, &md5_ctx);
+    md5.Final(md5_hash);
 
     // Format hash as a string
-    for(i=0; i<16; i++)
-    {
-        CString number;
-        number.Format(_T("%02x"), md5_hash[i]);
-        sMD5Hash += number;
-    }
+    hash_to_hex(md5_hash, sizeof(md5_hash), szHash);
+    sMD5Hash = szHash;
 
     CString sMsg2;
     sMsg2.Format(_T(" ... %s"), (LPCTSTR)sMD5Hash);
@@ -1882,8 +1840,8 @@ BOOL CErrorReportSender::CompressReportFiles(CErrorReportInfo* eri)
     CString sMsg;
     LONG64 lTotalSize = 0;
     LONG64 lTotalCompressed = 0;
-    BYTE buff[1024];
-    HANDLE hFile = INVALID_HANDLE_VALUE;
+    CFileReader reader;
+    CString sReportDir = eri->GetErrorReportDirName() + _T("\\");
     std::map<CString, ERIFileItem>::iterator it;
     FILE* f = NULL;
     CString sMD5Hash;
@@ -1942,10 +1900,13 @@ BOOL CErrorReportSender::CompressReportFiles(CErrorReportInfo* eri)
         sMsg.Format(_T("Compressing file %s"), (LPCTSTR) sDstFileName);
         m_Assync.SetProgress(sMsg, 0, false);
 
+        // Files in the report folder are ours, so they can be locked against
+        // writing and read through memory mapping. Files not copied on crash
+        // may still be written by the application.
+        BOOL bOwnFile = sFileName.Left(sReportDir.GetLength()).CompareNoCase(sReportDir)==0;
+
         // Open file for reading
-        hFile = CreateFile(sFileName,
-            GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, NULL, NULL);
-        if(hFile==INVALID_HANDLE_VALUE)
+        if(!reader.Open(sFileName, bOwnFile) && !(bOwnFile && reader.Open(sFileName, FALSE)))
         {
             sMsg.Format(_T("CErrorReportSender::CompressReportFiles - Couldn't open file %s"), (LPCTSTR)sFileName);
             m_Assync.SetProgress(sMsg, 0, false);
@@ -1954,7 +1915,7 @@ BOOL CErrorReportSender::CompressReportFiles(CErrorReportInfo* eri)
 
         // Get file information.
         BY_HANDLE_FILE_INFORMATION fi;
-        GetFileInformationByHandle(hFile, &fi);
+        GetFileInformationByHandle(reader.GetHandle(), &fi);
 
         // Convert file creation time to system file time.
         SYSTEMTIME st;
@@ -1990,13 +1951,14 @@ BOOL CErrorReportSender::CompressReportFiles(CErrorReportInfo* eri)
                 goto cleanup;
 
             // Read a portion of source file
+            const BYTE* pData = NULL;
             DWORD dwBytesRead=0;
-            BOOL bRead = ReadFile(hFile, buff, 1024, &dwBytesRead, NULL);
+            BOOL bRead = reader.Read(pData, dwBytesRead);
             if(!bRead || dwBytesRead==0)
                 break;
 
             // Write a portion into destination file
-            int res = zipWriteInFileInZip(hZip, buff, dwBytesRead);
+            int res = zipWriteInFileInZip(hZip, pData, dwBytesRead);
             if(res!=0)
             {
                 zipCloseFileInZip(hZip);
@@ -2015,8 +1977,7 @@ BOOL CErrorReportSender::CompressReportFiles(CErrorReportInfo* eri)
 
         // Close file
         zipCloseFileInZip(hZip);
-        CloseHandle(hFile);
-        hFile = INVALID_HANDLE_VALUE;
+        reader.Close();
     }
 
     // Close ZIP archive
@@ -2068,8 +2029,7 @@ cleanup:
     if(hZip!=NULL)
         zipClose(hZip, NULL);
 
-    if(hFile!=INVALID_HANDLE_VALUE)
-        CloseHandle(hFile);
+    reader.Close();
 
     if(f!=NULL)
         fclose(f);
@@ -2097,16 +2057,26 @@ cleanup:
 // This method sends the error report over the Internet
 BOOL CErrorReportSender::SendReport()
 {
-    // Kaneva - Added
-    auto pReport = GetReport();
-    if (!pReport) return FALSE;
-
-    int status = 1;
+    // Deliver the current report using the shared sender state
+    DeliveryJob job;
+    job.m_nReport = GetCurReportIndex();
+    job.m_sZipName = m_sZipName;
+    job.m_pAssync = &m_Assync;
+    job.m_pHttpSender = &m_HttpSender;
+    job.m_pOwner = this;
 
     InitLog();
 
-    m_Assync.SetProgress(_T("[sending_report]"), 0);
+    BOOL bSend = SendReport(&job);
+
+    // Done
+    m_nStatus = job.m_nStatus;
+    m_Assync.SetCompleted(job.m_nStatus);
+    return bSend;
+}
 
+void CErrorReportSender::GetTransportOrder(std::vector<int>& aOrder)
+{
     // Arrange priorities in reverse order
     std::multimap<int, int> order;
 
@@ -2119,42 +2089,81 @@ BOOL CErrorReportSender::SendReport()
     std::pair<int, int> pair1(m_CrashInfo.m_uPriorities[CR_HTTP], CR_HTTP);
     order.insert(pair1);
 
+    aOrder.clear();
     std::multimap<int, int>::reverse_iterator rit;
+    for(rit=order.rbegin(); rit!=order.rend(); rit++)
+        aOrder.push_back(rit->second);
+}
+
+BOOL CErrorReportSender::AcquireTransport(int nTransport, AssyncNotification* pAssync)
+{
+    // Wait for a free slot, checking for cancellation from time to time
+    for(;;)
+    {
+        if(WaitForSingleObject(m_hTransportSlots[nTransport], 100)==WAIT_OBJECT_0)
+            return TRUE;
+
+        if(pAssync->IsCancelled())
+            return FALSE;
+    }
+}
+
+BOOL CErrorReportSender::SendReport(DeliveryJob* pJob)
+{
+    // Kaneva - Added
+    auto pReport = GetReport(pJob->m_nReport);
+    if (!pReport) return FALSE;
+
+    AssyncNotification* pAssync = pJob->m_pAssync;
+    int status = 1;
+
+    pAssync->SetProgress(_T("[sending_report]"), 0);
+
+    std::vector<int> aOrder;
+    GetTransportOrder(aOrder);
 
     // Walk through priorities
-    for(rit=order.rbegin(); rit!=order.rend(); rit++)
+    size_t i;
+    for(i=0; i<aOrder.size(); i++)
     {
-        m_Assync.SetProgress(_T("[sending_attempt]"), 0);
-        m_SendAttempt++;
+        pAssync->SetProgress(_T("[sending_attempt]"), 0);
+        InterlockedIncrement(&m_SendAttempt);
 
         // Check if operation was cancelled.
-        if(m_Assync.IsCancelled()){ break; }
+        if(pAssync->IsCancelled()){ break; }
+
+        int id = aOrder[i];
 
-        int id = rit->second;
+        // Wait until the transport can take one more report
+        if(!AcquireTransport(id, pAssync)){ break; }
 
         BOOL bResult = FALSE;
 
         // Send the report
         if(id==CR_HTTP)
-            bResult = SendOverHTTP();
+            bResult = SendOverHTTP(pJob);
         else if(id==CR_SMTP)
-            bResult = SendOverSMTP();
+            bResult = SendOverSMTP(pJob);
         else if(id==CR_SMAPI)
-            bResult = SendOverSMAPI();
+            bResult = SendOverSMAPI(pJob);
 
         // Check if this attempt has failed
         if(bResult==FALSE)
+        {
+            ReleaseSemaphore(m_hTransportSlots[id], 1, NULL);
             continue;
+        }
 
         // If currently sending through Simple MAPI, do not wait for completion
         if(id==CR_SMAPI && bResult==TRUE)
         {
+            ReleaseSemaphore(m_hTransportSlots[id], 1, NULL);
             status = 0;
             break;
         }
 
         // else wait for completion
-        if(0==m_Assync.WaitForCompletion())
+        if(0==pAssync->WaitForCompletion())
         {
             status = 0;
 
@@ -2169,163 +2178,276 @@ BOOL CErrorReportSender::SendReport()
                 m_EmailMsg.RemoveRecipient(0);
             }
 
+            ReleaseSemaphore(m_hTransportSlots[id], 1, NULL);
             break;
         }
+
+        ReleaseSemaphore(m_hTransportSlots[id], 1, NULL);
     }
 
+    CompleteReport(pJob, status);
+
+    pJob->m_nStatus = status;
+    return status==0?TRUE:FALSE;
+}
+
+void CErrorReportSender::CompleteReport(DeliveryJob* pJob, int status)
+{
+    auto pReport = GetReport(pJob->m_nReport);
+    if (!pReport) return;
+
+    AssyncNotification* pAssync = pJob->m_pAssync;
+
     // Remove compressed ZIP file and MD5 file
-    Utility::RecycleFile(m_sZipName, true);
-    Utility::RecycleFile(m_sZipName+_T(".md5"), true);
+    Utility::RecycleFile(pJob->m_sZipName, true);
+    Utility::RecycleFile(pJob->m_sZipName+_T(".md5"), true);
+
+    // Deliveries finish on their own threads, while the queue index
+    // and the blob store are shared by all of them
+    CAutoLock lock(&m_csReportState);
 
     // Check status
     if(status==0)
     {
         // Success
-        m_Assync.SetProgress(_T("[status_success]"), 0);
+        pAssync->SetProgress(_T("[status_success]"), 0);
         pReport->SetDeliveryStatus(DELIVERED);
         // Delete report files
+        m_CrashInfo.RemoveFromQueueIndex(pReport);
         Utility::RecycleFile(pReport->GetErrorReportDirName(), true);
+        m_CrashInfo.GetBlobStore()->CollectGarbage();
     }
     else
     {
         // Some error occurred
         pReport->SetDeliveryStatus(FAILED);
-        m_Assync.SetProgress(_T("[status_failed]"), 0);
+        pAssync->SetProgress(_T("[status_failed]"), 0);
 
         // Check if we should store files for later delivery or we should remove them
         if(!m_CrashInfo.m_bQueueEnabled)
         {
             // Delete report files
+            m_CrashInfo.RemoveFromQueueIndex(pReport);
             Utility::RecycleFile(pReport->GetErrorReportDirName(), true);
         }
     }
 
-    // Done
-    m_nStatus = status;
-    m_Assync.SetCompleted(status);
-    return status==0?TRUE:FALSE;
+    pJob->m_nStatus = status;
 }
 
 // This method sends the report over HTTP request
-BOOL CErrorReportSender::SendOverHTTP()
+BOOL CErrorReportSender::SendOverHTTP(DeliveryJob* pJob)
 {
-    strconv_t strconv;
+    AssyncNotification* pAssync = pJob->m_pAssync;
 
     // Check our config - should we send the report over HTTP or not?
     if(m_CrashInfo.m_uPriorities[CR_HTTP]==CR_NEGATIVE_PRIORITY)
     {
-        m_Assync.SetProgress(_T("Sending error report over HTTP is disabled (negative priority); skipping."), 0);
+        pAssync->SetProgress(_T("Sending error report over HTTP is disabled (negative priority); skipping."), 0);
         return FALSE;
     }
 
     // Check URL
     if(m_CrashInfo.m_sUrl.IsEmpty())
     {
-        m_Assync.SetProgress(_T("No URL specified for sending error report over HTTP; skipping."), 0);
+        pAssync->SetProgress(_T("No URL specified for sending error report over HTTP; skipping."), 0);
         return FALSE;
     }
 
     // Update progress
-    m_Assync.SetProgress(_T("Sending error report over HTTP..."), 0);
-    m_Assync.SetProgress(_T("Preparing HTTP request data..."), 0);
+    pAssync->SetProgress(_T("Sending error report over HTTP..."), 0);
+    pAssync->SetProgress(_T("Preparing HTTP request data..."), 0);
 
     // Create HTTP request
     CHttpRequest request;
     request.m_sUrl = m_CrashInfo.m_sUrl;
 
+    if(!AddReportToHttpRequest(pJob, _T("%s"), _T("crashrpt"), request))
+        return FALSE;
+
+    // Send HTTP request assynchronously
+    BOOL bSend = pJob->m_pHttpSender->SendAssync(request, pAssync);
+    return bSend;
+}
+
+BOOL CErrorReportSender::AddReportToHttpRequest(DeliveryJob* pJob, LPCTSTR szNameFmt,
+                                                LPCTSTR szFileName, CHttpRequest& request)
+{
+    strconv_t strconv;
+    std::map<CString, std::string> aFields;
+
     // Kaneva - Added
-    auto pReport = GetReport();
+    auto pReport = GetReport(pJob->m_nReport);
     if (!pReport) return FALSE;
 
     // Fill in the request fields
     CString sNum;
     sNum.Format(_T("%d"), CRASHRPT_VER);
-    request.m_aTextFields[_T("crashrptver")] = strconv.t2utf8(sNum);
-    request.m_aTextFields[_T("appname")] = strconv.t2utf8(pReport->GetAppName());
-    request.m_aTextFields[_T("appversion")] = strconv.t2utf8(pReport->GetAppVersion());
-    request.m_aTextFields[_T("crashguid")] = strconv.t2utf8(pReport->GetCrashGUID());
-    request.m_aTextFields[_T("emailfrom")] = strconv.t2utf8(pReport->GetEmailFrom());
-    request.m_aTextFields[_T("emailsubject")] = strconv.t2utf8(m_CrashInfo.m_sEmailSubject);
-    request.m_aTextFields[_T("description")] = strconv.t2utf8(pReport->GetProblemDescription());
-    request.m_aTextFields[_T("exceptionmodule")] = strconv.t2utf8(pReport->GetExceptionModule());
-    request.m_aTextFields[_T("exceptionmoduleversion")] = strconv.t2utf8(pReport->GetExceptionModuleVersion());
+    aFields[_T("crashrptver")] = strconv.t2utf8(sNum);
+    aFields[_T("appname")] = strconv.t2utf8(pReport->GetAppName());
+    aFields[_T("appversion")] = strconv.t2utf8(pReport->GetAppVersion());
+    aFields[_T("crashguid")] = strconv.t2utf8(pReport->GetCrashGUID());
+    aFields[_T("emailfrom")] = strconv.t2utf8(pReport->GetEmailFrom());
+    aFields[_T("emailsubject")] = strconv.t2utf8(m_CrashInfo.m_sEmailSubject);
+    aFields[_T("description")] = strconv.t2utf8(pReport->GetProblemDescription());
+    aFields[_T("exceptionmodule")] = strconv.t2utf8(pReport->GetExceptionModule());
+    aFields[_T("exceptionmoduleversion")] = strconv.t2utf8(pReport->GetExceptionModuleVersion());
     sNum.Format(_T("%I64u"), pReport->GetExceptionModuleBase());
-    request.m_aTextFields[_T("exceptionmodulebase")] = strconv.t2utf8(sNum);
+    aFields[_T("exceptionmodulebase")] = strconv.t2utf8(sNum);
     sNum.Format(_T("%I64u"), pReport->GetExceptionAddress());
-    request.m_aTextFields[_T("exceptionaddress")] = strconv.t2utf8(sNum);
+    aFields[_T("exceptionaddress")] = strconv.t2utf8(sNum);
 
     // Add an MD5 hash of file attachment
     CString sMD5Hash;
-    CalcFileMD5Hash(m_sZipName, sMD5Hash);
-    request.m_aTextFields[_T("md5")] = strconv.t2utf8(sMD5Hash);
+    CalcFileMD5Hash(pJob->m_sZipName, sMD5Hash);
+    aFields[_T("md5")] = strconv.t2utf8(sMD5Hash);
+
+    std::map<CString, std::string>::iterator it;
+    for(it=aFields.begin(); it!=aFields.end(); it++)
+    {
+        CString sName;
+        sName.Format(szNameFmt, (LPCTSTR)it->first);
+        request.m_aTextFields[sName] = it->second;
+    }
 
     // Set content type
     CHttpRequestFile f;
-    f.m_sSrcFileName = m_sZipName;
+    f.m_sSrcFileName = pJob->m_sZipName;
     f.m_sContentType = _T("application/zip");
-    request.m_aIncludedFiles[_T("crashrpt")] = f;
+    request.m_aIncludedFiles[szFileName] = f;
 
-    // Send HTTP request assynchronously
-    BOOL bSend = m_HttpSender.SendAssync(request, &m_Assync);
-    return bSend;
+    return TRUE;
 }
 
-int CErrorReportSender::Base64EncodeAttachment(CString sFileName,
-                                               std::string& sEncodedFileData)
+BOOL CErrorReportSender::SendBatch(DeliveryJob* pJob)
 {
-    strconv_t strconv;
+    AssyncNotification* pAssync = pJob->m_pAssync;
+    std::vector<int> aStatus(pJob->m_aBatch.size(), -1); // -1 means no acknowledgement
+    CString sMsg;
+    size_t i;
 
-    int uFileSize = 0;
-    BYTE* uchFileData = NULL;
-    struct _stat st;
+    sMsg.Format(_T("Sending %d error reports in one HTTP request..."), (int)pJob->m_aBatch.size());
+    pAssync->SetProgress(sMsg, 0);
 
-    // Get file information
-    int nResult = _tstat(sFileName, &st);
-    if(nResult != 0)
-        return 1;  // File not found.
+    if(AcquireTransport(CR_HTTP, pAssync))
+    {
+        if(SendBatchOverHTTP(pJob) && 0==pAssync->WaitForCompletion())
+            ParseBatchAcks(pJob, aStatus);
+        else
+            pAssync->SetProgress(_T("Batch has not been accepted, sending the reports one by one."), 0);
 
-    // Allocate buffer of file size
-    uFileSize = (int)st.st_size;
-    uchFileData = new BYTE[uFileSize];
+        ReleaseSemaphore(m_hTransportSlots[CR_HTTP], 1, NULL);
+    }
 
-    // Read file data to buffer.
-    FILE* f = NULL;
-#if _MSC_VER<1400
-    f = _tfopen(sFileName, _T("rb"));
-#else
-    /*errno_t err = */_tfopen_s(&f, sFileName, _T("rb"));
-#endif
+    for(i=0; i<pJob->m_aBatch.size(); i++)
+    {
+        DeliveryJob* pReportJob = pJob->m_aBatch[i];
 
-    if(!f || fread(uchFileData, uFileSize, 1, f)!=1)
+        if(aStatus[i]==200)
+            CompleteReport(pReportJob, 0);
+        else if(aStatus[i]>0 || pAssync->IsCancelled())
+        {
+            // The server has refused this report
+            CompleteReport(pReportJob, 1);
+        }
+        else
+        {
+            // The report hasn't reached the server, send it on its own
+            SendReport(pReportJob);
+        }
+    }
+
+    pJob->m_nStatus = 0;
+    return TRUE;
+}
+
+BOOL CErrorReportSender::SendBatchOverHTTP(DeliveryJob* pJob)
+{
+    strconv_t strconv;
+    AssyncNotification* pAssync = pJob->m_pAssync;
+
+    pAssync->SetProgress(_T("Preparing HTTP request data..."), 0);
+
+    // Create HTTP request
+    CHttpRequest request;
+    request.m_sUrl = m_CrashInfo.m_sUrl;
+    request.m_bBatch = TRUE;
+
+    // The manifest lists index and crash GUID of each report
+    CString sManifest;
+    size_t i;
+    for(i=0; i<pJob->m_aBatch.size(); i++)
     {
-        m_Assync.SetProgress(_T("CErrorReportSender::Base64EncodeAttachment() - fread FAILED"), 0);
-        delete [] uchFileData;
-        uchFileData = NULL;
-        fclose(f);
-        return 2; // Coudln't read file data.
+        DeliveryJob* pReportJob = pJob->m_aBatch[i];
+        CErrorReportInfo* eri = GetReport(pReportJob->m_nReport);
+        if(eri==NULL)
+            return FALSE;
+
+        CString sNameFmt;
+        CString sFileName;
+        sNameFmt.Format(_T("report[%d][%%s]"), (int)i);
+        sFileName.Format(_T("crashrpt[%d]"), (int)i);
+        if(!AddReportToHttpRequest(pReportJob, sNameFmt, sFileName, request))
+            return FALSE;
+
+        CString sLine;
+        sLine.Format(_T("%d %s\n"), (int)i, (LPCTSTR)eri->GetCrashGUID());
+        sManifest += sLine;
     }
 
-    // Close file
-    fclose(f);
+    request.m_aTextFields[_T("batchmanifest")] = strconv.t2utf8(sManifest);
 
-    // BASE-64 ecode data
-    sEncodedFileData = base64_encode(uchFileData, uFileSize);
+    // Send HTTP request assynchronously
+    return pJob->m_pHttpSender->SendAssync(request, pAssync);
+}
 
-    // Clean up
-    delete [] uchFileData;
+void CErrorReportSender::ParseBatchAcks(DeliveryJob* pJob, std::vector<int>& aStatus)
+{
+    strconv_t strconv;
+    std::string sBody = pJob->m_pHttpSender->GetResponseBody();
 
-    // OK.
-    return 0;
+    // Each line is "<crash GUID> <status code> <message>"
+    size_t uPos = 0;
+    while(uPos<sBody.length())
+    {
+        size_t uEOL = sBody.find('\n', uPos);
+        if(uEOL==std::string::npos)
+            uEOL = sBody.length();
+        std::string sLine = sBody.substr(uPos, uEOL-uPos);
+        uPos = uEOL+1;
+
+        size_t uSpace = sLine.find(' ');
+        if(uSpace==std::string::npos)
+            continue;
+
+        CString sGUID = strconv.utf82t(sLine.substr(0, uSpace).c_str());
+        int nCode = atoi(sLine.c_str()+uSpace+1);
+
+        size_t i;
+        for(i=0; i<pJob->m_aBatch.size(); i++)
+        {
+            DeliveryJob* pReportJob = pJob->m_aBatch[i];
+            CErrorReportInfo* eri = GetReport(pReportJob->m_nReport);
+            if(eri==NULL || eri->GetCrashGUID().CompareNoCase(sGUID)!=0)
+                continue;
+
+            aStatus[i] = nCode;
+
+            CString sMsg;
+            sMsg.Format(_T("Server response for report: %s"), (LPCTSTR)strconv.utf82t(sLine.c_str()));
+            pReportJob->m_pAssync->SetProgress(sMsg, 0);
+        }
+    }
 }
 
 // This method formats the E-mail message text
-CString CErrorReportSender::FormatEmailText()
+CString CErrorReportSender::FormatEmailText(DeliveryJob* pJob)
 {
     // Kaneva - Added
-    auto pReport = GetReport();
+    auto pReport = GetReport(pJob->m_nReport);
     if (!pReport) return "";
 
-    CString sFileTitle = m_sZipName;
+    CString sFileTitle = pJob->m_sZipName;
     sFileTitle.Replace('/', '\\');
     int pos = sFileTitle.ReverseFind('\\');
     if(pos>=0)
@@ -2360,10 +2482,12 @@ CString CErrorReportSender::FormatEmailText()
 }
 
 // This method sends the report over SMTP
-BOOL CErrorReportSender::SendOverSMTP()
+BOOL CErrorReportSender::SendOverSMTP(DeliveryJob* pJob)
 {
+    AssyncNotification* pAssync = pJob->m_pAssync;
+
     // Kaneva - Added
-    auto pReport = GetReport();
+    auto pReport = GetReport(pJob->m_nReport);
     if (!pReport) return FALSE;
 
     strconv_t strconv;
@@ -2371,14 +2495,14 @@ BOOL CErrorReportSender::SendOverSMTP()
     // Check our config - should we send the report over SMTP or not?
     if(m_CrashInfo.m_uPriorities[CR_SMTP]==CR_NEGATIVE_PRIORITY)
     {
-        m_Assync.SetProgress(_T("Sending error report over SMTP is disabled (negative priority); skipping."), 0);
+        pAssync->SetProgress(_T("Sending error report over SMTP is disabled (negative priority); skipping."), 0);
         return FALSE;
     }
 
     // Check recipient's email
     if(m_CrashInfo.m_sEmailTo.IsEmpty())
     {
-        m_Assync.SetProgress(_T("No E-mail address is specified for sending error report over SMTP; skipping."), 0);
+        pAssync->SetProgress(_T("No E-mail address is specified for sending error report over SMTP; skipping."), 0);
         return FALSE;
     }
 
@@ -2400,16 +2524,16 @@ BOOL CErrorReportSender::SendOverSMTP()
     m_EmailMsg.SetSubject(m_CrashInfo.m_sEmailSubject);
 
     if(m_CrashInfo.m_sEmailText.IsEmpty())
-        m_EmailMsg.SetText(FormatEmailText());
+        m_EmailMsg.SetText(FormatEmailText(pJob));
     else
         m_EmailMsg.SetText(m_CrashInfo.m_sEmailText);
 
-    m_EmailMsg.AddAttachment(m_sZipName);
+    m_EmailMsg.AddAttachment(pJob->m_sZipName);
 
     // Create and attach MD5 hash file
     CString sErrorRptHash;
-    CalcFileMD5Hash(m_sZipName, sErrorRptHash);
-    CString sFileTitle = m_sZipName;
+    CalcFileMD5Hash(pJob->m_sZipName, sErrorRptHash);
+    CString sFileTitle = pJob->m_sZipName;
     sFileTitle.Replace('/', '\\');
     int pos = sFileTitle.ReverseFind('\\');
     if(pos>=0)
@@ -2436,16 +2560,18 @@ BOOL CErrorReportSender::SendOverSMTP()
     m_SmtpClient.SetAuthParams(m_CrashInfo.m_sSmtpLogin, m_CrashInfo.m_sSmtpPassword);
 
     // Send mail assynchronously
-    int res = m_SmtpClient.SendEmailAssync(&m_EmailMsg, &m_Assync);
+    int res = m_SmtpClient.SendEmailAssync(&m_EmailMsg, pAssync);
 
     return (res==0);
 }
 
 // This method sends the report over Simple MAPI
-BOOL CErrorReportSender::SendOverSMAPI()
+BOOL CErrorReportSender::SendOverSMAPI(DeliveryJob* pJob)
 {
+    AssyncNotification* pAssync = pJob->m_pAssync;
+
     // Kaneva - Added
-    auto pReport = GetReport();
+    auto pReport = GetReport(pJob->m_nReport);
     if (!pReport) return FALSE;
 
     strconv_t strconv;
@@ -2453,37 +2579,38 @@ BOOL CErrorReportSender::SendOverSMAPI()
     // Check our config - should we send the report over Simple MAPI or not?
     if(m_CrashInfo.m_uPriorities[CR_SMAPI]==CR_NEGATIVE_PRIORITY)
     {
-        m_Assync.SetProgress(_T("Sending error report over SMAPI is disabled (negative priority); skipping."), 0);
+        pAssync->SetProgress(_T("Sending error report over SMAPI is disabled (negative priority); skipping."), 0);
         return FALSE;
     }
 
     // Check recipient's email address
     if(m_CrashInfo.m_sEmailTo.IsEmpty())
     {
-        m_Assync.SetProgress(_T("No E-mail address is specified for sending error report over Simple MAPI; skipping."), 0);
+        pAssync->SetProgress(_T("No E-mail address is specified for sending error report over Simple MAPI; skipping."), 0);
         return FALSE;
     }
 
     // Do not send if we are in silent mode
     if(m_CrashInfo.m_bSilentMode)
     {
-        m_Assync.SetProgress(_T("Simple MAPI may require user interaction (not acceptable for non-GUI mode); skipping."), 0);
+        pAssync->SetProgress(_T("Simple MAPI may require user interaction (not acceptable for non-GUI mode); skipping."), 0);
         return FALSE;
     }
 
     // Update progress
-    m_Assync.SetProgress(_T("Sending error report using Simple MAPI"), 0, false);
-    m_Assync.SetProgress(_T("Initializing MAPI"), 1);
+    pAssync->SetProgress(_T("Sending error report using Simple MAPI"), 0, false);
+    pAssync->SetProgress(_T("Initializing MAPI"), 1);
 
     // Initialize MAPI
     BOOL bMAPIInit = m_MapiSender.MAPIInitialize();
     if(!bMAPIInit)
     {
-        m_Assync.SetProgress(m_MapiSender.GetLastErrorMsg(), 100, false);
+        pAssync->SetProgress(m_MapiSender.GetLastErrorMsg(), 100, false);
         return FALSE;
     }
 
-    // Request user confirmation
+    // Request user confirmation. The GUI watches the main notification object
+    // for this request, so it is used even if the delivery has its own one.
     if(m_SendAttempt!=0 && m_MailClientConfirm==NOT_CONFIRMED_YET)
     {
         m_Assync.SetProgress(_T("[confirm_launch_email_client]"), 0);
@@ -2492,7 +2619,7 @@ BOOL CErrorReportSender::SendOverSMAPI()
         if(confirm!=0)
         {
             m_MailClientConfirm = NOT_ALLOWED;
-            m_Assync.SetProgress(_T("Cancelled by user"), 100, false);
+            pAssync->SetProgress(_T("Cancelled by user"), 100, false);
             return FALSE;
         }
         else
@@ -2503,7 +2630,7 @@ BOOL CErrorReportSender::SendOverSMAPI()
 
     if(m_MailClientConfirm != ALLOWED)
     {
-        m_Assync.SetProgress(_T("Not allowed to launch E-mail client."), 100, false);
+        pAssync->SetProgress(_T("Not allowed to launch E-mail client."), 100, false);
         return FALSE;
     }
 
@@ -2513,7 +2640,7 @@ BOOL CErrorReportSender::SendOverSMAPI()
     m_MapiSender.DetectMailClient(sMailClientName);
 
     msg.Format(_T("Launching the default email client (%s)"), (LPCTSTR) sMailClientName);
-    m_Assync.SetProgress(msg, 10);
+    pAssync->SetProgress(msg, 10);
 
     // Fill in email fields
     m_MapiSender.SetFrom(pReport->GetEmailFrom());
@@ -2530,21 +2657,21 @@ BOOL CErrorReportSender::SendOverSMAPI()
     };
 
     m_MapiSender.SetSubject(m_CrashInfo.m_sEmailSubject);
-    CString sFileTitle = m_sZipName;
+    CString sFileTitle = pJob->m_sZipName;
     sFileTitle.Replace('/', '\\');
     int pos = sFileTitle.ReverseFind('\\');
     if(pos>=0)
         sFileTitle = sFileTitle.Mid(pos+1);
 
     if(m_CrashInfo.m_sEmailText.IsEmpty())
-        m_MapiSender.SetMessage(FormatEmailText());
+        m_MapiSender.SetMessage(FormatEmailText(pJob));
     else
         m_MapiSender.SetMessage(m_CrashInfo.m_sEmailText);
-    m_MapiSender.AddAttachment(m_sZipName, sFileTitle);
+    m_MapiSender.AddAttachment(pJob->m_sZipName, sFileTitle);
 
     // Create and attach MD5 hash file
     CString sErrorRptHash;
-    CalcFileMD5Hash(m_sZipName, sErrorRptHash);
+    CalcFileMD5Hash(pJob->m_sZipName, sErrorRptHash);
     sFileTitle += _T(".md5");
     CString sTempDir;
     Utility::getTempDirectory(sTempDir);
@@ -2562,16 +2689,35 @@ BOOL CErrorReportSender::SendOverSMAPI()
     // Send email
     BOOL bSend = m_MapiSender.Send();
     if(!bSend)
-        m_Assync.SetProgress(m_MapiSender.GetLastErrorMsg(), 100, false);
+        pAssync->SetProgress(m_MapiSender.GetLastErrorMsg(), 100, false);
     else
-        m_Assync.SetProgress(_T("Sent OK"), 100, false);
+        pAssync->SetProgress(_T("Sent OK"), 100, false);
 
     return bSend;
 }
 
+BOOL CErrorReportSender::LoadLangFile()
+{
+    FILE* f = NULL;
+    _tfopen_s(&f, m_CrashInfo.m_sLangFileName, _T("rb"));
+    if(f==NULL)
+        return FALSE;
+
+    bool bLoad = m_LangFile.Load(f);
+    fclose(f);
+
+    return bLoad?TRUE:FALSE;
+}
+
 CString CErrorReportSender::GetLangStr(LPCTSTR szSection, LPCTSTR szName)
 {
-    return Utility::GetINIString(m_CrashInfo.m_sLangFileName, szSection, szName);
+    // The lang file is read once; if it couldn't be parsed, read it the old way
+    if(!m_LangFile.IsLoaded())
+        return Utility::GetINIString(m_CrashInfo.m_sLangFileName, szSection, szName);
+
+    strconv_t strconv;
+    const wchar_t* szValue = m_LangFile.GetString(strconv.t2w(szSection), strconv.t2w(szName));
+    return CString(szValue!=NULL ? szValue : L"");
 }
 
 void CErrorReportSender::ExportReport(LPCTSTR szOutFileName)
@@ -2580,24 +2726,159 @@ void CErrorReportSender::ExportReport(LPCTSTR szOutFileName)
     DoWork(COMPRESS_REPORT);
 }
 
+// Creates an empty batch of reports.
+static DeliveryJob* NewBatch(CErrorReportSender* pOwner)
+{
+    DeliveryJob* pBatch = new DeliveryJob();
+    pBatch->m_pAssync = &pBatch->m_Assync;
+    pBatch->m_pHttpSender = &pBatch->m_HttpSender;
+    pBatch->m_pOwner = pOwner;
+    return pBatch;
+}
+
+// Returns the batch ready to be sent. A single report is sent on its own.
+static DeliveryJob* CloseBatch(DeliveryJob* pBatch)
+{
+    if(pBatch->m_aBatch.size()!=1)
+        return pBatch;
+
+    DeliveryJob* pJob = pBatch->m_aBatch[0];
+    delete pBatch;
+    return pJob;
+}
+
 BOOL CErrorReportSender::SendRecentReports()
 {
-    // This method sends all queued error reports in turn.
+    // This method sends all queued error reports. While some reports are
+    // being uploaded, the next one is compressed, so the network and the
+    // disk are kept busy at the same time.
     m_bSendingNow = TRUE;
     m_bErrors = FALSE;
 
-    // Send error reports in turn
-    BOOL bSend = TRUE;
-    int nReport = -1;
-    while(bSend)
+    int nMaxDeliveries = GetMaxConcurrentDeliveries();
+    std::vector<DeliveryJob*> aRunning; // Deliveries in progress
+    DeliveryJob* pReady = NULL;         // Compressed report waiting for a free slot
+    DeliveryJob* pBatch = NULL;         // Small reports being collected into a batch
+
+    // Count reports to send (for progress indication)
+    int nTotal = 0;
+    int nFinished = 0;
+    int i;
+    for(i=0; i<m_CrashInfo.GetReportCount(); i++)
     {
-        // Ask GUI for hint what report to send next.
-        // This is needed to send error report in the same order they appear in the list
-        // (list may be sorted in different order).
-        if(IsWindow(m_hWndNotify))
-            nReport = (int)::SendMessage(m_hWndNotify, WM_NEXT_ITEM_HINT, 0, 0);
+        CErrorReportInfo* eri = GetReport(i);
+        if(eri && eri->IsSelected() && eri->GetDeliveryStatus()==PENDING)
+            nTotal++;
+    }
+
+    for(;;)
+    {
+        BOOL bCancelled = m_Assync.IsCancelled();
+
+        // Start the prepared delivery when there is a free slot
+        if(pReady!=NULL && !bCancelled && (int)aRunning.size()<nMaxDeliveries)
+        {
+            if(StartDelivery(pReady))
+                aRunning.push_back(pReady);
+            else
+                nFinished += FinishDelivery(pReady);
+            pReady = NULL;
+        }
 
-        bSend = SendNextReport(nReport);
+        // Prepare the next report while others are being sent
+        if(pReady==NULL && !bCancelled)
+        {
+            int nReport = GetNextPendingReport();
+            if(nReport>=0)
+            {
+                DeliveryJob* pJob = PrepareDelivery(nReport);
+                if(pJob==NULL)
+                    nFinished++; // Couldn't compress the report
+                else if(CanAddToBatch(pBatch, pJob))
+                {
+                    // Small reports go to the server several at a time
+                    if(pBatch==NULL)
+                        pBatch = NewBatch(this);
+                    pBatch->m_aBatch.push_back(pJob);
+                    pBatch->m_uZipSize += pJob->m_uZipSize;
+                }
+                else if(pBatch!=NULL && CanAddToBatch(NULL, pJob))
+                {
+                    // The batch is full, send it and start the next one
+                    pReady = CloseBatch(pBatch);
+                    pBatch = NewBatch(this);
+                    pBatch->m_aBatch.push_back(pJob);
+                    pBatch->m_uZipSize = pJob->m_uZipSize;
+                }
+                else
+                    pReady = pJob;
+                continue;
+            }
+
+            // No more reports to add to the batch
+            if(pBatch!=NULL)
+            {
+                pReady = CloseBatch(pBatch);
+                pBatch = NULL;
+                continue;
+            }
+        }
+
+        if(bCancelled && pReady!=NULL)
+        {
+            // The report has been compressed, but not sent yet; return it to the queue
+            CancelDelivery(pReady);
+            pReady = NULL;
+        }
+
+        if(bCancelled && pBatch!=NULL)
+        {
+            CancelDelivery(pBatch);
+            pBatch = NULL;
+        }
+
+        if(aRunning.empty())
+        {
+            if(pReady==NULL && pBatch==NULL)
+                break; // Nothing more to do
+            continue;
+        }
+
+        if(bCancelled)
+        {
+            // Let running deliveries know they should stop
+            size_t j;
+            for(j=0; j<aRunning.size(); j++)
+            {
+                aRunning[j]->m_Assync.Cancel();
+
+                size_t k;
+                for(k=0; k<aRunning[j]->m_aBatch.size(); k++)
+                    aRunning[j]->m_aBatch[k]->m_Assync.Cancel();
+            }
+        }
+
+        // Wait for a delivery to finish (or for the next time to check for cancellation)
+        std::vector<HANDLE> aThreads;
+        size_t j;
+        for(j=0; j<aRunning.size(); j++)
+            aThreads.push_back(aRunning[j]->m_hThread);
+
+        DWORD dwWaitResult = WaitForMultipleObjects((DWORD)aThreads.size(),
+            &aThreads[0], FALSE, 100);
+
+        for(j=0; j<aRunning.size(); j++)
+            ForwardDeliveryLog(aRunning[j]);
+
+        if(dwWaitResult>=WAIT_OBJECT_0 && dwWaitResult<WAIT_OBJECT_0+aThreads.size())
+        {
+            DeliveryJob* pJob = aRunning[dwWaitResult-WAIT_OBJECT_0];
+            aRunning.erase(aRunning.begin()+(dwWaitResult-WAIT_OBJECT_0));
+            nFinished += FinishDelivery(pJob);
+
+            if(nTotal>0)
+                m_Assync.SetProgress(100*nFinished/nTotal, false);
+        }
     }
 
     // Close log
@@ -2612,60 +2893,75 @@ BOOL CErrorReportSender::SendRecentReports()
     return TRUE;
 }
 
-BOOL CErrorReportSender::SendNextReport(int nReport)
+int CErrorReportSender::GetMaxConcurrentDeliveries()
 {
-    if(m_Assync.IsCancelled())
-        return FALSE;	// Return FALSE to prevent sending next report
+    // The reports go to the transport of the highest priority first, so its limit applies
+    std::vector<int> aOrder;
+    GetTransportOrder(aOrder);
 
-    CErrorReportInfo* eri = NULL;
-    if(nReport != -1)
+    size_t i;
+    for(i=0; i<aOrder.size(); i++)
     {
-        eri = GetReport(nReport);
-        if(eri && (!eri->IsSelected() || eri->GetDeliveryStatus()!=PENDING))
-            eri = NULL;
+        int id = aOrder[i];
+        if(m_CrashInfo.m_uPriorities[id]==CR_NEGATIVE_PRIORITY)
+            continue;
+
+        if(id==CR_HTTP && !m_CrashInfo.m_sUrl.IsEmpty())
+            return MAX_HTTP_DELIVERIES;
+        if(id==CR_SMTP && !m_CrashInfo.m_sEmailTo.IsEmpty())
+            return MAX_SMTP_DELIVERIES;
+        if(id==CR_SMAPI && !m_CrashInfo.m_sEmailTo.IsEmpty())
+            return MAX_SMAPI_DELIVERIES;
     }
 
-    if(eri==NULL)
-    {
-        // Walk through error reports
-        int i;
-        for(i=0; i<m_CrashInfo.GetReportCount(); i++)
-        {
-            // Kaneva - Added
-            auto pReport = GetReport(i);
-            if (!pReport)
-                continue;
+    return 1;
+}
 
-            if(!pReport->IsSelected())
-                continue; // Skip this (not selected item)
+int CErrorReportSender::GetNextPendingReport()
+{
+    // Ask GUI for hint what report to send next.
+    // This is needed to send error report in the same order they appear in the list
+    // (list may be sorted in different order).
+    int nReport = -1;
+    if(IsWindow(m_hWndNotify))
+        nReport = (int)::SendMessage(m_hWndNotify, WM_NEXT_ITEM_HINT, 0, 0);
 
-            if(pReport->GetDeliveryStatus()==PENDING)
-            {
-                nReport = i;
-                eri = pReport;
-                break;
-            }
-        }
+    if(nReport != -1)
+    {
+        CErrorReportInfo* eri = GetReport(nReport);
+        if(eri && eri->IsSelected() && eri->GetDeliveryStatus()==PENDING)
+            return nReport;
     }
 
-    if(eri==NULL)
+    // Walk through error reports
+    int i;
+    for(i=0; i<m_CrashInfo.GetReportCount(); i++)
     {
-        // Return FALSE to prevent sending next report
-        return FALSE;
+        // Kaneva - Added
+        auto pReport = GetReport(i);
+        if (!pReport)
+            continue;
+
+        if(!pReport->IsSelected())
+            continue; // Skip this (not selected item)
+
+        if(pReport->GetDeliveryStatus()==PENDING)
+            return i;
     }
 
+    return -1;
+}
+
+DeliveryJob* CErrorReportSender::PrepareDelivery(int nReport)
+{
+    auto pReport = GetReport(nReport);
+    if (!pReport) return NULL;
+
     // Save current report index
     SetCurReportIndex(nReport);
 
-    // Kaneva - Added
-    auto pReport = GetReport();
-    if (!pReport) return FALSE;
-
     pReport->SetDeliveryStatus(INPROGRESS);
-
-    // Notify GUI about current item change
-    if(IsWindow(m_hWndNotify))
-        ::PostMessage(m_hWndNotify, WM_ITEM_STATUS_CHANGED, (WPARAM)GetCurReportIndex(), (LPARAM)pReport->GetDeliveryStatus());
+    NotifyItemStatus(nReport);
 
     // Add a message to log
     CString sMsg;
@@ -2673,23 +2969,179 @@ BOOL CErrorReportSender::SendNextReport(int nReport)
                     (LPCTSTR) pReport->GetErrorReportDirName());
     m_Assync.SetProgress(sMsg, 0, false);
 
-    // Send report
-    if(!DoWork(COMPRESS_REPORT|SEND_REPORT))
+    // Compress error report files
+    if(!CompressReportFiles(pReport))
     {
         m_bErrors = TRUE;
         pReport->SetDeliveryStatus(FAILED);
+        NotifyItemStatus(nReport);
+        return NULL;
+    }
+
+    DeliveryJob* pJob = new DeliveryJob();
+    pJob->m_nReport = nReport;
+    pJob->m_sZipName = m_sZipName;
+    pJob->m_uZipSize = Utility::GetFileSize(m_sZipName);
+    pJob->m_pAssync = &pJob->m_Assync;
+    pJob->m_pHttpSender = &pJob->m_HttpSender;
+    pJob->m_pOwner = this;
+    return pJob;
+}
+
+BOOL CErrorReportSender::CanAddToBatch(DeliveryJob* pBatch, DeliveryJob* pJob)
+{
+    // Batches are sent only if the server has told it accepts them
+    // and HTTP is the transport tried first
+    if(m_nBatchMaxCount<2 || pJob->m_uZipSize==0 || pJob->m_uZipSize>BATCH_MAX_REPORT_SIZE)
+        return FALSE;
+
+    std::vector<int> aOrder;
+    GetTransportOrder(aOrder);
+    if(aOrder.empty() || aOrder[0]!=CR_HTTP ||
+        m_CrashInfo.m_uPriorities[CR_HTTP]==CR_NEGATIVE_PRIORITY || m_CrashInfo.m_sUrl.IsEmpty())
+        return FALSE;
+
+    if(pBatch==NULL)
+        return TRUE;
+
+    // Check the batch limits
+    ULONG64 uMaxSize = BATCH_MAX_SIZE;
+    if(m_uBatchMaxSize!=0 && m_uBatchMaxSize<uMaxSize)
+        uMaxSize = m_uBatchMaxSize;
+
+    int nMaxCount = m_nBatchMaxCount<BATCH_MAX_REPORTS ? m_nBatchMaxCount : BATCH_MAX_REPORTS;
+
+    return (int)pBatch->m_aBatch.size()<nMaxCount &&
+        pBatch->m_uZipSize+pJob->m_uZipSize<=uMaxSize;
+}
+
+void CErrorReportSender::CancelDelivery(DeliveryJob* pJob)
+{
+    size_t i;
+    for(i=0; i<pJob->m_aBatch.size(); i++)
+        CancelDelivery(pJob->m_aBatch[i]);
+
+    if(pJob->m_nReport>=0)
+    {
+        Utility::RecycleFile(pJob->m_sZipName, true);
+        CErrorReportInfo* eri = GetReport(pJob->m_nReport);
+        if(eri)
+            eri->SetDeliveryStatus(PENDING);
+        NotifyItemStatus(pJob->m_nReport);
+    }
+
+    delete pJob;
+}
+
+BOOL CErrorReportSender::StartDelivery(DeliveryJob* pJob)
+{
+    pJob->m_hThread = CreateThread(NULL, 0, DeliveryThread, (LPVOID)pJob, 0, NULL);
+    if(pJob->m_hThread==NULL)
+    {
+        m_Assync.SetProgress(_T("Error creating delivery thread."), 0);
+        Utility::RecycleFile(pJob->m_sZipName, true);
+
+        size_t i;
+        for(i=0; i<pJob->m_aBatch.size(); i++)
+            Utility::RecycleFile(pJob->m_aBatch[i]->m_sZipName, true);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+DWORD WINAPI CErrorReportSender::DeliveryThread(LPVOID lpParam)
+{
+    DeliveryJob* pJob = (DeliveryJob*)lpParam;
+    if(!pJob->m_aBatch.empty())
+        pJob->m_pOwner->SendBatch(pJob);
+    else
+        pJob->m_pOwner->SendReport(pJob);
+    return 0;
+}
+
+void CErrorReportSender::ForwardDeliveryLog(DeliveryJob* pJob)
+{
+    // Prefix the messages with the report index, as they may interleave
+    // with messages of other deliveries.
+    int nProgressPct = 0;
+    std::vector<CString> msg_log;
+    pJob->m_Assync.GetProgress(nProgressPct, msg_log);
+
+    size_t i;
+    for(i=0; i<msg_log.size(); i++)
+    {
+        CString sMsg;
+        if(pJob->m_nReport<0)
+            sMsg.Format(_T("[batch] %s"), (LPCTSTR)msg_log[i]);
+        else
+            sMsg.Format(_T("[#%d] %s"), pJob->m_nReport, (LPCTSTR)msg_log[i]);
+        m_Assync.SetProgress(sMsg, 0);
+    }
+
+    for(i=0; i<pJob->m_aBatch.size(); i++)
+        ForwardDeliveryLog(pJob->m_aBatch[i]);
+}
+
+int CErrorReportSender::FinishDelivery(DeliveryJob* pJob)
+{
+    if(pJob->m_hThread!=NULL)
+    {
+        WaitForSingleObject(pJob->m_hThread, INFINITE);
+        CloseHandle(pJob->m_hThread);
+        ForwardDeliveryLog(pJob);
+    }
+
+    // Each response of the server tells whether it accepts batches
+    int nBatchMaxCount = 0;
+    ULONG64 uBatchMaxSize = 0;
+    if(pJob->m_HttpSender.GetBatchLimits(nBatchMaxCount, uBatchMaxSize))
+    {
+        m_nBatchMaxCount = nBatchMaxCount;
+        m_uBatchMaxSize = uBatchMaxSize;
+    }
+
+    if(!pJob->m_aBatch.empty())
+    {
+        int nFinished = 0;
+        size_t i;
+        for(i=0; i<pJob->m_aBatch.size(); i++)
+            nFinished += FinishDelivery(pJob->m_aBatch[i]);
+
+        delete pJob;
+        return nFinished;
+    }
+
+    CAutoLock lock(&m_csReportState);
+
+    CErrorReportInfo* eri = GetReport(pJob->m_nReport);
+    if(pJob->m_nStatus==0)
+    {
+        int nDailyReportCount = m_CrashInfo.GetDailyReportCount();
+        m_CrashInfo.SetDailyReportCount(nDailyReportCount + 1);
     }
     else
     {
-        pReport->SetDeliveryStatus(DELIVERED);
+        m_bErrors = TRUE;
+        if(eri)
+            eri->SetDeliveryStatus(FAILED);
     }
 
-    // Notify GUI about current item change
-    if(IsWindow(m_hWndNotify))
-        ::PostMessage(m_hWndNotify, WM_ITEM_STATUS_CHANGED, (WPARAM)GetCurReportIndex(), (LPARAM)eri->GetDeliveryStatus());
+    NotifyItemStatus(pJob->m_nReport);
 
-    // Return TRUE to indicate next report can be sent
-    return TRUE;
+    delete pJob;
+    return 1;
+}
+
+void CErrorReportSender::NotifyItemStatus(int nReport)
+{
+    CErrorReportInfo* eri = GetReport(nReport);
+    if(eri==NULL)
+        return;
+
+    // Notify GUI about item change
+    if(IsWindow(m_hWndNotify))
+        ::PostMessage(m_hWndNotify, WM_ITEM_STATUS_CHANGED, (WPARAM)nReport, (LPARAM)eri->GetDeliveryStatus());
 }
 
 BOOL CErrorReportSender::IsSendingNow()
@@ -2815,7 +3267,8 @@ BOOL CErrorReportSender::RecordVideo()
     if(!m_VideoRec.Init(pReport->GetErrorReportDirName(),
                 type, m_CrashInfo.m_dwProcessId, m_CrashInfo.m_nVideoDuration,
                 m_CrashInfo.m_nVideoFrameInterval,
-                quality, &m_CrashInfo.m_DesiredFrameSize))
+                quality, &m_CrashInfo.m_DesiredFrameSize,
+                (ULONG64)m_CrashInfo.m_nVideoMaxMemory*1024*1024))
     {
         // Add a message to log
         sMsg.Format(_T("Error initializing video recorder."));
@@ -2829,7 +3282,7 @@ BOOL CErrorReportSender::RecordVideo()
         // Wait for a while
         BOOL bExitLoop = WAIT_OBJECT_0==WaitForSingleObject(hEvent, m_CrashInfo.m_nVideoFrameInterval);
 
-        // This will record a single BMP file
+        // This will record a single video frame
         m_VideoRec.RecordVideoFrame();
 
         if(bExitLoop)
@@ -2894,7 +3347,7 @@ BOOL CErrorReportSender::EncodeVideo()
     ERIFileItem fi;
     fi.m_sSrcFile = m_VideoRec.GetOutFile();
     fi.m_sDestFile = Utility::GetFileName(fi.m_sSrcFile);
-    fi.m_sDesc = Utility::GetINIString(m_CrashInfo.m_sLangFileName, _T("DetailDlg"), _T("DescVideo"));
+    fi.m_sDesc = GetLangStr(_T("DetailDlg"), _T("DescVideo"));
     fi.m_bAllowDelete = bAllowDelete;
     pReport->AddFileItem(&fi);
 
@@ -16,6 +16,8 @@ be found in the Authors.txt file in the root of the source tree.
 #include "tinyxml.h"
 #include "CrashInfoReader.h"
 #include "VideoRec.h"
+#include "LangFile.h"
+#include "CritSec.h"
 
 // Action type
 enum ActionType
@@ -40,6 +42,55 @@ enum eMailClientConfirm
 #define WM_ITEM_STATUS_CHANGED (WM_USER+1024)
 #define WM_DELIVERY_COMPLETE   (WM_USER+1025)
 
+// How many queued reports may be delivered at the same time over each transport.
+#define MAX_HTTP_DELIVERIES  2 // WinINet's default per-server connection limit on older systems.
+#define MAX_SMTP_DELIVERIES  1 // The SMTP client and the e-mail message are shared.
+#define MAX_SMAPI_DELIVERIES 1 // Simple MAPI may require user interaction.
+
+// Queued reports with ZIP archive up to this size are sent in batches, several
+// in one HTTP request, if the server accepts batches.
+#define BATCH_MAX_REPORT_SIZE (256*1024)
+// Upper limits of a batch (the server may advertise lower ones).
+#define BATCH_MAX_REPORTS     16
+#define BATCH_MAX_SIZE        (4*1024*1024)
+
+// How many files are copied to the error report folder at the same time.
+#define MAX_FILE_COPY_THREADS 4
+
+// Limits of a registry key dump: how deep subkeys are enumerated and how big the XML may grow.
+#define REGDUMP_MAX_DEPTH 32
+#define REGDUMP_MAX_SIZE  (16*1024*1024)
+
+class CErrorReportSender;
+
+// Files being copied to the error report folder by several threads.
+struct FileCopyQueue
+{
+    CErrorReportSender* m_pSender;      // Owner.
+    std::vector<ERIFileItem*> m_aItems; // Files to copy.
+    volatile LONG m_nNext;              // Index of the next file to take.
+};
+
+// State of a single error report delivery. Queued reports may be delivered
+// concurrently, so everything that changes while a report is being sent lives here.
+struct DeliveryJob
+{
+    // Constructor.
+    DeliveryJob();
+
+    int m_nReport;                     // Index of the report being delivered (-1 for a batch).
+    CString m_sZipName;                // ZIP archive to send.
+    ULONG64 m_uZipSize;                // Size of ZIP archive.
+    AssyncNotification* m_pAssync;     // Receives progress of this delivery.
+    CHttpRequestSender* m_pHttpSender; // Used to send report over HTTP.
+    CErrorReportSender* m_pOwner;      // The sender that has started this delivery.
+    HANDLE m_hThread;                  // Delivery thread (for concurrent deliveries only).
+    int m_nStatus;                     // Delivery status (0 on success).
+    AssyncNotification m_Assync;       // Own notification object of a concurrent delivery.
+    CHttpRequestSender m_HttpSender;   // Own HTTP sender of a concurrent delivery.
+    std::vector<DeliveryJob*> m_aBatch; // Reports sent in one HTTP request (for a batch).
+};
+
 // The main class that collects crash report files, packs them
 // into a ZIP archive and sends the error report.
 class CErrorReportSender
@@ -103,6 +154,9 @@ public:
 	// Returns a localized string from lang file.
 	CString GetLangStr(LPCTSTR szSection, LPCTSTR szName);
 
+	// Reads all strings of the lang file into memory.
+	BOOL LoadLangFile();
+
 	// Allows to specify file name for exporting error report.
     void SetExportFlag(BOOL bExport, CString sExportFile);
 
@@ -138,9 +192,15 @@ private:
 	// Includes a single file to crash report
 	BOOL CollectSingleFile(ERIFileItem* pfi);
 
-	// Includes all files matching search pattern to crash report
+	// Finds files matching search pattern and adds them to the list (they are copied later)
 	BOOL CollectFilesBySearchTemplate(ERIFileItem* pfi, std::vector<ERIFileItem>& file_list);
 
+	// Includes files to crash report using several threads
+	void CollectFilesInParallel(std::vector<ERIFileItem*>& aItems);
+
+	// File copy thread proc.
+	static DWORD WINAPI FileCopyThread(LPVOID lpParam);
+
     // Calculates MD5 hash for a file.
     int CalcFileMD5Hash(CString sFileName, CString& sMD5Hash);
 
@@ -162,9 +222,6 @@ private:
     // Creates crash description XML file.
     BOOL CreateCrashDescriptionXML(CErrorReportInfo& eri);
 
-    // Adds an element to XML file.
-    void AddElemToXML(CString sName, CString sValue, TiXmlNode* root);
-
     // Minidump callback.
     static BOOL CALLBACK MiniDumpCallback(PVOID CallbackParam, PMINIDUMP_CALLBACK_INPUT CallbackInput,
         PMINIDUMP_CALLBACK_OUTPUT CallbackOutput);
@@ -179,9 +236,6 @@ private:
 	// Dumps registry key to the XML file.
     int DumpRegKey(CString sRegKey, CString sDestFile, CString& sErrorMsg);
 
-	// Used internally for dumping a registry key.
-    int DumpRegKey(HKEY hKeyParent, CString sSubKey, TiXmlElement* elem);
-
     // Packs error report files to ZIP archive.
     BOOL CompressReportFiles(CErrorReportInfo* eri);
 
@@ -191,43 +245,100 @@ private:
     // Sends error report.
     BOOL SendReport();
 
+    // Sends error report using the transports in order of their priorities.
+    BOOL SendReport(DeliveryJob* pJob);
+
+    // Returns the transports (CR_HTTP, CR_SMTP, CR_SMAPI) in order of their priorities.
+    void GetTransportOrder(std::vector<int>& aOrder);
+
+    // Blocks until the transport can take one more delivery. Returns FALSE if cancelled.
+    BOOL AcquireTransport(int nTransport, AssyncNotification* pAssync);
+
+    // Updates the report status after delivery and removes its files.
+    void CompleteReport(DeliveryJob* pJob, int status);
+
     // Sends error report over HTTP.
-    BOOL SendOverHTTP();
+    BOOL SendOverHTTP(DeliveryJob* pJob);
 
-    // Encodes attachment file with Base-64 encoding.
-    int Base64EncodeAttachment(CString sFileName, std::string& sEncodedFileData);
+    // Adds the report's text fields and ZIP archive to HTTP request. Field names
+    // are formatted with szNameFmt and the archive is attached as szFileName.
+    BOOL AddReportToHttpRequest(DeliveryJob* pJob, LPCTSTR szNameFmt,
+        LPCTSTR szFileName, CHttpRequest& request);
+
+    // Sends a batch of reports in one HTTP request; the reports the server hasn't
+    // acknowledged are then sent one by one.
+    BOOL SendBatch(DeliveryJob* pJob);
+
+    // Sends a batch of reports over HTTP.
+    BOOL SendBatchOverHTTP(DeliveryJob* pJob);
+
+    // Reads status codes of reports from acknowledgements of the batch.
+    void ParseBatchAcks(DeliveryJob* pJob, std::vector<int>& aStatus);
 
     // Formats Email text.
-    CString FormatEmailText();
+    CString FormatEmailText(DeliveryJob* pJob);
 
     // Sends error report over SMTP.
-    BOOL SendOverSMTP();
+    BOOL SendOverSMTP(DeliveryJob* pJob);
 
     // Sends error report over Simple MAPI.
-    BOOL SendOverSMAPI();
+    BOOL SendOverSMAPI(DeliveryJob* pJob);
 
-	// Sends all recently queued error reports in turn.
+	// Sends all recently queued error reports, several at a time.
 	BOOL SendRecentReports();
 
-	// Send the next queued report.
-	BOOL SendNextReport(int nReport);
+	// Returns how many queued reports may be delivered at the same time.
+	int GetMaxConcurrentDeliveries();
+
+	// Returns the index of the next queued report to send or -1 if there are no more.
+	int GetNextPendingReport();
+
+	// Compresses the queued report and prepares its delivery. Returns NULL on failure.
+	DeliveryJob* PrepareDelivery(int nReport);
+
+	// Checks if the prepared report can join the batch (pBatch may be NULL).
+	BOOL CanAddToBatch(DeliveryJob* pBatch, DeliveryJob* pJob);
+
+	// Returns the prepared, but not started delivery to the queue and destroys the job.
+	void CancelDelivery(DeliveryJob* pJob);
+
+	// Starts the delivery thread.
+	BOOL StartDelivery(DeliveryJob* pJob);
+
+	// Delivery thread proc.
+	static DWORD WINAPI DeliveryThread(LPVOID lpParam);
+
+	// Copies messages of the delivery to the main log.
+	void ForwardDeliveryLog(DeliveryJob* pJob);
+
+	// Updates report status after its delivery has finished and destroys the job.
+	// Returns the number of reports finished.
+	int FinishDelivery(DeliveryJob* pJob);
+
+	// Notifies GUI about the change of report delivery status.
+	void NotifyItemStatus(int nReport);
 
 	// Internal variables
 	static CErrorReportSender* m_pInstance; // Singleton
 	CCrashInfoReader m_CrashInfo;       // Contains crash information.
+	CLangFile m_LangFile;               // Strings of the language file.
 	CVideoRecorder m_VideoRec;            // Video recorder.
 	CString m_sErrorMsg;                // Last error message.
 	HWND m_hWndNotify;                  // Notification window.
     int m_nStatus;                      // Error report sending status.
     int m_nCurReport;                   // Index of current error report.
     HANDLE m_hThread;                   // Handle to the worker thread.
-    int m_SendAttempt;                  // Number of current sending attempt.
+    LONG m_SendAttempt;                 // Number of current sending attempt.
     AssyncNotification m_Assync;        // Used for communication with the main thread.
     CEmailMessage m_EmailMsg;           // Email message to send.
     CSmtpClient m_SmtpClient;           // Used to send report over SMTP.
     CHttpRequestSender m_HttpSender;    // Used to send report over HTTP.
     CMailMsg m_MapiSender;              // Used to send report over SMAPI.
     CString m_sZipName;                 // Name of the ZIP archive to send.
+    HANDLE m_hTransportSlots[3];        // Semaphores limiting concurrent deliveries per transport.
+    int m_nBatchMaxCount;               // How many reports the server accepts in a batch (0 if none).
+    ULONG64 m_uBatchMaxSize;            // Size limit of a batch set by the server (0 if none).
+    CCritSec m_csReportState;           // Serializes report status, queue index and blob store updates.
     int m_Action;                       // Current assynchronous action.
     BOOL m_bExport;                     // If TRUE than export should be performed.
     CString m_sExportFileName;          // File name for exporting.
@@ -0,0 +1,287 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+#include "FileGlob.h"
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+#include <wctype.h>
+
+// A path component: pointer and length.
+struct GlobPart
+{
+    const wchar_t* m_p;
+    size_t m_uLen;
+};
+
+static bool IsSeparator(wchar_t c)
+{
+    return c==L'\\' || c==L'/';
+}
+
+static bool HasWildcards(const wchar_t* p, size_t uLen)
+{
+    size_t i;
+    for(i=0; i<uLen; i++)
+    {
+        if(p[i]==L'*' || p[i]==L'?')
+            return true;
+    }
+    return false;
+}
+
+// Splits a path into non-empty components.
+static void SplitPath(const wchar_t* szPath, std::vector<GlobPart>& aParts)
+{
+    aParts.clear();
+    const wchar_t* p = szPath;
+    while(*p!=0)
+    {
+        while(IsSeparator(*p))
+            p++;
+        const wchar_t* pStart = p;
+        while(*p!=0 && !IsSeparator(*p))
+            p++;
+        if(p!=pStart)
+        {
+            GlobPart part = {pStart, (size_t)(p-pStart)};
+            aParts.push_back(part);
+        }
+    }
+}
+
+// Matches a single path component against a pattern component.
+static bool MatchPart(const GlobPart& pat, const GlobPart& str)
+{
+    size_t p = 0;
+    size_t s = 0;
+    size_t uStarPat = (size_t)-1;
+    size_t uStarStr = 0;
+
+    while(s<str.m_uLen)
+    {
+        if(p<pat.m_uLen && pat.m_p[p]==L'*')
+        {
+            // Remember the position to return to if the rest doesn't match
+            uStarPat = p++;
+            uStarStr = s;
+        }
+        else if(p<pat.m_uLen && (pat.m_p[p]==L'?' ||
+            towlower(pat.m_p[p])==towlower(str.m_p[s])))
+        {
+            p++;
+            s++;
+        }
+        else if(uStarPat!=(size_t)-1)
+        {
+            // Let the last star take one more character
+            p = uStarPat+1;
+            s = ++uStarStr;
+        }
+        else
+            return false;
+    }
+
+    while(p<pat.m_uLen && pat.m_p[p]==L'*')
+        p++;
+
+    // As in Windows, a trailing ".*" matches a name without extension too,
+    // so that "*.*" matches any name
+    if(p+2==pat.m_uLen && pat.m_p[p]==L'.' && pat.m_p[p+1]==L'*')
+        return true;
+
+    return p==pat.m_uLen;
+}
+
+static bool IsRecursivePart(const GlobPart& part)
+{
+    return part.m_uLen==2 && part.m_p[0]==L'*' && part.m_p[1]==L'*';
+}
+
+// Matches path components starting at j against pattern components starting at i.
+// In directory mode the path may end before the pattern does.
+static bool MatchParts(const std::vector<GlobPart>& aPat, size_t i,
+                       const std::vector<GlobPart>& aPath, size_t j, bool bDir)
+{
+    for(;;)
+    {
+        if(i==aPat.size())
+            return !bDir && j==aPath.size();
+
+        if(j==aPath.size())
+            return bDir;
+
+        if(IsRecursivePart(aPat[i]))
+        {
+            // Skip repeated "**"
+            while(i+1<aPat.size() && IsRecursivePart(aPat[i+1]))
+                i++;
+
+            // Any directory below may contain matching files
+            if(bDir)
+                return true;
+
+            // Match zero or more directories
+            size_t k;
+            for(k=j; k<=aPath.size(); k++)
+            {
+                if(MatchParts(aPat, i+1, aPath, k, false))
+                    return true;
+            }
+            return false;
+        }
+
+        if(!MatchPart(aPat[i], aPath[j]))
+            return false;
+
+        i++;
+        j++;
+    }
+}
+
+void glob_split(const wchar_t* szPattern, std::wstring& sBaseDir, std::wstring& sRelPattern)
+{
+    const wchar_t* p = szPattern;
+    const wchar_t* pBaseEnd = szPattern;
+
+    // The "\\?\" prefix of long paths is not a wildcard
+    if(p[0]==L'\\' && p[1]==L'\\' && p[2]==L'?' && p[3]==L'\\')
+    {
+        p += 4;
+        pBaseEnd = p;
+    }
+
+    for(;;)
+    {
+        const wchar_t* pStart = p;
+        while(*p!=0 && !IsSeparator(*p))
+            p++;
+
+        // The last component is always a part of the pattern
+        if(*p==0 || HasWildcards(pStart, p-pStart))
+            break;
+
+        pBaseEnd = p;
+        while(IsSeparator(*p))
+            p++;
+        if(*p==0)
+            break;
+    }
+
+    sBaseDir.assign(szPattern, pBaseEnd-szPattern);
+
+    while(IsSeparator(*pBaseEnd))
+        pBaseEnd++;
+    sRelPattern = pBaseEnd;
+}
+
+bool glob_match(const wchar_t* szRelPattern, const wchar_t* szRelPath)
+{
+    std::vector<GlobPart> aPat;
+    std::vector<GlobPart> aPath;
+    SplitPath(szRelPattern, aPat);
+    SplitPath(szRelPath, aPath);
+    return MatchParts(aPat, 0, aPath, 0, false);
+}
+
+bool glob_match_dir(const wchar_t* szRelPattern, const wchar_t* szRelDir)
+{
+    std::vector<GlobPart> aPat;
+    std::vector<GlobPart> aPath;
+    SplitPath(szRelPattern, aPat);
+    SplitPath(szRelDir, aPath);
+    return MatchParts(aPat, 0, aPath, 0, true);
+}
+
+// Newer files first; files of the same age in path order, so the result is stable.
+static bool IsNewer(const GlobFile& a, const GlobFile& b)
+{
+    if(a.m_uTime!=b.m_uTime)
+        return a.m_uTime>b.m_uTime;
+    return a.m_sPath<b.m_sPath;
+}
+
+size_t glob_select(std::vector<GlobFile>& aFiles, unsigned long long uMaxTotalSize,
+                   unsigned long long uMaxFileSize)
+{
+    std::sort(aFiles.begin(), aFiles.end(), IsNewer);
+
+    unsigned long long uTotal = 0;
+    size_t i;
+    for(i=0; i<aFiles.size(); i++)
+    {
+        GlobFile& file = aFiles[i];
+        file.m_uCopySize = file.m_uSize;
+        if(uMaxFileSize!=0 && file.m_uCopySize>uMaxFileSize)
+            file.m_uCopySize = uMaxFileSize;
+
+        if(uMaxTotalSize!=0)
+        {
+            unsigned long long uLeft = uMaxTotalSize-uTotal;
+            if(uLeft==0)
+                break;
+
+            if(file.m_uCopySize>uLeft)
+            {
+                // The last file that fits partially
+                file.m_uCopySize = uLeft;
+                i++;
+                break;
+            }
+        }
+
+        uTotal += file.m_uCopySize;
+    }
+
+    aFiles.resize(i);
+    return i;
+}
+
+std::wstring glob_dest_name(const wchar_t* szRelPath)
+{
+    std::vector<GlobPart> aParts;
+    std::wstring sName;
+    size_t i;
+
+    SplitPath(szRelPath, aParts);
+    for(i=0; i<aParts.size(); i++)
+    {
+        if(i!=0)
+            sName += L'_';
+        sName.append(aParts[i].m_p, aParts[i].m_uLen);
+    }
+    return sName;
+}
+
+std::wstring glob_unique_name(const std::wstring& sName, std::set<std::wstring>& aTaken)
+{
+    std::wstring sResult = sName;
+    int nSuffix = 1;
+
+    for(;;)
+    {
+        std::wstring sKey = sResult;
+        size_t i;
+        for(i=0; i<sKey.length(); i++)
+            sKey[i] = (wchar_t)towlower(sKey[i]);
+
+        if(aTaken.insert(sKey).second)
+            return sResult;
+
+        // Add the suffix before the extension: app.log, app_2.log, app_3.log...
+        char szSuffix[16];
+        sprintf(szSuffix, "_%d", ++nSuffix);
+        std::wstring sSuffix(szSuffix, szSuffix+strlen(szSuffix));
+        size_t uDot = sName.rfind(L'.');
+        if(uDot==std::wstring::npos || uDot==0)
+            uDot = sName.length();
+        sResult = sName.substr(0, uDot)+sSuffix+sName.substr(uDot);
+    }
+}
@@ -0,0 +1,60 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+// File: FileGlob.h
+// Description: File search patterns with recursive wildcards (like C:\Logs\**\*.log) and
+// selection of the matched files within a size budget.
+// This file doesn't depend on Windows headers, so it can be built and tested anywhere.
+
+#pragma once
+
+#include <set>
+#include <string>
+#include <vector>
+
+// A file matching a search pattern.
+struct GlobFile
+{
+    std::wstring m_sPath;               // Path relative to the base directory of the pattern.
+    unsigned long long m_uSize;         // File size.
+    unsigned long long m_uTime;         // Last write time (larger is newer).
+    unsigned long long m_uCopySize;     // Bytes to take from the end of the file (set by glob_select).
+};
+
+// Splits a search pattern into the base directory, which has no wildcards, and the rest
+// of the pattern, relative to the base directory. Both '\' and '/' separate directories.
+void glob_split(const wchar_t* szPattern, std::wstring& sBaseDir, std::wstring& sRelPattern);
+
+// Returns true if the relative path matches the relative pattern. '*' and '?' match
+// within a single path component; a "**" component matches any number of directories.
+// Case is ignored. As in Windows, a trailing ".*" also matches names without extension.
+bool glob_match(const wchar_t* szRelPattern, const wchar_t* szRelPath);
+
+// Returns true if files inside of the directory (given by its relative path)
+// may match the relative pattern, so the directory should be searched.
+bool glob_match_dir(const wchar_t* szRelPattern, const wchar_t* szRelDir);
+
+// Orders files newest first and selects the ones fitting in uMaxTotalSize bytes.
+// Files larger than uMaxFileSize contribute only their last uMaxFileSize bytes;
+// the file that doesn't fit in the remaining budget contributes its last bytes
+// and ends the selection. Zero means no limit. Unselected files are removed;
+// returns the count of selected files.
+size_t glob_select(std::vector<GlobFile>& aFiles, unsigned long long uMaxTotalSize,
+                   unsigned long long uMaxFileSize);
+
+// Makes a flat file name for a matched file, joining path components with '_'
+// (files from different directories may have the same name). Different paths
+// may give the same name, use glob_unique_name to tell them apart.
+std::wstring glob_dest_name(const wchar_t* szRelPath);
+
+// Returns the name, with a numeric suffix added before the extension if the name
+// is already in aTaken (app.log, app_2.log, ...), and adds the result to aTaken.
+// aTaken keeps names in lower case, as file names are compared ignoring case.
+std::wstring glob_unique_name(const std::wstring& sName, std::set<std::wstring>& aTaken);
@@ -0,0 +1,471 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+#include "stdafx.h"
+#include "FileIO.h"
+#include "Utility.h"
+
+// The block cloning API is not declared by older SDKs.
+#ifndef FSCTL_DUPLICATE_EXTENTS_TO_FILE
+#define FSCTL_DUPLICATE_EXTENTS_TO_FILE CTL_CODE(FILE_DEVICE_FILE_SYSTEM, 209, METHOD_BUFFERED, FILE_WRITE_ACCESS)
+typedef struct _DUPLICATE_EXTENTS_DATA
+{
+    HANDLE FileHandle;
+    LARGE_INTEGER SourceFileOffset;
+    LARGE_INTEGER TargetFileOffset;
+    LARGE_INTEGER ByteCount;
+} DUPLICATE_EXTENTS_DATA, *PDUPLICATE_EXTENTS_DATA;
+#endif
+
+// Largest region cloned by a single FSCTL_DUPLICATE_EXTENTS_TO_FILE call.
+#define FILEIO_MAX_CLONE_REGION (1024*1024*1024)
+
+CFileReader::CFileReader()
+{
+    m_hFile = INVALID_HANDLE_VALUE;
+    m_hFileMapping = NULL;
+    m_pView = NULL;
+    m_pBuffer = NULL;
+    m_uFileSize = 0;
+    m_uOffset = 0;
+}
+
+CFileReader::~CFileReader()
+{
+    Close();
+}
+
+BOOL CFileReader::Open(LPCTSTR szFileName, BOOL bExclusive)
+{
+    Close();
+
+    // Deny writers in exclusive mode, so nobody can truncate the file under the mapped view.
+    DWORD dwShareMode = bExclusive ? FILE_SHARE_READ : (FILE_SHARE_READ | FILE_SHARE_WRITE);
+    m_hFile = CreateFile(szFileName, GENERIC_READ, dwShareMode, NULL,
+        OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if(m_hFile==INVALID_HANDLE_VALUE)
+        return FALSE;
+
+    LARGE_INTEGER lFileSize;
+    if(!GetFileSizeEx(m_hFile, &lFileSize))
+    {
+        Close();
+        return FALSE;
+    }
+    m_uFileSize = lFileSize.QuadPart;
+
+    // Empty files can't be mapped; read small files through the buffer as well,
+    // because mapping costs more than it saves for them.
+    if(bExclusive && m_uFileSize>FILEIO_BUFFER_SIZE)
+    {
+        m_hFileMapping = CreateFileMapping(m_hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    }
+
+    if(m_hFileMapping==NULL)
+    {
+        // VirtualAlloc returns page-aligned memory.
+        m_pBuffer = (LPBYTE)VirtualAlloc(NULL, FILEIO_BUFFER_SIZE, MEM_COMMIT|MEM_RESERVE, PAGE_READWRITE);
+        if(m_pBuffer==NULL)
+        {
+            Close();
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+void CFileReader::Close()
+{
+    if(m_pView!=NULL)
+    {
+        UnmapViewOfFile(m_pView);
+        m_pView = NULL;
+    }
+
+    if(m_hFileMapping!=NULL)
+    {
+        CloseHandle(m_hFileMapping);
+        m_hFileMapping = NULL;
+    }
+
+    if(m_pBuffer!=NULL)
+    {
+        VirtualFree(m_pBuffer, 0, MEM_RELEASE);
+        m_pBuffer = NULL;
+    }
+
+    if(m_hFile!=INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(m_hFile);
+        m_hFile = INVALID_HANDLE_VALUE;
+    }
+
+    m_uFileSize = 0;
+    m_uOffset = 0;
+}
+
+BOOL CFileReader::IsOpen()
+{
+    return m_hFile!=INVALID_HANDLE_VALUE;
+}
+
+ULONG64 CFileReader::GetSize()
+{
+    return m_uFileSize;
+}
+
+HANDLE CFileReader::GetHandle()
+{
+    return m_hFile;
+}
+
+BOOL CFileReader::Seek(ULONG64 uOffset)
+{
+    if(m_hFile==INVALID_HANDLE_VALUE || m_hFileMapping!=NULL)
+        return FALSE;
+
+    LARGE_INTEGER lPos;
+    lPos.QuadPart = uOffset;
+    if(!SetFilePointerEx(m_hFile, lPos, NULL, FILE_BEGIN))
+        return FALSE;
+
+    m_uOffset = uOffset;
+    return TRUE;
+}
+
+BOOL CFileReader::Read(const BYTE*& pData, DWORD& dwLength)
+{
+    pData = NULL;
+    dwLength = 0;
+
+    if(m_hFile==INVALID_HANDLE_VALUE)
+        return FALSE;
+
+    if(m_hFileMapping!=NULL)
+        return ReadMapped(pData, dwLength);
+
+    return ReadBuffered(pData, dwLength);
+}
+
+BOOL CFileReader::ReadBuffered(const BYTE*& pData, DWORD& dwLength)
+{
+    // The file may grow while being read, so read until ReadFile reports EOF.
+    DWORD dwBytesRead = 0;
+    if(!ReadFile(m_hFile, m_pBuffer, FILEIO_BUFFER_SIZE, &dwBytesRead, NULL))
+        return FALSE;
+
+    m_uOffset += dwBytesRead;
+    pData = m_pBuffer;
+    dwLength = dwBytesRead;
+    return TRUE;
+}
+
+BOOL CFileReader::ReadMapped(const BYTE*& pData, DWORD& dwLength)
+{
+    if(m_pView!=NULL)
+    {
+        UnmapViewOfFile(m_pView);
+        m_pView = NULL;
+    }
+
+    if(m_uOffset>=m_uFileSize)
+        return TRUE; // End of file
+
+    // View offsets are multiples of FILEIO_VIEW_SIZE, which is a multiple
+    // of the system allocation granularity.
+    ULONG64 uRemaining = m_uFileSize-m_uOffset;
+    DWORD dwViewSize = uRemaining<FILEIO_VIEW_SIZE ? (DWORD)uRemaining : FILEIO_VIEW_SIZE;
+
+    m_pView = (LPBYTE)MapViewOfFile(m_hFileMapping, FILE_MAP_READ,
+        (DWORD)(m_uOffset>>32), (DWORD)(m_uOffset&0xFFFFFFFF), dwViewSize);
+    if(m_pView==NULL)
+        return FALSE;
+
+    m_uOffset += dwViewSize;
+    pData = m_pView;
+    dwLength = dwViewSize;
+    return TRUE;
+}
+
+// Clones file extents on file systems supporting block cloning (ReFS).
+// The destination file must be empty and located on the same volume.
+static BOOL CloneFile(HANDLE hSrcFile, HANDLE hDstFile, ULONG64 uFileSize, LPCTSTR szDstFile)
+{
+    if(uFileSize==0)
+        return FALSE;
+
+    // Cloned regions must be aligned on the cluster boundary.
+    TCHAR szVolume[MAX_PATH] = _T("");
+    if(!GetVolumePathName(szDstFile, szVolume, MAX_PATH))
+        return FALSE;
+
+    DWORD dwSectorsPerCluster = 0;
+    DWORD dwBytesPerSector = 0;
+    DWORD dwFreeClusters = 0;
+    DWORD dwTotalClusters = 0;
+    if(!GetDiskFreeSpace(szVolume, &dwSectorsPerCluster, &dwBytesPerSector,
+        &dwFreeClusters, &dwTotalClusters))
+        return FALSE;
+
+    ULONG64 uClusterSize = (ULONG64)dwSectorsPerCluster*dwBytesPerSector;
+    if(uClusterSize==0)
+        return FALSE;
+
+    // The destination must have its final size before cloning.
+    LARGE_INTEGER lSize;
+    lSize.QuadPart = uFileSize;
+    if(!SetFilePointerEx(hDstFile, lSize, NULL, FILE_BEGIN) || !SetEndOfFile(hDstFile))
+        return FALSE;
+
+    // The last region is rounded up to the cluster boundary; the file system
+    // clips it at the end of file.
+    ULONG64 uAlignedSize = (uFileSize+uClusterSize-1)/uClusterSize*uClusterSize;
+    ULONG64 uOffset = 0;
+    while(uOffset<uAlignedSize)
+    {
+        ULONG64 uRegion = uAlignedSize-uOffset;
+        if(uRegion>FILEIO_MAX_CLONE_REGION)
+            uRegion = FILEIO_MAX_CLONE_REGION;
+
+        DUPLICATE_EXTENTS_DATA ded;
+        ded.FileHandle = hSrcFile;
+        ded.SourceFileOffset.QuadPart = uOffset;
+        ded.TargetFileOffset.QuadPart = uOffset;
+        ded.ByteCount.QuadPart = uRegion;
+
+        DWORD dwBytesReturned = 0;
+        if(!DeviceIoControl(hDstFile, FSCTL_DUPLICATE_EXTENTS_TO_FILE, &ded, sizeof(ded),
+            NULL, 0, &dwBytesReturned, NULL))
+            return FALSE;
+
+        uOffset += uRegion;
+    }
+
+    return TRUE;
+}
+
+FileCopyMethod FileIO::CopyReportFile(LPCTSTR szSrcFile, LPCTSTR szDstFile,
+    AssyncNotification* pAssync, CString& sErrorMsg)
+{
+    FileCopyMethod method = FILECOPY_FAILED;
+    HANDLE hDstFile = INVALID_HANDLE_VALUE;
+    CFileReader reader;
+    ULONG64 uFileSize = 0;
+    ULONG64 uTotalWritten = 0;
+
+    sErrorMsg.Empty();
+
+    // Open source file with read/write sharing permissions.
+    if(!reader.Open(szSrcFile))
+    {
+        sErrorMsg = Utility::FormatErrorMsg(GetLastError());
+        goto cleanup;
+    }
+
+    uFileSize = reader.GetSize();
+
+    BY_HANDLE_FILE_INFORMATION fi;
+    if(!GetFileInformationByHandle(reader.GetHandle(), &fi))
+    {
+        sErrorMsg = Utility::FormatErrorMsg(GetLastError());
+        goto cleanup;
+    }
+
+    hDstFile = CreateFile(szDstFile, GENERIC_READ|GENERIC_WRITE,
+        FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if(hDstFile==INVALID_HANDLE_VALUE)
+    {
+        sErrorMsg = Utility::FormatErrorMsg(GetLastError());
+        goto cleanup;
+    }
+
+    // Sparse files can't be cloned into a non-sparse destination.
+    if((fi.dwFileAttributes&FILE_ATTRIBUTE_SPARSE_FILE)==0 &&
+        CloneFile(reader.GetHandle(), hDstFile, uFileSize, szDstFile))
+    {
+        method = FILECOPY_CLONE;
+        goto cleanup;
+    }
+
+    // Fall back to copying the data. Reserve space for the whole file first
+    // to reduce fragmentation, then trim it to the length actually written.
+    {
+        LARGE_INTEGER lPos;
+        lPos.QuadPart = uFileSize;
+        if(SetFilePointerEx(hDstFile, lPos, NULL, FILE_BEGIN))
+            SetEndOfFile(hDstFile);
+        lPos.QuadPart = 0;
+        SetFilePointerEx(hDstFile, lPos, NULL, FILE_BEGIN);
+    }
+
+    for(;;)
+    {
+        if(pAssync!=NULL && pAssync->IsCancelled())
+        {
+            sErrorMsg = _T("Cancelled by user.");
+            goto cleanup;
+        }
+
+        const BYTE* pData = NULL;
+        DWORD dwBytesRead = 0;
+        if(!reader.Read(pData, dwBytesRead))
+        {
+            sErrorMsg = Utility::FormatErrorMsg(GetLastError());
+            goto cleanup;
+        }
+
+        if(dwBytesRead==0)
+            break; // End of file
+
+        DWORD dwBytesWritten = 0;
+        if(!WriteFile(hDstFile, pData, dwBytesRead, &dwBytesWritten, NULL) ||
+            dwBytesWritten!=dwBytesRead)
+        {
+            sErrorMsg = Utility::FormatErrorMsg(GetLastError());
+            goto cleanup;
+        }
+
+        uTotalWritten += dwBytesWritten;
+        if(pAssync!=NULL && uFileSize!=0)
+        {
+            ULONG64 uProgress = uTotalWritten<uFileSize ? uTotalWritten : uFileSize;
+            pAssync->SetProgress((int)(100*uProgress/uFileSize), false);
+        }
+    }
+
+    // The source file may have been truncated while we were reading it.
+    if(!SetEndOfFile(hDstFile))
+    {
+        sErrorMsg = Utility::FormatErrorMsg(GetLastError());
+        goto cleanup;
+    }
+
+    method = FILECOPY_STREAM;
+
+cleanup:
+
+    if(hDstFile!=INVALID_HANDLE_VALUE)
+        CloseHandle(hDstFile);
+
+    reader.Close();
+
+    if(method==FILECOPY_FAILED && hDstFile!=INVALID_HANDLE_VALUE)
+        DeleteFile(szDstFile); // Don't leave a partial copy behind
+
+    return method;
+}
+
+FileCopyMethod FileIO::CopyFileTail(LPCTSTR szSrcFile, LPCTSTR szDstFile, ULONG64 uMaxSize,
+    AssyncNotification* pAssync, CString& sErrorMsg)
+{
+    FileCopyMethod method = FILECOPY_FAILED;
+    HANDLE hDstFile = INVALID_HANDLE_VALUE;
+    CFileReader reader;
+    ULONG64 uFileSize = 0;
+    ULONG64 uStart = 0;
+    ULONG64 uTotalWritten = 0;
+    BOOL bSkipLine = FALSE;
+
+    sErrorMsg.Empty();
+
+    // Open source file with read/write sharing permissions (it is likely a log being written).
+    if(!reader.Open(szSrcFile))
+    {
+        sErrorMsg = Utility::FormatErrorMsg(GetLastError());
+        goto cleanup;
+    }
+
+    uFileSize = reader.GetSize();
+    if(uFileSize>uMaxSize)
+    {
+        uStart = uFileSize-uMaxSize;
+        bSkipLine = TRUE;
+    }
+
+    if(!reader.Seek(uStart))
+    {
+        sErrorMsg = Utility::FormatErrorMsg(GetLastError());
+        goto cleanup;
+    }
+
+    hDstFile = CreateFile(szDstFile, GENERIC_WRITE,
+        FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if(hDstFile==INVALID_HANDLE_VALUE)
+    {
+        sErrorMsg = Utility::FormatErrorMsg(GetLastError());
+        goto cleanup;
+    }
+
+    while(uTotalWritten<uMaxSize)
+    {
+        if(pAssync!=NULL && pAssync->IsCancelled())
+        {
+            sErrorMsg = _T("Cancelled by user.");
+            goto cleanup;
+        }
+
+        const BYTE* pData = NULL;
+        DWORD dwBytesRead = 0;
+        if(!reader.Read(pData, dwBytesRead))
+        {
+            sErrorMsg = Utility::FormatErrorMsg(GetLastError());
+            goto cleanup;
+        }
+
+        if(dwBytesRead==0)
+            break; // End of file
+
+        if(bSkipLine)
+        {
+            // Drop the partial line the tail begins with, if the line ends in the first portion
+            const BYTE* pLineEnd = (const BYTE*)memchr(pData, '\n', dwBytesRead);
+            if(pLineEnd!=NULL)
+            {
+                dwBytesRead -= (DWORD)(pLineEnd+1-pData);
+                pData = pLineEnd+1;
+            }
+            bSkipLine = FALSE;
+        }
+
+        if(dwBytesRead>uMaxSize-uTotalWritten)
+            dwBytesRead = (DWORD)(uMaxSize-uTotalWritten);
+
+        DWORD dwBytesWritten = 0;
+        if(dwBytesRead!=0 &&
+            (!WriteFile(hDstFile, pData, dwBytesRead, &dwBytesWritten, NULL) ||
+            dwBytesWritten!=dwBytesRead))
+        {
+            sErrorMsg = Utility::FormatErrorMsg(GetLastError());
+            goto cleanup;
+        }
+
+        uTotalWritten += dwBytesWritten;
+        if(pAssync!=NULL && uFileSize>uStart)
+        {
+            ULONG64 uProgress = uTotalWritten<uFileSize-uStart ? uTotalWritten : uFileSize-uStart;
+            pAssync->SetProgress((int)(100*uProgress/(uFileSize-uStart)), false);
+        }
+    }
+
+    method = FILECOPY_STREAM;
+
+cleanup:
+
+    if(hDstFile!=INVALID_HANDLE_VALUE)
+        CloseHandle(hDstFile);
+
+    reader.Close();
+
+    if(method==FILECOPY_FAILED && hDstFile!=INVALID_HANDLE_VALUE)
+        DeleteFile(szDstFile); // Don't leave a partial copy behind
+
+    return method;
+}
@@ -0,0 +1,97 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+// File: FileIO.h
+// Description: Large-buffer file I/O shared by report file collection and compression.
+
+#pragma once
+#include "stdafx.h"
+#include "AssyncNotification.h"
+
+// Size of the page-aligned buffer used for buffered reads and copies.
+#define FILEIO_BUFFER_SIZE (1024*1024)
+
+// Size of the sliding view used when reading a file through memory mapping.
+#define FILEIO_VIEW_SIZE (4*1024*1024)
+
+// How a file was placed into the error report folder.
+enum FileCopyMethod
+{
+    FILECOPY_FAILED   = -1, // The file couldn't be copied.
+    FILECOPY_CLONE    = 0,  // Block clone (copy-on-write), source data was not read.
+    FILECOPY_STREAM   = 1   // Source data was read once through a large buffer.
+};
+
+// Reads a file sequentially. Files opened in exclusive mode are read through
+// a sliding memory mapped view, other files through a single large buffer.
+class CFileReader
+{
+public:
+
+    // Construction/destruction
+    CFileReader();
+    ~CFileReader();
+
+    // Opens the file for reading. If bExclusive is TRUE, writers are denied
+    // access while the file is open and the file is read through memory mapping.
+    // Otherwise other processes may keep writing the file while we read it.
+    BOOL Open(LPCTSTR szFileName, BOOL bExclusive=FALSE);
+
+    // Closes the file and frees the buffer and the view.
+    void Close();
+
+    // Returns TRUE if the file is open.
+    BOOL IsOpen();
+
+    // Returns size of the file at the moment it was opened.
+    ULONG64 GetSize();
+
+    // Returns the file handle.
+    HANDLE GetHandle();
+
+    // Moves the read position. Not supported for files read through memory mapping.
+    BOOL Seek(ULONG64 uOffset);
+
+    // Returns the next portion of file data. The returned pointer is valid until the
+    // next call. At end of file returns TRUE and sets dwLength to zero.
+    BOOL Read(const BYTE*& pData, DWORD& dwLength);
+
+private:
+
+    // Reads the next portion through the buffer.
+    BOOL ReadBuffered(const BYTE*& pData, DWORD& dwLength);
+
+    // Reads the next portion through the mapped view.
+    BOOL ReadMapped(const BYTE*& pData, DWORD& dwLength);
+
+    HANDLE m_hFile;           // File handle.
+    HANDLE m_hFileMapping;    // File mapping handle (exclusive mode only).
+    LPBYTE m_pView;           // Currently mapped view.
+    LPBYTE m_pBuffer;         // Read buffer (non-exclusive mode only).
+    ULONG64 m_uFileSize;      // File size.
+    ULONG64 m_uOffset;        // Current read position.
+};
+
+namespace FileIO
+{
+    // Places a copy of the source file to the destination path using the cheapest
+    // method the file system supports: block clone or a single buffered pass over
+    // the source. User files are never hard-linked, because their read-only
+    // attribute can be cleared and the file rewritten, changing the queued report.
+    // Progress and cancellation are reported through pAssync, which may be NULL.
+    FileCopyMethod CopyReportFile(LPCTSTR szSrcFile, LPCTSTR szDstFile,
+        AssyncNotification* pAssync, CString& sErrorMsg);
+
+    // Copies the last uMaxSize bytes of the source file, starting from the first
+    // line that begins within them (used for large log files). The copy is never
+    // larger than uMaxSize, even if the source file grows while being copied.
+    FileCopyMethod CopyFileTail(LPCTSTR szSrcFile, LPCTSTR szDstFile, ULONG64 uMaxSize,
+        AssyncNotification* pAssync, CString& sErrorMsg);
+};
@@ -15,6 +15,7 @@ be found in the Authors.txt file in the root of the source tree.
 #include "pnginfo.h"
 #include "jpeglib.h"
 #include "strconv.h"
+#include "ColorConv.h"
 
 #pragma warning(disable:4611)
 // DIBSIZE calculates the number of bytes required by an image
@@ -24,12 +25,6 @@ be found in the Authors.txt file in the root of the source tree.
 #define _DIBSIZE(bi) (DIBWIDTHBYTES(bi) * (DWORD)(bi).biHeight)
 #define DIBSIZE(bi) ((bi).biHeight < 0 ? (-1)*(_DIBSIZE(bi)) : _DIBSIZE(bi))
 
-static inline
-unsigned char CLAMP(int x)
-{
-   return  (unsigned char)((x > 255) ? 255 : (x < 0) ? 0 : x);
-}
-
 //-----------------------------------------------------------------------------
 // CFileMemoryMapping implementation
 //-----------------------------------------------------------------------------
@@ -109,11 +104,11 @@ ULONG64 CFileMemoryMapping::GetSize()
     return m_uFileLength;
 }
 
-LPBYTE CFileMemoryMapping::CreateView(DWORD dwOffset, DWORD dwLength)
+LPBYTE CFileMemoryMapping::CreateView(ULONG64 uOffset, DWORD dwLength)
 {
     DWORD dwThreadId = GetCurrentThreadId();
-    DWORD dwBaseOffs = dwOffset-dwOffset%m_dwAllocGranularity;
-    DWORD dwDiff = dwOffset-dwBaseOffs;
+    ULONG64 uBaseOffs = uOffset-uOffset%m_dwAllocGranularity;
+    DWORD dwDiff = (DWORD)(uOffset-uBaseOffs);
     LPBYTE pPtr = NULL;
 
     CAutoLock lock(&m_csLock);
@@ -124,7 +119,8 @@ LPBYTE CFileMemoryMapping::CreateView(DWORD dwOffset, DWORD dwLength)
         UnmapViewOfFile(it->second);
     }
 
-    pPtr = (LPBYTE)MapViewOfFile(m_hFileMapping, FILE_MAP_READ, 0, dwBaseOffs, dwLength+dwDiff);
+    pPtr = (LPBYTE)MapViewOfFile(m_hFileMapping, FILE_MAP_READ,
+        (DWORD)(uBaseOffs>>32), (DWORD)uBaseOffs, dwLength+dwDiff);
     if(it!=m_aViewStartPtrs.end())
     {
         it->second = pPtr;
@@ -134,6 +130,9 @@ LPBYTE CFileMemoryMapping::CreateView(DWORD dwOffset, DWORD dwLength)
         m_aViewStartPtrs[dwThreadId] = pPtr;
     }
 
+    if(pPtr==NULL)
+        return NULL;
+
     return (pPtr+dwDiff);
 }
 
@@ -384,20 +383,26 @@ BOOL CImage::LoadBitmapFromPNGFile(LPTSTR szFileName)
     // Read PNG information
     png_read_info(png_ptr, info_ptr);
 
-    // Get count of bytes per row
-    rowbytes = png_get_rowbytes(png_ptr, info_ptr);
-    row = new png_byte[rowbytes];
-
-    width = png_get_image_width(png_ptr, info_ptr);
-    height = png_get_image_height(png_ptr, info_ptr);
+    // Palette images (written in fast PNG mode) are expanded to RGB
+    if(png_get_color_type(png_ptr, info_ptr)==PNG_COLOR_TYPE_PALETTE)
+        png_set_palette_to_rgb(png_ptr);
 
-    if(info_ptr->channels==3)
+    if(info_ptr->channels==3 || png_get_color_type(png_ptr, info_ptr)==PNG_COLOR_TYPE_PALETTE)
     {
         png_set_strip_16(png_ptr);
         png_set_packing(png_ptr);
         png_set_bgr(png_ptr);
     }
 
+    png_read_update_info(png_ptr, info_ptr);
+
+    // Get count of bytes per row
+    rowbytes = png_get_rowbytes(png_ptr, info_ptr);
+    row = new png_byte[rowbytes];
+
+    width = png_get_image_width(png_ptr, info_ptr);
+    height = png_get_image_height(png_ptr, info_ptr);
+
     hDC = GetDC(NULL);
 
     {
@@ -1021,23 +1026,9 @@ BOOL CVideo::IsValid()
 void CVideo::YV12_To_RGB(unsigned char *pRGBData, int nFrameWidth,
             int nFrameHeight, int nRGBStride, th_ycbcr_buffer raw)
 {
-
-    int x, y;
-    for(y=0; y<nFrameHeight;y++)
-    {
-        for (x=0; x < nFrameWidth; x ++)
-        {
-            int nRGBOffs = y*nRGBStride+x*3;
-
-            float Y = raw[0].data[y*raw[0].stride+x];
-            float U = raw[1].data[y/2*raw[1].stride+x/2];
-            float V = raw[2].data[y/2*raw[2].stride+x/2];
-
-            pRGBData[nRGBOffs+0] = CLAMP((int)(1.164*(Y - 16) + 2.018*(U - 128)));
-            pRGBData[nRGBOffs+1] = CLAMP((int)(1.164*(Y - 16) - 0.813*(V - 128) - 0.391*(U - 128)));
-            pRGBData[nRGBOffs+2] = CLAMP((int)(1.164*(Y - 16) + 1.596*(V - 128)));
-        }
-    }
+    yv12_to_rgb24(pRGBData, nFrameWidth, nFrameHeight, nRGBStride,
+        raw[0].data, raw[0].stride, raw[1].data, raw[1].stride,
+        raw[2].data, raw[2].stride);
 }
 
 BOOL CVideo::CreateFrameDIB(DWORD dwWidth, DWORD dwHeight, int nBits)
@@ -1117,6 +1108,8 @@ CFilePreviewCtrl::CFilePreviewCtrl()
     m_PreviewMode = PREVIEW_HEX;
     m_TextEncoding = ENC_ASCII;
     m_nEncSignatureLen = 0;
+    m_uCachedFirstLine = 0;
+    m_bCachedToEnd = FALSE;
 }
 
 CFilePreviewCtrl::~CFilePreviewCtrl()
@@ -1140,7 +1133,7 @@ BOOL CFilePreviewCtrl::SetFile(LPCTSTR szFileName, PreviewMode mode, TextEncodin
     // stop the worker thread
     if(m_hWorkerThread!=NULL)
     {
-        m_bCancelled = TRUE;
+        InterlockedExchange(&m_bCancelled, TRUE);
         m_bmp.Cancel();
         WaitForSingleObject(m_hWorkerThread, INFINITE);
         m_hWorkerThread = NULL;
@@ -1186,7 +1179,10 @@ BOOL CFilePreviewCtrl::SetFile(LPCTSTR szFileName, PreviewMode mode, TextEncodin
     m_nVScrollMax = 0;
     m_nHScrollPos = 0;
     m_nHScrollMax = 0;
-    m_aTextLines.clear();
+    m_TextLineIndex.Init(TEXT_LINE_CHECKPOINT_STRIDE, TEXT_LINE_CHECKPOINTS_MAX);
+    m_aCachedLines.clear();
+    m_uCachedFirstLine = 0;
+    m_bCachedToEnd = FALSE;
     m_uNumLines = 0;
     m_nMaxDisplayWidth = 0;
     m_bmp.Destroy();
@@ -1223,19 +1219,19 @@ BOOL CFilePreviewCtrl::SetFile(LPCTSTR szFileName, PreviewMode mode, TextEncodin
                 m_nEncSignatureLen = nSignatureLen;
         }
 
-        m_bCancelled = FALSE;
+        InterlockedExchange(&m_bCancelled, FALSE);
         m_hWorkerThread = CreateThread(NULL, 0, WorkerThread, this, 0, NULL);
         ::SetTimer(m_hWnd, 0, 250, NULL);
     }
     else if(m_PreviewMode==PREVIEW_IMAGE)
     {
-        m_bCancelled = FALSE;
+        InterlockedExchange(&m_bCancelled, FALSE);
         m_hWorkerThread = CreateThread(NULL, 0, WorkerThread, this, 0, NULL);
         ::SetTimer(m_hWnd, 0, 250, NULL);
     }
     else if(m_PreviewMode==PREVIEW_VIDEO)
     {
-        m_bCancelled = FALSE;
+        InterlockedExchange(&m_bCancelled, FALSE);
         m_hWorkerThread = CreateThread(NULL, 0, WorkerThread, this, 0, NULL);
         //::SetTimer(m_hWnd, 0, 250, NULL);
     }
@@ -1406,113 +1402,54 @@ void CFilePreviewCtrl::DoInWorkerThread()
         LoadVideo();
 }
 
-WCHAR swap_bytes(WCHAR src_char)
-{
-    return (WCHAR)MAKEWORD((src_char>>8), (src_char&0xFF));
-}
-
 void CFilePreviewCtrl::ParseText()
 {
-    DWORD dwFileSize = (DWORD)m_fm.GetSize();
-    DWORD dwOffset = 0;
-    DWORD dwPrevOffset = 0;
-    int nTabs = 0;
+    ULONG64 uFileSize = m_fm.GetSize();
+    ULONG64 uOffset = 0;
+    std::vector<ULONG64> aLines;
+    CLineIndexer Indexer;
 
-    if(dwFileSize!=0)
+    if(uFileSize!=0)
     {
-        CAutoLock lock(&m_csLock);
         if(m_PreviewMode==PREVIEW_TEXT)
-        {
-            dwOffset+=m_nEncSignatureLen;
-            m_aTextLines.push_back(dwOffset);
-        }
-        else
-        {
-            m_aTextLines.push_back(0);
-        }
+            uOffset+=m_nEncSignatureLen;
 
-        m_uNumLines++;
+        CAutoLock lock(&m_csLock);
+        aLines.push_back(uOffset);
+        m_TextLineIndex.AddLines(aLines);
+        m_uNumLines = m_TextLineIndex.GetLineCount();
     }
 
-    for(;;)
-    {
-        {
-            CAutoLock lock(&m_csLock);
-            if(m_bCancelled)
-                break;
-        }
+    BOOL bUTF16 = m_TextEncoding==ENC_UTF16_LE || m_TextEncoding==ENC_UTF16_BE;
+    Indexer.Init(bUTF16?2:1, m_TextEncoding==ENC_UTF16_BE, m_cchTabLength, uOffset);
 
-        DWORD dwLength = 4096;
-        if(dwOffset+dwLength>=dwFileSize)
-            dwLength = dwFileSize-dwOffset;
+    // Map big windows of the file and scan them in smaller blocks. The cancel flag
+    // is checked and found lines are published once per block, not per character.
+    while(uOffset<uFileSize && !m_bCancelled)
+    {
+        DWORD dwLength = TEXT_PARSE_VIEW_SIZE;
+        if(dwLength>uFileSize-uOffset)
+            dwLength = (DWORD)(uFileSize-uOffset);
 
-        if(dwLength==0)
+        LPBYTE ptr = m_fm.CreateView(uOffset, dwLength);
+        if(ptr==NULL)
             break;
 
-        LPBYTE ptr = m_fm.CreateView(dwOffset, dwLength);
-
-        UINT i;
-        for(i=0; i<dwLength; )
+        DWORD dwPos;
+        for(dwPos=0; dwPos<dwLength && !m_bCancelled; dwPos+=TEXT_PARSE_BLOCK_SIZE)
         {
-            {
-                CAutoLock lock(&m_csLock);
-                if(m_bCancelled)
-                    break;
-            }
+            DWORD dwBlock = min(TEXT_PARSE_BLOCK_SIZE, dwLength-dwPos);
 
-            if(m_TextEncoding==ENC_UTF16_LE || m_TextEncoding==ENC_UTF16_BE)
-            {
-                WCHAR src_char = ((WCHAR*)ptr)[i/2];
-
-                WCHAR c = m_TextEncoding==ENC_UTF16_LE?src_char:swap_bytes(src_char);
-
-                if(c=='\t')
-                {
-                    nTabs++;
-                }
-                else if(c=='\n')
-                {
-                    CAutoLock lock(&m_csLock);
-                    m_aTextLines.push_back(dwOffset+i+2);
-                    int cchLineLength = dwOffset+i+2-dwPrevOffset;
-                    if(nTabs!=0)
-                        cchLineLength += nTabs*(m_cchTabLength-1);
-
-                    m_nMaxDisplayWidth = max(m_nMaxDisplayWidth, cchLineLength);
-                    m_uNumLines++;
-                    dwPrevOffset = dwOffset+i+2;
-                    nTabs = 0;
-                }
-
-                i+=2;
-            }
-            else
-            {
-                char c = ((char*)ptr)[i];
-
-                if(c=='\t')
-                {
-                    nTabs++;
-                }
-                else if(c=='\n')
-                {
-                    CAutoLock lock(&m_csLock);
-                    m_aTextLines.push_back(dwOffset+i+1);
-                    int cchLineLength = dwOffset+i+1-dwPrevOffset;
-                    if(nTabs!=0)
-                        cchLineLength += nTabs*(m_cchTabLength-1);
-
-                    m_nMaxDisplayWidth = max(m_nMaxDisplayWidth, cchLineLength);
-                    m_uNumLines++;
-                    dwPrevOffset = dwOffset+i+1;
-                    nTabs = 0;
-                }
-
-                i++;
-            }
+            aLines.clear();
+            Indexer.ScanBlock(ptr+dwPos, dwBlock, aLines);
+
+            CAutoLock lock(&m_csLock);
+            m_TextLineIndex.AddLines(aLines);
+            m_uNumLines = m_TextLineIndex.GetLineCount();
+            m_nMaxDisplayWidth = max(m_nMaxDisplayWidth, Indexer.GetMaxLineWidth());
         }
 
-        dwOffset += dwLength;
+        uOffset += dwLength;
     }
 
     PostMessage(WM_FPC_COMPLETE);
@@ -1610,7 +1547,7 @@ CString CFilePreviewCtrl::FormatHexLine(LPBYTE pData, int nBytesInLine, ULONG64
     int i;
 
     //print the hex address
-    str.Format(_T("%08X  "), uLineOffset);
+    str.Format(_T("%08I64X  "), uLineOffset);
     sResult += str;
 
     //print hex data
@@ -1654,15 +1591,18 @@ CString CFilePreviewCtrl::FormatHexLine(LPBYTE pData, int nBytesInLine, ULONG64
 void CFilePreviewCtrl::DrawHexLine(HDC hdc, DWORD nLineNo)
 {
     int nBytesPerLine = m_nBytesPerLine;
+    ULONG64 uOffset = (ULONG64)nLineNo*m_nBytesPerLine;
 
-    if(m_fm.GetSize() - nLineNo * m_nBytesPerLine < (UINT)m_nBytesPerLine)
-        nBytesPerLine= (DWORD)m_fm.GetSize() - nLineNo * m_nBytesPerLine;
+    if(m_fm.GetSize() - uOffset < (UINT)m_nBytesPerLine)
+        nBytesPerLine = (int)(m_fm.GetSize() - uOffset);
 
     //get data from our file mapping
-    LPBYTE ptr = m_fm.CreateView(nLineNo * m_nBytesPerLine, nBytesPerLine);
+    LPBYTE ptr = m_fm.CreateView(uOffset, nBytesPerLine);
+    if(ptr==NULL)
+        return;
 
     //convert the data into a one-line hex-dump
-    CString str = FormatHexLine(ptr, nBytesPerLine, nLineNo*m_nBytesPerLine );
+    CString str = FormatHexLine(ptr, nBytesPerLine, uOffset);
 
     //draw this line to the screen
     TextOut(hdc, -(int)(m_nHScrollPos * m_xChar),
@@ -1674,22 +1614,15 @@ void CFilePreviewCtrl::DrawTextLine(HDC hdc, DWORD nLineNo)
     CRect rcClient;
     GetClientRect(&rcClient);
 
-    DWORD dwOffset = 0;
+    ULONG64 uOffset = 0;
     DWORD dwLength = 0;
-    {
-        CAutoLock lock(&m_csLock);
-        dwOffset = m_aTextLines[nLineNo];
-        if(nLineNo==m_uNumLines-1)
-            dwLength = (DWORD)m_fm.GetSize() - dwOffset;
-        else
-            dwLength = m_aTextLines[nLineNo+1]-dwOffset-1;
-    }
-
-    if(dwLength==0)
+    if(!GetTextLine(nLineNo, uOffset, dwLength) || dwLength==0)
         return;
 
     //get data from our file mapping
-    LPBYTE ptr = m_fm.CreateView(dwOffset, dwLength);
+    LPBYTE ptr = m_fm.CreateView(uOffset, dwLength);
+    if(ptr==NULL)
+        return;
 
     //draw this line to the screen
     CRect rcText;
@@ -1730,6 +1663,74 @@ void CFilePreviewCtrl::DrawTextLine(HDC hdc, DWORD nLineNo)
     }
 }
 
+BOOL CFilePreviewCtrl::GetTextLine(ULONG64 uLineNo, ULONG64& uOffset, DWORD& dwLength)
+{
+    // The cache holds offsets of lines starting at m_uCachedFirstLine. It is
+    // extended while scrolling down and refilled from the nearest checkpoint
+    // when another part of the file is displayed.
+    ULONG64 uCheckpointLine = 0;
+    ULONG64 uCheckpointOffset = 0;
+    {
+        CAutoLock lock(&m_csLock);
+        if(!m_TextLineIndex.FindCheckpoint(uLineNo, uCheckpointLine, uCheckpointOffset))
+            return FALSE;
+    }
+
+    ULONG64 uCachedEnd = m_uCachedFirstLine+m_aCachedLines.size();
+    if(m_aCachedLines.empty() || uLineNo<m_uCachedFirstLine || uCheckpointLine>=uCachedEnd)
+    {
+        m_uCachedFirstLine = uCheckpointLine;
+        m_aCachedLines.assign(1, uCheckpointOffset);
+        m_bCachedToEnd = FALSE;
+    }
+    else if(uCheckpointLine>m_uCachedFirstLine)
+    {
+        // Forget lines before the checkpoint to keep the cache small
+        m_aCachedLines.erase(m_aCachedLines.begin(),
+            m_aCachedLines.begin()+(size_t)(uCheckpointLine-m_uCachedFirstLine));
+        m_uCachedFirstLine = uCheckpointLine;
+    }
+
+    // Scan the file until the start of the next line is known
+    ULONG64 uFileSize = m_fm.GetSize();
+    if(!m_bCachedToEnd && uLineNo+1>=m_uCachedFirstLine+m_aCachedLines.size())
+    {
+        BOOL bUTF16 = m_TextEncoding==ENC_UTF16_LE || m_TextEncoding==ENC_UTF16_BE;
+        ULONG64 uPos = m_aCachedLines.back();
+        CLineIndexer Indexer;
+        Indexer.Init(bUTF16?2:1, m_TextEncoding==ENC_UTF16_BE, m_cchTabLength, uPos);
+
+        while(uLineNo+1>=m_uCachedFirstLine+m_aCachedLines.size())
+        {
+            DWORD dwBlock = TEXT_LINE_SCAN_BLOCK_SIZE;
+            if(dwBlock>uFileSize-uPos)
+                dwBlock = (DWORD)(uFileSize-uPos);
+
+            LPBYTE ptr = dwBlock!=0 ? m_fm.CreateView(uPos, dwBlock) : NULL;
+            if(ptr==NULL)
+            {
+                m_bCachedToEnd = TRUE;
+                break;
+            }
+
+            Indexer.ScanBlock(ptr, dwBlock, m_aCachedLines);
+            uPos += dwBlock;
+        }
+    }
+
+    size_t uIndex = (size_t)(uLineNo-m_uCachedFirstLine);
+    if(uIndex>=m_aCachedLines.size())
+        return FALSE;
+
+    uOffset = m_aCachedLines[uIndex];
+    if(uIndex+1<m_aCachedLines.size())
+        dwLength = (DWORD)(m_aCachedLines[uIndex+1]-uOffset-1);
+    else
+        dwLength = (DWORD)(uFileSize-uOffset);
+
+    return TRUE;
+}
+
 void CFilePreviewCtrl::DoPaintEmpty(HDC hDC)
 {
     RECT rcClient;
@@ -12,6 +12,7 @@ be found in the Authors.txt file in the root of the source tree.
 #include "stdafx.h"
 #include "CritSec.h"
 #include "theora/theoradec.h"
+#include "LineIndexer.h"
 
 // Preview mode
 enum PreviewMode
@@ -50,8 +51,8 @@ public:
     // Returns memory size
     ULONG64 GetSize();
 
-    // Creates a view
-    LPBYTE CreateView(DWORD dwOffset, DWORD dwLength);
+    // Creates a view of dwLength bytes starting at uOffset
+    LPBYTE CreateView(ULONG64 uOffset, DWORD dwLength);
 
 private:
 
@@ -63,12 +64,6 @@ private:
     std::map<DWORD, LPBYTE> m_aViewStartPtrs; // Base of the view of the file.
 };
 
-// Line info
-struct LineInfo
-{
-    DWORD m_dwOffsetInFile; // Line offset in file
-    DWORD m_cchLineLength;  // Line length in symbols
-};
 
 // Image class - encapsulates image reading functionality
 class CImage
@@ -188,6 +183,17 @@ private:
 #define WM_FPC_COMPLETE  (WM_APP+100)
 #define WM_FPC_FRAMEAWAIL (WM_APP+101)
 
+// Size of file view mapped at once when parsing text files
+#define TEXT_PARSE_VIEW_SIZE ((DWORD)16*1024*1024)
+// Size of text block scanned between checks of the cancel flag
+#define TEXT_PARSE_BLOCK_SIZE ((DWORD)1024*1024)
+// Initial count of text lines per line index checkpoint
+#define TEXT_LINE_CHECKPOINT_STRIDE 64
+// Maximum count of line index checkpoints (bounds the memory used by the index)
+#define TEXT_LINE_CHECKPOINTS_MAX 65536
+// Size of text block scanned when looking for lines between checkpoints
+#define TEXT_LINE_SCAN_BLOCK_SIZE ((DWORD)64*1024)
+
 // File preview control
 // A custom control derived from CStatic. Can preview files as hex, text and image
 class CFilePreviewCtrl : public CWindowImpl<CFilePreviewCtrl, CStatic>
@@ -272,6 +278,10 @@ public:
     CString FormatHexLine(LPBYTE pData, int nBytesInLine, ULONG64 uLineOffset);
     void DrawHexLine(HDC hdc, DWORD nLineNo);
     void DrawTextLine(HDC hdc, DWORD nLineNo);
+
+    // Returns offset and length of a text line, scanning the file from
+    // the nearest line index checkpoint if the line is not cached
+    BOOL GetTextLine(ULONG64 uLineNo, ULONG64& uOffset, DWORD& dwLength);
     void DoPaintEmpty(HDC hDC);
     void DoPaintText(HDC hDC);
     void DoPaintBitmap(HDC hDC);
@@ -311,9 +321,12 @@ public:
     int m_nHScrollMax;           // Max horizontal scroll position.
     int m_nVScrollPos;           // Vertical scrolling position.
     int m_nVScrollMax;           // Maximum vertical scrolling position.
-    std::vector<DWORD> m_aTextLines; // The array of lines of text file.
+    CSparseLineIndex m_TextLineIndex;    // Checkpoints of lines of text file.
+    ULONG64 m_uCachedFirstLine;          // First line in the line cache.
+    std::vector<ULONG64> m_aCachedLines; // Offsets of consecutive lines around the displayed ones.
+    BOOL m_bCachedToEnd;                 // Does the line cache reach the end of file?
     HANDLE m_hWorkerThread;      // Handle to the worker thread.
-    BOOL m_bCancelled;           // Is worker thread cancelled?
+    volatile LONG m_bCancelled;  // Is worker thread cancelled?
     CImage m_bmp;                // Stores the bitmap.
 	CVideo m_video;              // Stores the decoded video.
 };
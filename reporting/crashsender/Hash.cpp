@@ -0,0 +1,862 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+// MD5 is derived from the RSA Data Security, Inc. MD5 Message-Digest Algorithm.
+// XXH64 algorithm is by Yann Collet (BSD license).
+
+#include "Hash.h"
+#include <string.h>
+#include <vector>
+#include <algorithm>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define HASH_X86
+#endif
+
+#ifdef HASH_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define HASH_TARGET_SSE2
+#define HASH_TARGET_SHA
+#if _MSC_VER>=1900
+#define HASH_HAVE_SHANI
+#endif
+#else
+#include <cpuid.h>
+#define HASH_TARGET_SSE2 __attribute__((target("sse2")))
+#define HASH_TARGET_SHA __attribute__((target("sha,sse4.1,ssse3")))
+#if defined(__clang__) || __GNUC__>=5
+#define HASH_HAVE_SHANI
+#endif
+#endif
+#endif
+
+//-----------------------------------------------
+// Dispatch
+//-----------------------------------------------
+
+static int hash_detect_isa()
+{
+    int nIsa = HASH_ISA_SCALAR;
+
+#ifdef HASH_X86
+    unsigned int nMaxLeaf, ecx1, edx1, ebx7 = 0;
+
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    nMaxLeaf = info[0];
+    __cpuid(info, 1);
+    ecx1 = info[2];
+    edx1 = info[3];
+    if(nMaxLeaf>=7)
+    {
+        __cpuidex(info, 7, 0);
+        ebx7 = info[1];
+    }
+#else
+    unsigned int eax, ebx, ecx, edx;
+    nMaxLeaf = __get_cpuid_max(0, NULL);
+    if(!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+        return nIsa;
+    ecx1 = ecx;
+    edx1 = edx;
+    if(nMaxLeaf>=7)
+    {
+        __cpuid_count(7, 0, eax, ebx, ecx, edx);
+        ebx7 = ebx;
+    }
+#endif
+
+    if(edx1 & (1<<26))
+        nIsa = HASH_ISA_SSE2;
+
+#ifdef HASH_HAVE_SHANI
+    // SHA extensions come with SSSE3 and SSE4.1 shuffles
+    if(nIsa==HASH_ISA_SSE2 && (ebx7 & (1<<29)) && (ecx1 & (1<<9)) && (ecx1 & (1<<19)))
+        nIsa = HASH_ISA_SHA;
+#else
+    (void)ecx1;
+    (void)ebx7;
+#endif
+#endif
+
+    return nIsa;
+}
+
+static const int g_nBestHashIsa = hash_detect_isa();
+static int g_nHashIsa = g_nBestHashIsa;
+
+int hash_get_best_isa()
+{
+    return g_nBestHashIsa;
+}
+
+int hash_get_isa()
+{
+    return g_nHashIsa;
+}
+
+int hash_set_isa(int nIsa)
+{
+    if(nIsa<HASH_ISA_SCALAR || nIsa>g_nBestHashIsa)
+        nIsa = g_nBestHashIsa;
+    g_nHashIsa = nIsa;
+    return nIsa;
+}
+
+//-----------------------------------------------
+// Helpers
+//-----------------------------------------------
+
+void hash_to_hex(const unsigned char* pDigest, size_t uSize, char* szHex)
+{
+    static const char szDigits[] = "0123456789abcdef";
+    size_t i;
+    for(i=0; i<uSize; i++)
+    {
+        szHex[2*i] = szDigits[pDigest[i]>>4];
+        szHex[2*i+1] = szDigits[pDigest[i]&0xF];
+    }
+    szHex[2*uSize] = 0;
+}
+
+// Reads little-endian and big-endian words.
+static inline unsigned ReadLE32(const unsigned char* p)
+{
+    return p[0] | (p[1]<<8) | (p[2]<<16) | ((unsigned)p[3]<<24);
+}
+
+static inline unsigned ReadBE32(const unsigned char* p)
+{
+    return ((unsigned)p[0]<<24) | (p[1]<<16) | (p[2]<<8) | p[3];
+}
+
+static inline unsigned long long ReadLE64(const unsigned char* p)
+{
+    return ReadLE32(p) | ((unsigned long long)ReadLE32(p+4)<<32);
+}
+
+static inline void WriteLE32(unsigned char* p, unsigned v)
+{
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v>>8);
+    p[2] = (unsigned char)(v>>16);
+    p[3] = (unsigned char)(v>>24);
+}
+
+static inline void WriteBE32(unsigned char* p, unsigned v)
+{
+    p[0] = (unsigned char)(v>>24);
+    p[1] = (unsigned char)(v>>16);
+    p[2] = (unsigned char)(v>>8);
+    p[3] = (unsigned char)v;
+}
+
+static inline unsigned Rotl32(unsigned x, int n)
+{
+    return (x<<n) | (x>>(32-n));
+}
+
+static inline unsigned Rotr32(unsigned x, int n)
+{
+    return (x>>n) | (x<<(32-n));
+}
+
+static inline unsigned long long Rotl64(unsigned long long x, int n)
+{
+    return (x<<n) | (x>>(64-n));
+}
+
+//-----------------------------------------------
+// MD5
+//-----------------------------------------------
+
+// All 64 MD5 steps: function, registers, message word, shift and constant.
+#define MD5_ROUNDS(STEP) \
+    STEP(F, a, b, c, d,  0,  7, 0xd76aa478) \
+    STEP(F, d, a, b, c,  1, 12, 0xe8c7b756) \
+    STEP(F, c, d, a, b,  2, 17, 0x242070db) \
+    STEP(F, b, c, d, a,  3, 22, 0xc1bdceee) \
+    STEP(F, a, b, c, d,  4,  7, 0xf57c0faf) \
+    STEP(F, d, a, b, c,  5, 12, 0x4787c62a) \
+    STEP(F, c, d, a, b,  6, 17, 0xa8304613) \
+    STEP(F, b, c, d, a,  7, 22, 0xfd469501) \
+    STEP(F, a, b, c, d,  8,  7, 0x698098d8) \
+    STEP(F, d, a, b, c,  9, 12, 0x8b44f7af) \
+    STEP(F, c, d, a, b, 10, 17, 0xffff5bb1) \
+    STEP(F, b, c, d, a, 11, 22, 0x895cd7be) \
+    STEP(F, a, b, c, d, 12,  7, 0x6b901122) \
+    STEP(F, d, a, b, c, 13, 12, 0xfd987193) \
+    STEP(F, c, d, a, b, 14, 17, 0xa679438e) \
+    STEP(F, b, c, d, a, 15, 22, 0x49b40821) \
+    STEP(G, a, b, c, d,  1,  5, 0xf61e2562) \
+    STEP(G, d, a, b, c,  6,  9, 0xc040b340) \
+    STEP(G, c, d, a, b, 11, 14, 0x265e5a51) \
+    STEP(G, b, c, d, a,  0, 20, 0xe9b6c7aa) \
+    STEP(G, a, b, c, d,  5,  5, 0xd62f105d) \
+    STEP(G, d, a, b, c, 10,  9, 0x02441453) \
+    STEP(G, c, d, a, b, 15, 14, 0xd8a1e681) \
+    STEP(G, b, c, d, a,  4, 20, 0xe7d3fbc8) \
+    STEP(G, a, b, c, d,  9,  5, 0x21e1cde6) \
+    STEP(G, d, a, b, c, 14,  9, 0xc33707d6) \
+    STEP(G, c, d, a, b,  3, 14, 0xf4d50d87) \
+    STEP(G, b, c, d, a,  8, 20, 0x455a14ed) \
+    STEP(G, a, b, c, d, 13,  5, 0xa9e3e905) \
+    STEP(G, d, a, b, c,  2,  9, 0xfcefa3f8) \
+    STEP(G, c, d, a, b,  7, 14, 0x676f02d9) \
+    STEP(G, b, c, d, a, 12, 20, 0x8d2a4c8a) \
+    STEP(H, a, b, c, d,  5,  4, 0xfffa3942) \
+    STEP(H, d, a, b, c,  8, 11, 0x8771f681) \
+    STEP(H, c, d, a, b, 11, 16, 0x6d9d6122) \
+    STEP(H, b, c, d, a, 14, 23, 0xfde5380c) \
+    STEP(H, a, b, c, d,  1,  4, 0xa4beea44) \
+    STEP(H, d, a, b, c,  4, 11, 0x4bdecfa9) \
+    STEP(H, c, d, a, b,  7, 16, 0xf6bb4b60) \
+    STEP(H, b, c, d, a, 10, 23, 0xbebfbc70) \
+    STEP(H, a, b, c, d, 13,  4, 0x289b7ec6) \
+    STEP(H, d, a, b, c,  0, 11, 0xeaa127fa) \
+    STEP(H, c, d, a, b,  3, 16, 0xd4ef3085) \
+    STEP(H, b, c, d, a,  6, 23, 0x04881d05) \
+    STEP(H, a, b, c, d,  9,  4, 0xd9d4d039) \
+    STEP(H, d, a, b, c, 12, 11, 0xe6db99e5) \
+    STEP(H, c, d, a, b, 15, 16, 0x1fa27cf8) \
+    STEP(H, b, c, d, a,  2, 23, 0xc4ac5665) \
+    STEP(I, a, b, c, d,  0,  6, 0xf4292244) \
+    STEP(I, d, a, b, c,  7, 10, 0x432aff97) \
+    STEP(I, c, d, a, b, 14, 15, 0xab9423a7) \
+    STEP(I, b, c, d, a,  5, 21, 0xfc93a039) \
+    STEP(I, a, b, c, d, 12,  6, 0x655b59c3) \
+    STEP(I, d, a, b, c,  3, 10, 0x8f0ccc92) \
+    STEP(I, c, d, a, b, 10, 15, 0xffeff47d) \
+    STEP(I, b, c, d, a,  1, 21, 0x85845dd1) \
+    STEP(I, a, b, c, d,  8,  6, 0x6fa87e4f) \
+    STEP(I, d, a, b, c, 15, 10, 0xfe2ce6e0) \
+    STEP(I, c, d, a, b,  6, 15, 0xa3014314) \
+    STEP(I, b, c, d, a, 13, 21, 0x4e0811a1) \
+    STEP(I, a, b, c, d,  4,  6, 0xf7537e82) \
+    STEP(I, d, a, b, c, 11, 10, 0xbd3af235) \
+    STEP(I, c, d, a, b,  2, 15, 0x2ad7d2bb) \
+    STEP(I, b, c, d, a,  9, 21, 0xeb86d391)
+
+// Basic MD5 functions.
+#define MD5_F(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+#define MD5_G(x, y, z) ((y) ^ ((z) & ((x) ^ (y))))
+#define MD5_H(x, y, z) ((x) ^ (y) ^ (z))
+#define MD5_I(x, y, z) ((y) ^ ((x) | ~(z)))
+
+#define MD5_STEP(f, a, b, c, d, i, s, t) \
+    a += MD5_##f(b, c, d) + X[i] + t; \
+    a = Rotl32(a, s) + b;
+
+// Processes whole blocks.
+static void MD5Transform(unsigned uState[4], const unsigned char* pData, size_t uBlocks)
+{
+    unsigned X[16];
+    int i;
+
+    for(; uBlocks!=0; uBlocks--, pData+=64)
+    {
+        for(i=0; i<16; i++)
+            X[i] = ReadLE32(pData+4*i);
+
+        unsigned a = uState[0];
+        unsigned b = uState[1];
+        unsigned c = uState[2];
+        unsigned d = uState[3];
+
+        MD5_ROUNDS(MD5_STEP)
+
+        uState[0] += a;
+        uState[1] += b;
+        uState[2] += c;
+        uState[3] += d;
+    }
+}
+
+#ifdef HASH_X86
+
+// The same functions for four lanes.
+#define MD5_SSE_F(x, y, z) _mm_xor_si128(z, _mm_and_si128(x, _mm_xor_si128(y, z)))
+#define MD5_SSE_G(x, y, z) _mm_xor_si128(y, _mm_and_si128(z, _mm_xor_si128(x, y)))
+#define MD5_SSE_H(x, y, z) _mm_xor_si128(_mm_xor_si128(x, y), z)
+#define MD5_SSE_I(x, y, z) _mm_xor_si128(y, _mm_or_si128(x, _mm_xor_si128(z, ones)))
+
+#define MD5_SSE_STEP(f, a, b, c, d, i, s, t) \
+    a = _mm_add_epi32(_mm_add_epi32(a, MD5_SSE_##f(b, c, d)), \
+        _mm_add_epi32(X[i], _mm_set1_epi32((int)t))); \
+    a = _mm_add_epi32(_mm_or_si128(_mm_slli_epi32(a, s), _mm_srli_epi32(a, 32-s)), b);
+
+// Processes whole blocks of four buffers at once. Each register holds
+// the same word of the four buffers.
+HASH_TARGET_SSE2
+static void MD5TransformSSE2(unsigned uState[4][4], const unsigned char* const pData[4], size_t uBlocks)
+{
+    const __m128i ones = _mm_set1_epi32(-1);
+    __m128i X[16];
+    size_t uOffs;
+    int i;
+
+    __m128i sa = _mm_setr_epi32((int)uState[0][0], (int)uState[1][0], (int)uState[2][0], (int)uState[3][0]);
+    __m128i sb = _mm_setr_epi32((int)uState[0][1], (int)uState[1][1], (int)uState[2][1], (int)uState[3][1]);
+    __m128i sc = _mm_setr_epi32((int)uState[0][2], (int)uState[1][2], (int)uState[2][2], (int)uState[3][2]);
+    __m128i sd = _mm_setr_epi32((int)uState[0][3], (int)uState[1][3], (int)uState[2][3], (int)uState[3][3]);
+
+    for(uOffs=0; uBlocks!=0; uBlocks--, uOffs+=64)
+    {
+        // Transpose 4x4 words of each 16-byte column
+        for(i=0; i<4; i++)
+        {
+            __m128i r0 = _mm_loadu_si128((const __m128i*)(pData[0]+uOffs+16*i));
+            __m128i r1 = _mm_loadu_si128((const __m128i*)(pData[1]+uOffs+16*i));
+            __m128i r2 = _mm_loadu_si128((const __m128i*)(pData[2]+uOffs+16*i));
+            __m128i r3 = _mm_loadu_si128((const __m128i*)(pData[3]+uOffs+16*i));
+            __m128i t0 = _mm_unpacklo_epi32(r0, r1);
+            __m128i t1 = _mm_unpacklo_epi32(r2, r3);
+            __m128i t2 = _mm_unpackhi_epi32(r0, r1);
+            __m128i t3 = _mm_unpackhi_epi32(r2, r3);
+            X[4*i] = _mm_unpacklo_epi64(t0, t1);
+            X[4*i+1] = _mm_unpackhi_epi64(t0, t1);
+            X[4*i+2] = _mm_unpacklo_epi64(t2, t3);
+            X[4*i+3] = _mm_unpackhi_epi64(t2, t3);
+        }
+
+        __m128i a = sa;
+        __m128i b = sb;
+        __m128i c = sc;
+        __m128i d = sd;
+
+        MD5_ROUNDS(MD5_SSE_STEP)
+
+        sa = _mm_add_epi32(sa, a);
+        sb = _mm_add_epi32(sb, b);
+        sc = _mm_add_epi32(sc, c);
+        sd = _mm_add_epi32(sd, d);
+    }
+
+    unsigned uOut[4][4];
+    _mm_storeu_si128((__m128i*)uOut[0], sa);
+    _mm_storeu_si128((__m128i*)uOut[1], sb);
+    _mm_storeu_si128((__m128i*)uOut[2], sc);
+    _mm_storeu_si128((__m128i*)uOut[3], sd);
+    for(i=0; i<4; i++)
+    {
+        uState[i][0] = uOut[0][i];
+        uState[i][1] = uOut[1][i];
+        uState[i][2] = uOut[2][i];
+        uState[i][3] = uOut[3][i];
+    }
+}
+
+#endif //HASH_X86
+
+CMD5::CMD5()
+{
+    Init();
+}
+
+void CMD5::Init()
+{
+    m_uState[0] = 0x67452301;
+    m_uState[1] = 0xefcdab89;
+    m_uState[2] = 0x98badcfe;
+    m_uState[3] = 0x10325476;
+    m_uCount = 0;
+}
+
+void CMD5::Update(const void* pData, size_t uSize)
+{
+    const unsigned char* p = (const unsigned char*)pData;
+    size_t uUsed = (size_t)(m_uCount&63);
+    m_uCount += uSize;
+
+    if(uUsed!=0)
+    {
+        size_t uCopy = 64-uUsed;
+        if(uCopy>uSize)
+            uCopy = uSize;
+        memcpy(m_Buffer+uUsed, p, uCopy);
+        p += uCopy;
+        uSize -= uCopy;
+        if(uUsed+uCopy<64)
+            return;
+        MD5Transform(m_uState, m_Buffer, 1);
+    }
+
+    // Hash whole blocks right from the input
+    MD5Transform(m_uState, p, uSize/64);
+    p += uSize&~(size_t)63;
+    uSize &= 63;
+
+    if(uSize!=0)
+        memcpy(m_Buffer, p, uSize);
+}
+
+void CMD5::Final(unsigned char pDigest[MD5_DIGEST_SIZE])
+{
+    // Pad to 56 bytes mod 64 and append the bit count
+    unsigned char Padding[72];
+    unsigned long long uBits = m_uCount*8;
+    size_t uPad = 64-(size_t)((m_uCount+8)&63);
+    memset(Padding, 0, sizeof(Padding));
+    Padding[0] = 0x80;
+    WriteLE32(Padding+uPad, (unsigned)uBits);
+    WriteLE32(Padding+uPad+4, (unsigned)(uBits>>32));
+    Update(Padding, uPad+8);
+
+    int i;
+    for(i=0; i<4; i++)
+        WriteLE32(pDigest+4*i, m_uState[i]);
+
+    Init();
+}
+
+// Compares buffer sizes, so that buffers of similar size share the lanes.
+struct CompareSizes
+{
+    const size_t* m_puSizes;
+    bool operator()(size_t i, size_t j) const
+    {
+        return m_puSizes[i]>m_puSizes[j];
+    }
+};
+
+void CMD5::HashMany(const void* const* ppData, const size_t* puSizes, size_t uCount,
+    unsigned char (*pDigests)[MD5_DIGEST_SIZE])
+{
+    size_t uFirst = 0;
+
+#ifdef HASH_X86
+    if(g_nHashIsa>=HASH_ISA_SSE2 && uCount>=4)
+    {
+        std::vector<size_t> aOrder(uCount);
+        size_t i;
+        for(i=0; i<uCount; i++)
+            aOrder[i] = i;
+        CompareSizes cmp = {puSizes};
+        std::sort(aOrder.begin(), aOrder.end(), cmp);
+
+        for(; uFirst+4<=uCount; uFirst+=4)
+        {
+            const unsigned char* pLanes[4];
+            unsigned uState[4][4];
+            CMD5 md5[4];
+            size_t uBlocks = puSizes[aOrder[uFirst+3]]/64; // The smallest of the four
+            int nLane;
+
+            for(nLane=0; nLane<4; nLane++)
+            {
+                pLanes[nLane] = (const unsigned char*)ppData[aOrder[uFirst+nLane]];
+                memcpy(uState[nLane], md5[nLane].m_uState, sizeof(uState[nLane]));
+            }
+
+            MD5TransformSSE2(uState, pLanes, uBlocks);
+
+            // Each lane hashes the rest of its buffer alone
+            for(nLane=0; nLane<4; nLane++)
+            {
+                size_t uIndex = aOrder[uFirst+nLane];
+                memcpy(md5[nLane].m_uState, uState[nLane], sizeof(uState[nLane]));
+                md5[nLane].m_uCount = uBlocks*64;
+                md5[nLane].Update(pLanes[nLane]+uBlocks*64, puSizes[uIndex]-uBlocks*64);
+                md5[nLane].Final(pDigests[uIndex]);
+            }
+        }
+
+        for(i=uFirst; i<uCount; i++)
+        {
+            CMD5 md5;
+            md5.Update(ppData[aOrder[i]], puSizes[aOrder[i]]);
+            md5.Final(pDigests[aOrder[i]]);
+        }
+        return;
+    }
+#endif
+
+    for(; uFirst<uCount; uFirst++)
+    {
+        CMD5 md5;
+        md5.Update(ppData[uFirst], puSizes[uFirst]);
+        md5.Final(pDigests[uFirst]);
+    }
+}
+
+//-----------------------------------------------
+// SHA-256
+//-----------------------------------------------
+
+static const unsigned g_uSHA256K[64] =
+{
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+// Processes whole blocks without special instructions.
+static void SHA256Transform(unsigned uState[8], const unsigned char* pData, size_t uBlocks)
+{
+    unsigned W[64];
+    int i;
+
+    for(; uBlocks!=0; uBlocks--, pData+=64)
+    {
+        for(i=0; i<16; i++)
+            W[i] = ReadBE32(pData+4*i);
+        for(i=16; i<64; i++)
+        {
+            unsigned s0 = Rotr32(W[i-15], 7) ^ Rotr32(W[i-15], 18) ^ (W[i-15]>>3);
+            unsigned s1 = Rotr32(W[i-2], 17) ^ Rotr32(W[i-2], 19) ^ (W[i-2]>>10);
+            W[i] = W[i-16]+s0+W[i-7]+s1;
+        }
+
+        unsigned a = uState[0], b = uState[1], c = uState[2], d = uState[3];
+        unsigned e = uState[4], f = uState[5], g = uState[6], h = uState[7];
+
+        for(i=0; i<64; i++)
+        {
+            unsigned S1 = Rotr32(e, 6) ^ Rotr32(e, 11) ^ Rotr32(e, 25);
+            unsigned ch = g ^ (e & (f ^ g));
+            unsigned t1 = h+S1+ch+g_uSHA256K[i]+W[i];
+            unsigned S0 = Rotr32(a, 2) ^ Rotr32(a, 13) ^ Rotr32(a, 22);
+            unsigned maj = (a & b) | (c & (a | b));
+            unsigned t2 = S0+maj;
+            h = g;
+            g = f;
+            f = e;
+            e = d+t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1+t2;
+        }
+
+        uState[0] += a; uState[1] += b; uState[2] += c; uState[3] += d;
+        uState[4] += e; uState[5] += f; uState[6] += g; uState[7] += h;
+    }
+}
+
+#ifdef HASH_HAVE_SHANI
+
+// Processes whole blocks with SHA extensions. Each group makes four rounds
+// and computes message words for later groups.
+HASH_TARGET_SHA
+static void SHA256TransformSHANI(unsigned uState[8], const unsigned char* pData, size_t uBlocks)
+{
+    const __m128i MASK = _mm_set_epi64x(0x0c0d0e0f08090a0bLL, 0x0405060700010203LL);
+    __m128i MSG[4];
+    int i;
+
+    // State is kept as ABEF and CDGH
+    __m128i TMP = _mm_loadu_si128((const __m128i*)&uState[0]);
+    __m128i STATE1 = _mm_loadu_si128((const __m128i*)&uState[4]);
+    TMP = _mm_shuffle_epi32(TMP, 0xB1);
+    STATE1 = _mm_shuffle_epi32(STATE1, 0x1B);
+    __m128i STATE0 = _mm_alignr_epi8(TMP, STATE1, 8);
+    STATE1 = _mm_blend_epi16(STATE1, TMP, 0xF0);
+
+    for(; uBlocks!=0; uBlocks--, pData+=64)
+    {
+        __m128i ABEF = STATE0;
+        __m128i CDGH = STATE1;
+
+        for(i=0; i<4; i++)
+            MSG[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(pData+16*i)), MASK);
+
+        for(i=0; i<16; i++)
+        {
+            __m128i W = _mm_add_epi32(MSG[i&3], _mm_loadu_si128((const __m128i*)&g_uSHA256K[4*i]));
+            STATE1 = _mm_sha256rnds2_epu32(STATE1, STATE0, W);
+            if(i>=3 && i<=14)
+            {
+                TMP = _mm_alignr_epi8(MSG[i&3], MSG[(i+3)&3], 4);
+                MSG[(i+1)&3] = _mm_sha256msg2_epu32(_mm_add_epi32(MSG[(i+1)&3], TMP), MSG[i&3]);
+            }
+            W = _mm_shuffle_epi32(W, 0x0E);
+            STATE0 = _mm_sha256rnds2_epu32(STATE0, STATE1, W);
+            if(i>=1 && i<=12)
+                MSG[(i+3)&3] = _mm_sha256msg1_epu32(MSG[(i+3)&3], MSG[i&3]);
+        }
+
+        STATE0 = _mm_add_epi32(STATE0, ABEF);
+        STATE1 = _mm_add_epi32(STATE1, CDGH);
+    }
+
+    TMP = _mm_shuffle_epi32(STATE0, 0x1B);
+    STATE1 = _mm_shuffle_epi32(STATE1, 0xB1);
+    STATE0 = _mm_blend_epi16(TMP, STATE1, 0xF0);
+    STATE1 = _mm_alignr_epi8(STATE1, TMP, 8);
+    _mm_storeu_si128((__m128i*)&uState[0], STATE0);
+    _mm_storeu_si128((__m128i*)&uState[4], STATE1);
+}
+
+#endif //HASH_HAVE_SHANI
+
+CSHA256::CSHA256()
+{
+    Init();
+}
+
+void CSHA256::Init()
+{
+    m_uState[0] = 0x6a09e667;
+    m_uState[1] = 0xbb67ae85;
+    m_uState[2] = 0x3c6ef372;
+    m_uState[3] = 0xa54ff53a;
+    m_uState[4] = 0x510e527f;
+    m_uState[5] = 0x9b05688c;
+    m_uState[6] = 0x1f83d9ab;
+    m_uState[7] = 0x5be0cd19;
+    m_uCount = 0;
+}
+
+void CSHA256::ProcessBlocks(const unsigned char* pData, size_t uBlocks)
+{
+#ifdef HASH_HAVE_SHANI
+    if(g_nHashIsa==HASH_ISA_SHA)
+    {
+        SHA256TransformSHANI(m_uState, pData, uBlocks);
+        return;
+    }
+#endif
+
+    SHA256Transform(m_uState, pData, uBlocks);
+}
+
+void CSHA256::Update(const void* pData, size_t uSize)
+{
+    const unsigned char* p = (const unsigned char*)pData;
+    size_t uUsed = (size_t)(m_uCount&63);
+    m_uCount += uSize;
+
+    if(uUsed!=0)
+    {
+        size_t uCopy = 64-uUsed;
+        if(uCopy>uSize)
+            uCopy = uSize;
+        memcpy(m_Buffer+uUsed, p, uCopy);
+        p += uCopy;
+        uSize -= uCopy;
+        if(uUsed+uCopy<64)
+            return;
+        ProcessBlocks(m_Buffer, 1);
+    }
+
+    if(uSize>=64)
+        ProcessBlocks(p, uSize/64);
+    p += uSize&~(size_t)63;
+    uSize &= 63;
+
+    if(uSize!=0)
+        memcpy(m_Buffer, p, uSize);
+}
+
+void CSHA256::Final(unsigned char pDigest[SHA256_DIGEST_SIZE])
+{
+    unsigned char Padding[72];
+    unsigned long long uBits = m_uCount*8;
+    size_t uPad = 64-(size_t)((m_uCount+8)&63);
+    memset(Padding, 0, sizeof(Padding));
+    Padding[0] = 0x80;
+    WriteBE32(Padding+uPad, (unsigned)(uBits>>32));
+    WriteBE32(Padding+uPad+4, (unsigned)uBits);
+    Update(Padding, uPad+8);
+
+    int i;
+    for(i=0; i<8; i++)
+        WriteBE32(pDigest+4*i, m_uState[i]);
+
+    Init();
+}
+
+//-----------------------------------------------
+// Fast hash (XXH64)
+//-----------------------------------------------
+
+static const unsigned long long P1 = 0x9E3779B185EBCA87ULL;
+static const unsigned long long P2 = 0xC2B2AE3D27D4EB4FULL;
+static const unsigned long long P3 = 0x165667B19E3779F9ULL;
+static const unsigned long long P4 = 0x85EBCA77C2B2AE63ULL;
+static const unsigned long long P5 = 0x27D4EB2F165667C5ULL;
+
+// Seed of the second half of 128-bit hash is derived from the first one.
+static const unsigned long long g_uSeed2 = 0x9E3779B97F4A7C15ULL;
+
+static inline unsigned long long XXH64Round(unsigned long long uAcc, unsigned long long uInput)
+{
+    uAcc += uInput*P2;
+    uAcc = Rotl64(uAcc, 31);
+    return uAcc*P1;
+}
+
+static inline unsigned long long XXH64Merge(unsigned long long uAcc, unsigned long long uVal)
+{
+    uAcc ^= XXH64Round(0, uVal);
+    return uAcc*P1+P4;
+}
+
+CFastHash::CFastHash()
+{
+    Init();
+}
+
+void CFastHash::Init(unsigned long long uSeed, bool b128)
+{
+    int i;
+    for(i=0; i<2; i++)
+    {
+        State& s = m_State[i];
+        s.m_uSeed = i==0 ? uSeed : uSeed^g_uSeed2;
+        s.m_uAcc[0] = s.m_uSeed+P1+P2;
+        s.m_uAcc[1] = s.m_uSeed+P2;
+        s.m_uAcc[2] = s.m_uSeed;
+        s.m_uAcc[3] = s.m_uSeed-P1;
+    }
+    m_b128 = b128;
+    m_uCount = 0;
+}
+
+void CFastHash::ProcessStripes(State& s, const unsigned char* pData, size_t uStripes)
+{
+    // Four independent accumulators keep the multipliers busy
+    unsigned long long v1 = s.m_uAcc[0];
+    unsigned long long v2 = s.m_uAcc[1];
+    unsigned long long v3 = s.m_uAcc[2];
+    unsigned long long v4 = s.m_uAcc[3];
+
+    for(; uStripes!=0; uStripes--, pData+=32)
+    {
+        v1 = XXH64Round(v1, ReadLE64(pData));
+        v2 = XXH64Round(v2, ReadLE64(pData+8));
+        v3 = XXH64Round(v3, ReadLE64(pData+16));
+        v4 = XXH64Round(v4, ReadLE64(pData+24));
+    }
+
+    s.m_uAcc[0] = v1;
+    s.m_uAcc[1] = v2;
+    s.m_uAcc[2] = v3;
+    s.m_uAcc[3] = v4;
+}
+
+void CFastHash::Update(const void* pData, size_t uSize)
+{
+    const unsigned char* p = (const unsigned char*)pData;
+    size_t uUsed = (size_t)(m_uCount&31);
+    int nStates = m_b128 ? 2 : 1;
+    int i;
+    m_uCount += uSize;
+
+    if(uUsed!=0)
+    {
+        size_t uCopy = 32-uUsed;
+        if(uCopy>uSize)
+            uCopy = uSize;
+        memcpy(m_Buffer+uUsed, p, uCopy);
+        p += uCopy;
+        uSize -= uCopy;
+        if(uUsed+uCopy<32)
+            return;
+        for(i=0; i<nStates; i++)
+            ProcessStripes(m_State[i], m_Buffer, 1);
+    }
+
+    // Both halves of 128-bit hash go through the data while it is in cache
+    while(uSize>=32)
+    {
+        size_t uStripes = uSize/32;
+        if(uStripes>512)
+            uStripes = 512;
+        for(i=0; i<nStates; i++)
+            ProcessStripes(m_State[i], p, uStripes);
+        p += uStripes*32;
+        uSize -= uStripes*32;
+    }
+
+    if(uSize!=0)
+        memcpy(m_Buffer, p, uSize);
+}
+
+unsigned long long CFastHash::Finish(const State& s) const
+{
+    unsigned long long h;
+
+    if(m_uCount>=32)
+    {
+        h = Rotl64(s.m_uAcc[0], 1)+Rotl64(s.m_uAcc[1], 7)+
+            Rotl64(s.m_uAcc[2], 12)+Rotl64(s.m_uAcc[3], 18);
+        h = XXH64Merge(h, s.m_uAcc[0]);
+        h = XXH64Merge(h, s.m_uAcc[1]);
+        h = XXH64Merge(h, s.m_uAcc[2]);
+        h = XXH64Merge(h, s.m_uAcc[3]);
+    }
+    else
+        h = s.m_uSeed+P5;
+
+    h += m_uCount;
+
+    const unsigned char* p = m_Buffer;
+    size_t uSize = (size_t)(m_uCount&31);
+    for(; uSize>=8; uSize-=8, p+=8)
+    {
+        h ^= XXH64Round(0, ReadLE64(p));
+        h = Rotl64(h, 27)*P1+P4;
+    }
+    if(uSize>=4)
+    {
+        h ^= (unsigned long long)ReadLE32(p)*P1;
+        h = Rotl64(h, 23)*P2+P3;
+        uSize -= 4;
+        p += 4;
+    }
+    for(; uSize!=0; uSize--, p++)
+    {
+        h ^= (*p)*P5;
+        h = Rotl64(h, 11)*P1;
+    }
+
+    h ^= h>>33;
+    h *= P2;
+    h ^= h>>29;
+    h *= P3;
+    h ^= h>>32;
+    return h;
+}
+
+unsigned long long CFastHash::Final64()
+{
+    return Finish(m_State[0]);
+}
+
+void CFastHash::Final128(unsigned long long pHash[2])
+{
+    pHash[0] = Finish(m_State[0]);
+    pHash[1] = m_b128 ? Finish(m_State[1]) : 0;
+}
+
+unsigned long long fast_hash64(const void* pData, size_t uSize, unsigned long long uSeed)
+{
+    CFastHash hash;
+    hash.Init(uSeed);
+    hash.Update(pData, uSize);
+    return hash.Final64();
+}
+
+void fast_hash128(const void* pData, size_t uSize, unsigned long long pHash[2])
+{
+    CFastHash hash;
+    hash.Init(0, true);
+    hash.Update(pData, uSize);
+    hash.Final128(pHash);
+}
@@ -0,0 +1,145 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+// File: Hash.h
+// Description: MD5, SHA-256 and a fast non-cryptographic hash. Vector versions
+// are selected at run time depending on CPU. They give exactly the same result as the scalar ones.
+// This file doesn't depend on Windows headers, so it can be built and tested anywhere.
+
+#pragma once
+
+#include <stddef.h>
+
+// Digest sizes in bytes.
+#define MD5_DIGEST_SIZE    16
+#define SHA256_DIGEST_SIZE 32
+
+// Instruction sets hash functions may use.
+#define HASH_ISA_SCALAR  0  // Plain C++ code.
+#define HASH_ISA_SSE2    1  // SSE2 (four MD5 digests at once).
+#define HASH_ISA_SHA     2  // SHA extensions with SSSE3 and SSE4.1 (SHA-256).
+
+// Returns the best instruction set supported by CPU.
+int hash_get_best_isa();
+
+// Returns the instruction set currently used.
+int hash_get_isa();
+
+// Selects the instruction set to use (used by tests and benchmarks). If the CPU
+// doesn't support it, the best supported one is selected. Returns the selected one.
+int hash_set_isa(int nIsa);
+
+// Formats a digest as a lowercase hexadecimal string (szHex must have room for 2*uSize+1 characters).
+void hash_to_hex(const unsigned char* pDigest, size_t uSize, char* szHex);
+
+// MD5 message digest (RFC 1321).
+class CMD5
+{
+public:
+
+    // Constructor.
+    CMD5();
+
+    // Starts a new digest.
+    void Init();
+
+    // Adds data to the digest.
+    void Update(const void* pData, size_t uSize);
+
+    // Finishes the digest.
+    void Final(unsigned char pDigest[MD5_DIGEST_SIZE]);
+
+    // Computes digests of several independent buffers at once. With SSE2,
+    // four buffers are hashed in parallel, which is about three times faster
+    // than hashing them one by one.
+    static void HashMany(const void* const* ppData, const size_t* puSizes, size_t uCount,
+        unsigned char (*pDigests)[MD5_DIGEST_SIZE]);
+
+private:
+
+    unsigned m_uState[4];           // State (ABCD).
+    unsigned long long m_uCount;    // Count of bytes hashed.
+    unsigned char m_Buffer[64];     // Incomplete block.
+};
+
+// SHA-256 message digest (FIPS 180-4). Uses SHA extensions when the CPU has them.
+class CSHA256
+{
+public:
+
+    // Constructor.
+    CSHA256();
+
+    // Starts a new digest.
+    void Init();
+
+    // Adds data to the digest.
+    void Update(const void* pData, size_t uSize);
+
+    // Finishes the digest.
+    void Final(unsigned char pDigest[SHA256_DIGEST_SIZE]);
+
+private:
+
+    // Processes whole blocks.
+    void ProcessBlocks(const unsigned char* pData, size_t uBlocks);
+
+    unsigned m_uState[8];           // State (A-H).
+    unsigned long long m_uCount;    // Count of bytes hashed.
+    unsigned char m_Buffer[64];     // Incomplete block.
+};
+
+// Fast non-cryptographic hash (XXH64) for content signatures. The 128-bit form
+// combines two 64-bit hashes with different seeds, computed in a single pass.
+class CFastHash
+{
+public:
+
+    // Constructor.
+    CFastHash();
+
+    // Starts a new hash.
+    void Init(unsigned long long uSeed = 0, bool b128 = false);
+
+    // Adds data to the hash.
+    void Update(const void* pData, size_t uSize);
+
+    // Returns the 64-bit hash.
+    unsigned long long Final64();
+
+    // Returns the 128-bit hash (requires b128 passed to Init()).
+    void Final128(unsigned long long pHash[2]);
+
+private:
+
+    // State of one 64-bit hash.
+    struct State
+    {
+        unsigned long long m_uSeed;
+        unsigned long long m_uAcc[4];
+    };
+
+    // Processes whole 32-byte stripes.
+    static void ProcessStripes(State& s, const unsigned char* pData, size_t uStripes);
+
+    // Returns the hash of the state and the buffered tail.
+    unsigned long long Finish(const State& s) const;
+
+    State m_State[2];               // Hash states (the second one is for 128-bit hash).
+    bool m_b128;                    // Is 128-bit hash computed?
+    unsigned long long m_uCount;    // Count of bytes hashed.
+    unsigned char m_Buffer[32];     // Incomplete stripe.
+};
+
+// Returns the 64-bit fast hash of a buffer.
+unsigned long long fast_hash64(const void* pData, size_t uSize, unsigned long long uSeed = 0);
+
+// Computes the 128-bit fast hash of a buffer.
+void fast_hash128(const void* pData, size_t uSize, unsigned long long pHash[2]);
@@ -11,7 +11,6 @@ be found in the Authors.txt file in the root of the source tree.
 #include "stdafx.h"
 #include "HttpRequestSender.h"
 #include "base64.h"
-#include "md5.h"
 #include "Utility.h"
 #include "strconv.h"
 
@@ -23,6 +22,9 @@ be found in the Authors.txt file in the root of the source tree.
 CHttpRequestSender::CHttpRequestSender()
 {
     // Init variables
+    m_Assync = NULL;
+    m_pTransport = NULL;
+    m_bGotResponse = FALSE;
     m_sBoundary = _T("AaB03x5fs1045fcc7");
 
     m_sTextPartHeaderFmt = _T("--%s\r\nContent-disposition: form-data; name=\"%s\"\r\n\r\n");
@@ -31,12 +33,21 @@ CHttpRequestSender::CHttpRequestSender()
     m_sFilePartFooterFmt = _T("\r\n");
 }
 
+// Destructor
+CHttpRequestSender::~CHttpRequestSender()
+{
+    if(m_pTransport)
+        delete m_pTransport;
+}
+
 // Sends HTTP request assyncronously (in a working thread)
 BOOL CHttpRequestSender::SendAssync(CHttpRequest& Request, AssyncNotification* an)
 {
     // Copy parameters
     m_Request = Request;
     m_Assync = an;
+    m_LastResponse = CHttpTransportResponse();
+    m_bGotResponse = FALSE;
 
     // Create worker thread
     HANDLE hThread = CreateThread(NULL, 0, WorkerThread, (void*)this, 0, NULL);
@@ -56,208 +67,85 @@ DWORD WINAPI CHttpRequestSender::WorkerThread(VOID* pParam)
     return 0;
 }
 
+std::string CHttpRequestSender::GetResponseBody()
+{
+    return m_LastResponse.m_sBody;
+}
+
+BOOL CHttpRequestSender::GetBatchLimits(int& nMaxCount, ULONG64& uMaxSize)
+{
+    nMaxCount = 0;
+    uMaxSize = 0;
+
+    if(!m_bGotResponse)
+        return FALSE;
+
+    CString sValue;
+    if(m_LastResponse.GetHeader(_T("X-CrashRpt-Batch-Max-Count"), sValue))
+        nMaxCount = _ttoi(sValue);
+    if(m_LastResponse.GetHeader(_T("X-CrashRpt-Batch-Max-Size"), sValue))
+        uMaxSize = _tcstoui64(sValue, NULL, 10);
+
+    return TRUE;
+}
+
 // Sends HTTP request and checks response
 BOOL CHttpRequestSender::InternalSend()
 {
     BOOL bStatus = FALSE;      // Resulting status
-    strconv_t strconv;         // String conversion
-    HINTERNET hSession = NULL; // Internet session
-    HINTERNET hConnect = NULL; // Internet connection
-    HINTERNET hRequest = NULL; // Handle to HTTP request
-    TCHAR szProtocol[512];     // Protocol
-    TCHAR szServer[512];       // Server name
-    TCHAR szURI[1024];         // URI
-    DWORD dwPort=0;            // Port
-    CString sHeaders = _T("Content-type: multipart/form-data; boundary=") + m_sBoundary;
-    LPCTSTR szAccept[2]={_T("*/*"), NULL};
-    INTERNET_BUFFERS BufferIn;
-    BYTE pBuffer[4096] = {0};
-    BOOL bRet = FALSE;
-    DWORD dwBuffSize = 0;
+    CString sURI;              // URI
     CString sMsg;
-    LONGLONG lPostSize = 0;
-    std::map<CString, std::string>::iterator it;
-    std::map<CString, CHttpRequestFile>::iterator it2;
+    CHttpTransportRequest Request;
+    CHttpTransportResponse Response;
 
     {
-        // Calculate size of data to send
-        bRet = CalcRequestSize(lPostSize);
-        if(!bRet)
-        {
-            m_Assync->SetProgress(_T("Error calculating size of data to send!"), 0);
+        // Connect to HTTP server
+        if(!Connect(m_Request.m_sUrl, sURI))
             goto cleanup;
-        }
 
-        // Create Internet session
-        m_Assync->SetProgress(_T("Opening Internet connection."), 0);
-        hSession = InternetOpen(_T("CrashRpt"), INTERNET_OPEN_TYPE_PRECONFIG, NULL, NULL, 0);
-        if(hSession==NULL)
+        // Check if canceled
+        if(m_Assync->IsCancelled()){ goto cleanup; }
+
+        // Large attachments are uploaded in chunks, so an interrupted upload can be resumed.
+        int nResumable = m_Request.m_bBatch ? -1 : SendResumable(sURI);
+        if(nResumable==0)
+            goto cleanup;
+        else if(nResumable>0)
         {
-            m_Assync->SetProgress(_T("Error opening Internet session"), 0);
+            bStatus = TRUE;
+            m_Assync->SetProgress(_T("Error report has been sent OK!"), 100, false);
             goto cleanup;
         }
 
-        // Parse application-provided URL
-        ParseURL(m_Request.m_sUrl, szProtocol, 512, szServer, 512, dwPort, szURI, 1024);
-
-        // Connect to HTTP server
-        m_Assync->SetProgress(_T("Connecting to server"), 0, true);
-
-        hConnect = InternetConnect(
-            hSession,     // InternetOpen handle
-            szServer,     // Server  name
-            (WORD)dwPort, // Default HTTPS port - 443
-            NULL,         // User name
-            NULL,         //  User password
-            INTERNET_SERVICE_HTTP, // Service
-            0,            // Flags
-            0             // Context
-            );
-        if(hConnect==NULL)
+        // Prepare multipart request body
+        if(!FormatRequest(Request))
         {
-            m_Assync->SetProgress(_T("Error connecting to server"), 0);
+            m_Assync->SetProgress(_T("Error calculating size of data to send!"), 0);
             goto cleanup;
         }
 
-        // Set large receive timeout to avoid problems in case of
-        // slow upload => slow response from the server.
-        DWORD dwReceiveTimeout = 0;
-        InternetSetOption(hConnect, INTERNET_OPTION_RECEIVE_TIMEOUT,
-            &dwReceiveTimeout, sizeof(dwReceiveTimeout));
-
-        // Check if canceled
-        if(m_Assync->IsCancelled()){ goto cleanup; }
-
-        // Add a message to log
-        m_Assync->SetProgress(_T("Opening HTTP request..."), 0, true);
-
-        // Configure flags for HttpOpenRequest
-        DWORD dwFlags = INTERNET_FLAG_NO_CACHE_WRITE | INTERNET_FLAG_NO_AUTO_REDIRECT;
-        if(dwPort==INTERNET_DEFAULT_HTTPS_PORT)
-            dwFlags |= INTERNET_FLAG_SECURE; // Use SSL
-
         BOOL bRedirect = FALSE;
-        int nCount = 0;
-        while(nCount==0 || bRedirect)
+        for(;;)
         {
-            nCount++;
-
-            // Open HTTP request
-            hRequest = HttpOpenRequest(
-                hConnect,
-                _T("POST"),
-                szURI,
-                NULL,
-                NULL,
-                szAccept,
-                dwFlags,
-                0
-                );
-            if (!hRequest)
-            {
-                m_Assync->SetProgress(_T("HttpOpenRequest has failed."), 0, true);
-                goto cleanup;
-            }
-
-            // This code was copied from http://support.microsoft.com/kb/182888 to address the problem
-            // that MVS doesn't have a valid SSL certificate.
-            DWORD extraSSLDwFlags = 0;
-            DWORD dwBuffLen = sizeof(extraSSLDwFlags);
-            InternetQueryOption (hRequest, INTERNET_OPTION_SECURITY_FLAGS,
-            (LPVOID)&extraSSLDwFlags, &dwBuffLen);
-            // We have to specifically ignore these 2 errors for MVS
-            extraSSLDwFlags |= SECURITY_FLAG_IGNORE_REVOCATION |  // Ignores certificate revocation problems.
-                               SECURITY_FLAG_IGNORE_WRONG_USAGE | // Ignores incorrect usage problems.
-                               SECURITY_FLAG_IGNORE_CERT_CN_INVALID | // Ignores the ERROR_INTERNET_SEC_CERT_CN_INVALID error message.
-                               SECURITY_FLAG_IGNORE_CERT_DATE_INVALID; // Ignores the ERROR_INTERNET_SEC_CERT_DATE_INVALID error message.
-            InternetSetOption (hRequest, INTERNET_OPTION_SECURITY_FLAGS,
-                                &extraSSLDwFlags, sizeof (extraSSLDwFlags) );
-
-            // Fill in buffer
-            BufferIn.dwStructSize = sizeof( INTERNET_BUFFERS ); // Must be set or error will occur
-            BufferIn.Next = NULL;
-            BufferIn.lpcszHeader = sHeaders;
-            BufferIn.dwHeadersLength = sHeaders.GetLength();
-            BufferIn.dwHeadersTotal = 0;
-            BufferIn.lpvBuffer = NULL;
-            BufferIn.dwBufferLength = 0;
-            BufferIn.dwBufferTotal = (DWORD)lPostSize; // This is the only member used other than dwStructSize
-            BufferIn.dwOffsetLow = 0;
-            BufferIn.dwOffsetHigh = 0;
-
-            m_dwPostSize = (DWORD)lPostSize;
-            m_dwUploaded = 0;
-
-            // Add a message to log
-            m_Assync->SetProgress(_T("Sending HTTP request..."), 0);
             // Send request
-            if(!HttpSendRequestEx( hRequest, &BufferIn, NULL, 0, 0))
-            {
-                m_Assync->SetProgress(_T("HttpSendRequestEx has failed."), 0);
-                goto cleanup;
-            }
-
-            // Write text fields
-            for(it=m_Request.m_aTextFields.begin(); it!=m_Request.m_aTextFields.end(); it++)
-            {
-                bRet = WriteTextPart(hRequest, it->first);
-                if(!bRet)
-                    goto cleanup;
-            }
-
-            // Write attachments
-            for(it2=m_Request.m_aIncludedFiles.begin(); it2!=m_Request.m_aIncludedFiles.end(); it2++)
-            {
-                bRet = WriteAttachmentPart(hRequest, it2->first);
-                if(!bRet)
-                    goto cleanup;
-            }
-
-            // Write boundary
-            bRet = WriteTrailingBoundary(hRequest);
-            if(!bRet)
-                goto cleanup;
-
-            // Add a message to log
-            m_Assync->SetProgress(_T("Ending HTTP request..."), 0);
-
-            // End request
-            if(!HttpEndRequest(hRequest, NULL, 0, 0))
-            {
-                m_Assync->SetProgress(_T("HttpEndRequest has failed."), 0);
+            Request.m_sURI = sURI;
+            if(!SendRequest(Request, Response))
                 goto cleanup;
-            }
-
-            // Add a message to log
-            m_Assync->SetProgress(_T("Reading server response..."), 0);
 
-            // Get HTTP response code from HTTP headers
-            DWORD lHttpStatus = 0;
-            DWORD lHttpStatusSize = sizeof(lHttpStatus);
-            BOOL bQueryInfo = HttpQueryInfo(hRequest, HTTP_QUERY_STATUS_CODE|HTTP_QUERY_FLAG_NUMBER,
-                                            &lHttpStatus, &lHttpStatusSize, 0);
-
-            if(bQueryInfo)
-            {
-                sMsg.Format(_T("Server response code: %ld"), lHttpStatus);
-                m_Assync->SetProgress(sMsg, 0);
-            }
+            LogResponse(Response);
 
-            // Read HTTP response
-            InternetReadFile(hRequest, pBuffer, 4095, &dwBuffSize);
-            pBuffer[dwBuffSize] = 0;
-            sMsg = CString((LPCSTR)pBuffer, dwBuffSize);
-            sMsg = _T("Server response body:")  + sMsg;
-            m_Assync->SetProgress(sMsg, 0);
+            // Acknowledgements of a batch are checked by the caller
+            if(m_Request.m_bBatch && Response.m_dwStatus==200)
+                break;
 
             // If the first byte of HTTP response is a digit, than assume a legacy way
             // of determining delivery status - the HTTP response starts with a delivery status code
-            if(dwBuffSize>0 && pBuffer[0]>='0' && pBuffer[0]<='9')
+            if(!Response.m_sBody.empty() && Response.m_sBody[0]>='0' && Response.m_sBody[0]<='9')
             {
                 m_Assync->SetProgress(_T("Assuming legacy method of determining delivery status (from HTTP response body)."), 0);
 
                 // Get status code from HTTP response
-                if(atoi((LPCSTR)pBuffer)!=200)
+                if(atoi(Response.m_sBody.c_str())!=200)
                 {
                     m_Assync->SetProgress(_T("Failed (HTTP response body doesn't start with code 200)."), 100, false);
                     goto cleanup;
@@ -265,57 +153,47 @@ BOOL CHttpRequestSender::InternalSend()
 
                 break;
             }
-            else
-            {
-                // If the first byte of HTTP response is not a digit, assume that
-                // the delivery status should be read from HTTP header
 
-                // Check if we have a redirect (302 response code)
-                if(bQueryInfo && lHttpStatus==302)
+            // If the first byte of HTTP response is not a digit, assume that
+            // the delivery status should be read from HTTP header
+
+            // Check if we have a redirect (302 response code)
+            if(Response.m_dwStatus==302)
+            {
+                // Check for multiple redirects
+                if(bRedirect)
                 {
-                    // Check for multiple redirects
-                    if(bRedirect)
-                    {
-                        m_Assync->SetProgress(_T("Multiple redirects are not allowed."), 100, false);
-                        goto cleanup;
-                    }
-
-                    bRedirect = TRUE;
-
-                    TCHAR szBuffer[1024]=_T("");
-                    DWORD dwBuffSize = 1024*sizeof(TCHAR);
-                    DWORD nIndex = 0;
-
-                    BOOL bQueryInfo = HttpQueryInfo(hRequest, HTTP_QUERY_LOCATION,
-                            szBuffer,
-                            &dwBuffSize,
-                            &nIndex);
-                    if(!bQueryInfo)
-                    {
-                        m_Assync->SetProgress(_T("Failed to redirect."), 100, false);
-                        goto cleanup;
-                    }
-                    else
-                    {
-                        // Parse the redirect URL
-                        ParseURL(szBuffer, szProtocol, 512, szServer, 512, dwPort, szURI, 1024);
-
-                        CString sMsg;
-                        sMsg.Format(_T("Redirecting to %s"), szBuffer);
-                        m_Assync->SetProgress(sMsg, 0, true);
-                        continue;
-                    }
+                    m_Assync->SetProgress(_T("Multiple redirects are not allowed."), 100, false);
+                    goto cleanup;
                 }
 
-                // Check for server response code - expected code 200
-                if(!bQueryInfo || lHttpStatus!=200)
+                bRedirect = TRUE;
+
+                CString sLocation;
+                if(!Response.GetHeader(_T("Location"), sLocation))
                 {
-                    m_Assync->SetProgress(_T("Failed (HTTP response code is not equal to 200)."), 100, false);
+                    m_Assync->SetProgress(_T("Failed to redirect."), 100, false);
                     goto cleanup;
                 }
 
-                break;
+                sMsg.Format(_T("Redirecting to %s"), (LPCTSTR)sLocation);
+                m_Assync->SetProgress(sMsg, 0, true);
+
+                // The new location may be on another server
+                if(!Connect(sLocation, sURI))
+                    goto cleanup;
+
+                continue;
+            }
+
+            // Check for server response code - expected code 200
+            if(Response.m_dwStatus!=200)
+            {
+                m_Assync->SetProgress(_T("Failed (HTTP response code is not equal to 200)."), 100, false);
+                goto cleanup;
             }
+
+            break;
         }
     }
 
@@ -331,17 +209,13 @@ cleanup:
         m_Assync->SetProgress(_T("Error sending HTTP request."), 100, false);
     }
 
-    // Clean up
-    if(hRequest)
-        InternetCloseHandle(hRequest);
-
-    // Clean up internet handle
-    if(hConnect)
-        InternetCloseHandle(hConnect);
-
-    // Clean up internet session
-    if(hSession)
-        InternetCloseHandle(hSession);
+    // Clean up (an idle connection is kept for the next report)
+    if(m_pTransport)
+    {
+        m_pTransport->Close();
+        delete m_pTransport;
+        m_pTransport = NULL;
+    }
 
     // Notify about completion
     m_Assync->SetCompleted(bStatus?0:1);
@@ -349,380 +223,438 @@ cleanup:
     return bStatus;
 }
 
-BOOL CHttpRequestSender::WriteTextPart(HINTERNET hRequest, CString sName)
+BOOL CHttpRequestSender::Connect(LPCTSTR szURL, CString& sURI)
 {
-    BOOL bRet = FALSE;
-
-    /* Write part header */
-    CString sHeader;
-    bRet= FormatTextPartHeader(sName, sHeader);
-    if(!bRet)
-    {
-        m_Assync->SetProgress(_T("Error formatting text part header."), 0);
-        return FALSE;
-    }
-
-    strconv_t strconv;
-    LPCSTR pszHeader = strconv.t2a(sHeader);
-    if(pszHeader==NULL)
-    {
-        m_Assync->SetProgress(_T("Error converting text part header to ASCII."), 0);
-        return FALSE;
-    }
+    TCHAR szProtocol[512];     // Protocol
+    TCHAR szServer[512];       // Server name
+    TCHAR szURI[1024];         // URI
+    DWORD dwPort=0;            // Port
 
-    DWORD dwBytesWritten = 0;
-    bRet=InternetWriteFile(hRequest, pszHeader, (DWORD)strlen(pszHeader), &dwBytesWritten);
-    if(!bRet)
-    {
-        m_Assync->SetProgress(_T("Error uploading text part header."), 0);
-        return FALSE;
-    }
-    UploadProgress(dwBytesWritten);
+    // Parse application-provided URL
+    ParseURL(szURL, szProtocol, 512, szServer, 512, dwPort, szURI, 1024);
+    sURI = szURI;
 
-    /* Write form data */
+    BOOL bSecure = _tcscmp(szProtocol, _T("https"))==0 || dwPort==INTERNET_DEFAULT_HTTPS_PORT;
 
-    std::map<CString, std::string>::iterator it = m_Request.m_aTextFields.find(sName);
-    if(it==m_Request.m_aTextFields.end())
+    if(m_pTransport)
     {
-        m_Assync->SetProgress(_T("Error searching for text part header name."), 0);
-        return FALSE;
+        m_pTransport->Close();
+        delete m_pTransport;
     }
 
-    size_t nDataSize = it->second.length();
-    int pos = 0;
-    DWORD dwBytesRead = 0;
-    for(;;)
-    {
-        if(m_Assync->IsCancelled())
-        {
-            return FALSE;
-        }
-
-        dwBytesRead = (DWORD)MIN(1024, nDataSize-pos);
-        if(dwBytesRead==0)
-            break; // EOF
+    m_pTransport = CHttpTransport::Create(bSecure, TRUE, m_Assync);
+    if(m_pTransport->Connect(szServer, dwPort, bSecure))
+        return TRUE;
 
-        std::string sBuffer = it->second.substr(pos, dwBytesRead);
+    delete m_pTransport;
+    m_pTransport = NULL;
 
-        DWORD dwBytesWritten = 0;
-        bRet=InternetWriteFile(hRequest, sBuffer.c_str(), dwBytesRead, &dwBytesWritten);
-        if(!bRet)
-        {
-            m_Assync->SetProgress(_T("Error uploading text part data."), 0);
-            return FALSE;
-        }
-        UploadProgress(dwBytesWritten);
+    if(m_Assync->IsCancelled())
+        return FALSE;
 
-        pos += dwBytesRead;
-    }
+    // The server may be reachable through a proxy found by automatic detection
+    m_Assync->SetProgress(_T("Retrying connection with WinINet."), 0);
 
-    /* Write part footer */
+    m_pTransport = CHttpTransport::Create(bSecure, FALSE, m_Assync);
+    if(m_pTransport->Connect(szServer, dwPort, bSecure))
+        return TRUE;
 
-    CString sFooter;
-    bRet= FormatTextPartFooter(sName, sFooter);
-    if(!bRet)
-    {
-        m_Assync->SetProgress(_T("Error formatting text part footer."), 0);
-        return FALSE;
-    }
+    delete m_pTransport;
+    m_pTransport = NULL;
 
-    LPCSTR pszFooter = strconv.t2a(sFooter);
-    if(pszFooter==NULL)
-    {
-        m_Assync->SetProgress(_T("Error converting text part footer to ASCII."), 0);
-        return FALSE;
-    }
+    return FALSE;
+}
 
-    bRet=InternetWriteFile(hRequest, pszFooter, (DWORD)strlen(pszFooter), &dwBytesWritten);
-    if(!bRet)
-    {
-        m_Assync->SetProgress(_T("Error uploading text part footer."), 0);
+BOOL CHttpRequestSender::SendRequest(CHttpTransportRequest& Request, CHttpTransportResponse& Response)
+{
+    if(!m_pTransport->SendRequest(Request, Response))
         return FALSE;
-    }
-    UploadProgress(dwBytesWritten);
 
+    m_LastResponse = Response;
+    m_bGotResponse = TRUE;
     return TRUE;
 }
 
-BOOL CHttpRequestSender::WriteAttachmentPart(HINTERNET hRequest, CString sName)
+void CHttpRequestSender::LogResponse(CHttpTransportResponse& Response)
 {
-    BOOL bRet = FALSE;
+    CString sMsg;
+    sMsg.Format(_T("Server response code: %ld"), Response.m_dwStatus);
+    m_Assync->SetProgress(sMsg, 0);
 
-    /* Write part header */
-    CString sHeader;
-    bRet= FormatAttachmentPartHeader(sName, sHeader);
-    if(!bRet)
-    {
-        m_Assync->SetProgress(_T("Error formatting attachment part header."), 0);
-        return FALSE;
-    }
+    sMsg = CString(Response.m_sBody.c_str(), (int)MIN(Response.m_sBody.length(), (size_t)4095));
+    sMsg = _T("Server response body:")  + sMsg;
+    m_Assync->SetProgress(sMsg, 0);
+}
 
-    strconv_t strconv;
-    LPCSTR pszHeader = strconv.t2a(sHeader);
-    if(pszHeader==NULL)
-    {
-        m_Assync->SetProgress(_T("Error converting attachment part header to ASCII."), 0);
-        return FALSE;
-    }
+// Encodes a form field for application/x-www-form-urlencoded content.
+static std::string UrlEncode(const std::string& sValue)
+{
+    static const char szHex[] = "0123456789ABCDEF";
+    std::string sResult;
 
-    DWORD dwBytesWritten = 0;
-    bRet=InternetWriteFile(hRequest, pszHeader, (DWORD)strlen(pszHeader), &dwBytesWritten);
-    if(!bRet)
+    size_t i;
+    for(i=0; i<sValue.length(); i++)
     {
-        m_Assync->SetProgress(_T("Error uploading attachment part header."), 0);
-        return FALSE;
+        unsigned char c = (unsigned char)sValue[i];
+        if((c>='0' && c<='9') || (c>='a' && c<='z') || (c>='A' && c<='Z') ||
+            c=='-' || c=='_' || c=='.' || c=='~')
+        {
+            sResult += (char)c;
+        }
+        else
+        {
+            sResult += '%';
+            sResult += szHex[c>>4];
+            sResult += szHex[c&0x0F];
+        }
     }
-    UploadProgress(dwBytesWritten);
 
-    /* Write attachment data */
+    return sResult;
+}
 
-    std::map<CString, CHttpRequestFile>::iterator it = m_Request.m_aIncludedFiles.find(sName);
-    if(it==m_Request.m_aIncludedFiles.end())
-    {
-        m_Assync->SetProgress(_T("Error searching for attachment part name."), 0);
-        return FALSE;
-    }
+int CHttpRequestSender::SendResumable(LPCTSTR szURI)
+{
+    // Only a request with a single large attachment is worth resuming
+    if(m_Request.m_aIncludedFiles.size()!=1)
+        return -1;
 
-    CString sFileName = it->second.m_sSrcFileName.GetBuffer(0);
-    HANDLE hFile = CreateFile(sFileName,
-        GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, NULL, NULL);
+    CString sFileName = m_Request.m_aIncludedFiles.begin()->second.m_sSrcFileName;
+    HANDLE hFile = CreateFile(sFileName, GENERIC_READ, FILE_SHARE_READ|FILE_SHARE_WRITE,
+        NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
     if(hFile==INVALID_HANDLE_VALUE)
-    {
-        m_Assync->SetProgress(_T("Error opening attachment file."), 0);
-        return FALSE;
-    }
+        return -1;
+
+    LARGE_INTEGER lFileSize;
+    BOOL bGetSize = GetFileSizeEx(hFile, &lFileSize);
+    CloseHandle(hFile);
+    if(!bGetSize || lFileSize.QuadPart<RESUMABLE_UPLOAD_MIN_SIZE)
+        return -1;
+
+    ULONG64 uLength = lFileSize.QuadPart;
+    ULONG64 uOffset = 0;
+    CString sUploadId;
+    CString sMsg;
+    BOOL bSession = FALSE;  // Do we know where to continue from?
+    BOOL bOffered = FALSE;  // Has the server accepted the offer at least once?
+    int nAttempt = 0;       // Retries since the last successful chunk
+    int nResult = 0;
 
-    BYTE pBuffer[1024];
-    DWORD dwBytesRead = 0;
     for(;;)
     {
         if(m_Assync->IsCancelled())
-            return FALSE;
+            break;
 
-        bRet = ReadFile(hFile, pBuffer, 1024, &dwBytesRead, NULL);
-        if(!bRet)
+        if(!bSession)
         {
-            m_Assync->SetProgress(_T("Error reading data from attachment file."), 0);
-            CloseHandle(hFile);
-            return FALSE;
-        }
+            // Ask the server how much it has already received
+            int nBegin = BeginResumableUpload(szURI, uLength, sUploadId, uOffset);
+            if(nBegin<0)
+            {
+                // Declined; a server that accepted the upload before shouldn't do this
+                if(!bOffered)
+                {
+                    m_Assync->SetProgress(_T("Server doesn't support resumable uploads."), 0);
+                    nResult = -1;
+                }
+                break;
+            }
+            else if(nBegin==0)
+            {
+                if(!WaitBeforeRetry(++nAttempt))
+                    break;
+                continue;
+            }
 
-        if(dwBytesRead==0)
-            break; // EOF
+            bSession = TRUE;
+            bOffered = TRUE;
+
+            if(uOffset>uLength)
+                uOffset = 0; // Shouldn't happen, start over
+
+            sMsg.Format(_T("Uploading %I64u bytes starting at offset %I64u."), uLength, uOffset);
+            m_Assync->SetProgress(sMsg, 0);
+            m_Assync->SetProgress((int)(100*uOffset/uLength), false);
+        }
 
-        DWORD dwBytesWritten = 0;
-        bRet=InternetWriteFile(hRequest, pBuffer, dwBytesRead, &dwBytesWritten);
-        if(!bRet)
+        // Send the next chunk (an empty one if the server has got everything,
+        // but hasn't received the final request yet)
+        DWORD dwChunk = (DWORD)MIN((ULONG64)RESUMABLE_UPLOAD_CHUNK_SIZE, uLength-uOffset);
+        DWORD dwStatus = 0;
+        ULONG64 uCommitted = uOffset;
+        if(!UploadChunk(szURI, sUploadId, sFileName, uOffset, dwChunk, dwStatus, uCommitted))
         {
-            m_Assync->SetProgress(_T("Error uploading attachment part data."), 0);
-            return FALSE;
+            // Connection problem; find out what has reached the server and continue from there
+            bSession = FALSE;
+            if(!WaitBeforeRetry(++nAttempt))
+                break;
+            continue;
         }
-        UploadProgress(dwBytesWritten);
-    }
 
-    CloseHandle(hFile);
+        if(dwStatus==409)
+        {
+            // Server expects data from another offset
+            if(uCommitted>uLength || ++nAttempt>RESUMABLE_UPLOAD_RETRIES)
+                break;
+            uOffset = uCommitted;
+            continue;
+        }
+        else if(dwStatus==404)
+        {
+            // Upload session has expired, offer the upload again
+            bSession = FALSE;
+            if(++nAttempt>RESUMABLE_UPLOAD_RETRIES)
+                break;
+            continue;
+        }
+        else if(dwStatus!=200)
+        {
+            sMsg.Format(_T("Failed (HTTP response code %lu)."), dwStatus);
+            m_Assync->SetProgress(sMsg, 100, false);
+            break;
+        }
 
-    /* Write part footer */
+        nAttempt = 0;
+        uOffset = uCommitted;
+        m_Assync->SetProgress((int)(100*MIN(uOffset, uLength)/uLength), false);
 
-    CString sFooter;
-    bRet= FormatAttachmentPartFooter(sName, sFooter);
-    if(!bRet)
-    {
-        m_Assync->SetProgress(_T("Error formatting attachment part footer."), 0);
-        return FALSE;
+        if(uOffset>=uLength)
+        {
+            // The server has received and accepted the whole report
+            nResult = 1;
+            break;
+        }
     }
 
-    LPCSTR pszFooter = strconv.t2a(sFooter);
-    if(pszFooter==NULL)
-    {
-        m_Assync->SetProgress(_T("Error converting attachment part footer to ASCII."), 0);
-        return FALSE;
-    }
+    return nResult;
+}
+
+int CHttpRequestSender::BeginResumableUpload(LPCTSTR szURI, ULONG64 uLength,
+                                             CString& sUploadId, ULONG64& uCommitted)
+{
+    strconv_t strconv;
+    CHttpTransportRequest Request;
+    CHttpTransportResponse Response;
+    CString sValue;
+    char szLength[32];
+
+    // Put text fields into the body of the offer
+    std::string sBody = "upload=resumable&uploadlength=";
+#if _MSC_VER<1400
+    sprintf(szLength, "%I64u", uLength);
+#else
+    sprintf_s(szLength, 32, "%I64u", uLength);
+#endif
+    sBody += szLength;
 
-    bRet=InternetWriteFile(hRequest, pszFooter, (DWORD)strlen(pszFooter), &dwBytesWritten);
-    if(!bRet)
+    std::map<CString, std::string>::iterator it;
+    for(it=m_Request.m_aTextFields.begin(); it!=m_Request.m_aTextFields.end(); it++)
     {
-        m_Assync->SetProgress(_T("Error uploading attachment part footer."), 0);
-        return FALSE;
+        sBody += "&";
+        sBody += UrlEncode(strconv.t2utf8(it->first));
+        sBody += "=";
+        sBody += UrlEncode(it->second);
     }
-    UploadProgress(dwBytesWritten);
 
-    return TRUE;
-}
+    m_Assync->SetProgress(_T("Offering resumable upload to the server..."), 0);
 
-BOOL CHttpRequestSender::WriteTrailingBoundary(HINTERNET hRequest)
-{
-    BOOL bRet = FALSE;
+    Request.m_sURI = szURI;
+    Request.m_sHeaders = _T("Content-Type: application/x-www-form-urlencoded\r\n");
+    Request.m_bReportProgress = FALSE;
+    Request.m_aBody.push_back(CHttpBodySegment());
+    Request.m_aBody[0].m_sData.swap(sBody);
 
-    CString sText;
-    bRet= FormatTrailingBoundary(sText);
-    if(!bRet)
-        return FALSE;
+    if(!SendRequest(Request, Response))
+        return 0;
 
-    strconv_t strconv;
-    LPCSTR pszText = strconv.t2a(sText);
-    if(pszText==NULL)
-        return FALSE;
-
-    DWORD dwBytesWritten = 0;
-    bRet=InternetWriteFile(hRequest, pszText, (DWORD)strlen(pszText), &dwBytesWritten);
-    if(!bRet)
-        return FALSE;
+    // Anything but 201 with upload id means the server doesn't know this protocol
+    if(Response.m_dwStatus!=201 ||
+        !Response.GetHeader(_T("X-CrashRpt-Upload-Id"), sUploadId) ||
+        sUploadId.IsEmpty())
+        return -1;
 
-    UploadProgress(dwBytesWritten);
+    uCommitted = 0;
+    if(Response.GetHeader(_T("X-CrashRpt-Upload-Offset"), sValue))
+        uCommitted = _tcstoui64(sValue, NULL, 10);
 
-    return TRUE;
+    return 1;
 }
 
-
-BOOL CHttpRequestSender::FormatTextPartHeader(CString sName, CString& sPart)
+BOOL CHttpRequestSender::UploadChunk(LPCTSTR szURI, CString sUploadId, CString sFileName,
+                                     ULONG64 uOffset, DWORD dwLength,
+                                     DWORD& dwStatus, ULONG64& uCommitted)
 {
-    std::map<CString, std::string>::iterator it = m_Request.m_aTextFields.find(sName);
-    if(it==m_Request.m_aTextFields.end())
+    CHttpTransportRequest Request;
+    CHttpTransportResponse Response;
+    CString sValue;
+
+    Request.m_sVerb = _T("PUT");
+    Request.m_sURI = szURI;
+    Request.m_sHeaders.Format(_T("Content-Type: application/octet-stream\r\n")
+        _T("X-CrashRpt-Upload-Id: %s\r\n")
+        _T("X-CrashRpt-Upload-Offset: %I64u\r\n"), (LPCTSTR)sUploadId, uOffset);
+    Request.m_bReportProgress = FALSE;
+
+    // The chunk goes straight from the file
+    CHttpBodySegment Segment;
+    Segment.m_sFileName = sFileName;
+    Segment.m_uFileOffset = uOffset;
+    Segment.m_uFileLength = dwLength;
+    Request.m_aBody.push_back(Segment);
+
+    if(!SendRequest(Request, Response))
+    {
+        m_Assync->SetProgress(_T("Error uploading chunk of attachment."), 0);
         return FALSE;
+    }
 
-    sPart.Format(m_sTextPartHeaderFmt, (LPCTSTR) m_sBoundary, (LPCTSTR) it->first);
+    dwStatus = Response.m_dwStatus;
 
-    return TRUE;
-}
+    if(Response.GetHeader(_T("X-CrashRpt-Upload-Offset"), sValue))
+        uCommitted = _tcstoui64(sValue, NULL, 10);
+
+    // Tell the reason of failure
+    if(dwStatus!=200)
+        LogResponse(Response);
 
-BOOL CHttpRequestSender::FormatTextPartFooter(CString sName, CString& sText)
-{
-    sText = m_sTextPartFooterFmt;
     return TRUE;
 }
 
-BOOL CHttpRequestSender::FormatAttachmentPartHeader(CString sName, CString& sText)
+BOOL CHttpRequestSender::WaitBeforeRetry(int nAttempt)
 {
-    std::map<CString, CHttpRequestFile>::iterator it = m_Request.m_aIncludedFiles.find(sName);
-    if(it==m_Request.m_aIncludedFiles.end())
+    if(nAttempt>RESUMABLE_UPLOAD_RETRIES)
+    {
+        m_Assync->SetProgress(_T("Too many failed attempts, giving up."), 0);
         return FALSE;
+    }
 
-    sText.Format(m_sFilePartHeaderFmt, (LPCTSTR) m_sBoundary, (LPCTSTR) it->first, (LPCTSTR) Utility::GetFileName(it->second.m_sSrcFileName), (LPCTSTR) it->second.m_sContentType);
-    return TRUE;
-}
+    // Wait longer after each failure in a row
+    DWORD dwDelay = 1000<<(nAttempt-1);
 
-BOOL CHttpRequestSender::FormatAttachmentPartFooter(CString sName, CString& sText)
-{
-    sText = m_sFilePartFooterFmt;
-    return TRUE;
-}
+    CString sMsg;
+    sMsg.Format(_T("Upload interrupted, retrying in %lu s."), dwDelay/1000);
+    m_Assync->SetProgress(sMsg, 0);
+
+    DWORD dwWaited;
+    for(dwWaited=0; dwWaited<dwDelay; dwWaited+=100)
+    {
+        if(m_Assync->IsCancelled())
+            return FALSE;
+        Sleep(100);
+    }
 
-BOOL CHttpRequestSender::FormatTrailingBoundary(CString& sText)
-{
-    sText.Format(_T("--%s--\r\n"), (LPCTSTR) m_sBoundary);
     return TRUE;
 }
 
-BOOL CHttpRequestSender::CalcRequestSize(LONGLONG& lSize)
+BOOL CHttpRequestSender::FormatRequest(CHttpTransportRequest& Request)
 {
-    lSize = 0;
+    // The body is made of segments: part headers and text fields are kept in memory,
+    // while attachments are referenced by file name and read by the transport.
+
+    strconv_t strconv;
+    CString sText;
 
-    // Calculate summary size of all text fields included into request
-    for(const auto& it : m_Request.m_aTextFields)
+    Request.m_sVerb = _T("POST");
+    Request.m_sHeaders = _T("Content-type: multipart/form-data; boundary=") + m_sBoundary + _T("\r\n");
+    Request.m_bGzip = m_Request.m_bCompressBody;
+    Request.m_aBody.clear();
+
+    // Text fields
+    std::map<CString, std::string>::iterator it;
+    for(it=m_Request.m_aTextFields.begin(); it!=m_Request.m_aTextFields.end(); it++)
     {
-        LONGLONG lPartSize = 0;
-        BOOL bCalc = CalcTextPartSize(it.first, lPartSize);
-        if(!bCalc) {
-            m_Assync->SetProgress(_T("CHttpRequestSender::CalcRequestSize - CalcTextPartSize() FAILED"), 0);
+        CHttpBodySegment Segment;
+
+        if(!FormatTextPartHeader(it->first, sText))
             return FALSE;
-        }
-        lSize += lPartSize;
+        Segment.m_sData = strconv.t2a(sText);
+
+        Segment.m_sData += it->second;
+
+        if(!FormatTextPartFooter(it->first, sText))
+            return FALSE;
+        Segment.m_sData += strconv.t2a(sText);
+
+        Request.m_aBody.push_back(Segment);
     }
 
-    // Calculate summary size of all files included into report
-    for(const auto& it2 : m_Request.m_aIncludedFiles)
+    // Attachments
+    std::map<CString, CHttpRequestFile>::iterator it2;
+    for(it2=m_Request.m_aIncludedFiles.begin(); it2!=m_Request.m_aIncludedFiles.end(); it2++)
     {
-        LONGLONG lPartSize = 0;
-        BOOL bCalc = CalcAttachmentPartSize(it2.first, lPartSize);
-        if(!bCalc) {
-            m_Assync->SetProgress(_T("CHttpRequestSender::CalcRequestSize - CalcAttachmentPartSize() FAILED"), 0);
+        CHttpBodySegment Header;
+        if(!FormatAttachmentPartHeader(it2->first, sText))
             return FALSE;
-        }
-        lSize += lPartSize;
+        Header.m_sData = strconv.t2a(sText);
+        Request.m_aBody.push_back(Header);
+
+        CHttpBodySegment File;
+        File.m_sFileName = it2->second.m_sSrcFileName;
+        HANDLE hFile = CreateFile(File.m_sFileName,
+            GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, NULL, NULL);
+        if(hFile==INVALID_HANDLE_VALUE)
+            return FALSE;
+
+        LARGE_INTEGER lFileSize;
+        BOOL bGetSize = GetFileSizeEx(hFile, &lFileSize);
+        CloseHandle(hFile);
+        if(!bGetSize)
+            return FALSE;
+        File.m_uFileLength = lFileSize.QuadPart;
+        Request.m_aBody.push_back(File);
+
+        CHttpBodySegment Footer;
+        if(!FormatAttachmentPartFooter(it2->first, sText))
+            return FALSE;
+        Footer.m_sData = strconv.t2a(sText);
+        Request.m_aBody.push_back(Footer);
     }
 
-    CString sTrailingBoundary;
-    FormatTrailingBoundary(sTrailingBoundary);
-    lSize += sTrailingBoundary.GetLength();
+    // Trailing boundary
+    CHttpBodySegment Trailer;
+    FormatTrailingBoundary(sText);
+    Trailer.m_sData = strconv.t2a(sText);
+    Request.m_aBody.push_back(Trailer);
 
     return TRUE;
 }
 
-BOOL CHttpRequestSender::CalcTextPartSize(CString sName, LONGLONG& lSize)
+BOOL CHttpRequestSender::FormatTextPartHeader(CString sName, CString& sPart)
 {
-    lSize = 0;
-
-    CString sPartHeader;
-    BOOL bFormat = FormatTextPartHeader(sName, sPartHeader);
-    if(!bFormat)
-        return FALSE;
-    lSize += sPartHeader.GetLength();
-
     std::map<CString, std::string>::iterator it = m_Request.m_aTextFields.find(sName);
     if(it==m_Request.m_aTextFields.end())
         return FALSE;
 
-    lSize += it->second.length();
-
-    CString sPartFooter;
-    bFormat = FormatTextPartFooter(sName, sPartFooter);
-    if(!bFormat)
-        return FALSE;
-    lSize += sPartFooter.GetLength();
+    sPart.Format(m_sTextPartHeaderFmt, (LPCTSTR) m_sBoundary, (LPCTSTR) it->first);
 
     return TRUE;
 }
 
-BOOL CHttpRequestSender::CalcAttachmentPartSize(CString sName, LONGLONG& lSize)
+BOOL CHttpRequestSender::FormatTextPartFooter(CString sName, CString& sText)
 {
-    lSize = 0;
-
-    CString sPartHeader;
-    BOOL bFormat = FormatAttachmentPartHeader(sName, sPartHeader);
-    if(!bFormat)
-        return FALSE;
-    lSize += sPartHeader.GetLength();
+    sText = m_sTextPartFooterFmt;
+    return TRUE;
+}
 
+BOOL CHttpRequestSender::FormatAttachmentPartHeader(CString sName, CString& sText)
+{
     std::map<CString, CHttpRequestFile>::iterator it = m_Request.m_aIncludedFiles.find(sName);
     if(it==m_Request.m_aIncludedFiles.end())
         return FALSE;
 
-    CString sFileName = it->second.m_sSrcFileName.GetBuffer(0);
-    HANDLE hFile = CreateFile(sFileName,
-        GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, NULL, NULL);
-    if(hFile==INVALID_HANDLE_VALUE)
-    {
-        return FALSE;
-    }
-
-    LARGE_INTEGER lFileSize;
-    BOOL bGetSize = GetFileSizeEx(hFile, &lFileSize);
-    if(!bGetSize)
-    {
-        CloseHandle(hFile);
-        return FALSE;
-    }
-
-    lSize += lFileSize.QuadPart;
-    CloseHandle(hFile);
-
-    CString sPartFooter;
-    bFormat = FormatAttachmentPartFooter(sName, sPartFooter);
-    if(!bFormat)
-        return FALSE;
-    lSize += sPartFooter.GetLength();
-
+    sText.Format(m_sFilePartHeaderFmt, (LPCTSTR) m_sBoundary, (LPCTSTR) it->first, (LPCTSTR) Utility::GetFileName(it->second.m_sSrcFileName), (LPCTSTR) it->second.m_sContentType);
     return TRUE;
 }
 
-// This method updates upload progress status
-void CHttpRequestSender::UploadProgress(DWORD dwBytesWritten)
+BOOL CHttpRequestSender::FormatAttachmentPartFooter(CString sName, CString& sText)
 {
-    m_dwUploaded += dwBytesWritten;
+    sText = m_sFilePartFooterFmt;
+    return TRUE;
+}
 
-    float progress = 100*(float)m_dwUploaded/m_dwPostSize;
-    m_Assync->SetProgress((int)progress, false);
+BOOL CHttpRequestSender::FormatTrailingBoundary(CString& sText)
+{
+    sText.Format(_T("--%s--\r\n"), (LPCTSTR) m_sBoundary);
+    return TRUE;
 }
 
 // Parses URL and splits it into URL, port, protocol and so on. This method's code was taken from
@@ -16,6 +16,7 @@ be found in the Authors.txt file in the root of the source tree.
 #pragma once
 #include "stdafx.h"
 #include "AssyncNotification.h"
+#include "HttpTransport.h"
 
 
 struct CHttpRequestFile
@@ -28,22 +29,59 @@ struct CHttpRequestFile
 class CHttpRequest
 {
 public:
+    CHttpRequest() { m_bCompressBody = FALSE; m_bBatch = FALSE; }
+
     CString m_sUrl;      // Script URL
     std::map<CString, std::string> m_aTextFields;    // Array of text fields to include into POST data
     std::map<CString, CHttpRequestFile> m_aIncludedFiles; // Array of binary files to include into POST data
+    BOOL m_bCompressBody; // Send POST data with gzip content encoding (unless it has file attachments)
+    BOOL m_bBatch;        // Request carries several reports, response body holds their acknowledgements
 };
 
+// Attachments at least this large are uploaded in resumable chunks (if the server supports it).
+#define RESUMABLE_UPLOAD_MIN_SIZE   (1024*1024)
+// Size of a single chunk of resumable upload.
+#define RESUMABLE_UPLOAD_CHUNK_SIZE (512*1024)
+// How many times in a row a failed chunk is retried before giving up.
+#define RESUMABLE_UPLOAD_RETRIES    5
+
 // Sends HTTP request
 // See also: RFC 1867 - Form-based File Upload in HTML (http://www.ietf.org/rfc/rfc1867.txt)
+//
+// A request with a single large attachment is first offered to the server as a
+// resumable upload: the text fields are POSTed with upload=resumable and
+// uploadlength=<size>, and a server supporting this replies 201 with the
+// X-CrashRpt-Upload-Id and X-CrashRpt-Upload-Offset (bytes already received) headers.
+// The attachment is then sent with PUT requests carrying X-CrashRpt-Upload-Id and
+// X-CrashRpt-Upload-Offset headers, each reply telling the committed offset. After a
+// failure, the session is offered again to learn where to continue. Any other reply
+// to the offer means the server doesn't support resumable uploads, and the request
+// is sent as a single multipart POST. See reporting/scripts/crashrpt.php.
+//
+// A server accepting several reports in one request tells so in every response with
+// the X-CrashRpt-Batch-Max-Count and X-CrashRpt-Batch-Max-Size headers. A batch is a
+// multipart POST with the batchmanifest field (a line "<index> <crash GUID>" per report),
+// the report[<index>][<name>] text fields and the crashrpt[<index>] attachments. The
+// response body has a line "<crash GUID> <status code> <message>" per report.
 class CHttpRequestSender
 {
 public:
 
     CHttpRequestSender();
 
+    ~CHttpRequestSender();
+
     // Sends HTTP request assynchroniously
     BOOL SendAssync(CHttpRequest& Request, AssyncNotification* an);
 
+    // Returns the body of the last response received from the server.
+    std::string GetResponseBody();
+
+    // Returns how many reports and bytes the server accepts in one batch request, as
+    // advertised in the last response (zero count if batches are not accepted).
+    // Returns FALSE if no response has been received.
+    BOOL GetBatchLimits(int& nMaxCount, ULONG64& uMaxSize);
+
 private:
 
     // Worker thread procedure
@@ -51,19 +89,38 @@ private:
 
     BOOL InternalSend();
 
-    // Used to calculate summary size of the request
-    BOOL CalcRequestSize(LONGLONG& lSize);
+    // Creates the transport and connects it to the server given by URL. Returns the URI part of URL.
+    BOOL Connect(LPCTSTR szURL, CString& sURI);
+
+    // Sends a request through the transport and remembers the response.
+    BOOL SendRequest(CHttpTransportRequest& Request, CHttpTransportResponse& Response);
+
+    // Logs server response code and the beginning of response body.
+    void LogResponse(CHttpTransportResponse& Response);
+
+    // Sends the attachment in chunks. Returns 1 on success, 0 on failure and -1 if
+    // the request can't be sent this way (then it should be sent as a whole).
+    int SendResumable(LPCTSTR szURI);
+
+    // Offers the resumable upload to the server. Returns 1 and the upload id and committed
+    // offset on success, 0 on network error and -1 if the server declines the offer.
+    int BeginResumableUpload(LPCTSTR szURI, ULONG64 uLength, CString& sUploadId, ULONG64& uCommitted);
+
+    // Sends one chunk of the resumable upload (a range of the attachment file). Returns FALSE
+    // on network error; otherwise returns HTTP status code and committed offset.
+    BOOL UploadChunk(LPCTSTR szURI, CString sUploadId, CString sFileName,
+        ULONG64 uOffset, DWORD dwLength, DWORD& dwStatus, ULONG64& uCommitted);
+
+    // Waits before the next retry. Returns FALSE if there are no more retries or cancelled.
+    BOOL WaitBeforeRetry(int nAttempt);
+
+    // Used to format multipart request body
+    BOOL FormatRequest(CHttpTransportRequest& Request);
     BOOL FormatTextPartHeader(CString sName, CString& sText);
     BOOL FormatTextPartFooter(CString sName, CString& sText);
     BOOL FormatAttachmentPartHeader(CString sName, CString& sText);
     BOOL FormatAttachmentPartFooter(CString sName, CString& sText);
     BOOL FormatTrailingBoundary(CString& sBoundary);
-    BOOL CalcTextPartSize(CString sFileName, LONGLONG& lSize);
-    BOOL CalcAttachmentPartSize(CString sFileName, LONGLONG& lSize);
-    BOOL WriteTextPart(HINTERNET hRequest, CString sName);
-    BOOL WriteAttachmentPart(HINTERNET hRequest, CString sName);
-    BOOL WriteTrailingBoundary(HINTERNET hRequest);
-    void UploadProgress(DWORD dwBytesWritten);
 
     // This helper function is used to split URL into several parts
     void ParseURL(LPCTSTR szURL, LPTSTR szProtocol, UINT cbProtocol,
@@ -71,14 +128,15 @@ private:
 
     CHttpRequest m_Request;       // HTTP request being sent
     AssyncNotification* m_Assync; // Used to communicate with the main thread
+    CHttpTransport* m_pTransport; // Transport used to send requests
+    CHttpTransportResponse m_LastResponse; // The last response received
+    BOOL m_bGotResponse;          // Has any response been received?
 
     CString m_sFilePartHeaderFmt;
     CString m_sFilePartFooterFmt;
     CString m_sTextPartHeaderFmt;
     CString m_sTextPartFooterFmt;
     CString m_sBoundary;
-    DWORD m_dwPostSize;
-    DWORD m_dwUploaded;
 };
 
 
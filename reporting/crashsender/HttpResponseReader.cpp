@@ -0,0 +1,322 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+#include "HttpResponseReader.h"
+#include <stdlib.h>
+#include <string.h>
+
+static std::string ToLower(const std::string& s)
+{
+    std::string sLower = s;
+    size_t i;
+    for(i=0; i<sLower.length(); i++)
+    {
+        if(sLower[i]>='A' && sLower[i]<='Z')
+            sLower[i] = (char)(sLower[i]-'A'+'a');
+    }
+    return sLower;
+}
+
+static std::string Trim(const std::string& s)
+{
+    size_t uStart = s.find_first_not_of(" \t");
+    if(uStart==std::string::npos)
+        return std::string();
+    size_t uEnd = s.find_last_not_of(" \t");
+    return s.substr(uStart, uEnd-uStart+1);
+}
+
+// Returns true if the comma-separated header value has the token (ignoring case).
+static bool HasToken(const std::string& sValue, const char* szToken)
+{
+    std::string sLower = ToLower(sValue);
+    size_t uStart = 0;
+    while(uStart<=sLower.length())
+    {
+        size_t uEnd = sLower.find(',', uStart);
+        if(uEnd==std::string::npos)
+            uEnd = sLower.length();
+        if(Trim(sLower.substr(uStart, uEnd-uStart))==szToken)
+            return true;
+        uStart = uEnd+1;
+    }
+    return false;
+}
+
+bool http_parse_header(const std::string& sLine, std::string& sName, std::string& sValue)
+{
+    // Header line looks like "Name: value"
+    size_t uColon = sLine.find(':');
+    if(uColon==std::string::npos)
+        return false;
+
+    sName = ToLower(Trim(sLine.substr(0, uColon)));
+    sValue = Trim(sLine.substr(uColon+1));
+    return !sName.empty();
+}
+
+bool http_parse_chunk_size(const std::string& sLine, unsigned long long& uSize)
+{
+    size_t i;
+    uSize = 0;
+    for(i=0; i<sLine.length(); i++)
+    {
+        char c = sLine[i];
+        int nDigit;
+        if(c>='0' && c<='9')
+            nDigit = c-'0';
+        else if(c>='a' && c<='f')
+            nDigit = c-'a'+10;
+        else if(c>='A' && c<='F')
+            nDigit = c-'A'+10;
+        else
+            break;
+
+        if(uSize>>60)
+            return false; // Would overflow
+        uSize = (uSize<<4)|nDigit;
+    }
+
+    // Anything after the digits must be an extension or blanks
+    if(i==0)
+        return false;
+    std::string sRest = Trim(sLine.substr(i));
+    return sRest.empty() || sRest[0]==';';
+}
+
+//----------------------------------------------------------
+// HttpResponseHead impl
+//----------------------------------------------------------
+
+HttpResponseHead::HttpResponseHead()
+{
+    m_uStatus = 0;
+}
+
+bool HttpResponseHead::GetHeader(const char* szName, std::string& sValue) const
+{
+    std::string sName = ToLower(szName);
+    size_t i;
+    for(i=m_aHeaders.size(); i>0; i--)
+    {
+        if(m_aHeaders[i-1].first==sName)
+        {
+            sValue = m_aHeaders[i-1].second;
+            return true;
+        }
+    }
+    return false;
+}
+
+//----------------------------------------------------------
+// CHttpResponseReader impl
+//----------------------------------------------------------
+
+CHttpResponseReader::CHttpResponseReader(CHttpByteSource* pSource)
+{
+    m_pSource = pSource;
+    m_bGotData = false;
+    m_bEOF = false;
+}
+
+void CHttpResponseReader::Reset()
+{
+    m_sRecvBuf.clear();
+    m_bGotData = false;
+    m_bEOF = false;
+}
+
+bool CHttpResponseReader::HasReceivedData() const
+{
+    return m_bGotData;
+}
+
+int CHttpResponseReader::ReadResponse(HttpResponseHead& Head, std::string& sBody, bool& bKeepAlive)
+{
+    std::string sLine;
+    std::string sValue;
+    int nResult;
+
+    sBody.clear();
+    bKeepAlive = false;
+
+    // Skip interim (1xx) responses
+    for(;;)
+    {
+        Head = HttpResponseHead();
+
+        // Status line, for example "HTTP/1.1 200 OK"
+        if((nResult = ReadLine(sLine))!=HTTPRESP_OK)
+            return nResult;
+
+        if(sLine.compare(0, 5, "HTTP/")!=0)
+            return HTTPRESP_INVALID;
+
+        size_t uSpace = sLine.find(' ');
+        if(uSpace==std::string::npos || sLine.length()<uSpace+4)
+            return HTTPRESP_INVALID;
+        Head.m_uStatus = strtoul(sLine.c_str()+uSpace+1, NULL, 10);
+        if(Head.m_uStatus<100 || Head.m_uStatus>999)
+            return HTTPRESP_INVALID;
+
+        // HTTP/1.1 connections are persistent by default
+        bKeepAlive = sLine.compare(0, 8, "HTTP/1.1")==0;
+
+        // Headers end with an empty line
+        for(;;)
+        {
+            if((nResult = ReadLine(sLine))!=HTTPRESP_OK)
+                return nResult;
+            if(sLine.empty())
+                break;
+
+            std::string sName;
+            if(http_parse_header(sLine, sName, sValue))
+                Head.m_aHeaders.push_back(std::make_pair(sName, sValue));
+        }
+
+        if(Head.m_uStatus>=200)
+            break;
+    }
+
+    if(Head.GetHeader("Connection", sValue))
+    {
+        if(HasToken(sValue, "close"))
+            bKeepAlive = false;
+        else if(HasToken(sValue, "keep-alive"))
+            bKeepAlive = true;
+    }
+
+    // Responses to HEAD requests aren't read here, so only these have no body
+    if(Head.m_uStatus==204 || Head.m_uStatus==304)
+        return HTTPRESP_OK;
+
+    if(Head.GetHeader("Transfer-Encoding", sValue) && HasToken(sValue, "chunked"))
+        return ReadChunkedBody(sBody);
+
+    if(Head.GetHeader("Content-Length", sValue))
+    {
+        char* pEnd = NULL;
+        unsigned long long uLength = strtoull(sValue.c_str(), &pEnd, 10);
+        if(sValue.empty() || *pEnd!=0 || uLength==(unsigned long long)-1)
+            return HTTPRESP_INVALID;
+        return ReadBody(uLength, sBody);
+    }
+
+    // The body ends when the server closes the connection
+    bKeepAlive = false;
+    return ReadBody((unsigned long long)-1, sBody);
+}
+
+int CHttpResponseReader::ReadLine(std::string& sLine)
+{
+    for(;;)
+    {
+        size_t uEOL = m_sRecvBuf.find('\n');
+        if(uEOL!=std::string::npos)
+        {
+            sLine = m_sRecvBuf.substr(0, uEOL);
+            if(!sLine.empty() && sLine[sLine.length()-1]=='\r')
+                sLine.erase(sLine.length()-1);
+            m_sRecvBuf.erase(0, uEOL+1);
+            return HTTPRESP_OK;
+        }
+
+        // Refuse unreasonably long lines
+        if(m_sRecvBuf.length()>HTTP_MAX_RESPONSE_BODY)
+            return HTTPRESP_INVALID;
+
+        if(!ReceiveMore())
+            return HTTPRESP_RECEIVE_ERROR;
+    }
+}
+
+int CHttpResponseReader::ReadBody(unsigned long long uLength, std::string& sBody)
+{
+    // Read the whole body (so the connection can be reused),
+    // but keep only the beginning of it.
+    unsigned long long uRead = 0;
+    while(uRead<uLength)
+    {
+        if(m_sRecvBuf.empty() && !ReceiveMore())
+        {
+            // A body of unknown length ends with the data
+            return uLength==(unsigned long long)-1 && m_bEOF ? HTTPRESP_OK : HTTPRESP_RECEIVE_ERROR;
+        }
+
+        size_t uTake = m_sRecvBuf.length();
+        if(uTake>uLength-uRead)
+            uTake = (size_t)(uLength-uRead);
+        if(sBody.length()<HTTP_MAX_RESPONSE_BODY)
+        {
+            size_t uKeep = HTTP_MAX_RESPONSE_BODY-sBody.length();
+            sBody.append(m_sRecvBuf, 0, uTake<uKeep ? uTake : uKeep);
+        }
+        m_sRecvBuf.erase(0, uTake);
+        uRead += uTake;
+    }
+
+    return HTTPRESP_OK;
+}
+
+int CHttpResponseReader::ReadChunkedBody(std::string& sBody)
+{
+    std::string sLine;
+    int nResult;
+
+    for(;;)
+    {
+        // Each chunk starts with its size in hex
+        if((nResult = ReadLine(sLine))!=HTTPRESP_OK)
+            return nResult;
+
+        unsigned long long uChunkSize = 0;
+        if(!http_parse_chunk_size(sLine, uChunkSize))
+            return HTTPRESP_INVALID;
+        if(uChunkSize==0)
+            break;
+
+        // Chunk data is followed by CRLF
+        if((nResult = ReadBody(uChunkSize, sBody))!=HTTPRESP_OK ||
+            (nResult = ReadLine(sLine))!=HTTPRESP_OK)
+            return nResult;
+        if(!sLine.empty())
+            return HTTPRESP_INVALID;
+    }
+
+    // Skip trailer
+    do
+    {
+        if((nResult = ReadLine(sLine))!=HTTPRESP_OK)
+            return nResult;
+    }
+    while(!sLine.empty());
+
+    return HTTPRESP_OK;
+}
+
+bool CHttpResponseReader::ReceiveMore()
+{
+    if(m_bEOF)
+        return false;
+
+    size_t uOldLength = m_sRecvBuf.length();
+    bool bEOF = false;
+    if(!m_pSource->Receive(m_sRecvBuf, bEOF))
+    {
+        m_bEOF = bEOF;
+        return false;
+    }
+
+    if(m_sRecvBuf.length()>uOldLength)
+        m_bGotData = true;
+
+    return true;
+}
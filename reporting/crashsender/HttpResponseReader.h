@@ -0,0 +1,102 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+// File: HttpResponseReader.h
+// Description: Reads HTTP/1.x responses (status line, headers and a body of known
+// length, chunked or ending with the connection) from a stream of bytes.
+// This file doesn't depend on Windows headers, so it can be built and tested anywhere.
+
+#pragma once
+
+#include <stddef.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Response body is kept up to this size, the rest is read and discarded.
+#define HTTP_MAX_RESPONSE_BODY      (64*1024)
+
+// Results of CHttpResponseReader::ReadResponse().
+#define HTTPRESP_OK                 0  // The whole response has been read.
+#define HTTPRESP_RECEIVE_ERROR      1  // Receiving failed, was cancelled, or the data ended too early.
+#define HTTPRESP_INVALID            2  // The data is not a valid HTTP response.
+
+// Source of response bytes. The socket transport receives them from the network;
+// tests feed canned responses.
+class CHttpByteSource
+{
+public:
+
+    virtual ~CHttpByteSource() {}
+
+    // Appends received data to the buffer. Returns false on error, cancel or end
+    // of data; in the latter case sets bEOF.
+    virtual bool Receive(std::string& sBuffer, bool& bEOF) = 0;
+};
+
+// Status and headers of a response.
+struct HttpResponseHead
+{
+    // Constructor.
+    HttpResponseHead();
+
+    // Returns the value of the last header with this name (ignoring case).
+    bool GetHeader(const char* szName, std::string& sValue) const;
+
+    unsigned m_uStatus;      // Status code.
+    std::vector<std::pair<std::string, std::string> > m_aHeaders; // Headers in order of arrival (names in lower case).
+};
+
+// Reads responses one after another from the same connection.
+class CHttpResponseReader
+{
+public:
+
+    // Constructor.
+    CHttpResponseReader(CHttpByteSource* pSource);
+
+    // Forgets data left from the previous connection.
+    void Reset();
+
+    // Reads the next response. Interim (1xx) responses are skipped. The body is read
+    // completely, so the connection can be reused, but only the first
+    // HTTP_MAX_RESPONSE_BODY bytes are kept. bKeepAlive tells if the connection
+    // may be reused afterwards. Returns one of HTTPRESP_xxx results.
+    int ReadResponse(HttpResponseHead& Head, std::string& sBody, bool& bKeepAlive);
+
+    // Returns true if any data has been received since the last Reset().
+    bool HasReceivedData() const;
+
+private:
+
+    // Reads a line (without CRLF).
+    int ReadLine(std::string& sLine);
+
+    // Reads body of known length (or until the connection is closed if uLength is -1).
+    int ReadBody(unsigned long long uLength, std::string& sBody);
+
+    // Reads chunked body.
+    int ReadChunkedBody(std::string& sBody);
+
+    // Receives more data into the buffer.
+    bool ReceiveMore();
+
+    CHttpByteSource* m_pSource; // Source of data.
+    std::string m_sRecvBuf;     // Received data not parsed yet.
+    bool m_bGotData;            // Some data has been received.
+    bool m_bEOF;                // The source has no more data.
+};
+
+// Parses a "Name: value" header line. Returns false if the line has no name.
+bool http_parse_header(const std::string& sLine, std::string& sName, std::string& sValue);
+
+// Parses a hexadecimal chunk size line (possibly with chunk extensions).
+// Returns false if it doesn't start with a hex digit or is too large.
+bool http_parse_chunk_size(const std::string& sLine, unsigned long long& uSize);
@@ -0,0 +1,940 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+#include "stdafx.h"
+#include "HttpTransport.h"
+#include "strconv.h"
+#include "zlib.h"
+#include <mswsock.h>
+
+#ifndef MIN
+#define MIN(a,b) ((a)<(b)?(a):(b))
+#endif
+
+// Size of buffer used for reading files and compressing data.
+#define HTTP_IO_BUFFER_SIZE (64*1024)
+
+//----------------------------------------------------------
+// CHttpBodySegment, CHttpTransportRequest and CHttpTransportResponse impl
+//----------------------------------------------------------
+
+CHttpBodySegment::CHttpBodySegment()
+{
+    m_uFileOffset = 0;
+    m_uFileLength = 0;
+}
+
+CHttpTransportRequest::CHttpTransportRequest()
+{
+    m_sVerb = _T("POST");
+    m_bGzip = FALSE;
+    m_bReportProgress = TRUE;
+}
+
+CHttpTransportResponse::CHttpTransportResponse()
+{
+    m_dwStatus = 0;
+}
+
+BOOL CHttpTransportResponse::GetHeader(LPCTSTR szName, CString& sValue)
+{
+    CString sName = szName;
+    sName.MakeLower();
+
+    std::map<CString, CString>::iterator it = m_aHeaders.find(sName);
+    if(it==m_aHeaders.end())
+        return FALSE;
+
+    sValue = it->second;
+    return TRUE;
+}
+
+void CHttpTransportResponse::ParseHeader(CString sLine)
+{
+    // Header line looks like "Name: value"
+    int nColon = sLine.Find(_T(':'));
+    if(nColon<=0)
+        return;
+
+    CString sName = sLine.Left(nColon);
+    sName.Trim();
+    sName.MakeLower();
+    CString sValue = sLine.Mid(nColon+1);
+    sValue.Trim();
+
+    m_aHeaders[sName] = sValue;
+}
+
+//----------------------------------------------------------
+// CHttpTransport impl
+//----------------------------------------------------------
+
+CHttpTransport::CHttpTransport(AssyncNotification* pAssync)
+{
+    m_pAssync = pAssync;
+    m_uBodySize = 0;
+    m_uBodySent = 0;
+}
+
+CHttpTransport::~CHttpTransport()
+{
+}
+
+CHttpTransport* CHttpTransport::Create(BOOL bSecure, BOOL bAllowSockets, AssyncNotification* pAssync)
+{
+    // Sockets know nothing about TLS and proxy servers, leave these to WinINet.
+    // Automatic proxy detection alone doesn't count: in most networks it finds nothing,
+    // and where it does, the caller retries with WinINet after the socket fails to connect.
+    if(!bSecure && bAllowSockets)
+    {
+        INTERNET_PER_CONN_OPTION Option;
+        Option.dwOption = INTERNET_PER_CONN_FLAGS;
+        INTERNET_PER_CONN_OPTION_LIST List;
+        List.dwSize = sizeof(List);
+        List.pszConnection = NULL; // LAN connection
+        List.dwOptionCount = 1;
+        List.dwOptionError = 0;
+        List.pOptions = &Option;
+        DWORD dwSize = sizeof(List);
+
+        if(InternetQueryOption(NULL, INTERNET_OPTION_PER_CONNECTION_OPTION, &List, &dwSize) &&
+            (Option.Value.dwValue&(PROXY_TYPE_PROXY|PROXY_TYPE_AUTO_PROXY_URL))==0)
+            return new CSocketTransport(pAssync);
+    }
+
+    return new CWinInetTransport(pAssync);
+}
+
+// Compresses a block of data and appends the result to the string.
+static BOOL DeflateBlock(z_stream& zs, const void* pData, size_t uLength, int nFlush, std::string& sOut)
+{
+    char buf[HTTP_IO_BUFFER_SIZE];
+
+    zs.next_in = (Bytef*)pData;
+    zs.avail_in = (uInt)uLength;
+
+    do
+    {
+        zs.next_out = (Bytef*)buf;
+        zs.avail_out = sizeof(buf);
+
+        int nResult = deflate(&zs, nFlush);
+        if(nResult!=Z_OK && nResult!=Z_STREAM_END && nResult!=Z_BUF_ERROR)
+            return FALSE;
+
+        sOut.append(buf, sizeof(buf)-zs.avail_out);
+    }
+    while(zs.avail_out==0);
+
+    return TRUE;
+}
+
+BOOL CHttpTransport::PrepareBody(CHttpTransportRequest& Request, ULONG64& uBodySize)
+{
+    size_t i;
+
+    if(Request.m_bGzip)
+    {
+        // File segments are sent straight from disk, compressing them here would
+        // load the whole attachment into memory. So such bodies go uncompressed.
+        for(i=0; i<Request.m_aBody.size(); i++)
+        {
+            if(!Request.m_aBody[i].m_sFileName.IsEmpty())
+            {
+                m_pAssync->SetProgress(_T("Request body has file attachments, sending it uncompressed."), 0);
+                Request.m_bGzip = FALSE;
+                break;
+            }
+        }
+    }
+
+    if(Request.m_bGzip)
+    {
+        // Compress the memory segments into a single one
+        BOOL bStatus = TRUE;
+        std::string sCompressed;
+        z_stream zs;
+        memset(&zs, 0, sizeof(zs));
+
+        // Window bits over 15 make zlib write gzip header and trailer
+        if(deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 16+MAX_WBITS, 8, Z_DEFAULT_STRATEGY)!=Z_OK)
+            return FALSE;
+
+        for(i=0; i<Request.m_aBody.size() && bStatus; i++)
+        {
+            CHttpBodySegment& Segment = Request.m_aBody[i];
+            bStatus = DeflateBlock(zs, Segment.m_sData.c_str(), Segment.m_sData.length(), Z_NO_FLUSH, sCompressed);
+        }
+
+        if(bStatus)
+            bStatus = DeflateBlock(zs, NULL, 0, Z_FINISH, sCompressed);
+
+        deflateEnd(&zs);
+
+        if(!bStatus)
+        {
+            m_pAssync->SetProgress(_T("Error compressing request body."), 0);
+            return FALSE;
+        }
+
+        Request.m_aBody.clear();
+        Request.m_aBody.push_back(CHttpBodySegment());
+        Request.m_aBody[0].m_sData.swap(sCompressed);
+        Request.m_sHeaders += _T("Content-Encoding: gzip\r\n");
+        Request.m_bGzip = FALSE;
+    }
+
+    uBodySize = 0;
+    for(i=0; i<Request.m_aBody.size(); i++)
+    {
+        if(Request.m_aBody[i].m_sFileName.IsEmpty())
+            uBodySize += Request.m_aBody[i].m_sData.length();
+        else
+            uBodySize += Request.m_aBody[i].m_uFileLength;
+    }
+
+    m_uBodySize = Request.m_bReportProgress ? uBodySize : 0;
+    m_uBodySent = 0;
+
+    return TRUE;
+}
+
+void CHttpTransport::UploadProgress(DWORD dwBytesSent)
+{
+    m_uBodySent += dwBytesSent;
+
+    if(m_uBodySize!=0)
+        m_pAssync->SetProgress((int)(100*MIN(m_uBodySent, m_uBodySize)/m_uBodySize), false);
+}
+
+//----------------------------------------------------------
+// CWinInetTransport impl
+//----------------------------------------------------------
+
+CWinInetTransport::CWinInetTransport(AssyncNotification* pAssync)
+    : CHttpTransport(pAssync)
+{
+    m_hSession = NULL;
+    m_hConnect = NULL;
+    m_dwFlags = 0;
+}
+
+CWinInetTransport::~CWinInetTransport()
+{
+    Close();
+}
+
+BOOL CWinInetTransport::Connect(LPCTSTR szServer, DWORD dwPort, BOOL bSecure)
+{
+    Close();
+
+    // Create Internet session
+    m_pAssync->SetProgress(_T("Opening Internet connection."), 0);
+    m_hSession = InternetOpen(_T("CrashRpt"), INTERNET_OPEN_TYPE_PRECONFIG, NULL, NULL, 0);
+    if(m_hSession==NULL)
+    {
+        m_pAssync->SetProgress(_T("Error opening Internet session"), 0);
+        return FALSE;
+    }
+
+    // Connect to HTTP server
+    m_pAssync->SetProgress(_T("Connecting to server"), 0, true);
+
+    m_hConnect = InternetConnect(
+        m_hSession,   // InternetOpen handle
+        szServer,     // Server  name
+        (WORD)dwPort, // Default HTTPS port - 443
+        NULL,         // User name
+        NULL,         //  User password
+        INTERNET_SERVICE_HTTP, // Service
+        0,            // Flags
+        0             // Context
+        );
+    if(m_hConnect==NULL)
+    {
+        m_pAssync->SetProgress(_T("Error connecting to server"), 0);
+        return FALSE;
+    }
+
+    // Set large receive timeout to avoid problems in case of
+    // slow upload => slow response from the server.
+    DWORD dwReceiveTimeout = 0;
+    InternetSetOption(m_hConnect, INTERNET_OPTION_RECEIVE_TIMEOUT,
+        &dwReceiveTimeout, sizeof(dwReceiveTimeout));
+
+    // Configure flags for HttpOpenRequest
+    m_dwFlags = INTERNET_FLAG_NO_CACHE_WRITE | INTERNET_FLAG_NO_AUTO_REDIRECT | INTERNET_FLAG_KEEP_CONNECTION;
+    if(bSecure)
+        m_dwFlags |= INTERNET_FLAG_SECURE; // Use SSL
+
+    return TRUE;
+}
+
+void CWinInetTransport::Close()
+{
+    // Clean up internet handle
+    if(m_hConnect)
+        InternetCloseHandle(m_hConnect);
+    m_hConnect = NULL;
+
+    // Clean up internet session
+    if(m_hSession)
+        InternetCloseHandle(m_hSession);
+    m_hSession = NULL;
+}
+
+HINTERNET CWinInetTransport::OpenRequest(LPCTSTR szVerb, LPCTSTR szURI)
+{
+    LPCTSTR szAccept[2]={_T("*/*"), NULL};
+
+    HINTERNET hRequest = HttpOpenRequest(
+        m_hConnect,
+        szVerb,
+        szURI,
+        NULL,
+        NULL,
+        szAccept,
+        m_dwFlags,
+        0
+        );
+    if (!hRequest)
+        return NULL;
+
+    // This code was copied from http://support.microsoft.com/kb/182888 to address the problem
+    // that MVS doesn't have a valid SSL certificate.
+    DWORD extraSSLDwFlags = 0;
+    DWORD dwBuffLen = sizeof(extraSSLDwFlags);
+    InternetQueryOption (hRequest, INTERNET_OPTION_SECURITY_FLAGS,
+    (LPVOID)&extraSSLDwFlags, &dwBuffLen);
+    // We have to specifically ignore these 2 errors for MVS
+    extraSSLDwFlags |= SECURITY_FLAG_IGNORE_REVOCATION |  // Ignores certificate revocation problems.
+                       SECURITY_FLAG_IGNORE_WRONG_USAGE | // Ignores incorrect usage problems.
+                       SECURITY_FLAG_IGNORE_CERT_CN_INVALID | // Ignores the ERROR_INTERNET_SEC_CERT_CN_INVALID error message.
+                       SECURITY_FLAG_IGNORE_CERT_DATE_INVALID; // Ignores the ERROR_INTERNET_SEC_CERT_DATE_INVALID error message.
+    InternetSetOption (hRequest, INTERNET_OPTION_SECURITY_FLAGS,
+                        &extraSSLDwFlags, sizeof (extraSSLDwFlags) );
+
+    return hRequest;
+}
+
+BOOL CWinInetTransport::SendRequest(CHttpTransportRequest& Request, CHttpTransportResponse& Response)
+{
+    BOOL bStatus = FALSE;
+    HINTERNET hRequest = NULL;
+    INTERNET_BUFFERS BufferIn;
+    ULONG64 uBodySize = 0;
+    size_t i;
+
+    if(!PrepareBody(Request, uBodySize))
+        return FALSE;
+
+    // Check if canceled
+    if(m_pAssync->IsCancelled())
+        return FALSE;
+
+    // Add a message to log
+    m_pAssync->SetProgress(_T("Opening HTTP request..."), 0, true);
+
+    // Open HTTP request
+    hRequest = OpenRequest(Request.m_sVerb, Request.m_sURI);
+    if (!hRequest)
+    {
+        m_pAssync->SetProgress(_T("HttpOpenRequest has failed."), 0, true);
+        goto cleanup;
+    }
+
+    // Fill in buffer
+    BufferIn.dwStructSize = sizeof( INTERNET_BUFFERS ); // Must be set or error will occur
+    BufferIn.Next = NULL;
+    BufferIn.lpcszHeader = Request.m_sHeaders;
+    BufferIn.dwHeadersLength = Request.m_sHeaders.GetLength();
+    BufferIn.dwHeadersTotal = 0;
+    BufferIn.lpvBuffer = NULL;
+    BufferIn.dwBufferLength = 0;
+    BufferIn.dwBufferTotal = (DWORD)uBodySize; // This is the only member used other than dwStructSize
+    BufferIn.dwOffsetLow = 0;
+    BufferIn.dwOffsetHigh = 0;
+
+    // Add a message to log
+    m_pAssync->SetProgress(_T("Sending HTTP request..."), 0);
+    // Send request
+    if(!HttpSendRequestEx( hRequest, &BufferIn, NULL, 0, 0))
+    {
+        m_pAssync->SetProgress(_T("HttpSendRequestEx has failed."), 0);
+        goto cleanup;
+    }
+
+    // Write request body
+    for(i=0; i<Request.m_aBody.size(); i++)
+    {
+        if(!WriteSegment(hRequest, Request.m_aBody[i]))
+            goto cleanup;
+    }
+
+    // Add a message to log
+    m_pAssync->SetProgress(_T("Ending HTTP request..."), 0);
+
+    // End request
+    if(!HttpEndRequest(hRequest, NULL, 0, 0))
+    {
+        m_pAssync->SetProgress(_T("HttpEndRequest has failed."), 0);
+        goto cleanup;
+    }
+
+    // Add a message to log
+    m_pAssync->SetProgress(_T("Reading server response..."), 0);
+
+    bStatus = ReadResponse(hRequest, Response);
+
+cleanup:
+
+    // Clean up
+    if(hRequest)
+        InternetCloseHandle(hRequest);
+
+    return bStatus;
+}
+
+BOOL CWinInetTransport::WriteSegment(HINTERNET hRequest, CHttpBodySegment& Segment)
+{
+    DWORD dwBytesWritten = 0;
+
+    if(Segment.m_sFileName.IsEmpty())
+    {
+        size_t uPos = 0;
+        while(uPos<Segment.m_sData.length())
+        {
+            if(m_pAssync->IsCancelled())
+                return FALSE;
+
+            DWORD dwLength = (DWORD)MIN(Segment.m_sData.length()-uPos, (size_t)HTTP_IO_BUFFER_SIZE);
+            if(!InternetWriteFile(hRequest, Segment.m_sData.c_str()+uPos, dwLength, &dwBytesWritten))
+            {
+                m_pAssync->SetProgress(_T("Error uploading request data."), 0);
+                return FALSE;
+            }
+            UploadProgress(dwBytesWritten);
+
+            uPos += dwLength;
+        }
+
+        return TRUE;
+    }
+
+    HANDLE hFile = CreateFile(Segment.m_sFileName, GENERIC_READ, FILE_SHARE_READ|FILE_SHARE_WRITE,
+        NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if(hFile==INVALID_HANDLE_VALUE)
+    {
+        m_pAssync->SetProgress(_T("Error opening attachment file."), 0);
+        return FALSE;
+    }
+
+    BOOL bStatus = TRUE;
+    std::vector<BYTE> aBuffer(HTTP_IO_BUFFER_SIZE);
+    ULONG64 uLeft = Segment.m_uFileLength;
+
+    LARGE_INTEGER lPos;
+    lPos.QuadPart = Segment.m_uFileOffset;
+    if(!SetFilePointerEx(hFile, lPos, NULL, FILE_BEGIN))
+        bStatus = FALSE;
+
+    while(bStatus && uLeft!=0)
+    {
+        if(m_pAssync->IsCancelled())
+        {
+            bStatus = FALSE;
+            break;
+        }
+
+        DWORD dwBytesRead = 0;
+        if(!ReadFile(hFile, &aBuffer[0], (DWORD)MIN(uLeft, (ULONG64)aBuffer.size()), &dwBytesRead, NULL) ||
+            dwBytesRead==0)
+        {
+            m_pAssync->SetProgress(_T("Error reading data from attachment file."), 0);
+            bStatus = FALSE;
+            break;
+        }
+
+        if(!InternetWriteFile(hRequest, &aBuffer[0], dwBytesRead, &dwBytesWritten))
+        {
+            m_pAssync->SetProgress(_T("Error uploading attachment part data."), 0);
+            bStatus = FALSE;
+            break;
+        }
+        UploadProgress(dwBytesWritten);
+
+        uLeft -= dwBytesRead;
+    }
+
+    CloseHandle(hFile);
+
+    return bStatus;
+}
+
+BOOL CWinInetTransport::ReadResponse(HINTERNET hRequest, CHttpTransportResponse& Response)
+{
+    Response = CHttpTransportResponse();
+
+    // Get HTTP response code from HTTP headers
+    DWORD dwStatusSize = sizeof(Response.m_dwStatus);
+    if(!HttpQueryInfo(hRequest, HTTP_QUERY_STATUS_CODE|HTTP_QUERY_FLAG_NUMBER,
+        &Response.m_dwStatus, &dwStatusSize, 0))
+        return FALSE;
+
+    // Get all headers, one per line
+    DWORD dwHeadersSize = 0;
+    HttpQueryInfo(hRequest, HTTP_QUERY_RAW_HEADERS_CRLF, NULL, &dwHeadersSize, NULL);
+    if(dwHeadersSize!=0)
+    {
+        std::vector<TCHAR> aHeaders(dwHeadersSize/sizeof(TCHAR)+1);
+        if(HttpQueryInfo(hRequest, HTTP_QUERY_RAW_HEADERS_CRLF, &aHeaders[0], &dwHeadersSize, NULL))
+        {
+            CString sHeaders = &aHeaders[0];
+            int nPos = sHeaders.Find(_T("\r\n")); // Skip status line
+            while(nPos>=0)
+            {
+                int nEnd = sHeaders.Find(_T("\r\n"), nPos+2);
+                if(nEnd<0)
+                    break;
+                Response.ParseHeader(sHeaders.Mid(nPos+2, nEnd-nPos-2));
+                nPos = nEnd;
+            }
+        }
+    }
+
+    // Read response body
+    char buf[4096];
+    for(;;)
+    {
+        DWORD dwBytesRead = 0;
+        if(!InternetReadFile(hRequest, buf, sizeof(buf), &dwBytesRead))
+            return FALSE;
+        if(dwBytesRead==0)
+            break;
+
+        if(Response.m_sBody.length()<HTTP_MAX_RESPONSE_BODY)
+            Response.m_sBody.append(buf, MIN((size_t)dwBytesRead, HTTP_MAX_RESPONSE_BODY-Response.m_sBody.length()));
+    }
+
+    return TRUE;
+}
+
+//----------------------------------------------------------
+// CSocketTransport impl
+//----------------------------------------------------------
+
+// The reader only keeps the pointer, it doesn't call us from its constructor.
+#pragma warning(disable:4355)
+
+CSocketTransport::CSocketTransport(AssyncNotification* pAssync)
+    : CHttpTransport(pAssync), m_Reader(this)
+{
+    m_dwPort = 0;
+    m_sock = INVALID_SOCKET;
+    m_bReused = FALSE;
+}
+#pragma warning(default:4355)
+
+CSocketTransport::~CSocketTransport()
+{
+    Close();
+}
+
+BOOL CSocketTransport::Connect(LPCTSTR szServer, DWORD dwPort, BOOL bSecure)
+{
+    Close();
+
+    if(bSecure)
+        return FALSE; // Not supported
+
+    m_sServer = szServer;
+    m_dwPort = dwPort;
+    m_sPoolKey.Format(_T("%s:%lu"), szServer, dwPort);
+    m_sPoolKey.MakeLower();
+
+    return OpenConnection(TRUE);
+}
+
+void CSocketTransport::Close()
+{
+    if(m_sock!=INVALID_SOCKET)
+    {
+        // The connection is idle, let the next request use it
+        CHttpConnectionPool::GetInstance().Release(m_sPoolKey, m_sock);
+        m_sock = INVALID_SOCKET;
+    }
+}
+
+BOOL CSocketTransport::OpenConnection(BOOL bAllowReuse)
+{
+    strconv_t strconv;
+    CString sServiceName;
+    struct addrinfo hints;
+    struct addrinfo *result = NULL;
+    struct addrinfo *ptr = NULL;
+
+    if(bAllowReuse)
+    {
+        m_sock = CHttpConnectionPool::GetInstance().Acquire(m_sPoolKey);
+        if(m_sock!=INVALID_SOCKET)
+        {
+            m_pAssync->SetProgress(_T("Reusing connection to server"), 0, true);
+            m_bReused = TRUE;
+            return TRUE;
+        }
+    }
+
+    m_bReused = FALSE;
+
+    m_pAssync->SetProgress(_T("Connecting to server"), 0, true);
+
+    sServiceName.Format(_T("%lu"), m_dwPort);
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = IPPROTO_TCP;
+
+    if(getaddrinfo(strconv.t2a(m_sServer), strconv.t2a(sServiceName), &hints, &result)!=0)
+    {
+        m_pAssync->SetProgress(_T("Error connecting to server"), 0);
+        return FALSE;
+    }
+
+    for(ptr=result; ptr!=NULL; ptr=ptr->ai_next)
+    {
+        if(m_pAssync->IsCancelled())
+            break;
+
+        m_sock = socket(ptr->ai_family, ptr->ai_socktype, ptr->ai_protocol);
+        if(m_sock==INVALID_SOCKET)
+            continue;
+
+        if(connect(m_sock, ptr->ai_addr, (int)ptr->ai_addrlen)==0)
+            break;
+
+        closesocket(m_sock);
+        m_sock = INVALID_SOCKET;
+    }
+
+    freeaddrinfo(result);
+
+    if(m_sock==INVALID_SOCKET)
+    {
+        m_pAssync->SetProgress(_T("Error connecting to server"), 0);
+        return FALSE;
+    }
+
+    // Don't delay small writes (request head and the last piece of body)
+    BOOL bNoDelay = TRUE;
+    setsockopt(m_sock, IPPROTO_TCP, TCP_NODELAY, (const char*)&bNoDelay, sizeof(bNoDelay));
+
+    return TRUE;
+}
+
+BOOL CSocketTransport::SendRequest(CHttpTransportRequest& Request, CHttpTransportResponse& Response)
+{
+    strconv_t strconv;
+    ULONG64 uBodySize = 0;
+    CString sHead;
+    CString sHost;
+    int nAttempt;
+
+    if(!PrepareBody(Request, uBodySize))
+        return FALSE;
+
+    // Format request head
+    sHost = m_sServer;
+    if(m_dwPort!=INTERNET_DEFAULT_HTTP_PORT)
+        sHost.Format(_T("%s:%lu"), (LPCTSTR)m_sServer, m_dwPort);
+
+    sHead.Format(_T("%s %s HTTP/1.1\r\n")
+        _T("Host: %s\r\n")
+        _T("User-Agent: CrashRpt\r\n")
+        _T("Accept: */*\r\n")
+        _T("Connection: keep-alive\r\n")
+        _T("Content-Length: %I64u\r\n"),
+        (LPCTSTR)Request.m_sVerb,
+        Request.m_sURI.IsEmpty() ? _T("/") : (LPCTSTR)Request.m_sURI,
+        (LPCTSTR)sHost,
+        uBodySize);
+    sHead += Request.m_sHeaders;
+    sHead += _T("\r\n");
+    std::string sHeadA = strconv.t2a(sHead);
+
+    for(nAttempt=0; nAttempt<2; nAttempt++)
+    {
+        if(m_sock==INVALID_SOCKET && !OpenConnection(nAttempt==0))
+            return FALSE;
+
+        m_Reader.Reset();
+        m_uBodySent = 0;
+
+        // Add a message to log
+        m_pAssync->SetProgress(_T("Sending HTTP request..."), 0);
+
+        BOOL bKeepAlive = FALSE;
+        if(WriteRequest(Request, sHeadA))
+        {
+            // Add a message to log
+            m_pAssync->SetProgress(_T("Reading server response..."), 0);
+
+            if(ReadResponse(Response, bKeepAlive))
+            {
+                if(!bKeepAlive)
+                {
+                    closesocket(m_sock);
+                    m_sock = INVALID_SOCKET;
+                }
+                return TRUE;
+            }
+        }
+
+        closesocket(m_sock);
+        m_sock = INVALID_SOCKET;
+
+        // The server may close an idle connection just before we send the request over it.
+        // Nothing has been processed then, so it is safe to send the request again.
+        if(!m_bReused || m_Reader.HasReceivedData() || m_pAssync->IsCancelled())
+            break;
+
+        m_pAssync->SetProgress(_T("Connection has been closed by server, reconnecting."), 0);
+    }
+
+    m_pAssync->SetProgress(_T("Error sending HTTP request over socket."), 0);
+    return FALSE;
+}
+
+BOOL CSocketTransport::WriteRequest(CHttpTransportRequest& Request, const std::string& sHead)
+{
+    // Memory segments (and the request head before them) are gathered
+    // into one WSASend() call; file segments are sent with TransmitFile().
+
+    std::vector<WSABUF> aBuffers;
+    DWORD dwGathered = 0;
+    size_t i;
+
+    WSABUF Buffer;
+    Buffer.buf = (char*)sHead.c_str();
+    Buffer.len = (ULONG)sHead.length();
+    aBuffers.push_back(Buffer);
+
+    for(i=0; i<=Request.m_aBody.size(); i++)
+    {
+        BOOL bFile = i<Request.m_aBody.size() && !Request.m_aBody[i].m_sFileName.IsEmpty();
+
+        if(i<Request.m_aBody.size() && !bFile)
+        {
+            Buffer.buf = (char*)Request.m_aBody[i].m_sData.c_str();
+            Buffer.len = (ULONG)Request.m_aBody[i].m_sData.length();
+            aBuffers.push_back(Buffer);
+            dwGathered += Buffer.len;
+            continue;
+        }
+
+        if(!aBuffers.empty())
+        {
+            if(m_pAssync->IsCancelled())
+                return FALSE;
+
+            // Blocking WSASend() returns when all buffers are sent
+            DWORD dwBytesSent = 0;
+            if(WSASend(m_sock, &aBuffers[0], (DWORD)aBuffers.size(), &dwBytesSent, 0, NULL, NULL)!=0)
+                return FALSE;
+
+            UploadProgress(dwGathered);
+            aBuffers.clear();
+            dwGathered = 0;
+        }
+
+        if(bFile && !WriteFileRange(Request.m_aBody[i]))
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+BOOL CSocketTransport::WriteFileRange(CHttpBodySegment& Segment)
+{
+    HANDLE hFile = CreateFile(Segment.m_sFileName, GENERIC_READ, FILE_SHARE_READ|FILE_SHARE_WRITE,
+        NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if(hFile==INVALID_HANDLE_VALUE)
+    {
+        m_pAssync->SetProgress(_T("Error opening attachment file."), 0);
+        return FALSE;
+    }
+
+    BOOL bStatus = TRUE;
+    ULONG64 uSent = 0;
+
+    // The file is sent in pieces to report progress and check for cancel
+    while(uSent<Segment.m_uFileLength)
+    {
+        if(m_pAssync->IsCancelled())
+        {
+            bStatus = FALSE;
+            break;
+        }
+
+        DWORD dwPiece = (DWORD)MIN(Segment.m_uFileLength-uSent, (ULONG64)HTTP_FILE_PIECE_SIZE);
+
+        // TransmitFile() sends data from the current file position
+        LARGE_INTEGER lPos;
+        lPos.QuadPart = Segment.m_uFileOffset+uSent;
+        if(!SetFilePointerEx(hFile, lPos, NULL, FILE_BEGIN) ||
+            !TransmitFile(m_sock, hFile, dwPiece, 0, NULL, NULL, TF_USE_KERNEL_APC))
+        {
+            m_pAssync->SetProgress(_T("Error uploading attachment part data."), 0);
+            bStatus = FALSE;
+            break;
+        }
+
+        UploadProgress(dwPiece);
+        uSent += dwPiece;
+    }
+
+    CloseHandle(hFile);
+
+    return bStatus;
+}
+
+BOOL CSocketTransport::ReadResponse(CHttpTransportResponse& Response, BOOL& bKeepAlive)
+{
+    HttpResponseHead Head;
+    bool bKeep = false;
+
+    Response = CHttpTransportResponse();
+    bKeepAlive = FALSE;
+
+    int nResult = m_Reader.ReadResponse(Head, Response.m_sBody, bKeep);
+    if(nResult!=HTTPRESP_OK)
+    {
+        if(nResult==HTTPRESP_INVALID)
+            m_pAssync->SetProgress(_T("Invalid server response."), 0);
+        return FALSE;
+    }
+
+    Response.m_dwStatus = Head.m_uStatus;
+    size_t i;
+    for(i=0; i<Head.m_aHeaders.size(); i++)
+        Response.m_aHeaders[CString(Head.m_aHeaders[i].first.c_str())] = CString(Head.m_aHeaders[i].second.c_str());
+
+    bKeepAlive = bKeep;
+    return TRUE;
+}
+
+bool CSocketTransport::Receive(std::string& sBuffer, bool& bEOF)
+{
+    // Wait for data, checking for cancel now and then
+    for(;;)
+    {
+        if(m_pAssync->IsCancelled())
+            return false;
+
+        fd_set fds;
+        FD_ZERO(&fds);
+        FD_SET(m_sock, &fds);
+        struct timeval tv;
+        tv.tv_sec = 0;
+        tv.tv_usec = 100000;
+
+        int nReady = select((int)m_sock+1, &fds, NULL, NULL, &tv);
+        if(nReady<0)
+            return false;
+        if(nReady==0)
+            continue;
+
+        char buf[16384];
+        int nReceived = recv(m_sock, buf, sizeof(buf), 0);
+        if(nReceived<=0)
+        {
+            bEOF = nReceived==0;
+            return false;
+        }
+
+        sBuffer.append(buf, nReceived);
+        return true;
+    }
+}
+
+//----------------------------------------------------------
+// CHttpConnectionPool impl
+//----------------------------------------------------------
+
+// The pool lives as long as the process.
+static CHttpConnectionPool g_ConnectionPool;
+
+CHttpConnectionPool::CHttpConnectionPool()
+{
+    // Initialize WinSock library
+    WSADATA wsaData;
+    WSAStartup(MAKEWORD(2,2), &wsaData);
+}
+
+CHttpConnectionPool::~CHttpConnectionPool()
+{
+    std::multimap<CString, IdleConnection>::iterator it;
+    for(it=m_aIdle.begin(); it!=m_aIdle.end(); it++)
+        closesocket(it->second.m_sock);
+    m_aIdle.clear();
+
+    // Release WinSock
+    WSACleanup();
+}
+
+CHttpConnectionPool& CHttpConnectionPool::GetInstance()
+{
+    return g_ConnectionPool;
+}
+
+SOCKET CHttpConnectionPool::Acquire(const CString& sKey)
+{
+    CAutoLock lock(&m_csLock);
+
+    DWORD dwNow = GetTickCount();
+
+    std::multimap<CString, IdleConnection>::iterator it = m_aIdle.find(sKey);
+    while(it!=m_aIdle.end() && it->first==sKey)
+    {
+        IdleConnection conn = it->second;
+        m_aIdle.erase(it++);
+
+        // An idle connection should have nothing to read. If it has,
+        // the server has closed it (or sent something unexpected).
+        fd_set fds;
+        FD_ZERO(&fds);
+        FD_SET(conn.m_sock, &fds);
+        struct timeval tv = {0, 0};
+        BOOL bReadable = select((int)conn.m_sock+1, &fds, NULL, NULL, &tv)!=0;
+
+        if(dwNow-conn.m_dwIdleSince<HTTP_KEEPALIVE_TIMEOUT && !bReadable)
+            return conn.m_sock;
+
+        closesocket(conn.m_sock);
+    }
+
+    return INVALID_SOCKET;
+}
+
+void CHttpConnectionPool::Release(const CString& sKey, SOCKET sock)
+{
+    CAutoLock lock(&m_csLock);
+
+    if(m_aIdle.count(sKey)>=HTTP_MAX_IDLE_CONNECTIONS)
+    {
+        closesocket(sock);
+        return;
+    }
+
+    IdleConnection conn;
+    conn.m_sock = sock;
+    conn.m_dwIdleSince = GetTickCount();
+    m_aIdle.insert(std::make_pair(sKey, conn));
+}
@@ -0,0 +1,212 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+// File: HttpTransport.h
+// Description: Transports used to send HTTP requests (WinINet and plain sockets).
+
+#pragma once
+#include "stdafx.h"
+#include "AssyncNotification.h"
+#include "CritSec.h"
+#include "HttpResponseReader.h"
+
+// Files are sent in pieces of this size, to report progress and check for cancel.
+#define HTTP_FILE_PIECE_SIZE        (1024*1024)
+// Idle connection is not reused after this time (in milliseconds), as the server may close it any moment.
+#define HTTP_KEEPALIVE_TIMEOUT      4000
+// Maximum count of idle connections kept per server.
+#define HTTP_MAX_IDLE_CONNECTIONS   4
+
+// A piece of request body: either a memory block or a range of file.
+struct CHttpBodySegment
+{
+    CHttpBodySegment();
+
+    std::string m_sData;     // Data (if m_sFileName is empty).
+    CString m_sFileName;     // File to take data from.
+    ULONG64 m_uFileOffset;   // Offset of data in file.
+    ULONG64 m_uFileLength;   // Length of data in file.
+};
+
+// Request sent through a transport.
+struct CHttpTransportRequest
+{
+    CHttpTransportRequest();
+
+    CString m_sVerb;         // Method (POST, PUT).
+    CString m_sURI;          // Request URI.
+    CString m_sHeaders;      // Additional headers, each followed by CRLF.
+    std::vector<CHttpBodySegment> m_aBody; // Request body.
+    BOOL m_bGzip;            // Compress the body with gzip content encoding (ignored if it has file segments).
+    BOOL m_bReportProgress;  // Report upload progress of this request.
+};
+
+// Response received through a transport.
+struct CHttpTransportResponse
+{
+    CHttpTransportResponse();
+
+    // Returns the value of the header. Returns FALSE if there is no such header.
+    BOOL GetHeader(LPCTSTR szName, CString& sValue);
+
+    // Adds a header from the "Name: value" line.
+    void ParseHeader(CString sLine);
+
+    DWORD m_dwStatus;        // Status code.
+    std::map<CString, CString> m_aHeaders; // Headers (names in lower case).
+    std::string m_sBody;     // Response body (up to HTTP_MAX_RESPONSE_BODY bytes).
+};
+
+// Sends HTTP requests to a server. A transport stays connected between requests,
+// so several requests (for example, several error reports or chunks of a
+// resumable upload) are sent over the same connection.
+class CHttpTransport
+{
+public:
+
+    // Constructor.
+    CHttpTransport(AssyncNotification* pAssync);
+
+    // Destructor.
+    virtual ~CHttpTransport();
+
+    // Creates the transport suitable for the server. Plain HTTP over a direct connection
+    // goes through sockets (unless bAllowSockets is FALSE); HTTPS and connections
+    // through a proxy go through WinINet.
+    static CHttpTransport* Create(BOOL bSecure, BOOL bAllowSockets, AssyncNotification* pAssync);
+
+    // Sets the server requests are sent to.
+    virtual BOOL Connect(LPCTSTR szServer, DWORD dwPort, BOOL bSecure) = 0;
+
+    // Sends the request and reads the response.
+    // Returns FALSE on network error or if cancelled.
+    virtual BOOL SendRequest(CHttpTransportRequest& Request, CHttpTransportResponse& Response) = 0;
+
+    // Disconnects from the server.
+    virtual void Close() = 0;
+
+protected:
+
+    // Compresses the body if requested and calculates its size.
+    BOOL PrepareBody(CHttpTransportRequest& Request, ULONG64& uBodySize);
+
+    // Updates upload progress.
+    void UploadProgress(DWORD dwBytesSent);
+
+    AssyncNotification* m_pAssync; // Used to communicate with the main thread.
+    ULONG64 m_uBodySize;           // Size of the request body being sent.
+    ULONG64 m_uBodySent;           // Bytes of the request body sent so far.
+};
+
+// Sends requests with WinINet. Supports HTTPS and proxy servers.
+class CWinInetTransport : public CHttpTransport
+{
+public:
+
+    // Constructor.
+    CWinInetTransport(AssyncNotification* pAssync);
+
+    // Destructor.
+    ~CWinInetTransport();
+
+    BOOL Connect(LPCTSTR szServer, DWORD dwPort, BOOL bSecure);
+    BOOL SendRequest(CHttpTransportRequest& Request, CHttpTransportResponse& Response);
+    void Close();
+
+private:
+
+    // Opens HTTP request with the given verb.
+    HINTERNET OpenRequest(LPCTSTR szVerb, LPCTSTR szURI);
+
+    // Writes a body segment.
+    BOOL WriteSegment(HINTERNET hRequest, CHttpBodySegment& Segment);
+
+    // Reads status, headers and body of the response.
+    BOOL ReadResponse(HINTERNET hRequest, CHttpTransportResponse& Response);
+
+    HINTERNET m_hSession;    // Internet session.
+    HINTERNET m_hConnect;    // Internet connection.
+    DWORD m_dwFlags;         // Flags for HttpOpenRequest.
+};
+
+// Sends requests over a plain socket. Keeps connections alive between requests
+// (and between transports, see CHttpConnectionPool). Memory parts of the body are
+// gathered into a single WSASend() call, file parts are sent with TransmitFile(),
+// so the data isn't copied through user-mode buffers.
+class CSocketTransport : public CHttpTransport, private CHttpByteSource
+{
+public:
+
+    // Constructor.
+    CSocketTransport(AssyncNotification* pAssync);
+
+    // Destructor.
+    ~CSocketTransport();
+
+    BOOL Connect(LPCTSTR szServer, DWORD dwPort, BOOL bSecure);
+    BOOL SendRequest(CHttpTransportRequest& Request, CHttpTransportResponse& Response);
+    void Close();
+
+private:
+
+    // Takes an idle connection from the pool (if allowed) or opens a new one.
+    BOOL OpenConnection(BOOL bAllowReuse);
+
+    // Sends the request. Returns FALSE on error.
+    BOOL WriteRequest(CHttpTransportRequest& Request, const std::string& sHead);
+
+    // Sends a range of file.
+    BOOL WriteFileRange(CHttpBodySegment& Segment);
+
+    // Reads the response. bKeepAlive tells if the connection may be reused afterwards.
+    BOOL ReadResponse(CHttpTransportResponse& Response, BOOL& bKeepAlive);
+
+    // Receives more response data from the socket. Returns false on error, cancel or end of data.
+    bool Receive(std::string& sBuffer, bool& bEOF);
+
+    CString m_sServer;       // Server name.
+    DWORD m_dwPort;          // Server port.
+    CString m_sPoolKey;      // Connection pool key.
+    SOCKET m_sock;           // Connected socket.
+    BOOL m_bReused;          // Connection was taken from the pool.
+    CHttpResponseReader m_Reader; // Parses responses received over the connection.
+};
+
+// Keeps idle HTTP connections for reuse.
+class CHttpConnectionPool
+{
+public:
+
+    // Constructor.
+    CHttpConnectionPool();
+
+    // Destructor. Closes idle connections.
+    ~CHttpConnectionPool();
+
+    // Returns the process-wide pool.
+    static CHttpConnectionPool& GetInstance();
+
+    // Takes an idle connection to the server. Returns INVALID_SOCKET if there is none.
+    SOCKET Acquire(const CString& sKey);
+
+    // Returns the connection to the pool.
+    void Release(const CString& sKey, SOCKET sock);
+
+private:
+
+    struct IdleConnection
+    {
+        SOCKET m_sock;       // Socket.
+        DWORD m_dwIdleSince; // When the connection became idle (tick count).
+    };
+
+    CCritSec m_csLock;       // Protects the pool.
+    std::multimap<CString, IdleConnection> m_aIdle; // Idle connections by server.
+};
@@ -0,0 +1,911 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+// File: ImageEncoder.cpp
+// Description: Writes raw screenshot images to PNG, JPEG and BMP files.
+
+#include "ImageEncoder.h"
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include "zlib.h"
+#include "jpeglib.h"
+
+// Size of deflate window. The tail of the previous band of this size
+// is used as dictionary when compressing the next band.
+#define DEFLATE_WINDOW_SIZE 32768
+
+// Calls func(i) for i in [0, nCount) on up to nThreads threads (including the calling one).
+// Returns false if any call returns false.
+template <class F>
+static bool run_parallel(int nCount, int nThreads, F func)
+{
+    std::atomic<int> nNext(0);
+    std::atomic<bool> bOK(true);
+
+    auto worker = [&]()
+    {
+        for(;;)
+        {
+            int i = nNext++;
+            if(i>=nCount)
+                break;
+            if(!func(i))
+                bOK = false;
+        }
+    };
+
+    std::vector<std::thread> aThreads;
+    int t;
+    for(t=1; t<nThreads && t<nCount; t++)
+    {
+        try
+        {
+            aThreads.push_back(std::thread(worker));
+        }
+        catch(...)
+        {
+            // Can't start more threads; the rest of work is done by those started
+            break;
+        }
+    }
+
+    worker();
+
+    size_t i;
+    for(i=0; i<aThreads.size(); i++)
+        aThreads[i].join();
+
+    return bOK;
+}
+
+// Converts a BGR row to RGB or grayscale.
+static void convert_row(const unsigned char* pSrc, unsigned char* pDst, int nWidth, bool bGrayscale)
+{
+    int x;
+    if(bGrayscale)
+    {
+        for(x=0; x<nWidth; x++)
+            pDst[x] = (unsigned char)((pSrc[x*3+0]+pSrc[x*3+1]+pSrc[x*3+2])/3);
+    }
+    else
+    {
+        for(x=0; x<nWidth; x++)
+        {
+            pDst[x*3+0] = pSrc[x*3+2];
+            pDst[x*3+1] = pSrc[x*3+1];
+            pDst[x*3+2] = pSrc[x*3+0];
+        }
+    }
+}
+
+//-----------------------------------------------
+// PNG
+//-----------------------------------------------
+
+// Name of the private chunk telling that the image is split into strips.
+// Its data is the count of rows per strip (4 bytes, big-endian). Strip i
+// is stored in the i-th IDAT chunk and can be decoded without preceding ones.
+#define PNG_STRIP_CHUNK "crSI"
+
+// Size of the hash table used for palette detection (must be a power of 2
+// and more than twice the palette size).
+#define PALETTE_HASH_SIZE 1024
+
+PngEncodeParams::PngEncodeParams()
+{
+    m_bGrayscale = false;
+    m_nLevel = Z_BEST_COMPRESSION;
+    m_nStrategy = Z_DEFAULT_STRATEGY;
+    m_nFilter = PNGENC_FILTER_ADAPTIVE;
+    m_bPalette = false;
+    m_nStripRows = 0;
+    m_nThreads = 0;
+}
+
+void PngEncodeParams::SetFastLossless()
+{
+    // On UI screenshots level 3 is as fast as Z_RLE, and gives files 3 times smaller,
+    // about as small as Z_BEST_COMPRESSION does
+    m_nLevel = 3;
+    m_nStrategy = Z_DEFAULT_STRATEGY;
+    m_nFilter = PNGENC_FILTER_FAST;
+    m_bPalette = true;
+    m_nStripRows = PNG_FAST_STRIP_ROWS;
+}
+
+// Colors of an image having at most 256 of them, and a hash table
+// mapping each color to its palette index.
+struct PngPalette
+{
+    int m_nColors;                              // Count of colors.
+    unsigned int m_aColors[256];                // Colors as 0xRRGGBB.
+    unsigned int m_aHashColors[PALETTE_HASH_SIZE]; // Colors in hash table, 0xFFFFFFFF for empty slots.
+    unsigned char m_aHashIndices[PALETTE_HASH_SIZE]; // Palette indices in hash table.
+
+    static unsigned int Hash(unsigned int uColor)
+    {
+        return (uColor*2654435761U)>>22;
+    }
+
+    // Returns the slot where the color is, or an empty slot where it would be.
+    int Find(unsigned int uColor) const
+    {
+        unsigned int h = Hash(uColor);
+        while(m_aHashColors[h]!=uColor && m_aHashColors[h]!=0xFFFFFFFF)
+            h = (h+1)&(PALETTE_HASH_SIZE-1);
+        return (int)h;
+    }
+
+    // Collects image colors. Returns false as soon as the 257th color is found,
+    // so photos and gradients are rejected after scanning a few pixels.
+    bool Build(const unsigned char* pBits, int nWidth, int nHeight, int nStride)
+    {
+        m_nColors = 0;
+        memset(m_aHashColors, 0xFF, sizeof(m_aHashColors));
+
+        unsigned int uLast = 0xFFFFFFFF;
+        int x, y;
+        for(y=0; y<nHeight; y++)
+        {
+            const unsigned char* p = pBits+(size_t)y*nStride;
+            for(x=0; x<nWidth; x++, p+=3)
+            {
+                unsigned int uColor = (p[2]<<16)|(p[1]<<8)|p[0];
+                if(uColor==uLast)
+                    continue; // UI images have long runs of the same color
+                uLast = uColor;
+
+                int h = Find(uColor);
+                if(m_aHashColors[h]==uColor)
+                    continue;
+                if(m_nColors==256)
+                    return false;
+                m_aHashColors[h] = uColor;
+                m_aHashIndices[h] = (unsigned char)m_nColors;
+                m_aColors[m_nColors++] = uColor;
+            }
+        }
+
+        return true;
+    }
+};
+
+// Converts a BGR row to palette indices.
+static void convert_row_to_palette(const unsigned char* pSrc, unsigned char* pDst, int nWidth,
+                                   const PngPalette& Palette)
+{
+    unsigned int uLast = 0xFFFFFFFF;
+    unsigned char uIndex = 0;
+    int x;
+    for(x=0; x<nWidth; x++, pSrc+=3)
+    {
+        unsigned int uColor = (pSrc[2]<<16)|(pSrc[1]<<8)|pSrc[0];
+        if(uColor!=uLast)
+        {
+            uLast = uColor;
+            uIndex = Palette.m_aHashIndices[Palette.Find(uColor)];
+        }
+        pDst[x] = uIndex;
+    }
+}
+
+// Paeth predictor as defined by PNG specification.
+static inline int paeth(int a, int b, int c)
+{
+    int p = a + b - c;
+    int pa = abs(p - a);
+    int pb = abs(p - b);
+    int pc = abs(p - c);
+    if(pa<=pb && pa<=pc)
+        return a;
+    if(pb<=pc)
+        return b;
+    return c;
+}
+
+// Applies a PNG filter to a row. pPrev is NULL for the first row of the image or a strip.
+static void apply_filter(int nFilter, const unsigned char* pRow, const unsigned char* pPrev,
+                         int nRowBytes, int nBpp, unsigned char* pOut)
+{
+    int i;
+    switch(nFilter)
+    {
+    case PNGENC_FILTER_NONE:
+        memcpy(pOut, pRow, nRowBytes);
+        break;
+    case PNGENC_FILTER_SUB:
+        for(i=0; i<nBpp && i<nRowBytes; i++)
+            pOut[i] = pRow[i];
+        for(; i<nRowBytes; i++)
+            pOut[i] = (unsigned char)(pRow[i]-pRow[i-nBpp]);
+        break;
+    case PNGENC_FILTER_UP:
+        for(i=0; i<nRowBytes; i++)
+            pOut[i] = (unsigned char)(pRow[i]-pPrev[i]);
+        break;
+    case PNGENC_FILTER_AVERAGE:
+        for(i=0; i<nBpp && i<nRowBytes; i++)
+            pOut[i] = (unsigned char)(pRow[i]-pPrev[i]/2);
+        for(; i<nRowBytes; i++)
+            pOut[i] = (unsigned char)(pRow[i]-(pRow[i-nBpp]+pPrev[i])/2);
+        break;
+    case PNGENC_FILTER_PAETH:
+        for(i=0; i<nBpp && i<nRowBytes; i++)
+            pOut[i] = (unsigned char)(pRow[i]-pPrev[i]);
+        for(; i<nRowBytes; i++)
+            pOut[i] = (unsigned char)(pRow[i]-paeth(pRow[i-nBpp], pPrev[i], pPrev[i-nBpp]));
+        break;
+    }
+}
+
+// Returns the sum of absolute values of filtered bytes (heuristic suggested by PNG
+// specification for general purpose compression).
+static unsigned int sum_abs(const unsigned char* p, int nCount)
+{
+    unsigned int uSum = 0;
+    int i;
+    for(i=0; i<nCount; i++)
+        uSum += p[i]<128 ? p[i] : 256-p[i];
+    return uSum;
+}
+
+// Returns the count of runs of equal bytes (heuristic for run-length compression).
+static unsigned int count_runs(const unsigned char* p, int nCount)
+{
+    unsigned int uRuns = nCount>0 ? 1 : 0;
+    int i;
+    for(i=1; i<nCount; i++)
+        uRuns += p[i]!=p[i-1];
+    return uRuns;
+}
+
+// Filters a row. pOut receives the filter type byte followed by the filtered row.
+// Adaptive and fast modes try several filters and keep the one with the minimum cost.
+static void filter_row(int nFilter, const unsigned char* pRow, const unsigned char* pPrev,
+                       int nRowBytes, int nBpp, unsigned char* pOut, std::vector<unsigned char>& aTemp)
+{
+    if(pPrev==NULL)
+    {
+        // Filters using the previous row can't be used at the top of the image, nor at the
+        // top of a strip, where a reader may start decoding
+        if(nFilter==PNGENC_FILTER_UP)
+            nFilter = PNGENC_FILTER_NONE;
+        else if(nFilter==PNGENC_FILTER_AVERAGE || nFilter==PNGENC_FILTER_PAETH)
+            nFilter = PNGENC_FILTER_SUB;
+    }
+
+    if(nFilter!=PNGENC_FILTER_ADAPTIVE && nFilter!=PNGENC_FILTER_FAST)
+    {
+        pOut[0] = (unsigned char)nFilter;
+        apply_filter(nFilter, pRow, pPrev, nRowBytes, nBpp, pOut+1);
+        return;
+    }
+
+    bool bFast = nFilter==PNGENC_FILTER_FAST;
+    int nLastFilter = bFast ? PNGENC_FILTER_UP : PNGENC_FILTER_PAETH;
+    unsigned int uBestCost = 0xFFFFFFFF;
+    aTemp.resize(nRowBytes+1);
+    int i;
+    for(i=PNGENC_FILTER_NONE; i<=nLastFilter; i++)
+    {
+        if(pPrev==NULL && i>PNGENC_FILTER_SUB)
+            break;
+
+        apply_filter(i, pRow, pPrev, nRowBytes, nBpp, &aTemp[0]);
+        unsigned int uCost = bFast ? count_runs(&aTemp[0], nRowBytes) : sum_abs(&aTemp[0], nRowBytes);
+        if(uCost<uBestCost)
+        {
+            uBestCost = uCost;
+            pOut[0] = (unsigned char)i;
+            memcpy(pOut+1, &aTemp[0], nRowBytes);
+        }
+    }
+}
+
+// Writes a PNG chunk. Chunk data is given in up to three parts.
+static bool write_png_chunk(FILE* f, const char* szType,
+                            const void* pData1, size_t uSize1,
+                            const void* pData2=NULL, size_t uSize2=0,
+                            const void* pData3=NULL, size_t uSize3=0)
+{
+    unsigned char aHead[8];
+    unsigned long uLength = (unsigned long)(uSize1+uSize2+uSize3);
+    aHead[0] = (unsigned char)(uLength>>24);
+    aHead[1] = (unsigned char)(uLength>>16);
+    aHead[2] = (unsigned char)(uLength>>8);
+    aHead[3] = (unsigned char)uLength;
+    memcpy(aHead+4, szType, 4);
+
+    uLong uCRC = crc32(0, aHead+4, 4);
+    if(uSize1)
+        uCRC = crc32(uCRC, (const Bytef*)pData1, (uInt)uSize1);
+    if(uSize2)
+        uCRC = crc32(uCRC, (const Bytef*)pData2, (uInt)uSize2);
+    if(uSize3)
+        uCRC = crc32(uCRC, (const Bytef*)pData3, (uInt)uSize3);
+
+    unsigned char aTail[4];
+    aTail[0] = (unsigned char)(uCRC>>24);
+    aTail[1] = (unsigned char)(uCRC>>16);
+    aTail[2] = (unsigned char)(uCRC>>8);
+    aTail[3] = (unsigned char)uCRC;
+
+    if(fwrite(aHead, 1, 8, f)!=8)
+        return false;
+    if(uSize1 && fwrite(pData1, 1, uSize1, f)!=uSize1)
+        return false;
+    if(uSize2 && fwrite(pData2, 1, uSize2, f)!=uSize2)
+        return false;
+    if(uSize3 && fwrite(pData3, 1, uSize3, f)!=uSize3)
+        return false;
+    return fwrite(aTail, 1, 4, f)==4;
+}
+
+// Puts a big-endian 32-bit value.
+static void put_be32(unsigned char* p, unsigned long uValue)
+{
+    p[0] = (unsigned char)(uValue>>24);
+    p[1] = (unsigned char)(uValue>>16);
+    p[2] = (unsigned char)(uValue>>8);
+    p[3] = (unsigned char)uValue;
+}
+
+// Gets a big-endian 32-bit value.
+static unsigned long get_be32(const unsigned char* p)
+{
+    return ((unsigned long)p[0]<<24)|((unsigned long)p[1]<<16)|((unsigned long)p[2]<<8)|p[3];
+}
+
+bool image_write_png(FILE* f, const unsigned char* pBits, int nWidth, int nHeight,
+                     int nStride, const PngEncodeParams& Params)
+{
+    if(f==NULL || pBits==NULL || nWidth<=0 || nHeight<=0)
+        return false;
+
+    // Use a palette if the image has few colors
+    std::vector<PngPalette> aPalette;
+    if(Params.m_bPalette && !Params.m_bGrayscale)
+    {
+        aPalette.resize(1);
+        if(!aPalette[0].Build(pBits, nWidth, nHeight, nStride))
+            aPalette.clear();
+    }
+    const PngPalette* pPalette = aPalette.empty() ? NULL : &aPalette[0];
+
+    int nBpp = (Params.m_bGrayscale || pPalette) ? 1 : 3;
+    size_t uRowBytes = (size_t)nWidth*nBpp;
+    size_t uLineSize = uRowBytes+1; // With filter type byte
+
+    // Palette indices are not magnitudes, so the sum of absolute values
+    // says nothing about them; use the run count instead
+    int nFilter = Params.m_nFilter;
+    if(pPalette && nFilter==PNGENC_FILTER_ADAPTIVE)
+        nFilter = PNGENC_FILTER_FAST;
+
+    int nThreads = Params.m_nThreads;
+    if(nThreads<=0)
+        nThreads = (int)std::thread::hardware_concurrency();
+    if(nThreads<=0)
+        nThreads = 1;
+
+    // Split rows into bands, a few per thread, so threads stay busy till the end.
+    // If strips are requested, each strip is a band.
+    bool bStrips = Params.m_nStripRows>0;
+    int nBandRows = Params.m_nStripRows;
+    if(!bStrips)
+    {
+        nBandRows = (nHeight+nThreads*4-1)/(nThreads*4);
+        if(nBandRows<PNG_MIN_BAND_ROWS)
+            nBandRows = PNG_MIN_BAND_ROWS;
+    }
+    int nBands = (nHeight+nBandRows-1)/nBandRows;
+
+    std::vector<unsigned char> aFiltered(uLineSize*nHeight);
+    std::vector<std::string> aPacked(nBands);
+    std::vector<uLong> aAdler(nBands);
+
+    // Filter rows. Each band converts the row above it too, as filters need it,
+    // unless the band is a strip which must be decodable by itself.
+    bool bFilter = run_parallel(nBands, nThreads, [&](int nBand) -> bool
+    {
+        std::vector<unsigned char> aRow(uRowBytes), aPrev(uRowBytes), aTemp;
+        int nFirst = nBand*nBandRows;
+        int nLast = nFirst+nBandRows<nHeight ? nFirst+nBandRows : nHeight;
+        bool bHavePrev = nFirst>0 && !bStrips;
+        int y;
+        for(y=(bHavePrev ? nFirst-1 : nFirst); y<nLast; y++)
+        {
+            const unsigned char* pSrc = pBits+(size_t)y*nStride;
+            if(pPalette)
+                convert_row_to_palette(pSrc, &aRow[0], nWidth, *pPalette);
+            else
+                convert_row(pSrc, &aRow[0], nWidth, Params.m_bGrayscale);
+
+            if(y>=nFirst)
+            {
+                filter_row(nFilter, &aRow[0], (y>nFirst || bHavePrev) ? &aPrev[0] : NULL,
+                    (int)uRowBytes, nBpp, &aFiltered[uLineSize*y], aTemp);
+            }
+            aRow.swap(aPrev);
+        }
+        return true;
+    });
+    if(!bFilter)
+        return false;
+
+    // Compress bands. Each band but the last ends with a sync flush, so it ends on a byte
+    // boundary and the next band can be appended. The end of the previous band is used
+    // as dictionary, so compression is almost as good as for a single stream. Strips don't
+    // use a dictionary, so a reader can start inflating at any strip.
+    bool bCompress = run_parallel(nBands, nThreads, [&](int nBand) -> bool
+    {
+        size_t uStart = uLineSize*nBand*nBandRows;
+        size_t uEnd = uLineSize*(nBand*nBandRows+nBandRows);
+        if(uEnd>aFiltered.size())
+            uEnd = aFiltered.size();
+        bool bLast = nBand==nBands-1;
+
+        z_stream zs;
+        memset(&zs, 0, sizeof(zs));
+        if(deflateInit2(&zs, Params.m_nLevel, Z_DEFLATED, -MAX_WBITS, 8, Params.m_nStrategy)!=Z_OK)
+            return false;
+
+        if(uStart>0 && !bStrips)
+        {
+            size_t uDict = uStart<DEFLATE_WINDOW_SIZE ? uStart : DEFLATE_WINDOW_SIZE;
+            deflateSetDictionary(&zs, &aFiltered[uStart-uDict], (uInt)uDict);
+        }
+
+        std::string& sOut = aPacked[nBand];
+        sOut.resize(deflateBound(&zs, (uLong)(uEnd-uStart))+16);
+        zs.next_in = &aFiltered[uStart];
+        zs.avail_in = (uInt)(uEnd-uStart);
+        zs.next_out = (Bytef*)&sOut[0];
+        zs.avail_out = (uInt)sOut.size();
+        int res = deflate(&zs, bLast ? Z_FINISH : Z_SYNC_FLUSH);
+        bool bOK = bLast ? res==Z_STREAM_END : (res==Z_OK && zs.avail_in==0 && zs.avail_out>0);
+        sOut.resize(sOut.size()-zs.avail_out);
+        deflateEnd(&zs);
+
+        aAdler[nBand] = adler32(adler32(0, NULL, 0), &aFiltered[uStart], (uInt)(uEnd-uStart));
+        return bOK;
+    });
+    if(!bCompress)
+        return false;
+
+    // Signature
+    static const unsigned char aSignature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+    if(fwrite(aSignature, 1, 8, f)!=8)
+        return false;
+
+    // Header
+    unsigned char aIHDR[13];
+    put_be32(aIHDR, nWidth);
+    put_be32(aIHDR+4, nHeight);
+    aIHDR[8] = 8; // Bit depth
+    aIHDR[9] = pPalette ? 3 : (Params.m_bGrayscale ? 0 : 2); // Color type
+    aIHDR[10] = 0; // Compression method
+    aIHDR[11] = 0; // Filter method
+    aIHDR[12] = 0; // No interlace
+    if(!write_png_chunk(f, "IHDR", aIHDR, sizeof(aIHDR)))
+        return false;
+
+    // Palette
+    if(pPalette)
+    {
+        unsigned char aPLTE[256*3];
+        int i;
+        for(i=0; i<pPalette->m_nColors; i++)
+        {
+            aPLTE[i*3+0] = (unsigned char)(pPalette->m_aColors[i]>>16);
+            aPLTE[i*3+1] = (unsigned char)(pPalette->m_aColors[i]>>8);
+            aPLTE[i*3+2] = (unsigned char)pPalette->m_aColors[i];
+        }
+        if(!write_png_chunk(f, "PLTE", aPLTE, pPalette->m_nColors*3))
+            return false;
+    }
+
+    // Strip index
+    if(bStrips)
+    {
+        unsigned char aStrip[4];
+        put_be32(aStrip, nBandRows);
+        if(!write_png_chunk(f, PNG_STRIP_CHUNK, aStrip, sizeof(aStrip)))
+            return false;
+    }
+
+    // Image data: zlib header, the bands, Adler-32 of uncompressed data.
+    // Each band goes to its own IDAT chunk.
+    uLong uAdler = aAdler[0];
+    int i;
+    for(i=1; i<nBands; i++)
+    {
+        size_t uLen = (i==nBands-1 ? aFiltered.size() : uLineSize*(i+1)*nBandRows) - uLineSize*i*nBandRows;
+        uAdler = adler32_combine(uAdler, aAdler[i], (z_off_t)uLen);
+    }
+
+    unsigned char aZlibHeader[2] = {0x78, 0xDA};
+    unsigned char aZlibTrailer[4];
+    put_be32(aZlibTrailer, uAdler);
+
+    for(i=0; i<nBands; i++)
+    {
+        bool bFirst = i==0;
+        bool bLast = i==nBands-1;
+        if(!write_png_chunk(f, "IDAT",
+            bFirst ? aZlibHeader : NULL, bFirst ? sizeof(aZlibHeader) : 0,
+            aPacked[i].data(), aPacked[i].size(),
+            bLast ? aZlibTrailer : NULL, bLast ? sizeof(aZlibTrailer) : 0))
+            return false;
+    }
+
+    // End
+    if(!write_png_chunk(f, "IEND", NULL, 0))
+        return false;
+
+    return true;
+}
+
+bool image_read_png_info(FILE* f, PngStripInfo& Info)
+{
+    Info.m_nWidth = 0;
+    Info.m_nHeight = 0;
+    Info.m_nStripRows = 0;
+    Info.m_bPalette = false;
+    Info.m_bGrayscale = false;
+    Info.m_nColors = 0;
+    Info.m_aIDAT.clear();
+
+    unsigned char aSignature[8];
+    static const unsigned char aExpected[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+    if(fseek(f, 0, SEEK_SET)!=0 ||
+       fread(aSignature, 1, 8, f)!=8 ||
+       memcmp(aSignature, aExpected, 8)!=0)
+        return false;
+
+    // Walk chunks, reading the small ones and remembering where IDATs are
+    long lPos = 8;
+    for(;;)
+    {
+        unsigned char aHead[8];
+        if(fseek(f, lPos, SEEK_SET)!=0 || fread(aHead, 1, 8, f)!=8)
+            return false;
+        unsigned long uLength = get_be32(aHead);
+        if(uLength>0x7FFFFFFF)
+            return false;
+
+        if(memcmp(aHead+4, "IHDR", 4)==0)
+        {
+            unsigned char aIHDR[13];
+            if(uLength!=13 || fread(aIHDR, 1, 13, f)!=13)
+                return false;
+            Info.m_nWidth = (int)get_be32(aIHDR);
+            Info.m_nHeight = (int)get_be32(aIHDR+4);
+            // Only what this encoder writes is supported
+            if(Info.m_nWidth<=0 || Info.m_nHeight<=0 || aIHDR[8]!=8 || aIHDR[12]!=0 ||
+               (aIHDR[9]!=0 && aIHDR[9]!=2 && aIHDR[9]!=3))
+                return false;
+            Info.m_bGrayscale = aIHDR[9]==0;
+            Info.m_bPalette = aIHDR[9]==3;
+        }
+        else if(memcmp(aHead+4, "PLTE", 4)==0)
+        {
+            unsigned char aPLTE[256*3];
+            if(uLength>sizeof(aPLTE) || uLength%3!=0 || fread(aPLTE, 1, uLength, f)!=uLength)
+                return false;
+            Info.m_nColors = (int)uLength/3;
+            int i;
+            for(i=0; i<Info.m_nColors; i++)
+                Info.m_aPalette[i] = (aPLTE[i*3]<<16)|(aPLTE[i*3+1]<<8)|aPLTE[i*3+2];
+        }
+        else if(memcmp(aHead+4, PNG_STRIP_CHUNK, 4)==0)
+        {
+            unsigned char aStrip[4];
+            if(uLength!=4 || fread(aStrip, 1, 4, f)!=4)
+                return false;
+            Info.m_nStripRows = (int)get_be32(aStrip);
+        }
+        else if(memcmp(aHead+4, "IDAT", 4)==0)
+        {
+            PngStripInfo::Chunk chunk;
+            chunk.m_lOffset = lPos+8;
+            chunk.m_lLength = (long)uLength;
+            Info.m_aIDAT.push_back(chunk);
+        }
+        else if(memcmp(aHead+4, "IEND", 4)==0)
+            break;
+
+        lPos += 12+(long)uLength;
+    }
+
+    if(Info.m_nWidth==0 || Info.m_aIDAT.empty() || (Info.m_bPalette && Info.m_nColors==0))
+        return false;
+
+    // The strip index is valid only if there is an IDAT per strip
+    if(Info.m_nStripRows>0 &&
+       (int)Info.m_aIDAT.size()!=(Info.m_nHeight+Info.m_nStripRows-1)/Info.m_nStripRows)
+        Info.m_nStripRows = 0;
+
+    return true;
+}
+
+bool image_read_png_rows(FILE* f, const PngStripInfo& Info, int nFirstRow, int nRowCount,
+                         unsigned char* pBits, int nStride)
+{
+    if(f==NULL || pBits==NULL || nFirstRow<0 || nRowCount<=0 ||
+       nFirstRow+nRowCount>Info.m_nHeight)
+        return false;
+
+    // Start at the strip containing the first row, or at the beginning
+    // of the image if there are no strips
+    int nStrip = Info.m_nStripRows>0 ? nFirstRow/Info.m_nStripRows : 0;
+    int y = Info.m_nStripRows>0 ? nStrip*Info.m_nStripRows : 0;
+    size_t uChunk = nStrip;
+    long lSkip = uChunk==0 ? 2 : 0; // zlib header
+
+    int nBpp = (Info.m_bGrayscale || Info.m_bPalette) ? 1 : 3;
+    size_t uRowBytes = (size_t)Info.m_nWidth*nBpp;
+    std::vector<unsigned char> aLine(uRowBytes+1), aPrev(uRowBytes, 0), aIn(65536);
+    bool bStatus = false;
+
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if(inflateInit2(&zs, -MAX_WBITS)!=Z_OK)
+        return false;
+
+    long lChunkLeft = 0;
+    zs.next_out = &aLine[0];
+    zs.avail_out = (uInt)aLine.size();
+
+    while(y<nFirstRow+nRowCount)
+    {
+        // Feed compressed data from consecutive IDAT chunks
+        if(zs.avail_in==0)
+        {
+            while(lChunkLeft==0)
+            {
+                if(uChunk>=Info.m_aIDAT.size())
+                    goto cleanup;
+                if(fseek(f, Info.m_aIDAT[uChunk].m_lOffset+lSkip, SEEK_SET)!=0)
+                    goto cleanup;
+                lChunkLeft = Info.m_aIDAT[uChunk].m_lLength-lSkip;
+                lSkip = 0;
+                uChunk++;
+            }
+            size_t uRead = lChunkLeft<(long)aIn.size() ? (size_t)lChunkLeft : aIn.size();
+            if(fread(&aIn[0], 1, uRead, f)!=uRead)
+                goto cleanup;
+            lChunkLeft -= (long)uRead;
+            zs.next_in = &aIn[0];
+            zs.avail_in = (uInt)uRead;
+        }
+
+        int res = inflate(&zs, Z_SYNC_FLUSH);
+        if(res!=Z_OK && res!=Z_STREAM_END && res!=Z_BUF_ERROR)
+            goto cleanup;
+        if(res==Z_STREAM_END && zs.avail_out!=0)
+            goto cleanup;
+
+        if(zs.avail_out!=0)
+            continue;
+
+        // A row is ready; the first row of a strip was filtered without the previous one
+        if(Info.m_nStripRows>0 && y%Info.m_nStripRows==0)
+            memset(&aPrev[0], 0, uRowBytes);
+
+        unsigned char* pRow = &aLine[1];
+        size_t i;
+        switch(aLine[0])
+        {
+        case PNGENC_FILTER_NONE:
+            break;
+        case PNGENC_FILTER_SUB:
+            for(i=nBpp; i<uRowBytes; i++)
+                pRow[i] = (unsigned char)(pRow[i]+pRow[i-nBpp]);
+            break;
+        case PNGENC_FILTER_UP:
+            for(i=0; i<uRowBytes; i++)
+                pRow[i] = (unsigned char)(pRow[i]+aPrev[i]);
+            break;
+        case PNGENC_FILTER_AVERAGE:
+            for(i=0; i<uRowBytes; i++)
+                pRow[i] = (unsigned char)(pRow[i]+((i>=(size_t)nBpp ? pRow[i-nBpp] : 0)+aPrev[i])/2);
+            break;
+        case PNGENC_FILTER_PAETH:
+            for(i=0; i<uRowBytes; i++)
+            {
+                int a = i>=(size_t)nBpp ? pRow[i-nBpp] : 0;
+                int c = i>=(size_t)nBpp ? aPrev[i-nBpp] : 0;
+                pRow[i] = (unsigned char)(pRow[i]+paeth(a, aPrev[i], c));
+            }
+            break;
+        default:
+            goto cleanup;
+        }
+
+        if(y>=nFirstRow)
+        {
+            // Output BGR pixels
+            unsigned char* pDst = pBits+(size_t)(y-nFirstRow)*nStride;
+            int x;
+            for(x=0; x<Info.m_nWidth; x++, pDst+=3)
+            {
+                if(Info.m_bPalette)
+                {
+                    unsigned int uColor = pRow[x]<Info.m_nColors ? Info.m_aPalette[pRow[x]] : 0;
+                    pDst[0] = (unsigned char)uColor;
+                    pDst[1] = (unsigned char)(uColor>>8);
+                    pDst[2] = (unsigned char)(uColor>>16);
+                }
+                else if(Info.m_bGrayscale)
+                {
+                    pDst[0] = pDst[1] = pDst[2] = pRow[x];
+                }
+                else
+                {
+                    pDst[0] = pRow[x*3+2];
+                    pDst[1] = pRow[x*3+1];
+                    pDst[2] = pRow[x*3+0];
+                }
+            }
+        }
+
+        memcpy(&aPrev[0], pRow, uRowBytes);
+        y++;
+        zs.next_out = &aLine[0];
+        zs.avail_out = (uInt)aLine.size();
+    }
+
+    bStatus = true;
+
+cleanup:
+
+    inflateEnd(&zs);
+
+    return bStatus;
+}
+
+//-----------------------------------------------
+// JPEG
+//-----------------------------------------------
+
+// libjpeg error manager returning control to the caller instead of exiting the process.
+struct JpegErrorMgr
+{
+    struct jpeg_error_mgr m_pub; // libjpeg fields.
+    jmp_buf m_JmpBuf;            // Where to return on error.
+};
+
+static void jpeg_error_exit(j_common_ptr cinfo)
+{
+    JpegErrorMgr* pErr = (JpegErrorMgr*)cinfo->err;
+    longjmp(pErr->m_JmpBuf, 1);
+}
+
+bool image_write_jpeg(FILE* f, const unsigned char* pBits, int nWidth, int nHeight,
+                      int nStride, bool bGrayscale, int nQuality)
+{
+    if(f==NULL || pBits==NULL || nWidth<=0 || nHeight<=0)
+        return false;
+
+    struct jpeg_compress_struct cinfo;
+    JpegErrorMgr jerr;
+    std::vector<unsigned char> aRow((size_t)nWidth*3);
+
+    cinfo.err = jpeg_std_error(&jerr.m_pub);
+    jerr.m_pub.error_exit = jpeg_error_exit;
+    if(setjmp(jerr.m_JmpBuf))
+    {
+        jpeg_destroy_compress(&cinfo);
+        return false;
+    }
+
+    jpeg_create_compress(&cinfo);
+    jpeg_stdio_dest(&cinfo, f);
+
+    cinfo.image_width = nWidth;
+    cinfo.image_height = nHeight;
+    cinfo.input_components = bGrayscale?1:3;
+    cinfo.in_color_space = bGrayscale?JCS_GRAYSCALE:JCS_RGB;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, nQuality, TRUE /* limit to baseline-JPEG values */);
+
+    jpeg_start_compress(&cinfo, TRUE);
+
+    int y;
+    for(y=0; y<nHeight; y++)
+    {
+        convert_row(pBits+(size_t)y*nStride, &aRow[0], nWidth, bGrayscale);
+        JSAMPROW row_pointer[1];
+        row_pointer[0] = (JSAMPROW)&aRow[0];
+        jpeg_write_scanlines(&cinfo, row_pointer, 1);
+    }
+
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+
+    return true;
+}
+
+//-----------------------------------------------
+// BMP
+//-----------------------------------------------
+
+// Puts a little-endian value of nBytes bytes.
+static void put_le(unsigned char* p, unsigned long uValue, int nBytes)
+{
+    int i;
+    for(i=0; i<nBytes; i++)
+        p[i] = (unsigned char)(uValue>>(i*8));
+}
+
+bool image_write_bmp(FILE* f, const unsigned char* pBits, int nWidth, int nHeight,
+                     int nStride, bool bGrayscale)
+{
+    if(f==NULL || pBits==NULL || nWidth<=0 || nHeight<=0)
+        return false;
+
+    // Rows are padded to 4 bytes; grayscale image needs a palette
+    int nBpp = bGrayscale ? 1 : 3;
+    size_t uRowSize = ((size_t)nWidth*nBpp+3)&~(size_t)3;
+    unsigned long uPaletteSize = bGrayscale ? 256*4 : 0;
+    unsigned long uOffBits = 14+40+uPaletteSize;
+
+    // BITMAPFILEHEADER and BITMAPINFOHEADER
+    unsigned char aHeader[14+40];
+    memset(aHeader, 0, sizeof(aHeader));
+    aHeader[0] = 'B';
+    aHeader[1] = 'M';
+    put_le(aHeader+2, (unsigned long)(uOffBits+uRowSize*nHeight), 4);
+    put_le(aHeader+10, uOffBits, 4);
+    put_le(aHeader+14, 40, 4);
+    put_le(aHeader+18, nWidth, 4);
+    put_le(aHeader+22, nHeight, 4); // Bottom-up
+    put_le(aHeader+26, 1, 2);
+    put_le(aHeader+28, nBpp*8, 2);
+    put_le(aHeader+38, 0x0ec4, 4);
+    put_le(aHeader+42, 0x0ec4, 4);
+    if(fwrite(aHeader, 1, sizeof(aHeader), f)!=sizeof(aHeader))
+        return false;
+
+    if(bGrayscale)
+    {
+        unsigned char aPalette[256*4];
+        int i;
+        for(i=0; i<256; i++)
+        {
+            aPalette[i*4+0] = aPalette[i*4+1] = aPalette[i*4+2] = (unsigned char)i;
+            aPalette[i*4+3] = 0;
+        }
+        if(fwrite(aPalette, 1, sizeof(aPalette), f)!=sizeof(aPalette))
+            return false;
+    }
+
+    std::vector<unsigned char> aRow(uRowSize, 0);
+    int y;
+    for(y=nHeight-1; y>=0; y--)
+    {
+        const unsigned char* pSrc = pBits+(size_t)y*nStride;
+        if(bGrayscale)
+            convert_row(pSrc, &aRow[0], nWidth, true);
+        else
+            memcpy(&aRow[0], pSrc, (size_t)nWidth*3);
+
+        if(fwrite(&aRow[0], 1, uRowSize, f)!=uRowSize)
+            return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,101 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+// File: ImageEncoder.h
+// Description: Writes raw screenshot images to PNG, JPEG and BMP files.
+// This file doesn't depend on Windows headers, so it can be built and tested anywhere.
+
+#pragma once
+
+#include <stdio.h>
+#include <vector>
+
+// Rows of a PNG image are filtered and compressed in bands of at least this many rows,
+// several bands at once.
+#define PNG_MIN_BAND_ROWS 16
+
+// Count of rows per strip in fast lossless mode.
+#define PNG_FAST_STRIP_ROWS 64
+
+// PNG row filters. The first five are filter types defined by PNG specification.
+#define PNGENC_FILTER_NONE      0  // No filtering.
+#define PNGENC_FILTER_SUB       1  // Difference with the left pixel.
+#define PNGENC_FILTER_UP        2  // Difference with the pixel above.
+#define PNGENC_FILTER_AVERAGE   3  // Difference with the average of left and above pixels.
+#define PNGENC_FILTER_PAETH     4  // Difference with the Paeth predictor.
+#define PNGENC_FILTER_ADAPTIVE  5  // Try all filters for each row, keep the one giving the smallest bytes.
+#define PNGENC_FILTER_FAST      6  // Try None, Sub and Up for each row, keep the one giving the fewest byte runs.
+
+// Parameters of PNG encoding.
+struct PngEncodeParams
+{
+    // Constructor. Sets default parameters (best compression).
+    PngEncodeParams();
+
+    // Sets parameters for fast lossless encoding of UI screenshots, which mostly
+    // consist of flat areas: palette if possible, fast filter selection and
+    // compression level, strips.
+    void SetFastLossless();
+
+    bool m_bGrayscale;       // Write a grayscale image.
+    int m_nLevel;            // zlib compression level.
+    int m_nStrategy;         // zlib compression strategy.
+    int m_nFilter;           // Row filter, one of PNGENC_FILTER_* constants.
+    bool m_bPalette;         // Write a palette image if there are at most 256 colors.
+    int m_nStripRows;        // If not 0, image is split into strips of this many rows, each decodable by itself.
+    int m_nThreads;          // Count of threads (0 means one per CPU).
+};
+
+// Information about a PNG file needed to decode its rows.
+struct PngStripInfo
+{
+    // Location of an IDAT chunk data in the file.
+    struct Chunk
+    {
+        long m_lOffset;
+        long m_lLength;
+    };
+
+    int m_nWidth;                  // Image width.
+    int m_nHeight;                 // Image height.
+    int m_nStripRows;              // Rows per strip, or 0 if the image has no strips.
+    bool m_bGrayscale;             // Image is grayscale.
+    bool m_bPalette;               // Image has a palette.
+    int m_nColors;                 // Count of palette colors.
+    unsigned int m_aPalette[256];  // Palette colors as 0xRRGGBB.
+    std::vector<Chunk> m_aIDAT;    // IDAT chunks.
+};
+
+// All functions below take a top-down image of 24-bit pixels in BGR byte order
+// (as in Windows DIBs), with nStride bytes per row, and return false on error.
+// Grayscale images are made by averaging color channels.
+
+// Writes the image to a PNG file. Bands of rows are filtered and compressed
+// in parallel; compressed bands continue each other, making a single zlib stream.
+bool image_write_png(FILE* f, const unsigned char* pBits, int nWidth, int nHeight,
+                     int nStride, const PngEncodeParams& Params);
+
+// Reads the header and chunk layout of a PNG file. Only non-interlaced 8-bit
+// gray, RGB and palette images (as written by image_write_png) are supported.
+bool image_read_png_info(FILE* f, PngStripInfo& Info);
+
+// Decodes nRowCount rows starting from nFirstRow into a top-down BGR24 image.
+// If the file has strips, decoding starts at the strip containing nFirstRow,
+// so showing a part of a large image doesn't require decoding all of it.
+bool image_read_png_rows(FILE* f, const PngStripInfo& Info, int nFirstRow, int nRowCount,
+                         unsigned char* pBits, int nStride);
+
+// Writes the image to a JPEG file.
+bool image_write_jpeg(FILE* f, const unsigned char* pBits, int nWidth, int nHeight,
+                      int nStride, bool bGrayscale, int nQuality);
+
+// Writes the image to a BMP file.
+bool image_write_bmp(FILE* f, const unsigned char* pBits, int nWidth, int nHeight,
+                     int nStride, bool bGrayscale);
@@ -0,0 +1,405 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+// File: LangFile.cpp
+// Description: Language file parsed into memory once, for fast lookup of UI strings.
+
+#include "LangFile.h"
+#include <string.h>
+#include <wctype.h>
+
+// Size of the compiled file header: magic, version, table size, string count, pool length.
+#define LANG_FILE_HEADER_SIZE 20
+
+static void put_u32(std::vector<unsigned char>& aData, unsigned v)
+{
+    aData.push_back((unsigned char)v);
+    aData.push_back((unsigned char)(v>>8));
+    aData.push_back((unsigned char)(v>>16));
+    aData.push_back((unsigned char)(v>>24));
+}
+
+static unsigned get_u32(const unsigned char* p)
+{
+    return p[0] | (p[1]<<8) | (p[2]<<16) | ((unsigned)p[3]<<24);
+}
+
+static bool is_space(wchar_t c)
+{
+    return c==' ' || c=='\t' || c=='\r' || c=='\n';
+}
+
+// Decodes the file contents into UTF-16 code units.
+static void decode_text(const unsigned char* pData, size_t uSize, std::vector<wchar_t>& aText)
+{
+    size_t i = 0;
+
+    aText.clear();
+    aText.reserve(uSize);
+
+    if(uSize>=2 && ((pData[0]==0xFF && pData[1]==0xFE) || (pData[0]==0xFE && pData[1]==0xFF)))
+    {
+        // UTF-16 with byte order mark
+        int nHigh = pData[0]==0xFF ? 1 : 0;
+        for(i=2; i+1<uSize; i+=2)
+            aText.push_back((wchar_t)(pData[i+nHigh]<<8 | pData[i+1-nHigh]));
+        return;
+    }
+
+    if(uSize>=3 && pData[0]==0xEF && pData[1]==0xBB && pData[2]==0xBF)
+        i = 3;
+
+    // UTF-8; bytes that are not valid UTF-8 are taken as Latin-1 characters
+    while(i<uSize)
+    {
+        unsigned c = pData[i];
+        int nTrail = c>=0xF0 && c<0xF5 ? 3 : c>=0xE0 ? 2 : c>=0xC2 && c<0xE0 ? 1 : 0;
+        if(c>=0xF5)
+            nTrail = 0;
+
+        unsigned cp = nTrail==3 ? c&0x07 : nTrail==2 ? c&0x0F : c&0x1F;
+        int j;
+        for(j=1; j<=nTrail; j++)
+        {
+            if(i+j>=uSize || (pData[i+j]&0xC0)!=0x80)
+                break;
+            cp = cp<<6 | (pData[i+j]&0x3F);
+        }
+
+        if(nTrail==0 || j<=nTrail || (nTrail==2 && cp<0x800) || (nTrail==3 && (cp<0x10000 || cp>0x10FFFF)))
+        {
+            aText.push_back((wchar_t)c);
+            i++;
+            continue;
+        }
+
+        if(cp>=0x10000)
+        {
+            cp -= 0x10000;
+            aText.push_back((wchar_t)(0xD800+(cp>>10)));
+            aText.push_back((wchar_t)(0xDC00+(cp&0x3FF)));
+        }
+        else
+            aText.push_back((wchar_t)cp);
+
+        i += nTrail+1;
+    }
+}
+
+CLangFile::CLangFile()
+{
+    Clear();
+}
+
+void CLangFile::Clear()
+{
+    m_aPool.assign(1, 0);
+    m_aTable.clear();
+    m_uStringCount = 0;
+}
+
+bool CLangFile::IsLoaded() const
+{
+    return m_uStringCount!=0;
+}
+
+size_t CLangFile::GetStringCount() const
+{
+    return m_uStringCount;
+}
+
+bool CLangFile::Load(FILE* f)
+{
+    std::vector<unsigned char> aData;
+    unsigned char buf[4096];
+    size_t uRead;
+
+    Clear();
+
+    if(f==NULL)
+        return false;
+
+    while((uRead = fread(buf, 1, sizeof(buf), f))!=0)
+        aData.insert(aData.end(), buf, buf+uRead);
+
+    if(aData.empty())
+        return false;
+
+    if(aData.size()>=4 && memcmp(&aData[0], LANG_FILE_BINARY_MAGIC, 4)==0)
+        return LoadBinary(&aData[0], aData.size());
+
+    return Parse(&aData[0], aData.size());
+}
+
+unsigned CLangFile::AddToPool(const std::wstring& sStr, std::map<std::wstring, unsigned>& aInterned)
+{
+    if(sStr.empty())
+        return 0;
+
+    std::map<std::wstring, unsigned>::iterator it = aInterned.find(sStr);
+    if(it!=aInterned.end())
+        return it->second;
+
+    unsigned uOffset = (unsigned)m_aPool.size();
+    m_aPool.insert(m_aPool.end(), sStr.begin(), sStr.end());
+    m_aPool.push_back(0);
+    aInterned[sStr] = uOffset;
+    return uOffset;
+}
+
+bool CLangFile::Parse(const unsigned char* pData, size_t uSize)
+{
+    std::vector<wchar_t> aText;
+    std::vector<Entry> aEntries;
+    std::map<std::wstring, unsigned> aInterned;
+    unsigned uSection = 0;
+    bool bInSection = false;
+    size_t i = 0;
+
+    Clear();
+    decode_text(pData, uSize, aText);
+
+    while(i<aText.size())
+    {
+        // Find the line
+        size_t uEnd = i;
+        while(uEnd<aText.size() && aText[uEnd]!='\n')
+            uEnd++;
+        size_t uNext = uEnd+1;
+
+        while(i<uEnd && is_space(aText[i]))
+            i++;
+        while(uEnd>i && is_space(aText[uEnd-1]))
+            uEnd--;
+
+        if(i<uEnd && aText[i]=='[')
+        {
+            // Section name
+            size_t uClose = i+1;
+            while(uClose<uEnd && aText[uClose]!=']')
+                uClose++;
+            size_t uStart = i+1;
+            while(uStart<uClose && is_space(aText[uStart]))
+                uStart++;
+            while(uClose>uStart && is_space(aText[uClose-1]))
+                uClose--;
+            uSection = AddToPool(std::wstring(&aText[0]+uStart, uClose-uStart), aInterned);
+            bInSection = true;
+        }
+        else if(i<uEnd && aText[i]!=';' && bInSection)
+        {
+            // Key=Value
+            size_t uEq = i;
+            while(uEq<uEnd && aText[uEq]!='=')
+                uEq++;
+
+            size_t uNameEnd = uEq;
+            while(uNameEnd>i && is_space(aText[uNameEnd-1]))
+                uNameEnd--;
+
+            if(uEq<uEnd && uNameEnd>i)
+            {
+                size_t uValue = uEq+1;
+                while(uValue<uEnd && is_space(aText[uValue]))
+                    uValue++;
+                size_t uValueEnd = uEnd;
+                if(uValueEnd-uValue>=2 && aText[uValue]==aText[uValueEnd-1] &&
+                    (aText[uValue]=='"' || aText[uValue]=='\''))
+                {
+                    uValue++;
+                    uValueEnd--;
+                }
+
+                std::wstring sValue;
+                sValue.reserve(uValueEnd-uValue);
+                size_t j;
+                for(j=uValue; j<uValueEnd; j++)
+                {
+                    if(aText[j]=='\\' && j+1<uValueEnd && aText[j+1]=='n')
+                    {
+                        sValue += L'\n';
+                        j++;
+                    }
+                    else
+                        sValue += aText[j];
+                }
+
+                Entry e;
+                e.m_uSection = uSection;
+                e.m_uName = AddToPool(std::wstring(&aText[0]+i, uNameEnd-i), aInterned);
+                e.m_uValue = AddToPool(sValue, aInterned);
+                e.m_uHash = HashName(&m_aPool[e.m_uSection], &m_aPool[e.m_uName]);
+                aEntries.push_back(e);
+            }
+        }
+
+        i = uNext;
+    }
+
+    BuildTable(aEntries);
+
+    return m_uStringCount!=0;
+}
+
+unsigned CLangFile::HashName(const wchar_t* szSection, const wchar_t* szName)
+{
+    // FNV-1a of lower-case section name, a separator and lower-case key name
+    unsigned uHash = 2166136261u;
+    const wchar_t* p;
+    for(p=szSection; *p!=0; p++)
+        uHash = (uHash^(unsigned)towlower(*p))*16777619u;
+    uHash = (uHash^0xFFFF)*16777619u;
+    for(p=szName; *p!=0; p++)
+        uHash = (uHash^(unsigned)towlower(*p))*16777619u;
+    return uHash;
+}
+
+bool CLangFile::NamesEqual(const wchar_t* szName1, const wchar_t* szName2)
+{
+    while(*szName1!=0 && towlower(*szName1)==towlower(*szName2))
+    {
+        szName1++;
+        szName2++;
+    }
+    return *szName1==0 && *szName2==0;
+}
+
+size_t CLangFile::FindSlot(unsigned uHash, const wchar_t* szSection, const wchar_t* szName) const
+{
+    size_t uMask = m_aTable.size()-1;
+    size_t uSlot = uHash&uMask;
+
+    for(;;)
+    {
+        const Entry& e = m_aTable[uSlot];
+        if(e.m_uName==0)
+            return uSlot;
+        if(e.m_uHash==uHash && NamesEqual(&m_aPool[e.m_uName], szName) &&
+            NamesEqual(&m_aPool[e.m_uSection], szSection))
+            return uSlot;
+        uSlot = (uSlot+1)&uMask;
+    }
+}
+
+void CLangFile::BuildTable(const std::vector<Entry>& aEntries)
+{
+    // Keep at least half of slots free
+    size_t uSize = 16;
+    while(uSize<aEntries.size()*2)
+        uSize *= 2;
+
+    Entry Empty = {0, 0, 0, 0};
+    m_aTable.assign(uSize, Empty);
+    m_uStringCount = 0;
+
+    size_t i;
+    for(i=0; i<aEntries.size(); i++)
+    {
+        const Entry& e = aEntries[i];
+        size_t uSlot = FindSlot(e.m_uHash, &m_aPool[e.m_uSection], &m_aPool[e.m_uName]);
+
+        // The first of duplicate keys wins, as with GetPrivateProfileString
+        if(m_aTable[uSlot].m_uName==0)
+        {
+            m_aTable[uSlot] = e;
+            m_uStringCount++;
+        }
+    }
+}
+
+const wchar_t* CLangFile::GetString(const wchar_t* szSection, const wchar_t* szName) const
+{
+    if(m_uStringCount==0 || szSection==NULL || szName==NULL)
+        return NULL;
+
+    size_t uSlot = FindSlot(HashName(szSection, szName), szSection, szName);
+    if(m_aTable[uSlot].m_uName==0)
+        return NULL;
+
+    return &m_aPool[m_aTable[uSlot].m_uValue];
+}
+
+void CLangFile::SaveBinary(std::vector<unsigned char>& aData) const
+{
+    // Header, hash table entries and the pool of UTF-16 strings, all little-endian
+    aData.assign(LANG_FILE_BINARY_MAGIC, LANG_FILE_BINARY_MAGIC+4);
+    put_u32(aData, LANG_FILE_BINARY_VERSION);
+    put_u32(aData, (unsigned)m_aTable.size());
+    put_u32(aData, (unsigned)m_uStringCount);
+    put_u32(aData, (unsigned)m_aPool.size());
+
+    size_t i;
+    for(i=0; i<m_aTable.size(); i++)
+    {
+        put_u32(aData, m_aTable[i].m_uHash);
+        put_u32(aData, m_aTable[i].m_uSection);
+        put_u32(aData, m_aTable[i].m_uName);
+        put_u32(aData, m_aTable[i].m_uValue);
+    }
+
+    for(i=0; i<m_aPool.size(); i++)
+    {
+        aData.push_back((unsigned char)m_aPool[i]);
+        aData.push_back((unsigned char)(m_aPool[i]>>8));
+    }
+}
+
+bool CLangFile::LoadBinary(const unsigned char* pData, size_t uSize)
+{
+    Clear();
+
+    if(uSize<LANG_FILE_HEADER_SIZE || memcmp(pData, LANG_FILE_BINARY_MAGIC, 4)!=0 ||
+        get_u32(pData+4)!=LANG_FILE_BINARY_VERSION)
+        return false;
+
+    size_t uTableSize = get_u32(pData+8);
+    size_t uStringCount = get_u32(pData+12);
+    size_t uPoolLength = get_u32(pData+16);
+
+    // Table size must be a power of two with free slots, the pool must start
+    // with an empty string and end with zero
+    if(uTableSize<2 || (uTableSize&(uTableSize-1))!=0 || uStringCount>=uTableSize ||
+        uPoolLength==0 || uTableSize>(uSize-LANG_FILE_HEADER_SIZE)/16 ||
+        uPoolLength!=(uSize-LANG_FILE_HEADER_SIZE-uTableSize*16)/2)
+        return false;
+
+    const unsigned char* pPool = pData+LANG_FILE_HEADER_SIZE+uTableSize*16;
+    std::vector<wchar_t> aPool(uPoolLength);
+    size_t i;
+    for(i=0; i<uPoolLength; i++)
+        aPool[i] = (wchar_t)(pPool[2*i] | (pPool[2*i+1]<<8));
+    if(aPool[0]!=0 || aPool[uPoolLength-1]!=0)
+        return false;
+
+    std::vector<Entry> aTable(uTableSize);
+    size_t uCount = 0;
+    for(i=0; i<uTableSize; i++)
+    {
+        const unsigned char* p = pData+LANG_FILE_HEADER_SIZE+i*16;
+        aTable[i].m_uHash = get_u32(p);
+        aTable[i].m_uSection = get_u32(p+4);
+        aTable[i].m_uName = get_u32(p+8);
+        aTable[i].m_uValue = get_u32(p+12);
+        if(aTable[i].m_uSection>=uPoolLength || aTable[i].m_uName>=uPoolLength ||
+            aTable[i].m_uValue>=uPoolLength)
+            return false;
+        if(aTable[i].m_uName!=0)
+            uCount++;
+    }
+
+    if(uCount!=uStringCount)
+        return false;
+
+    m_aPool.swap(aPool);
+    m_aTable.swap(aTable);
+    m_uStringCount = uStringCount;
+
+    return m_uStringCount!=0;
+}
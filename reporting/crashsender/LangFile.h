@@ -0,0 +1,90 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+// File: LangFile.h
+// Description: Language file parsed into memory once, for fast lookup of UI strings.
+// This file doesn't depend on Windows headers, so it can be built and tested anywhere.
+
+#pragma once
+
+#include <stdio.h>
+#include <stddef.h>
+#include <vector>
+#include <map>
+#include <string>
+
+// Signature and version of the compiled (binary) form of a language file.
+#define LANG_FILE_BINARY_MAGIC   "CRLN"
+#define LANG_FILE_BINARY_VERSION 1
+
+// Strings of a language file (an INI file), looked up by section and key names.
+// Names are case-insensitive, as GetPrivateProfileString treats them. Values
+// are interned in one pool, and "\n" sequences in them are turned into newlines.
+class CLangFile
+{
+public:
+
+    // Constructor.
+    CLangFile();
+
+    // Loads an INI file (UTF-16 with BOM, UTF-8 or ANSI) or a compiled language file.
+    bool Load(FILE* f);
+
+    // Parses INI file contents.
+    bool Parse(const unsigned char* pData, size_t uSize);
+
+    // Loads the compiled form saved by SaveBinary().
+    bool LoadBinary(const unsigned char* pData, size_t uSize);
+
+    // Saves the parsed strings in a compiled form that loads without parsing.
+    void SaveBinary(std::vector<unsigned char>& aData) const;
+
+    // Removes all strings.
+    void Clear();
+
+    // Returns true if any strings are loaded.
+    bool IsLoaded() const;
+
+    // Returns the count of strings.
+    size_t GetStringCount() const;
+
+    // Returns the string value or NULL if there is no such string.
+    const wchar_t* GetString(const wchar_t* szSection, const wchar_t* szName) const;
+
+private:
+
+    // Hash table entry. Strings are referenced by their offsets in the pool.
+    struct Entry
+    {
+        unsigned m_uHash;    // Hash of section and key names.
+        unsigned m_uSection; // Section name.
+        unsigned m_uName;    // Key name.
+        unsigned m_uValue;   // Value.
+    };
+
+    // Returns hash of the section and key names, ignoring case.
+    static unsigned HashName(const wchar_t* szSection, const wchar_t* szName);
+
+    // Compares names ignoring case.
+    static bool NamesEqual(const wchar_t* szName1, const wchar_t* szName2);
+
+    // Adds a string to the pool, reusing the same string if it's already there.
+    unsigned AddToPool(const std::wstring& sStr, std::map<std::wstring, unsigned>& aInterned);
+
+    // Builds the hash table of the given entries.
+    void BuildTable(const std::vector<Entry>& aEntries);
+
+    // Finds the table slot of the given names (an empty one if there is no such string).
+    size_t FindSlot(unsigned uHash, const wchar_t* szSection, const wchar_t* szName) const;
+
+    std::vector<wchar_t> m_aPool;  // Zero-terminated strings. The first one is empty.
+    std::vector<Entry> m_aTable;   // Hash table (size is a power of two). Free slots have zero name.
+    size_t m_uStringCount;         // Count of strings in the table.
+};
@@ -0,0 +1,240 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+// File: LineIndexer.cpp
+// Description: Finds line starts in text files previewed by the file preview control
+// and keeps a sparse index of them.
+
+#include "LineIndexer.h"
+
+// SSE2 is always available on x64; on x86 only if the compiler is told so.
+#if defined(_M_X64) || defined(__x86_64__) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP>=2)
+#define LINEINDEXER_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Returns the count of set bits.
+static inline int bit_count(unsigned int v)
+{
+    v = v - ((v>>1)&0x55555555);
+    v = (v&0x33333333) + ((v>>2)&0x33333333);
+    return (int)((((v+(v>>4))&0x0F0F0F0F)*0x01010101)>>24);
+}
+
+// Returns the index of the lowest set bit (v must not be zero).
+static inline int lowest_bit(unsigned int v)
+{
+#if defined(_MSC_VER)
+    unsigned long i;
+    _BitScanForward(&i, v);
+    return (int)i;
+#else
+    return __builtin_ctz(v);
+#endif
+}
+
+CLineIndexer::CLineIndexer()
+{
+    Init(1, false, 4, 0);
+}
+
+void CLineIndexer::Init(int nCharSize, bool bBigEndian, int nTabLength, unsigned long long uStartOffset)
+{
+    m_nCharSize = nCharSize==2 ? 2 : 1;
+    m_bBigEndian = bBigEndian;
+    m_nTabLength = nTabLength;
+    m_uOffset = uStartOffset;
+    m_uLineStart = uStartOffset;
+    m_nTabs = 0;
+    m_nMaxLineWidth = 0;
+}
+
+int CLineIndexer::GetMaxLineWidth() const
+{
+    return m_nMaxLineWidth;
+}
+
+void CLineIndexer::AddLine(unsigned long long uEndOffset, std::vector<unsigned long long>& aLineOffsets)
+{
+    // Line width includes the newline, as the preview control always counted it
+    int nWidth = (int)((uEndOffset-m_uLineStart)/m_nCharSize);
+    if(m_nTabs!=0)
+        nWidth += m_nTabs*(m_nTabLength-1);
+    if(nWidth>m_nMaxLineWidth)
+        m_nMaxLineWidth = nWidth;
+
+    aLineOffsets.push_back(uEndOffset);
+    m_uLineStart = uEndOffset;
+    m_nTabs = 0;
+}
+
+void CLineIndexer::ScanBlock(const unsigned char* pData, size_t uSize, std::vector<unsigned long long>& aLineOffsets)
+{
+    size_t i = 0;
+
+#ifdef LINEINDEXER_SSE2
+
+    // Compare 16 bytes at once. Most chunks contain neither newlines nor tabs,
+    // so they cost a couple of instructions. For UTF-16 texts characters are
+    // compared as 16-bit words, and only the low bit of each word's mask is kept.
+    __m128i xmmNewline, xmmTab;
+    unsigned int uCharMask;
+    if(m_nCharSize==1)
+    {
+        xmmNewline = _mm_set1_epi8('\n');
+        xmmTab = _mm_set1_epi8('\t');
+        uCharMask = 0xFFFF;
+    }
+    else
+    {
+        // Words are loaded in little-endian order
+        xmmNewline = _mm_set1_epi16(m_bBigEndian ? 0x0A00 : 0x000A);
+        xmmTab = _mm_set1_epi16(m_bBigEndian ? 0x0900 : 0x0009);
+        uCharMask = 0x5555;
+    }
+
+    for(; i+16<=uSize; i+=16)
+    {
+        __m128i xmm = _mm_loadu_si128((const __m128i*)(pData+i));
+        __m128i xmmIsNewline, xmmIsTab;
+        if(m_nCharSize==1)
+        {
+            xmmIsNewline = _mm_cmpeq_epi8(xmm, xmmNewline);
+            xmmIsTab = _mm_cmpeq_epi8(xmm, xmmTab);
+        }
+        else
+        {
+            xmmIsNewline = _mm_cmpeq_epi16(xmm, xmmNewline);
+            xmmIsTab = _mm_cmpeq_epi16(xmm, xmmTab);
+        }
+
+        unsigned int uNewlines = (unsigned int)_mm_movemask_epi8(xmmIsNewline)&uCharMask;
+        unsigned int uTabs = (unsigned int)_mm_movemask_epi8(xmmIsTab)&uCharMask;
+        if((uNewlines|uTabs)==0)
+            continue;
+
+        while(uNewlines!=0)
+        {
+            int nBit = lowest_bit(uNewlines);
+            unsigned int uBefore = (1u<<nBit)-1;
+            m_nTabs += bit_count(uTabs&uBefore);
+            uTabs &= ~uBefore;
+            AddLine(m_uOffset+i+nBit+m_nCharSize, aLineOffsets);
+            uNewlines &= uNewlines-1;
+        }
+
+        m_nTabs += bit_count(uTabs);
+    }
+
+#endif
+
+    ScanScalar(pData+i, uSize-i, m_uOffset+i, aLineOffsets);
+    m_uOffset += uSize;
+}
+
+void CLineIndexer::ScanScalar(const unsigned char* pData, size_t uSize, unsigned long long uOffset,
+                              std::vector<unsigned long long>& aLineOffsets)
+{
+    size_t i;
+
+    if(m_nCharSize==1)
+    {
+        for(i=0; i<uSize; i++)
+        {
+            if(pData[i]=='\t')
+                m_nTabs++;
+            else if(pData[i]=='\n')
+                AddLine(uOffset+i+1, aLineOffsets);
+        }
+    }
+    else
+    {
+        // A trailing odd byte is not a character
+        int nHigh = m_bBigEndian ? 0 : 1;
+        for(i=0; i+1<uSize; i+=2)
+        {
+            if(pData[i+nHigh]!=0)
+                continue;
+            if(pData[i+1-nHigh]=='\t')
+                m_nTabs++;
+            else if(pData[i+1-nHigh]=='\n')
+                AddLine(uOffset+i+2, aLineOffsets);
+        }
+    }
+}
+
+CSparseLineIndex::CSparseLineIndex()
+{
+    Init(64, 65536);
+}
+
+void CSparseLineIndex::Init(unsigned long long uStride, size_t uMaxCheckpoints)
+{
+    m_aCheckpoints.clear();
+    m_uStride = uStride!=0 ? uStride : 1;
+    m_uLineCount = 0;
+    m_uMaxCheckpoints = uMaxCheckpoints>=2 ? uMaxCheckpoints : 2;
+}
+
+void CSparseLineIndex::AddLines(const std::vector<unsigned long long>& aLineOffsets)
+{
+    size_t i;
+    for(i=0; i<aLineOffsets.size(); i++)
+    {
+        if(m_uLineCount%m_uStride==0)
+        {
+            if(m_aCheckpoints.size()==m_uMaxCheckpoints)
+            {
+                // Keep checkpoints of lines 0, 2N, 4N, ...
+                size_t j;
+                for(j=0; 2*j<m_aCheckpoints.size(); j++)
+                    m_aCheckpoints[j] = m_aCheckpoints[2*j];
+                m_aCheckpoints.resize(j);
+                m_uStride *= 2;
+            }
+
+            if(m_uLineCount%m_uStride==0)
+                m_aCheckpoints.push_back(aLineOffsets[i]);
+        }
+
+        m_uLineCount++;
+    }
+}
+
+unsigned long long CSparseLineIndex::GetLineCount() const
+{
+    return m_uLineCount;
+}
+
+unsigned long long CSparseLineIndex::GetStride() const
+{
+    return m_uStride;
+}
+
+size_t CSparseLineIndex::GetCheckpointCount() const
+{
+    return m_aCheckpoints.size();
+}
+
+bool CSparseLineIndex::FindCheckpoint(unsigned long long uLine, unsigned long long& uCheckpointLine,
+                                      unsigned long long& uCheckpointOffset) const
+{
+    if(uLine>=m_uLineCount)
+        return false;
+
+    size_t uIndex = (size_t)(uLine/m_uStride);
+    uCheckpointLine = uIndex*m_uStride;
+    uCheckpointOffset = m_aCheckpoints[uIndex];
+    return true;
+}
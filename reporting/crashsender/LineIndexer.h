@@ -0,0 +1,97 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+// File: LineIndexer.h
+// Description: Finds line starts in text files previewed by the file preview control
+// and keeps a sparse index of them.
+// This file doesn't depend on Windows headers, so it can be built and tested anywhere.
+
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+
+// Finds offsets of text lines, scanning the text block by block.
+class CLineIndexer
+{
+public:
+
+    // Constructor.
+    CLineIndexer();
+
+    // Starts indexing a text. nCharSize is 1 for single-byte and UTF-8 texts or 2 for
+    // UTF-16 ones (bBigEndian tells the byte order). The first line starts at uStartOffset.
+    void Init(int nCharSize, bool bBigEndian, int nTabLength, unsigned long long uStartOffset);
+
+    // Scans the next block of the text. Blocks must follow each other without gaps,
+    // and sizes of all blocks but the last must be multiples of character size.
+    // Offsets of lines starting after newlines found in the block are appended to aLineOffsets.
+    void ScanBlock(const unsigned char* pData, size_t uSize, std::vector<unsigned long long>& aLineOffsets);
+
+    // Returns the width of the longest line found so far, in characters, with tabs expanded.
+    // The last line is counted only once it ends with a newline.
+    int GetMaxLineWidth() const;
+
+private:
+
+    // Scans characters one by one. uOffset is the offset of pData in the text.
+    void ScanScalar(const unsigned char* pData, size_t uSize, unsigned long long uOffset,
+                    std::vector<unsigned long long>& aLineOffsets);
+
+    // Registers a newline ending at uEndOffset (the offset of the next line start).
+    void AddLine(unsigned long long uEndOffset, std::vector<unsigned long long>& aLineOffsets);
+
+    int m_nCharSize;                 // Size of text character in bytes.
+    bool m_bBigEndian;               // Byte order of UTF-16 text.
+    int m_nTabLength;                // Width of the tab in characters.
+    unsigned long long m_uOffset;    // Offset of the next block.
+    unsigned long long m_uLineStart; // Offset of the current line.
+    int m_nTabs;                     // Count of tabs in the current line.
+    int m_nMaxLineWidth;             // Width of the longest line.
+};
+
+// Remembers offsets of every N-th line of a text. Offsets of other lines are found
+// by scanning the text from the nearest checkpoint. When there are too many checkpoints,
+// every other one is dropped and N is doubled, so memory use is bounded for any file size.
+class CSparseLineIndex
+{
+public:
+
+    // Constructor.
+    CSparseLineIndex();
+
+    // Clears the index. uStride is the initial count of lines per checkpoint
+    // and uMaxCheckpoints is the maximum count of checkpoints kept.
+    void Init(unsigned long long uStride, size_t uMaxCheckpoints);
+
+    // Appends line start offsets, in the order lines follow in the text.
+    void AddLines(const std::vector<unsigned long long>& aLineOffsets);
+
+    // Returns the count of lines added.
+    unsigned long long GetLineCount() const;
+
+    // Returns the count of lines per checkpoint.
+    unsigned long long GetStride() const;
+
+    // Returns the count of checkpoints.
+    size_t GetCheckpointCount() const;
+
+    // Finds the last checkpoint at or before the given line.
+    // Returns false if the line has not been added yet.
+    bool FindCheckpoint(unsigned long long uLine, unsigned long long& uCheckpointLine,
+                        unsigned long long& uCheckpointOffset) const;
+
+private:
+
+    std::vector<unsigned long long> m_aCheckpoints; // Offsets of lines 0, N, 2N, ...
+    unsigned long long m_uStride;    // Count of lines per checkpoint (N).
+    unsigned long long m_uLineCount; // Count of lines added.
+    size_t m_uMaxCheckpoints;        // Maximum count of checkpoints.
+};
@@ -0,0 +1,283 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+#include "RegKeyDump.h"
+#include "StringArena.h"
+#include <stdio.h>
+#include <string.h>
+
+// Initial sizes of name and value data buffers. Most keys fit in them,
+// so the buffers are rarely reallocated.
+#define REGDUMP_NAME_BUFFER_SIZE 512
+#define REGDUMP_DATA_BUFFER_SIZE (64*1024)
+
+CRegKeyDumper::CRegKeyDumper()
+{
+    m_pSource = NULL;
+    m_pXml = NULL;
+    m_nMaxDepth = 0;
+    m_uMaxSize = 0;
+    m_bTruncated = false;
+    m_aName.resize(REGDUMP_NAME_BUFFER_SIZE);
+    m_aData.resize(REGDUMP_DATA_BUFFER_SIZE);
+}
+
+void CRegKeyDumper::SetLimits(int nMaxDepth, unsigned long long uMaxSize)
+{
+    m_nMaxDepth = nMaxDepth;
+    m_uMaxSize = uMaxSize;
+}
+
+bool CRegKeyDumper::IsFull() const
+{
+    return m_uMaxSize!=0 && m_pXml->GetTotalSize()>=m_uMaxSize;
+}
+
+const char* CRegKeyDumper::ToUTF8(const wchar_t* pText, size_t cch)
+{
+    m_aUTF8.resize(cch*3+1);
+    size_t n = utf16_to_utf8(pText, cch, &m_aUTF8[0]);
+    m_aUTF8[n] = 0;
+    return &m_aUTF8[0];
+}
+
+const char* CRegKeyDumper::DataToUTF8(const unsigned char* pData, size_t cch)
+{
+    m_aText.resize(cch+1);
+    size_t i;
+    for(i=0; i<cch; i++)
+        m_aText[i] = (wchar_t)(pData[2*i] | (pData[2*i+1]<<8));
+    return ToUTF8(&m_aText[0], cch);
+}
+
+int CRegKeyDumper::Dump(CRegKeySource* pSource, const wchar_t* szPath, CXmlWriter& xml)
+{
+    std::vector<void*> aKeys;
+    std::wstring sName;
+    std::string sError;
+    const wchar_t* p = szPath;
+    size_t i;
+
+    m_pSource = pSource;
+    m_pXml = &xml;
+    m_bTruncated = false;
+
+    // Open keys along the path, writing an element for each of them
+    while(*p!=0)
+    {
+        const wchar_t* pEnd = wcschr(p, L'\\');
+        if(pEnd==NULL)
+            pEnd = p+wcslen(p);
+        sName.assign(p, pEnd-p);
+        p = *pEnd!=0 ? pEnd+1 : pEnd;
+
+        if(sName.empty())
+            continue;
+
+        void* hParent = aKeys.empty() ? NULL : aKeys.back();
+        void* hKey = m_pSource->OpenKey(hParent, sName.c_str(), sError);
+
+        if(hParent==NULL && hKey==NULL)
+            break; // Nothing is written for an unknown root
+
+        xml.StartElement("k");
+        xml.AddAttribute("name", ToUTF8(sName.c_str(), sName.length()));
+
+        if(hKey==NULL)
+        {
+            xml.AddAttribute("error", sError.c_str());
+            xml.EndElement();
+            break;
+        }
+
+        aKeys.push_back(hKey);
+
+        if(*p==0)
+            DumpKey(hKey, 0);
+    }
+
+    if(aKeys.empty())
+        return REGDUMP_INVALID_KEY;
+
+    for(i=aKeys.size(); i>0; i--)
+    {
+        m_pSource->CloseKey(aKeys[i-1]);
+        xml.EndElement();
+    }
+
+    return m_bTruncated ? REGDUMP_TRUNCATED : REGDUMP_OK;
+}
+
+void CRegKeyDumper::DumpKey(void* hKey, int nDepth)
+{
+    RegKeyInfo info;
+    std::string sError;
+    unsigned i;
+
+    memset(&info, 0, sizeof(info));
+    if(!m_pSource->QueryKey(hKey, info))
+        return;
+
+    // Grow buffers once for the whole key
+    unsigned uMaxName = info.m_uMaxSubKeyLen>info.m_uMaxValueNameLen ?
+        info.m_uMaxSubKeyLen : info.m_uMaxValueNameLen;
+    if(m_aName.size()<(size_t)uMaxName+1)
+        m_aName.resize((size_t)uMaxName+1);
+    if(m_aData.size()<info.m_uMaxValueLen)
+        m_aData.resize(info.m_uMaxValueLen);
+
+    if(info.m_uSubKeys!=0 && m_nMaxDepth!=0 && nDepth>=m_nMaxDepth)
+    {
+        // Subkeys are too deep
+        m_pXml->AddAttribute("truncated", "1");
+        m_bTruncated = true;
+    }
+    else
+    {
+        for(i=0; i<info.m_uSubKeys; i++)
+        {
+            if(IsFull())
+            {
+                m_bTruncated = true;
+                return;
+            }
+
+            unsigned uNameLen = (unsigned)m_aName.size();
+            if(!m_pSource->EnumKey(hKey, i, &m_aName[0], uNameLen))
+                continue;
+            m_aName[uNameLen] = 0;
+
+            m_pXml->StartElement("k");
+            m_pXml->AddAttribute("name", ToUTF8(&m_aName[0], uNameLen));
+
+            void* hSubKey = m_pSource->OpenKey(hKey, &m_aName[0], sError);
+            if(hSubKey!=NULL)
+            {
+                DumpKey(hSubKey, nDepth+1);
+                m_pSource->CloseKey(hSubKey);
+            }
+            else
+                m_pXml->AddAttribute("error", sError.c_str());
+
+            m_pXml->EndElement();
+        }
+    }
+
+    for(i=0; i<info.m_uValues; i++)
+    {
+        if(IsFull())
+        {
+            m_bTruncated = true;
+            return;
+        }
+
+        // A value that has grown since the key was queried is skipped
+        unsigned uNameLen = (unsigned)m_aName.size();
+        unsigned uDataSize = (unsigned)m_aData.size();
+        unsigned uType = 0;
+        if(!m_pSource->EnumValue(hKey, i, &m_aName[0], uNameLen, uType, &m_aData[0], uDataSize))
+            continue;
+
+        DumpValue(&m_aName[0], uNameLen, uType, &m_aData[0], uDataSize);
+    }
+}
+
+void CRegKeyDumper::DumpValue(const wchar_t* szName, unsigned uNameLen, unsigned uType,
+                              const unsigned char* pData, unsigned uDataSize)
+{
+    char szType[64];
+    const char* pszType = NULL;
+
+    m_pXml->StartElement("v");
+    m_pXml->AddAttribute("name", ToUTF8(szName, uNameLen));
+
+    switch(uType)
+    {
+    case REGDUMP_BINARY: pszType = "REG_BINARY"; break;
+    case REGDUMP_DWORD: pszType = "REG_DWORD"; break;
+    case REGDUMP_EXPAND_SZ: pszType = "REG_EXPAND_SZ"; break;
+    case REGDUMP_MULTI_SZ: pszType = "REG_MULTI_SZ"; break;
+    case REGDUMP_QWORD: pszType = "REG_QWORD"; break;
+    case REGDUMP_SZ: pszType = "REG_SZ"; break;
+    default:
+        sprintf(szType, "Unknown type (0x%08x)", uType);
+        pszType = szType;
+    }
+
+    m_pXml->AddAttribute("type", pszType);
+
+    if(uType==REGDUMP_BINARY)
+    {
+        // Bytes as hex numbers, each followed by a space
+        static const char szDigits[] = "0123456789ABCDEF";
+        m_aUTF8.resize((size_t)uDataSize*3+1);
+        unsigned j;
+        for(j=0; j<uDataSize; j++)
+        {
+            m_aUTF8[3*j] = szDigits[pData[j]>>4];
+            m_aUTF8[3*j+1] = szDigits[pData[j]&0xF];
+            m_aUTF8[3*j+2] = ' ';
+        }
+        m_aUTF8[(size_t)uDataSize*3] = 0;
+        m_pXml->AddAttribute("value", &m_aUTF8[0]);
+    }
+    else if(uType==REGDUMP_DWORD)
+    {
+        if(uDataSize>=4)
+        {
+            unsigned uValue = pData[0] | (pData[1]<<8) | (pData[2]<<16) | ((unsigned)pData[3]<<24);
+            char szValue[64];
+            sprintf(szValue, "0x%08x (%u)", uValue, uValue);
+            m_pXml->AddAttribute("value", szValue);
+        }
+    }
+    else if(uType==REGDUMP_SZ || uType==REGDUMP_EXPAND_SZ)
+    {
+        // The string ends at zero terminator or at the end of data
+        size_t cch = uDataSize/2;
+        size_t uLen;
+        for(uLen=0; uLen<cch; uLen++)
+        {
+            if(pData[2*uLen]==0 && pData[2*uLen+1]==0)
+                break;
+        }
+        m_pXml->AddAttribute("value", DataToUTF8(pData, uLen));
+    }
+    else if(uType==REGDUMP_MULTI_SZ)
+    {
+        // Strings separated by zeroes, the list ends with two zeroes
+        size_t cch = uDataSize/2;
+        size_t uStart = 0;
+        size_t uPos;
+        for(uPos=0; uPos<cch; uPos++)
+        {
+            if(pData[2*uPos]!=0 || pData[2*uPos+1]!=0)
+                continue;
+
+            m_pXml->StartElement("str");
+            m_pXml->AddAttribute("value", DataToUTF8(pData+2*uStart, uPos-uStart));
+            m_pXml->EndElement();
+            uStart = uPos+1;
+
+            if(uPos+1>=cch || (pData[2*uPos+2]==0 && pData[2*uPos+3]==0))
+                break;
+        }
+
+        if(uPos>=cch && uStart<cch)
+        {
+            // Last string has no zero terminator
+            m_pXml->StartElement("str");
+            m_pXml->AddAttribute("value", DataToUTF8(pData+2*uStart, cch-uStart));
+            m_pXml->EndElement();
+        }
+    }
+
+    m_pXml->EndElement();
+}
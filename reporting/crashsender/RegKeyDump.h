@@ -0,0 +1,118 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+// File: RegKeyDump.h
+// Description: Dumps a registry key tree to XML while enumerating it, without
+// building the document in memory.
+// This file doesn't depend on Windows headers, so it can be built and tested anywhere.
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include "XmlWriter.h"
+
+// Registry value types (the same as REG_xxx constants).
+#define REGDUMP_SZ          1
+#define REGDUMP_EXPAND_SZ   2
+#define REGDUMP_BINARY      3
+#define REGDUMP_DWORD       4
+#define REGDUMP_MULTI_SZ    7
+#define REGDUMP_QWORD       11
+
+// Results of CRegKeyDumper::Dump().
+#define REGDUMP_OK          0  // The whole key was dumped.
+#define REGDUMP_INVALID_KEY 1  // The root key is unknown, nothing was dumped.
+#define REGDUMP_TRUNCATED   2  // Some subkeys or values were skipped because of limits.
+
+// Information about a registry key.
+struct RegKeyInfo
+{
+    unsigned m_uSubKeys;        // Count of subkeys.
+    unsigned m_uMaxSubKeyLen;   // Length of the longest subkey name, in characters.
+    unsigned m_uValues;         // Count of values.
+    unsigned m_uMaxValueNameLen; // Length of the longest value name, in characters.
+    unsigned m_uMaxValueLen;    // Size of the longest value data, in bytes.
+};
+
+// Source of registry keys. CrashSender reads the Windows registry through it;
+// tests provide a synthetic key tree. Names are UTF-16 (as wchar_t), string values
+// are UTF-16LE data, as Windows registry functions return them.
+class CRegKeySource
+{
+public:
+
+    virtual ~CRegKeySource() {}
+
+    // Opens a subkey of the given key. With NULL parent, opens a root key by its
+    // name, like HKEY_CURRENT_USER. Returns NULL on failure and sets an error message (UTF-8).
+    virtual void* OpenKey(void* hParent, const wchar_t* szName, std::string& sError) = 0;
+
+    // Closes a key opened with OpenKey().
+    virtual void CloseKey(void* hKey) = 0;
+
+    // Retrieves counts and maximum sizes of subkeys and values.
+    virtual bool QueryKey(void* hKey, RegKeyInfo& info) = 0;
+
+    // Retrieves the name of a subkey. uNameLen is the buffer size on input and
+    // the name length (without zero terminator) on output.
+    virtual bool EnumKey(void* hKey, unsigned uIndex, wchar_t* szName, unsigned& uNameLen) = 0;
+
+    // Retrieves the name, type and data of a value. uNameLen and uDataSize are
+    // buffer sizes on input and actual sizes on output.
+    virtual bool EnumValue(void* hKey, unsigned uIndex, wchar_t* szName, unsigned& uNameLen,
+        unsigned& uType, unsigned char* pData, unsigned& uDataSize) = 0;
+};
+
+// Writes a registry key with all its subkeys and values as a chain of <k> elements
+// with <v> elements inside.
+class CRegKeyDumper
+{
+public:
+
+    // Constructor.
+    CRegKeyDumper();
+
+    // Limits how deep subkeys below the dumped key are enumerated and how many bytes
+    // of XML may be written. Zero means no limit.
+    void SetLimits(int nMaxDepth, unsigned long long uMaxSize);
+
+    // Dumps the key given by its full path, like HKEY_CURRENT_USER\Software\MyApp.
+    // Returns one of REGDUMP_xxx results.
+    int Dump(CRegKeySource* pSource, const wchar_t* szPath, CXmlWriter& xml);
+
+private:
+
+    // Writes subkeys and values of an open key.
+    void DumpKey(void* hKey, int nDepth);
+
+    // Writes a value.
+    void DumpValue(const wchar_t* szName, unsigned uNameLen, unsigned uType,
+        const unsigned char* pData, unsigned uDataSize);
+
+    // Converts UTF-16 text to UTF-8 in the conversion buffer.
+    const char* ToUTF8(const wchar_t* pText, size_t cch);
+
+    // Converts UTF-16LE data to UTF-8 in the conversion buffer.
+    const char* DataToUTF8(const unsigned char* pData, size_t cch);
+
+    // Returns true if the size limit is reached.
+    bool IsFull() const;
+
+    CRegKeySource* m_pSource;           // Source of keys.
+    CXmlWriter* m_pXml;                 // Output.
+    int m_nMaxDepth;                    // Depth limit (zero if none).
+    unsigned long long m_uMaxSize;      // Size limit (zero if none).
+    bool m_bTruncated;                  // Was anything skipped?
+    std::vector<wchar_t> m_aName;       // Subkey or value name buffer.
+    std::vector<unsigned char> m_aData; // Value data buffer.
+    std::vector<wchar_t> m_aText;       // UTF-16 text taken from value data.
+    std::vector<char> m_aUTF8;          // Conversion buffer.
+};
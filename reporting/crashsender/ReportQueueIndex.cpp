@@ -0,0 +1,366 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+#include "stdafx.h"
+#include "ReportQueueIndex.h"
+#include "CrashInfoReader.h"
+#include "strconv.h"
+
+// First line of the index file.
+#define QUEUE_INDEX_HEADER "CrashRptQueue\t1\n"
+
+// Count of fixed fields in a report record (not including file items).
+#define QUEUE_INDEX_REPORT_FIELDS 8
+
+// Count of fields describing a file item.
+#define QUEUE_INDEX_FILE_FIELDS 3
+
+// How many times to retry opening the index while another process compacts it.
+#define QUEUE_INDEX_OPEN_ATTEMPTS 20
+
+// Escapes tabs, line breaks and backslashes in a field value.
+static std::string EscapeField(LPCSTR szValue)
+{
+    std::string sResult;
+    if(szValue==NULL)
+        return sResult;
+
+    for(; *szValue!=0; szValue++)
+    {
+        switch(*szValue)
+        {
+        case '\\': sResult += "\\\\"; break;
+        case '\t': sResult += "\\t"; break;
+        case '\n': sResult += "\\n"; break;
+        case '\r': sResult += "\\r"; break;
+        default: sResult += *szValue;
+        }
+    }
+
+    return sResult;
+}
+
+// Reverts EscapeField().
+static std::string UnescapeField(const char* pBegin, const char* pEnd)
+{
+    std::string sResult;
+    sResult.reserve(pEnd-pBegin);
+
+    for(; pBegin<pEnd; pBegin++)
+    {
+        if(*pBegin=='\\' && pBegin+1<pEnd)
+        {
+            pBegin++;
+            switch(*pBegin)
+            {
+            case 't': sResult += '\t'; break;
+            case 'n': sResult += '\n'; break;
+            case 'r': sResult += '\r'; break;
+            default: sResult += *pBegin;
+            }
+        }
+        else
+        {
+            sResult += *pBegin;
+        }
+    }
+
+    return sResult;
+}
+
+CReportQueueIndex::CReportQueueIndex()
+{
+}
+
+void CReportQueueIndex::Init(LPCTSTR szUnsentCrashReportsFolder)
+{
+    m_sFolder = szUnsentCrashReportsFolder;
+    m_sFileName = m_sFolder + _T("\\~CrashRptQueue.idx");
+}
+
+BOOL CReportQueueIndex::Exists()
+{
+    if(m_sFileName.IsEmpty())
+        return FALSE;
+
+    DWORD dwAttrs = GetFileAttributes(m_sFileName);
+    return dwAttrs!=INVALID_FILE_ATTRIBUTES && (dwAttrs&FILE_ATTRIBUTE_DIRECTORY)==0;
+}
+
+HANDLE CReportQueueIndex::OpenIndexFile(DWORD dwAccess, DWORD dwShareMode, DWORD dwCreation)
+{
+    HANDLE hFile = INVALID_HANDLE_VALUE;
+
+    int i;
+    for(i=0; i<QUEUE_INDEX_OPEN_ATTEMPTS; i++)
+    {
+        hFile = CreateFile(m_sFileName, dwAccess, dwShareMode, NULL,
+            dwCreation, FILE_ATTRIBUTE_NORMAL, NULL);
+        if(hFile!=INVALID_HANDLE_VALUE || GetLastError()!=ERROR_SHARING_VIOLATION)
+            break;
+
+        // Another process holds the index exclusively; wait a little.
+        Sleep(50);
+    }
+
+    return hFile;
+}
+
+BOOL CReportQueueIndex::Create()
+{
+    if(m_sFileName.IsEmpty())
+        return FALSE;
+
+    HANDLE hFile = OpenIndexFile(GENERIC_WRITE, FILE_SHARE_READ, CREATE_ALWAYS);
+    if(hFile==INVALID_HANDLE_VALUE)
+        return FALSE;
+
+    DWORD dwLength = (DWORD)strlen(QUEUE_INDEX_HEADER);
+    DWORD dwWritten = 0;
+    BOOL bWrite = WriteFile(hFile, QUEUE_INDEX_HEADER, dwLength, &dwWritten, NULL);
+    CloseHandle(hFile);
+
+    return bWrite && dwWritten==dwLength;
+}
+
+BOOL CReportQueueIndex::AppendRecord(const std::string& sRecord)
+{
+    // Never create the index here: if there is no index, the next resend
+    // session rebuilds it from the report folders.
+    HANDLE hFile = OpenIndexFile(FILE_APPEND_DATA,
+        FILE_SHARE_READ|FILE_SHARE_WRITE, OPEN_EXISTING);
+    if(hFile==INVALID_HANDLE_VALUE)
+        return FALSE;
+
+    // A single write per record keeps concurrent appends from interleaving.
+    DWORD dwWritten = 0;
+    BOOL bWrite = WriteFile(hFile, sRecord.c_str(), (DWORD)sRecord.length(), &dwWritten, NULL);
+    CloseHandle(hFile);
+
+    return bWrite && dwWritten==sRecord.length();
+}
+
+std::string CReportQueueIndex::FormatReportRecord(CErrorReportInfo& eri)
+{
+    strconv_t strconv;
+
+    // Reports are stored relative to the UnsentCrashReports folder.
+    CString sDirName = eri.m_sErrorReportDirName;
+    int nPos = sDirName.ReverseFind(_T('\\'));
+    if(nPos>=0)
+        sDirName = sDirName.Mid(nPos+1);
+
+    char szSize[32];
+#if _MSC_VER<1400
+    sprintf(szSize, "%I64u", eri.GetTotalSize());
+#else
+    sprintf_s(szSize, 32, "%I64u", eri.GetTotalSize());
+#endif
+
+    std::string sRecord = "R";
+    sRecord += "\t" + EscapeField(strconv.t2utf8(eri.m_sCrashGUID));
+    sRecord += "\t" + EscapeField(strconv.t2utf8(sDirName));
+    sRecord += "\t";
+    sRecord += szSize;
+    sRecord += "\t" + EscapeField(strconv.t2utf8(eri.m_sAppName));
+    sRecord += "\t" + EscapeField(strconv.t2utf8(eri.m_sAppVersion));
+    sRecord += "\t" + EscapeField(strconv.t2utf8(eri.m_sImageName));
+    sRecord += "\t" + EscapeField(strconv.t2utf8(eri.m_sSystemTimeUTC));
+
+    std::map<CString, ERIFileItem>::iterator it;
+    for(it=eri.m_FileItems.begin(); it!=eri.m_FileItems.end(); it++)
+    {
+        if(!it->second.m_sErrorStatus.IsEmpty())
+            continue; // The file wasn't collected
+
+        sRecord += "\t" + EscapeField(strconv.t2utf8(it->second.m_sDestFile));
+        sRecord += "\t" + EscapeField(strconv.t2utf8(it->second.m_sDesc));
+        sRecord += it->second.m_bAllowDelete ? "\t1" : "\t0";
+    }
+
+    sRecord += "\n";
+    return sRecord;
+}
+
+BOOL CReportQueueIndex::ParseReportRecord(const std::vector<std::string>& aFields, CErrorReportInfo& eri)
+{
+    strconv_t strconv;
+
+    if(aFields.size()<QUEUE_INDEX_REPORT_FIELDS ||
+        (aFields.size()-QUEUE_INDEX_REPORT_FIELDS)%QUEUE_INDEX_FILE_FIELDS!=0)
+        return FALSE;
+
+    eri.m_sCrashGUID = strconv.utf82t(aFields[1].c_str());
+    eri.m_sErrorReportDirName = m_sFolder + _T("\\") + strconv.utf82t(aFields[2].c_str());
+    eri.m_uTotalSize = _strtoui64(aFields[3].c_str(), NULL, 10);
+    eri.m_sAppName = strconv.utf82t(aFields[4].c_str());
+    eri.m_sAppVersion = strconv.utf82t(aFields[5].c_str());
+    eri.m_sImageName = strconv.utf82t(aFields[6].c_str());
+    eri.m_sSystemTimeUTC = strconv.utf82t(aFields[7].c_str());
+
+    size_t i;
+    for(i=QUEUE_INDEX_REPORT_FIELDS; i<aFields.size(); i+=QUEUE_INDEX_FILE_FIELDS)
+    {
+        ERIFileItem item;
+        item.m_sDestFile = strconv.utf82t(aFields[i].c_str());
+        item.m_sSrcFile = eri.m_sErrorReportDirName + _T("\\") + item.m_sDestFile;
+        item.m_sDesc = strconv.utf82t(aFields[i+1].c_str());
+        item.m_bMakeCopy = FALSE;
+        item.m_bAllowDelete = aFields[i+2]=="1";
+
+        // Kaneva - Bug Fix - Use Source File Full Path
+        eri.m_FileItems[item.m_sSrcFile] = item;
+    }
+
+    // The size stored in the index is reused instead of opening every file again
+    eri.m_bTotalSizeKnown = TRUE;
+
+    return TRUE;
+}
+
+BOOL CReportQueueIndex::Load(std::vector<CErrorReportInfo>& aReports)
+{
+    if(m_sFileName.IsEmpty())
+        return FALSE;
+
+    // Hold the index exclusively, so it can be compacted in place.
+    HANDLE hFile = OpenIndexFile(GENERIC_READ|GENERIC_WRITE, 0, OPEN_EXISTING);
+    if(hFile==INVALID_HANDLE_VALUE)
+        return FALSE;
+
+    LARGE_INTEGER lFileSize;
+    if(!GetFileSizeEx(hFile, &lFileSize) || lFileSize.HighPart!=0)
+    {
+        CloseHandle(hFile);
+        return FALSE;
+    }
+
+    // Read the whole journal with a single read.
+    std::vector<char> aData(lFileSize.LowPart+1, 0);
+    DWORD dwRead = 0;
+    if(!ReadFile(hFile, &aData[0], lFileSize.LowPart, &dwRead, NULL) || dwRead!=lFileSize.LowPart)
+    {
+        CloseHandle(hFile);
+        return FALSE;
+    }
+
+    size_t uHeaderLen = strlen(QUEUE_INDEX_HEADER);
+    if(dwRead<uHeaderLen || memcmp(&aData[0], QUEUE_INDEX_HEADER, uHeaderLen)!=0)
+    {
+        CloseHandle(hFile);
+        return FALSE; // Unknown format
+    }
+
+    std::vector<CErrorReportInfo> aRecords; // Latest record of each report
+    std::vector<bool> aAlive;               // Whether the report is still queued
+    std::map<std::string, size_t> aIndexByGUID;
+    int nRecords = 0;
+
+    const char* p = &aData[0] + uHeaderLen;
+    const char* pEnd = &aData[0] + dwRead;
+    while(p<pEnd)
+    {
+        const char* pEOL = (const char*)memchr(p, '\n', pEnd-p);
+        if(pEOL==NULL)
+            break; // Incomplete record (the writer died); ignore it.
+
+        // Split the line into fields.
+        std::vector<std::string> aFields;
+        const char* pField = p;
+        const char* q;
+        for(q=p; q<=pEOL; q++)
+        {
+            if(q==pEOL || *q=='\t')
+            {
+                aFields.push_back(UnescapeField(pField, q));
+                pField = q+1;
+            }
+        }
+
+        p = pEOL+1;
+        nRecords++;
+
+        if(aFields.size()<2)
+            continue;
+
+        const std::string& sGUID = aFields[1];
+        std::map<std::string, size_t>::iterator it = aIndexByGUID.find(sGUID);
+
+        if(aFields[0]=="R")
+        {
+            CErrorReportInfo eri;
+            if(!ParseReportRecord(aFields, eri))
+                continue;
+
+            if(it==aIndexByGUID.end())
+            {
+                aIndexByGUID[sGUID] = aRecords.size();
+                aRecords.push_back(eri);
+                aAlive.push_back(true);
+            }
+            else
+            {
+                aRecords[it->second] = eri;
+                aAlive[it->second] = true;
+            }
+        }
+        else if(aFields[0]=="D")
+        {
+            if(it!=aIndexByGUID.end())
+                aAlive[it->second] = false;
+        }
+    }
+
+    size_t i;
+    std::string sCompacted = QUEUE_INDEX_HEADER;
+    int nAlive = 0;
+    for(i=0; i<aRecords.size(); i++)
+    {
+        if(!aAlive[i])
+            continue;
+
+        aReports.push_back(aRecords[i]);
+        nAlive++;
+
+        sCompacted += FormatReportRecord(aRecords[i]);
+    }
+
+    // Rewrite the journal when most of it is superseded records.
+    if(nRecords>2*nAlive+16)
+    {
+        LARGE_INTEGER lPos;
+        lPos.QuadPart = 0;
+        DWORD dwWritten = 0;
+        if(SetFilePointerEx(hFile, lPos, NULL, FILE_BEGIN) &&
+            WriteFile(hFile, sCompacted.c_str(), (DWORD)sCompacted.length(), &dwWritten, NULL))
+        {
+            SetEndOfFile(hFile);
+        }
+    }
+
+    CloseHandle(hFile);
+    return TRUE;
+}
+
+BOOL CReportQueueIndex::AddReport(CErrorReportInfo& eri)
+{
+    return AppendRecord(FormatReportRecord(eri));
+}
+
+BOOL CReportQueueIndex::RemoveReport(LPCTSTR szCrashGUID)
+{
+    strconv_t strconv;
+
+    std::string sRecord = "D\t";
+    sRecord += EscapeField(strconv.t2utf8(szCrashGUID));
+    sRecord += "\n";
+
+    return AppendRecord(sRecord);
+}
@@ -0,0 +1,68 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+// File: ReportQueueIndex.h
+// Description: Append-only index of error reports queued for later delivery.
+
+#pragma once
+#include "stdafx.h"
+
+class CErrorReportInfo;
+
+// The queue index is a UTF-8 text journal stored in the UnsentCrashReports folder.
+// Each line is a tab-separated record. A report record holds everything the
+// resend dialog and the sender need to know about a queued report (GUID, folder,
+// summary fields, size and file list); a later record for the same GUID supersedes
+// earlier ones. A removal record drops the report from the queue. Records are
+// appended with a single write each, so several CrashSender processes may update
+// the index concurrently. The journal is compacted when it mostly consists of
+// superseded records.
+class CReportQueueIndex
+{
+public:
+
+    // Constructor.
+    CReportQueueIndex();
+
+    // Sets the folder the index is stored in.
+    void Init(LPCTSTR szUnsentCrashReportsFolder);
+
+    // Returns TRUE if the index file exists.
+    BOOL Exists();
+
+    // Creates an empty index file. Reports found afterwards must be added with AddReport().
+    BOOL Create();
+
+    // Reads the list of queued reports. Returns FALSE if the index doesn't exist or is damaged.
+    BOOL Load(std::vector<CErrorReportInfo>& aReports);
+
+    // Appends a report record (adds the report or replaces its previous record).
+    BOOL AddReport(CErrorReportInfo& eri);
+
+    // Appends a removal record.
+    BOOL RemoveReport(LPCTSTR szCrashGUID);
+
+private:
+
+    // Opens the index file for the specified access, retrying while it is being compacted.
+    HANDLE OpenIndexFile(DWORD dwAccess, DWORD dwShareMode, DWORD dwCreation);
+
+    // Appends one record.
+    BOOL AppendRecord(const std::string& sRecord);
+
+    // Formats the report record.
+    std::string FormatReportRecord(CErrorReportInfo& eri);
+
+    // Parses the report record.
+    BOOL ParseReportRecord(const std::vector<std::string>& aFields, CErrorReportInfo& eri);
+
+    CString m_sFolder;   // UnsentCrashReports folder.
+    CString m_sFileName; // Path to the index file.
+};
@@ -506,7 +506,7 @@ LRESULT CResendDlg::OnSendNow(WORD /*wNotifyCode*/, WORD /*wID*/, HWND /*hWndCtl
                 if(eri->GetDeliveryStatus() == PENDING)
                 {
                     m_listReports.SetItemText(i, 2,
-                        Utility::GetINIString(pSender->GetCrashInfo()->m_sLangFileName, _T("ResendDlg"), _T("StatusPending")));
+                        pSender->GetLangStr(_T("ResendDlg"), _T("StatusPending")));
                 }
             }
             else
@@ -832,7 +832,7 @@ void CResendDlg::DoProgressTimer()
 
             // Determine window mirroring flags (language specific).
             DWORD dwFlags = 0;
-            CString sRTL = Utility::GetINIString(pSender->GetCrashInfo()->m_sLangFileName, _T("Settings"), _T("RTLReading"));
+            CString sRTL = pSender->GetLangStr(_T("Settings"), _T("RTLReading"));
             if(sRTL.CompareNoCase(_T("1"))==0)
                 dwFlags = MB_RTLREADING;
 
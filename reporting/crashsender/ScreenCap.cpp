@@ -11,18 +11,17 @@ be found in the Authors.txt file in the root of the source tree.
 #include "stdafx.h"
 #include "ScreenCap.h"
 #include "Utility.h"
-#include "zlib.h"
-
-// Disable warning C4611: interaction between '_setjmp' and C++ object destruction is non-portable
-#pragma warning(disable:4611)
+#include "ImageEncoder.h"
+#include "math.h"
 
 CScreenCapture::CScreenCapture()
 {
     // Init internal variables
-    m_fp = NULL;
-    m_png_ptr = NULL;
-    m_info_ptr = NULL;
     m_nIdStartFrom = 0;
+    m_nPngThreads = 1;
+    m_hFrameDC = NULL;
+    m_FrameSize.cx = 0;
+    m_FrameSize.cy = 0;
 }
 
 CScreenCapture::~CScreenCapture()
@@ -102,6 +101,28 @@ BOOL CScreenCapture::TakeDesktopScreenshot(
     return TRUE;
 }
 
+BOOL CScreenCapture::CaptureDesktopFrame(
+            HDC hFrameDC,
+            SIZE FrameSize,
+            ScreenshotInfo& ssi,
+            SCREENSHOT_TYPE type,
+            DWORD dwProcessId)
+{
+    // This method takes the desktop screenshot the same way as TakeDesktopScreenshot() does,
+    // but each monitor image is scaled down into its place in the given DC
+    // (a video frame) rather than written to an image file.
+
+    m_hFrameDC = hFrameDC;
+    m_FrameSize = FrameSize;
+
+    BOOL bTakeScreenshot = TakeDesktopScreenshot(NULL, ssi, type, dwProcessId,
+        SCREENSHOT_FORMAT_BMP, 0, FALSE, 0);
+
+    m_hFrameDC = NULL;
+
+    return bTakeScreenshot;
+}
+
 BOOL CScreenCapture::CaptureScreenRect(
                                        std::vector<CRect> arcCapture,
                                        CString sSaveDirName,
@@ -128,9 +149,38 @@ BOOL CScreenCapture::CaptureScreenRect(
     m_CursorInfo.cbSize = sizeof(CURSORINFO);
     GetCursorInfo(&m_CursorInfo);
 
+    // Monitor images are written to files by a worker thread per monitor.
+    // Spread the rest of CPUs among PNG band compressors.
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    int nMonitors = GetSystemMetrics(SM_CMONITORS);
+    m_nPngThreads = nMonitors>0 ? (int)si.dwNumberOfProcessors/nMonitors : 1;
+    if(m_nPngThreads<1)
+        m_nPngThreads = 1;
+
     // Perform actual capture task inside of EnumMonitorsProc
     EnumDisplayMonitors(NULL, NULL, EnumMonitorsProc, (LPARAM)this);
 
+    // Wait until all monitor images are written
+    size_t i;
+    for(i=0; i<m_aJobs.size(); i++)
+    {
+        MonitorImageJob* pJob = m_aJobs[i];
+
+        if(pJob->m_hThread!=NULL)
+        {
+            WaitForSingleObject(pJob->m_hThread, INFINITE);
+            CloseHandle(pJob->m_hThread);
+        }
+
+        if(pJob->m_bResult)
+            m_monitor_list.push_back(pJob->m_MonitorInfo);
+
+        DeleteObject(pJob->m_hBitmap);
+        delete pJob;
+    }
+    m_aJobs.clear();
+
     // Return
     monitor_list = m_monitor_list;
     return TRUE;
@@ -145,13 +195,14 @@ BOOL CALLBACK CScreenCapture::EnumMonitorsProc(HMONITOR hMonitor, HDC /*hdcMonit
     HDC hDC = NULL;
     HDC hCompatDC = NULL;
     HBITMAP hBitmap = NULL;
+    HBITMAP hOldBitmap = NULL;
+    LPBYTE pBits = NULL;
     BITMAPINFO bmi;
     int nWidth = 0;
     int nHeight = 0;
-    int nRowWidth = 0;
-    LPBYTE pRowBits = NULL;
     CString sFileName;
     MonitorInfo monitor_info;
+    MonitorImageJob* pJob = NULL;
 
     // Get monitor rect size
     nWidth = lprcMonitor->right - lprcMonitor->left;
@@ -170,11 +221,21 @@ BOOL CALLBACK CScreenCapture::EnumMonitorsProc(HMONITOR hMonitor, HDC /*hdcMonit
     if(hCompatDC==NULL)
         goto cleanup;
 
-    hBitmap = CreateCompatibleBitmap(hDC, nWidth, nHeight);
-    if(hBitmap==NULL)
+    // Capture into a top-down 24-bit DIB section, so the whole image
+    // is available in memory at once, without fetching it row by row
+    memset(&bmi.bmiHeader, 0, sizeof(BITMAPINFOHEADER));
+    bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+    bmi.bmiHeader.biWidth = nWidth;
+    bmi.bmiHeader.biHeight = -nHeight;
+    bmi.bmiHeader.biBitCount = 24;
+    bmi.bmiHeader.biPlanes = 1;
+    bmi.bmiHeader.biCompression = BI_RGB;
+
+    hBitmap = CreateDIBSection(hDC, &bmi, DIB_RGB_COLORS, (void**)&pBits, NULL, 0);
+    if(hBitmap==NULL || pBits==NULL)
         goto cleanup;
 
-    SelectObject(hCompatDC, hBitmap);
+    hOldBitmap = (HBITMAP)SelectObject(hCompatDC, hBitmap);
 
     int i;
     for(i=0; i<(int)psc->m_arcCapture.size(); i++)
@@ -205,118 +266,79 @@ BOOL CALLBACK CScreenCapture::EnumMonitorsProc(HMONITOR hMonitor, HDC /*hdcMonit
         }
     }
 
-    /* Write screenshot bitmap to an image file. */
-
-    if(psc->m_fmt==SCREENSHOT_FORMAT_PNG)
-    {
-        // Init PNG writer
-        sFileName.Format(_T("%s\\screenshot%d.png"), (LPCTSTR) psc->m_sSaveDirName, psc->m_nIdStartFrom++);
-        BOOL bInit = psc->PngInit(nWidth, nHeight, psc->m_bGrayscale, (LPCTSTR) sFileName);
-        if(!bInit)
-            goto cleanup;
-    }
-    else if(psc->m_fmt==SCREENSHOT_FORMAT_JPG)
+    if(psc->m_hFrameDC!=NULL)
     {
-        // Init JPG writer
-        sFileName.Format(_T("%s\\screenshot%d.jpg"), (LPCTSTR) psc->m_sSaveDirName, psc->m_nIdStartFrom++);
-        BOOL bInit = psc->JpegInit(nWidth, nHeight, psc->m_bGrayscale, psc->m_nJpegQuality, (LPCTSTR) sFileName);
-        if(!bInit)
-            goto cleanup;
-    }
-    else if(psc->m_fmt==SCREENSHOT_FORMAT_BMP)
-    {
-        // Init BMP header
-        sFileName.Format(_T("%s\\screenshot%d.bmp"), (LPCTSTR) psc->m_sSaveDirName, psc->m_nIdStartFrom++);
-        BOOL bInit = psc->BmpInit(nWidth, nHeight, psc->m_bGrayscale, (LPCTSTR) sFileName);
-        if(!bInit)
+        // Scale the monitor image into its place in the frame
+        CRect rcScreen;
+        psc->GetScreenRect(&rcScreen);
+
+        float x_ratio = (float)psc->m_FrameSize.cx/(float)rcScreen.Width();
+        float y_ratio = (float)psc->m_FrameSize.cy/(float)rcScreen.Height();
+        int xDest = (int)ceil((lprcMonitor->left - rcScreen.left)*x_ratio-0.5);
+        int yDest = (int)ceil((lprcMonitor->top - rcScreen.top)*y_ratio-0.5);
+        int wDest = (int)ceil(nWidth*x_ratio-0.5);
+        int hDest = (int)ceil(nHeight*y_ratio-0.5);
+
+        int nOldMode = SetStretchBltMode(psc->m_hFrameDC, HALFTONE);
+        BOOL bStretchBlt = StretchBlt(psc->m_hFrameDC, xDest, yDest, wDest, hDest,
+            hCompatDC, 0, 0, nWidth, nHeight, SRCCOPY);
+        SetStretchBltMode(psc->m_hFrameDC, nOldMode);
+        if(!bStretchBlt)
             goto cleanup;
-    }
 
-    // We will get bitmap bits row by row
-    nRowWidth = nWidth*3;
-    nRowWidth+=nRowWidth%4;
-    pRowBits = new BYTE[nRowWidth];
-    if(pRowBits==NULL)
+        monitor_info.m_rcMonitor = mi.rcMonitor;
+        monitor_info.m_sDeviceID = mi.szDevice;
+        psc->m_monitor_list.push_back(monitor_info);
         goto cleanup;
-
-    memset(&bmi.bmiHeader, 0, sizeof(BITMAPINFOHEADER));
-    bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
-    bmi.bmiHeader.biWidth = nWidth;
-    bmi.bmiHeader.biHeight = -nHeight;
-    bmi.bmiHeader.biBitCount = 24;
-    bmi.bmiHeader.biPlanes = 1;
-
-    //int i;
-    if(psc->m_fmt==SCREENSHOT_FORMAT_BMP)
-        i=0;
-    else
-        i=nHeight-1;
-
-    for(;;)
-    {
-        int nFetched = GetDIBits(hCompatDC, hBitmap, i, 1, pRowBits, &bmi, DIB_RGB_COLORS);
-        if(nFetched!=1)
-            break;
-
-        if(psc->m_fmt==SCREENSHOT_FORMAT_PNG)
-        {
-            BOOL bWrite = psc->PngWriteRow(pRowBits, nRowWidth, psc->m_bGrayscale);
-            if(!bWrite)
-                goto cleanup;
-        }
-        else if(psc->m_fmt==SCREENSHOT_FORMAT_JPG)
-        {
-            BOOL bWrite = psc->JpegWriteRow(pRowBits, nRowWidth, psc->m_bGrayscale);
-            if(!bWrite)
-                goto cleanup;
-        }
-        else if(psc->m_fmt==SCREENSHOT_FORMAT_BMP)
-        {
-            BOOL bWrite = psc->BmpWriteRow(pRowBits, nRowWidth, psc->m_bGrayscale);
-            if(!bWrite)
-                goto cleanup;
-        }
-
-        if(psc->m_fmt==SCREENSHOT_FORMAT_BMP)
-        {
-            i++;
-            if(i==nHeight)
-                break;
-        }
-        else
-        {
-            i--;
-            if(i<0)
-                break;
-        }
     }
 
-    if(psc->m_fmt==SCREENSHOT_FORMAT_PNG)
-    {
-        psc->PngFinalize();
-    }
+    /* Write screenshot bitmap to an image file. */
+
+    if(psc->m_fmt==SCREENSHOT_FORMAT_PNG || psc->m_fmt==SCREENSHOT_FORMAT_PNG_FAST)
+        sFileName.Format(_T("%s\\screenshot%d.png"), (LPCTSTR) psc->m_sSaveDirName, psc->m_nIdStartFrom++);
     else if(psc->m_fmt==SCREENSHOT_FORMAT_JPG)
-    {
-        psc->JpegFinalize();
-    }
+        sFileName.Format(_T("%s\\screenshot%d.jpg"), (LPCTSTR) psc->m_sSaveDirName, psc->m_nIdStartFrom++);
     else if(psc->m_fmt==SCREENSHOT_FORMAT_BMP)
-    {
-        psc->BmpFinalize();
-    }
+        sFileName.Format(_T("%s\\screenshot%d.bmp"), (LPCTSTR) psc->m_sSaveDirName, psc->m_nIdStartFrom++);
     else
     {
         ATLASSERT(0); // Invalid format
         goto cleanup;
     }
 
-    monitor_info.m_rcMonitor = mi.rcMonitor;
-    monitor_info.m_sDeviceID = mi.szDevice;
-    monitor_info.m_sFileName = sFileName;
-    psc->m_monitor_list.push_back(monitor_info);
+    // Make sure GDI has finished drawing into the bitmap
+    GdiFlush();
+
+    // The job owns the bitmap from now on
+    pJob = new MonitorImageJob;
+    pJob->m_pOwner = psc;
+    pJob->m_hBitmap = hBitmap;
+    pJob->m_pBits = pBits;
+    pJob->m_nWidth = nWidth;
+    pJob->m_nHeight = nHeight;
+    pJob->m_nStride = (nWidth*3+3)&~3;
+    pJob->m_MonitorInfo.m_rcMonitor = mi.rcMonitor;
+    pJob->m_MonitorInfo.m_sDeviceID = mi.szDevice;
+    pJob->m_MonitorInfo.m_sFileName = sFileName;
+    pJob->m_hThread = NULL;
+    pJob->m_bResult = FALSE;
+    SelectObject(hCompatDC, hOldBitmap);
+    hOldBitmap = NULL;
+    hBitmap = NULL;
+    psc->m_aJobs.push_back(pJob);
+
+    // Write the image while the next monitor is being captured.
+    // If the thread can't be started, write the image now.
+    pJob->m_hThread = CreateThread(NULL, 0, ImageWriterThread, pJob, 0, NULL);
+    if(pJob->m_hThread==NULL)
+        pJob->m_bResult = psc->WriteImageFile(pJob);
 
 cleanup:
 
     // Clean up
+    if(hOldBitmap)
+        SelectObject(hCompatDC, hOldBitmap);
+
     if(hDC)
         DeleteDC(hDC);
 
@@ -326,300 +348,67 @@ cleanup:
     if(hBitmap)
         DeleteObject(hBitmap);
 
-    if(pRowBits)
-        delete [] pRowBits;
-
     // Next monitor
     return TRUE;
 }
 
-// Gets rectangle of the virtual screen
-void CScreenCapture::GetScreenRect(LPRECT rcScreen)
+DWORD WINAPI CScreenCapture::ImageWriterThread(LPVOID lpParam)
 {
-    int nWidth = GetSystemMetrics(SM_CXVIRTUALSCREEN);
-    int nHeight = GetSystemMetrics(SM_CYVIRTUALSCREEN);
-
-    rcScreen->left = GetSystemMetrics(SM_XVIRTUALSCREEN);
-    rcScreen->top = GetSystemMetrics(SM_YVIRTUALSCREEN);
-    rcScreen->right = rcScreen->left + nWidth;
-    rcScreen->bottom = rcScreen->top + nHeight;
+    MonitorImageJob* pJob = (MonitorImageJob*)lpParam;
+    pJob->m_bResult = pJob->m_pOwner->WriteImageFile(pJob);
+    return 0;
 }
 
-BOOL CScreenCapture::PngInit(int nWidth, int nHeight, BOOL bGrayscale, CString sFileName)
+BOOL CScreenCapture::WriteImageFile(MonitorImageJob* pJob)
 {
-    m_fp = NULL;
-    m_png_ptr = NULL;
-    m_info_ptr = NULL;
+    FILE* f = NULL;
+    bool bWrite = false;
 
 #if _MSC_VER>=1400
-    _tfopen_s(&m_fp, sFileName.GetBuffer(0), _T("wb"));
+    _tfopen_s(&f, pJob->m_MonitorInfo.m_sFileName, _T("wb"));
 #else
-    m_fp = _tfopen(sFileName.GetBuffer(0), _T("wb"));
+    f = _tfopen(pJob->m_MonitorInfo.m_sFileName, _T("wb"));
 #endif
-
-    if (!m_fp)
-    {
-        return FALSE;
-    }
-
-    m_png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING,
-        (png_voidp)NULL, NULL, NULL);
-    if (!m_png_ptr)
+    if(f==NULL)
         return FALSE;
 
-    m_info_ptr = png_create_info_struct(m_png_ptr);
-    if (!m_info_ptr)
+    if(m_fmt==SCREENSHOT_FORMAT_PNG || m_fmt==SCREENSHOT_FORMAT_PNG_FAST)
     {
-        png_destroy_write_struct(&m_png_ptr, (png_infopp)NULL);
-        return FALSE;
+        PngEncodeParams Params;
+        if(m_fmt==SCREENSHOT_FORMAT_PNG_FAST)
+            Params.SetFastLossless();
+        Params.m_bGrayscale = m_bGrayscale!=FALSE;
+        Params.m_nThreads = m_nPngThreads;
+        bWrite = image_write_png(f, pJob->m_pBits, pJob->m_nWidth, pJob->m_nHeight,
+            pJob->m_nStride, Params);
     }
-
-    /* Error handler*/
-    if (setjmp(png_jmpbuf(m_png_ptr)))
+    else if(m_fmt==SCREENSHOT_FORMAT_JPG)
     {
-        png_destroy_write_struct(&m_png_ptr, &m_info_ptr);
-        fclose(m_fp);
-        return FALSE;
+        bWrite = image_write_jpeg(f, pJob->m_pBits, pJob->m_nWidth, pJob->m_nHeight,
+            pJob->m_nStride, m_bGrayscale!=FALSE, m_nJpegQuality);
     }
-
-    png_init_io(m_png_ptr, m_fp);
-
-    /* set the zlib compression level */
-    png_set_compression_level(m_png_ptr, Z_BEST_COMPRESSION);
-
-    /* set other zlib parameters */
-    png_set_compression_mem_level(m_png_ptr, 8);
-    png_set_compression_strategy(m_png_ptr, Z_DEFAULT_STRATEGY);
-    png_set_compression_window_bits(m_png_ptr, 15);
-    png_set_compression_method(m_png_ptr, 8);
-    png_set_compression_buffer_size(m_png_ptr, 8192);
-
-    png_set_IHDR(
-        m_png_ptr,
-        m_info_ptr,
-        nWidth, //width,
-        nHeight, //height,
-        8, // bit_depth
-        bGrayscale?PNG_COLOR_TYPE_GRAY:PNG_COLOR_TYPE_RGB, // color_type
-        PNG_INTERLACE_NONE, // interlace_type
-        PNG_COMPRESSION_TYPE_DEFAULT,
-        PNG_FILTER_TYPE_DEFAULT);
-
-    png_set_bgr(m_png_ptr);
-
-    /* write the file information */
-    png_write_info(m_png_ptr, m_info_ptr);
-
-    return TRUE;
-}
-
-BOOL CScreenCapture::PngWriteRow(LPBYTE pRow, int nRowLen, BOOL bGrayscale)
-{
-    // Convert RGB to BGR
-    LPBYTE pRow2 = NULL;
-
-    if(bGrayscale)
-    {
-        int i;
-        pRow2 = new BYTE[nRowLen/3];
-        for(i=0; i<nRowLen/3; i++)
-            pRow2[i] = (pRow[i*3+0]+pRow[i*3+1]+pRow[i*3+2])/3;
-    }
-    else
-    {
-        pRow2 = pRow;
-    }
-
-    png_bytep rows[1] = {pRow2};
-    png_write_rows(m_png_ptr, (png_bytepp)&rows, 1);
-
-    if(bGrayscale)
-        delete [] pRow2;
-    return TRUE;
-}
-
-BOOL CScreenCapture::PngFinalize()
-{
-    /* end write */
-    png_write_end(m_png_ptr, m_info_ptr);
-
-    /* clean up */
-    png_destroy_write_struct(&m_png_ptr, (png_infopp)&m_info_ptr);
-
-    if(m_fp)
-        fclose(m_fp);
-
-    return TRUE;
-}
-
-BOOL CScreenCapture::JpegInit(int nWidth, int nHeight, BOOL bGrayscale, int nQuality, CString sFileName)
-{
-    /* Step 1: allocate and initialize JPEG compression object */
-
-    m_cinfo.err = jpeg_std_error(&m_jerr);
-    jpeg_create_compress(&m_cinfo);
-
-    /* Step 2: specify data destination (eg, a file) */
-
-#if _MSC_VER < 1400
-    m_fp = _tfopen(sFileName, _T("wb"));
-#else
-    _tfopen_s(&m_fp, sFileName, _T("wb"));
-#endif
-    if(m_fp==NULL)
-        return FALSE;
-
-    jpeg_stdio_dest(&m_cinfo, m_fp);
-
-    /* Step 3: set parameters for compression */
-
-    m_cinfo.image_width = nWidth; 	/* image width and height, in pixels */
-    m_cinfo.image_height = nHeight;
-    m_cinfo.input_components = bGrayscale?1:3;		/* # of color components per pixel */
-    m_cinfo.in_color_space = bGrayscale?JCS_GRAYSCALE:JCS_RGB; 	/* colorspace of input image */
-    jpeg_set_defaults(&m_cinfo);
-    jpeg_set_quality(&m_cinfo, nQuality, TRUE /* limit to baseline-JPEG values */);
-
-    /* Step 4: Start compressor */
-
-    jpeg_start_compress(&m_cinfo, TRUE);
-
-    return TRUE;
-}
-
-BOOL CScreenCapture::JpegWriteRow(LPBYTE pRow, int nRowLen, BOOL bGrayscale)
-{
-    // Convert RGB to BGR
-    LPBYTE pRow2 = NULL;
-    int i;
-    if(bGrayscale)
-    {
-        pRow2 = new BYTE[nRowLen/3];
-        for(i=0; i<nRowLen/3; i++)
-            pRow2[i] = (pRow[i*3+0]+pRow[i*3+1]+pRow[i*3+2])/3;
-    }
-    else
-    {
-        pRow2 = new BYTE[nRowLen];
-        for(i=0; i<nRowLen/3; i++)
-        {
-            pRow2[i*3+0] = pRow[i*3+2];
-            pRow2[i*3+1] = pRow[i*3+1];
-            pRow2[i*3+2] = pRow[i*3+0];
-        }
-    }
-
-    JSAMPROW row_pointer[1];
-    row_pointer[0] = (JSAMPROW)pRow2;
-    (void) jpeg_write_scanlines(&m_cinfo, row_pointer, 1);
-
-    delete [] pRow2;
-
-    return TRUE;
-}
-
-BOOL CScreenCapture::JpegFinalize()
-{
-    /* Step 6: Finish compression */
-    jpeg_finish_compress(&m_cinfo);
-
-    /* After finish_compress, we can close the output file. */
-    if(m_fp!=NULL)
-        fclose(m_fp);
-    m_fp = NULL;
-
-    /* Step 7: release JPEG compression object */
-
-    /* This is an important step since it will release a good deal of memory. */
-    jpeg_destroy_compress(&m_cinfo);
-
-    return TRUE;
-}
-
-BOOL CScreenCapture::BmpInit(int nWidth, int nHeight, BOOL bGrayscale, CString sFileName)
-{
-    m_fp = NULL;
-
-    // Open file for writing
-#if _MSC_VER>=1400
-    _tfopen_s(&m_fp, sFileName.GetBuffer(0), _T("wb"));
-#else
-    m_fp = _tfopen(sFileName.GetBuffer(0), _T("wb"));
-#endif
-
-    if(m_fp==NULL)
-        return FALSE; // error opening file for writing
-
-    BITMAPFILEHEADER bmfh;
-    BITMAPINFOHEADER info;
-    memset ( &bmfh, 0, sizeof (BITMAPFILEHEADER ) );
-    memset ( &info, 0, sizeof (BITMAPINFOHEADER ) );
-
-    bmfh.bfType = 0x4d42;       // 0x4d42 = 'BM'
-    bmfh.bfReserved1 = 0;
-    bmfh.bfReserved2 = 0;
-    int paddedsize = nWidth*(bGrayscale?1:3);
-    paddedsize+=paddedsize%4;
-    paddedsize*=nHeight;
-    bmfh.bfSize = sizeof(BITMAPFILEHEADER) +
-        sizeof(BITMAPINFOHEADER) + paddedsize;
-    bmfh.bfOffBits = 0x36;
-
-    info.biSize = sizeof(BITMAPINFOHEADER);
-    info.biWidth = nWidth;
-    info.biHeight = nHeight;
-    info.biPlanes = 1;
-    info.biBitCount = bGrayscale?8:24;
-    info.biCompression = BI_RGB;
-    info.biSizeImage = 0;
-    info.biXPelsPerMeter = 0x0ec4;
-    info.biYPelsPerMeter = 0x0ec4;
-    info.biClrUsed = 0;
-    info.biClrImportant = 0;
-
-    if(1!=fwrite(&bmfh, sizeof ( BITMAPFILEHEADER ), 1, m_fp))
-    {
-        return FALSE;
-    }
-
-    if(1!=fwrite(&info, sizeof ( BITMAPINFOHEADER ), 1, m_fp))
+    else if(m_fmt==SCREENSHOT_FORMAT_BMP)
     {
-        return FALSE;
+        bWrite = image_write_bmp(f, pJob->m_pBits, pJob->m_nWidth, pJob->m_nHeight,
+            pJob->m_nStride, m_bGrayscale!=FALSE);
     }
 
-    return TRUE;
-}
+    if(fclose(f)!=0)
+        bWrite = false;
 
-BOOL CScreenCapture::BmpWriteRow(LPBYTE pRow, int nRowLen, BOOL bGrayscale)
-{
-    // Convert RGB to BGR
-    LPBYTE pRow2 = NULL;
-    int i;
-    if(bGrayscale)
-    {
-        pRow2 = new BYTE[nRowLen/3];
-        for(i=0; i<nRowLen/3; i++)
-            pRow2[i] = (pRow[i*3+0]+pRow[i*3+1]+pRow[i*3+2])/3;
-
-        fwrite(pRow2, nRowLen/3, 1, m_fp);
-
-        delete [] pRow2;
-    }
-    else
-    {
-        fwrite(pRow, nRowLen, 1, m_fp);
-    }
-
-    return TRUE;
+    return bWrite ? TRUE : FALSE;
 }
 
-BOOL CScreenCapture::BmpFinalize()
+// Gets rectangle of the virtual screen
+void CScreenCapture::GetScreenRect(LPRECT rcScreen)
 {
-    if(m_fp)
-        fclose(m_fp);
-    m_fp=NULL;
+    int nWidth = GetSystemMetrics(SM_CXVIRTUALSCREEN);
+    int nHeight = GetSystemMetrics(SM_CYVIRTUALSCREEN);
 
-    return TRUE;
+    rcScreen->left = GetSystemMetrics(SM_XVIRTUALSCREEN);
+    rcScreen->top = GetSystemMetrics(SM_YVIRTUALSCREEN);
+    rcScreen->right = rcScreen->left + nWidth;
+    rcScreen->bottom = rcScreen->top + nHeight;
 }
 
 BOOL CALLBACK CScreenCapture::EnumWndProc(HWND hWnd, LPARAM lParam)
@@ -13,11 +13,6 @@ be found in the Authors.txt file in the root of the source tree.
 
 #include "stdafx.h"
 
-extern "C" {
-#include "png.h"
-}
-#include "jpeglib.h"
-
 // Window information
 struct WindowInfo
 {
@@ -64,7 +59,8 @@ enum SCREENSHOT_IMAGE_FORMAT
 {
     SCREENSHOT_FORMAT_PNG = 0, // Use PNG format
     SCREENSHOT_FORMAT_JPG = 1, // Use JPG format
-    SCREENSHOT_FORMAT_BMP = 2  // Use BMP format
+    SCREENSHOT_FORMAT_BMP = 2, // Use BMP format
+    SCREENSHOT_FORMAT_PNG_FAST = 3 // Use PNG format, encode for speed
 };
 
 // Desktop screenshot capture
@@ -89,6 +85,15 @@ public:
 			BOOL bGrayscale=FALSE,
 			int nIdStartFrom=0);
 
+	// Takes desktop screenshot and scales it into the given DC of FrameSize
+	// size instead of saving monitor images to files.
+	BOOL CaptureDesktopFrame(
+			HDC hFrameDC,
+			SIZE FrameSize,
+			ScreenshotInfo& ssi,
+			SCREENSHOT_TYPE type=SCREENSHOT_TYPE_VIRTUAL_SCREEN,
+			DWORD dwProcessId = 0);
+
 private:
 
 	// Returns current virtual screen rectangle
@@ -116,39 +121,6 @@ private:
 	// Window enumeration callback.
 	static BOOL CALLBACK EnumWndProc(HWND hWnd, LPARAM lParam);
 
-    /* PNG management functions */
-
-    // Initializes PNG file header
-    BOOL PngInit(int nWidth, int nHeight, BOOL bGrayscale, CString sFileName);
-
-    // Writes a scan line to the PNG file
-    BOOL PngWriteRow(LPBYTE pRow, int nRowLen, BOOL bGrayscale);
-
-    // Closes PNG file
-    BOOL PngFinalize();
-
-    /* JPEG management functions */
-
-	// Initializes JPEG file header.
-    BOOL JpegInit(int nWidth, int nHeight, BOOL bGrayscale, int nQuality, CString sFileName);
-
-	// Writes a scan line to JPEG file.
-    BOOL JpegWriteRow(LPBYTE pRow, int nRowLen, BOOL bGrayscale);
-
-	// Closes PNG file.
-    BOOL JpegFinalize();
-
-	/* BMP management functions */
-
-	// Initializes BMP file header
-    BOOL BmpInit(int nWidth, int nHeight, BOOL bGrayscale, CString sFileName);
-
-    // Writes a scan line to the BMP file
-    BOOL BmpWriteRow(LPBYTE pRow, int nRowLen, BOOL bGrayscale);
-
-    // Closes BMP file
-    BOOL BmpFinalize();
-
 	// The following structure stores window find data.
 	struct FindWindowData
 	{
@@ -157,6 +129,26 @@ private:
 		std::vector<WindowInfo>* paWindows;  // Output array of window handles
 	};
 
+    // A monitor image captured and being written to a file by a worker thread.
+    struct MonitorImageJob
+    {
+        CScreenCapture* m_pOwner;     // Screen capture object that started the job.
+        HBITMAP m_hBitmap;            // Top-down 24-bit DIB section with monitor image.
+        LPBYTE m_pBits;               // Pixels of m_hBitmap.
+        int m_nWidth;                 // Image width.
+        int m_nHeight;                // Image height.
+        int m_nStride;                // Bytes per image row.
+        MonitorInfo m_MonitorInfo;    // Monitor info, including the image file name.
+        HANDLE m_hThread;             // Worker thread or NULL if the job was done synchronously.
+        BOOL m_bResult;               // TRUE if the image file was written.
+    };
+
+    // Writes a captured monitor image to its file.
+    BOOL WriteImageFile(MonitorImageJob* pJob);
+
+    // Thread writing a captured monitor image to its file.
+    static DWORD WINAPI ImageWriterThread(LPVOID lpParam);
+
     /* Internal member variables. */
 
     CPoint m_ptCursorPos;                 // Current mouse cursor pos
@@ -167,12 +159,11 @@ private:
     SCREENSHOT_IMAGE_FORMAT m_fmt;        // Image format
     int m_nJpegQuality;                   // Jpeg quality
     BOOL m_bGrayscale;                    // Create grayscale image or not
-    FILE* m_fp;                           // Handle to the file
-    png_structp m_png_ptr;                // libpng stuff
-    png_infop m_info_ptr;                 // libpng stuff
-    struct jpeg_compress_struct m_cinfo;  // libjpeg stuff
-    struct jpeg_error_mgr m_jerr;         // libjpeg stuff
+    int m_nPngThreads;                    // Count of threads compressing each PNG image
+    std::vector<MonitorImageJob*> m_aJobs; // Monitor images being written to files
     std::vector<MonitorInfo> m_monitor_list; // The list of monitor devices
+    HDC m_hFrameDC;                       // If not NULL, monitor images are scaled into this DC
+    SIZE m_FrameSize;                     // Size of the m_hFrameDC image
 };
 
 #endif //__SCREENCAP_H__
@@ -0,0 +1,408 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+// File: VideoEncoder.cpp
+// Description: Incremental Theora video encoder keeping the most recent part of video.
+
+#include "VideoEncoder.h"
+#include "ColorConv.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+//-----------------------------------------------
+// CTheoraEncoder impl
+//-----------------------------------------------
+
+CTheoraEncoder::CTheoraEncoder()
+{
+    m_pEnc = NULL;
+    memset(&m_Stream, 0, sizeof(m_Stream));
+    m_bStreamInit = false;
+    m_nFrameWidth = 0;
+    m_nFrameHeight = 0;
+    m_nMaxFrames = 0;
+    m_nGranuleShift = 0;
+    memset(&m_Image, 0, sizeof(m_Image));
+    m_nFrameCount = 0;
+    memset(&m_HeldPacket, 0, sizeof(m_HeldPacket));
+    m_bHavePacket = false;
+    m_nFirstKeyframe = -1;
+}
+
+CTheoraEncoder::~CTheoraEncoder()
+{
+    Destroy();
+}
+
+bool CTheoraEncoder::Init(int nFrameWidth, int nFrameHeight, int nFrameInterval,
+                          int nQuality, int nMaxFrames, int nKeyframeInterval)
+{
+    th_info ti;
+    th_comment tc;
+    ogg_packet op;
+    ogg_page og;
+    ogg_uint32_t uKeyframeInterval;
+    bool bResult = false;
+    int ret;
+
+    Destroy();
+
+    // Validate input
+    if(nFrameWidth<=0 || nFrameHeight<=0 || (nFrameWidth&0xF)!=0 || (nFrameHeight&0xF)!=0 ||
+        nFrameInterval<=0 || nMaxFrames<=0)
+        return false;
+
+    m_nFrameWidth = nFrameWidth;
+    m_nFrameHeight = nFrameHeight;
+    m_nMaxFrames = nMaxFrames;
+    m_nGranuleShift = 6;
+
+    if(nKeyframeInterval<1)
+        nKeyframeInterval = 1;
+    if(nKeyframeInterval>(1<<m_nGranuleShift))
+        nKeyframeInterval = 1<<m_nGranuleShift;
+
+    /* Set up Ogg output stream */
+    srand((unsigned int)time(NULL));
+    if(ogg_stream_init(&m_Stream, rand())!=0)
+        return false;
+    m_bStreamInit = true;
+
+    // Fill in a th_info structure with details on the format of the video you wish to encode.
+    th_info_init(&ti);
+    ti.frame_width=nFrameWidth;
+    ti.frame_height=nFrameHeight;
+    ti.pic_width=nFrameWidth;
+    ti.pic_height=nFrameHeight;
+    ti.pic_x=0;
+    ti.pic_y=0;
+    ti.fps_numerator=1000;
+    ti.fps_denominator=nFrameInterval;
+    ti.aspect_numerator=0;
+    ti.aspect_denominator=0;
+    ti.colorspace=TH_CS_UNSPECIFIED;
+    ti.target_bitrate=0; // VBR mode at specified video quality
+    ti.quality=nQuality;
+    ti.keyframe_granule_shift=m_nGranuleShift;
+    ti.pixel_fmt=TH_PF_420;
+
+    // Allocate a th_enc_ctx handle with th_encode_alloc().
+    m_pEnc=th_encode_alloc(&ti);
+    th_info_clear(&ti);
+    if(m_pEnc==NULL)
+        return false;
+
+    // Segments of video start with keyframes, so they can be dropped independently
+    uKeyframeInterval = nKeyframeInterval;
+    th_encode_ctl(m_pEnc, TH_ENCCTL_SET_KEYFRAME_FREQUENCY_FORCE,
+        &uKeyframeInterval, sizeof(uKeyframeInterval));
+
+    /* Allocate YV12 image */
+    m_aYUV.resize(nFrameWidth*nFrameHeight*3/2);
+    m_Image[0].data = &m_aYUV[0];
+    m_Image[0].width = nFrameWidth;
+    m_Image[0].height = nFrameHeight;
+    m_Image[0].stride = nFrameWidth;
+    m_Image[1].data = &m_aYUV[0]+nFrameWidth*nFrameHeight;
+    m_Image[1].width = nFrameWidth/2;
+    m_Image[1].height = nFrameHeight/2;
+    m_Image[1].stride = nFrameWidth/2;
+    m_Image[2].data = &m_aYUV[0]+nFrameWidth*nFrameHeight*5/4;
+    m_Image[2].width = nFrameWidth/2;
+    m_Image[2].height = nFrameHeight/2;
+    m_Image[2].stride = nFrameWidth/2;
+
+    /* Create the bitstream header packets with proper page interleave */
+    th_comment_init(&tc);
+
+    // The first packet will get its own page automatically
+    if(th_encode_flushheader(m_pEnc,&tc,&op)<=0)
+        goto cleanup;
+    ogg_stream_packetin(&m_Stream,&op);
+    if(ogg_stream_pageout(&m_Stream,&og)!=1)
+        goto cleanup;
+    m_sHeaderPages.append((const char*)og.header, og.header_len);
+    m_sHeaderPages.append((const char*)og.body, og.body_len);
+
+    /* Create the remaining theora headers */
+    for(;;)
+    {
+        ret=th_encode_flushheader(m_pEnc,&tc,&op);
+        if(ret<0)
+            goto cleanup; // Internal Theora library error
+        else if(!ret)
+            break;
+        ogg_stream_packetin(&m_Stream,&op);
+    }
+
+    /* Headers take pages of their own */
+    for(;;)
+    {
+        ret = ogg_stream_flush(&m_Stream,&og);
+        if(ret==0)
+            break;
+        m_sHeaderPages.append((const char*)og.header, og.header_len);
+        m_sHeaderPages.append((const char*)og.body, og.body_len);
+    }
+
+    bResult = true;
+
+cleanup:
+
+    th_comment_clear(&tc);
+
+    if(!bResult)
+        Destroy();
+
+    return bResult;
+}
+
+void CTheoraEncoder::Destroy()
+{
+    if(m_pEnc)
+    {
+        th_encode_free(m_pEnc);
+        m_pEnc = NULL;
+    }
+
+    if(m_bStreamInit)
+    {
+        ogg_stream_clear(&m_Stream);
+        m_bStreamInit = false;
+    }
+
+    std::vector<unsigned char>().swap(m_aYUV);
+    memset(&m_Image, 0, sizeof(m_Image));
+    m_sHeaderPages.clear();
+    m_aSegments.clear();
+    m_nFrameCount = 0;
+    m_aHeldPacket.clear();
+    m_bHavePacket = false;
+    m_nFirstKeyframe = -1;
+}
+
+bool CTheoraEncoder::IsInitialized()
+{
+    return m_pEnc!=NULL;
+}
+
+bool CTheoraEncoder::EncodeFrame(const unsigned char* pRGBData, int nRGBStride)
+{
+    ogg_packet op;
+    int ret;
+
+    if(m_pEnc==NULL)
+        return false;
+
+    // Convert RGB to YV12
+    rgb24_to_yv12(pRGBData, m_nFrameWidth, m_nFrameHeight, nRGBStride,
+        m_Image[0].data, m_Image[1].data, m_Image[2].data);
+
+    // Encode frame
+    if(th_encode_ycbcr_in(m_pEnc, m_Image))
+        return false;
+
+    // Read packets
+    while((ret = th_encode_packetout(m_pEnc, 0, &op))>0)
+    {
+        // The previous packet is not the last one, write it
+        if(m_bHavePacket && !WriteHeldPacket(false))
+            return false;
+
+        // Hold this packet, so we could mark it as the last one in Finish()
+        m_aHeldPacket.assign(op.packet, op.packet+op.bytes);
+        m_HeldPacket = op;
+        m_bHavePacket = true;
+    }
+
+    if(ret<0)
+        return false;
+
+    DropOldSegments();
+
+    return true;
+}
+
+bool CTheoraEncoder::WriteHeldPacket(bool bLast)
+{
+    ogg_packet op = m_HeldPacket;
+    op.packet = m_aHeldPacket.empty() ? NULL : &m_aHeldPacket[0];
+    op.e_o_s = bLast ? 1 : 0;
+    m_bHavePacket = false;
+
+    if(th_packet_iskeyframe(&op)==1)
+    {
+        // A keyframe starts a new segment on a new page
+        if(!m_aSegments.empty() && !TakePages(true))
+            return false;
+
+        Segment seg;
+        seg.m_nFrames = 0;
+        m_aSegments.push_back(seg);
+
+        if(m_nFirstKeyframe<0)
+            m_nFirstKeyframe = op.granulepos>>m_nGranuleShift;
+    }
+
+    if(m_aSegments.empty())
+        return false; // The stream must start with a keyframe
+
+    if(ogg_stream_packetin(&m_Stream, &op)!=0)
+        return false;
+
+    m_aSegments.back().m_nFrames++;
+    m_nFrameCount++;
+
+    return TakePages(bLast);
+}
+
+bool CTheoraEncoder::TakePages(bool bFlush)
+{
+    ogg_page og;
+
+    for(;;)
+    {
+        int ret = bFlush ? ogg_stream_flush(&m_Stream, &og) : ogg_stream_pageout(&m_Stream, &og);
+        if(ret==0)
+            break;
+
+        m_aSegments.back().m_sPages.append((const char*)og.header, og.header_len);
+        m_aSegments.back().m_sPages.append((const char*)og.body, og.body_len);
+    }
+
+    return true;
+}
+
+void CTheoraEncoder::DropOldSegments()
+{
+    // The held frame counts too, as it will be written
+    while(m_aSegments.size()>1 &&
+        GetFrameCount()-m_aSegments.front().m_nFrames>=m_nMaxFrames)
+    {
+        m_nFrameCount -= m_aSegments.front().m_nFrames;
+        m_aSegments.pop_front();
+    }
+}
+
+int CTheoraEncoder::GetFrameCount()
+{
+    return m_nFrameCount + (m_bHavePacket ? 1 : 0);
+}
+
+bool CTheoraEncoder::Finish(FILE* f)
+{
+    bool bResult = false;
+    long nPageNo = 0;
+    ogg_int64_t nKeyframeShift = 0;
+    std::deque<Segment>::iterator it;
+    size_t i;
+
+    if(m_pEnc==NULL || f==NULL)
+        return false;
+
+    // Write the last packet marking the end of stream
+    if(m_bHavePacket && !WriteHeldPacket(true))
+        goto cleanup;
+
+    // If the oldest segments were dropped, granule positions of the rest
+    // are shifted so that the video starts with the first keyframe number
+    if(!m_aSegments.empty())
+    {
+        const std::string& sPages = m_aSegments.front().m_sPages;
+        if(sPages.size()>=14)
+        {
+            ogg_int64_t nGranule = 0;
+            for(i=0; i<8; i++)
+                nGranule |= (ogg_int64_t)(unsigned char)sPages[6+i]<<(8*i);
+            if(nGranule!=-1)
+                nKeyframeShift = (nGranule>>m_nGranuleShift)-m_nFirstKeyframe;
+        }
+    }
+
+    // Write header pages, then video pages
+    if(!WritePages(f, m_sHeaderPages, nPageNo, 0))
+        goto cleanup;
+
+    for(it=m_aSegments.begin(); it!=m_aSegments.end(); it++)
+    {
+        if(!WritePages(f, it->m_sPages, nPageNo, nKeyframeShift))
+            goto cleanup;
+    }
+
+    bResult = true;
+
+cleanup:
+
+    Destroy();
+
+    return bResult;
+}
+
+bool CTheoraEncoder::WritePages(FILE* f, const std::string& sPages, long& nPageNo,
+                                ogg_int64_t nKeyframeShift)
+{
+    size_t uOffs = 0;
+    while(uOffs<sPages.size())
+    {
+        // Determine page size from its header
+        const unsigned char* pPage = (const unsigned char*)sPages.data()+uOffs;
+        size_t uSize = sPages.size()-uOffs;
+        if(uSize<27 || uSize<27+(size_t)pPage[26])
+            return false;
+        size_t uPageSize = 27+pPage[26];
+        int i;
+        for(i=0; i<pPage[26]; i++)
+            uPageSize += pPage[27+i];
+        if(uPageSize>uSize)
+            return false;
+
+        if(!WritePage(f, pPage, uPageSize, nPageNo++, nKeyframeShift))
+            return false;
+
+        uOffs += uPageSize;
+    }
+
+    return true;
+}
+
+bool CTheoraEncoder::WritePage(FILE* f, const unsigned char* pPage, size_t uPageSize,
+                               long nPageNo, ogg_int64_t nKeyframeShift)
+{
+    std::vector<unsigned char> aPage(pPage, pPage+uPageSize);
+    int i;
+
+    // Fix granule position
+    ogg_int64_t nGranule = 0;
+    for(i=0; i<8; i++)
+        nGranule |= (ogg_int64_t)aPage[6+i]<<(8*i);
+    if(nGranule!=-1 && nKeyframeShift!=0)
+    {
+        ogg_int64_t nKeyframe = (nGranule>>m_nGranuleShift)-nKeyframeShift;
+        ogg_int64_t nOffset = nGranule&((1<<m_nGranuleShift)-1);
+        nGranule = (nKeyframe<<m_nGranuleShift)|nOffset;
+        for(i=0; i<8; i++)
+            aPage[6+i] = (unsigned char)(nGranule>>(8*i));
+    }
+
+    // Fix page sequence number
+    for(i=0; i<4; i++)
+        aPage[18+i] = (unsigned char)(nPageNo>>(8*i));
+
+    // Recalculate checksum
+    ogg_page og;
+    og.header = &aPage[0];
+    og.header_len = 27+aPage[26];
+    og.body = &aPage[0]+og.header_len;
+    og.body_len = (long)uPageSize-og.header_len;
+    ogg_page_checksum_set(&og);
+
+    return fwrite(&aPage[0], 1, uPageSize, f)==uPageSize;
+}
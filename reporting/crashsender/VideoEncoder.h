@@ -0,0 +1,104 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+// File: VideoEncoder.h
+// Description: Incremental Theora video encoder keeping the most recent part of video.
+// This file doesn't depend on Windows headers, so it can be built and tested anywhere.
+
+#pragma once
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include "theora/theoraenc.h"
+
+// class CTheoraEncoder
+// Encodes video frames one by one as they come and keeps the encoded Ogg pages
+// in memory. Pages are grouped into segments, each segment starting with a
+// keyframe on a new page. When the video grows longer than the given count of
+// frames, the oldest segments are dropped, so the video can be written to file
+// at any moment by finalizing just the last frame.
+//
+class CTheoraEncoder
+{
+public:
+
+    // Constructor
+    CTheoraEncoder();
+
+    // Destructor
+    ~CTheoraEncoder();
+
+    // Starts encoding. Frame width and height must be multiples of 16.
+    // At least the nMaxFrames most recent frames are kept; a keyframe is inserted
+    // at least every nKeyframeInterval frames (not more than 64).
+    bool Init(int nFrameWidth, int nFrameHeight, int nFrameInterval,
+              int nQuality, int nMaxFrames, int nKeyframeInterval);
+
+    // Frees all resources.
+    void Destroy();
+
+    // Returns true if the encoder is initialized.
+    bool IsInitialized();
+
+    // Encodes a top-down RGB24 frame of the given row stride.
+    bool EncodeFrame(const unsigned char* pRGBData, int nRGBStride);
+
+    // Returns count of frames in the kept part of video.
+    int GetFrameCount();
+
+    // Finishes the video and writes it to file. After this,
+    // the encoder should be initialized again.
+    bool Finish(FILE* f);
+
+private:
+
+    // A part of video starting with a keyframe.
+    struct Segment
+    {
+        std::string m_sPages;   // Ogg pages.
+        int m_nFrames;          // Count of frames.
+    };
+
+    // Writes the held packet into the stream.
+    bool WriteHeldPacket(bool bLast);
+
+    // Moves complete Ogg pages from the stream to the last segment.
+    // If bFlush is true, the last incomplete page is flushed as well.
+    bool TakePages(bool bFlush);
+
+    // Drops the oldest segments not needed to keep nMaxFrames frames.
+    void DropOldSegments();
+
+    // Writes the pages one by one with WritePage().
+    bool WritePages(FILE* f, const std::string& sPages, long& nPageNo, ogg_int64_t nKeyframeShift);
+
+    // Writes the page with its sequence number and granule position
+    // fixed up, as the pages before it may have been dropped.
+    bool WritePage(FILE* f, const unsigned char* pPage, size_t uPageSize, long nPageNo, ogg_int64_t nKeyframeShift);
+
+    th_enc_ctx* m_pEnc;          // Theora encoder.
+    ogg_stream_state m_Stream;   // Ogg stream.
+    bool m_bStreamInit;          // Whether m_Stream is initialized.
+    int m_nFrameWidth;           // Frame width.
+    int m_nFrameHeight;          // Frame height.
+    int m_nMaxFrames;            // Count of frames to keep.
+    int m_nGranuleShift;         // Bits of granule position used for frame offset from keyframe.
+    std::vector<unsigned char> m_aYUV; // YV12 frame buffer.
+    th_ycbcr_buffer m_Image;     // Planes of m_aYUV.
+    std::string m_sHeaderPages;  // Ogg pages with stream headers.
+    std::deque<Segment> m_aSegments; // Pages with encoded frames.
+    int m_nFrameCount;           // Count of frames in m_aSegments.
+    std::vector<unsigned char> m_aHeldPacket; // The latest packet, written when the next one comes.
+    ogg_packet m_HeldPacket;     // Fields of the held packet.
+    bool m_bHavePacket;          // Whether there is a held packet.
+    ogg_int64_t m_nFirstKeyframe; // Keyframe number of the first frame ever encoded.
+};
@@ -18,10 +18,243 @@ be found in the Authors.txt file in the root of the source tree.
 #include "Utility.h"
 #include "math.h"
 
-static int ilog(unsigned _v){
-  int ret;
-  for(ret=0;_v;ret++)_v>>=1;
-  return ret;
+//-----------------------------------------------
+// CVideoFrameRing impl
+//-----------------------------------------------
+
+// XORs the block with another one of the same size.
+static void XorBlock(LPBYTE pDst, const BYTE* pSrc, size_t uSize)
+{
+    size_t i = 0;
+    for(; i+sizeof(DWORD_PTR)<=uSize; i+=sizeof(DWORD_PTR))
+        *(DWORD_PTR*)(pDst+i) ^= *(const DWORD_PTR*)(pSrc+i);
+    for(; i<uSize; i++)
+        pDst[i] ^= pSrc[i];
+}
+
+CVideoFrameRing::CVideoFrameRing()
+{
+    m_dwFrameSize = 0;
+    m_nMaxFrames = 0;
+    m_uMaxMemory = 0;
+    m_nFrameCount = 0;
+    m_uDeltaSize = 0;
+    memset(&m_zs, 0, sizeof(m_zs));
+    m_bDeflateInit = FALSE;
+}
+
+CVideoFrameRing::~CVideoFrameRing()
+{
+    Destroy();
+}
+
+BOOL CVideoFrameRing::Init(DWORD dwFrameSize, int nMaxFrames, ULONG64 uMaxMemory)
+{
+    Destroy();
+
+    if(dwFrameSize==0 || nMaxFrames<=0)
+        return FALSE;
+
+    m_dwFrameSize = dwFrameSize;
+    m_nMaxFrames = nMaxFrames;
+    m_uMaxMemory = uMaxMemory;
+
+    // Deltas are mostly runs of zero bytes, so run-length encoding
+    // compresses them nearly as well as full deflate, but much faster
+    memset(&m_zs, 0, sizeof(m_zs));
+    if(deflateInit2(&m_zs, Z_BEST_SPEED, Z_DEFLATED, MAX_WBITS, 8, Z_RLE)!=Z_OK)
+        return FALSE;
+    m_bDeflateInit = TRUE;
+
+    m_aFirst.resize(dwFrameSize);
+    m_aLast.resize(dwFrameSize);
+    m_aPacked.resize(deflateBound(&m_zs, dwFrameSize));
+
+    return TRUE;
+}
+
+void CVideoFrameRing::Destroy()
+{
+    if(m_bDeflateInit)
+    {
+        deflateEnd(&m_zs);
+        m_bDeflateInit = FALSE;
+    }
+
+    // Free memory (swap with empty vectors, as clear() doesn't free it)
+    std::vector<BYTE>().swap(m_aFirst);
+    std::vector<BYTE>().swap(m_aLast);
+    std::vector<BYTE>().swap(m_aPacked);
+    std::deque<std::vector<BYTE> >().swap(m_aDeltas);
+    m_uDeltaSize = 0;
+    m_nFrameCount = 0;
+}
+
+BOOL CVideoFrameRing::AddFrame(const BYTE* pFrame)
+{
+    if(!m_bDeflateInit)
+        return FALSE;
+
+    if(m_nFrameCount==0)
+    {
+        // The first frame is kept as is
+        memcpy(&m_aFirst[0], pFrame, m_dwFrameSize);
+        memcpy(&m_aLast[0], pFrame, m_dwFrameSize);
+        m_nFrameCount = 1;
+        return TRUE;
+    }
+
+    if(memcmp(&m_aLast[0], pFrame, m_dwFrameSize)==0)
+    {
+        // Frame is unchanged, its delta is empty
+        m_aDeltas.push_back(std::vector<BYTE>());
+    }
+    else
+    {
+        // Turn the last frame into the delta and compress it
+        XorBlock(&m_aLast[0], pFrame, m_dwFrameSize);
+
+        deflateReset(&m_zs);
+        m_zs.next_in = &m_aLast[0];
+        m_zs.avail_in = m_dwFrameSize;
+        m_zs.next_out = &m_aPacked[0];
+        m_zs.avail_out = (uInt)m_aPacked.size();
+        int res = deflate(&m_zs, Z_FINISH);
+
+        // Restore the last frame
+        memcpy(&m_aLast[0], pFrame, m_dwFrameSize);
+
+        if(res!=Z_STREAM_END)
+        {
+            // Can't keep the delta, so start the ring anew from this frame
+            memcpy(&m_aFirst[0], pFrame, m_dwFrameSize);
+            m_aDeltas.clear();
+            m_uDeltaSize = 0;
+            m_nFrameCount = 1;
+            return FALSE;
+        }
+
+        size_t uPackedSize = m_aPacked.size()-m_zs.avail_out;
+        m_aDeltas.push_back(std::vector<BYTE>(m_aPacked.begin(), m_aPacked.begin()+uPackedSize));
+        m_uDeltaSize += uPackedSize;
+    }
+
+    m_nFrameCount++;
+
+    // Drop the oldest frames if there are too many of them
+    while(m_nFrameCount>1 &&
+        (m_nFrameCount>m_nMaxFrames || GetMemoryUsage()>m_uMaxMemory))
+    {
+        if(!DropOldestFrame())
+            break;
+    }
+
+    return TRUE;
+}
+
+int CVideoFrameRing::GetFrameCount()
+{
+    return m_nFrameCount;
+}
+
+ULONG64 CVideoFrameRing::GetMemoryUsage()
+{
+    return m_aFirst.size()+m_aLast.size()+m_aPacked.size()+m_uDeltaSize;
+}
+
+BOOL CVideoFrameRing::ReadFrame(int nFrame, LPBYTE pFrame)
+{
+    if(nFrame<0 || nFrame>=m_nFrameCount)
+        return FALSE;
+
+    if(nFrame==0)
+    {
+        memcpy(pFrame, &m_aFirst[0], m_dwFrameSize);
+        return TRUE;
+    }
+
+    return ApplyDelta(m_aDeltas[nFrame-1], pFrame);
+}
+
+BOOL CVideoFrameRing::PopFrame(LPBYTE pFrame)
+{
+    if(m_nFrameCount==0)
+        return FALSE;
+
+    memcpy(pFrame, &m_aFirst[0], m_dwFrameSize);
+
+    if(m_nFrameCount==1)
+    {
+        // The ring is empty now; the next frame added will be kept as is
+        m_nFrameCount = 0;
+        return TRUE;
+    }
+
+    if(!DropOldestFrame())
+    {
+        // Can't restore the next frame, so drop the rest of frames
+        m_aDeltas.clear();
+        m_uDeltaSize = 0;
+        m_nFrameCount = 0;
+    }
+
+    return TRUE;
+}
+
+BOOL CVideoFrameRing::ApplyDelta(const std::vector<BYTE>& aDelta, LPBYTE pFrame)
+{
+    // Empty delta means frame is unchanged
+    if(aDelta.empty())
+        return TRUE;
+
+    // Unpack the delta piece by piece, applying each piece to the frame,
+    // so we don't need another frame-sized buffer
+    BYTE buf[16384];
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if(inflateInit(&zs)!=Z_OK)
+        return FALSE;
+
+    zs.next_in = (Bytef*)&aDelta[0];
+    zs.avail_in = (uInt)aDelta.size();
+
+    DWORD dwOffs = 0;
+    int res = Z_OK;
+    while(res==Z_OK)
+    {
+        zs.next_out = buf;
+        zs.avail_out = sizeof(buf);
+        res = inflate(&zs, Z_NO_FLUSH);
+        if(res!=Z_OK && res!=Z_STREAM_END)
+            break;
+
+        DWORD dwUnpacked = (DWORD)(sizeof(buf)-zs.avail_out);
+        if(dwOffs+dwUnpacked>m_dwFrameSize)
+        {
+            res = Z_DATA_ERROR;
+            break;
+        }
+
+        XorBlock(pFrame+dwOffs, buf, dwUnpacked);
+        dwOffs += dwUnpacked;
+    }
+
+    inflateEnd(&zs);
+
+    return res==Z_STREAM_END && dwOffs==m_dwFrameSize;
+}
+
+BOOL CVideoFrameRing::DropOldestFrame()
+{
+    // The second oldest frame becomes the first one
+    if(!ApplyDelta(m_aDeltas.front(), &m_aFirst[0]))
+        return FALSE;
+
+    m_uDeltaSize -= m_aDeltas.front().size();
+    m_aDeltas.pop_front();
+    m_nFrameCount--;
+
+    return TRUE;
 }
 
 //-----------------------------------------------
@@ -35,14 +268,20 @@ CVideoRecorder::CVideoRecorder()
     m_nVideoFrameInterval = 300;
     m_dwProcessId = 0;
     m_nFrameCount = 0;
-    m_nFileId = 0;
-    m_nFrameId = 0;
     m_nVideoQuality = 5;
     m_DesiredFrameSize.cx = 0;
     m_DesiredFrameSize.cy = 0;
+    m_ActualFrameSize.cx = 0;
+    m_ActualFrameSize.cy = 0;
+    m_nFrameStride = 0;
     m_hbmpFrame = NULL;
     m_pFrameBits = NULL;
     m_pDIB = NULL;
+    m_hDC = NULL;
+    m_hOldBitmap = NULL;
+    m_hEncoderThread = NULL;
+    m_hFrameEvent = NULL;
+    m_bStopEncoder = FALSE;
     m_bInitialized = FALSE;
 }
 
@@ -57,7 +296,8 @@ BOOL CVideoRecorder::Init(LPCTSTR szSaveToDir,
     int nVideoDuration,
     int nVideoFrameInterval,
     int nVideoQuality,
-    SIZE* pDesiredFrameSize)
+    SIZE* pDesiredFrameSize,
+    ULONG64 uMaxMemory)
 {
     // Validate input params
     if(nVideoDuration<=0 || nVideoFrameInterval<=0)
@@ -85,147 +325,92 @@ BOOL CVideoRecorder::Init(LPCTSTR szSaveToDir,
 
     // Calculate max frame count
     m_nFrameCount = m_nVideoDuration/m_nVideoFrameInterval;
-    m_nFileId = 0;
-    m_nFrameId = 0;
+    if(m_nFrameCount<1)
+        m_nFrameCount = 1;
 
-    // Create folder where to save video frames
-    CString sDirName = m_sSaveToDir + _T("\\~temp_video");
-    if(!Utility::CreateFolder(sDirName))
+    // Determine frame size based on current virtual screen size
+    SIZE ScreenSize;
+    ScreenSize.cx = GetSystemMetrics(SM_CXVIRTUALSCREEN);
+    ScreenSize.cy = GetSystemMetrics(SM_CYVIRTUALSCREEN);
+    CalcFrameSize(ScreenSize);
+
+    // Create the bitmap screenshots are scaled into
+    if(!CreateFrameDIB(m_ActualFrameSize.cx, m_ActualFrameSize.cy, 24))
     {
-        // Error creating temp folder
+        // Error creating frame bitmap
         return FALSE;
     }
 
-    // Done
-    m_bInitialized = TRUE;
-    return TRUE;
-}
-
-BOOL CVideoRecorder::IsInitialized()
-{
-    return m_bInitialized;
-}
-
-void CVideoRecorder::Destroy()
-{
-    // Remove temp files
-    if(!m_sSaveToDir.IsEmpty())
+    // Create frame ring
+    m_nFrameStride = m_ActualFrameSize.cx*3+(m_ActualFrameSize.cx*3)%4;
+    DWORD dwFrameSize = m_nFrameStride*m_ActualFrameSize.cy;
+    memset(m_pFrameBits, 0, dwFrameSize);
+    if(!m_FrameRing.Init(dwFrameSize, m_nFrameCount,
+        uMaxMemory!=0 ? uMaxMemory : VIDEO_DEFAULT_MAX_MEMORY))
     {
-        CString sDirName = m_sSaveToDir + _T("\\~temp_video");
-        Utility::RecycleFile(sDirName, TRUE);
+        // Error allocating frame buffers
+        return FALSE;
     }
 
-    m_bInitialized=FALSE;
-}
-
-BOOL CVideoRecorder::RecordVideoFrame()
-{
-    // The following method records a single video frame and returns.
-
-    ScreenshotInfo ssi; // Screenshot params
-
-    CString sDirName = m_sSaveToDir + _T("\\~temp_video");
-
-    // Take the screen shot and save it as raw BMP file.
-    BOOL bTakeScreenshot = m_sc.TakeDesktopScreenshot(
-        sDirName,
-        ssi, m_ScreenshotType, m_dwProcessId,
-        SCREENSHOT_FORMAT_BMP, 0, FALSE, m_nFileId);
-    if(bTakeScreenshot==FALSE)
+    // Init video encoder. It keeps at least the requested count of frames and
+    // inserts a keyframe every few seconds, so the video it keeps is not much longer.
+    int nKeyframeInterval = 4000/m_nVideoFrameInterval;
+    if(nKeyframeInterval<1)
+        nKeyframeInterval = 1;
+    if(!m_Encoder.Init(m_ActualFrameSize.cx, m_ActualFrameSize.cy, m_nVideoFrameInterval,
+        m_nVideoQuality, m_nFrameCount, nKeyframeInterval))
     {
-        // Failed to take screenshot
+        // Error initializing encoder
         return FALSE;
     }
 
-    // Save video frame info
-    SetVideoFrameInfo(m_nFrameId, ssi);
-
-    // Increment file ID
-    m_nFileId += (int)ssi.m_aMonitors.size();
-
-    // Increment frame number
-    m_nFrameId++;
-
-    // Reuse files cyclically
-    if(m_nFrameId>=m_nFrameCount)
+    // Start the encoder thread with low priority, so it doesn't disturb the application.
+    // If the thread can't be started, frames are kept in the ring and
+    // encoded all at once by EncodeVideo().
+    m_aEncoderFrame.resize(dwFrameSize);
+    m_bStopEncoder = FALSE;
+    m_hFrameEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+    if(m_hFrameEvent!=NULL)
     {
-        m_nFileId = 0;
-        m_nFrameId = 0;
+        m_hEncoderThread = CreateThread(NULL, 0, EncoderThread, this, 0, NULL);
+        if(m_hEncoderThread!=NULL)
+            SetThreadPriority(m_hEncoderThread, THREAD_PRIORITY_LOWEST);
     }
 
+    // Done
+    m_bInitialized = TRUE;
     return TRUE;
 }
 
-void CVideoRecorder::SetVideoFrameInfo(int nFrameId, ScreenshotInfo& ssi)
+void CVideoRecorder::CalcFrameSize(SIZE ScreenSize)
 {
-    if((int)m_aVideoFrames.size()<=nFrameId)
-    {
-        // Add frame to the end of sequence
-        m_aVideoFrames.push_back(ssi);
-    }
-    else
-    {
-        // Replace existing frame
-
-        /*size_t j;
-        for(j=0; j<m_aVideoFrames[nFrameId].m_aMonitors.size(); j++)
-        {
-        Utility::RecycleFile(m_aVideoFrames[nFrameId].m_aMonitors[j].m_sFileName, TRUE);
-        }*/
-
-        m_aVideoFrames[nFrameId]=ssi;
-    }
-}
-
-BOOL CVideoRecorder::EncodeVideo()
-{
-    // This method encodes all raw BMP files
-    // into a single OGG file.
-
-    FILE* fout = NULL;
-    ogg_stream_state to; /* take physical pages, weld into a logical
-                         stream of packets */
-    ogg_page         og; /* one Ogg bitstream page.  Vorbis packets are inside */
-    ogg_packet       op; /* one raw packet of data for decode */
-
-    th_enc_ctx      *td = NULL;
-    th_info          ti;
-    th_comment       tc;
-    int frame_avail = 0;
-    th_ycbcr_buffer raw;
-    int frame_cnt = 0;
     int nFrameWidth = 0;
     int nFrameHeight = 0;
-    int ret = 1;
-
-    memset(&to, 0, sizeof(to));
-    memset(&og, 0, sizeof(og));
-    memset(&op, 0, sizeof(op));
-    memset(&tc, 0, sizeof(tc));
 
-    // Clear frame buffer
-    memset(&raw, 0, sizeof(raw));
-
-    /* Determine max screen size, it will define frame width and height */
-    SIZE ScreenSize={0,0};
-    size_t i;
-    for(i=0; i<m_aVideoFrames.size(); i++)
+    if(ScreenSize.cx<=0 || ScreenSize.cy<=0)
     {
-        ScreenshotInfo& ssi = m_aVideoFrames[i];
-        if(ScreenSize.cx<ssi.m_rcVirtualScreen.Width() ||
-           ScreenSize.cy<ssi.m_rcVirtualScreen.Height())
-        {
-            ScreenSize.cx = ssi.m_rcVirtualScreen.Width();
-            ScreenSize.cy = ssi.m_rcVirtualScreen.Height();
-        }
+        ScreenSize.cx = 640;
+        ScreenSize.cy = 480;
     }
 
+    float ratio = (float)ScreenSize.cx/(float)ScreenSize.cy;
+
     // Check if desired frame size is not specified
     if(m_DesiredFrameSize.cx==0 && m_DesiredFrameSize.cy==0)
     {
-        // Determine frame size automatically
+        // Determine frame size automatically, scaling large screens down
         nFrameWidth = ScreenSize.cx;
         nFrameHeight = ScreenSize.cy;
+        if(nFrameWidth>VIDEO_MAX_AUTO_FRAME_WIDTH)
+        {
+            nFrameWidth = VIDEO_MAX_AUTO_FRAME_WIDTH;
+            nFrameHeight = (int)ceil(nFrameWidth/ratio-0.5f);
+        }
+        if(nFrameHeight>VIDEO_MAX_AUTO_FRAME_HEIGHT)
+        {
+            nFrameHeight = VIDEO_MAX_AUTO_FRAME_HEIGHT;
+            nFrameWidth = (int)ceil(nFrameHeight*ratio-0.5f);
+        }
     }
     else
     {
@@ -237,259 +422,191 @@ BOOL CVideoRecorder::EncodeVideo()
         if(m_DesiredFrameSize.cy!=0)
             nFrameHeight=m_DesiredFrameSize.cy;
 
-        float ratio = (float)ScreenSize.cx/(float)ScreenSize.cy;
         if(m_DesiredFrameSize.cx==0)
         {
             nFrameWidth = (int)ceil(nFrameHeight*ratio-0.5f);
         }
-        else if(m_DesiredFrameSize.cy!=0)
+        else if(m_DesiredFrameSize.cy==0)
         {
             nFrameHeight = (int)ceil(nFrameWidth/ratio-0.5f);
         }
     }
 
     /* Theora encoder has a divisible-by-sixteen restriction for the encoded frame size */
-    /* scale the picture size up to the nearest /16 and calculate offsets */
-    nFrameWidth=nFrameWidth+15&~0xF;
-    nFrameHeight=nFrameHeight+15&~0xF;
-
-    /* Set up Ogg output stream */
-    srand((unsigned int)time(NULL));
-    ogg_stream_init(&to,rand());
-
-    // Fill in a th_info structure with details on the format of the video you wish to encode.
-    th_info_init(&ti);
-    ti.frame_width=nFrameWidth;
-    ti.frame_height=nFrameHeight;
-    ti.pic_width=nFrameWidth;
-    ti.pic_height=nFrameHeight;
-    ti.pic_x=0;
-    ti.pic_y=0;
-    ti.fps_numerator=1000;
-    ti.fps_denominator=m_nVideoFrameInterval;
-    ti.aspect_numerator=0;
-    ti.aspect_denominator=0;
-    ti.colorspace=TH_CS_UNSPECIFIED;
-    ti.target_bitrate=0; // VBR mode at specified video quality
-    ti.quality=m_nVideoQuality;
-    ti.keyframe_granule_shift=6;
-    ti.pixel_fmt=TH_PF_420;
-
-    // Allocate a th_enc_ctx handle with th_encode_alloc().
-    td=th_encode_alloc(&ti);
-    th_info_clear(&ti);
-
-    /*Allocate YV12 image */
-    int nDataSize = (nFrameWidth*nFrameHeight*3)/2;
-    unsigned char* pImageData = new unsigned char[nDataSize];
-    raw[0].data = pImageData;
-    raw[0].width = nFrameWidth;
-    raw[0].height = nFrameHeight;
-    raw[0].stride = nFrameWidth;
-    raw[1].data = pImageData+nFrameWidth*nFrameHeight;
-    raw[1].width = nFrameWidth/2;
-    raw[1].height = nFrameHeight/2;
-    raw[1].stride = nFrameWidth/2;
-    raw[2].data = pImageData+nFrameWidth*nFrameHeight*5/4;
-    raw[2].width = nFrameWidth/2;
-    raw[2].height = nFrameHeight/2;
-    raw[2].stride = nFrameWidth/2;
+    /* scale the picture size up to the nearest /16 */
+    m_ActualFrameSize.cx=nFrameWidth+15&~0xF;
+    m_ActualFrameSize.cy=nFrameHeight+15&~0xF;
+}
 
+BOOL CVideoRecorder::IsInitialized()
+{
+    return m_bInitialized;
+}
+
+void CVideoRecorder::Destroy()
+{
+    // Stop encoding
+    StopEncoderThread();
+    if(m_hFrameEvent)
     {
-        /*Open output file */
-        CString sFileName = m_sSaveToDir + _T("\\video.ogg");
-        m_sOutFile = sFileName;
-        _tfopen_s(&fout, sFileName, _T("wb"));
-        if(fout==NULL)
-            goto cleanup;
+        CloseHandle(m_hFrameEvent);
+        m_hFrameEvent = NULL;
+    }
+    m_Encoder.Destroy();
+    std::vector<BYTE>().swap(m_aEncoderFrame);
 
-        /* write the bitstream header packets with proper page interleave */
-        th_comment_init(&tc);
-        // Repeatedly call th_encode_flushheader() to retrieve all the header packets.
-        // first packet will get its own page automatically
-        if(th_encode_flushheader(td,&tc,&op)<=0)
-        {
-          // Internal Theora library error.
-          goto cleanup;
-        }
+    // Free recorded frames
+    m_FrameRing.Destroy();
 
-        /* Write OGG page */
-        ogg_stream_packetin(&to,&op);
-        if(ogg_stream_pageout(&to,&og)!=1)
-        {
-            goto cleanup;
-        }
-        fwrite(og.header,1,og.header_len,fout);
-        fwrite(og.body,1,og.body_len,fout);
+    // Free frame bitmap
+    if(m_hDC)
+    {
+        SelectObject(m_hDC, m_hOldBitmap);
+        DeleteDC(m_hDC);
+        m_hDC = NULL;
+    }
 
-        /* create the remaining theora headers */
-        for(;;)
-        {
-          ret=th_encode_flushheader(td,&tc,&op);
-          if(ret<0)
-          {
-            // Internal Theora library error
-            goto cleanup;
-          }
-          else if(!ret)
-              break;
-          ogg_stream_packetin(&to,&op);
-        }
+    if(m_hbmpFrame)
+    {
+        DeleteObject(m_hbmpFrame);
+        m_hbmpFrame = NULL;
+        m_pFrameBits = NULL;
+    }
 
-        /* Write OGG page */
-        for(;;)
-        {
-            int ret = ogg_stream_flush(&to,&og);
-            if(ret==0)
-                break;
-            if(ret<0)
-                goto cleanup;
-            fwrite(og.header,1,og.header_len,fout);
-            fwrite(og.body,1,og.body_len,fout);
-        }
+    if(m_pDIB)
+    {
+        delete [] (BYTE*)m_pDIB;
+        m_pDIB = NULL;
+    }
 
-        /* Encode frames. */
-        int nFrame = m_nFrameId; // Start with the oldest frame
-        if(nFrame==(int)m_aVideoFrames.size())
-            nFrame=0; // Start from the zeroth frame
-        for( ; ; )
-        {
-            /* Compose frame */
-            frame_avail = ComposeFrame(nFrame, &raw);
-
-            // Encode frame
-            if(th_encode_ycbcr_in(td, raw))
-            {
-                goto cleanup;
-            }
-
-            // Read packets
-            while((ret = th_encode_packetout(td, !frame_avail, &op))!=0)
-            {
-                /* Write OGG page */
-                ogg_stream_packetin(&to,&op);
-                int ret = ogg_stream_pageout(&to,&og);
-                if(ret<0)
-                    goto cleanup;
-                if(ret!=0)
-                {
-                    fwrite(og.header,1,og.header_len,fout);
-                    fwrite(og.body,1,og.body_len,fout);
-                }
-            }
-
-            // Increment total encoded frame count
-            if(frame_avail)
-                frame_cnt++;
-            else
-                break;
-
-            // Increment frame index
-            nFrame++;
-            if(nFrame==(int)m_aVideoFrames.size())
-                nFrame=0; // Start from the zeroth frame
-
-            if(nFrame==m_nFrameId || frame_cnt>=(int)m_aVideoFrames.size())
-                break; // All frames have been encoded
-        }
+    m_bInitialized=FALSE;
+}
 
-        /* Write OGG page */
-        for(;;)
-        {
-            int ret = ogg_stream_flush(&to,&og);
-            if(ret==0)
-                break;
-            if(ret<0)
-                goto cleanup;
-            fwrite(og.header,1,og.header_len,fout);
-            fwrite(og.body,1,og.body_len,fout);
-        }
+BOOL CVideoRecorder::RecordVideoFrame()
+{
+    // The following method records a single video frame and returns.
+
+    if(!m_bInitialized)
+        return FALSE;
+
+    ScreenshotInfo ssi; // Screenshot params
+
+    // Take the screen shot scaled down to the frame size.
+    BOOL bTakeScreenshot = m_sc.CaptureDesktopFrame(
+        m_hDC, m_ActualFrameSize,
+        ssi, m_ScreenshotType, m_dwProcessId);
+    if(bTakeScreenshot==FALSE)
+    {
+        // Failed to take screenshot
+        return FALSE;
     }
 
-cleanup:
+    // Make sure GDI has finished drawing to the frame bitmap
+    GdiFlush();
 
-    /* Free codec resources */
-    ogg_stream_clear(&to);
-    th_comment_clear(&tc);
-    th_encode_free(td);
+    // Add the frame to the ring (the oldest frames are dropped as needed,
+    // if the encoder thread doesn't keep up)
+    BOOL bAdded;
+    {
+        CAutoLock lock(&m_csFrameRing);
+        bAdded = m_FrameRing.AddFrame((const BYTE*)m_pFrameBits);
+    }
 
-    // Close file
-    if(fout)
-        fclose(fout);
+    // Wake up the encoder thread
+    if(m_hFrameEvent)
+        SetEvent(m_hFrameEvent);
 
-    if(raw[0].data)
-        delete [] raw[0].data;
+    return bAdded;
+}
 
-    // Delete temp files.
-    CString sDirName = m_sSaveToDir + _T("\\~temp_video");
-    Utility::RecycleFile(sDirName, true);
+BOOL CVideoRecorder::PopFrame(LPBYTE pFrame)
+{
+    CAutoLock lock(&m_csFrameRing);
+    return m_FrameRing.PopFrame(pFrame);
+}
 
-    // Done
-    return TRUE;
+DWORD WINAPI CVideoRecorder::EncoderThread(LPVOID lpParam)
+{
+    CVideoRecorder* pSelf = (CVideoRecorder*)lpParam;
+
+    for(;;)
+    {
+        // Wait for new frames
+        WaitForSingleObject(pSelf->m_hFrameEvent, INFINITE);
+
+        // Encode all frames in the ring
+        while(!pSelf->m_bStopEncoder && pSelf->PopFrame(&pSelf->m_aEncoderFrame[0]))
+        {
+            pSelf->m_Encoder.EncodeFrame(&pSelf->m_aEncoderFrame[0], pSelf->m_nFrameStride);
+        }
+
+        if(pSelf->m_bStopEncoder)
+            break;
+    }
+
+    return 0;
 }
 
-BOOL CVideoRecorder::ComposeFrame(int nFrameId, th_ycbcr_buffer *pImage)
+void CVideoRecorder::StopEncoderThread()
 {
-    // This method composes several bitmaps into single frame image
+    if(m_hEncoderThread==NULL)
+        return;
+
+    // Tell the thread to exit and wait until it does
+    InterlockedExchange(&m_bStopEncoder, TRUE);
+    SetEvent(m_hFrameEvent);
+    WaitForSingleObject(m_hEncoderThread, INFINITE);
+    CloseHandle(m_hEncoderThread);
+    m_hEncoderThread = NULL;
+}
 
-    // Validate input
-    if(nFrameId<0 || nFrameId>=(int)m_aVideoFrames.size())
-        return FALSE;
+BOOL CVideoRecorder::EncodeVideo()
+{
+    // This method encodes the frames not encoded yet and writes
+    // the most recent part of video into a single OGG file.
+
+    BOOL bStatus = FALSE;
+    FILE* fout = NULL;
 
-    if(pImage==NULL)
+    if(!m_bInitialized)
         return FALSE;
 
-    if(m_hbmpFrame==NULL)
+    // Recording is over, so stop the encoder thread and encode the rest of frames
+    // here. Frames are restored from the ring right into the frame bitmap.
+    StopEncoderThread();
+    while(PopFrame((LPBYTE)m_pFrameBits))
     {
-        // Calculate frame size
-
-        CreateFrameDIB(pImage[0]->width, pImage[0]->height, 24);
+        if(!m_Encoder.EncodeFrame((const unsigned char*)m_pFrameBits, m_nFrameStride))
+            goto cleanup;
     }
 
-    // Walk through monitor bitmaps
-    ScreenshotInfo& ssi = m_aVideoFrames[nFrameId];
-    size_t i;
-    for(i=0; i<ssi.m_aMonitors.size(); i++)
     {
-        // Load image from BMP
-        CString sFileName = ssi.m_aMonitors[i].m_sFileName;
-        HBITMAP hBitmap = LoadBitmapFromBMPFile(sFileName);
-        if(hBitmap)
-        {
-            // Create temp DC
-            HDC hMemDC = CreateCompatibleDC(m_hDC);
-            // Select loaded bitmap into DC
-            HBITMAP hOldBitmap = (HBITMAP)SelectObject(hMemDC, hBitmap);
-
-            float x_ratio = (float)pImage[0]->width/(float)ssi.m_rcVirtualScreen.Width();
-            float y_ratio = (float)pImage[0]->height/(float)ssi.m_rcVirtualScreen.Height();
-            int xDest = (int)ceil((ssi.m_aMonitors[i].m_rcMonitor.left +  abs(ssi.m_rcVirtualScreen.left))*x_ratio-0.5);
-            int yDest = (int)ceil((ssi.m_aMonitors[i].m_rcMonitor.top + abs(ssi.m_rcVirtualScreen.top))*y_ratio-0.5);
-            int wDest = (int)ceil(ssi.m_aMonitors[i].m_rcMonitor.Width()*x_ratio-0.5);
-            int hDest = (int)ceil(ssi.m_aMonitors[i].m_rcMonitor.Height()*y_ratio-0.5);
-
-            // Copy bitmap to its destination rect
-            int nOldMode = SetStretchBltMode(m_hDC, HALFTONE);
-            StretchBlt(m_hDC, xDest, yDest, wDest, hDest, hMemDC, 0, 0,
-                ssi.m_aMonitors[i].m_rcMonitor.Width(), ssi.m_aMonitors[i].m_rcMonitor.Height(), SRCCOPY);
-            SetStretchBltMode(m_hDC, nOldMode);
-
-            // Select old bitmap into DC
-            SelectObject(hMemDC, hOldBitmap);
-            // Free DC
-            DeleteDC(hMemDC);
-            // Free loaded bitmap
-            DeleteObject(hBitmap);
-        }
+        /*Open output file */
+        CString sFileName = m_sSaveToDir + _T("\\video.ogg");
+        m_sOutFile = sFileName;
+        _tfopen_s(&fout, sFileName, _T("wb"));
+        if(fout==NULL)
+            goto cleanup;
+
+        // Finalize the last frame and write the kept pages
+        if(!m_Encoder.Finish(fout))
+            goto cleanup;
     }
 
-    // Convert RGB to YV12
-    RGB_To_YV12((unsigned char*)m_pFrameBits,
-        pImage[0]->width, pImage[0]->height,
-        pImage[0]->width*3+(pImage[0]->width*3)%4,
-        (*pImage)[0].data, (*pImage)[1].data, (*pImage)[2].data);
+    bStatus = TRUE;
 
-    return TRUE;
+cleanup:
+
+    // Close file
+    if(fout)
+        fclose(fout);
+
+    // Free encoder and recorded frames.
+    m_Encoder.Destroy();
+    m_FrameRing.Destroy();
+
+    // Done
+    return bStatus;
 }
 
 BOOL CVideoRecorder::CreateFrameDIB(DWORD dwWidth, DWORD dwHeight, int nBits)
@@ -531,80 +648,21 @@ BOOL CVideoRecorder::CreateFrameDIB(DWORD dwWidth, DWORD dwHeight, int nBits)
         lpColors[i].rgbReserved=0;
     }
 
-    m_hDC = CreateCompatibleDC(GetDC(NULL));
+    HDC hScreenDC = GetDC(NULL);
+    m_hDC = CreateCompatibleDC(hScreenDC);
+    ReleaseDC(NULL, hScreenDC);
 
     m_hbmpFrame = CreateDIBSection(m_hDC, m_pDIB, DIB_RGB_COLORS, &m_pFrameBits,
         NULL, 0);
+    if(m_hbmpFrame==NULL)
+        return FALSE;
 
     m_hOldBitmap = (HBITMAP)SelectObject(m_hDC, m_hbmpFrame);
 
     return TRUE;
 }
 
-HBITMAP CVideoRecorder::LoadBitmapFromBMPFile(LPCTSTR szFileName)
-{
-    // This method loads a BMP file.
-
-    // Use LoadImage() to get the image loaded into a DIBSection
-    HBITMAP hBitmap = (HBITMAP)LoadImage( NULL, szFileName, IMAGE_BITMAP, 0, 0,
-        LR_CREATEDIBSECTION | LR_DEFAULTSIZE | LR_LOADFROMFILE );
-
-    return hBitmap;
-}
-
 CString CVideoRecorder::GetOutFile()
 {
     return m_sOutFile;
 }
-
-void CVideoRecorder::RGB_To_YV12( unsigned char *pRGBData, int nFrameWidth,
-    int nFrameHeight, int nRGBStride, unsigned char *pFullYPlane,
-    unsigned char *pDownsampledUPlane,
-    unsigned char *pDownsampledVPlane )
-{
-    // Convert RGB -> YV12. We do this in-place to avoid allocating any more memory.
-    unsigned char *pYPlaneOut = (unsigned char*)pFullYPlane;
-    int nYPlaneOut = 0;
-
-    int x, y;
-    for(y=0; y<nFrameHeight;y++)
-    {
-        for (x=0; x < nFrameWidth; x ++)
-        {
-            int nRGBOffs = y*nRGBStride+x*3;
-
-            unsigned char B = pRGBData[nRGBOffs+0];
-            unsigned char G = pRGBData[nRGBOffs+1];
-            unsigned char R = pRGBData[nRGBOffs+2];
-
-            float y = (float)( R*66 + G*129 + B*25 + 128 ) / 256 + 16;
-            float u = (float)( R*-38 + G*-74 + B*112 + 128 ) / 256 + 128;
-            float v = (float)( R*112 + G*-94 + B*-18 + 128 ) / 256 + 128;
-
-            // NOTE: We're converting pRGBData to YUV in-place here as well as writing out YUV to pFullYPlane/pDownsampledUPlane/pDownsampledVPlane.
-            pRGBData[nRGBOffs+0] = (unsigned char)y;
-            pRGBData[nRGBOffs+1] = (unsigned char)u;
-            pRGBData[nRGBOffs+2] = (unsigned char)v;
-
-            // Write out the Y plane directly here rather than in another loop.
-            pYPlaneOut[nYPlaneOut++] = pRGBData[nRGBOffs+0];
-        }
-    }
-
-    // Downsample to U and V.
-    int halfHeight = nFrameHeight/2;
-    int halfWidth = nFrameWidth/2;
-
-    for ( int yPixel=0; yPixel < halfHeight; yPixel++ )
-    {
-        int iBaseSrc = ( (yPixel*2) * nRGBStride );
-
-        for ( int xPixel=0; xPixel < halfWidth; xPixel++ )
-        {
-            pDownsampledVPlane[yPixel * halfWidth + xPixel] = pRGBData[iBaseSrc + 2];
-            pDownsampledUPlane[yPixel * halfWidth + xPixel] = pRGBData[iBaseSrc + 1];
-
-            iBaseSrc += 6;
-        }
-    }
-}
@@ -16,11 +16,86 @@ be found in the Authors.txt file in the root of the source tree.
 #pragma once
 #include "stdafx.h"
 #include "ScreenCap.h"
-#include "theora/theoraenc.h"
+#include "VideoEncoder.h"
+#include "CritSec.h"
+#include "zlib.h"
+#include <deque>
+
+// Default limit of memory used to keep recorded video frames (in bytes).
+#define VIDEO_DEFAULT_MAX_MEMORY (64*1024*1024)
+
+// When frame size is determined automatically, frames are scaled down to fit this size.
+#define VIDEO_MAX_AUTO_FRAME_WIDTH  1920
+#define VIDEO_MAX_AUTO_FRAME_HEIGHT 1080
+
+// class CVideoFrameRing
+// Keeps the most recent video frames in memory. The oldest frame is kept uncompressed,
+// each next frame is kept as a zlib-compressed XOR delta against the previous one.
+// Desktop usually changes a little between frames, so deltas are mostly zero bytes
+// and compress very well.
+//
+class CVideoFrameRing
+{
+public:
+
+	// Constructor
+	CVideoFrameRing();
+
+	// Destructor
+	~CVideoFrameRing();
+
+	// Allocates buffers for frames of dwFrameSize bytes. The oldest frames are dropped
+	// when there are more than nMaxFrames of them or when the ring takes more than
+	// uMaxMemory bytes. At least the latest frame is always kept.
+	BOOL Init(DWORD dwFrameSize, int nMaxFrames, ULONG64 uMaxMemory);
+
+	// Frees all frames and buffers.
+	void Destroy();
+
+	// Adds a frame to the end of the ring.
+	BOOL AddFrame(const BYTE* pFrame);
+
+	// Returns count of frames in the ring.
+	int GetFrameCount();
+
+	// Returns count of bytes taken by the ring.
+	ULONG64 GetMemoryUsage();
+
+	// Restores a frame. Frames must be read in order, starting from the oldest one (zero),
+	// into the same buffer, because each frame is restored from the previous one.
+	BOOL ReadFrame(int nFrame, LPBYTE pFrame);
+
+	// Restores the oldest frame and removes it from the ring.
+	// Returns FALSE if the ring is empty.
+	BOOL PopFrame(LPBYTE pFrame);
+
+private:
+
+	// Unpacks the delta and applies it to the frame.
+	BOOL ApplyDelta(const std::vector<BYTE>& aDelta, LPBYTE pFrame);
+
+	// Drops the oldest frame.
+	BOOL DropOldestFrame();
+
+	DWORD m_dwFrameSize;         // Size of a frame.
+	int m_nMaxFrames;            // Max count of frames.
+	ULONG64 m_uMaxMemory;        // Max count of bytes taken by the ring.
+	int m_nFrameCount;           // Count of frames in the ring.
+	std::vector<BYTE> m_aFirst;  // The oldest frame.
+	std::vector<BYTE> m_aLast;   // The latest frame.
+	std::vector<BYTE> m_aPacked; // Buffer for compressing a delta.
+	std::deque<std::vector<BYTE> > m_aDeltas; // Deltas of the rest of frames (empty if frame is unchanged).
+	ULONG64 m_uDeltaSize;        // Total size of deltas.
+	z_stream m_zs;               // Deflate stream used for compressing deltas.
+	BOOL m_bDeflateInit;         // Whether m_zs is initialized.
+};
 
 // class CVideoRecorder
-// Captures desktop and writes the video frames as raw uncompressed BMP files
-// Later the recorded frames are encoded to a libtheora-encoded video file.
+// Captures desktop and puts the video frames, scaled down to the video frame size,
+// to an in-memory frame ring. A low-priority worker thread takes frames from the ring
+// and encodes them with Theora codec as they come, keeping the most recent part of
+// the encoded video in memory. When the video is requested, only the frames not
+// encoded yet are encoded, and the video file is written.
 //
 class CVideoRecorder
 {
@@ -39,18 +114,19 @@ public:
 			int nVideoDuration,
 			int nVideoFrameInterval,
 			int nVideoQuality,
-			SIZE* pDesiredFrameSize
+			SIZE* pDesiredFrameSize,
+			ULONG64 uMaxMemory
 			);
 
 	BOOL IsInitialized();
 
-	// Deletes all temp files and frees used resources.
+	// Frees recorded frames and used resources.
 	void Destroy();
 
 	// Records a single video frame
 	BOOL RecordVideoFrame();
 
-	// Encodes the video with VP8 codec and writes .webm file.
+	// Stops recording, encodes the rest of frames and writes .ogg file.
 	BOOL EncodeVideo();
 
 	// Returns the output file name
@@ -58,39 +134,42 @@ public:
 
 private:
 
-	// Sets video frame parameters.
-	void SetVideoFrameInfo(int nFrameId, ScreenshotInfo& ssi);
-
-	// Composes video frame from one or several bitmaps.
-	BOOL ComposeFrame(int nFrameId, th_ycbcr_buffer* raw);
+	// Calculates video frame size based on the screen size and the desired frame size.
+	void CalcFrameSize(SIZE ScreenSize);
 
 	// Creates a device-independent bitmap (DIB) used as video frame
 	BOOL CreateFrameDIB(DWORD dwWidth, DWORD dwHeight,int nBits);
 
-	// Loads a BMP file and returns its data.
-	HBITMAP LoadBitmapFromBMPFile(LPCTSTR szFileName);
+	// Encoder thread procedure.
+	static DWORD WINAPI EncoderThread(LPVOID lpParam);
+
+	// Stops the encoder thread and waits until it exits.
+	void StopEncoderThread();
 
-	// Converts an RGB24 image to YV12 image.
-	void RGB_To_YV12( unsigned char *pRGBData, int nFrameWidth,
-				int nFrameHeight, int nRGBStride, unsigned char *pFullYPlane,
-				unsigned char *pDownsampledUPlane, unsigned char *pDownsampledVPlane );
+	// Takes the oldest frame from the frame ring (thread-safe).
+	BOOL PopFrame(LPBYTE pFrame);
 
 	/* Internal variables */
 	BOOL m_bInitialized;  // Init flag.
-	CString m_sSaveToDir; // Directory where to save recorded video frames.
-	CString m_sOutFile;   // Output webm file.
+	CString m_sSaveToDir; // Directory where to save the video file.
+	CString m_sOutFile;   // Output ogg file.
 	SCREENSHOT_TYPE m_ScreenshotType; // What part of desktop is captured.
 	CScreenCapture m_sc;  // Screen capture object
-	std::vector<ScreenshotInfo> m_aVideoFrames; // Array of recorded video frames.
+	CVideoFrameRing m_FrameRing; // Recorded video frames not encoded yet.
+	CCritSec m_csFrameRing; // Protects the frame ring.
+	CTheoraEncoder m_Encoder; // Video encoder.
+	HANDLE m_hEncoderThread; // Encoder thread.
+	HANDLE m_hFrameEvent; // Signaled when a frame is added to the ring.
+	volatile LONG m_bStopEncoder; // Tells the encoder thread to exit.
+	std::vector<BYTE> m_aEncoderFrame; // Frame buffer of the encoder thread.
 	SIZE m_DesiredFrameSize; // Desired frame size.
 	SIZE m_ActualFrameSize;  // Actual frame size.
+	int m_nFrameStride;   // Count of bytes in a frame row.
 	int m_nVideoQuality;  // Video quality.
 	int m_nVideoDuration; // Video duration (in msec)
 	int m_nVideoFrameInterval; // Interval between two subsequent frames (in msec).
 	DWORD m_dwProcessId;  // ID of the process being captured.
 	int m_nFrameCount;    // Total max count of frames.
-	int m_nFileId;        // Index of current BMP file.
-	int m_nFrameId;       // Index of current video frame.
 	HBITMAP m_hbmpFrame;  // Video frame bitmap.
 	LPVOID m_pFrameBits;  // Frame buffer.
 	LPBITMAPINFO m_pDIB;  // Bitmap info.
@@ -0,0 +1,260 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+#include "XmlWriter.h"
+#include <string.h>
+
+// Size of the output buffer used when writing to a file.
+#define XML_WRITER_BUFFER_SIZE (64*1024)
+
+// Non-zero for characters that must be replaced by references
+// (markup characters and control characters, as TinyXML does).
+static const unsigned char g_EscapeTable[256] =
+{
+    1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1, 1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,
+    0,0,1,0,0,0,1,1,0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0,0,0,0,0,1,0,1,0,
+};
+
+CXmlWriter::CXmlWriter()
+{
+    m_pFile = NULL;
+    m_uUsed = 0;
+    m_uTotal = 0;
+    m_bStartTagOpen = false;
+    m_bOk = true;
+}
+
+CXmlWriter::~CXmlWriter()
+{
+    Flush();
+}
+
+void CXmlWriter::Attach(FILE* f)
+{
+    m_pFile = f;
+    m_uUsed = 0;
+    m_uTotal = 0;
+    m_sNames.clear();
+    m_aNameOffs.clear();
+    m_bStartTagOpen = false;
+    m_bOk = true;
+
+    if(m_pFile!=NULL && m_aBuffer.size()<XML_WRITER_BUFFER_SIZE)
+        m_aBuffer.resize(XML_WRITER_BUFFER_SIZE);
+}
+
+void CXmlWriter::Put(const char* pData, size_t uSize)
+{
+    m_uTotal += uSize;
+
+    if(m_uUsed+uSize>m_aBuffer.size())
+    {
+        if(m_pFile==NULL)
+        {
+            // Memory output grows as needed
+            size_t uNewSize = m_aBuffer.size()*2;
+            if(uNewSize<m_uUsed+uSize)
+                uNewSize = m_uUsed+uSize+256;
+            m_aBuffer.resize(uNewSize);
+        }
+        else
+        {
+            Flush();
+            if(uSize>m_aBuffer.size())
+            {
+                // Big pieces go to the file directly
+                if(fwrite(pData, 1, uSize, m_pFile)!=uSize)
+                    m_bOk = false;
+                return;
+            }
+        }
+    }
+
+    memcpy(&m_aBuffer[m_uUsed], pData, uSize);
+    m_uUsed += uSize;
+}
+
+void CXmlWriter::PutEscaped(const char* szText)
+{
+    const unsigned char* p = (const unsigned char*)szText;
+    for(;;)
+    {
+        // Copy characters that don't need replacing at once
+        const unsigned char* pStart = p;
+        while(*p!=0 && !g_EscapeTable[*p])
+            p++;
+        if(p!=pStart)
+            Put((const char*)pStart, p-pStart);
+
+        if(*p==0)
+            break;
+
+        switch(*p)
+        {
+        case '&': Put("&amp;", 5); break;
+        case '<': Put("&lt;", 4); break;
+        case '>': Put("&gt;", 4); break;
+        case '\"': Put("&quot;", 6); break;
+        case '\'': Put("&apos;", 6); break;
+        default:
+            {
+                static const char szDigits[] = "0123456789ABCDEF";
+                char szRef[7] = {'&', '#', 'x', szDigits[*p>>4], szDigits[*p&0xF], ';', 0};
+                Put(szRef, 6);
+            }
+        }
+        p++;
+    }
+}
+
+void CXmlWriter::CloseStartTag()
+{
+    if(m_bStartTagOpen)
+    {
+        Put(">\n", 2);
+        m_bStartTagOpen = false;
+    }
+}
+
+void CXmlWriter::PutIndent()
+{
+    static const char szSpaces[] = "                                ";
+    size_t uIndent = m_aNameOffs.size()*4;
+    while(uIndent!=0)
+    {
+        size_t uPart = uIndent<sizeof(szSpaces)-1 ? uIndent : sizeof(szSpaces)-1;
+        Put(szSpaces, uPart);
+        uIndent -= uPart;
+    }
+}
+
+void CXmlWriter::WriteDeclaration(bool bBOM)
+{
+    if(bBOM)
+        Put("\xEF\xBB\xBF", 3);
+    const char szDecl[] = "<?xml version=\"1.0\" encoding=\"UTF-8\" ?>\n";
+    Put(szDecl, sizeof(szDecl)-1);
+}
+
+void CXmlWriter::StartElement(const char* szName)
+{
+    CloseStartTag();
+    PutIndent();
+    Put("<", 1);
+    Put(szName, strlen(szName));
+
+    m_aNameOffs.push_back(m_sNames.size());
+    m_sNames.append(szName, strlen(szName)+1);
+    m_bStartTagOpen = true;
+}
+
+void CXmlWriter::ResumeElement(const char* szName)
+{
+    CloseStartTag();
+    m_aNameOffs.push_back(m_sNames.size());
+    m_sNames.append(szName, strlen(szName)+1);
+}
+
+void CXmlWriter::AddAttribute(const char* szName, const char* szValue)
+{
+    if(!m_bStartTagOpen)
+        return; // Content of the element has begun already
+
+    Put(" ", 1);
+    Put(szName, strlen(szName));
+    Put("=\"", 2);
+    PutEscaped(szValue);
+    Put("\"", 1);
+}
+
+void CXmlWriter::AddAttribute(const char* szName, int nValue)
+{
+    char szValue[16];
+    sprintf(szValue, "%d", nValue);
+    AddAttribute(szName, szValue);
+}
+
+void CXmlWriter::EndElement()
+{
+    if(m_aNameOffs.empty())
+        return;
+
+    size_t uOffs = m_aNameOffs.back();
+    m_aNameOffs.pop_back();
+
+    if(m_bStartTagOpen)
+    {
+        // Element has no content
+        Put(" />\n", 4);
+        m_bStartTagOpen = false;
+    }
+    else
+    {
+        const char* szName = m_sNames.c_str()+uOffs;
+        PutIndent();
+        Put("</", 2);
+        Put(szName, strlen(szName));
+        Put(">\n", 2);
+    }
+
+    m_sNames.resize(uOffs);
+}
+
+void CXmlWriter::WriteElement(const char* szName, const char* szText)
+{
+    size_t uNameLen = strlen(szName);
+    CloseStartTag();
+    PutIndent();
+    Put("<", 1);
+    Put(szName, uNameLen);
+    Put(">", 1);
+    PutEscaped(szText);
+    Put("</", 2);
+    Put(szName, uNameLen);
+    Put(">\n", 2);
+}
+
+void CXmlWriter::WriteElement(const char* szName, int nValue)
+{
+    char szValue[16];
+    sprintf(szValue, "%d", nValue);
+    WriteElement(szName, szValue);
+}
+
+bool CXmlWriter::Flush()
+{
+    if(m_pFile!=NULL && m_uUsed!=0)
+    {
+        if(fwrite(&m_aBuffer[0], 1, m_uUsed, m_pFile)!=m_uUsed)
+            m_bOk = false;
+        m_uUsed = 0;
+    }
+    return m_bOk;
+}
+
+bool CXmlWriter::IsOk() const
+{
+    return m_bOk;
+}
+
+const char* CXmlWriter::GetData() const
+{
+    return m_uUsed!=0 ? &m_aBuffer[0] : "";
+}
+
+size_t CXmlWriter::GetSize() const
+{
+    return m_uUsed;
+}
+
+unsigned long long CXmlWriter::GetTotalSize() const
+{
+    return m_uTotal;
+}
@@ -0,0 +1,100 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+// File: XmlWriter.h
+// Description: Streaming XML writer. Elements are written to the output as soon as
+// they are added, so documents of any size are written in one pass without building a tree.
+// The output is formatted the same way as TinyXML formats it.
+// This file doesn't depend on Windows headers, so it can be built and tested anywhere.
+
+#pragma once
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+// Writes UTF-8 XML to a file or to memory.
+class CXmlWriter
+{
+public:
+
+    // Constructor.
+    CXmlWriter();
+
+    // Destructor. Flushes buffered output.
+    ~CXmlWriter();
+
+    // Starts writing to a file opened in binary mode (not closed by the writer).
+    // If the file is NULL, the output is kept in memory.
+    void Attach(FILE* f);
+
+    // Writes the XML declaration, preceded by the UTF-8 byte order mark if bBOM is true.
+    void WriteDeclaration(bool bBOM);
+
+    // Starts an element. Attributes may be added until its content begins.
+    void StartElement(const char* szName);
+
+    // Continues an element whose start tag was written before (used to append
+    // to an existing document). The element is then closed with EndElement().
+    void ResumeElement(const char* szName);
+
+    // Adds an attribute to the element just started.
+    void AddAttribute(const char* szName, const char* szValue);
+
+    // Adds an integer attribute to the element just started.
+    void AddAttribute(const char* szName, int nValue);
+
+    // Ends the element started last.
+    void EndElement();
+
+    // Writes an element containing text.
+    void WriteElement(const char* szName, const char* szText);
+
+    // Writes an element containing an integer.
+    void WriteElement(const char* szName, int nValue);
+
+    // Writes buffered output to the file. Returns false if writing failed.
+    bool Flush();
+
+    // Returns true if there were no write errors.
+    bool IsOk() const;
+
+    // Returns the output kept in memory (when there is no file).
+    const char* GetData() const;
+
+    // Returns the size of the output kept in memory.
+    size_t GetSize() const;
+
+    // Returns the count of bytes written since Attach().
+    unsigned long long GetTotalSize() const;
+
+private:
+
+    // Appends raw bytes to the output.
+    void Put(const char* pData, size_t uSize);
+
+    // Appends a string with special characters replaced by references.
+    void PutEscaped(const char* szText);
+
+    // Finishes the start tag of the current element, if it is still open.
+    void CloseStartTag();
+
+    // Appends indentation for the current depth.
+    void PutIndent();
+
+    FILE* m_pFile;                      // Output file (NULL if output is kept in memory).
+    std::vector<char> m_aBuffer;        // Buffered output.
+    size_t m_uUsed;                     // Bytes used in the buffer.
+    unsigned long long m_uTotal;        // Bytes written since Attach().
+    std::string m_sNames;               // Names of open elements, separated by zeroes.
+    std::vector<size_t> m_aNameOffs;    // Offsets of open element names.
+    bool m_bStartTagOpen;               // Is start tag of the current element not finished yet?
+    bool m_bOk;                         // Were all writes successful?
+};
@@ -38,6 +38,18 @@ be found in the Authors.txt file in the root of the source tree.
 #include "base64.h"
 #include <iostream>
 
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define BASE64_SSSE3
+#include <tmmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define BASE64_TARGET_SSSE3
+#else
+#include <cpuid.h>
+#define BASE64_TARGET_SSSE3 __attribute__((target("ssse3")))
+#endif
+#endif
+
 static const std::string base64_chars =
              "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
              "abcdefghijklmnopqrstuvwxyz"
@@ -143,4 +155,110 @@ std::string base64_decode(std::string const& encoded_string) {
   return ret;
 }
 
+size_t base64_mime_encoded_size(size_t in_len) {
+  size_t lines = (in_len + BASE64_MIME_LINE_BYTES - 1) / BASE64_MIME_LINE_BYTES;
+  return (in_len + 2) / 3 * 4 + lines * 2;
+}
+
+// Encodes complete groups of 3 bytes.
+static char* base64_encode_groups_scalar(unsigned char const* in, size_t groups, char* out) {
+  const char* chars = base64_chars.c_str();
+  while (groups--) {
+    out[0] = chars[in[0] >> 2];
+    out[1] = chars[((in[0] & 0x03) << 4) | (in[1] >> 4)];
+    out[2] = chars[((in[1] & 0x0f) << 2) | (in[2] >> 6)];
+    out[3] = chars[in[2] & 0x3f];
+    in += 3;
+    out += 4;
+  }
+  return out;
+}
+
+#ifdef BASE64_SSSE3
+
+static bool base64_has_ssse3() {
+#ifdef _MSC_VER
+  int info[4];
+  __cpuid(info, 1);
+  return (info[2] & (1 << 9)) != 0;
+#else
+  unsigned int eax, ebx, ecx, edx;
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+    return false;
+  return (ecx & (1 << 9)) != 0;
+#endif
+}
+
+static const bool base64_use_ssse3 = base64_has_ssse3();
+
+// Encodes 12 bytes into 16 characters. Reads 16 bytes of input.
+// See W. Mula, D. Lemire, "Faster Base64 Encoding and Decoding Using AVX2 Instructions".
+BASE64_TARGET_SSSE3
+static inline void base64_encode_12_ssse3(unsigned char const* in, char* out) {
+  __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in));
+
+  // Spread 3-byte groups over 32-bit lanes: [b a c b]
+  v = _mm_shuffle_epi8(v, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+
+  // Move each 6-bit index into its own byte
+  __m128i t0 = _mm_and_si128(v, _mm_set1_epi32(0x0fc0fc00));
+  __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+  __m128i t2 = _mm_and_si128(v, _mm_set1_epi32(0x003f03f0));
+  __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+  __m128i indices = _mm_or_si128(t1, t3);
+
+  // Translate indices to characters by adding a per-range offset
+  __m128i ranges = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+  __m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+  ranges = _mm_or_si128(ranges, _mm_and_si128(less, _mm_set1_epi8(13)));
+  const __m128i offsets = _mm_setr_epi8(
+    'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+    '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+  __m128i result = _mm_add_epi8(_mm_shuffle_epi8(offsets, ranges), indices);
+
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(out), result);
+}
+
+#endif
 
+size_t base64_mime_encode_block(unsigned char const* bytes_to_encode, size_t in_len, char* out) {
+  char* p = out;
+
+  while (in_len > 0) {
+    size_t line = in_len < BASE64_MIME_LINE_BYTES ? in_len : BASE64_MIME_LINE_BYTES;
+    size_t groups = line / 3;
+    size_t done = 0;
+
+#ifdef BASE64_SSSE3
+    // The vector kernel reads 4 bytes past its 12, so stop while there is enough input
+    if (base64_use_ssse3) {
+      while (groups - done >= 4 && (done + 4) * 3 + 4 <= in_len) {
+        base64_encode_12_ssse3(bytes_to_encode + done * 3, p);
+        done += 4;
+        p += 16;
+      }
+    }
+#endif
+
+    p = base64_encode_groups_scalar(bytes_to_encode + done * 3, groups - done, p);
+
+    // The final 1 or 2 bytes are padded
+    size_t rest = line - groups * 3;
+    if (rest) {
+      unsigned char const* in = bytes_to_encode + groups * 3;
+      unsigned char b1 = rest > 1 ? in[1] : 0;
+      *p++ = base64_chars[in[0] >> 2];
+      *p++ = base64_chars[((in[0] & 0x03) << 4) | (b1 >> 4)];
+      *p++ = rest > 1 ? base64_chars[(b1 & 0x0f) << 2] : '=';
+      *p++ = '=';
+    }
+
+    *p++ = '\r';
+    *p++ = '\n';
+
+    bytes_to_encode += line;
+    in_len -= line;
+  }
+
+  return p - out;
+}
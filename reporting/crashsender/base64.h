@@ -14,3 +14,16 @@ be found in the Authors.txt file in the root of the source tree.
 std::string base64_encode(unsigned char const* , unsigned int len, int split_count = 76, const char *split = "\r\n");
 std::string base64_decode(std::string const& s);
 
+// Streaming MIME encoding. Data is split into lines of BASE64_MIME_LINE_BYTES bytes,
+// each line is encoded into 76 characters followed by CRLF. Encoding the data in blocks
+// whose sizes (except the last one) are multiples of BASE64_MIME_LINE_BYTES gives the
+// same result as encoding it at once.
+#define BASE64_MIME_LINE_BYTES 57
+
+// Returns the count of characters base64_mime_encode_block() writes for in_len bytes.
+size_t base64_mime_encoded_size(size_t in_len);
+
+// Encodes a block of data into MIME lines. The output buffer should be at least
+// base64_mime_encoded_size(in_len) characters long. Returns the count of characters written.
+size_t base64_mime_encode_block(unsigned char const* bytes_to_encode, size_t in_len, char* out);
+
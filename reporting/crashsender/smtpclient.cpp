@@ -128,6 +128,36 @@ void CEmailMessage::SetText(LPCTSTR szText)
     m_sText = szText;
 }
 
+//----------------------------------------------------------
+// SmtpServerCaps, SmtpConnection and SmtpServerAddress impl
+//----------------------------------------------------------
+
+SmtpServerCaps::SmtpServerCaps()
+{
+    m_bESMTP = false;
+    m_bPipelining = false;
+    m_bChunking = false;
+    m_b8BitMime = false;
+    m_bBinaryMime = false;
+    m_bSize = false;
+    m_uMaxSize = 0;
+}
+
+SmtpConnection::SmtpConnection()
+{
+    m_sock = INVALID_SOCKET;
+    m_bChunked = false;
+    m_nPendingReplies = 0;
+}
+
+SmtpServerAddress::SmtpServerAddress()
+{
+    m_nFamily = AF_UNSPEC;
+    memset(&m_Addr, 0, sizeof(m_Addr));
+    m_nAddrLen = 0;
+    m_bTried = false;
+}
+
 //----------------------------------------------------------
 // CSmtpClient impl
 //----------------------------------------------------------
@@ -205,43 +235,93 @@ int CSmtpClient::SendEmail(CEmailMessage* msg)
 {
     m_scn->SetProgress(_T("Start sending email"), 0, false);
 
-    std::map<WORD, CString> host_list;
+    CString sStatusMsg;
+    std::vector<SmtpRecipientGroup> aGroups;
+    int nUnresolved = 0;
+    int nDelivered = 0;
+    int i;
+
+    // Check that all attachments exist
+    for(i=0; i<msg->GetAttachmentCount(); i++)
+    {
+        CString sFileName = msg->GetAttachment(i);
+        if(CheckAttachmentOK(sFileName)!=0)
+        {
+            // Some attachment file does not present
+            sStatusMsg.Format(_T("Attachment not found: %s"), (LPCTSTR) sFileName);
+            m_scn->SetProgress(sStatusMsg, 1);
+            m_scn->SetProgress(_T("Critical error detected."), 100, false);
+            return 2; // critical error
+        }
+    }
 
     // Check whether to use proxy server or to resolve SMTP server
     // address from MX record of domain.
     if(!m_sServer.IsEmpty())
     {
-        // Use proxy server
-        host_list[0] = m_sServer;
+        // Use proxy server for all recipients
+        aGroups.resize(1);
+        aGroups[0].m_HostList.insert(std::make_pair((WORD)0, m_sServer));
+        for(i=0; i<msg->GetRecipientCount(); i++)
+            aGroups[0].m_aRecipients.push_back(msg->GetRecipientAddress(i));
     }
     else
     {
-        // Resolve domain name(s) from DNS record
-        int res = ResolveSmtpServerName(msg->GetRecipientAddress(0), host_list);
-        if(res!=0)
+        // Resolve domain name(s) from DNS record. Recipients whose domains are
+        // served by the same MX hosts are delivered through a single connection.
+        std::map<CString, std::multimap<WORD, CString> > domains;
+        for(i=0; i<msg->GetRecipientCount(); i++)
         {
-            m_scn->SetProgress(_T("Error querying DNS record."), 100, false);
-            return 1;
+            CString sAddress = msg->GetRecipientAddress(i);
+            CString sDomain = sAddress.Mid(sAddress.Find('@')+1);
+            sDomain.MakeLower();
+
+            if(domains.find(sDomain)==domains.end())
+            {
+                std::multimap<WORD, CString> host_list;
+                if(ResolveSmtpServerName(sAddress, host_list)!=0 || host_list.empty())
+                {
+                    sStatusMsg.Format(_T("Error querying DNS record of %s."), (LPCTSTR) sDomain);
+                    m_scn->SetProgress(sStatusMsg, 0);
+                    nUnresolved++;
+                    continue;
+                }
+                domains[sDomain] = host_list;
+            }
+
+            std::multimap<WORD, CString>& host_list = domains[sDomain];
+
+            size_t j;
+            for(j=0; j<aGroups.size(); j++)
+            {
+                if(aGroups[j].m_HostList==host_list)
+                    break;
+            }
+
+            if(j==aGroups.size())
+            {
+                aGroups.resize(j+1);
+                aGroups[j].m_HostList = host_list;
+            }
+
+            aGroups[j].m_aRecipients.push_back(sAddress);
         }
     }
 
-    // For each resolved domain name of SMTP server, try to send E-mail to the specified domain.
-    std::map<WORD, CString>::iterator it;
-    for(it=host_list.begin(); it!=host_list.end(); it++)
+    // For each group of recipients, try to send E-mail through their SMTP servers.
+    for(i=0; i<(int)aGroups.size(); i++)
     {
         // Check if operation cancelled by user
         if(m_scn->IsCancelled())
             return 2;
 
-        // Send E-mail to current SMTP server
-        int res = SendEmailToRecipient(it->second, msg);
+        int res = SendEmailToRecipients(aGroups[i].m_HostList, aGroups[i].m_aRecipients, msg);
         if(res==0)
         {
             // Succeeded
-            m_scn->SetProgress(_T("Finished OK."), 100, false);
-            return 0;
+            nDelivered++;
         }
-        if(res==2)
+        else if(res==2)
         {
             // Failure
             m_scn->SetProgress(_T("Critical error detected."), 100, false);
@@ -249,13 +329,24 @@ int CSmtpClient::SendEmail(CEmailMessage* msg)
         }
     }
 
-    // Failed to send E-mail
-    m_scn->SetProgress(_T("Error sending email."), 100, false);
-    return 1;
+    if(nDelivered==0)
+    {
+        // Failed to send E-mail
+        m_scn->SetProgress(_T("Error sending email."), 100, false);
+        return 1;
+    }
+
+    // The report is delivered if at least someone received it;
+    // resending would duplicate it for recipients who did.
+    if(nDelivered<(int)aGroups.size() || nUnresolved!=0)
+        m_scn->SetProgress(_T("Email could not be delivered to some recipients."), 0, false);
+
+    m_scn->SetProgress(_T("Finished OK."), 100, false);
+    return 0;
 }
 
 
-int CSmtpClient::ResolveSmtpServerName(LPCTSTR szEmailAddress, std::map<WORD, CString>& host_list)
+int CSmtpClient::ResolveSmtpServerName(LPCTSTR szEmailAddress, std::multimap<WORD, CString>& host_list)
 {
     // This methods takes an E-mail address and resolve the domain name(s)
     // associated with this address.
@@ -290,7 +381,7 @@ int CSmtpClient::ResolveSmtpServerName(LPCTSTR szEmailAddress, std::map<WORD, CS
             {
                 // Save domain name to our list
                 CString sServerName = CString(apResult->Data.MX.pNameExchange);
-                host_list[apResult->Data.MX.wPreference] = sServerName;
+                host_list.insert(std::make_pair(apResult->Data.MX.wPreference, sServerName));
             }
 
             // Next record
@@ -300,6 +391,10 @@ int CSmtpClient::ResolveSmtpServerName(LPCTSTR szEmailAddress, std::map<WORD, CS
         // Free resources
         DnsRecordListFree(pRecOrig, DnsFreeRecordList);
 
+        // If there is no MX record, the domain itself is the mail server
+        if(host_list.empty())
+            host_list.insert(std::make_pair((WORD)0, sServer));
+
         // Done
         return 0;
     }
@@ -311,118 +406,329 @@ int CSmtpClient::ResolveSmtpServerName(LPCTSTR szEmailAddress, std::map<WORD, CS
 }
 
 
-int CSmtpClient::SendEmailToRecipient(CString sSmtpServer, CEmailMessage* msg)
+int CSmtpClient::SendEmailToRecipients(std::multimap<WORD, CString>& host_list,
+                                       std::vector<CString>& aRecipients, CEmailMessage* msg)
 {
-    // This method connects to the given SMTP server and tries to send
-    // the E-mail message.
+    // This method delivers the message to the given recipients through one of the
+    // given SMTP servers. It connects to whichever server answers first, then sends
+    // the message once with all the recipients. If the server fails to accept
+    // the message, other servers are tried.
 
-    int status = 1; // Resulting status.
-    strconv_t strconv; // String convertor
-    struct addrinfo *result = NULL;
-    struct addrinfo *ptr = NULL;
-    struct addrinfo hints;
-    std::string sEncodedLogin;
-    std::string sEncodedPassword;
-    CString sBodyTo; //Vojtech: Lines of the "To:" and "Cc:" lines, that will become part of the e-mail header.
-    int iResult = -1;
-    CString sPostServer;
+    std::vector<SmtpServerAddress> aAddresses;
+    CString sStatusMsg;
+    size_t i;
+
+    ResolveServerAddresses(host_list, aAddresses);
+    if(aAddresses.empty())
+    {
+        m_scn->SetProgress(_T("Error getting address info of SMTP server."), 1);
+        return 1;
+    }
+
+    for(;;)
+    {
+        SmtpConnection conn;
+        int nAddress = ConnectToServer(aAddresses, conn);
+        if(nAddress<0)
+            return m_scn->IsCancelled() ? 2 : 1;
+
+        int status = SendEmailTransaction(conn, aRecipients, msg);
+
+        closesocket(conn.m_sock);
+
+        if(status!=1)
+            return status;
+
+        // Don't try other addresses of this server again
+        CString sHost = aAddresses[nAddress].m_sHost;
+        for(i=0; i<aAddresses.size(); i++)
+        {
+            if(aAddresses[i].m_sHost==sHost)
+                aAddresses[i].m_bTried = true;
+        }
+    }
+}
+
+void CSmtpClient::ResolveServerAddresses(std::multimap<WORD, CString>& host_list,
+                                         std::vector<SmtpServerAddress>& aAddresses)
+{
+    // This method resolves IP addresses of the SMTP servers, keeping the servers
+    // in preference order. Addresses of each server alternate between IPv6 and IPv4,
+    // so a broken network path of one family delays connection only a little.
+
+    strconv_t strconv;
     CString sServiceName;
-    SOCKET sock = INVALID_SOCKET;
-    CString sMsg, str;
-    std::set<CString>::iterator it;
     CString sStatusMsg;
-    const int RESPONSE_BUFF_SIZE = 4096;
-    char response[RESPONSE_BUFF_SIZE];
-    int res = SOCKET_ERROR;
-    std::string sEncodedFileData;
-    bool bESMTP = false;
+    struct addrinfo hints;
 
     // Convert port number to string
     sServiceName.Format(_T("%d"),
         m_sServer.IsEmpty()?25:m_nPort);
 
-    // Prepare message text (we need to replace "\n" by "\r\n" and remove . from message).
-    CString sMessageText = msg->GetText();
-    sMessageText.Replace(_T("\n"),_T("\r\n"));
-    sMessageText.Replace(_T("\r\n.\r\n"), _T("\r\n*\r\n"));
-    LPCWSTR lpwszMessageText = strconv.t2w(sMessageText.GetBuffer(0));
-    // Convert the text to UTF-8 encoding
-    std::string sUTF8Text = UTF16toUTF8(lpwszMessageText);
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = IPPROTO_TCP;
 
-    // Check that all attachments exist
-    int i;
-    for(i=0; i<msg->GetAttachmentCount(); i++)
+    std::multimap<WORD, CString>::iterator it;
+    for(it=host_list.begin(); it!=host_list.end(); it++)
     {
-        CString sFileName = msg->GetAttachment(i);
-        if(CheckAttachmentOK(sFileName)!=0)
+        // Add a message to log
+        sStatusMsg.Format(_T("Getting address info of %s port %s"), (LPCTSTR) it->second, (LPCTSTR) sServiceName);
+        m_scn->SetProgress(sStatusMsg, 1);
+
+        struct addrinfo *result = NULL;
+        LPCSTR lpszSmtpServer = strconv.t2a(it->second);
+        LPCSTR lpszServiceName = strconv.t2a(sServiceName);
+        if(getaddrinfo(lpszSmtpServer, lpszServiceName, &hints, &result)!=0)
+            continue;
+
+        std::vector<struct addrinfo*> aFamilies[2];
+        struct addrinfo *ptr = NULL;
+        for(ptr=result; ptr!=NULL; ptr=ptr->ai_next)
         {
-            // Some attachment file does not present
-            sStatusMsg.Format(_T("Attachment not found: %s"), (LPCTSTR) sFileName);
-            m_scn->SetProgress(sStatusMsg, 1);
-            return 2; // critical error
+            if(ptr->ai_addrlen>sizeof(SOCKADDR_STORAGE))
+                continue;
+            // Start with the family of the first address returned
+            aFamilies[ptr->ai_family==result->ai_family ? 0 : 1].push_back(ptr);
+        }
+
+        size_t j;
+        for(j=0; j<aFamilies[0].size() || j<aFamilies[1].size(); j++)
+        {
+            int f;
+            for(f=0; f<2; f++)
+            {
+                if(j>=aFamilies[f].size())
+                    continue;
+
+                ptr = aFamilies[f][j];
+
+                SmtpServerAddress addr;
+                addr.m_sHost = it->second;
+                addr.m_nFamily = ptr->ai_family;
+                addr.m_nAddrLen = (int)ptr->ai_addrlen;
+                memcpy(&addr.m_Addr, ptr->ai_addr, ptr->ai_addrlen);
+                aAddresses.push_back(addr);
+            }
         }
+
+        freeaddrinfo(result);
     }
+}
 
-    // Add a message to log
-    sStatusMsg.Format(_T("Getting address info of %s port %s"), (LPCTSTR) sSmtpServer, (LPCTSTR) CString(sServiceName));
-    m_scn->SetProgress(sStatusMsg, 1);
+int CSmtpClient::ConnectToServer(std::vector<SmtpServerAddress>& aAddresses, SmtpConnection& conn)
+{
+    // This method connects to one of the given addresses in happy eyeballs style.
+    // Connection attempts are started in order, one every SMTP_CONNECT_ATTEMPT_DELAY ms,
+    // (or at once when all previous attempts failed) without waiting for the previous
+    // ones to complete. The first connected socket wins, the rest are closed. This way a
+    // slow or dead server doesn't stall delivery for the full TCP connection timeout.
+    // Returns the index of the connected address, or -1 if none is reachable.
+
+    std::vector<SOCKET> aSockets(aAddresses.size(), INVALID_SOCKET);
+    CString sStatusMsg;
+    int nConnected = -1;
+    int nPending = 0;
+    size_t uNext = 0;
+    size_t i;
+    DWORD dwStartTime = GetTickCount();
+    DWORD dwLastAttemptTime = 0;
 
+    while(nConnected<0)
     {
-        // Prepare to open socket
-        memset(&hints, 0, sizeof(hints));
-        hints.ai_family = AF_INET;
-        hints.ai_socktype = SOCK_STREAM;
-        hints.ai_protocol = IPPROTO_TCP;
+        // Check if cancelled
+        if(m_scn->IsCancelled())
+            break;
 
-        LPCSTR lpszSmtpServer = strconv.t2a(sSmtpServer);
-        LPCSTR lpszServiceName = strconv.t2a(sServiceName);
-        iResult = getaddrinfo(lpszSmtpServer, lpszServiceName, &hints, &result);
-        if(iResult!=0)
-            goto exit;
+        DWORD dwElapsed = GetTickCount()-dwStartTime;
+        if(dwElapsed>=SMTP_CONNECT_TIMEOUT)
+        {
+            m_scn->SetProgress(_T("Timed out connecting to SMTP server."), 5);
+            break;
+        }
 
-        // For each interface do
-        for(ptr=result; ptr != NULL ;ptr=ptr->ai_next)
+        // Skip addresses that already failed
+        while(uNext<aAddresses.size() && aAddresses[uNext].m_bTried)
+            uNext++;
+
+        // Start the next attempt if it is time to
+        if(uNext<aAddresses.size() && nPending<FD_SETSIZE &&
+            (nPending==0 || GetTickCount()-dwLastAttemptTime>=SMTP_CONNECT_ATTEMPT_DELAY))
         {
-            // Check if cancelled
-            if(m_scn->IsCancelled()) {status = 2; goto exit;}
+            SmtpServerAddress& addr = aAddresses[uNext];
+
+            char szHost[NI_MAXHOST] = "";
+            getnameinfo((const sockaddr*)&addr.m_Addr, addr.m_nAddrLen, szHost, NI_MAXHOST, NULL, 0, NI_NUMERICHOST);
 
             // Add a message to log
-            sStatusMsg.Format(_T("Creating socket"));
+            sStatusMsg.Format(_T("Connecting to SMTP server %s (%s)"), (LPCTSTR) addr.m_sHost, (LPCTSTR) CString(szHost));
             m_scn->SetProgress(sStatusMsg, 1);
 
-            // Open socket
-            sock = socket(ptr->ai_family, ptr->ai_socktype, ptr->ai_protocol);
-            if(sock==INVALID_SOCKET)
+            dwLastAttemptTime = GetTickCount();
+
+            SOCKET sock = socket(addr.m_nFamily, SOCK_STREAM, IPPROTO_TCP);
+            u_long uNonBlocking = 1;
+            if(sock==INVALID_SOCKET || ioctlsocket(sock, FIONBIO, &uNonBlocking)!=0)
             {
                 m_scn->SetProgress(_T("Socket creation failed."), 1);
-                goto exit;
+                if(sock!=INVALID_SOCKET)
+                    closesocket(sock);
+                addr.m_bTried = true;
+                uNext++;
+                continue;
             }
 
-            // Add a message to log
-            sStatusMsg.Format(_T("Connecting to SMTP server %s port %s"), (LPCTSTR) sSmtpServer, (LPCTSTR) CString(sServiceName));
-            m_scn->SetProgress(sStatusMsg, 1);
+            int res = connect(sock, (const sockaddr*)&addr.m_Addr, addr.m_nAddrLen);
+            if(res==0)
+            {
+                aSockets[uNext] = sock;
+                nConnected = (int)uNext;
+                break;
+            }
 
-            // Connect socket
-            res = connect(sock, ptr->ai_addr, (int)ptr->ai_addrlen);
-            if(res!=SOCKET_ERROR)
-                break; // If successfull, break the loop
+            if(WSAGetLastError()!=WSAEWOULDBLOCK)
+            {
+                closesocket(sock);
+                addr.m_bTried = true;
+            }
+            else
+            {
+                aSockets[uNext] = sock;
+                nPending++;
+            }
 
-            // Close socket
-            closesocket(sock);
+            uNext++;
+            continue;
         }
 
-        // Check if socket open
-        if(res==SOCKET_ERROR)
+        if(nPending==0)
         {
-            sStatusMsg.Format(_T("Socket connection error."));
-            m_scn->SetProgress(sStatusMsg, 5);
-            goto exit;
+            // No more addresses to try
+            if(uNext>=aAddresses.size())
+            {
+                m_scn->SetProgress(_T("Socket connection error."), 5);
+                break;
+            }
+            continue;
         }
 
-        // Add a message to log
-        sStatusMsg.Format(_T("Connected OK."));
-        m_scn->SetProgress(sStatusMsg, 5);
+        // Wait until an attempt completes or it is time to start the next one
+        DWORD dwWait = SMTP_CONNECT_TIMEOUT-dwElapsed;
+        if(uNext<aAddresses.size())
+        {
+            DWORD dwSinceLast = GetTickCount()-dwLastAttemptTime;
+            DWORD dwTillNext = dwSinceLast<SMTP_CONNECT_ATTEMPT_DELAY ? SMTP_CONNECT_ATTEMPT_DELAY-dwSinceLast : 0;
+            if(dwTillNext<dwWait)
+                dwWait = dwTillNext;
+        }
+        // Wake up periodically to check for cancel
+        if(dwWait>100)
+            dwWait = 100;
+
+        fd_set wfds;
+        fd_set efds;
+        FD_ZERO(&wfds);
+        FD_ZERO(&efds);
+        SOCKET maxfd = 0;
+        for(i=0; i<aSockets.size(); i++)
+        {
+            if(aSockets[i]!=INVALID_SOCKET)
+            {
+                FD_SET(aSockets[i], &wfds);
+                FD_SET(aSockets[i], &efds);
+                if(aSockets[i]>maxfd)
+                    maxfd = aSockets[i];
+            }
+        }
+
+        struct timeval tv;
+        tv.tv_sec = dwWait/1000;
+        tv.tv_usec = (dwWait%1000)*1000;
+        if(select((int)maxfd+1, NULL, &wfds, &efds, &tv)<=0)
+            continue;
+
+        for(i=0; i<aSockets.size() && nConnected<0; i++)
+        {
+            if(aSockets[i]==INVALID_SOCKET ||
+                (!FD_ISSET(aSockets[i], &wfds) && !FD_ISSET(aSockets[i], &efds)))
+                continue;
+
+            int nError = 0;
+            int nErrorLen = sizeof(nError);
+            if(getsockopt(aSockets[i], SOL_SOCKET, SO_ERROR, (char*)&nError, &nErrorLen)==0 &&
+                nError==0 && FD_ISSET(aSockets[i], &wfds))
+            {
+                nConnected = (int)i;
+                break;
+            }
+
+            // This attempt failed
+            closesocket(aSockets[i]);
+            aSockets[i] = INVALID_SOCKET;
+            aAddresses[i].m_bTried = true;
+            nPending--;
+        }
+    }
+
+    // Close the losers
+    for(i=0; i<aSockets.size(); i++)
+    {
+        if((int)i!=nConnected && aSockets[i]!=INVALID_SOCKET)
+            closesocket(aSockets[i]);
+    }
+
+    if(nConnected<0)
+        return -1;
+
+    // Switch back to blocking mode with timeouts, so a server
+    // that stops responding doesn't hang us up forever
+    conn.m_sock = aSockets[nConnected];
+    u_long uNonBlocking = 0;
+    ioctlsocket(conn.m_sock, FIONBIO, &uNonBlocking);
+    DWORD dwTimeout = SMTP_REPLY_TIMEOUT;
+    setsockopt(conn.m_sock, SOL_SOCKET, SO_RCVTIMEO, (const char*)&dwTimeout, sizeof(dwTimeout));
+    setsockopt(conn.m_sock, SOL_SOCKET, SO_SNDTIMEO, (const char*)&dwTimeout, sizeof(dwTimeout));
+
+    // Add a message to log
+    m_scn->SetProgress(_T("Connected OK."), 5);
 
+    return nConnected;
+}
+
+int CSmtpClient::SendEmailTransaction(SmtpConnection& conn, std::vector<CString>& aRecipients, CEmailMessage* msg)
+{
+    // This method sends the E-mail message over the connected socket.
+
+    int status = 1; // Resulting status.
+    strconv_t strconv; // String convertor
+    std::string sEncodedLogin;
+    std::string sEncodedPassword;
+    CString sBodyTo; //Vojtech: Lines of the "To:" and "Cc:" lines, that will become part of the e-mail header.
+    CString sMsg, str;
+    CString sStatusMsg;
+    CString sMessageText;
+    std::string sUTF8Text;
+    std::string sReply;
+    std::vector<std::string> aCommands;
+    std::vector<ULONG64> aAttachmentSizes;
+    ULONG64 uMessageSize = 0;
+    LPCSTR lpszBodyType = "";
+    bool bBinaryAttachments = false;
+    int res = SOCKET_ERROR;
+    char szSize[32];
+    int i;
+
+    // Determine attachment sizes
+    for(i=0; i<msg->GetAttachmentCount(); i++)
+    {
+        ULONG64 uFileSize = 0;
+        if(CheckAttachmentOK(msg->GetAttachment(i), &uFileSize)!=0)
+            return 2; // critical error
+        aAttachmentSizes.push_back(uFileSize);
+    }
+
+    {
         // Check cancel status
         if(m_scn->IsCancelled()) {status = 2; goto exit;}
 
@@ -430,8 +736,8 @@ int CSmtpClient::SendEmailToRecipient(CString sSmtpServer, CEmailMessage* msg)
 
         // Wait until server send us greeting message, for example:
         // 220 mail.company.tld ESMTP CommuniGate Pro 5.1.4i is glad to see you!
-        res=SendMsg(sock, NULL, response, RESPONSE_BUFF_SIZE);
-        if(res==SOCKET_ERROR)
+        res=ReadReply(conn);
+        if(res<0)
         {
             // Error - server did not send us greeting message
             sStatusMsg.Format(_T("Failed to receive greeting message from SMTP server (recv code %d)."), res);
@@ -440,7 +746,7 @@ int CSmtpClient::SendEmailToRecipient(CString sSmtpServer, CEmailMessage* msg)
         }
 
         // Check the code server returned (expect code 220).
-        if(220!=GetMessageCode(response))
+        if(220!=res)
         {
             // Invalid greeting
             m_scn->SetProgress(_T("Invalid greeting message."), 1);
@@ -451,21 +757,21 @@ int CSmtpClient::SendEmailToRecipient(CString sSmtpServer, CEmailMessage* msg)
         sStatusMsg.Format(_T("Sending EHLO"));
         m_scn->SetProgress(sStatusMsg, 1);
 
-        res=SendMsg(sock, _T("EHLO CrashSender\r\n"), response, RESPONSE_BUFF_SIZE);
+        res=SendMsg(conn, _T("EHLO CrashSender\r\n"), &sReply);
         // Check return code (expect code 250)
         if(res==250)
         {
-            sStatusMsg = CString(_T("EHLO command not supported"));
-            bESMTP = true;
+            // Determine what service extensions server supports
+            ParseEhloReply(sReply, conn.m_Caps);
         }
 
-        if(!bESMTP)
+        if(!conn.m_Caps.m_bESMTP)
         {
             // Server may not understand EHLO, try HELO
             sStatusMsg.Format(_T("Sending HELO"));
             m_scn->SetProgress(sStatusMsg, 1);
 
-            res=SendMsg(sock, _T("HELO CrashSender\r\n"), response, RESPONSE_BUFF_SIZE);
+            res=SendMsg(conn, _T("HELO CrashSender\r\n"));
             // Expect code 250
             if(res!=250)
             {
@@ -479,7 +785,7 @@ int CSmtpClient::SendEmailToRecipient(CString sSmtpServer, CEmailMessage* msg)
         // Check whether to perform authorization procedure
         if(!m_sLogin.IsEmpty())
         {
-            if(!bESMTP)
+            if(!conn.m_Caps.m_bESMTP)
             {
                 sStatusMsg.Format(_T("SMTP server does not support authorization."));
                 m_scn->SetProgress(sStatusMsg, 1);
@@ -490,7 +796,7 @@ int CSmtpClient::SendEmailToRecipient(CString sSmtpServer, CEmailMessage* msg)
 
             // SMTP authorization
             // AUTH <SP> LOGIN <CRLF>
-            res=SendMsg(sock, _T("AUTH LOGIN\r\n"), response, RESPONSE_BUFF_SIZE);
+            res=SendMsg(conn, _T("AUTH LOGIN\r\n"));
 
             if(res!=334)
             {
@@ -507,9 +813,8 @@ int CSmtpClient::SendEmailToRecipient(CString sSmtpServer, CEmailMessage* msg)
             sEncodedLogin = base64_encode(reinterpret_cast<const unsigned char*>(lpszLogin),(int)strlen(lpszLogin));
             sEncodedLogin+="\r\n";
             LPCTSTR lpwszLogin = strconv.a2t((LPCSTR)(sEncodedLogin.c_str()));
-            memset(response,0,1024);
             // Send it
-            res=SendMsg(sock, lpwszLogin, response, 1024);
+            res=SendMsg(conn, lpwszLogin);
             // Check return code - expect 334
             if (res!=334)
             {
@@ -527,9 +832,8 @@ int CSmtpClient::SendEmailToRecipient(CString sSmtpServer, CEmailMessage* msg)
             sEncodedPassword = base64_encode(reinterpret_cast<const unsigned char*>(lpszPassword),(int)strlen(lpszPassword));
             sEncodedPassword+="\r\n";
             LPCTSTR lpwszPassword = strconv.a2t((LPCSTR)(sEncodedPassword.c_str()));
-            memset(response,0,1024);
             // Send it
-            res=SendMsg(sock, lpwszPassword, response, 1024);
+            res=SendMsg(conn, lpwszPassword);
             if(res!=235)
             {
                 sStatusMsg = _T("Authorization failed");
@@ -537,28 +841,100 @@ int CSmtpClient::SendEmailToRecipient(CString sSmtpServer, CEmailMessage* msg)
             }
         }
 
+        // With CHUNKING, message data is sent in BDAT chunks of known size and
+        // doesn't need dot-stuffing. BINARYMIME (only allowed with BDAT) lets us send
+        // attachments as they are, without BASE-64 inflation. 8BITMIME lets us
+        // declare the UTF-8 message text properly.
+        conn.m_bChunked = conn.m_Caps.m_bChunking;
+        if(conn.m_Caps.m_bChunking && conn.m_Caps.m_bBinaryMime)
+        {
+            bBinaryAttachments = true;
+            lpszBodyType = " BODY=BINARYMIME";
+        }
+        else if(conn.m_Caps.m_b8BitMime)
+        {
+            lpszBodyType = " BODY=8BITMIME";
+        }
+
+        // Prepare message text (we need to replace "\n" by "\r\n" and dot-stuff lines when using DATA).
+        sMessageText = msg->GetText();
+        sMessageText.Replace(_T("\n"),_T("\r\n"));
+        if(!conn.m_bChunked)
+        {
+            sMessageText.Replace(_T("\r\n."), _T("\r\n.."));
+            if(sMessageText.Left(1)==_T("."))
+                sMessageText = _T(".") + sMessageText;
+        }
+        // Convert the text to UTF-8 encoding
+        sUTF8Text = UTF16toUTF8(strconv.t2w(sMessageText.GetBuffer(0)));
+
+        // Estimate message size (a bit more than it will actually be)
+        uMessageSize = 1024 + sUTF8Text.length();
+        for(i=0; i<(int)aAttachmentSizes.size(); i++)
+        {
+            ULONG64 uLines = (aAttachmentSizes[i]+BASE64_MIME_LINE_BYTES-1)/BASE64_MIME_LINE_BYTES;
+            uMessageSize += 512 + (bBinaryAttachments ? aAttachmentSizes[i] : uLines*78);
+        }
+
+        // Don't transfer the message just to have it rejected
+        if(conn.m_Caps.m_uMaxSize!=0 && uMessageSize>conn.m_Caps.m_uMaxSize)
+        {
+            sStatusMsg.Format(_T("Message size exceeds the limit of SMTP server (%I64u bytes)"), conn.m_Caps.m_uMaxSize);
+            m_scn->SetProgress(sStatusMsg, 0);
+            goto exit;
+        }
+
         // Next send sender and recipient info
         sStatusMsg.Format(_T("Sending sender and recipient information"));
         m_scn->SetProgress(sStatusMsg, 1);
 
-        // Send MAIL FROM
-        sMsg.Format(_T("MAIL FROM:<%s>\r\n"), (LPCTSTR) msg->GetSenderAddress());
-        res=SendMsg(sock, sMsg, response, RESPONSE_BUFF_SIZE);
-        if (res!=250)
+        // MAIL FROM
+        aCommands.push_back(std::string("MAIL FROM:<") + strconv.t2a(msg->GetSenderAddress()) + ">");
+        aCommands.back() += lpszBodyType;
+        if(conn.m_Caps.m_bSize)
         {
-            sStatusMsg = _T("Unexpected status code");
-            m_scn->SetProgress(sStatusMsg, 0);
-            goto exit;
+            sprintf_s(szSize, 32, " SIZE=%I64u", uMessageSize);
+            aCommands.back() += szSize;
         }
+        aCommands.back() += "\r\n";
 
-        // Process multiple e-mail recipients.
+        // Process multiple e-mail recipients. The headers list all recipients,
+        // while only those served by this server are given in RCPT TO.
         for(i=0; i<msg->GetRecipientCount(); i++)
         {
             sMsg.Format(i==0 ? _T("To: <%s>\r\n") : _T("Cc: <%s>\r\n"), (LPCTSTR) msg->GetRecipientAddress(i));
             sBodyTo += sMsg;
-            sMsg.Format(_T("RCPT TO:<%s>\r\n"), (LPCTSTR) msg->GetRecipientAddress(i));
-            res=SendMsg(sock, sMsg, response, RESPONSE_BUFF_SIZE);
-            if(res!=250)
+        }
+        for(i=0; i<(int)aRecipients.size(); i++)
+            aCommands.push_back(std::string("RCPT TO:<") + strconv.t2a(aRecipients[i]) + ">\r\n");
+
+        // DATA
+        if(!conn.m_bChunked)
+            aCommands.push_back("DATA\r\n");
+
+        // With PIPELINING, send all commands in a single packet and then check replies,
+        // instead of waiting for the reply to each command.
+        if(conn.m_Caps.m_bPipelining)
+        {
+            std::string sBatch;
+            for(i=0; i<(int)aCommands.size(); i++)
+                sBatch += aCommands[i];
+
+            if(SendAll(conn.m_sock, sBatch.c_str(), sBatch.length())!=0)
+                goto exit;
+        }
+
+        for(i=0; i<(int)aCommands.size(); i++)
+        {
+            if(!conn.m_Caps.m_bPipelining &&
+                SendAll(conn.m_sock, aCommands[i].c_str(), aCommands[i].length())!=0)
+                goto exit;
+
+            res = ReadReply(conn);
+
+            bool bDataCmd = !conn.m_bChunked && i==(int)aCommands.size()-1;
+            bool bRcptCmd = i!=0 && !bDataCmd;
+            if(bDataCmd ? res!=354 : (res!=250 && !(bRcptCmd && res==251)))
             {
                 sStatusMsg = _T("Unexpected status code");
                 m_scn->SetProgress(sStatusMsg, 0);
@@ -569,14 +945,7 @@ int CSmtpClient::SendEmailToRecipient(CString sSmtpServer, CEmailMessage* msg)
         sStatusMsg.Format(_T("Start sending email data"));
         m_scn->SetProgress(sStatusMsg, 1);
 
-        // Send DATA
-        res=SendMsg(sock, _T("DATA\r\n"), response, RESPONSE_BUFF_SIZE);
-        if (res!=354)
-        {
-            sStatusMsg = _T("Unexpected status code");
-            m_scn->SetProgress(sStatusMsg, 0);
-            goto exit;
-        }
+        conn.m_aDataBuf.reserve(SMTP_DATA_CHUNK_SIZE);
 
         // Get current time
         time_t cur_time;
@@ -612,8 +981,7 @@ int CSmtpClient::SendEmailToRecipient(CString sSmtpServer, CEmailMessage* msg)
         // Send Content-Type
         sMsg += "Content-Type: multipart/mixed; boundary=KkK170891tpbkKk__FV_KKKkkkjjwq\r\n";
         sMsg += "\r\n\r\n";
-        res = SendMsg(sock, sMsg);
-        if(res!=sMsg.GetLength())
+        if(WriteMessageData(conn, sMsg)!=0)
             goto exit;
 
         /* Message text */
@@ -623,11 +991,12 @@ int CSmtpClient::SendEmailToRecipient(CString sSmtpServer, CEmailMessage* msg)
 
         sMsg =  "--KkK170891tpbkKk__FV_KKKkkkjjwq\r\n";
         sMsg += "Content-Type: text/plain; charset=UTF-8\r\n";
+        if(lpszBodyType[0]!=0)
+            sMsg += "Content-Transfer-Encoding: 8bit\r\n";
         sMsg += "\r\n";
-        sMsg += sUTF8Text.c_str();
-        sMsg += "\r\n";
-        res = SendMsg(sock, sMsg);
-        if(res!=sMsg.GetLength())
+        if(WriteMessageData(conn, sMsg)!=0 ||
+            WriteMessageData(conn, sUTF8Text.c_str(), sUTF8Text.length())!=0 ||
+            WriteMessageData(conn, "\r\n", 2)!=0)
             goto exit;
 
         sStatusMsg.Format(_T("Sending attachments"));
@@ -643,49 +1012,48 @@ int CSmtpClient::SendEmailToRecipient(CString sSmtpServer, CEmailMessage* msg)
             // Header
             sMsg =  "\r\n--KkK170891tpbkKk__FV_KKKkkkjjwq\r\n";
             sMsg += "Content-Type: application/octet-stream\r\n";
-            sMsg += "Content-Transfer-Encoding: base64\r\n";
+            sMsg += bBinaryAttachments ? "Content-Transfer-Encoding: binary\r\n" :
+                "Content-Transfer-Encoding: base64\r\n";
             sMsg += "Content-Disposition: attachment; filename=\"";
             sMsg += sDisplayName;
             sMsg += "\"\r\n";
             sMsg += "\r\n";
-            res = SendMsg(sock, sMsg);
-            if(res!=sMsg.GetLength())
+            if(WriteMessageData(conn, sMsg)!=0)
                 goto exit;
 
-            // Encode data
-            LPBYTE buf = NULL;
-            //int buf_len = 0;
-            int nEncode=Base64EncodeAttachment(sFileName, sEncodedFileData);
+            // Encode and send data
+            int nEncode=SendAttachment(conn, sFileName, bBinaryAttachments);
             if(nEncode!=0)
             {
-                sStatusMsg.Format(_T("Error BASE64-encoding attachment %s"), (LPCTSTR) sFileName);
+                sStatusMsg.Format(_T("Error sending attachment %s"), (LPCTSTR) sFileName);
                 m_scn->SetProgress(sStatusMsg, 1);
                 goto exit;
             }
-
-            // Send encoded data
-            sMsg = sEncodedFileData.c_str();
-            res = SendMsg(sock, sMsg);
-            if(res!=sMsg.GetLength())
-                goto exit;
-
-            delete [] buf;
         }
 
-        sMsg =  "\r\n--KkK170891tpbkKk__FV_KKKkkkjjwq--";
-        res = SendMsg(sock, sMsg);
-        if(res!=sMsg.GetLength())
+        sMsg =  "\r\n--KkK170891tpbkKk__FV_KKKkkkjjwq--\r\n";
+        if(WriteMessageData(conn, sMsg)!=0)
             goto exit;
 
-        // End of message marker
-        res = SendMsg(sock, _T("\r\n.\r\n"), response, RESPONSE_BUFF_SIZE);
-        if (res!=250)
+        if(!conn.m_bChunked)
         {
-            goto exit;
+            // End of message marker
+            if(WriteMessageData(conn, ".\r\n", 3)!=0 ||
+                FlushMessageData(conn, true)!=0)
+                goto exit;
+
+            if(ReadReply(conn)!=250)
+                goto exit;
+        }
+        else
+        {
+            // The last chunk, wait until server accepts all chunks
+            if(FlushMessageData(conn, true)!=0)
+                goto exit;
         }
 
         // Quit
-        res = SendMsg(sock, _T("QUIT\r\n"), response, RESPONSE_BUFF_SIZE);
+        res = SendMsg(conn, _T("QUIT\r\n"));
         // Expect code 221
         if(res!=221)
         {
@@ -704,51 +1072,56 @@ exit:
     sStatusMsg.Format(_T("Finished with error code %d"), status);
     m_scn->SetProgress(sStatusMsg, 100, false);
 
-    // Clean up
-    closesocket(sock);
-    freeaddrinfo(result);
     return status;
 }
 
-int CSmtpClient::GetMessageCode(LPSTR msg)
+void CSmtpClient::ParseEhloReply(const std::string& sReply, SmtpServerCaps& caps)
 {
-    // This method extracts the return code from string.
-    // For example, passing "220 Success" will return 220.
-    // The SMTP server may return intermediate result in case of PIPELINING command,
-    // for example, passing "250-ENHANCEDSTATUSCODES" is an intermediate result.
-    // For intermediate results, this function returns -1 indicating
-    // more information should be received from server.
-    // If the message has invalid format, -2 is returned.
-
-    // Check if invalid string
-    if(msg==NULL)
-        return -1;
-
-    // Split multi-line string
-    std::vector<CString> aLines = Utility::ExplodeStr(CString(msg), _T("\n"));
-    // Take the last line
-    CString sLastLine = aLines[aLines.size()-1];
-
-    // Check message format is valid
-    if(sLastLine.GetLength()>4 &&
-        isdigit(sLastLine.GetAt(0)) &&
-       isdigit(sLastLine.GetAt(1)) &&
-       isdigit(sLastLine.GetAt(2)))
+    // This method determines what service extensions the server supports.
+    // Each line of EHLO reply except the first one names an extension, optionally
+    // followed by parameters, for example:
+    // 250-mail.company.tld Hello
+    // 250-PIPELINING
+    // 250-SIZE 10240000
+    // 250 CHUNKING
+
+    caps = SmtpServerCaps();
+    caps.m_bESMTP = true;
+
+    size_t uPos = sReply.find('\n');
+    while(uPos!=std::string::npos && uPos+1<sReply.length())
     {
-        if(sLastLine.GetAt(3)==' ')
+        size_t uStart = uPos+1;
+        uPos = sReply.find('\n', uStart);
+        std::string sLine = sReply.substr(uStart, uPos==std::string::npos ? std::string::npos : uPos-uStart);
+
+        // Skip the reply code
+        if(sLine.length()<4)
+            continue;
+        sLine = sLine.substr(4);
+
+        // Separate keyword from parameters
+        size_t uEnd = sLine.find_first_of(" \r");
+        std::string sKeyword = sLine.substr(0, uEnd);
+        std::string sParams;
+        if(uEnd!=std::string::npos && sLine[uEnd]==' ')
+            sParams = sLine.substr(uEnd+1);
+
+        if(_stricmp(sKeyword.c_str(), "PIPELINING")==0)
+            caps.m_bPipelining = true;
+        else if(_stricmp(sKeyword.c_str(), "CHUNKING")==0)
+            caps.m_bChunking = true;
+        else if(_stricmp(sKeyword.c_str(), "8BITMIME")==0)
+            caps.m_b8BitMime = true;
+        else if(_stricmp(sKeyword.c_str(), "BINARYMIME")==0)
+            caps.m_bBinaryMime = true;
+        else if(_stricmp(sKeyword.c_str(), "SIZE")==0)
         {
-            // Extract the number
-            return atoi(msg);
-        }
-        else if(sLastLine.GetAt(3)=='-')
-        {
-            // Intermediate result
-            return -1;
+            // Zero or missing parameter means there is no fixed limit
+            caps.m_bSize = true;
+            caps.m_uMaxSize = _strtoui64(sParams.c_str(), NULL, 10);
         }
     }
-
-    // Message format is invalid.
-    return -2;
 }
 
 int CSmtpClient::CheckAddressSyntax(CString addr)
@@ -779,9 +1152,10 @@ std::string CSmtpClient::UTF16toUTF8(LPCWSTR utf16)
     return utf8;
 }
 
-int CSmtpClient::SendMsg(SOCKET sock, LPCTSTR pszMessage, LPSTR pszResponse, UINT uResponseSize)
+
+int CSmtpClient::SendMsg(SmtpConnection& conn, LPCTSTR pszMessage, std::string* psReply)
 {
-    // This method sends a message using the specified socket and
+    // This method sends a command to SMTP server and
     // waits for response.
 
     strconv_t strconv;
@@ -789,122 +1163,267 @@ int CSmtpClient::SendMsg(SOCKET sock, LPCTSTR pszMessage, LPSTR pszResponse, UIN
     // Check if cancelled
     if(m_scn->IsCancelled()) {return -1;}
 
-    if(pszMessage!=NULL)
-    {
-        // Determine message length.
-        int msg_len = (int)_tcslen(pszMessage);
+    // Convert message to ASCII
+    LPCSTR lpszMessageA = strconv.t2a((TCHAR*)pszMessage);
+
+    // Send the message
+    if(SendAll(conn.m_sock, lpszMessageA, strlen(lpszMessageA))!=0)
+        return -1;
+
+    // Read response
+    return ReadReply(conn, psReply);
+}
+
+int CSmtpClient::ReadReply(SmtpConnection& conn, std::string* psReply)
+{
+    // This method reads one (possibly multi-line) reply from SMTP server.
+    // Replies to pipelined commands may arrive in a single packet, so the
+    // data following the reply is kept in the receive buffer for the next call.
 
-        // Convert message to ASCII
-        LPCSTR lpszMessageA = strconv.t2a((TCHAR*)pszMessage);
+    std::string sReply;
+    std::string sLine;
 
-        // Send the message
-        int res = send(sock, lpszMessageA, msg_len, 0);
-        if(res == SOCKET_ERROR)
+    for(;;)
+    {
+        size_t uEOL = conn.m_sRecvBuf.find('\n');
+        if(uEOL==std::string::npos)
         {
-            ATLASSERT(0);
-            CString sMsg;
-            sMsg.Format(_T("Send error: %d"), res);
-            m_scn->SetProgress(sMsg, 0);
+            // Check if cancelled
+            if(m_scn->IsCancelled()) {return -1;}
+
+            if(conn.m_sRecvBuf.length()>SMTP_MAX_REPLY_LINE)
+            {
+                m_scn->SetProgress(_T("Invalid response format"), 0);
+                return -1;
+            }
+
+            // Read more data
+            char buf[4096];
+            int br = recv(conn.m_sock, buf, sizeof(buf), 0);
+            if(br==SOCKET_ERROR || br==0)
+            {
+                m_scn->SetProgress(_T("Receive error"), 0);
+                return -1; // Failed
+            }
 
-            // Print last socket error message
-            CString sLastSocketError;
-            //sLastSocketError.FormatMessage(WSAGetLastError());
-            m_scn->SetProgress(sLastSocketError, 0);
+            conn.m_sRecvBuf.append(buf, br);
+            continue;
         }
 
-        // Check if the caller wants to get response
-        if(pszResponse==NULL)
-            return res; // Return now
+        sLine = conn.m_sRecvBuf.substr(0, uEOL+1);
+        conn.m_sRecvBuf.erase(0, uEOL+1);
+        sReply += sLine;
+
+        // Each line starts with a three-digit code. In a multi-line reply,
+        // the code is followed by a dash in all lines except the last one,
+        // for example "250-ENHANCEDSTATUSCODES".
+        if(sLine.length()<4 ||
+            !isdigit((unsigned char)sLine[0]) ||
+            !isdigit((unsigned char)sLine[1]) ||
+            !isdigit((unsigned char)sLine[2]))
+        {
+            m_scn->SetProgress(_T("Invalid response format"), 0);
+            return -1;
+        }
+
+        if(sLine[3]!='-')
+            break; // The last line
     }
 
-    for(;;)
+    // Add a message to log
+    m_scn->SetProgress(CString(sReply.c_str()), 0);
+
+    if(psReply!=NULL)
+        *psReply = sReply;
+
+    // Return status code
+    return atoi(sLine.c_str());
+}
+
+int CSmtpClient::SendAll(SOCKET sock, LPCSTR pData, size_t uDataLen)
+{
+    // send() may transmit only a part of the data,
+    // so repeat until everything is sent.
+
+    while(uDataLen!=0)
     {
-        // Read response
-        memset(pszResponse, 0, uResponseSize);
-        int br = recv(sock, pszResponse, uResponseSize, 0);
-        // Check result
-        if(br==SOCKET_ERROR)
+        // Check if cancelled
+        if(m_scn->IsCancelled()) {return 1;}
+
+        int res = send(sock, pData, (int)uDataLen, 0);
+        if(res==SOCKET_ERROR)
         {
-            m_scn->SetProgress(_T("Receive error"), 0);
-            return br; // Failed
+            CString sMsg;
+            sMsg.Format(_T("Send error: %d"), WSAGetLastError());
+            m_scn->SetProgress(sMsg, 0);
+            return 1;
         }
 
-        // Add a message to log
-        CString sStatusMsg = CString(pszResponse);
-        m_scn->SetProgress(sStatusMsg, 0);
-
-        // Determine status returned
-        int nStatusCode = GetMessageCode(pszResponse);
-        if(nStatusCode==-1)
-            continue; // Intermediate result
-        else if(nStatusCode==-2)
-            return -1; // Invalid response format
-        else
-            return nStatusCode; // Ready
+        pData += res;
+        uDataLen -= res;
     }
+
+    return 0;
 }
 
-int CSmtpClient::CheckAttachmentOK(CString sFileName)
+int CSmtpClient::WriteMessageData(SmtpConnection& conn, CString sData)
 {
-    // This method checks if the given file presents.
+    // Convert to ASCII and write
+    strconv_t strconv;
+    LPCSTR lpszData = strconv.t2a(sData);
+    return WriteMessageData(conn, lpszData, strlen(lpszData));
+}
 
-    struct _stat st;
+int CSmtpClient::WriteMessageData(SmtpConnection& conn, LPCSTR pData, size_t uDataLen)
+{
+    // Message data is collected in the buffer and sent in big portions,
+    // this way each BDAT chunk carries a lot of data, and DATA is sent
+    // without a lot of tiny packets.
 
-    int nResult = _tstat(sFileName, &st);
-    if(nResult != 0)
-        return 1;  // File not found.
+    while(uDataLen!=0)
+    {
+        size_t uFree = SMTP_DATA_CHUNK_SIZE-conn.m_aDataBuf.size();
+        size_t uCopy = uDataLen<uFree ? uDataLen : uFree;
+        conn.m_aDataBuf.insert(conn.m_aDataBuf.end(), pData, pData+uCopy);
+        pData += uCopy;
+        uDataLen -= uCopy;
+
+        if(conn.m_aDataBuf.size()==SMTP_DATA_CHUNK_SIZE &&
+            FlushMessageData(conn, false)!=0)
+            return 1;
+    }
 
-    // File exists.
     return 0;
 }
 
-int CSmtpClient::Base64EncodeAttachment(CString sFileName,
-                                        std::string& sEncodedFileData)
+int CSmtpClient::FlushMessageData(SmtpConnection& conn, bool bLast)
 {
-    // This method encodes the file into BASE-64 encoding.
-    // It is suitable for small files only, because it reads
-    // entire file contents into memory.
+    // This method sends the collected message data.
 
-    strconv_t strconv;
-    int uFileSize = 0;
-    BYTE* uchFileData = NULL;
+    if(!conn.m_bChunked)
+    {
+        // DATA command is already accepted, just send the data.
+        if(!conn.m_aDataBuf.empty() &&
+            SendAll(conn.m_sock, &conn.m_aDataBuf[0], conn.m_aDataBuf.size())!=0)
+            return 1;
 
-    // Check if file exists.
-    long lFileSize = Utility::GetFileSize(sFileName);
-    if(lFileSize<0)
-        return 1;  // File not found.
+        conn.m_aDataBuf.clear();
+        return 0;
+    }
 
-    // Allocate buffer of file size
-    uFileSize = (int)lFileSize;
-    uchFileData = new BYTE[uFileSize];
+    // BDAT <SP> chunk-size [ <SP> LAST ] <CRLF> followed by chunk data
+    char szCommand[64];
+    sprintf_s(szCommand, 64, "BDAT %u%s\r\n", (unsigned)conn.m_aDataBuf.size(), bLast?" LAST":"");
+    if(SendAll(conn.m_sock, szCommand, strlen(szCommand))!=0)
+        return 1;
 
-    // Read file data to buffer.
-    FILE* f = NULL;
-#if _MSC_VER<1400
-    f = _tfopen(sFileName, _T("rb"));
-#else
-    _tfopen_s(&f, sFileName, _T("rb"));
-#endif
+    if(!conn.m_aDataBuf.empty() &&
+        SendAll(conn.m_sock, &conn.m_aDataBuf[0], conn.m_aDataBuf.size())!=0)
+        return 1;
 
-    // Read file data to buffer
-    if(!f || fread(uchFileData, uFileSize, 1, f)!=1)
+    conn.m_aDataBuf.clear();
+    conn.m_nPendingReplies++;
+
+    // Without pipelining, each chunk should be accepted before the next one is sent.
+    // With pipelining, read replies only to limit the count of unread ones.
+    // After the last chunk, wait for all replies.
+    int nMaxPending = (conn.m_Caps.m_bPipelining && !bLast) ? SMTP_MAX_PENDING_REPLIES : 0;
+    while(conn.m_nPendingReplies>nMaxPending)
     {
-        delete [] uchFileData;
-        uchFileData = NULL;
-        return 2; // Coudln't read file data.
+        conn.m_nPendingReplies--;
+        if(ReadReply(conn)!=250)
+        {
+            m_scn->SetProgress(_T("Message chunk not accepted"), 0);
+            return 1;
+        }
     }
 
-    // Close file
-    fclose(f);
+    return 0;
+}
 
-    // Encode file data.
-    sEncodedFileData = base64_encode(uchFileData, uFileSize);
+int CSmtpClient::CheckAttachmentOK(CString sFileName, ULONG64* puFileSize)
+{
+    // This method checks if the given file presents.
 
-    // Release buffer
-    delete [] uchFileData;
+    struct _stat64 st;
 
-    // OK.
+    int nResult = _tstat64(sFileName, &st);
+    if(nResult != 0)
+        return 1;  // File not found.
+
+    if(puFileSize!=NULL)
+        *puFileSize = (ULONG64)st.st_size;
+
+    // File exists.
     return 0;
 }
 
+int CSmtpClient::SendAttachment(SmtpConnection& conn, CString sFileName, bool bBinary)
+{
+    // This method reads the file block by block and writes each block
+    // into the message either as is or encoded into BASE-64 MIME lines,
+    // so memory usage doesn't depend on file size.
+
+    HANDLE hFile = CreateFile(sFileName, GENERIC_READ, FILE_SHARE_READ|FILE_SHARE_WRITE,
+        NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if(hFile==INVALID_HANDLE_VALUE)
+        return 1; // File not found.
+
+    // Block size is a multiple of line size, so each block ends with a complete line
+    const DWORD dwBlockSize = BASE64_MIME_LINE_BYTES*1024;
+    std::vector<unsigned char> aBlock(dwBlockSize);
+    std::vector<char> aEncoded;
+    if(!bBinary)
+        aEncoded.resize(base64_mime_encoded_size(dwBlockSize));
+    int nStatus = 0;
+
+    for(;;)
+    {
+        if(m_scn->IsCancelled())
+        {
+            nStatus = 3;
+            break;
+        }
+
+        // Fill in the whole block (ReadFile may return less)
+        DWORD dwBlockLen = 0;
+        while(dwBlockLen<dwBlockSize)
+        {
+            DWORD dwBytesRead = 0;
+            if(!ReadFile(hFile, &aBlock[dwBlockLen], dwBlockSize-dwBlockLen, &dwBytesRead, NULL))
+            {
+                nStatus = 2; // Couldn't read file data.
+                break;
+            }
+            if(dwBytesRead==0)
+                break; // EOF
+            dwBlockLen += dwBytesRead;
+        }
+
+        if(nStatus!=0 || dwBlockLen==0)
+            break;
+
+        int res = 0;
+        if(bBinary)
+        {
+            res = WriteMessageData(conn, (LPCSTR)&aBlock[0], dwBlockLen);
+        }
+        else
+        {
+            size_t uEncodedLen = base64_mime_encode_block(&aBlock[0], dwBlockLen, &aEncoded[0]);
+            res = WriteMessageData(conn, &aEncoded[0], uEncodedLen);
+        }
+
+        if(res!=0)
+        {
+            nStatus = 3; // Couldn't send data.
+            break;
+        }
+
+        if(dwBlockLen<dwBlockSize)
+            break;
+    }
 
+    CloseHandle(hFile);
+    return nStatus;
+}
@@ -83,6 +83,78 @@ private:
     std::vector<CString> m_aAttachments; // The list of file attachments
 };
 
+// Message data is sent in portions of this size (the size of BDAT chunk).
+#define SMTP_DATA_CHUNK_SIZE (256*1024)
+
+// Maximum count of pipelined BDAT chunks whose replies are not read yet.
+#define SMTP_MAX_PENDING_REPLIES 8
+
+// Maximum length of a reply line.
+#define SMTP_MAX_REPLY_LINE 4096
+
+// Total time allowed for connecting to SMTP server (in milliseconds).
+#define SMTP_CONNECT_TIMEOUT 30000
+
+// Delay before starting a connection attempt to the next server address
+// while previous attempts are still in progress (in milliseconds).
+#define SMTP_CONNECT_ATTEMPT_DELAY 250
+
+// Time to wait for SMTP server reply (in milliseconds).
+#define SMTP_REPLY_TIMEOUT 300000
+
+// Struct: SmtpServerCaps
+// Brief: Service extensions announced by SMTP server in reply to EHLO.
+struct SmtpServerCaps
+{
+    // Constructor.
+    SmtpServerCaps();
+
+    bool m_bESMTP;        // Server accepted EHLO.
+    bool m_bPipelining;   // PIPELINING (RFC 2920).
+    bool m_bChunking;     // CHUNKING, the BDAT command (RFC 3030).
+    bool m_b8BitMime;     // 8BITMIME (RFC 6152).
+    bool m_bBinaryMime;   // BINARYMIME (RFC 3030), usable only together with CHUNKING.
+    bool m_bSize;         // SIZE (RFC 1870).
+    ULONG64 m_uMaxSize;   // Message size limit, zero if there is no limit.
+};
+
+// Struct: SmtpConnection
+// Brief: State of a connection to SMTP server.
+struct SmtpConnection
+{
+    // Constructor.
+    SmtpConnection();
+
+    SOCKET m_sock;                 // Connected socket.
+    SmtpServerCaps m_Caps;         // Extensions supported by server.
+    std::string m_sRecvBuf;        // Received data not parsed into replies yet.
+    std::vector<char> m_aDataBuf;  // Message data waiting to be sent.
+    bool m_bChunked;               // Message data is sent with BDAT rather than DATA.
+    int m_nPendingReplies;         // Count of BDAT chunks whose replies are not read yet.
+};
+
+// Struct: SmtpServerAddress
+// Brief: Network address of SMTP server.
+struct SmtpServerAddress
+{
+    // Constructor.
+    SmtpServerAddress();
+
+    CString m_sHost;               // Server name.
+    int m_nFamily;                 // Address family.
+    SOCKADDR_STORAGE m_Addr;       // Address.
+    int m_nAddrLen;                // Address length.
+    bool m_bTried;                 // Connection to this address failed.
+};
+
+// Struct: SmtpRecipientGroup
+// Brief: Recipients delivered to through the same SMTP servers.
+struct SmtpRecipientGroup
+{
+    std::multimap<WORD, CString> m_HostList; // Servers ordered by preference.
+    std::vector<CString> m_aRecipients;      // Recipient addresses.
+};
+
 // Class: CSmtpClient
 // Brief: Simple SMTP client.
 // Details: Sends an E-mail message to one or several recipients.
@@ -120,32 +192,62 @@ protected:
     // Resolves the domain name(s) of SMTP server by given E-mail address.
 	// To resolve the name, MX record of DNS is used.
 	// Returns zero on success, otherwise non-zero.
-    int ResolveSmtpServerName(LPCTSTR szEmailAddress, std::map<WORD, CString>& host_list);
+    int ResolveSmtpServerName(LPCTSTR szEmailAddress, std::multimap<WORD, CString>& host_list);
+
+	// Sends E-mail message to the given recipients through one of the given SMTP servers.
+	// Returns zero on success, otherwise non-zero.
+    int SendEmailToRecipients(std::multimap<WORD, CString>& host_list,
+		std::vector<CString>& aRecipients, CEmailMessage* msg);
+
+	// Resolves addresses of the given SMTP servers.
+    void ResolveServerAddresses(std::multimap<WORD, CString>& host_list,
+		std::vector<SmtpServerAddress>& aAddresses);
 
-	// Sends E-mail message to the specified SMTP server.
+	// Connects to whichever of the given addresses responds first.
+	// Returns the index of connected address, or -1 on failure.
+    int ConnectToServer(std::vector<SmtpServerAddress>& aAddresses, SmtpConnection& conn);
+
+	// Sends E-mail message to the given recipients over the connection.
 	// Returns zero on success, otherwise non-zero.
-    int SendEmailToRecipient(CString sSmtpServer, CEmailMessage* msg);
+    int SendEmailTransaction(SmtpConnection& conn,
+		std::vector<CString>& aRecipients, CEmailMessage* msg);
 
 	// Validates E-mail address syntax.
 	// Returns zero on success, otherwise non-zero.
     int CheckAddressSyntax(CString addr);
 
-	// Sends a message to SMTP server and reads response.
+	// Sends a command to SMTP server and reads response.
+	// Returns the reply code, or -1 on error.
+    int SendMsg(SmtpConnection& conn, LPCTSTR pszMessage, std::string* psReply=NULL);
+
+	// Reads a (possibly multi-line) reply from SMTP server.
+	// Returns the reply code, or -1 on error.
+    int ReadReply(SmtpConnection& conn, std::string* psReply=NULL);
+
+	// Determines service extensions supported by server from its reply to EHLO.
+    static void ParseEhloReply(const std::string& sReply, SmtpServerCaps& caps);
+
+	// Sends the whole buffer, repeating send() as needed.
 	// Returns zero on success, otherwise non-zero.
-    int SendMsg(SOCKET sock, LPCTSTR pszMessage,
-		LPSTR pszResponse=0, UINT uResponseSize=0);
+    int SendAll(SOCKET sock, LPCSTR pData, size_t uDataLen);
 
-	// Extracts the first number from reponse message.
-    int GetMessageCode(LPSTR msg);
+	// Adds data to the message being sent. The data is sent as the buffer fills up.
+	// Returns zero on success, otherwise non-zero.
+    int WriteMessageData(SmtpConnection& conn, CString sData);
+    int WriteMessageData(SmtpConnection& conn, LPCSTR pData, size_t uDataLen);
+
+	// Sends the buffered message data (as a BDAT chunk if CHUNKING is used).
+	// Returns zero on success, otherwise non-zero.
+    int FlushMessageData(SmtpConnection& conn, bool bLast);
 
-	// Validates attachment.
+	// Validates attachment and optionally returns its size.
 	// Returns zero on success, otherwise non-zero.
-    int CheckAttachmentOK(CString sFileName);
+    int CheckAttachmentOK(CString sFileName, ULONG64* puFileSize=NULL);
 
-	// Encodes the given file into BASE-64 encoding and returns the file contents as a string.
+	// Writes the given file into the message block by block, either as is
+	// (bBinary is true) or in BASE-64 encoding.
 	// Returns zero on success, otherwise non-zero.
-    int Base64EncodeAttachment(CString sFileName,
-        std::string& sEncodedFileData);
+    int SendAttachment(SmtpConnection& conn, CString sFileName, bool bBinary);
 
 	// Converts a string from UTF-16 (UNICODE) to UTF-8 encoding.
     std::string UTF16toUTF8(LPCWSTR utf16);
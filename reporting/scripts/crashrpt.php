@@ -16,15 +16,240 @@ function done($return_status, $message)
   exit(0);
 }
 
+// Returns TRUE if text field doesn't contain inacceptable symbols
+function isOK($field)
+{
+  return !(stristr($field, "\\r") || stristr($field, "\\n"));
+}
+
 // Checks that text fild doesn't contain inacceptable symbols
 function checkOK($field)
 {
-  if (stristr($field, "\\r") || stristr($field, "\\n"))
+  if (!isOK($field))
   {
     done(450, "Invalid input parameter.");
   }
 }
 
+// Checks MD5 hash and crash GUID of a report.
+// Returns array of status code and message.
+function check_report($md5_hash, $crash_guid)
+{
+  if(!isOK($md5_hash) || !isOK($crash_guid))
+    return array(450, "Invalid input parameter.");
+  if(strlen($md5_hash)!=32)
+    return array(450, "MD5 hash value has wrong length.");
+  if(strlen($crash_guid)!=36)
+    return array(450, "Crash GUID has wrong length.");
+  // Crash GUID names the stored file
+  if(!preg_match('/^[0-9a-fA-F\-]{36}$/', $crash_guid))
+    return array(450, "Invalid crash GUID.");
+  return array(200, "OK.");
+}
+
+// Stores uploaded report file.
+// Returns array of status code and message.
+function store_report($md5_hash, $crash_guid, $error_code, $tmp_file_name)
+{
+  global $file_root;
+
+  // Check upload error code
+  if($error_code!=0)
+    return array(450, "File upload failed with code $error_code.");
+
+  if(!isOK($tmp_file_name))
+    return array(450, "Invalid input parameter.");
+
+  // Check that uploaded file data have correct MD5 hash
+  $my_md5_hash = strtolower(md5_file($tmp_file_name));
+  $their_md5_hash = strtolower($md5_hash);
+  if($my_md5_hash!=$their_md5_hash)
+    return array(451, "MD5 hash is invalid (yours is ".$their_md5_hash.", but mine is ".$my_md5_hash.")");
+
+  // Use crash GUID as file name
+  $file_name = $file_root.$crash_guid.".zip";
+
+  // Move uploaded file to an appropriate directory
+  if(!move_uploaded_file($tmp_file_name, $file_name))
+    return array(452, "Couldn't save data to local storage");
+
+  return array(200, "Success.");
+}
+
+// Batch submission. Small error reports may be sent several in one request.
+// Every reply tells the client how many reports (and bytes) a batch may hold.
+// A batch carries the batchmanifest field with "<index> <crash GUID>" line per report,
+// report[<index>][<name>] text fields and crashrpt[<index>] file attachments.
+// The reply body has "<crash GUID> <status code> <message>" line per report.
+$batch_max_count = 16;
+$batch_max_size = 4*1024*1024;
+header("X-CrashRpt-Batch-Max-Count: ".$batch_max_count);
+header("X-CrashRpt-Batch-Max-Size: ".$batch_max_size);
+
+// Specify the directory where to keep incomplete resumable uploads
+$upload_root = $file_root."uploads/";
+
+// Resumable uploads. Large error reports may be sent in chunks, so that an
+// interrupted upload continues where it stopped. The client first posts the
+// usual text fields together with upload=resumable and uploadlength=<size>.
+// The reply (201) carries the upload ID and the count of bytes received so far.
+// Then the client PUTs chunks with X-CrashRpt-Upload-Id and X-CrashRpt-Upload-Offset
+// headers; each reply carries the committed offset. When the last byte arrives,
+// the report is verified and stored as if it was uploaded in one request.
+if($_SERVER['REQUEST_METHOD']=="PUT")
+{
+  $upload_id = "";
+  if(isset($_SERVER['HTTP_X_CRASHRPT_UPLOAD_ID']))
+    $upload_id = $_SERVER['HTTP_X_CRASHRPT_UPLOAD_ID'];
+  if(!preg_match('/^[0-9a-fA-F\-]{36}$/', $upload_id))
+  {
+    done(450, "Invalid upload ID.");
+  }
+
+  $part_name = $upload_root.$upload_id.".part";
+  $info_name = $upload_root.$upload_id.".info";
+  if(!file_exists($info_name))
+  {
+    done(404, "Unknown upload ID.");
+  }
+
+  // Get MD5 hash and size of the whole report
+  list($md5_hash, $upload_length) = explode(" ", trim(file_get_contents($info_name)));
+
+  clearstatcache();
+  $committed = file_exists($part_name) ? filesize($part_name) : 0;
+
+  // The chunk must continue the data received so far
+  $offset = -1;
+  if(isset($_SERVER['HTTP_X_CRASHRPT_UPLOAD_OFFSET']))
+    $offset = intval($_SERVER['HTTP_X_CRASHRPT_UPLOAD_OFFSET']);
+  if($offset!=$committed)
+  {
+    header("X-CrashRpt-Upload-Offset: ".$committed);
+    done(409, "Upload offset mismatch.");
+  }
+
+  // Append the chunk
+  $in = fopen("php://input", "rb");
+  $out = fopen($part_name, "ab");
+  if(!$in || !$out)
+  {
+    done(452, "Couldn't save data to local storage");
+  }
+  stream_copy_to_stream($in, $out);
+  fclose($in);
+  fclose($out);
+
+  clearstatcache();
+  $committed = filesize($part_name);
+  if($committed>$upload_length)
+  {
+    unlink($part_name);
+    unlink($info_name);
+    done(450, "Too much data uploaded.");
+  }
+
+  header("X-CrashRpt-Upload-Offset: ".$committed);
+
+  if($committed<$upload_length)
+  {
+    done(200, "Chunk accepted.");
+  }
+
+  // The report is complete; check that it has correct MD5 hash
+  $my_md5_hash = strtolower(md5_file($part_name));
+  if($my_md5_hash!=$md5_hash)
+  {
+    unlink($part_name);
+    unlink($info_name);
+    done(451, "MD5 hash is invalid (yours is ".$md5_hash.", but mine is ".$my_md5_hash.")");
+  }
+
+  // Use crash GUID (upload ID) as file name
+  if(!rename($part_name, $file_root.$upload_id.".zip"))
+  {
+    done(452, "Couldn't save data to local storage");
+  }
+
+  unlink($info_name);
+  done(200, "Success.");
+}
+
+if(isset($_POST['batchmanifest']))
+{
+  $reports = isset($_POST['report']) ? $_POST['report'] : array();
+  $files = isset($_FILES['crashrpt']) ? $_FILES['crashrpt'] : array();
+
+  $lines = preg_split('/\r?\n/', trim($_POST['batchmanifest']));
+  if(count($lines)>$batch_max_count)
+  {
+    done(450, "Too many reports in batch.");
+  }
+
+  // Check the whole manifest before storing anything: every index and
+  // crash GUID may appear only once, and the attachments must fit the
+  // advertised batch size.
+  $entries = array();
+  $seen_indexes = array();
+  $seen_guids = array();
+  $total_size = 0;
+  foreach($lines as $line)
+  {
+    $parts = explode(" ", trim($line));
+    if(count($parts)!=2)
+    {
+      done(450, "Invalid batch manifest.");
+    }
+    list($index, $crash_guid) = $parts;
+
+    $guid_key = strtolower($crash_guid);
+    if(isset($seen_indexes[$index]) || isset($seen_guids[$guid_key]))
+    {
+      done(450, "Duplicate report in batch manifest.");
+    }
+    $seen_indexes[$index] = true;
+    $seen_guids[$guid_key] = true;
+
+    if(isset($files['size'][$index]))
+      $total_size += $files['size'][$index];
+
+    $entries[] = $parts;
+  }
+
+  if($total_size>$batch_max_size)
+  {
+    done(450, "Batch is too large.");
+  }
+
+  $acks = "";
+  foreach($entries as $parts)
+  {
+    list($index, $crash_guid) = $parts;
+
+    $fields = isset($reports[$index]) ? $reports[$index] : array();
+    $md5_hash = isset($fields['md5']) ? $fields['md5'] : "";
+
+    if(!isset($fields['crashguid']) || $fields['crashguid']!=$crash_guid)
+      $result = array(450, "Crash GUID doesn't match batch manifest.");
+    else
+      $result = check_report($md5_hash, $crash_guid);
+
+    if($result[0]==200)
+    {
+      if(!isset($files['error'][$index]))
+        $result = array(452, "File attachment missing");
+      else
+        $result = store_report($md5_hash, $crash_guid, $files['error'][$index], $files['tmp_name'][$index]);
+    }
+
+    $acks .= $crash_guid." ".$result[0]." ".$result[1]."\n";
+  }
+
+  header("HTTP/1.0 200 Batch processed.");
+  echo $acks;
+  exit(0);
+}
+
 $md5_hash = "";    // MD5 hash for error report ZIP
 $file_name = "";   // Destination file name
 $crash_guid = "";  // Crash GUID
@@ -56,35 +281,61 @@ if(strlen($crash_guid)!=36)
   done(450, "Crash GUID has wrong length.");
 }
 
-// Get file attachment
-if(array_key_exists("crashrpt", $_FILES))
+// Start (or continue) a resumable upload
+if(isset($_POST['upload']) && $_POST['upload']=="resumable")
 {
-  // Check upload error code
-  $error_code = $_FILES["crashrpt"]["error"];
-  if($error_code!=0)
+  // Crash GUID names the upload files, so it must be a GUID indeed
+  if(!preg_match('/^[0-9a-fA-F\-]{36}$/', $crash_guid))
   {
-    done(450, "File upload failed with code $error_code.");
+    done(450, "Invalid crash GUID.");
   }
 
-  // Get temporary name uploaded file is stored currently
-  $tmp_file_name = $_FILES["crashrpt"]["tmp_name"];
-  checkOK($tmp_file_name);
+  $upload_length = isset($_POST['uploadlength']) ? intval($_POST['uploadlength']) : 0;
+  if($upload_length<=0)
+  {
+    done(450, "Upload length is missing.");
+  }
 
-  // Check that uploaded file data have correct MD5 hash
-  $my_md5_hash = strtolower(md5_file($tmp_file_name));
-  $their_md5_hash = strtolower($md5_hash);
-  if($my_md5_hash!=$their_md5_hash)
+  if(!is_dir($upload_root) && !mkdir($upload_root, 0700, true))
   {
-    done(451, "MD5 hash is invalid (yours is ".$their_md5_hash.", but mine is ".$my_md5_hash.")");
+    done(452, "Couldn't save data to local storage");
   }
 
-  // Use crash GUID as file name
-  $file_name = $file_root.$crash_guid.".zip";
+  $part_name = $upload_root.$crash_guid.".part";
+  $info_name = $upload_root.$crash_guid.".info";
+  $upload_info = strtolower($md5_hash)." ".$upload_length;
 
-  // Move uploaded file to an appropriate directory
-  if(!move_uploaded_file($tmp_file_name, $file_name))
+  // Data received before can be kept only if it belongs to the same report file
+  $committed = 0;
+  clearstatcache();
+  if(file_exists($info_name) && trim(file_get_contents($info_name))==$upload_info)
   {
-    done(452, "Couldn't save data to local storage");
+    if(file_exists($part_name))
+      $committed = filesize($part_name);
+  }
+  else
+  {
+    if(file_exists($part_name))
+      unlink($part_name);
+    if(file_put_contents($info_name, $upload_info)===FALSE)
+    {
+      done(452, "Couldn't save data to local storage");
+    }
+  }
+
+  header("X-CrashRpt-Upload-Id: ".$crash_guid);
+  header("X-CrashRpt-Upload-Offset: ".$committed);
+  done(201, "Upload session created.");
+}
+
+// Get file attachment
+if(array_key_exists("crashrpt", $_FILES))
+{
+  $result = store_report($md5_hash, $crash_guid,
+    $_FILES["crashrpt"]["error"], $_FILES["crashrpt"]["tmp_name"]);
+  if($result[0]!=200)
+  {
+    done($result[0], $result[1]);
   }
 }
 else
@@ -0,0 +1,87 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+#include "stdafx.h"
+#include "Tests.h"
+#include "../reporting/crashsender/base64.h"
+
+class Base64Tests : public CTestSuite
+{
+    BEGIN_TEST_MAP(Base64Tests, "BASE-64 encoder tests")
+        REGISTER_TEST(Test_mime_encode_block);
+    END_TEST_MAP()
+
+public:
+
+    void SetUp();
+    void TearDown();
+
+    void Test_mime_encode_block();
+
+private:
+
+    // Encodes data with the streaming encoder, splitting it into blocks of the given size.
+    std::string MimeEncode(const std::vector<unsigned char>& aData, size_t uBlockSize);
+};
+
+REGISTER_TEST_SUITE( Base64Tests );
+
+void Base64Tests::SetUp()
+{
+}
+
+void Base64Tests::TearDown()
+{
+}
+
+std::string Base64Tests::MimeEncode(const std::vector<unsigned char>& aData, size_t uBlockSize)
+{
+    std::vector<char> aOut(base64_mime_encoded_size(aData.size())+1);
+    size_t uWritten = 0;
+    size_t uOffset = 0;
+    while(uOffset<aData.size())
+    {
+        size_t uLen = aData.size()-uOffset;
+        if(uLen>uBlockSize)
+            uLen = uBlockSize;
+        uWritten += base64_mime_encode_block(&aData[uOffset], uLen, &aOut[uWritten]);
+        uOffset += uLen;
+    }
+
+    return std::string(&aOut[0], uWritten);
+}
+
+void Base64Tests::Test_mime_encode_block()
+{
+    // The streaming encoder must produce the same lines as base64_encode()
+    // for any data length and any block size that is a multiple of line size.
+
+    srand(1);
+
+    size_t uLen;
+    for(uLen=0; uLen<1000; uLen++)
+    {
+        std::vector<unsigned char> aData(uLen);
+        size_t i;
+        for(i=0; i<uLen; i++)
+            aData[i] = (unsigned char)rand();
+
+        std::string sExpected = base64_encode(uLen?&aData[0]:NULL, (unsigned int)uLen);
+        // The streaming encoder terminates the last line too
+        if(uLen>0 && (sExpected.length()<2 || sExpected.substr(sExpected.length()-2)!="\r\n"))
+            sExpected += "\r\n";
+
+        TEST_ASSERT(base64_mime_encoded_size(uLen)==sExpected.length());
+        TEST_ASSERT(MimeEncode(aData, BASE64_MIME_LINE_BYTES)==sExpected);
+        TEST_ASSERT(MimeEncode(aData, BASE64_MIME_LINE_BYTES*7)==sExpected);
+    }
+
+    __TEST_CLEANUP__;
+}
@@ -0,0 +1,222 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+#include "stdafx.h"
+#include "Tests.h"
+#include "../reporting/crashsender/ColorConv.h"
+
+class ColorConvTests : public CTestSuite
+{
+    BEGIN_TEST_MAP(ColorConvTests, "Color conversion tests")
+        REGISTER_TEST(Test_rgb24_to_yv12);
+        REGISTER_TEST(Test_rgb24_to_yv12_exact);
+        REGISTER_TEST(Test_yv12_to_rgb24_exact);
+        REGISTER_TEST(Test_yv12_to_rgb24_all_colors);
+    END_TEST_MAP()
+
+public:
+
+    void SetUp();
+    void TearDown();
+
+    void Test_rgb24_to_yv12();
+    void Test_rgb24_to_yv12_exact();
+    void Test_yv12_to_rgb24_exact();
+    void Test_yv12_to_rgb24_all_colors();
+
+private:
+
+    // Converts a random image of the given size with every supported instruction set.
+    // Returns false if the result differs from the scalar one.
+    bool CompareRGBToYV12(int nWidth, int nHeight);
+    bool CompareYV12ToRGB(int nWidth, int nHeight);
+
+    int m_nIsa; // Instruction set used before the test.
+};
+
+REGISTER_TEST_SUITE( ColorConvTests );
+
+void ColorConvTests::SetUp()
+{
+    m_nIsa = colorconv_get_isa();
+}
+
+void ColorConvTests::TearDown()
+{
+    colorconv_set_isa(m_nIsa);
+}
+
+bool ColorConvTests::CompareRGBToYV12(int nWidth, int nHeight)
+{
+    int nStride = nWidth*3+(nWidth*3)%4;
+    int nYSize = nWidth*nHeight;
+    int nUVSize = (nWidth/2)*(nHeight/2);
+    std::vector<unsigned char> aRGB(nStride*nHeight);
+    std::vector<unsigned char> aExpected(nYSize+nUVSize*2+1, 0xAA);
+    size_t i;
+
+    for(i=0; i<aRGB.size(); i++)
+        aRGB[i] = (unsigned char)rand();
+
+    colorconv_set_isa(COLORCONV_ISA_SCALAR);
+    rgb24_to_yv12(&aRGB[0], nWidth, nHeight, nStride,
+        &aExpected[0], &aExpected[nYSize], &aExpected[nYSize+nUVSize]);
+
+    int nIsa;
+    for(nIsa=COLORCONV_ISA_SCALAR+1; nIsa<=colorconv_get_best_isa(); nIsa++)
+    {
+        std::vector<unsigned char> aYUV(aExpected.size(), 0xAA);
+        colorconv_set_isa(nIsa);
+        rgb24_to_yv12(&aRGB[0], nWidth, nHeight, nStride,
+            &aYUV[0], &aYUV[nYSize], &aYUV[nYSize+nUVSize]);
+        if(aYUV!=aExpected)
+            return false;
+    }
+
+    return true;
+}
+
+bool ColorConvTests::CompareYV12ToRGB(int nWidth, int nHeight)
+{
+    // Planes have padding at the end of rows, like decoder output does
+    int nStride = nWidth*3+(nWidth*3)%4;
+    int nYStride = nWidth+16;
+    int nUVStride = (nWidth+1)/2+8;
+    int nUVHeight = (nHeight+1)/2;
+    std::vector<unsigned char> aY(nYStride*nHeight);
+    std::vector<unsigned char> aU(nUVStride*nUVHeight);
+    std::vector<unsigned char> aV(nUVStride*nUVHeight);
+    std::vector<unsigned char> aExpected(nStride*nHeight, 0x55);
+    size_t i;
+
+    for(i=0; i<aY.size(); i++)
+        aY[i] = (unsigned char)rand();
+    for(i=0; i<aU.size(); i++)
+    {
+        aU[i] = (unsigned char)rand();
+        aV[i] = (unsigned char)rand();
+    }
+
+    colorconv_set_isa(COLORCONV_ISA_SCALAR);
+    yv12_to_rgb24(&aExpected[0], nWidth, nHeight, nStride,
+        &aY[0], nYStride, &aU[0], nUVStride, &aV[0], nUVStride);
+
+    int nIsa;
+    for(nIsa=COLORCONV_ISA_SCALAR+1; nIsa<=colorconv_get_best_isa(); nIsa++)
+    {
+        std::vector<unsigned char> aRGB(aExpected.size(), 0x55);
+        colorconv_set_isa(nIsa);
+        yv12_to_rgb24(&aRGB[0], nWidth, nHeight, nStride,
+            &aY[0], nYStride, &aU[0], nUVStride, &aV[0], nUVStride);
+        if(aRGB!=aExpected)
+            return false;
+    }
+
+    return true;
+}
+
+void ColorConvTests::Test_rgb24_to_yv12()
+{
+    // Black and white pixels must be converted to standard video levels
+
+    unsigned char aRGB[4*2*3];
+    unsigned char aYUV[4*2+2*2];
+    int i;
+
+    memset(aRGB, 0, sizeof(aRGB));
+    memset(aRGB+6, 255, 6); // Two white pixels at the right of the top row
+    memset(aRGB+12+6, 255, 6);
+
+    rgb24_to_yv12(aRGB, 4, 2, 12, aYUV, aYUV+8, aYUV+10);
+
+    for(i=0; i<8; i++)
+        TEST_ASSERT(aYUV[i]==((i%4)<2 ? 16 : 235));
+    for(i=8; i<12; i++)
+        TEST_ASSERT(aYUV[i]==128);
+
+    __TEST_CLEANUP__;
+}
+
+void ColorConvTests::Test_rgb24_to_yv12_exact()
+{
+    // Vector code must give the same result as the scalar code,
+    // including image sizes not multiple of vector size
+
+    srand(1);
+
+    int nWidth;
+    for(nWidth=1; nWidth<=100; nWidth++)
+        TEST_ASSERT_MSG(CompareRGBToYV12(nWidth, 5), "Width %d", nWidth);
+
+    TEST_ASSERT(CompareRGBToYV12(1920, 32));
+
+    __TEST_CLEANUP__;
+}
+
+void ColorConvTests::Test_yv12_to_rgb24_exact()
+{
+    // Vector code must give the same result as the scalar code,
+    // including image sizes not multiple of vector size
+
+    srand(1);
+
+    int nWidth;
+    for(nWidth=1; nWidth<=100; nWidth++)
+        TEST_ASSERT_MSG(CompareYV12ToRGB(nWidth, 5), "Width %d", nWidth);
+
+    TEST_ASSERT(CompareYV12ToRGB(1920, 32));
+
+    __TEST_CLEANUP__;
+}
+
+void ColorConvTests::Test_yv12_to_rgb24_all_colors()
+{
+    // Converts every Y, U, V combination, as vector code must round
+    // exactly as the scalar code does for all of them. Each chroma sample
+    // is shared by a 2x2 block, so blocks are filled with 4 luma values.
+
+    const int nSize = 4096;
+    const int nHalf = nSize/2;
+    std::vector<unsigned char> aY(nSize*nSize);
+    std::vector<unsigned char> aU(nHalf*nHalf);
+    std::vector<unsigned char> aV(nHalf*nHalf);
+    std::vector<unsigned char> aExpected(nSize*nSize*3);
+    std::vector<unsigned char> aRGB(nSize*nSize*3);
+    int x, y, nIsa;
+
+    for(y=0; y<nHalf; y++)
+    {
+        for(x=0; x<nHalf; x++)
+        {
+            int n = y*nHalf+x;
+            aU[n] = (unsigned char)n;
+            aV[n] = (unsigned char)(n>>8);
+            int nLuma = (n>>16)*4;
+            aY[(y*2)*nSize+x*2] = (unsigned char)(nLuma+0);
+            aY[(y*2)*nSize+x*2+1] = (unsigned char)(nLuma+1);
+            aY[(y*2+1)*nSize+x*2] = (unsigned char)(nLuma+2);
+            aY[(y*2+1)*nSize+x*2+1] = (unsigned char)(nLuma+3);
+        }
+    }
+
+    colorconv_set_isa(COLORCONV_ISA_SCALAR);
+    yv12_to_rgb24(&aExpected[0], nSize, nSize, nSize*3,
+        &aY[0], nSize, &aU[0], nHalf, &aV[0], nHalf);
+
+    for(nIsa=COLORCONV_ISA_SCALAR+1; nIsa<=colorconv_get_best_isa(); nIsa++)
+    {
+        colorconv_set_isa(nIsa);
+        yv12_to_rgb24(&aRGB[0], nSize, nSize, nSize*3,
+            &aY[0], nSize, &aU[0], nHalf, &aV[0], nHalf);
+        TEST_ASSERT_MSG(aRGB==aExpected, "Instruction set %d", nIsa);
+    }
+
+    __TEST_CLEANUP__;
+}
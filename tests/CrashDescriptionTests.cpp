@@ -0,0 +1,315 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+#include "stdafx.h"
+#include "Tests.h"
+#include "CrashDescription.h"
+
+class CrashDescriptionTests : public CTestSuite
+{
+    BEGIN_TEST_MAP(CrashDescriptionTests, "Crash description format tests")
+        REGISTER_TEST(Test_Write_Read);
+        REGISTER_TEST(Test_LargeData);
+        REGISTER_TEST(Test_SetString);
+        REGISTER_TEST(Test_Damaged);
+    END_TEST_MAP()
+
+public:
+
+    void SetUp();
+    void TearDown();
+
+    void Test_Write_Read();
+    void Test_LargeData();
+    void Test_SetString();
+    void Test_Damaged();
+
+private:
+
+    // Makes a UTF-16 string of the given text followed by a number.
+    void MakeString(const char* szText, int nNumber, std::vector<unsigned short>& aStr);
+
+    // Returns true if the string at the given offset equals the expected one.
+    bool StringEquals(CCrashDescReader& Reader, unsigned uOffs, const std::vector<unsigned short>& aExpected);
+
+    // Writes a description with the given count of file items and properties.
+    unsigned WriteDescription(void* pBuffer, size_t uSize, int nFiles, int nProps);
+};
+
+REGISTER_TEST_SUITE( CrashDescriptionTests );
+
+void CrashDescriptionTests::SetUp()
+{
+}
+
+void CrashDescriptionTests::TearDown()
+{
+}
+
+void CrashDescriptionTests::MakeString(const char* szText, int nNumber, std::vector<unsigned short>& aStr)
+{
+    char szBuf[64];
+    sprintf(szBuf, "%d", nNumber);
+    aStr.clear();
+    const char* p;
+    for(p=szText; *p!=0; p++)
+        aStr.push_back((unsigned char)*p);
+    for(p=szBuf; *p!=0; p++)
+        aStr.push_back((unsigned char)*p);
+}
+
+bool CrashDescriptionTests::StringEquals(CCrashDescReader& Reader, unsigned uOffs, const std::vector<unsigned short>& aExpected)
+{
+    const unsigned short* pStr = NULL;
+    unsigned uLength = 0;
+    if(!Reader.GetString(uOffs, pStr, uLength) || uLength!=aExpected.size())
+        return false;
+    return uLength==0 || memcmp(pStr, &aExpected[0], uLength*sizeof(unsigned short))==0;
+}
+
+unsigned CrashDescriptionTests::WriteDescription(void* pBuffer, size_t uSize, int nFiles, int nProps)
+{
+    CCrashDescWriter Writer;
+    std::vector<unsigned short> aStr;
+    int i;
+
+    CRASH_DESCRIPTION* pDesc = Writer.Create(pBuffer, uSize);
+    if(pDesc==NULL)
+        return 0;
+
+    MakeString("MyApp", 1, aStr);
+    pDesc->m_dwAppNameOffs = Writer.AddString(&aStr[0], aStr.size());
+    pDesc->m_pExceptionPtrs = 0x123456789ABCull;
+
+    for(i=0; i<nFiles; i++)
+    {
+        unsigned uOffs = Writer.AddBlock("FIL ", sizeof(FILE_ITEM));
+        MakeString("C:\\Logs\\file", i, aStr);
+        unsigned uSrcOffs = Writer.AddString(&aStr[0], aStr.size());
+        MakeString("file", i, aStr);
+        unsigned uDstOffs = Writer.AddString(&aStr[0], aStr.size());
+        if(uOffs==0 || uSrcOffs==0 || uDstOffs==0)
+            return 0;
+
+        FILE_ITEM* pItem = (FILE_ITEM*)Writer.GetBlock(uOffs);
+        pItem->m_dwSrcFilePathOffs = uSrcOffs;
+        pItem->m_dwDstFileNameOffs = uDstOffs;
+        pItem->m_bMakeCopy = i%2;
+        pItem->m_uMaxTotalSize = 0x100000000ull*i;
+        pDesc->m_uFileItems++;
+    }
+
+    for(i=0; i<nProps; i++)
+    {
+        unsigned uOffs = Writer.AddBlock("CPR ", sizeof(CUSTOM_PROP));
+        MakeString("Name", i, aStr);
+        unsigned uNameOffs = Writer.AddString(&aStr[0], aStr.size());
+        MakeString("Value", i, aStr);
+        unsigned uValueOffs = Writer.AddString(&aStr[0], aStr.size());
+        if(uOffs==0 || uNameOffs==0 || uValueOffs==0)
+            return 0;
+
+        CUSTOM_PROP* pProp = (CUSTOM_PROP*)Writer.GetBlock(uOffs);
+        pProp->m_dwNameOffs = uNameOffs;
+        pProp->m_dwValueOffs = uValueOffs;
+        pDesc->m_uCustomProps++;
+    }
+
+    return pDesc->m_dwTotalSize;
+}
+
+void CrashDescriptionTests::Test_Write_Read()
+{
+    std::vector<unsigned long long> aBuffer(4096);
+    std::vector<unsigned short> aStr;
+    CCrashDescReader Reader;
+    const GENERIC_HEADER* pBlock = NULL;
+    unsigned uOffs = 0;
+    int nFiles = 0;
+    int nProps = 0;
+
+    unsigned uSize = WriteDescription(&aBuffer[0], aBuffer.size()*8, 10, 5);
+    TEST_ASSERT(uSize!=0);
+
+    TEST_ASSERT(Reader.Init(&aBuffer[0], aBuffer.size()*8)==0);
+    TEST_ASSERT(Reader.GetHeader()->m_uVersion==CRASH_DESC_VERSION);
+    TEST_ASSERT(Reader.GetHeader()->m_dwTotalSize==uSize);
+    TEST_ASSERT(Reader.GetHeader()->m_pExceptionPtrs==0x123456789ABCull);
+    MakeString("MyApp", 1, aStr);
+    TEST_ASSERT(StringEquals(Reader, Reader.GetHeader()->m_dwAppNameOffs, aStr));
+
+    // Zero offset is an empty string
+    aStr.clear();
+    TEST_ASSERT(StringEquals(Reader, 0, aStr));
+
+    uOffs = Reader.GetHeader()->m_uSize;
+    while((pBlock = Reader.GetBlock(uOffs, uOffs))!=NULL)
+    {
+        const FILE_ITEM* pItem = (const FILE_ITEM*)CCrashDescReader::CheckBlock(pBlock, "FIL ", sizeof(FILE_ITEM));
+        const CUSTOM_PROP* pProp = (const CUSTOM_PROP*)CCrashDescReader::CheckBlock(pBlock, "CPR ", sizeof(CUSTOM_PROP));
+        if(pItem!=NULL)
+        {
+            MakeString("file", nFiles, aStr);
+            TEST_ASSERT(StringEquals(Reader, pItem->m_dwDstFileNameOffs, aStr));
+            TEST_ASSERT(pItem->m_bMakeCopy==nFiles%2);
+            TEST_ASSERT(pItem->m_uMaxTotalSize==0x100000000ull*nFiles);
+            nFiles++;
+        }
+        else if(pProp!=NULL)
+        {
+            MakeString("Value", nProps, aStr);
+            TEST_ASSERT(StringEquals(Reader, pProp->m_dwValueOffs, aStr));
+            nProps++;
+        }
+    }
+    TEST_ASSERT(uOffs==uSize);
+    TEST_ASSERT(nFiles==10 && nProps==5);
+
+    // Unknown magic and version are rejected
+    memcpy(&aBuffer[0], "CRD1", 4);
+    TEST_ASSERT(Reader.Init(&aBuffer[0], aBuffer.size()*8)==1);
+    memcpy(&aBuffer[0], "CRD2", 4);
+    ((CRASH_DESCRIPTION*)&aBuffer[0])->m_uVersion = CRASH_DESC_VERSION+1;
+    TEST_ASSERT(Reader.Init(&aBuffer[0], aBuffer.size()*8)==2);
+
+    __TEST_CLEANUP__;
+}
+
+void CrashDescriptionTests::Test_LargeData()
+{
+    // Strings longer than 64 KB and many file items must survive
+
+    std::vector<unsigned long long> aBuffer(8*1024*1024/8);
+    std::vector<unsigned short> aLong(100000);
+    CCrashDescWriter Writer;
+    CCrashDescReader Reader;
+    CRASH_DESCRIPTION* pDesc = NULL;
+    unsigned uOffs = 0;
+    size_t i;
+
+    for(i=0; i<aLong.size(); i++)
+        aLong[i] = (unsigned short)(0x400+i%1000);
+
+    pDesc = Writer.Create(&aBuffer[0], aBuffer.size()*8);
+    TEST_ASSERT(pDesc!=NULL);
+    uOffs = Writer.AddString(&aLong[0], aLong.size());
+    TEST_ASSERT(uOffs!=0);
+    pDesc->m_dwEmailTextOffs = uOffs;
+
+    TEST_ASSERT(Reader.Init(&aBuffer[0], aBuffer.size()*8)==0);
+    TEST_ASSERT(StringEquals(Reader, Reader.GetHeader()->m_dwEmailTextOffs, aLong));
+
+    TEST_ASSERT(WriteDescription(&aBuffer[0], aBuffer.size()*8, 20000, 20000)!=0);
+    TEST_ASSERT(Reader.Init(&aBuffer[0], aBuffer.size()*8)==0);
+    TEST_ASSERT(Reader.GetHeader()->m_uFileItems==20000);
+
+    // Out of space is reported
+    TEST_ASSERT(WriteDescription(&aBuffer[0], 64*1024, 20000, 0)==0);
+    TEST_ASSERT(Writer.Create(&aBuffer[0], 16)==NULL);
+
+    __TEST_CLEANUP__;
+}
+
+void CrashDescriptionTests::Test_SetString()
+{
+    std::vector<unsigned long long> aBuffer(1024);
+    std::vector<unsigned short> aStr;
+    CCrashDescWriter Writer;
+    CCrashDescReader Reader;
+    unsigned uOffs = 0;
+    unsigned uTotal = 0;
+
+    TEST_ASSERT(Writer.Create(&aBuffer[0], aBuffer.size()*8)!=NULL);
+    MakeString("Level ", 1, aStr);
+    uOffs = Writer.AddString(&aStr[0], aStr.size(), 16);
+    TEST_ASSERT(uOffs!=0);
+    uTotal = Writer.GetHeader()->m_dwTotalSize;
+
+    // Strings up to the reserved length are replaced in place
+    MakeString("Level ", 1000000000, aStr);
+    TEST_ASSERT(Writer.SetString(uOffs, &aStr[0], aStr.size()));
+    TEST_ASSERT(Writer.GetHeader()->m_dwTotalSize==uTotal);
+    TEST_ASSERT(Reader.Init(&aBuffer[0], aBuffer.size()*8)==0);
+    TEST_ASSERT(StringEquals(Reader, uOffs, aStr));
+
+    MakeString("", 2, aStr);
+    TEST_ASSERT(Writer.SetString(uOffs, &aStr[0], aStr.size()));
+    TEST_ASSERT(StringEquals(Reader, uOffs, aStr));
+
+    MakeString("Level 1234567890", 1, aStr);
+    TEST_ASSERT(!Writer.SetString(uOffs, &aStr[0], aStr.size()));
+    TEST_ASSERT(!Writer.SetString(uOffs+8, &aStr[0], 1));
+
+    // A writer attached later continues the same description
+    {
+        CCrashDescWriter Writer2;
+        TEST_ASSERT(Writer2.Attach(&aBuffer[0], aBuffer.size()*8)!=NULL);
+        TEST_ASSERT(Writer2.AddString(&aStr[0], aStr.size())==uTotal);
+    }
+
+    __TEST_CLEANUP__;
+}
+
+void CrashDescriptionTests::Test_Damaged()
+{
+    // Corrupt random bytes of a valid description. The reader must either
+    // reject the data or return only blocks and strings inside it.
+
+    std::vector<unsigned long long> aValid(2048);
+    std::vector<unsigned long long> aBuffer;
+    CCrashDescReader Reader;
+    unsigned uSize = 0;
+    int nRejected = 0;
+    int i;
+
+    uSize = WriteDescription(&aValid[0], aValid.size()*8, 50, 50);
+    TEST_ASSERT(uSize!=0);
+
+    srand(1);
+    for(i=0; i<20000; i++)
+    {
+        // Copy to a buffer of exactly the used size, so any overrun is detectable by memory checkers
+        aBuffer.assign(aValid.begin(), aValid.begin()+uSize/8);
+        unsigned char* pData = (unsigned char*)&aBuffer[0];
+        int nChanges = 1+rand()%8;
+        int j;
+        for(j=0; j<nChanges; j++)
+        {
+            size_t uPos = (size_t)rand()%(i%2==0 ? sizeof(CRASH_DESCRIPTION) : uSize);
+            pData[uPos] = (unsigned char)(rand()%4==0 ? 0xFF : rand());
+        }
+
+        if(Reader.Init(pData, uSize)!=0)
+        {
+            nRejected++;
+            continue;
+        }
+
+        unsigned uOffs = Reader.GetHeader()->m_uSize;
+        const GENERIC_HEADER* pBlock = NULL;
+        while((pBlock = Reader.GetBlock(uOffs, uOffs))!=NULL)
+        {
+            TEST_ASSERT((const unsigned char*)pBlock+pBlock->m_uSize<=pData+uSize);
+
+            const CUSTOM_PROP* pProp = (const CUSTOM_PROP*)CCrashDescReader::CheckBlock(pBlock, "CPR ", sizeof(CUSTOM_PROP));
+            const unsigned short* pStr = NULL;
+            unsigned uLength = 0;
+            if(pProp!=NULL && Reader.GetString(pProp->m_dwValueOffs, pStr, uLength) && uLength!=0)
+            {
+                TEST_ASSERT((const unsigned char*)pStr>=pData+sizeof(CRASH_DESCRIPTION));
+                TEST_ASSERT((const unsigned char*)(pStr+uLength)<=pData+uSize);
+            }
+        }
+    }
+
+    TEST_ASSERT(nRejected>0);
+
+    __TEST_CLEANUP__;
+}
@@ -32,14 +32,17 @@ class CrashRptAPITests : public CTestSuite
         REGISTER_TEST(Test_crInstallToCurrentThread2_concurrent)
         REGISTER_TEST(Test_crAddFile2A)
         REGISTER_TEST(Test_crAddFile2W)
+        REGISTER_TEST(Test_crAddFile3W)
         REGISTER_TEST(Test_crAddScreenshot)
         REGISTER_TEST(Test_crAddScreenshot2)
         REGISTER_TEST(Test_crAddPropertyA)
         REGISTER_TEST(Test_crAddPropertyW)
+        REGISTER_TEST(Test_crAddProperty_update)
         REGISTER_TEST(Test_crAddRegKeyA)
         REGISTER_TEST(Test_crAddRegKeyW)
         REGISTER_TEST(Test_crAddVideo)
         REGISTER_TEST(Test_crAddVideo_defaults)
+        REGISTER_TEST(Test_crSetVideoMemoryLimit)
         // REGISTER_TEST(Test_crAddVideo_crash)
         REGISTER_TEST(Test_crSetCrashCallbackA)
         REGISTER_TEST(Test_crSetCrashCallbackW)
@@ -80,14 +83,17 @@ class CrashRptAPITests : public CTestSuite
     void Test_crAddFileW();
     void Test_crAddFile2A();
     void Test_crAddFile2W();
+    void Test_crAddFile3W();
     void Test_crAddScreenshot();
     void Test_crAddScreenshot2();
     void Test_crAddPropertyA();
     void Test_crAddPropertyW();
+    void Test_crAddProperty_update();
     void Test_crAddRegKeyA();
     void Test_crAddRegKeyW();
     void Test_crAddVideo();
     void Test_crAddVideo_defaults();
+    void Test_crSetVideoMemoryLimit();
     void Test_crAddVideo_crash();
     void Test_crSetCrashCallbackA();
     void Test_crSetCrashCallbackW();
@@ -492,6 +498,48 @@ void CrashRptAPITests::Test_crAddFile2W()
     crUninstall();
 }
 
+void CrashRptAPITests::Test_crAddFile3W()
+{
+    strconv_t strconv;
+    CString sFileName;
+
+    {
+        // Should fail, because crInstall() should be called first
+        int nResult = crAddFile3W(L"a.txt", NULL, L"invalid file", 0, 0, 0);
+        TEST_ASSERT(nResult!=0);
+
+        // Install crash handler
+        CR_INSTALL_INFOW infoW;
+        memset(&infoW, 0, sizeof(CR_INSTALL_INFOW));
+        infoW.cb = sizeof(CR_INSTALL_INFOW);
+        infoW.pszAppVersion = L"1.0.0"; // Specify app version, otherwise it will fail.
+
+        int nInstallResult = crInstallW(&infoW);
+        TEST_ASSERT(nInstallResult==0);
+
+        // Add not existing file, crAddFile3W should fail
+        int nResult2 = crAddFile3W(L"a.txt", NULL, L"invalid file", 0, 0, 1024);
+        TEST_ASSERT(nResult2!=0);
+
+        // Add existing file with size limit, crAddFile3W should succeed
+        sFileName = Utility::GetModulePath(NULL)+_T("\\dummy.ini");
+        LPCWSTR szFileName = strconv.t2w(sFileName);
+        int nResult3 = crAddFile3W(szFileName, NULL, L"Dummy INI File", CR_AF_MAKE_FILE_COPY, 0, 1024);
+        TEST_ASSERT(nResult3==0);
+
+        // Add recursive search pattern with size budget, crAddFile3W should succeed
+        sFileName = Utility::GetModulePath(NULL)+_T("\\**\\*.log");
+        szFileName = strconv.t2w(sFileName);
+        int nResult4 = crAddFile3W(szFileName, NULL, L"Log File", CR_AF_MAKE_FILE_COPY, 1024*1024, 64*1024);
+        TEST_ASSERT(nResult4==0);
+    }
+
+    __TEST_CLEANUP__;
+
+    // Uninstall
+    crUninstall();
+}
+
 void CrashRptAPITests::Test_crAddPropertyA()
 {
     {
@@ -556,6 +604,36 @@ void CrashRptAPITests::Test_crAddPropertyW()
 
 }
 
+void CrashRptAPITests::Test_crAddProperty_update()
+{
+    {
+        // Install crash handler
+        CR_INSTALL_INFOW infoW;
+        memset(&infoW, 0, sizeof(CR_INSTALL_INFOW));
+        infoW.cb = sizeof(CR_INSTALL_INFOW);
+        infoW.pszAppVersion = L"1.0.0"; // Specify app version, otherwise it will fail.
+
+        int nInstallResult = crInstallW(&infoW);
+        TEST_ASSERT(nInstallResult==0);
+
+        // Update the same property many times, with values of different length.
+        // Should succeed without running out of shared memory.
+        CStringW sValue;
+        int i;
+        for(i=0; i<200000; i++)
+        {
+            sValue.Format(L"Level %d %s", i, CStringW(L'x', i%1000==0 ? i/1000 : i%20).GetString());
+            int nResult = crAddPropertyW(L"CurrentLevel", sValue);
+            TEST_ASSERT(nResult==0);
+        }
+    }
+
+    __TEST_CLEANUP__;
+
+    // Uninstall
+    crUninstall();
+}
+
 void CrashRptAPITests::Test_crAddScreenshot()
 {
     {
@@ -773,6 +851,47 @@ void CrashRptAPITests::Test_crAddVideo_defaults()
     crUninstall();
 }
 
+void CrashRptAPITests::Test_crSetVideoMemoryLimit()
+{
+    {
+        // Should fail, because crInstall() should be called first
+        int nResult = crSetVideoMemoryLimit(16);
+        TEST_ASSERT(nResult!=0);
+
+        // Install crash handler
+        CR_INSTALL_INFOW infoW;
+        memset(&infoW, 0, sizeof(CR_INSTALL_INFOW));
+        infoW.cb = sizeof(CR_INSTALL_INFOW);
+        infoW.pszAppVersion = L"1.0.0"; // Specify app version, otherwise it will fail.
+
+        int nInstallResult = crInstallW(&infoW);
+        TEST_ASSERT(nInstallResult==0);
+
+        // Invalid limits - should fail
+        int nResult2 = crSetVideoMemoryLimit(-1);
+        TEST_ASSERT(nResult2!=0);
+
+        int nResult3 = crSetVideoMemoryLimit(2048);
+        TEST_ASSERT(nResult3!=0);
+
+        // Should succeed
+        int nResult4 = crSetVideoMemoryLimit(16);
+        TEST_ASSERT(nResult4==0);
+
+        int nResult5 = crAddVideo(CR_AV_VIRTUAL_SCREEN|CR_AV_NO_GUI, 10000, 300, NULL, NULL);
+        TEST_ASSERT(nResult5==0);
+
+        // Video recording has been started - should fail
+        int nResult6 = crSetVideoMemoryLimit(32);
+        TEST_ASSERT(nResult6!=0);
+    }
+
+    __TEST_CLEANUP__;
+
+    // Uninstall
+    crUninstall();
+}
+
 void CrashRptAPITests::Test_crAddVideo_crash()
 {
     // This test will install CrashRpt and start recording video.
@@ -1293,6 +1412,12 @@ void CrashRptAPITests::Test_undecorated_func_names()
             (PFNCRADDVIDEO)GetProcAddress(hCrashRpt, "crAddVideo");
         TEST_ASSERT(pfncrAddVideo!=NULL);
 
+        // Test crSetVideoMemoryLimit() function name presents in the DLL export table
+        typedef int (WINAPI *PFNCRSETVIDEOMEMORYLIMIT)(int);
+        PFNCRSETVIDEOMEMORYLIMIT pfncrSetVideoMemoryLimit =
+            (PFNCRSETVIDEOMEMORYLIMIT)GetProcAddress(hCrashRpt, "crSetVideoMemoryLimit");
+        TEST_ASSERT(pfncrSetVideoMemoryLimit!=NULL);
+
         // Test crExceptionFilter() function name presents in the DLL export table
         typedef int (WINAPI *PFNCREXCEPTIONFILTER)(int, struct _EXCEPTION_POINTERS*);
         PFNCREXCEPTIONFILTER pfncrExceptionFilter =
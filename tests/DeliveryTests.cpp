@@ -12,6 +12,345 @@ be found in the Authors.txt file in the root of the source tree.
 #include "Tests.h"
 #include "Utility.h"
 #include "CrashRpt.h"
+#include <algorithm>
+
+// How many reports CrashSender.exe uploads over HTTP at the same time (MAX_HTTP_DELIVERIES).
+#define STUB_MAX_HTTP_DELIVERIES 2
+
+// A minimal HTTP server on the loopback interface that accepts error reports.
+// Each report upload is held for a while, so concurrent uploads overlap,
+// and the server tracks how many of them were in progress at once.
+class CStubHttpServer
+{
+public:
+
+    // Constructor.
+    CStubHttpServer();
+
+    // Destructor.
+    ~CStubHttpServer();
+
+    // Starts listening on a free port. The nFailReport-th report upload
+    // (counting from 1) gets error 500, the others succeed.
+    BOOL Start(int nFailReport);
+
+    // Stops the server and waits until all connections are closed.
+    void Stop();
+
+    // Returns the URL to send reports to.
+    CString GetUrl();
+
+    // Returns crash GUIDs of received reports, in order of arrival.
+    std::vector<CString> GetReports();
+
+    // Returns crash GUID of the report that has got an error.
+    CString GetFailedReport();
+
+    // Returns the maximum count of report uploads in progress at the same time.
+    int GetMaxConcurrentUploads();
+
+private:
+
+    // Accepts connections.
+    static DWORD WINAPI AcceptThread(LPVOID lpParam);
+
+    // Serves a connection.
+    static DWORD WINAPI ConnectionThread(LPVOID lpParam);
+
+    // Reads requests from the connection and answers them.
+    void ServeConnection(SOCKET sock);
+
+    // Returns the crash GUID from the multipart request body.
+    static CString GetCrashGUID(const std::string& sBody);
+
+    SOCKET m_sockListen;           // Listening socket.
+    DWORD m_dwPort;                // Listening port.
+    HANDLE m_hAcceptThread;        // Accepting thread.
+    int m_nFailReport;             // Which report upload fails.
+    CRITICAL_SECTION m_csLock;     // Protects the fields below.
+    std::vector<SOCKET> m_aSockets;  // Accepted connections.
+    std::vector<HANDLE> m_aThreads;  // Connection threads.
+    std::vector<CString> m_aReports; // Received reports.
+    CString m_sFailedReport;       // The report that has got an error.
+    int m_nUploads;                // Report uploads in progress.
+    int m_nMaxUploads;             // Maximum of m_nUploads.
+};
+
+struct StubConnection
+{
+    CStubHttpServer* m_pServer;  // Owner.
+    SOCKET m_sock;               // Accepted socket.
+};
+
+CStubHttpServer::CStubHttpServer()
+{
+    m_sockListen = INVALID_SOCKET;
+    m_dwPort = 0;
+    m_hAcceptThread = NULL;
+    m_nFailReport = 0;
+    m_nUploads = 0;
+    m_nMaxUploads = 0;
+    InitializeCriticalSection(&m_csLock);
+}
+
+CStubHttpServer::~CStubHttpServer()
+{
+    Stop();
+    DeleteCriticalSection(&m_csLock);
+}
+
+BOOL CStubHttpServer::Start(int nFailReport)
+{
+    WSADATA wsaData;
+    if(WSAStartup(MAKEWORD(2, 2), &wsaData)!=0)
+        return FALSE;
+
+    m_nFailReport = nFailReport;
+
+    m_sockListen = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if(m_sockListen==INVALID_SOCKET)
+        return FALSE;
+
+    // Let the system choose a free port
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    int nAddrLen = sizeof(addr);
+    if(bind(m_sockListen, (sockaddr*)&addr, sizeof(addr))!=0 ||
+        getsockname(m_sockListen, (sockaddr*)&addr, &nAddrLen)!=0 ||
+        listen(m_sockListen, SOMAXCONN)!=0)
+        return FALSE;
+    m_dwPort = ntohs(addr.sin_port);
+
+    m_hAcceptThread = CreateThread(NULL, 0, AcceptThread, this, 0, NULL);
+    return m_hAcceptThread!=NULL;
+}
+
+void CStubHttpServer::Stop()
+{
+    if(m_sockListen==INVALID_SOCKET)
+        return;
+
+    // Closing the socket makes accept() fail
+    closesocket(m_sockListen);
+    m_sockListen = INVALID_SOCKET;
+    if(m_hAcceptThread!=NULL)
+    {
+        WaitForSingleObject(m_hAcceptThread, INFINITE);
+        CloseHandle(m_hAcceptThread);
+        m_hAcceptThread = NULL;
+    }
+
+    // Break connections the client has left open
+    size_t i;
+    EnterCriticalSection(&m_csLock);
+    for(i=0; i<m_aSockets.size(); i++)
+        shutdown(m_aSockets[i], SD_BOTH);
+    LeaveCriticalSection(&m_csLock);
+
+    for(i=0; i<m_aThreads.size(); i++)
+    {
+        WaitForSingleObject(m_aThreads[i], INFINITE);
+        CloseHandle(m_aThreads[i]);
+    }
+    m_aThreads.clear();
+
+    for(i=0; i<m_aSockets.size(); i++)
+        closesocket(m_aSockets[i]);
+    m_aSockets.clear();
+
+    WSACleanup();
+}
+
+CString CStubHttpServer::GetUrl()
+{
+    CString sUrl;
+    sUrl.Format(_T("http://127.0.0.1:%u/crashrpt.php"), m_dwPort);
+    return sUrl;
+}
+
+std::vector<CString> CStubHttpServer::GetReports()
+{
+    EnterCriticalSection(&m_csLock);
+    std::vector<CString> aReports = m_aReports;
+    LeaveCriticalSection(&m_csLock);
+    return aReports;
+}
+
+CString CStubHttpServer::GetFailedReport()
+{
+    EnterCriticalSection(&m_csLock);
+    CString sReport = m_sFailedReport;
+    LeaveCriticalSection(&m_csLock);
+    return sReport;
+}
+
+int CStubHttpServer::GetMaxConcurrentUploads()
+{
+    EnterCriticalSection(&m_csLock);
+    int nMaxUploads = m_nMaxUploads;
+    LeaveCriticalSection(&m_csLock);
+    return nMaxUploads;
+}
+
+DWORD WINAPI CStubHttpServer::AcceptThread(LPVOID lpParam)
+{
+    CStubHttpServer* pServer = (CStubHttpServer*)lpParam;
+
+    for(;;)
+    {
+        SOCKET sock = accept(pServer->m_sockListen, NULL, NULL);
+        if(sock==INVALID_SOCKET)
+            break;
+
+        StubConnection* pConn = new StubConnection;
+        pConn->m_pServer = pServer;
+        pConn->m_sock = sock;
+
+        HANDLE hThread = CreateThread(NULL, 0, ConnectionThread, pConn, 0, NULL);
+        if(hThread==NULL)
+        {
+            closesocket(sock);
+            delete pConn;
+            continue;
+        }
+
+        EnterCriticalSection(&pServer->m_csLock);
+        pServer->m_aSockets.push_back(sock);
+        pServer->m_aThreads.push_back(hThread);
+        LeaveCriticalSection(&pServer->m_csLock);
+    }
+
+    return 0;
+}
+
+DWORD WINAPI CStubHttpServer::ConnectionThread(LPVOID lpParam)
+{
+    StubConnection* pConn = (StubConnection*)lpParam;
+    pConn->m_pServer->ServeConnection(pConn->m_sock);
+    delete pConn;
+    return 0;
+}
+
+void CStubHttpServer::ServeConnection(SOCKET sock)
+{
+    std::string sBuf;
+    char buf[16384];
+
+    // Serve requests until the client closes the connection
+    for(;;)
+    {
+        // Read request head
+        size_t uHeadEnd;
+        while((uHeadEnd = sBuf.find("\r\n\r\n"))==std::string::npos)
+        {
+            int nReceived = recv(sock, buf, sizeof(buf), 0);
+            if(nReceived<=0)
+                return;
+            sBuf.append(buf, nReceived);
+        }
+
+        std::string sHead = sBuf.substr(0, uHeadEnd+2);
+        sBuf.erase(0, uHeadEnd+4);
+        size_t i;
+        for(i=0; i<sHead.length(); i++)
+            sHead[i] = (char)tolower((unsigned char)sHead[i]);
+
+        // Read request body
+        size_t uLength = 0;
+        size_t uPos = sHead.find("\r\ncontent-length:");
+        if(uPos!=std::string::npos)
+            uLength = (size_t)_strtoui64(sHead.c_str()+uPos+17, NULL, 10);
+
+        while(sBuf.length()<uLength)
+        {
+            int nReceived = recv(sock, buf, sizeof(buf), 0);
+            if(nReceived<=0)
+                return;
+            sBuf.append(buf, nReceived);
+        }
+
+        std::string sBody = sBuf.substr(0, uLength);
+        sBuf.erase(0, uLength);
+
+        // Anything but a report upload (for example, an offer of resumable
+        // upload) gets an empty 200 response, which means "not supported"
+        BOOL bReport = sHead.find("multipart/form-data")!=std::string::npos;
+        BOOL bFail = FALSE;
+        if(bReport)
+        {
+            EnterCriticalSection(&m_csLock);
+            m_aReports.push_back(GetCrashGUID(sBody));
+            bFail = (int)m_aReports.size()==m_nFailReport;
+            if(bFail)
+                m_sFailedReport = m_aReports.back();
+            m_nUploads++;
+            if(m_nUploads>m_nMaxUploads)
+                m_nMaxUploads = m_nUploads;
+            LeaveCriticalSection(&m_csLock);
+
+            // Hold the upload, so other deliveries may start meanwhile
+            Sleep(500);
+
+            EnterCriticalSection(&m_csLock);
+            m_nUploads--;
+            LeaveCriticalSection(&m_csLock);
+        }
+
+        const char* szResponse = bFail ?
+            "HTTP/1.1 500 Internal Server Error\r\nContent-Length: 0\r\n\r\n" :
+            "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n";
+        if(send(sock, szResponse, (int)strlen(szResponse), 0)<=0)
+            return;
+    }
+}
+
+CString CStubHttpServer::GetCrashGUID(const std::string& sBody)
+{
+    // The field looks like: name="crashguid"CRLF CRLF value CRLF
+    const char* szField = "name=\"crashguid\"\r\n\r\n";
+    size_t uPos = sBody.find(szField);
+    if(uPos==std::string::npos)
+        return CString();
+
+    uPos += strlen(szField);
+    size_t uEnd = sBody.find("\r\n", uPos);
+    if(uEnd==std::string::npos)
+        return CString();
+
+    return CString(sBody.substr(uPos, uEnd-uPos).c_str());
+}
+
+// Returns names of report folders in the folder.
+static std::vector<CString> ListReportFolders(CString sFolder)
+{
+    std::vector<CString> aFolders;
+    CFindFile ff;
+    BOOL bFound = ff.FindFile(sFolder+_T("\\*"));
+    while(bFound)
+    {
+        CString sName = ff.GetFileName();
+        if(ff.IsDirectory() && !ff.IsDots() &&
+            sName.CompareNoCase(_T("blobs"))!=0 && sName.CompareNoCase(_T("logs"))!=0)
+            aFolders.push_back(sName);
+        bFound = ff.FindNextFile();
+    }
+    return aFolders;
+}
+
+// Returns TRUE while CrashSender.exe is sending queued reports.
+static BOOL IsSendingQueuedReports()
+{
+    // CrashSender.exe holds this mutex while sending queued reports
+    HANDLE hMutex = OpenMutex(SYNCHRONIZE, FALSE, _T("Local\\43773530-129a-4298-88f2-20eea3e4a59b"));
+    if(hMutex==NULL)
+        return FALSE;
+
+    CloseHandle(hMutex);
+    return TRUE;
+}
 
 class DeliveryTests : public CTestSuite
 {
@@ -20,6 +359,7 @@ class DeliveryTests : public CTestSuite
         //REGISTER_TEST(Test_SmtpDelivery)
         //REGISTER_TEST(Test_SmtpDelivery_proxy);
         //REGISTER_TEST(Test_SMAPI_Delivery)
+        REGISTER_TEST(Test_QueuedHttpDelivery);
     END_TEST_MAP()
 
 public:
@@ -31,6 +371,7 @@ public:
     void Test_SmtpDelivery();
     void Test_SmtpDelivery_proxy();
     void Test_SMAPI_Delivery();
+    void Test_QueuedHttpDelivery();
 };
 
 REGISTER_TEST_SUITE( DeliveryTests );
@@ -261,3 +602,108 @@ void DeliveryTests::Test_SMAPI_Delivery()
     // Delete tmp folder
     Utility::RecycleFile(sTmpFolder, TRUE);
 }
+
+// This test queues several reports and lets CrashSender.exe send them
+// to a local stub server. Reports are uploaded concurrently, but not more
+// of them than the HTTP transport allows, and a failed upload affects
+// only its own report.
+void DeliveryTests::Test_QueuedHttpDelivery()
+{
+    const size_t nReportCount = 5;
+    CString sAppDataFolder;
+    CString sTmpFolder;
+    CStubHttpServer Server;
+    std::vector<CString> aQueued;
+    std::vector<CString> aReceived;
+    std::vector<CString> aLeft;
+    CString sFailed;
+    size_t i;
+
+    {
+        // Start the server, it fails the second upload
+        BOOL bStart = Server.Start(2);
+        TEST_ASSERT(bStart);
+
+        // Create a temporary folder
+        Utility::GetSpecialFolder(CSIDL_APPDATA, sAppDataFolder);
+        sTmpFolder = sAppDataFolder+_T("\\CrashRptQueue");
+        Utility::RecycleFile(sTmpFolder, TRUE);
+        BOOL bCreate = Utility::CreateFolder(sTmpFolder);
+        TEST_ASSERT(bCreate);
+
+        CString sUrl = Server.GetUrl();
+
+        CR_INSTALL_INFO info;
+        memset(&info, 0, sizeof(CR_INSTALL_INFO));
+        info.cb = sizeof(CR_INSTALL_INFO);
+        info.pszAppVersion = _T("1.0.0"); // Specify app version, otherwise it will fail.
+        info.dwFlags = CR_INST_NO_GUI|CR_INST_DONT_SEND_REPORT|CR_INST_NO_MINIDUMP;
+        info.pszUrl = sUrl;
+        info.uPriorities[CR_HTTP] = 0;
+        info.uPriorities[CR_SMTP] = CR_NEGATIVE_PRIORITY;
+        info.uPriorities[CR_SMAPI] = CR_NEGATIVE_PRIORITY;
+        info.pszErrorReportSaveDir = sTmpFolder;
+        int nInstResult = crInstall(&info);
+        TEST_ASSERT(nInstResult==0);
+
+        // Generate reports and leave them in the queue
+        for(i=0; i<nReportCount; i++)
+        {
+            CR_EXCEPTION_INFO exc;
+            memset(&exc, 0, sizeof(CR_EXCEPTION_INFO));
+            exc.cb = sizeof(CR_EXCEPTION_INFO);
+            int nResult = crGenerateErrorReport(&exc);
+            TEST_ASSERT(nResult==0);
+            TEST_ASSERT(exc.hSenderProcess!=NULL);
+            WaitForSingleObject(exc.hSenderProcess, INFINITE);
+            CloseHandle(exc.hSenderProcess);
+        }
+
+        crUninstall();
+
+        aQueued = ListReportFolders(sTmpFolder);
+        TEST_ASSERT(aQueued.size()==nReportCount);
+
+        // Installing again with this flag launches CrashSender.exe to send queued reports
+        info.dwFlags = CR_INST_NO_GUI|CR_INST_SEND_QUEUED_REPORTS|CR_INST_NO_MINIDUMP;
+        nInstResult = crInstall(&info);
+        TEST_ASSERT(nInstResult==0);
+
+        // Wait until all reports have arrived and CrashSender.exe has exited
+        DWORD dwStart = GetTickCount();
+        while(Server.GetReports().size()<nReportCount || IsSendingQueuedReports())
+        {
+            TEST_ASSERT(GetTickCount()-dwStart<60000);
+            Sleep(100);
+        }
+
+        // Each report has been sent once
+        aReceived = Server.GetReports();
+        TEST_ASSERT(aReceived.size()==nReportCount);
+        for(i=0; i<nReportCount; i++)
+        {
+            TEST_ASSERT(std::find(aQueued.begin(), aQueued.end(), aReceived[i])!=aQueued.end());
+            TEST_ASSERT(std::count(aReceived.begin(), aReceived.end(), aReceived[i])==1);
+        }
+
+        // Uploads overlapped, but didn't exceed the limit
+        TEST_ASSERT(Server.GetMaxConcurrentUploads()==STUB_MAX_HTTP_DELIVERIES);
+
+        // Only the failed report stays in the queue
+        sFailed = Server.GetFailedReport();
+        aLeft = ListReportFolders(sTmpFolder);
+        TEST_ASSERT(aLeft.size()==1);
+        TEST_ASSERT(aLeft[0].CompareNoCase(sFailed)==0);
+    }
+
+    __TEST_CLEANUP__;
+
+    // Uninstall
+    crUninstall();
+
+    // Stop the server
+    Server.Stop();
+
+    // Delete tmp folder
+    Utility::RecycleFile(sTmpFolder, TRUE);
+}
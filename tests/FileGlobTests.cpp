@@ -0,0 +1,225 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+#include "stdafx.h"
+#include "Tests.h"
+#include "../reporting/crashsender/FileGlob.h"
+
+class FileGlobTests : public CTestSuite
+{
+    BEGIN_TEST_MAP(FileGlobTests, "File search pattern tests")
+        REGISTER_TEST(Test_glob_split);
+        REGISTER_TEST(Test_glob_match);
+        REGISTER_TEST(Test_glob_match_dir);
+        REGISTER_TEST(Test_glob_select);
+        REGISTER_TEST(Test_glob_dest_name);
+        REGISTER_TEST(Test_glob_unique_name);
+    END_TEST_MAP()
+
+public:
+
+    void SetUp();
+    void TearDown();
+
+    void Test_glob_split();
+    void Test_glob_match();
+    void Test_glob_match_dir();
+    void Test_glob_select();
+    void Test_glob_dest_name();
+    void Test_glob_unique_name();
+
+private:
+
+    // Adds a file to the list.
+    void AddFile(std::vector<GlobFile>& aFiles, const wchar_t* szPath,
+        unsigned long long uSize, unsigned long long uTime);
+};
+
+REGISTER_TEST_SUITE( FileGlobTests );
+
+void FileGlobTests::SetUp()
+{
+}
+
+void FileGlobTests::TearDown()
+{
+}
+
+void FileGlobTests::AddFile(std::vector<GlobFile>& aFiles, const wchar_t* szPath,
+                            unsigned long long uSize, unsigned long long uTime)
+{
+    GlobFile file;
+    file.m_sPath = szPath;
+    file.m_uSize = uSize;
+    file.m_uTime = uTime;
+    file.m_uCopySize = 0;
+    aFiles.push_back(file);
+}
+
+void FileGlobTests::Test_glob_split()
+{
+    std::wstring sBaseDir;
+    std::wstring sRelPattern;
+
+    // Single directory pattern (as before)
+    glob_split(L"C:\\Program Files\\MyApp\\*.txt", sBaseDir, sRelPattern);
+    TEST_ASSERT(sBaseDir==L"C:\\Program Files\\MyApp");
+    TEST_ASSERT(sRelPattern==L"*.txt");
+
+    // Recursive pattern, mixed separators
+    glob_split(L"C:\\MyApp/logs\\**/app*.log", sBaseDir, sRelPattern);
+    TEST_ASSERT(sBaseDir==L"C:\\MyApp/logs");
+    TEST_ASSERT(sRelPattern==L"**/app*.log");
+
+    // Wildcards in a directory name
+    glob_split(L"C:\\MyApp\\run-*\\trace.txt", sBaseDir, sRelPattern);
+    TEST_ASSERT(sBaseDir==L"C:\\MyApp");
+    TEST_ASSERT(sRelPattern==L"run-*\\trace.txt");
+
+    // Long path prefix is not a wildcard
+    glob_split(L"\\\\?\\C:\\Logs\\*.log", sBaseDir, sRelPattern);
+    TEST_ASSERT(sBaseDir==L"\\\\?\\C:\\Logs");
+    TEST_ASSERT(sRelPattern==L"*.log");
+
+    // No directory
+    glob_split(L"*.log", sBaseDir, sRelPattern);
+    TEST_ASSERT(sBaseDir==L"");
+    TEST_ASSERT(sRelPattern==L"*.log");
+
+    __TEST_CLEANUP__;
+}
+
+void FileGlobTests::Test_glob_match()
+{
+    // Single component wildcards
+    TEST_ASSERT(glob_match(L"*.log", L"app.log"));
+    TEST_ASSERT(glob_match(L"*.log", L"APP.LOG"));
+    TEST_ASSERT(glob_match(L"app?.log", L"app1.log"));
+    TEST_ASSERT(glob_match(L"a*b*c", L"aXXbYYbZc"));
+    TEST_ASSERT(glob_match(L"*", L"anything"));
+    TEST_ASSERT(!glob_match(L"*.log", L"app.log.1"));
+    TEST_ASSERT(!glob_match(L"app?.log", L"app.log"));
+    TEST_ASSERT(!glob_match(L"*.log", L"sub\\app.log"));
+
+    // Trailing ".*" matches names without extension, as in Windows
+    TEST_ASSERT(glob_match(L"*.*", L"README"));
+    TEST_ASSERT(glob_match(L"*.*", L"app.log"));
+    TEST_ASSERT(glob_match(L"app.*", L"app"));
+    TEST_ASSERT(!glob_match(L"app.*", L"apps"));
+    TEST_ASSERT(!glob_match(L"*.l*", L"README"));
+
+    // Wildcards don't cross directories
+    TEST_ASSERT(glob_match(L"*\\*.log", L"sub\\app.log"));
+    TEST_ASSERT(!glob_match(L"*\\*.log", L"a\\b\\app.log"));
+
+    // "**" matches any number of directories, including none
+    TEST_ASSERT(glob_match(L"**\\*.log", L"app.log"));
+    TEST_ASSERT(glob_match(L"**/*.log", L"a\\app.log"));
+    TEST_ASSERT(glob_match(L"**\\*.log", L"a\\b\\c\\app.log"));
+    TEST_ASSERT(glob_match(L"**\\old\\*.log", L"a\\b\\old\\app.log"));
+    TEST_ASSERT(!glob_match(L"**\\old\\*.log", L"a\\old\\b\\app.log"));
+    TEST_ASSERT(glob_match(L"a\\**\\**\\*.log", L"a\\app.log"));
+    TEST_ASSERT(glob_match(L"a\\**", L"a\\b\\c.txt"));
+    TEST_ASSERT(!glob_match(L"**\\*.log", L"a\\b\\app.txt"));
+
+    __TEST_CLEANUP__;
+}
+
+void FileGlobTests::Test_glob_match_dir()
+{
+    // Single directory pattern never descends
+    TEST_ASSERT(!glob_match_dir(L"*.log", L"sub"));
+    TEST_ASSERT(!glob_match_dir(L"*.log", L"sub.log"));
+
+    // Directory wildcards descend only into matching directories
+    TEST_ASSERT(glob_match_dir(L"run-*\\trace.txt", L"run-1"));
+    TEST_ASSERT(!glob_match_dir(L"run-*\\trace.txt", L"other"));
+    TEST_ASSERT(!glob_match_dir(L"run-*\\trace.txt", L"run-1\\deeper"));
+
+    // Recursive pattern descends everywhere below "**"
+    TEST_ASSERT(glob_match_dir(L"**\\*.log", L"a"));
+    TEST_ASSERT(glob_match_dir(L"**\\*.log", L"a\\b\\c"));
+    TEST_ASSERT(glob_match_dir(L"app\\**\\*.log", L"app\\x"));
+    TEST_ASSERT(!glob_match_dir(L"app\\**\\*.log", L"other"));
+
+    __TEST_CLEANUP__;
+}
+
+void FileGlobTests::Test_glob_select()
+{
+    std::vector<GlobFile> aFiles;
+    size_t uCount = 0;
+
+    // No limits: all files, newest first
+    AddFile(aFiles, L"old.log", 100, 1);
+    AddFile(aFiles, L"new.log", 200, 3);
+    AddFile(aFiles, L"b.log", 300, 2);
+    AddFile(aFiles, L"a.log", 400, 2);
+    uCount = glob_select(aFiles, 0, 0);
+    TEST_ASSERT(uCount==4 && aFiles.size()==4);
+    TEST_ASSERT(aFiles[0].m_sPath==L"new.log" && aFiles[0].m_uCopySize==200);
+    TEST_ASSERT(aFiles[1].m_sPath==L"a.log" && aFiles[1].m_uCopySize==400);
+    TEST_ASSERT(aFiles[2].m_sPath==L"b.log" && aFiles[2].m_uCopySize==300);
+    TEST_ASSERT(aFiles[3].m_sPath==L"old.log" && aFiles[3].m_uCopySize==100);
+
+    // Tails of large files only
+    uCount = glob_select(aFiles, 0, 250);
+    TEST_ASSERT(uCount==4);
+    TEST_ASSERT(aFiles[0].m_uCopySize==200);
+    TEST_ASSERT(aFiles[1].m_uCopySize==250);
+    TEST_ASSERT(aFiles[2].m_uCopySize==250);
+    TEST_ASSERT(aFiles[3].m_uCopySize==100);
+
+    // Budget: the file that doesn't fit gives its tail, older files are dropped
+    uCount = glob_select(aFiles, 700, 0);
+    TEST_ASSERT(uCount==3 && aFiles.size()==3);
+    TEST_ASSERT(aFiles[0].m_uCopySize==200);
+    TEST_ASSERT(aFiles[1].m_uCopySize==400);
+    TEST_ASSERT(aFiles[2].m_sPath==L"b.log" && aFiles[2].m_uCopySize==100);
+
+    // Budget used up exactly
+    uCount = glob_select(aFiles, 600, 0);
+    TEST_ASSERT(uCount==2);
+    TEST_ASSERT(aFiles[1].m_uCopySize==400);
+
+    // Empty list
+    aFiles.clear();
+    uCount = glob_select(aFiles, 100, 10);
+    TEST_ASSERT(uCount==0);
+
+    __TEST_CLEANUP__;
+}
+
+void FileGlobTests::Test_glob_dest_name()
+{
+    TEST_ASSERT(glob_dest_name(L"app.log")==L"app.log");
+    TEST_ASSERT(glob_dest_name(L"a\\b/app.log")==L"a_b_app.log");
+
+    __TEST_CLEANUP__;
+}
+
+void FileGlobTests::Test_glob_unique_name()
+{
+    std::set<std::wstring> aTaken;
+
+    // Flattened names of different paths may coincide
+    TEST_ASSERT(glob_unique_name(glob_dest_name(L"a_b\\c.log"), aTaken)==L"a_b_c.log");
+    TEST_ASSERT(glob_unique_name(glob_dest_name(L"a\\b_c.log"), aTaken)==L"a_b_c_2.log");
+    TEST_ASSERT(glob_unique_name(L"A_B_C.LOG", aTaken)==L"A_B_C_3.LOG");
+    TEST_ASSERT(glob_unique_name(L"a_b_c_2.log", aTaken)==L"a_b_c_2_2.log");
+
+    // Names without extension
+    TEST_ASSERT(glob_unique_name(L"README", aTaken)==L"README");
+    TEST_ASSERT(glob_unique_name(L"README", aTaken)==L"README_2");
+    TEST_ASSERT(glob_unique_name(L".log", aTaken)==L".log");
+    TEST_ASSERT(glob_unique_name(L".log", aTaken)==L".log_2");
+
+    __TEST_CLEANUP__;
+}
@@ -0,0 +1,272 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+#include "stdafx.h"
+#include "Tests.h"
+#include "../reporting/crashsender/Hash.h"
+
+class HashTests : public CTestSuite
+{
+    BEGIN_TEST_MAP(HashTests, "Hash function tests")
+        REGISTER_TEST(Test_MD5);
+        REGISTER_TEST(Test_MD5_HashMany);
+        REGISTER_TEST(Test_SHA256);
+        REGISTER_TEST(Test_FastHash);
+    END_TEST_MAP()
+
+public:
+
+    void SetUp();
+    void TearDown();
+
+    void Test_MD5();
+    void Test_MD5_HashMany();
+    void Test_SHA256();
+    void Test_FastHash();
+
+private:
+
+    // Makes pseudo-random data.
+    void MakeData(size_t uSize, std::vector<unsigned char>& aData);
+
+    // Returns MD5 digest of a string as text.
+    std::string MD5Hex(const char* szText);
+
+    // Returns SHA-256 digest of data fed in pieces of random size as text.
+    std::string SHA256Hex(const void* pData, size_t uSize);
+
+    int m_nIsa; // Instruction set selected before the test.
+};
+
+REGISTER_TEST_SUITE( HashTests );
+
+void HashTests::SetUp()
+{
+    m_nIsa = hash_get_isa();
+}
+
+void HashTests::TearDown()
+{
+    hash_set_isa(m_nIsa);
+}
+
+void HashTests::MakeData(size_t uSize, std::vector<unsigned char>& aData)
+{
+    aData.resize(uSize);
+    size_t i;
+    for(i=0; i<uSize; i++)
+        aData[i] = (unsigned char)((i*2654435761U)>>24);
+}
+
+std::string HashTests::MD5Hex(const char* szText)
+{
+    CMD5 md5;
+    unsigned char Digest[MD5_DIGEST_SIZE];
+    char szHex[2*MD5_DIGEST_SIZE+1];
+    md5.Update(szText, strlen(szText));
+    md5.Final(Digest);
+    hash_to_hex(Digest, sizeof(Digest), szHex);
+    return szHex;
+}
+
+std::string HashTests::SHA256Hex(const void* pData, size_t uSize)
+{
+    CSHA256 sha;
+    unsigned char Digest[SHA256_DIGEST_SIZE];
+    char szHex[2*SHA256_DIGEST_SIZE+1];
+    const unsigned char* p = (const unsigned char*)pData;
+    while(uSize!=0)
+    {
+        size_t uPart = rand()%200;
+        if(uPart>uSize)
+            uPart = uSize;
+        sha.Update(p, uPart);
+        p += uPart;
+        uSize -= uPart;
+    }
+    sha.Final(Digest);
+    hash_to_hex(Digest, sizeof(Digest), szHex);
+    return szHex;
+}
+
+void HashTests::Test_MD5()
+{
+    // RFC 1321 test suite
+    std::vector<unsigned char> aData;
+    unsigned char Digest1[MD5_DIGEST_SIZE];
+    unsigned char Digest2[MD5_DIGEST_SIZE];
+    size_t i;
+
+    TEST_ASSERT(MD5Hex("")=="d41d8cd98f00b204e9800998ecf8427e");
+    TEST_ASSERT(MD5Hex("a")=="0cc175b9c0f1b6a831c399e269772661");
+    TEST_ASSERT(MD5Hex("abc")=="900150983cd24fb0d6963f7d28e17f72");
+    TEST_ASSERT(MD5Hex("message digest")=="f96b697d7cb7938d525a2f31aaf161d0");
+    TEST_ASSERT(MD5Hex("abcdefghijklmnopqrstuvwxyz")=="c3fcd3d76192e4007dfb496cca67e13b");
+    TEST_ASSERT(MD5Hex("ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789")==
+        "d174ab98d277d9f5a5611c2c9f419d9f");
+    TEST_ASSERT(MD5Hex("12345678901234567890123456789012345678901234567890123456789012345678901234567890")==
+        "57edf4a22be3c955ac49da2e2107b67a");
+
+    // Feeding data in pieces gives the same digest
+    MakeData(10000, aData);
+    {
+        CMD5 md5;
+        md5.Update(&aData[0], aData.size());
+        md5.Final(Digest1);
+        srand(1);
+        for(i=0; i<aData.size(); )
+        {
+            size_t uPart = rand()%150;
+            if(uPart>aData.size()-i)
+                uPart = aData.size()-i;
+            md5.Update(&aData[i], uPart);
+            i += uPart;
+        }
+        md5.Final(Digest2);
+        TEST_ASSERT(memcmp(Digest1, Digest2, sizeof(Digest1))==0);
+    }
+
+    __TEST_CLEANUP__;
+}
+
+void HashTests::Test_MD5_HashMany()
+{
+    // Digests of many buffers of random sizes must be the same as
+    // digests computed one by one, with any instruction set
+
+    std::vector<unsigned char> aData;
+    std::vector<const void*> apData;
+    std::vector<size_t> aSizes;
+    std::vector<unsigned char> aExpected;
+    std::vector<unsigned char> aDigests;
+    size_t i;
+    int nIsa;
+
+    MakeData(1<<20, aData);
+    srand(2);
+    for(i=0; i<103; i++)
+    {
+        size_t uSize = i%10==0 ? rand()%65536 : rand()%300;
+        size_t uOffs = rand()%(aData.size()-uSize);
+        apData.push_back(&aData[uOffs]);
+        aSizes.push_back(uSize);
+    }
+
+    aExpected.resize(apData.size()*MD5_DIGEST_SIZE);
+    aDigests.resize(apData.size()*MD5_DIGEST_SIZE);
+    for(i=0; i<apData.size(); i++)
+    {
+        CMD5 md5;
+        md5.Update(apData[i], aSizes[i]);
+        md5.Final(&aExpected[i*MD5_DIGEST_SIZE]);
+    }
+
+    for(nIsa=HASH_ISA_SCALAR; nIsa<=hash_get_best_isa(); nIsa++)
+    {
+        hash_set_isa(nIsa);
+
+        // All buffers, and fewer than four
+        memset(&aDigests[0], 0, aDigests.size());
+        CMD5::HashMany(&apData[0], &aSizes[0], apData.size(), (unsigned char (*)[MD5_DIGEST_SIZE])&aDigests[0]);
+        TEST_ASSERT_MSG(aDigests==aExpected, "Instruction set %d", nIsa);
+
+        memset(&aDigests[0], 0, aDigests.size());
+        CMD5::HashMany(&apData[0], &aSizes[0], 3, (unsigned char (*)[MD5_DIGEST_SIZE])&aDigests[0]);
+        TEST_ASSERT(memcmp(&aDigests[0], &aExpected[0], 3*MD5_DIGEST_SIZE)==0);
+    }
+
+    __TEST_CLEANUP__;
+}
+
+void HashTests::Test_SHA256()
+{
+    std::vector<unsigned char> aData;
+    std::string sExpected;
+    int nIsa;
+    size_t i;
+
+    MakeData(100000, aData);
+
+    for(nIsa=HASH_ISA_SCALAR; nIsa<=hash_get_best_isa(); nIsa++)
+    {
+        hash_set_isa(nIsa);
+        srand(3);
+
+        // FIPS 180-2 examples
+        TEST_ASSERT_MSG(SHA256Hex("", 0)==
+            "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855", "Instruction set %d", nIsa);
+        TEST_ASSERT_MSG(SHA256Hex("abc", 3)==
+            "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad", "Instruction set %d", nIsa);
+        TEST_ASSERT_MSG(SHA256Hex("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", 56)==
+            "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1", "Instruction set %d", nIsa);
+
+        {
+            std::string sA(1000000, 'a');
+            TEST_ASSERT(SHA256Hex(sA.c_str(), sA.size())==
+                "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+        }
+
+        // Vector and scalar versions agree on data of any length
+        for(i=0; i<aData.size(); i=i*3+1)
+        {
+            std::string sDigest = SHA256Hex(&aData[0], i);
+            if(nIsa==HASH_ISA_SCALAR)
+                sExpected += sDigest;
+            else
+                TEST_ASSERT_MSG(sExpected.find(sDigest)!=std::string::npos, "Length %d", (int)i);
+        }
+    }
+
+    __TEST_CLEANUP__;
+}
+
+void HashTests::Test_FastHash()
+{
+    std::vector<unsigned char> aData;
+    unsigned long long uHash[2] = {0, 0};
+    unsigned long long uHash2[2] = {0, 0};
+    size_t i;
+
+    // XXH64 reference values
+    TEST_ASSERT(fast_hash64("", 0)==0xEF46DB3751D8E999ULL);
+    TEST_ASSERT(fast_hash64("abc", 3)==0x44BC2CF5AD770999ULL);
+
+    // Feeding data in pieces gives the same hash, for any tail length
+    MakeData(5000, aData);
+    srand(4);
+    for(i=0; i<200; i++)
+    {
+        size_t uSize = rand()%aData.size();
+        CFastHash hash;
+        hash.Init(0, true);
+        size_t uDone = 0;
+        while(uDone<uSize)
+        {
+            size_t uPart = rand()%100;
+            if(uPart>uSize-uDone)
+                uPart = uSize-uDone;
+            hash.Update(&aData[uDone], uPart);
+            uDone += uPart;
+        }
+        hash.Final128(uHash);
+        fast_hash128(&aData[0], uSize, uHash2);
+        TEST_ASSERT(uHash[0]==uHash2[0] && uHash[1]==uHash2[1]);
+        TEST_ASSERT(uHash[0]==fast_hash64(&aData[0], uSize));
+        TEST_ASSERT(uHash[0]!=uHash[1]);
+    }
+
+    // Changing one bit changes the hash
+    fast_hash128(&aData[0], aData.size(), uHash);
+    aData[1234] ^= 0x10;
+    fast_hash128(&aData[0], aData.size(), uHash2);
+    TEST_ASSERT(uHash[0]!=uHash2[0] && uHash[1]!=uHash2[1]);
+
+    __TEST_CLEANUP__;
+}
@@ -0,0 +1,449 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+#include "stdafx.h"
+#include "Tests.h"
+#include "../reporting/crashsender/HttpResponseReader.h"
+
+// Feeds a canned response in small pieces, as a socket could deliver it.
+class CCannedSource : public CHttpByteSource
+{
+public:
+
+    CCannedSource(const std::string& sData, size_t uPieceSize)
+    {
+        m_sData = sData;
+        m_uPos = 0;
+        m_uPieceSize = uPieceSize;
+        m_bFail = false;
+    }
+
+    bool Receive(std::string& sBuffer, bool& bEOF)
+    {
+        if(m_uPos==m_sData.length())
+        {
+            // Either the connection is closed or it breaks
+            bEOF = !m_bFail;
+            return false;
+        }
+
+        size_t uTake = m_sData.length()-m_uPos;
+        if(uTake>m_uPieceSize)
+            uTake = m_uPieceSize;
+        sBuffer.append(m_sData, m_uPos, uTake);
+        m_uPos += uTake;
+        return true;
+    }
+
+    std::string m_sData;  // Response data.
+    size_t m_uPos;        // Bytes delivered so far.
+    size_t m_uPieceSize;  // Bytes delivered per call.
+    bool m_bFail;         // Report an error (not EOF) at the end of data.
+};
+
+class HttpResponseReaderTests : public CTestSuite
+{
+    BEGIN_TEST_MAP(HttpResponseReaderTests, "HTTP response reader tests")
+        REGISTER_TEST(Test_http_parse_header);
+        REGISTER_TEST(Test_http_parse_chunk_size);
+        REGISTER_TEST(Test_ContentLength);
+        REGISTER_TEST(Test_Chunked);
+        REGISTER_TEST(Test_CloseDelimited);
+        REGISTER_TEST(Test_Interim);
+        REGISTER_TEST(Test_KeepAlive);
+        REGISTER_TEST(Test_NoBody);
+        REGISTER_TEST(Test_Invalid);
+        REGISTER_TEST(Test_Truncated);
+        REGISTER_TEST(Test_LargeBody);
+        REGISTER_TEST(Test_Pipelined);
+    END_TEST_MAP()
+
+public:
+
+    void SetUp();
+    void TearDown();
+
+    void Test_http_parse_header();
+    void Test_http_parse_chunk_size();
+    void Test_ContentLength();
+    void Test_Chunked();
+    void Test_CloseDelimited();
+    void Test_Interim();
+    void Test_KeepAlive();
+    void Test_NoBody();
+    void Test_Invalid();
+    void Test_Truncated();
+    void Test_LargeBody();
+    void Test_Pipelined();
+
+private:
+
+    // Reads a single response delivered in pieces of the given size.
+    int ReadCanned(const std::string& sData, size_t uPieceSize,
+        HttpResponseHead& Head, std::string& sBody, bool& bKeepAlive);
+};
+
+REGISTER_TEST_SUITE( HttpResponseReaderTests );
+
+void HttpResponseReaderTests::SetUp()
+{
+}
+
+void HttpResponseReaderTests::TearDown()
+{
+}
+
+int HttpResponseReaderTests::ReadCanned(const std::string& sData, size_t uPieceSize,
+                                        HttpResponseHead& Head, std::string& sBody, bool& bKeepAlive)
+{
+    CCannedSource Source(sData, uPieceSize);
+    CHttpResponseReader Reader(&Source);
+    return Reader.ReadResponse(Head, sBody, bKeepAlive);
+}
+
+void HttpResponseReaderTests::Test_http_parse_header()
+{
+    std::string sName;
+    std::string sValue;
+
+    TEST_ASSERT(http_parse_header("Content-Type: text/plain", sName, sValue));
+    TEST_ASSERT(sName=="content-type");
+    TEST_ASSERT(sValue=="text/plain");
+
+    // Blanks around name and value, colon in value
+    TEST_ASSERT(http_parse_header(" X-Time :\t12:30 ", sName, sValue));
+    TEST_ASSERT(sName=="x-time");
+    TEST_ASSERT(sValue=="12:30");
+
+    // Empty value
+    TEST_ASSERT(http_parse_header("X-Empty:", sName, sValue));
+    TEST_ASSERT(sValue=="");
+
+    // No name or no colon
+    TEST_ASSERT(!http_parse_header(": value", sName, sValue));
+    TEST_ASSERT(!http_parse_header("garbage", sName, sValue));
+
+    __TEST_CLEANUP__;
+}
+
+void HttpResponseReaderTests::Test_http_parse_chunk_size()
+{
+    unsigned long long uSize = 0;
+
+    TEST_ASSERT(http_parse_chunk_size("1a", uSize) && uSize==0x1a);
+    TEST_ASSERT(http_parse_chunk_size("FF", uSize) && uSize==0xff);
+    TEST_ASSERT(http_parse_chunk_size("0", uSize) && uSize==0);
+
+    // Chunk extension and trailing blanks
+    TEST_ASSERT(http_parse_chunk_size("10;name=value", uSize) && uSize==0x10);
+    TEST_ASSERT(http_parse_chunk_size("10 ", uSize) && uSize==0x10);
+
+    // Not a number, garbage after it, overflow
+    TEST_ASSERT(!http_parse_chunk_size("", uSize));
+    TEST_ASSERT(!http_parse_chunk_size("xyz", uSize));
+    TEST_ASSERT(!http_parse_chunk_size("10zz", uSize));
+    TEST_ASSERT(!http_parse_chunk_size("10000000000000000", uSize));
+
+    __TEST_CLEANUP__;
+}
+
+void HttpResponseReaderTests::Test_ContentLength()
+{
+    HttpResponseHead Head;
+    std::string sBody;
+    std::string sValue;
+    bool bKeepAlive = false;
+    size_t uPieceSize;
+    const std::string sResponse =
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Type: text/plain\r\n"
+        "Content-Length: 11\r\n"
+        "\r\n"
+        "hello world";
+
+    // The result must not depend on how the data is split
+    for(uPieceSize=1; uPieceSize<=sResponse.length(); uPieceSize++)
+    {
+        TEST_ASSERT(ReadCanned(sResponse, uPieceSize, Head, sBody, bKeepAlive)==HTTPRESP_OK);
+        TEST_ASSERT(Head.m_uStatus==200);
+        TEST_ASSERT(sBody=="hello world");
+        TEST_ASSERT(bKeepAlive);
+        TEST_ASSERT(Head.m_aHeaders.size()==2);
+        TEST_ASSERT(Head.GetHeader("CONTENT-TYPE", sValue) && sValue=="text/plain");
+    }
+
+    // Lines ending with LF only
+    TEST_ASSERT(ReadCanned("HTTP/1.1 201 Created\nContent-Length: 2\n\nok", 5,
+        Head, sBody, bKeepAlive)==HTTPRESP_OK);
+    TEST_ASSERT(Head.m_uStatus==201);
+    TEST_ASSERT(sBody=="ok");
+
+    // Bad length
+    TEST_ASSERT(ReadCanned("HTTP/1.1 200 OK\r\nContent-Length: 1x\r\n\r\nab", 4,
+        Head, sBody, bKeepAlive)==HTTPRESP_INVALID);
+
+    __TEST_CLEANUP__;
+}
+
+void HttpResponseReaderTests::Test_Chunked()
+{
+    HttpResponseHead Head;
+    std::string sBody;
+    bool bKeepAlive = false;
+    size_t uPieceSize;
+    const std::string sResponse =
+        "HTTP/1.1 200 OK\r\n"
+        "Transfer-Encoding: gzip, Chunked\r\n"
+        "\r\n"
+        "5;ext=1\r\n"
+        "hello\r\n"
+        "6\r\n"
+        " world\r\n"
+        "0\r\n"
+        "X-Trailer: yes\r\n"
+        "\r\n";
+
+    for(uPieceSize=1; uPieceSize<=sResponse.length(); uPieceSize++)
+    {
+        TEST_ASSERT(ReadCanned(sResponse, uPieceSize, Head, sBody, bKeepAlive)==HTTPRESP_OK);
+        TEST_ASSERT(sBody=="hello world");
+        TEST_ASSERT(bKeepAlive);
+    }
+
+    // Chunked encoding wins over Content-Length
+    TEST_ASSERT(ReadCanned("HTTP/1.1 200 OK\r\nContent-Length: 100\r\nTransfer-Encoding: chunked\r\n\r\n"
+        "2\r\nab\r\n0\r\n\r\n", 7, Head, sBody, bKeepAlive)==HTTPRESP_OK);
+    TEST_ASSERT(sBody=="ab");
+
+    // Invalid chunk size
+    TEST_ASSERT(ReadCanned("HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\nzz\r\nab\r\n0\r\n\r\n", 7,
+        Head, sBody, bKeepAlive)==HTTPRESP_INVALID);
+
+    // Chunk data longer than its size
+    TEST_ASSERT(ReadCanned("HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n2\r\nabc\r\n0\r\n\r\n", 7,
+        Head, sBody, bKeepAlive)==HTTPRESP_INVALID);
+
+    __TEST_CLEANUP__;
+}
+
+void HttpResponseReaderTests::Test_CloseDelimited()
+{
+    HttpResponseHead Head;
+    std::string sBody;
+    bool bKeepAlive = true;
+
+    // Without length the body ends with the connection
+    TEST_ASSERT(ReadCanned("HTTP/1.1 200 OK\r\nConnection: keep-alive\r\n\r\nall the rest", 3,
+        Head, sBody, bKeepAlive)==HTTPRESP_OK);
+    TEST_ASSERT(sBody=="all the rest");
+    TEST_ASSERT(!bKeepAlive);
+
+    __TEST_CLEANUP__;
+}
+
+void HttpResponseReaderTests::Test_Interim()
+{
+    HttpResponseHead Head;
+    std::string sBody;
+    bool bKeepAlive = false;
+
+    TEST_ASSERT(ReadCanned(
+        "HTTP/1.1 100 Continue\r\n"
+        "\r\n"
+        "HTTP/1.1 102 Processing\r\n"
+        "X-Interim: 1\r\n"
+        "\r\n"
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Length: 4\r\n"
+        "\r\n"
+        "done", 9, Head, sBody, bKeepAlive)==HTTPRESP_OK);
+    TEST_ASSERT(Head.m_uStatus==200);
+    TEST_ASSERT(sBody=="done");
+
+    // Headers of interim responses are not kept
+    TEST_ASSERT(Head.m_aHeaders.size()==1);
+
+    __TEST_CLEANUP__;
+}
+
+void HttpResponseReaderTests::Test_KeepAlive()
+{
+    HttpResponseHead Head;
+    std::string sBody;
+    bool bKeepAlive = false;
+
+    // HTTP/1.0 closes by default
+    TEST_ASSERT(ReadCanned("HTTP/1.0 200 OK\r\nContent-Length: 0\r\n\r\n", 4,
+        Head, sBody, bKeepAlive)==HTTPRESP_OK);
+    TEST_ASSERT(!bKeepAlive);
+
+    TEST_ASSERT(ReadCanned("HTTP/1.0 200 OK\r\nConnection: Keep-Alive\r\nContent-Length: 0\r\n\r\n", 4,
+        Head, sBody, bKeepAlive)==HTTPRESP_OK);
+    TEST_ASSERT(bKeepAlive);
+
+    // HTTP/1.1 keeps by default
+    TEST_ASSERT(ReadCanned("HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n", 4,
+        Head, sBody, bKeepAlive)==HTTPRESP_OK);
+    TEST_ASSERT(bKeepAlive);
+
+    TEST_ASSERT(ReadCanned("HTTP/1.1 200 OK\r\nConnection: upgrade, Close\r\nContent-Length: 0\r\n\r\n", 4,
+        Head, sBody, bKeepAlive)==HTTPRESP_OK);
+    TEST_ASSERT(!bKeepAlive);
+
+    // Only whole tokens count
+    TEST_ASSERT(ReadCanned("HTTP/1.1 200 OK\r\nConnection: closed-caption\r\nContent-Length: 0\r\n\r\n", 4,
+        Head, sBody, bKeepAlive)==HTTPRESP_OK);
+    TEST_ASSERT(bKeepAlive);
+
+    __TEST_CLEANUP__;
+}
+
+void HttpResponseReaderTests::Test_NoBody()
+{
+    HttpResponseHead Head;
+    std::string sBody;
+    bool bKeepAlive = false;
+    const std::string sResponses =
+        "HTTP/1.1 204 No Content\r\n"
+        "Content-Length: 10\r\n"
+        "\r\n"
+        "HTTP/1.1 304 Not Modified\r\n"
+        "\r\n";
+    CCannedSource Source(sResponses, 6);
+    CHttpResponseReader Reader(&Source);
+
+    // These have no body even if they claim a length
+    TEST_ASSERT(Reader.ReadResponse(Head, sBody, bKeepAlive)==HTTPRESP_OK);
+    TEST_ASSERT(Head.m_uStatus==204);
+    TEST_ASSERT(sBody.empty());
+    TEST_ASSERT(bKeepAlive);
+
+    TEST_ASSERT(Reader.ReadResponse(Head, sBody, bKeepAlive)==HTTPRESP_OK);
+    TEST_ASSERT(Head.m_uStatus==304);
+    TEST_ASSERT(bKeepAlive);
+
+    __TEST_CLEANUP__;
+}
+
+void HttpResponseReaderTests::Test_Invalid()
+{
+    HttpResponseHead Head;
+    std::string sBody;
+    bool bKeepAlive = false;
+
+    TEST_ASSERT(ReadCanned("SSH-2.0-OpenSSH\r\n\r\n", 4, Head, sBody, bKeepAlive)==HTTPRESP_INVALID);
+    TEST_ASSERT(ReadCanned("HTTP/1.1\r\n\r\n", 4, Head, sBody, bKeepAlive)==HTTPRESP_INVALID);
+    TEST_ASSERT(ReadCanned("HTTP/1.1 abc OK\r\n\r\n", 4, Head, sBody, bKeepAlive)==HTTPRESP_INVALID);
+    TEST_ASSERT(ReadCanned("HTTP/1.1 20 OK\r\n\r\n", 4, Head, sBody, bKeepAlive)==HTTPRESP_INVALID);
+
+    // Endless line
+    TEST_ASSERT(ReadCanned("HTTP/1.1 200 OK\r\nX-Long: "+std::string(HTTP_MAX_RESPONSE_BODY+10, 'a'), 4096,
+        Head, sBody, bKeepAlive)==HTTPRESP_INVALID);
+
+    __TEST_CLEANUP__;
+}
+
+void HttpResponseReaderTests::Test_Truncated()
+{
+    HttpResponseHead Head;
+    std::string sBody;
+    bool bKeepAlive = false;
+
+    // Nothing at all
+    TEST_ASSERT(ReadCanned("", 4, Head, sBody, bKeepAlive)==HTTPRESP_RECEIVE_ERROR);
+
+    // Connection closed inside head, body and chunked body
+    TEST_ASSERT(ReadCanned("HTTP/1.1 200 OK\r\nContent-Le", 4,
+        Head, sBody, bKeepAlive)==HTTPRESP_RECEIVE_ERROR);
+    TEST_ASSERT(ReadCanned("HTTP/1.1 200 OK\r\nContent-Length: 10\r\n\r\nshort", 4,
+        Head, sBody, bKeepAlive)==HTTPRESP_RECEIVE_ERROR);
+    TEST_ASSERT(ReadCanned("HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n5\r\nhello\r\n", 4,
+        Head, sBody, bKeepAlive)==HTTPRESP_RECEIVE_ERROR);
+
+    // A broken connection doesn't end a close-delimited body
+    {
+        CCannedSource Source("HTTP/1.1 200 OK\r\n\r\npartial", 4);
+        Source.m_bFail = true;
+        CHttpResponseReader Reader(&Source);
+        TEST_ASSERT(Reader.ReadResponse(Head, sBody, bKeepAlive)==HTTPRESP_RECEIVE_ERROR);
+        TEST_ASSERT(Reader.HasReceivedData());
+    }
+
+    __TEST_CLEANUP__;
+}
+
+void HttpResponseReaderTests::Test_LargeBody()
+{
+    HttpResponseHead Head;
+    std::string sBody;
+    bool bKeepAlive = false;
+    const size_t uSize = HTTP_MAX_RESPONSE_BODY*2+100;
+    char szHead[64];
+    sprintf(szHead, "HTTP/1.1 200 OK\r\nContent-Length: %u\r\n\r\n", (unsigned)uSize);
+    std::string sResponse = std::string(szHead)+std::string(uSize, 'x')+
+        "HTTP/1.1 202 Accepted\r\nContent-Length: 2\r\n\r\nok";
+    CCannedSource Source(sResponse, 1000);
+    CHttpResponseReader Reader(&Source);
+
+    // Only the beginning of the body is kept...
+    TEST_ASSERT(Reader.ReadResponse(Head, sBody, bKeepAlive)==HTTPRESP_OK);
+    TEST_ASSERT(sBody.length()==HTTP_MAX_RESPONSE_BODY);
+    TEST_ASSERT(sBody==std::string(HTTP_MAX_RESPONSE_BODY, 'x'));
+
+    // ...but all of it is read, so the next response is found
+    TEST_ASSERT(Reader.ReadResponse(Head, sBody, bKeepAlive)==HTTPRESP_OK);
+    TEST_ASSERT(Head.m_uStatus==202);
+    TEST_ASSERT(sBody=="ok");
+
+    __TEST_CLEANUP__;
+}
+
+void HttpResponseReaderTests::Test_Pipelined()
+{
+    HttpResponseHead Head;
+    std::string sBody;
+    bool bKeepAlive = false;
+    std::string sResponses =
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Length: 5\r\n"
+        "\r\n"
+        "first"
+        "HTTP/1.1 200 OK\r\n"
+        "Transfer-Encoding: chunked\r\n"
+        "\r\n"
+        "6\r\n"
+        "second\r\n"
+        "0\r\n"
+        "\r\n"
+        "HTTP/1.1 500 Internal Server Error\r\n"
+        "Content-Length: 5\r\n"
+        "\r\n"
+        "third";
+    CCannedSource Source(sResponses, 1024);
+    CHttpResponseReader Reader(&Source);
+
+    // All responses arrive in one piece, each one is read separately
+    TEST_ASSERT(Reader.ReadResponse(Head, sBody, bKeepAlive)==HTTPRESP_OK);
+    TEST_ASSERT(sBody=="first");
+    TEST_ASSERT(Reader.ReadResponse(Head, sBody, bKeepAlive)==HTTPRESP_OK);
+    TEST_ASSERT(sBody=="second");
+    TEST_ASSERT(Reader.ReadResponse(Head, sBody, bKeepAlive)==HTTPRESP_OK);
+    TEST_ASSERT(Head.m_uStatus==500);
+    TEST_ASSERT(sBody=="third");
+
+    // Nothing more
+    TEST_ASSERT(Reader.ReadResponse(Head, sBody, bKeepAlive)==HTTPRESP_RECEIVE_ERROR);
+
+    // Reset forgets the data left from the previous connection
+    Reader.Reset();
+    TEST_ASSERT(!Reader.HasReceivedData());
+
+    __TEST_CLEANUP__;
+}
@@ -0,0 +1,600 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+#include "stdafx.h"
+#include "Tests.h"
+#include "Utility.h"
+#include "strconv.h"
+#include "../reporting/crashsender/ImageEncoder.h"
+#include "png.h"
+#include "jpeglib.h"
+
+class ImageEncoderTests : public CTestSuite
+{
+    BEGIN_TEST_MAP(ImageEncoderTests, "Screenshot image encoder tests")
+        REGISTER_TEST(Test_image_write_png);
+        REGISTER_TEST(Test_image_write_png_grayscale);
+        REGISTER_TEST(Test_image_write_png_fast);
+        REGISTER_TEST(Test_image_read_png_rows);
+        REGISTER_TEST(Test_image_write_jpeg);
+        REGISTER_TEST(Test_image_write_bmp);
+    END_TEST_MAP()
+
+public:
+
+    void SetUp();
+    void TearDown();
+
+    void Test_image_write_png();
+    void Test_image_write_png_grayscale();
+    void Test_image_write_png_fast();
+    void Test_image_read_png_rows();
+    void Test_image_write_jpeg();
+    void Test_image_write_bmp();
+
+private:
+
+    // Fills a BGR image with a pattern having both smooth and noisy areas.
+    void MakeImage(int nWidth, int nHeight, int nStride, std::vector<unsigned char>& aBits);
+
+    // Fills a BGR image with something looking like a desktop with windows and text.
+    // If bSmooth is TRUE, title bars have gradients and text is antialiased, so there
+    // are too many colors for a palette.
+    void MakeUIImage(int nWidth, int nHeight, int nStride, bool bSmooth, std::vector<unsigned char>& aBits);
+
+    // Reads a PNG file into a top-down BGR (or gray) image. Palette images are expanded to BGR.
+    bool ReadPng(const char* szFileName, int& nWidth, int& nHeight, bool& bGrayscale,
+                 bool& bPalette, std::vector<unsigned char>& aPixels);
+
+    // Writes an image to a PNG file and checks it decodes to the same pixels.
+    bool RoundTripPng(const std::vector<unsigned char>& aBits, int nWidth, int nHeight, int nStride,
+                      const PngEncodeParams& Params, bool* pbPalette=NULL);
+    bool RoundTripPng(int nWidth, int nHeight, bool bGrayscale, int nThreads);
+
+    // Writes an image to a PNG file. Returns file size or -1 on error.
+    long WritePng(const char* szFileName, const std::vector<unsigned char>& aBits,
+                  int nWidth, int nHeight, int nStride, const PngEncodeParams& Params);
+
+    CString m_sTmpFolder; // Folder for files written by tests.
+};
+
+REGISTER_TEST_SUITE( ImageEncoderTests );
+
+void ImageEncoderTests::SetUp()
+{
+    CString sAppDataFolder;
+    Utility::GetSpecialFolder(CSIDL_APPDATA, sAppDataFolder);
+    m_sTmpFolder = sAppDataFolder+_T("\\CrashRpt 1.4.3\\ImageEncoderTests");
+    Utility::CreateFolder(m_sTmpFolder);
+}
+
+void ImageEncoderTests::TearDown()
+{
+    Utility::RecycleFile(m_sTmpFolder, TRUE);
+}
+
+void ImageEncoderTests::MakeImage(int nWidth, int nHeight, int nStride, std::vector<unsigned char>& aBits)
+{
+    aBits.assign((size_t)nStride*nHeight, 0);
+    int x, y;
+    for(y=0; y<nHeight; y++)
+    {
+        for(x=0; x<nWidth; x++)
+        {
+            unsigned char* p = &aBits[(size_t)y*nStride+x*3];
+            if(y<nHeight/2)
+            {
+                // Gradient, like window backgrounds
+                p[0] = (unsigned char)x;
+                p[1] = (unsigned char)y;
+                p[2] = (unsigned char)(x+y);
+            }
+            else
+            {
+                // Noise, like photos
+                p[0] = (unsigned char)rand();
+                p[1] = (unsigned char)rand();
+                p[2] = (unsigned char)rand();
+            }
+        }
+    }
+}
+
+void ImageEncoderTests::MakeUIImage(int nWidth, int nHeight, int nStride, bool bSmooth,
+                                    std::vector<unsigned char>& aBits)
+{
+    aBits.assign((size_t)nStride*nHeight, 0);
+    int x, y, i;
+
+    // Desktop background
+    for(y=0; y<nHeight; y++)
+    {
+        for(x=0; x<nWidth; x++)
+        {
+            unsigned char* p = &aBits[(size_t)y*nStride+x*3];
+            p[0] = 160; p[1] = 100; p[2] = 40;
+        }
+    }
+
+    // Windows
+    for(i=0; i<6; i++)
+    {
+        int nLeft = rand()%(nWidth/2+1);
+        int nTop = rand()%(nHeight/2+1);
+        int nRight = nLeft+nWidth/4+rand()%(nWidth/4+1);
+        int nBottom = nTop+nHeight/4+rand()%(nHeight/4+1);
+        if(nRight>nWidth)
+            nRight = nWidth;
+        if(nBottom>nHeight)
+            nBottom = nHeight;
+
+        for(y=nTop; y<nBottom; y++)
+        {
+            for(x=nLeft; x<nRight; x++)
+            {
+                unsigned char* p = &aBits[(size_t)y*nStride+x*3];
+                if(y<nTop+24)
+                {
+                    // Title bar
+                    int nShade = bSmooth ? (x-nLeft)*128/(nRight-nLeft) : 0;
+                    p[0] = (unsigned char)(200-nShade/2); p[1] = (unsigned char)(120+nShade/4); p[2] = (unsigned char)(40+nShade);
+                }
+                else if(x==nLeft || x==nRight-1 || y==nBottom-1)
+                {
+                    p[0] = p[1] = p[2] = 100; // Border
+                }
+                else if((y-nTop-24)%16>=4 && (y-nTop-24)%16<13 && x>nLeft+8 && x<nRight-8 &&
+                        ((x*7+y/16*13)%37)<30 && ((x*x+y*3)%5)<2)
+                {
+                    // Text
+                    unsigned char c = bSmooth ? (unsigned char)(rand()%160) : 0;
+                    p[0] = p[1] = p[2] = c;
+                }
+                else
+                {
+                    p[0] = p[1] = p[2] = 240; // Client area
+                }
+            }
+        }
+    }
+}
+
+bool ImageEncoderTests::ReadPng(const char* szFileName, int& nWidth, int& nHeight, bool& bGrayscale,
+                                bool& bPalette, std::vector<unsigned char>& aPixels)
+{
+    bool bStatus = false;
+    png_structp png_ptr = NULL;
+    png_infop info_ptr = NULL;
+    std::vector<png_bytep> aRows;
+    int nChannels = 0;
+    int y;
+
+    FILE* f = NULL;
+#if _MSC_VER<1400
+    f = fopen(szFileName, "rb");
+#else
+    fopen_s(&f, szFileName, "rb");
+#endif
+    if(f==NULL)
+        goto cleanup;
+
+    png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    if(png_ptr==NULL)
+        goto cleanup;
+
+    info_ptr = png_create_info_struct(png_ptr);
+    if(info_ptr==NULL)
+        goto cleanup;
+
+    if(setjmp(png_jmpbuf(png_ptr)))
+        goto cleanup;
+
+    png_init_io(png_ptr, f);
+    png_set_bgr(png_ptr);
+    png_read_info(png_ptr, info_ptr);
+
+    nWidth = (int)png_get_image_width(png_ptr, info_ptr);
+    nHeight = (int)png_get_image_height(png_ptr, info_ptr);
+    bGrayscale = png_get_color_type(png_ptr, info_ptr)==PNG_COLOR_TYPE_GRAY;
+    bPalette = png_get_color_type(png_ptr, info_ptr)==PNG_COLOR_TYPE_PALETTE;
+    if(bPalette)
+        png_set_palette_to_rgb(png_ptr);
+    nChannels = bGrayscale ? 1 : 3;
+
+    aPixels.resize((size_t)nWidth*nHeight*nChannels);
+    aRows.resize(nHeight);
+    for(y=0; y<nHeight; y++)
+        aRows[y] = &aPixels[(size_t)y*nWidth*nChannels];
+    png_read_image(png_ptr, &aRows[0]);
+    png_read_end(png_ptr, NULL);
+
+    bStatus = true;
+
+cleanup:
+
+    if(png_ptr)
+        png_destroy_read_struct(&png_ptr, info_ptr ? &info_ptr : NULL, NULL);
+
+    if(f)
+        fclose(f);
+
+    return bStatus;
+}
+
+long ImageEncoderTests::WritePng(const char* szFileName, const std::vector<unsigned char>& aBits,
+                                 int nWidth, int nHeight, int nStride, const PngEncodeParams& Params)
+{
+    FILE* f = NULL;
+#if _MSC_VER<1400
+    f = fopen(szFileName, "wb");
+#else
+    fopen_s(&f, szFileName, "wb");
+#endif
+    if(f==NULL)
+        return -1;
+
+    bool bWrite = image_write_png(f, &aBits[0], nWidth, nHeight, nStride, Params);
+    long lSize = ftell(f);
+    fclose(f);
+
+    return bWrite ? lSize : -1;
+}
+
+bool ImageEncoderTests::RoundTripPng(const std::vector<unsigned char>& aBits, int nWidth, int nHeight,
+                                     int nStride, const PngEncodeParams& Params, bool* pbPalette)
+{
+    CString sFileName = m_sTmpFolder+_T("\\test.png");
+    strconv_t strconv;
+    const char* szFileName = strconv.t2a(sFileName);
+
+    if(WritePng(szFileName, aBits, nWidth, nHeight, nStride, Params)<0)
+        return false;
+
+    int nReadWidth = 0;
+    int nReadHeight = 0;
+    bool bReadGrayscale = false;
+    bool bReadPalette = false;
+    std::vector<unsigned char> aPixels;
+    if(!ReadPng(szFileName, nReadWidth, nReadHeight, bReadGrayscale, bReadPalette, aPixels))
+        return false;
+
+    if(nReadWidth!=nWidth || nReadHeight!=nHeight || bReadGrayscale!=Params.m_bGrayscale)
+        return false;
+
+    if(pbPalette)
+        *pbPalette = bReadPalette;
+
+    int x, y;
+    for(y=0; y<nHeight; y++)
+    {
+        for(x=0; x<nWidth; x++)
+        {
+            const unsigned char* p = &aBits[(size_t)y*nStride+x*3];
+            if(Params.m_bGrayscale)
+            {
+                if(aPixels[(size_t)y*nWidth+x]!=(p[0]+p[1]+p[2])/3)
+                    return false;
+            }
+            else if(memcmp(&aPixels[((size_t)y*nWidth+x)*3], p, 3)!=0)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+bool ImageEncoderTests::RoundTripPng(int nWidth, int nHeight, bool bGrayscale, int nThreads)
+{
+    int nStride = (nWidth*3+3)&~3;
+    std::vector<unsigned char> aBits;
+    MakeImage(nWidth, nHeight, nStride, aBits);
+
+    PngEncodeParams Params;
+    Params.m_bGrayscale = bGrayscale;
+    Params.m_nThreads = nThreads;
+    return RoundTripPng(aBits, nWidth, nHeight, nStride, Params);
+}
+
+void ImageEncoderTests::Test_image_write_png()
+{
+    // Images split into one or many bands must decode to the original pixels
+
+    srand(1);
+
+    TEST_ASSERT(RoundTripPng(1, 1, false, 1));
+    TEST_ASSERT(RoundTripPng(37, PNG_MIN_BAND_ROWS+1, false, 4));
+    TEST_ASSERT(RoundTripPng(640, 480, false, 1));
+    TEST_ASSERT(RoundTripPng(640, 480, false, 4));
+    TEST_ASSERT(RoundTripPng(1023, 767, false, 0));
+
+    __TEST_CLEANUP__;
+}
+
+void ImageEncoderTests::Test_image_write_png_grayscale()
+{
+    srand(1);
+
+    TEST_ASSERT(RoundTripPng(1, 1, true, 1));
+    TEST_ASSERT(RoundTripPng(333, 250, true, 4));
+
+    __TEST_CLEANUP__;
+}
+
+void ImageEncoderTests::Test_image_write_png_fast()
+{
+    // Fast mode must write a palette image if there are few colors,
+    // and still be lossless if there are many
+
+    const int nWidth = 800;
+    const int nHeight = 600;
+    const int nStride = nWidth*3;
+    std::vector<unsigned char> aBits;
+    PngEncodeParams Params;
+    bool bPalette = false;
+    int nFilter;
+
+    srand(1);
+    Params.SetFastLossless();
+
+    MakeUIImage(nWidth, nHeight, nStride, false, aBits);
+    TEST_ASSERT(RoundTripPng(aBits, nWidth, nHeight, nStride, Params, &bPalette));
+    TEST_ASSERT(bPalette);
+
+    MakeUIImage(nWidth, nHeight, nStride, true, aBits);
+    TEST_ASSERT(RoundTripPng(aBits, nWidth, nHeight, nStride, Params, &bPalette));
+    TEST_ASSERT(!bPalette);
+
+    Params.m_bGrayscale = true;
+    TEST_ASSERT(RoundTripPng(aBits, nWidth, nHeight, nStride, Params, &bPalette));
+    TEST_ASSERT(!bPalette);
+
+    // Each fixed filter, including ones that can't be used at the top of a strip
+    Params.m_bGrayscale = false;
+    for(nFilter=PNGENC_FILTER_NONE; nFilter<=PNGENC_FILTER_FAST; nFilter++)
+    {
+        Params.m_nFilter = nFilter;
+        TEST_ASSERT_MSG(RoundTripPng(aBits, nWidth, nHeight, nStride, Params), "Filter %d", nFilter);
+    }
+
+    __TEST_CLEANUP__;
+}
+
+void ImageEncoderTests::Test_image_read_png_rows()
+{
+    // Any range of rows must be decoded exactly, from files with and without strips
+
+    const int nWidth = 300;
+    const int nHeight = 333;
+    const int nStride = nWidth*3+4;
+    std::vector<unsigned char> aBits;
+    std::vector<unsigned char> aRows(nStride*nHeight);
+    CString sFileName = m_sTmpFolder+_T("\\test.png");
+    strconv_t strconv;
+    const char* szFileName = strconv.t2a(sFileName);
+    PngStripInfo Info;
+    FILE* f = NULL;
+    int nPass, i;
+
+    srand(1);
+
+    for(nPass=0; nPass<4; nPass++)
+    {
+        PngEncodeParams Params;
+        if(nPass>=1)
+            Params.SetFastLossless();
+        if(nPass==2)
+            Params.m_nFilter = PNGENC_FILTER_PAETH;
+        MakeUIImage(nWidth, nHeight, nStride, nPass!=1, aBits);
+        Params.m_bGrayscale = nPass==3;
+
+        TEST_ASSERT(WritePng(szFileName, aBits, nWidth, nHeight, nStride, Params)>0);
+
+#if _MSC_VER<1400
+        f = fopen(szFileName, "rb");
+#else
+        fopen_s(&f, szFileName, "rb");
+#endif
+        TEST_ASSERT(f!=NULL);
+        TEST_ASSERT(image_read_png_info(f, Info));
+        TEST_ASSERT(Info.m_nWidth==nWidth && Info.m_nHeight==nHeight);
+        TEST_ASSERT(Info.m_nStripRows==(nPass==0 ? 0 : PNG_FAST_STRIP_ROWS));
+        TEST_ASSERT(Info.m_bPalette==(nPass==1));
+
+        for(i=0; i<20; i++)
+        {
+            int nFirst = i==0 ? 0 : rand()%nHeight;
+            int nCount = i==0 ? nHeight : 1+rand()%(nHeight-nFirst);
+            TEST_ASSERT(image_read_png_rows(f, Info, nFirst, nCount, &aRows[0], nStride));
+
+            int x, y;
+            for(y=0; y<nCount; y++)
+            {
+                for(x=0; x<nWidth; x++)
+                {
+                    const unsigned char* pSrc = &aBits[(y+nFirst)*nStride+x*3];
+                    const unsigned char* pDst = &aRows[y*nStride+x*3];
+                    int nGray = (pSrc[0]+pSrc[1]+pSrc[2])/3;
+                    if(Params.m_bGrayscale)
+                    {
+                        TEST_ASSERT_MSG(pDst[0]==nGray && pDst[1]==nGray && pDst[2]==nGray,
+                            "Pass %d, row %d", nPass, y+nFirst);
+                    }
+                    else
+                    {
+                        TEST_ASSERT_MSG(memcmp(pDst, pSrc, 3)==0, "Pass %d, row %d", nPass, y+nFirst);
+                    }
+                }
+            }
+        }
+
+        TEST_ASSERT(!image_read_png_rows(f, Info, nHeight-1, 2, &aRows[0], nStride));
+
+        fclose(f);
+        f = NULL;
+    }
+
+    __TEST_CLEANUP__;
+
+    if(f)
+        fclose(f);
+}
+
+void ImageEncoderTests::Test_image_write_jpeg()
+{
+    // Decoded JPEG must have the same size and roughly the same colors
+
+    const int nWidth = 64;
+    const int nHeight = 48;
+    const int nStride = nWidth*3;
+    std::vector<unsigned char> aBits(nStride*nHeight);
+    std::vector<unsigned char> aRow(nWidth*3);
+    CString sFileName = m_sTmpFolder+_T("\\test.jpg");
+    strconv_t strconv;
+    const char* szFileName = strconv.t2a(sFileName);
+    struct jpeg_decompress_struct cinfo;
+    struct jpeg_error_mgr jerr;
+    bool bDecompress = false;
+    FILE* f = NULL;
+    int x, y;
+
+    // Solid red image
+    for(y=0; y<nHeight; y++)
+    {
+        for(x=0; x<nWidth; x++)
+        {
+            aBits[y*nStride+x*3+0] = 0;
+            aBits[y*nStride+x*3+1] = 0;
+            aBits[y*nStride+x*3+2] = 255;
+        }
+    }
+
+#if _MSC_VER<1400
+    f = fopen(szFileName, "wb");
+#else
+    fopen_s(&f, szFileName, "wb");
+#endif
+    TEST_ASSERT(f!=NULL);
+    TEST_ASSERT(image_write_jpeg(f, &aBits[0], nWidth, nHeight, nStride, false, 95));
+    fclose(f);
+    f = NULL;
+
+#if _MSC_VER<1400
+    f = fopen(szFileName, "rb");
+#else
+    fopen_s(&f, szFileName, "rb");
+#endif
+    TEST_ASSERT(f!=NULL);
+
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_decompress(&cinfo);
+    bDecompress = true;
+    jpeg_stdio_src(&cinfo, f);
+    TEST_ASSERT(jpeg_read_header(&cinfo, TRUE)==JPEG_HEADER_OK);
+    TEST_ASSERT(cinfo.image_width==nWidth && cinfo.image_height==nHeight);
+    TEST_ASSERT(cinfo.num_components==3);
+
+    jpeg_start_decompress(&cinfo);
+    while(cinfo.output_scanline<cinfo.output_height)
+    {
+        JSAMPROW row_pointer[1];
+        row_pointer[0] = &aRow[0];
+        jpeg_read_scanlines(&cinfo, row_pointer, 1);
+        for(x=0; x<nWidth; x++)
+        {
+            // Decoded pixels are RGB
+            TEST_ASSERT(aRow[x*3+0]>=240 && aRow[x*3+1]<16 && aRow[x*3+2]<16);
+        }
+    }
+    jpeg_finish_decompress(&cinfo);
+
+    __TEST_CLEANUP__;
+
+    if(bDecompress)
+        jpeg_destroy_decompress(&cinfo);
+
+    if(f)
+        fclose(f);
+}
+
+void ImageEncoderTests::Test_image_write_bmp()
+{
+    // BMP must be bottom-up, rows padded to 4 bytes, gray image has a palette
+
+    const int nWidth = 5;
+    const int nHeight = 3;
+    const int nStride = 16;
+    std::vector<unsigned char> aBits;
+    std::vector<unsigned char> aFile;
+    CString sFileName = m_sTmpFolder+_T("\\test.bmp");
+    strconv_t strconv;
+    const char* szFileName = strconv.t2a(sFileName);
+    FILE* f = NULL;
+    int nGray;
+
+    MakeImage(nWidth, nHeight, nStride, aBits);
+
+    for(nGray=0; nGray<2; nGray++)
+    {
+        bool bGrayscale = nGray!=0;
+        int nBpp = bGrayscale ? 1 : 3;
+        int nRowSize = (nWidth*nBpp+3)&~3;
+        int nOffBits = 54+(bGrayscale ? 1024 : 0);
+
+#if _MSC_VER<1400
+        f = fopen(szFileName, "wb");
+#else
+        fopen_s(&f, szFileName, "wb");
+#endif
+        TEST_ASSERT(f!=NULL);
+        TEST_ASSERT(image_write_bmp(f, &aBits[0], nWidth, nHeight, nStride, bGrayscale));
+        fclose(f);
+
+#if _MSC_VER<1400
+        f = fopen(szFileName, "rb");
+#else
+        fopen_s(&f, szFileName, "rb");
+#endif
+        TEST_ASSERT(f!=NULL);
+        aFile.resize(nOffBits+nRowSize*nHeight+1);
+        TEST_ASSERT(fread(&aFile[0], 1, aFile.size(), f)==aFile.size()-1);
+        fclose(f);
+        f = NULL;
+
+        TEST_ASSERT(aFile[0]=='B' && aFile[1]=='M');
+        TEST_ASSERT(aFile[10]==(nOffBits&0xFF) && aFile[11]==(nOffBits>>8));
+        TEST_ASSERT(aFile[18]==nWidth && aFile[22]==nHeight);
+        TEST_ASSERT(aFile[28]==nBpp*8);
+        if(bGrayscale)
+        {
+            TEST_ASSERT(aFile[54+200*4]==200 && aFile[54+200*4+1]==200 && aFile[54+200*4+2]==200);
+        }
+
+        // The last file row is the top image row
+        int x;
+        for(x=0; x<nWidth; x++)
+        {
+            const unsigned char* pSrc = &aBits[x*3];
+            const unsigned char* pDst = &aFile[nOffBits+nRowSize*(nHeight-1)+x*nBpp];
+            if(bGrayscale)
+            {
+                TEST_ASSERT(pDst[0]==(pSrc[0]+pSrc[1]+pSrc[2])/3);
+            }
+            else
+            {
+                TEST_ASSERT(memcmp(pDst, pSrc, 3)==0);
+            }
+        }
+    }
+
+    __TEST_CLEANUP__;
+
+    if(f)
+        fclose(f);
+}
@@ -14,6 +14,7 @@ be found in the Authors.txt file in the root of the source tree.
 #include "Utility.h"
 #include "strconv.h"
 #include "TestUtils.h"
+#include "../reporting/crashsender/LangFile.h"
 #define MIN(a,b) (a<=b?a:b)
 
 class LangFileTests : public CTestSuite
@@ -21,6 +22,9 @@ class LangFileTests : public CTestSuite
     BEGIN_TEST_MAP(LangFileTests, "CrashRpt language file tests")
         REGISTER_TEST(Test_lang_file_versions);
 		REGISTER_TEST(Test_lang_file_strings);
+        REGISTER_TEST(Test_CLangFile_Parse);
+        REGISTER_TEST(Test_CLangFile_Binary);
+        REGISTER_TEST(Test_CLangFile_lang_files);
     END_TEST_MAP()
 
 public:
@@ -30,6 +34,9 @@ public:
 
     void Test_lang_file_versions();
 	void Test_lang_file_strings();
+    void Test_CLangFile_Parse();
+    void Test_CLangFile_Binary();
+    void Test_CLangFile_lang_files();
 
 private:
 
@@ -169,3 +176,186 @@ void LangFileTests::Test_lang_file_strings()
 
 
 }
+
+void LangFileTests::Test_CLangFile_Parse()
+{
+    // Parse an INI file in UTF-8 and UTF-16 encodings and look up its strings
+
+    const char* szIni =
+        "; Comment\r\n"
+        "Orphan=Not in section\r\n"
+        "[Settings]\r\n"
+        "CrashRptVersion=1403\r\n"
+        "  RTLReading = 0  \r\n"
+        "[ MainDlg ]\r\n"
+        "Header=Line one\\nLine two\r\n"
+        "Quoted=\"  spaced  \"\r\n"
+        "Empty=\r\n"
+        "Same=1403\r\n"
+        "Header=Duplicate\r\n"
+        "NoValue\r\n"
+        "Unicode=\xD0\x9F\xD1\x80\xD0\xB8\xD0\xB2\xD0\xB5\xD1\x82\n"
+        "[Last]\n"
+        "Key=Value";
+
+    std::vector<unsigned char> aUTF16;
+    CLangFile LangFile;
+    int nPass;
+
+    for(nPass=0; nPass<2; nPass++)
+    {
+        if(nPass==0)
+        {
+            TEST_ASSERT(LangFile.Parse((const unsigned char*)szIni, strlen(szIni)));
+        }
+        else
+        {
+            // Convert to UTF-16 LE with byte order mark
+            strconv_t strconv;
+            LPCWSTR szIniW = strconv.utf82w(szIni);
+            aUTF16.push_back(0xFF);
+            aUTF16.push_back(0xFE);
+            size_t i;
+            for(i=0; szIniW[i]!=0; i++)
+            {
+                aUTF16.push_back((unsigned char)szIniW[i]);
+                aUTF16.push_back((unsigned char)(szIniW[i]>>8));
+            }
+            TEST_ASSERT(LangFile.Parse(&aUTF16[0], aUTF16.size()));
+        }
+
+        TEST_ASSERT(LangFile.GetStringCount()==8);
+        TEST_ASSERT(wcscmp(LangFile.GetString(L"Settings", L"CrashRptVersion"), L"1403")==0);
+        TEST_ASSERT(wcscmp(LangFile.GetString(L"settings", L"RTLREADING"), L"0")==0);
+        TEST_ASSERT(wcscmp(LangFile.GetString(L"MainDlg", L"Header"), L"Line one\nLine two")==0);
+        TEST_ASSERT(wcscmp(LangFile.GetString(L"MainDlg", L"Quoted"), L"  spaced  ")==0);
+        TEST_ASSERT(wcscmp(LangFile.GetString(L"MainDlg", L"Empty"), L"")==0);
+        TEST_ASSERT(LangFile.GetString(L"MainDlg", L"Same")==LangFile.GetString(L"Settings", L"CrashRptVersion"));
+        TEST_ASSERT(wcscmp(LangFile.GetString(L"MainDlg", L"Unicode"), L"\x041F\x0440\x0438\x0432\x0435\x0442")==0);
+        TEST_ASSERT(wcscmp(LangFile.GetString(L"Last", L"Key"), L"Value")==0);
+        TEST_ASSERT(LangFile.GetString(L"MainDlg", L"NoValue")==NULL);
+        TEST_ASSERT(LangFile.GetString(L"Settings", L"Orphan")==NULL);
+        TEST_ASSERT(LangFile.GetString(L"Settings", L"Header")==NULL);
+        TEST_ASSERT(LangFile.GetString(L"Missing", L"Key")==NULL);
+    }
+
+    TEST_ASSERT(!LangFile.Parse((const unsigned char*)"", 0));
+    TEST_ASSERT(!LangFile.IsLoaded());
+    TEST_ASSERT(LangFile.GetString(L"Settings", L"CrashRptVersion")==NULL);
+
+    __TEST_CLEANUP__;
+}
+
+void LangFileTests::Test_CLangFile_Binary()
+{
+    // Save a parsed file in compiled form, load it back and try damaged copies
+
+    const char* szIni =
+        "[Settings]\r\n"
+        "CrashRptVersion=1403\r\n"
+        "[MainDlg]\r\n"
+        "Header=Line one\\nLine two\r\n";
+
+    CLangFile LangFile;
+    CLangFile LangFile2;
+    std::vector<unsigned char> aData;
+    std::vector<unsigned char> aData2;
+    size_t i;
+
+    TEST_ASSERT(LangFile.Parse((const unsigned char*)szIni, strlen(szIni)));
+    LangFile.SaveBinary(aData);
+
+    TEST_ASSERT(LangFile2.LoadBinary(&aData[0], aData.size()));
+    TEST_ASSERT(LangFile2.GetStringCount()==2);
+    TEST_ASSERT(wcscmp(LangFile2.GetString(L"Settings", L"CrashRptVersion"), L"1403")==0);
+    TEST_ASSERT(wcscmp(LangFile2.GetString(L"MAINDLG", L"header"), L"Line one\nLine two")==0);
+
+    LangFile2.SaveBinary(aData2);
+    TEST_ASSERT(aData==aData2);
+
+    // Truncated data and any damaged header field must be rejected
+    for(i=0; i<aData.size(); i++)
+        TEST_ASSERT(!LangFile2.LoadBinary(&aData[0], i));
+
+    for(i=0; i<20; i++)
+    {
+        aData2 = aData;
+        aData2[i] ^= 0x40;
+        TEST_ASSERT_MSG(!LangFile2.LoadBinary(&aData2[0], aData2.size()), "Byte %d", (int)i);
+    }
+
+    __TEST_CLEANUP__;
+}
+
+void LangFileTests::Test_CLangFile_lang_files()
+{
+    // Ensure every string of every lang file is the same as
+    // GetPrivateProfileString returns. Timings are measured by Bench_lang_file.
+
+    if(g_bRunningFromUNICODEFolder)
+        return; // Skip this test if running from another process
+
+    CString sExePath = Utility::GetModulePath(NULL);
+    FILE* f = NULL;
+
+    UINT i;
+    for(i=0; i<m_asLangAbbr.size(); i++)
+    {
+        CString sFileName;
+#ifndef WIN64
+        sFileName.Format(_T("%s\\..\\lang_files\\crashrpt_lang_%s.ini"),
+            sExePath.GetBuffer(0), m_asLangAbbr[i].GetBuffer(0));
+#else
+        sFileName.Format(_T("%s\\..\\..\\lang_files\\crashrpt_lang_%s.ini"),
+            sExePath.GetBuffer(0), m_asLangAbbr[i].GetBuffer(0));
+#endif //!WIN64
+
+        std::vector<CString> asSections;
+        std::vector<std::vector<CString> > aasNames;
+        size_t nSection;
+        size_t nStr;
+        int nStrings = 0;
+
+        TestUtils::EnumINIFileSections(sFileName, asSections);
+        aasNames.resize(asSections.size());
+        for(nSection=0; nSection<asSections.size(); nSection++)
+        {
+            TestUtils::EnumINIFileStrings(sFileName, asSections[nSection], aasNames[nSection]);
+            nStrings += (int)aasNames[nSection].size();
+        }
+
+        std::vector<CString> asExpected;
+        for(nSection=0; nSection<asSections.size(); nSection++)
+            for(nStr=0; nStr<aasNames[nSection].size(); nStr++)
+                asExpected.push_back(Utility::GetINIString(sFileName, asSections[nSection], aasNames[nSection][nStr]));
+
+        CLangFile LangFile;
+        _tfopen_s(&f, sFileName, _T("rb"));
+        TEST_ASSERT(f!=NULL);
+        TEST_ASSERT(LangFile.Load(f));
+        fclose(f);
+        f = NULL;
+
+        TEST_ASSERT(LangFile.GetStringCount()==(size_t)nStrings);
+
+        size_t nIndex = 0;
+        for(nSection=0; nSection<asSections.size(); nSection++)
+        {
+            for(nStr=0; nStr<aasNames[nSection].size(); nStr++)
+            {
+                strconv_t strconv;
+                const wchar_t* szValue = LangFile.GetString(strconv.t2w(asSections[nSection]),
+                    strconv.t2w(aasNames[nSection][nStr]));
+                TEST_ASSERT(szValue!=NULL);
+                TEST_ASSERT_MSG(CString(szValue)==asExpected[nIndex], "String %s in section %s of lang file %s",
+                    strconv.t2a(aasNames[nSection][nStr]), strconv.t2a(asSections[nSection]), strconv.t2a(m_asLangAbbr[i]));
+                nIndex++;
+            }
+        }
+    }
+
+    __TEST_CLEANUP__;
+
+    if(f!=NULL)
+        fclose(f);
+}
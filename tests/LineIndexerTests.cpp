@@ -0,0 +1,216 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+#include "stdafx.h"
+#include "Tests.h"
+#include "../reporting/crashsender/LineIndexer.h"
+
+class LineIndexerTests : public CTestSuite
+{
+    BEGIN_TEST_MAP(LineIndexerTests, "Text line indexer tests")
+        REGISTER_TEST(Test_ScanBlock);
+        REGISTER_TEST(Test_ScanBlock_UTF16);
+        REGISTER_TEST(Test_SparseLineIndex);
+    END_TEST_MAP()
+
+public:
+
+    void SetUp();
+    void TearDown();
+
+    void Test_ScanBlock();
+    void Test_ScanBlock_UTF16();
+    void Test_SparseLineIndex();
+
+private:
+
+    // Makes a random text of nChars characters with some newlines and tabs.
+    void MakeText(int nCharSize, bool bBigEndian, size_t nChars, std::vector<unsigned char>& aText);
+
+    // Finds lines checking characters one by one, the way the preview control used to.
+    void IndexReference(const std::vector<unsigned char>& aText, int nCharSize, bool bBigEndian,
+                        std::vector<unsigned long long>& aLines, int& nMaxWidth);
+
+    // Indexes the text in blocks of random sizes and compares the result with the reference one.
+    bool CompareWithReference(int nCharSize, bool bBigEndian, size_t nChars);
+};
+
+REGISTER_TEST_SUITE( LineIndexerTests );
+
+void LineIndexerTests::SetUp()
+{
+}
+
+void LineIndexerTests::TearDown()
+{
+}
+
+void LineIndexerTests::MakeText(int nCharSize, bool bBigEndian, size_t nChars, std::vector<unsigned char>& aText)
+{
+    aText.resize(nChars*nCharSize);
+    size_t i;
+    for(i=0; i<nChars; i++)
+    {
+        int r = rand()%100;
+        unsigned int c = r<5 ? '\n' : r<8 ? '\t' : 'a'+rand()%26;
+        if(r>=95)
+            c = r==99 ? 0x0A0A : (unsigned int)rand()%0x10000; // Bytes looking like newlines
+        if(nCharSize==1)
+            aText[i] = (unsigned char)c;
+        else
+        {
+            aText[i*2+(bBigEndian?1:0)] = (unsigned char)c;
+            aText[i*2+(bBigEndian?0:1)] = (unsigned char)(c>>8);
+        }
+    }
+}
+
+void LineIndexerTests::IndexReference(const std::vector<unsigned char>& aText, int nCharSize, bool bBigEndian,
+                                      std::vector<unsigned long long>& aLines, int& nMaxWidth)
+{
+    const int nTabLength = 4;
+    size_t uLineStart = 0;
+    int nTabs = 0;
+    size_t i;
+
+    aLines.clear();
+    nMaxWidth = 0;
+
+    for(i=0; i+nCharSize<=aText.size(); i+=nCharSize)
+    {
+        unsigned int c = aText[i];
+        if(nCharSize==2)
+            c = bBigEndian ? (aText[i]<<8)|aText[i+1] : (aText[i+1]<<8)|aText[i];
+
+        if(c=='\t')
+            nTabs++;
+        else if(c=='\n')
+        {
+            int nWidth = (int)((i+nCharSize-uLineStart)/nCharSize)+nTabs*(nTabLength-1);
+            if(nWidth>nMaxWidth)
+                nMaxWidth = nWidth;
+            uLineStart = i+nCharSize;
+            aLines.push_back(uLineStart);
+            nTabs = 0;
+        }
+    }
+}
+
+bool LineIndexerTests::CompareWithReference(int nCharSize, bool bBigEndian, size_t nChars)
+{
+    std::vector<unsigned char> aText;
+    std::vector<unsigned long long> aExpected, aLines;
+    int nExpectedWidth = 0;
+
+    MakeText(nCharSize, bBigEndian, nChars, aText);
+    IndexReference(aText, nCharSize, bBigEndian, aExpected, nExpectedWidth);
+
+    CLineIndexer Indexer;
+    Indexer.Init(nCharSize, bBigEndian, 4, 0);
+    size_t uPos = 0;
+    while(uPos<aText.size())
+    {
+        size_t uSize = (rand()%100)*nCharSize;
+        if(uPos+uSize>aText.size())
+            uSize = aText.size()-uPos;
+        Indexer.ScanBlock(uSize ? &aText[uPos] : NULL, uSize, aLines);
+        uPos += uSize;
+    }
+
+    return aLines==aExpected && Indexer.GetMaxLineWidth()==nExpectedWidth;
+}
+
+void LineIndexerTests::Test_ScanBlock()
+{
+    // Vector code must find the same lines as the character by character scan,
+    // for any block sizes
+
+    srand(1);
+
+    size_t nChars;
+    for(nChars=0; nChars<=100; nChars++)
+        TEST_ASSERT_MSG(CompareWithReference(1, false, nChars), "Size %d", (int)nChars);
+
+    TEST_ASSERT(CompareWithReference(1, false, 100000));
+
+    __TEST_CLEANUP__;
+}
+
+void LineIndexerTests::Test_ScanBlock_UTF16()
+{
+    srand(1);
+
+    size_t nChars;
+    for(nChars=0; nChars<=100; nChars++)
+    {
+        TEST_ASSERT_MSG(CompareWithReference(2, false, nChars), "LE, size %d", (int)nChars);
+        TEST_ASSERT_MSG(CompareWithReference(2, true, nChars), "BE, size %d", (int)nChars);
+    }
+
+    TEST_ASSERT(CompareWithReference(2, false, 100000));
+    TEST_ASSERT(CompareWithReference(2, true, 100000));
+
+    __TEST_CLEANUP__;
+}
+
+void LineIndexerTests::Test_SparseLineIndex()
+{
+    // Index lines of a big text keeping at most 1000 checkpoints, then find
+    // offsets of random lines by scanning the text from the nearest checkpoint
+
+    std::vector<unsigned char> aText;
+    std::vector<unsigned long long> aExpected, aLines;
+    int nExpectedWidth = 0;
+    CSparseLineIndex Index;
+    CLineIndexer Indexer;
+    unsigned long long uLine = 0;
+    unsigned long long uCheckpointLine = 0;
+    unsigned long long uOffset = 0;
+    size_t uSize = 0;
+    int i;
+
+    srand(1);
+    MakeText(1, false, 2000000, aText);
+    IndexReference(aText, 1, false, aExpected, nExpectedWidth);
+    aExpected.insert(aExpected.begin(), 0);
+
+    Index.Init(4, 1000);
+    Indexer.Init(1, false, 4, 0);
+    aLines.push_back(0);
+    Index.AddLines(aLines);
+    for(i=0; i<(int)aText.size(); i+=65536)
+    {
+        uSize = aText.size()-i<65536 ? aText.size()-i : 65536;
+        aLines.clear();
+        Indexer.ScanBlock(&aText[i], uSize, aLines);
+        Index.AddLines(aLines);
+
+        TEST_ASSERT(Index.GetCheckpointCount()<=1000);
+    }
+
+    TEST_ASSERT(Index.GetLineCount()==aExpected.size());
+    TEST_ASSERT(Index.GetStride()>4);
+
+    for(i=0; i<1000; i++)
+    {
+        uLine = i==0 ? aExpected.size()-1 : ((unsigned)rand()*RAND_MAX+rand())%aExpected.size();
+        TEST_ASSERT(Index.FindCheckpoint(uLine, uCheckpointLine, uOffset));
+        TEST_ASSERT(uCheckpointLine<=uLine && uLine-uCheckpointLine<Index.GetStride());
+
+        aLines.assign(1, uOffset);
+        Indexer.Init(1, false, 4, uOffset);
+        Indexer.ScanBlock(&aText[(size_t)uOffset], aText.size()-(size_t)uOffset, aLines);
+        TEST_ASSERT_MSG(aLines[(size_t)(uLine-uCheckpointLine)]==aExpected[(size_t)uLine], "Line %d", (int)uLine);
+    }
+
+    TEST_ASSERT(!Index.FindCheckpoint(aExpected.size(), uCheckpointLine, uOffset));
+
+    __TEST_CLEANUP__;
+}
@@ -0,0 +1,376 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+#include "stdafx.h"
+#include "Tests.h"
+#include "../reporting/crashsender/RegKeyDump.h"
+
+// A key of the synthetic registry tree.
+struct TestKey
+{
+    std::wstring m_sName;
+    bool m_bDenied;                     // Opening the key fails.
+    std::vector<TestKey> m_aSubKeys;
+    std::vector<std::wstring> m_aValueNames;
+    std::vector<unsigned> m_aValueTypes;
+    std::vector<std::string> m_aValueData;
+
+    TestKey(const wchar_t* szName) : m_sName(szName), m_bDenied(false) {}
+
+    TestKey& AddKey(const wchar_t* szName)
+    {
+        m_aSubKeys.push_back(TestKey(szName));
+        return m_aSubKeys.back();
+    }
+
+    void AddValue(const wchar_t* szName, unsigned uType, const std::string& sData)
+    {
+        m_aValueNames.push_back(szName);
+        m_aValueTypes.push_back(uType);
+        m_aValueData.push_back(sData);
+    }
+
+    // Adds a string value, as UTF-16LE with zero terminator.
+    void AddString(const wchar_t* szName, unsigned uType, const wchar_t* szValue, size_t cch)
+    {
+        std::string sData;
+        size_t i;
+        for(i=0; i<cch; i++)
+        {
+            sData += (char)(szValue[i]&0xFF);
+            sData += (char)((szValue[i]>>8)&0xFF);
+        }
+        AddValue(szName, uType, sData);
+    }
+};
+
+// Registry source reading the synthetic tree. Keys are pointers to TestKey.
+class CTestRegKeySource : public CRegKeySource
+{
+public:
+
+    TestKey* m_pRoot;
+    int m_nOpenKeys;
+
+    CTestRegKeySource(TestKey* pRoot) : m_pRoot(pRoot), m_nOpenKeys(0) {}
+
+    void* OpenKey(void* hParent, const wchar_t* szName, std::string& sError)
+    {
+        if(hParent==NULL)
+        {
+            if(m_pRoot->m_sName!=szName)
+                return NULL;
+            m_nOpenKeys++;
+            return m_pRoot;
+        }
+
+        TestKey* pParent = (TestKey*)hParent;
+        size_t i;
+        for(i=0; i<pParent->m_aSubKeys.size(); i++)
+        {
+            TestKey* pKey = &pParent->m_aSubKeys[i];
+            if(pKey->m_sName==szName)
+            {
+                if(pKey->m_bDenied)
+                {
+                    sError = "Access is denied.";
+                    return NULL;
+                }
+                m_nOpenKeys++;
+                return pKey;
+            }
+        }
+
+        sError = "The system cannot find the file specified.";
+        return NULL;
+    }
+
+    void CloseKey(void* hKey)
+    {
+        m_nOpenKeys--;
+    }
+
+    bool QueryKey(void* hKey, RegKeyInfo& info)
+    {
+        TestKey* pKey = (TestKey*)hKey;
+        size_t i;
+        memset(&info, 0, sizeof(info));
+        info.m_uSubKeys = (unsigned)pKey->m_aSubKeys.size();
+        info.m_uValues = (unsigned)pKey->m_aValueNames.size();
+        for(i=0; i<pKey->m_aSubKeys.size(); i++)
+        {
+            if(pKey->m_aSubKeys[i].m_sName.length()>info.m_uMaxSubKeyLen)
+                info.m_uMaxSubKeyLen = (unsigned)pKey->m_aSubKeys[i].m_sName.length();
+        }
+        for(i=0; i<pKey->m_aValueNames.size(); i++)
+        {
+            if(pKey->m_aValueNames[i].length()>info.m_uMaxValueNameLen)
+                info.m_uMaxValueNameLen = (unsigned)pKey->m_aValueNames[i].length();
+            if(pKey->m_aValueData[i].size()>info.m_uMaxValueLen)
+                info.m_uMaxValueLen = (unsigned)pKey->m_aValueData[i].size();
+        }
+        return true;
+    }
+
+    bool EnumKey(void* hKey, unsigned uIndex, wchar_t* szName, unsigned& uNameLen)
+    {
+        TestKey* pKey = (TestKey*)hKey;
+        if(uIndex>=pKey->m_aSubKeys.size())
+            return false;
+        const std::wstring& sName = pKey->m_aSubKeys[uIndex].m_sName;
+        if(sName.length()+1>uNameLen)
+            return false;
+        memcpy(szName, sName.c_str(), (sName.length()+1)*sizeof(wchar_t));
+        uNameLen = (unsigned)sName.length();
+        return true;
+    }
+
+    bool EnumValue(void* hKey, unsigned uIndex, wchar_t* szName, unsigned& uNameLen,
+        unsigned& uType, unsigned char* pData, unsigned& uDataSize)
+    {
+        TestKey* pKey = (TestKey*)hKey;
+        if(uIndex>=pKey->m_aValueNames.size())
+            return false;
+        const std::wstring& sName = pKey->m_aValueNames[uIndex];
+        const std::string& sData = pKey->m_aValueData[uIndex];
+        if(sName.length()+1>uNameLen || sData.size()>uDataSize)
+            return false;
+        memcpy(szName, sName.c_str(), (sName.length()+1)*sizeof(wchar_t));
+        if(!sData.empty())
+            memcpy(pData, sData.data(), sData.size());
+        uNameLen = (unsigned)sName.length();
+        uType = pKey->m_aValueTypes[uIndex];
+        uDataSize = (unsigned)sData.size();
+        return true;
+    }
+};
+
+class RegKeyDumpTests : public CTestSuite
+{
+    BEGIN_TEST_MAP(RegKeyDumpTests, "Registry key dump tests")
+        REGISTER_TEST(Test_Dump);
+        REGISTER_TEST(Test_InvalidKey);
+        REGISTER_TEST(Test_MaxDepth);
+        REGISTER_TEST(Test_MaxSize);
+        REGISTER_TEST(Test_LargeValue);
+    END_TEST_MAP()
+
+public:
+
+    void SetUp();
+    void TearDown();
+
+    void Test_Dump();
+    void Test_InvalidKey();
+    void Test_MaxDepth();
+    void Test_MaxSize();
+    void Test_LargeValue();
+
+private:
+
+    // Builds a chain of nested keys of the given depth, each having a value.
+    void MakeChain(TestKey& key, int nDepth);
+};
+
+REGISTER_TEST_SUITE( RegKeyDumpTests );
+
+void RegKeyDumpTests::SetUp()
+{
+}
+
+void RegKeyDumpTests::TearDown()
+{
+}
+
+void RegKeyDumpTests::MakeChain(TestKey& key, int nDepth)
+{
+    key.AddValue(L"n", REGDUMP_DWORD, std::string("\x01\0\0\0", 4));
+    if(nDepth>0)
+        MakeChain(key.AddKey(L"sub"), nDepth-1);
+}
+
+void RegKeyDumpTests::Test_Dump()
+{
+    // Output must be the same as the one of the TinyXML based dump
+    TestKey root(L"HKEY_CURRENT_USER");
+    TestKey& app = root.AddKey(L"Software").AddKey(L"MyApp");
+    TestKey& settings = app.AddKey(L"Settings");
+    CTestRegKeySource source(&root);
+    CRegKeyDumper dumper;
+    CXmlWriter xml;
+    std::string sXml;
+    int nResult = 0;
+
+    settings.AddString(L"Path", REGDUMP_SZ, L"C:\\a&b", 7);
+    settings.AddString(L"Expand", REGDUMP_EXPAND_SZ, L"%TEMP%\0garbage", 14);
+    settings.AddString(L"List", REGDUMP_MULTI_SZ, L"one\0two\0\0", 9);
+    settings.AddString(L"Unterminated", REGDUMP_SZ, L"abc", 3);
+    app.AddKey(L"Secret").m_bDenied = true;
+    app.AddValue(L"Data", REGDUMP_BINARY, std::string("\x00\x7F\xAB", 3));
+    app.AddValue(L"Count", REGDUMP_DWORD, std::string("\x2A\0\0\0", 4));
+    app.AddValue(L"Big", REGDUMP_QWORD, std::string(8, '\x01'));
+    app.AddValue(L"", 0x20, std::string());
+
+    xml.Attach(NULL);
+    nResult = dumper.Dump(&source, L"HKEY_CURRENT_USER\\Software\\MyApp", xml);
+    sXml.assign(xml.GetData(), xml.GetSize());
+    TEST_ASSERT(nResult==REGDUMP_OK);
+    TEST_ASSERT(source.m_nOpenKeys==0);
+    TEST_ASSERT(sXml ==
+        "<k name=\"HKEY_CURRENT_USER\">\n"
+        "    <k name=\"Software\">\n"
+        "        <k name=\"MyApp\">\n"
+        "            <k name=\"Settings\">\n"
+        "                <v name=\"Path\" type=\"REG_SZ\" value=\"C:\\a&amp;b\" />\n"
+        "                <v name=\"Expand\" type=\"REG_EXPAND_SZ\" value=\"%TEMP%\" />\n"
+        "                <v name=\"List\" type=\"REG_MULTI_SZ\">\n"
+        "                    <str value=\"one\" />\n"
+        "                    <str value=\"two\" />\n"
+        "                </v>\n"
+        "                <v name=\"Unterminated\" type=\"REG_SZ\" value=\"abc\" />\n"
+        "            </k>\n"
+        "            <k name=\"Secret\" error=\"Access is denied.\" />\n"
+        "            <v name=\"Data\" type=\"REG_BINARY\" value=\"00 7F AB \" />\n"
+        "            <v name=\"Count\" type=\"REG_DWORD\" value=\"0x0000002a (42)\" />\n"
+        "            <v name=\"Big\" type=\"REG_QWORD\" />\n"
+        "            <v name=\"\" type=\"Unknown type (0x00000020)\" />\n"
+        "        </k>\n"
+        "    </k>\n"
+        "</k>\n");
+
+    // A missing key on the path gets the error
+    xml.Attach(NULL);
+    nResult = dumper.Dump(&source, L"HKEY_CURRENT_USER\\Software\\Other\\Key", xml);
+    sXml.assign(xml.GetData(), xml.GetSize());
+    TEST_ASSERT(nResult==REGDUMP_OK);
+    TEST_ASSERT(source.m_nOpenKeys==0);
+    TEST_ASSERT(sXml ==
+        "<k name=\"HKEY_CURRENT_USER\">\n"
+        "    <k name=\"Software\">\n"
+        "        <k name=\"Other\" error=\"The system cannot find the file specified.\" />\n"
+        "    </k>\n"
+        "</k>\n");
+
+    __TEST_CLEANUP__;
+}
+
+void RegKeyDumpTests::Test_InvalidKey()
+{
+    // Nothing is written for an unknown root key
+    TestKey root(L"HKEY_CURRENT_USER");
+    CTestRegKeySource source(&root);
+    CRegKeyDumper dumper;
+    CXmlWriter xml;
+    int nResult = 0;
+
+    xml.Attach(NULL);
+    nResult = dumper.Dump(&source, L"HKEY_CLASSES_ROOT\\Software", xml);
+    TEST_ASSERT(nResult==REGDUMP_INVALID_KEY);
+    TEST_ASSERT(xml.GetSize()==0);
+
+    nResult = dumper.Dump(&source, L"", xml);
+    TEST_ASSERT(nResult==REGDUMP_INVALID_KEY);
+    TEST_ASSERT(xml.GetSize()==0);
+
+    __TEST_CLEANUP__;
+}
+
+void RegKeyDumpTests::Test_MaxDepth()
+{
+    // Subkeys deeper than the limit are skipped and the key is marked
+    TestKey root(L"HKEY_LOCAL_MACHINE");
+    CTestRegKeySource source(&root);
+    CRegKeyDumper dumper;
+    CXmlWriter xml;
+    std::string sXml;
+    int nResult = 0;
+
+    MakeChain(root.AddKey(L"Chain"), 5);
+
+    xml.Attach(NULL);
+    dumper.SetLimits(2, 0);
+    nResult = dumper.Dump(&source, L"HKEY_LOCAL_MACHINE\\Chain", xml);
+    sXml.assign(xml.GetData(), xml.GetSize());
+    TEST_ASSERT(nResult==REGDUMP_TRUNCATED);
+    TEST_ASSERT(source.m_nOpenKeys==0);
+    TEST_ASSERT(sXml ==
+        "<k name=\"HKEY_LOCAL_MACHINE\">\n"
+        "    <k name=\"Chain\">\n"
+        "        <k name=\"sub\">\n"
+        "            <k name=\"sub\" truncated=\"1\">\n"
+        "                <v name=\"n\" type=\"REG_DWORD\" value=\"0x00000001 (1)\" />\n"
+        "            </k>\n"
+        "            <v name=\"n\" type=\"REG_DWORD\" value=\"0x00000001 (1)\" />\n"
+        "        </k>\n"
+        "        <v name=\"n\" type=\"REG_DWORD\" value=\"0x00000001 (1)\" />\n"
+        "    </k>\n"
+        "</k>\n");
+
+    // Without limits the whole chain is dumped
+    xml.Attach(NULL);
+    dumper.SetLimits(0, 0);
+    nResult = dumper.Dump(&source, L"HKEY_LOCAL_MACHINE\\Chain", xml);
+    TEST_ASSERT(nResult==REGDUMP_OK);
+
+    __TEST_CLEANUP__;
+}
+
+void RegKeyDumpTests::Test_MaxSize()
+{
+    // Enumeration stops once the output reaches the size limit,
+    // the document stays well-formed
+    TestKey root(L"HKEY_CURRENT_USER");
+    TestKey& key = root.AddKey(L"Many");
+    CTestRegKeySource source(&root);
+    CRegKeyDumper dumper;
+    CXmlWriter xml;
+    std::string sXml;
+    int nResult = 0;
+    int i;
+
+    for(i=0; i<1000; i++)
+        key.AddValue(L"Value", REGDUMP_BINARY, std::string(16, 'x'));
+
+    xml.Attach(NULL);
+    dumper.SetLimits(0, 4096);
+    nResult = dumper.Dump(&source, L"HKEY_CURRENT_USER\\Many", xml);
+    sXml.assign(xml.GetData(), xml.GetSize());
+    TEST_ASSERT(nResult==REGDUMP_TRUNCATED);
+    TEST_ASSERT(source.m_nOpenKeys==0);
+    TEST_ASSERT(sXml.size()>=4096 && sXml.size()<4096+256);
+    TEST_ASSERT(sXml.compare(sXml.size()-14, 14, "    </k>\n</k>\n")==0);
+
+    __TEST_CLEANUP__;
+}
+
+void RegKeyDumpTests::Test_LargeValue()
+{
+    // Values and names longer than the initial buffers
+    TestKey root(L"HKEY_CURRENT_USER");
+    TestKey& key = root.AddKey(L"Large");
+    CTestRegKeySource source(&root);
+    CRegKeyDumper dumper;
+    CXmlWriter xml;
+    std::string sXml;
+    std::wstring sName(2000, L'n');
+    std::wstring sValue(100000, L'v');
+    int nResult = 0;
+
+    key.AddString(sName.c_str(), REGDUMP_SZ, sValue.c_str(), sValue.length()+1);
+
+    xml.Attach(NULL);
+    nResult = dumper.Dump(&source, L"HKEY_CURRENT_USER\\Large", xml);
+    sXml.assign(xml.GetData(), xml.GetSize());
+    TEST_ASSERT(nResult==REGDUMP_OK);
+    TEST_ASSERT(sXml.find("<v name=\"" + std::string(2000, 'n') + "\" type=\"REG_SZ\" value=\"" +
+        std::string(100000, 'v') + "\" />")!=std::string::npos);
+
+    __TEST_CLEANUP__;
+}
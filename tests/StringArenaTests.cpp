@@ -0,0 +1,243 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+#include "stdafx.h"
+#include "Tests.h"
+#include "StringArena.h"
+#include "strconv.h"
+
+class StringArenaTests : public CTestSuite
+{
+    BEGIN_TEST_MAP(StringArenaTests, "String arena and conversion tests")
+        REGISTER_TEST(Test_CStringArena);
+        REGISTER_TEST(Test_utf8_to_utf16);
+        REGISTER_TEST(Test_utf16_to_utf8);
+        REGISTER_TEST(Test_strconv);
+    END_TEST_MAP()
+
+public:
+
+    void SetUp();
+    void TearDown();
+
+    void Test_CStringArena();
+    void Test_utf8_to_utf16();
+    void Test_utf16_to_utf8();
+    void Test_strconv();
+
+private:
+
+    // Makes a random string of code points, encoded as UTF-16.
+    void MakeString(int nLength, bool bASCII, std::vector<wchar_t>& aStr);
+};
+
+REGISTER_TEST_SUITE( StringArenaTests );
+
+void StringArenaTests::SetUp()
+{
+}
+
+void StringArenaTests::TearDown()
+{
+}
+
+void StringArenaTests::MakeString(int nLength, bool bASCII, std::vector<wchar_t>& aStr)
+{
+    aStr.clear();
+    int i;
+    for(i=0; i<nLength; i++)
+    {
+        unsigned cp = 0x20+rand()%0x5F;
+        int r = rand()%4;
+        if(!bASCII && r==1)
+            cp = 0x80+rand()%0x780;
+        else if(!bASCII && r==2)
+            cp = 0x800+rand()%(0xD800-0x800);
+        else if(!bASCII && r==3)
+            cp = 0x10000+(rand()*(RAND_MAX+1u)+rand())%0x100000;
+
+        if(cp>=0x10000)
+        {
+            aStr.push_back((wchar_t)(0xD800+((cp-0x10000)>>10)));
+            aStr.push_back((wchar_t)(0xDC00+((cp-0x10000)&0x3FF)));
+        }
+        else
+            aStr.push_back((wchar_t)cp);
+    }
+    aStr.push_back(0);
+}
+
+void StringArenaTests::Test_CStringArena()
+{
+    // Allocate many blocks of various sizes, fill them and check nothing was overwritten
+
+    CStringArena Arena;
+    std::vector<unsigned char*> aPtrs;
+    std::vector<size_t> aSizes;
+    size_t i;
+    size_t j;
+
+    srand(1);
+    for(i=0; i<10000; i++)
+    {
+        size_t uSize = i%100==99 ? 100000+rand()%100000 : rand()%300;
+        unsigned char* p = (unsigned char*)Arena.Alloc(uSize);
+        TEST_ASSERT(p!=NULL);
+        TEST_ASSERT(((size_t)p&7)==0);
+        memset(p, (int)(i&0xFF), uSize);
+        aPtrs.push_back(p);
+        aSizes.push_back(uSize);
+    }
+
+    for(i=0; i<aPtrs.size(); i++)
+    {
+        for(j=0; j<aSizes[i]; j++)
+            TEST_ASSERT_MSG(aPtrs[i][j]==(i&0xFF), "Block %d", (int)i);
+    }
+
+    // Shrinking the last block makes its tail reusable
+    {
+        char* p1 = (char*)Arena.Alloc(100);
+        Arena.Shrink(p1, 10);
+        char* p2 = (char*)Arena.Alloc(8);
+        TEST_ASSERT(p2==p1+16);
+
+        // Only the last block can shrink
+        Arena.Shrink(p1, 1);
+        char* p3 = (char*)Arena.Alloc(8);
+        TEST_ASSERT(p3==p2+8);
+    }
+
+    Arena.Free();
+    TEST_ASSERT(Arena.Alloc(16)!=NULL);
+
+    __TEST_CLEANUP__;
+}
+
+void StringArenaTests::Test_utf8_to_utf16()
+{
+    wchar_t szBuf[64];
+    size_t n = 0;
+
+    // Characters of 1, 2, 3 and 4 bytes
+    const char* szValid = "A\xD0\x9F\xE2\x82\xAC\xF0\x9F\x98\x80";
+    n = utf8_to_utf16(szValid, strlen(szValid), szBuf);
+    TEST_ASSERT(n==5);
+    TEST_ASSERT(szBuf[0]==L'A' && szBuf[1]==0x041F && szBuf[2]==0x20AC);
+    TEST_ASSERT(szBuf[3]==0xD83D && szBuf[4]==0xDE00);
+
+    // Overlong, stray continuation, truncated, surrogate and out of range
+    // sequences give replacement characters
+    n = utf8_to_utf16("\xC0\x80", 2, szBuf);
+    TEST_ASSERT(n==2 && szBuf[0]==0xFFFD && szBuf[1]==0xFFFD);
+    n = utf8_to_utf16("\x80" "A", 2, szBuf);
+    TEST_ASSERT(n==2 && szBuf[0]==0xFFFD && szBuf[1]==L'A');
+    n = utf8_to_utf16("\xE2\x82", 2, szBuf);
+    TEST_ASSERT(n==2 && szBuf[0]==0xFFFD && szBuf[1]==0xFFFD);
+    n = utf8_to_utf16("\xED\xA0\x80", 3, szBuf);
+    TEST_ASSERT(n==3 && szBuf[0]==0xFFFD);
+    n = utf8_to_utf16("\xF4\x90\x80\x80", 4, szBuf);
+    TEST_ASSERT(n==4 && szBuf[0]==0xFFFD);
+
+    // Only the given count of bytes is converted
+    n = utf8_to_utf16("ABC", 2, szBuf);
+    TEST_ASSERT(n==2 && szBuf[1]==L'B');
+
+    __TEST_CLEANUP__;
+}
+
+void StringArenaTests::Test_utf16_to_utf8()
+{
+    // Random strings must survive a round trip
+
+    std::vector<wchar_t> aStr;
+    std::vector<wchar_t> aStr2;
+    std::vector<char> aUTF8;
+    char szBuf[64];
+    size_t n = 0;
+    int i;
+
+    srand(1);
+    for(i=0; i<1000; i++)
+    {
+        MakeString(rand()%50, i%2==0, aStr);
+        size_t uLen = aStr.size()-1;
+        aUTF8.resize(uLen*3+1);
+        aStr2.resize(uLen+1);
+
+        n = utf16_to_utf8(&aStr[0], uLen, &aUTF8[0]);
+        TEST_ASSERT(n<=uLen*3);
+        TEST_ASSERT(str_is_ascii(&aUTF8[0], n)==str_is_ascii(&aStr[0], uLen));
+
+        n = utf8_to_utf16(&aUTF8[0], n, &aStr2[0]);
+        TEST_ASSERT(n==uLen);
+        TEST_ASSERT(memcmp(&aStr[0], &aStr2[0], uLen*sizeof(wchar_t))==0);
+    }
+
+    // Unpaired surrogates give replacement characters
+    {
+        const wchar_t szBad[] = {0xD83D, L'A', 0xDE00, 0};
+        n = utf16_to_utf8(szBad, 3, szBuf);
+        TEST_ASSERT(n==7);
+        TEST_ASSERT(memcmp(szBuf, "\xEF\xBF\xBD" "A" "\xEF\xBF\xBD", 7)==0);
+    }
+
+    __TEST_CLEANUP__;
+}
+
+void StringArenaTests::Test_strconv()
+{
+    // Conversions must give the same results as Windows API functions
+
+    std::vector<wchar_t> aStr;
+    std::vector<wchar_t> aExpectedW;
+    std::vector<char> aExpected;
+    int i;
+
+    srand(1);
+    for(i=0; i<1000; i++)
+    {
+        strconv_t strconv;
+        MakeString(rand()%50, i%2==0, aStr);
+
+        int nSize = WideCharToMultiByte(CP_UTF8, 0, &aStr[0], -1, NULL, 0, NULL, NULL);
+        aExpected.resize(nSize);
+        WideCharToMultiByte(CP_UTF8, 0, &aStr[0], -1, &aExpected[0], nSize, NULL, NULL);
+
+        int cch = 0;
+        LPCSTR szUTF8 = strconv.w2utf8(&aStr[0], -1, &cch);
+        TEST_ASSERT(cch==nSize-1);
+        TEST_ASSERT(strcmp(szUTF8, &aExpected[0])==0);
+
+        LPCWSTR szW = strconv.utf82w(szUTF8);
+        TEST_ASSERT(wcscmp(szW, &aStr[0])==0);
+
+        // ANSI conversions of what the code page can represent
+        nSize = WideCharToMultiByte(CP_ACP, 0, &aStr[0], -1, NULL, 0, NULL, NULL);
+        aExpected.resize(nSize);
+        WideCharToMultiByte(CP_ACP, 0, &aStr[0], -1, &aExpected[0], nSize, NULL, NULL);
+        TEST_ASSERT(strcmp(strconv.w2a(&aStr[0]), &aExpected[0])==0);
+
+        nSize = MultiByteToWideChar(CP_ACP, MB_PRECOMPOSED, &aExpected[0], -1, NULL, 0);
+        aExpectedW.resize(nSize);
+        MultiByteToWideChar(CP_ACP, MB_PRECOMPOSED, &aExpected[0], -1, &aExpectedW[0], nSize);
+        TEST_ASSERT(wcscmp(strconv.a2w(&aExpected[0]), &aExpectedW[0])==0);
+    }
+
+    {
+        strconv_t strconv;
+        int cch = -1;
+        TEST_ASSERT(strconv.a2w(NULL)==NULL);
+        TEST_ASSERT(wcscmp(strconv.utf82w(""), L"")==0);
+        TEST_ASSERT(strcmp(strconv.t2utf8(_T("abc"), 2, &cch), "ab")==0 && cch==2);
+    }
+
+    __TEST_CLEANUP__;
+}
@@ -0,0 +1,235 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+#include "stdafx.h"
+#include "Tests.h"
+#include "../reporting/crashsender/VideoEncoder.h"
+#include "theora/theoradec.h"
+
+class VideoEncoderTests : public CTestSuite
+{
+    BEGIN_TEST_MAP(VideoEncoderTests, "Incremental video encoder tests")
+        REGISTER_TEST(Test_EncodeShortVideo);
+        REGISTER_TEST(Test_EncodeLongVideo);
+    END_TEST_MAP()
+
+public:
+
+    void SetUp();
+    void TearDown();
+
+    void Test_EncodeShortVideo();
+    void Test_EncodeLongVideo();
+
+private:
+
+    // Draws a synthetic frame: a gradient with a square moving with frame number.
+    void MakeFrame(std::vector<unsigned char>& aFrame, int nWidth, int nHeight, int nFrame);
+
+    // Encodes frames and decodes the resulting video. Returns count of
+    // decoded frames or -1 if the video is malformed.
+    int EncodeAndDecode(int nFrames, int nMaxFrames, int nKeyframeInterval);
+
+    // Decodes the video file, checking its pages and packets.
+    // Returns count of decoded frames or -1 if the video is malformed.
+    int DecodeVideo(FILE* f);
+};
+
+REGISTER_TEST_SUITE( VideoEncoderTests );
+
+void VideoEncoderTests::SetUp()
+{
+}
+
+void VideoEncoderTests::TearDown()
+{
+}
+
+void VideoEncoderTests::MakeFrame(std::vector<unsigned char>& aFrame, int nWidth, int nHeight, int nFrame)
+{
+    int nStride = nWidth*3;
+    aFrame.assign(nStride*nHeight, 0);
+
+    int x, y;
+    for(y=0; y<nHeight; y++)
+    {
+        for(x=0; x<nWidth; x++)
+        {
+            unsigned char* p = &aFrame[y*nStride+x*3];
+            p[0] = (unsigned char)(x*4);
+            p[1] = (unsigned char)(y*4);
+            if(x>=nFrame%nWidth && x<nFrame%nWidth+8 && y>=16 && y<24)
+                p[0] = p[1] = p[2] = 255;
+        }
+    }
+}
+
+int VideoEncoderTests::EncodeAndDecode(int nFrames, int nMaxFrames, int nKeyframeInterval)
+{
+    const int nWidth = 64;
+    const int nHeight = 48;
+    std::vector<unsigned char> aFrame;
+    CTheoraEncoder enc;
+    FILE* f = NULL;
+    int nDecoded = -1;
+    int i;
+
+    if(!enc.Init(nWidth, nHeight, 100, 40, nMaxFrames, nKeyframeInterval))
+        goto cleanup;
+
+    for(i=0; i<nFrames; i++)
+    {
+        MakeFrame(aFrame, nWidth, nHeight, i);
+        if(!enc.EncodeFrame(&aFrame[0], nWidth*3))
+            goto cleanup;
+    }
+
+    f = tmpfile();
+    if(f==NULL || !enc.Finish(f))
+        goto cleanup;
+
+    rewind(f);
+    nDecoded = DecodeVideo(f);
+
+cleanup:
+
+    if(f)
+        fclose(f);
+
+    return nDecoded;
+}
+
+int VideoEncoderTests::DecodeVideo(FILE* f)
+{
+    ogg_sync_state oy;
+    ogg_stream_state os;
+    ogg_page og;
+    ogg_packet op;
+    th_info ti;
+    th_comment tc;
+    th_setup_info* ts = NULL;
+    th_dec_ctx* td = NULL;
+    bool bStreamInit = false;
+    bool bEOS = false;
+    bool bFirstFrame = true;
+    bool bError = false;
+    long nPageNo = 0;
+    int nFrames = 0;
+
+    ogg_sync_init(&oy);
+    th_info_init(&ti);
+    th_comment_init(&tc);
+
+    for(;;)
+    {
+        char* pBuf = ogg_sync_buffer(&oy, 4096);
+        size_t uRead = fread(pBuf, 1, 4096, f);
+        ogg_sync_wrote(&oy, (long)uRead);
+        if(uRead==0)
+            break;
+
+        int res;
+        while((res = ogg_sync_pageout(&oy, &og))!=0)
+        {
+            // Page checksum must be valid and pages must go one by one,
+            // starting with BOS page and ending with EOS page
+            if(res<0 || bEOS || ogg_page_pageno(&og)!=nPageNo ||
+                (nPageNo==0)!=(ogg_page_bos(&og)!=0))
+            {
+                bError = true;
+                continue;
+            }
+            nPageNo++;
+            bEOS = ogg_page_eos(&og)!=0;
+
+            if(!bStreamInit)
+            {
+                ogg_stream_init(&os, ogg_page_serialno(&og));
+                bStreamInit = true;
+            }
+            ogg_stream_pagein(&os, &og);
+
+            while((res = ogg_stream_packetout(&os, &op))!=0)
+            {
+                if(res<0)
+                {
+                    bError = true;
+                    continue;
+                }
+
+                if(td==NULL)
+                {
+                    res = th_decode_headerin(&ti, &tc, &ts, &op);
+                    if(res>0)
+                        continue;
+                    if(res<0)
+                    {
+                        bError = true;
+                        continue;
+                    }
+                    td = th_decode_alloc(&ti, ts);
+                }
+
+                // The video must start with a keyframe
+                if(bFirstFrame && th_packet_iskeyframe(&op)!=1)
+                    bError = true;
+                bFirstFrame = false;
+
+                ogg_int64_t granpos = -1;
+                if(th_decode_packetin(td, &op, &granpos)<0)
+                    bError = true;
+
+                nFrames++;
+            }
+        }
+    }
+
+    if(!bEOS)
+        bError = true;
+
+    if(td)
+        th_decode_free(td);
+    th_setup_free(ts);
+    th_info_clear(&ti);
+    th_comment_clear(&tc);
+    if(bStreamInit)
+        ogg_stream_clear(&os);
+    ogg_sync_clear(&oy);
+
+    return bError ? -1 : nFrames;
+}
+
+void VideoEncoderTests::Test_EncodeShortVideo()
+{
+    // When there are less frames than the max count, all of them must be kept
+
+    TEST_ASSERT(EncodeAndDecode(1, 20, 8)==1);
+    TEST_ASSERT(EncodeAndDecode(10, 20, 8)==10);
+    TEST_ASSERT(EncodeAndDecode(20, 20, 8)==20);
+
+    __TEST_CLEANUP__;
+}
+
+void VideoEncoderTests::Test_EncodeLongVideo()
+{
+    // When there are more frames, the oldest ones are dropped by whole segments,
+    // so the video keeps at least the max count of frames, but not much more
+
+    int nFrames = EncodeAndDecode(100, 20, 8);
+    TEST_ASSERT(nFrames>=20 && nFrames<=27);
+
+    nFrames = EncodeAndDecode(333, 20, 8);
+    TEST_ASSERT(nFrames>=20 && nFrames<=27);
+
+    nFrames = EncodeAndDecode(50, 20, 1);
+    TEST_ASSERT(nFrames==20);
+
+    __TEST_CLEANUP__;
+}
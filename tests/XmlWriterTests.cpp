@@ -0,0 +1,199 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+#include "stdafx.h"
+#include "Tests.h"
+#include "../reporting/crashsender/XmlWriter.h"
+
+class XmlWriterTests : public CTestSuite
+{
+    BEGIN_TEST_MAP(XmlWriterTests, "Streaming XML writer tests")
+        REGISTER_TEST(Test_Format);
+        REGISTER_TEST(Test_Escape);
+        REGISTER_TEST(Test_ResumeElement);
+        REGISTER_TEST(Test_File);
+    END_TEST_MAP()
+
+public:
+
+    void SetUp();
+    void TearDown();
+
+    void Test_Format();
+    void Test_Escape();
+    void Test_ResumeElement();
+    void Test_File();
+
+private:
+
+    // Writes a crash description with the given count of properties.
+    void WriteDocument(CXmlWriter& xml, int nProps);
+
+    // Reads the whole file.
+    std::string ReadAll(FILE* f);
+};
+
+REGISTER_TEST_SUITE( XmlWriterTests );
+
+void XmlWriterTests::SetUp()
+{
+}
+
+void XmlWriterTests::TearDown()
+{
+}
+
+void XmlWriterTests::WriteDocument(CXmlWriter& xml, int nProps)
+{
+    xml.WriteDeclaration(true);
+    xml.StartElement("CrashRpt");
+    xml.AddAttribute("version", 1500);
+    xml.WriteElement("AppName", "My & \"App\"");
+    xml.WriteElement("ExceptionType", -1);
+    xml.StartElement("CustomProps");
+    int i;
+    for(i=0; i<nProps; i++)
+    {
+        char szName[32];
+        sprintf(szName, "Prop%d", i);
+        xml.StartElement("Prop");
+        xml.AddAttribute("name", szName);
+        xml.AddAttribute("value", "Some value of a property <with markup>");
+        xml.EndElement();
+    }
+    xml.EndElement();
+    xml.StartElement("FileList");
+    xml.EndElement();
+    xml.EndElement();
+}
+
+std::string XmlWriterTests::ReadAll(FILE* f)
+{
+    std::string sData;
+    char szBuf[4096];
+    size_t n;
+    fseek(f, 0, SEEK_SET);
+    while((n = fread(szBuf, 1, sizeof(szBuf), f))!=0)
+        sData.append(szBuf, n);
+    return sData;
+}
+
+void XmlWriterTests::Test_Format()
+{
+    // Output must look the same as TinyXML output
+    CXmlWriter xml;
+    std::string sXml;
+
+    xml.Attach(NULL);
+    WriteDocument(xml, 2);
+    sXml.assign(xml.GetData(), xml.GetSize());
+
+    TEST_ASSERT(sXml ==
+        "\xEF\xBB\xBF<?xml version=\"1.0\" encoding=\"UTF-8\" ?>\n"
+        "<CrashRpt version=\"1500\">\n"
+        "    <AppName>My &amp; &quot;App&quot;</AppName>\n"
+        "    <ExceptionType>-1</ExceptionType>\n"
+        "    <CustomProps>\n"
+        "        <Prop name=\"Prop0\" value=\"Some value of a property &lt;with markup&gt;\" />\n"
+        "        <Prop name=\"Prop1\" value=\"Some value of a property &lt;with markup&gt;\" />\n"
+        "    </CustomProps>\n"
+        "    <FileList />\n"
+        "</CrashRpt>\n");
+
+    // Attributes are ignored once content has begun
+    xml.Attach(NULL);
+    xml.StartElement("a");
+    xml.WriteElement("b", "");
+    xml.AddAttribute("c", "d");
+    xml.EndElement();
+    xml.EndElement(); // Nothing to end
+    sXml.assign(xml.GetData(), xml.GetSize());
+    TEST_ASSERT(sXml=="<a>\n    <b></b>\n</a>\n");
+    TEST_ASSERT(xml.IsOk());
+
+    __TEST_CLEANUP__;
+}
+
+void XmlWriterTests::Test_Escape()
+{
+    // Markup and control characters are replaced by references,
+    // other characters (including multi-byte UTF-8) are kept as is
+    CXmlWriter xml;
+    std::string sXml;
+
+    xml.Attach(NULL);
+    xml.WriteElement("t", "a<b>&'\"\x01\t\nz \xD0\x9F\xE2\x82\xAC");
+    sXml.assign(xml.GetData(), xml.GetSize());
+    TEST_ASSERT(sXml=="<t>a&lt;b&gt;&amp;&apos;&quot;&#x01;&#x09;&#x0A;z \xD0\x9F\xE2\x82\xAC</t>\n");
+
+    xml.Attach(NULL);
+    xml.StartElement("t");
+    xml.AddAttribute("v", "&#xA9;");
+    xml.EndElement();
+    sXml.assign(xml.GetData(), xml.GetSize());
+    TEST_ASSERT(sXml=="<t v=\"&amp;#xA9;\" />\n");
+
+    __TEST_CLEANUP__;
+}
+
+void XmlWriterTests::Test_ResumeElement()
+{
+    // Appending elements to a document written before
+    CXmlWriter xml;
+    std::string sXml;
+
+    xml.Attach(NULL);
+    xml.ResumeElement("CrashRpt");
+    xml.WriteElement("UserEmail", "user@example.com");
+    xml.WriteElement("ProblemDescription", "Line 1\r\nLine 2");
+    xml.EndElement();
+    sXml.assign(xml.GetData(), xml.GetSize());
+    TEST_ASSERT(sXml ==
+        "    <UserEmail>user@example.com</UserEmail>\n"
+        "    <ProblemDescription>Line 1&#x0D;&#x0A;Line 2</ProblemDescription>\n"
+        "</CrashRpt>\n");
+
+    __TEST_CLEANUP__;
+}
+
+void XmlWriterTests::Test_File()
+{
+    // File output is the same as memory output, for documents larger than the buffer
+    CXmlWriter xml;
+    std::string sExpected;
+    std::string sXml;
+    FILE* f = tmpfile();
+    TEST_ASSERT(f!=NULL);
+
+    xml.Attach(NULL);
+    WriteDocument(xml, 10000);
+    sExpected.assign(xml.GetData(), xml.GetSize());
+    TEST_ASSERT(sExpected.size()>200000);
+
+    {
+        CXmlWriter xml2;
+        xml2.Attach(f);
+        WriteDocument(xml2, 10000);
+
+        // Long text goes to the file without the buffer
+        xml2.WriteElement("Long", std::string(200000, 'x').c_str());
+        TEST_ASSERT(xml2.Flush());
+        TEST_ASSERT(xml2.GetSize()==0);
+    }
+
+    sExpected += "<Long>" + std::string(200000, 'x') + "</Long>\n";
+    sXml = ReadAll(f);
+    TEST_ASSERT(sXml==sExpected);
+
+    __TEST_CLEANUP__;
+
+    if(f)
+        fclose(f);
+}
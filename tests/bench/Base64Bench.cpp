@@ -0,0 +1,52 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+#include "Bench.h"
+#include "../../reporting/crashsender/base64.h"
+
+static bool Bench_mime_encode()
+{
+    // Encodes 16 MB of data at once with base64_encode() and in blocks of
+    // 1024 MIME lines with base64_mime_encode_block(), as the SMTP client does.
+
+    const size_t uLen = 16*1024*1024;
+    const size_t uBlockSize = BASE64_MIME_LINE_BYTES*1024;
+    std::vector<unsigned char> aData(uLen);
+    std::vector<char> aOut(base64_mime_encoded_size(uLen)+1);
+    size_t uWritten = 0;
+    size_t uOffset = 0;
+    size_t i;
+
+    for(i=0; i<uLen; i++)
+        aData[i] = (unsigned char)(i*2654435761U>>24);
+
+    CBenchTimer timer;
+    std::string sOld = base64_encode(&aData[0], (unsigned int)uLen);
+    double dOld = timer.GetMs();
+
+    timer.Restart();
+    while(uOffset<uLen)
+    {
+        size_t uBlock = uLen-uOffset<uBlockSize ? uLen-uOffset : uBlockSize;
+        uWritten += base64_mime_encode_block(&aData[uOffset], uBlock, &aOut[uWritten]);
+        uOffset += uBlock;
+    }
+    double dNew = timer.GetMs();
+
+    printf("   base64_encode: %.0f ms, base64_mime_encode_block: %.0f ms (%.1fx)\n",
+        dOld, dNew, dNew>0 ? dOld/dNew : 0);
+
+    BENCH_CHECK(uWritten>=sOld.length());
+    BENCH_CHECK(sOld.compare(0, sOld.length(), &aOut[0], sOld.length())==0);
+
+    return true;
+}
+
+REGISTER_BENCHMARK( Bench_mime_encode, "BASE-64 MIME encoding of 16 MB" );
@@ -0,0 +1,76 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+// File: Bench.cpp
+// Description: Runs the micro-benchmarks. Without arguments all benchmarks are run,
+// otherwise only the ones named in the command line.
+// This file doesn't depend on Windows headers, so it can be built and tested anywhere.
+
+#include "Bench.h"
+#include <string.h>
+
+CBenchmark::CBenchmark(const char* szName, const char* szDescription, PFNBENCHMARK pfnRun)
+{
+    m_szName = szName;
+    m_szDescription = szDescription;
+    m_pfnRun = pfnRun;
+    GetList().push_back(this);
+}
+
+std::vector<CBenchmark*>& CBenchmark::GetList()
+{
+    static std::vector<CBenchmark*> s_aList;
+    return s_aList;
+}
+
+static bool IsSelected(const char* szName, int argc, char** argv)
+{
+    if(argc<2)
+        return true;
+
+    int i;
+    for(i=1; i<argc; i++)
+    {
+        if(strcmp(argv[i], szName)==0)
+            return true;
+    }
+    return false;
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<CBenchmark*>& aList = CBenchmark::GetList();
+    int nFailed = 0;
+    size_t i;
+
+    if(argc==2 && strcmp(argv[1], "--list")==0)
+    {
+        for(i=0; i<aList.size(); i++)
+            printf("%s - %s\n", aList[i]->m_szName, aList[i]->m_szDescription);
+        return 0;
+    }
+
+    for(i=0; i<aList.size(); i++)
+    {
+        if(!IsSelected(aList[i]->m_szName, argc, argv))
+            continue;
+
+        printf("%s - %s\n", aList[i]->m_szName, aList[i]->m_szDescription);
+        fflush(stdout);
+
+        if(!aList[i]->m_pfnRun())
+        {
+            printf("   FAILED\n");
+            nFailed++;
+        }
+    }
+
+    return nFailed==0 ? 0 : 1;
+}
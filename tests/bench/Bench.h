@@ -0,0 +1,73 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+// File: Bench.h
+// Description: Minimal harness for micro-benchmarks of the portable modules.
+// Benchmarks only print timings; they are not a part of the unit test suite.
+// This file doesn't depend on Windows headers, so it can be built and tested anywhere.
+
+#pragma once
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <chrono>
+
+// Benchmark function. Returns false if the result of the measured code is wrong.
+typedef bool (*PFNBENCHMARK)();
+
+// A registered benchmark. Instances are created by REGISTER_BENCHMARK.
+class CBenchmark
+{
+public:
+
+    // Adds the benchmark to the global list.
+    CBenchmark(const char* szName, const char* szDescription, PFNBENCHMARK pfnRun);
+
+    // Returns the list of all registered benchmarks.
+    static std::vector<CBenchmark*>& GetList();
+
+    const char* m_szName;        // Benchmark name, used to select it from command line.
+    const char* m_szDescription; // What is measured.
+    PFNBENCHMARK m_pfnRun;       // Benchmark function.
+};
+
+#define REGISTER_BENCHMARK( Function, Description )\
+    static CBenchmark g_Benchmark_##Function( #Function, Description, Function );
+
+// Measures wall clock time elapsed since construction or the last Restart().
+class CBenchTimer
+{
+public:
+
+    CBenchTimer() { Restart(); }
+
+    void Restart() { m_Start = std::chrono::steady_clock::now(); }
+
+    // Returns elapsed time in milliseconds.
+    double GetMs() const
+    {
+        return std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now()-m_Start).count();
+    }
+
+private:
+
+    std::chrono::steady_clock::time_point m_Start;
+};
+
+// Returns throughput in MB/s for the given byte count and time.
+inline double bench_mb_per_sec(unsigned long long uBytes, double dMs)
+{
+    return dMs>0 ? uBytes/(1024.0*1024.0)/(dMs/1000.0) : 0;
+}
+
+// Fails the benchmark if the result of the measured code is wrong.
+#define BENCH_CHECK(expr)\
+    if(!(expr)) { printf("   check failed: %s\n", #expr); return false; }
@@ -0,0 +1,60 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+#include "Bench.h"
+#include "../../reporting/crashsender/ColorConv.h"
+
+static bool Bench_color_conv()
+{
+    // Converts a 1920x1080 frame back and forth 20 times with
+    // every instruction set the CPU supports.
+
+    const int nWidth = 1920;
+    const int nHeight = 1080;
+    const int nStride = nWidth*3;
+    const int nYSize = nWidth*nHeight;
+    const int nUVSize = nYSize/4;
+    const int nPasses = 20;
+    const char* aszIsa[3] = {"scalar", "SSSE3", "AVX2"};
+    std::vector<unsigned char> aRGB(nStride*nHeight);
+    std::vector<unsigned char> aYUV(nYSize+nUVSize*2);
+    int nSavedIsa = colorconv_get_isa();
+    size_t i;
+    int nIsa, nPass;
+
+    for(i=0; i<aRGB.size(); i++)
+        aRGB[i] = (unsigned char)(i*2654435761U>>24);
+
+    for(nIsa=COLORCONV_ISA_SCALAR; nIsa<=colorconv_get_best_isa(); nIsa++)
+    {
+        BENCH_CHECK(colorconv_set_isa(nIsa)==nIsa);
+
+        CBenchTimer timer;
+        for(nPass=0; nPass<nPasses; nPass++)
+            rgb24_to_yv12(&aRGB[0], nWidth, nHeight, nStride,
+                &aYUV[0], &aYUV[nYSize], &aYUV[nYSize+nUVSize]);
+        double dEncode = timer.GetMs();
+
+        timer.Restart();
+        for(nPass=0; nPass<nPasses; nPass++)
+            yv12_to_rgb24(&aRGB[0], nWidth, nHeight, nStride,
+                &aYUV[0], nWidth, &aYUV[nYSize], nWidth/2, &aYUV[nYSize+nUVSize], nWidth/2);
+        double dDecode = timer.GetMs();
+
+        printf("   %s: rgb24_to_yv12 %.1f ms/frame, yv12_to_rgb24 %.1f ms/frame\n",
+            nIsa<3 ? aszIsa[nIsa] : "?", dEncode/nPasses, dDecode/nPasses);
+    }
+
+    colorconv_set_isa(nSavedIsa);
+
+    return true;
+}
+
+REGISTER_BENCHMARK( Bench_color_conv, "RGB24 <-> YV12 conversion of a 1080p frame" );
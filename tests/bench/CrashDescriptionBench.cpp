@@ -0,0 +1,119 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+#include "Bench.h"
+#include "../../reporting/crashrpt/CrashDescription.h"
+#include <string.h>
+
+// Makes a UTF-16 string of the text followed by the number.
+static void MakeString(const char* szText, int nNumber, std::vector<unsigned short>& aStr)
+{
+    char szBuf[64];
+    sprintf(szBuf, "%d", nNumber);
+    aStr.clear();
+    const char* p;
+    for(p=szText; *p!=0; p++)
+        aStr.push_back((unsigned char)*p);
+    for(p=szBuf; *p!=0; p++)
+        aStr.push_back((unsigned char)*p);
+}
+
+// Writes a crash description with the given count of file items and custom
+// properties. Returns the description size or 0 if it doesn't fit.
+static unsigned WriteDescription(void* pBuffer, size_t uSize, int nFiles, int nProps)
+{
+    CCrashDescWriter Writer;
+    std::vector<unsigned short> aStr;
+    int i;
+
+    CRASH_DESCRIPTION* pDesc = Writer.Create(pBuffer, uSize);
+    if(pDesc==NULL)
+        return 0;
+
+    MakeString("MyApp", 1, aStr);
+    pDesc->m_dwAppNameOffs = Writer.AddString(&aStr[0], aStr.size());
+
+    for(i=0; i<nFiles; i++)
+    {
+        unsigned uOffs = Writer.AddBlock("FIL ", sizeof(FILE_ITEM));
+        MakeString("C:\\Logs\\file", i, aStr);
+        unsigned uSrcOffs = Writer.AddString(&aStr[0], aStr.size());
+        MakeString("file", i, aStr);
+        unsigned uDstOffs = Writer.AddString(&aStr[0], aStr.size());
+        if(uOffs==0 || uSrcOffs==0 || uDstOffs==0)
+            return 0;
+
+        FILE_ITEM* pItem = (FILE_ITEM*)Writer.GetBlock(uOffs);
+        pItem->m_dwSrcFilePathOffs = uSrcOffs;
+        pItem->m_dwDstFileNameOffs = uDstOffs;
+        pDesc->m_uFileItems++;
+    }
+
+    for(i=0; i<nProps; i++)
+    {
+        unsigned uOffs = Writer.AddBlock("CPR ", sizeof(CUSTOM_PROP));
+        MakeString("Name", i, aStr);
+        unsigned uNameOffs = Writer.AddString(&aStr[0], aStr.size());
+        MakeString("Value", i, aStr);
+        unsigned uValueOffs = Writer.AddString(&aStr[0], aStr.size());
+        if(uOffs==0 || uNameOffs==0 || uValueOffs==0)
+            return 0;
+
+        CUSTOM_PROP* pProp = (CUSTOM_PROP*)Writer.GetBlock(uOffs);
+        pProp->m_dwNameOffs = uNameOffs;
+        pProp->m_dwValueOffs = uValueOffs;
+        pDesc->m_uCustomProps++;
+    }
+
+    return pDesc->m_dwTotalSize;
+}
+
+static bool Bench_crash_desc_read()
+{
+    // Validates a description with 20000 files and 50000 custom properties
+    // and reads all property values in place, as CrashSender.exe does.
+
+    const int nPasses = 20;
+    std::vector<unsigned long long> aBuffer(8*1024*1024/8);
+    CCrashDescReader Reader;
+    unsigned uSize = 0;
+    unsigned uTotalLength = 0;
+    int nPass;
+
+    CBenchTimer timer;
+    uSize = WriteDescription(&aBuffer[0], aBuffer.size()*8, 20000, 50000);
+    double dWrite = timer.GetMs();
+    BENCH_CHECK(uSize!=0);
+
+    timer.Restart();
+    for(nPass=0; nPass<nPasses; nPass++)
+    {
+        BENCH_CHECK(Reader.Init(&aBuffer[0], uSize)==0);
+        unsigned uOffs = Reader.GetHeader()->m_uSize;
+        const GENERIC_HEADER* pBlock = NULL;
+        while((pBlock = Reader.GetBlock(uOffs, uOffs))!=NULL)
+        {
+            const CUSTOM_PROP* pProp = (const CUSTOM_PROP*)CCrashDescReader::CheckBlock(pBlock, "CPR ", sizeof(CUSTOM_PROP));
+            const unsigned short* pStr = NULL;
+            unsigned uLength = 0;
+            if(pProp!=NULL && Reader.GetString(pProp->m_dwValueOffs, pStr, uLength))
+                uTotalLength += uLength;
+        }
+    }
+    double dRead = timer.GetMs();
+
+    printf("   %u bytes: write %.1f ms, read %.2f ms per pass\n", uSize, dWrite, dRead/nPasses);
+
+    BENCH_CHECK(uTotalLength!=0);
+
+    return true;
+}
+
+REGISTER_BENCHMARK( Bench_crash_desc_read, "Writing and reading a crash description with 70000 items" );
@@ -0,0 +1,92 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+#include "Bench.h"
+#include "../../reporting/crashsender/Hash.h"
+#include <string.h>
+
+static bool Bench_hash()
+{
+    // Hashes 64 MB with each function and every instruction set the CPU
+    // supports. Digests must not depend on the instruction set.
+
+    const size_t uSize = 64<<20;
+    const size_t uBuffers = 64;
+    const char* aszIsa[3] = {"scalar", "SSE2", "SHA"};
+    std::vector<unsigned char> aData(uSize);
+    std::vector<unsigned char> aDigests(uBuffers*MD5_DIGEST_SIZE);
+    unsigned char MD5Digest[MD5_DIGEST_SIZE];
+    unsigned char SHADigest[SHA256_DIGEST_SIZE];
+    unsigned char FirstMD5[MD5_DIGEST_SIZE];
+    unsigned char FirstSHA[SHA256_DIGEST_SIZE];
+    const void* apData[uBuffers];
+    size_t aSizes[uBuffers];
+    unsigned long long uHash[2] = {0, 0};
+    int nSavedIsa = hash_get_isa();
+    size_t i;
+    int nIsa;
+
+    for(i=0; i<uSize; i++)
+        aData[i] = (unsigned char)((i*2654435761U)>>24);
+    for(i=0; i<uBuffers; i++)
+    {
+        apData[i] = &aData[i*(uSize/uBuffers)];
+        aSizes[i] = uSize/uBuffers;
+    }
+
+    for(nIsa=HASH_ISA_SCALAR; nIsa<=hash_get_best_isa(); nIsa++)
+    {
+        BENCH_CHECK(hash_set_isa(nIsa)==nIsa);
+
+        CBenchTimer timer;
+        {
+            CMD5 md5;
+            md5.Update(&aData[0], uSize);
+            md5.Final(MD5Digest);
+        }
+        double dMD5 = timer.GetMs();
+
+        timer.Restart();
+        CMD5::HashMany(apData, aSizes, uBuffers, (unsigned char (*)[MD5_DIGEST_SIZE])&aDigests[0]);
+        double dMD5Many = timer.GetMs();
+
+        timer.Restart();
+        {
+            CSHA256 sha;
+            sha.Update(&aData[0], uSize);
+            sha.Final(SHADigest);
+        }
+        double dSHA = timer.GetMs();
+
+        timer.Restart();
+        fast_hash128(&aData[0], uSize, uHash);
+        double dFast = timer.GetMs();
+
+        if(nIsa==HASH_ISA_SCALAR)
+        {
+            memcpy(FirstMD5, MD5Digest, MD5_DIGEST_SIZE);
+            memcpy(FirstSHA, SHADigest, SHA256_DIGEST_SIZE);
+        }
+        BENCH_CHECK(memcmp(FirstMD5, MD5Digest, MD5_DIGEST_SIZE)==0);
+        BENCH_CHECK(memcmp(FirstSHA, SHADigest, SHA256_DIGEST_SIZE)==0);
+
+        printf("   %s: MD5 %.0f MB/s, MD5 x%d buffers %.0f MB/s, SHA-256 %.0f MB/s, fast hash 128 %.0f MB/s\n",
+            nIsa<3 ? aszIsa[nIsa] : "?", bench_mb_per_sec(uSize, dMD5), (int)uBuffers,
+            bench_mb_per_sec(uSize, dMD5Many), bench_mb_per_sec(uSize, dSHA), bench_mb_per_sec(uSize, dFast));
+    }
+
+    hash_set_isa(nSavedIsa);
+
+    BENCH_CHECK(uHash[0]!=0 || uHash[1]!=0);
+
+    return true;
+}
+
+REGISTER_BENCHMARK( Bench_hash, "MD5, SHA-256 and fast hash throughput on 64 MB" );
@@ -0,0 +1,150 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+#include "Bench.h"
+#include "../../reporting/crashsender/ImageEncoder.h"
+#include <stdlib.h>
+
+// Makes a screenshot-like image: desktop background with several windows
+// having title bars, borders and text. If bSmooth is set, title bars have
+// gradients and text is anti-aliased, so the image has many colors.
+static void MakeUIImage(int nWidth, int nHeight, int nStride, bool bSmooth,
+                        std::vector<unsigned char>& aBits)
+{
+    aBits.assign((size_t)nStride*nHeight, 0);
+    int x, y, i;
+
+    // Desktop background
+    for(y=0; y<nHeight; y++)
+    {
+        for(x=0; x<nWidth; x++)
+        {
+            unsigned char* p = &aBits[(size_t)y*nStride+x*3];
+            p[0] = 160; p[1] = 100; p[2] = 40;
+        }
+    }
+
+    // Windows
+    for(i=0; i<6; i++)
+    {
+        int nLeft = rand()%(nWidth/2+1);
+        int nTop = rand()%(nHeight/2+1);
+        int nRight = nLeft+nWidth/4+rand()%(nWidth/4+1);
+        int nBottom = nTop+nHeight/4+rand()%(nHeight/4+1);
+        if(nRight>nWidth)
+            nRight = nWidth;
+        if(nBottom>nHeight)
+            nBottom = nHeight;
+
+        for(y=nTop; y<nBottom; y++)
+        {
+            for(x=nLeft; x<nRight; x++)
+            {
+                unsigned char* p = &aBits[(size_t)y*nStride+x*3];
+                if(y<nTop+24)
+                {
+                    // Title bar
+                    int nShade = bSmooth ? (x-nLeft)*128/(nRight-nLeft) : 0;
+                    p[0] = (unsigned char)(200-nShade/2); p[1] = (unsigned char)(120+nShade/4); p[2] = (unsigned char)(40+nShade);
+                }
+                else if(x==nLeft || x==nRight-1 || y==nBottom-1)
+                {
+                    p[0] = p[1] = p[2] = 100; // Border
+                }
+                else if((y-nTop-24)%16>=4 && (y-nTop-24)%16<13 && x>nLeft+8 && x<nRight-8 &&
+                        ((x*7+y/16*13)%37)<30 && ((x*x+y*3)%5)<2)
+                {
+                    // Text
+                    unsigned char c = bSmooth ? (unsigned char)(rand()%160) : 0;
+                    p[0] = p[1] = p[2] = c;
+                }
+                else
+                {
+                    p[0] = p[1] = p[2] = 240; // Client area
+                }
+            }
+        }
+    }
+}
+
+// Makes an image whose upper half is a gradient and lower half is noise, like a photo.
+static void MakePhotoImage(int nWidth, int nHeight, int nStride, std::vector<unsigned char>& aBits)
+{
+    aBits.assign((size_t)nStride*nHeight, 0);
+    int x, y;
+    for(y=0; y<nHeight; y++)
+    {
+        for(x=0; x<nWidth; x++)
+        {
+            unsigned char* p = &aBits[(size_t)y*nStride+x*3];
+            if(y<nHeight/2)
+            {
+                p[0] = (unsigned char)x;
+                p[1] = (unsigned char)y;
+                p[2] = (unsigned char)(x+y);
+            }
+            else
+            {
+                p[0] = (unsigned char)rand();
+                p[1] = (unsigned char)rand();
+                p[2] = (unsigned char)rand();
+            }
+        }
+    }
+}
+
+static bool Bench_png_encode()
+{
+    // Writes sample 1080p screenshots with the default (best compression)
+    // and the fast lossless settings, using a single thread.
+
+    const int nWidth = 1920;
+    const int nHeight = 1080;
+    const int nStride = nWidth*3;
+    const char* aszSamples[3] = {"flat UI", "smooth UI", "photo"};
+    std::vector<unsigned char> aBits;
+    int nSample, nMode;
+
+    srand(1);
+
+    for(nSample=0; nSample<3; nSample++)
+    {
+        if(nSample<2)
+            MakeUIImage(nWidth, nHeight, nStride, nSample==1, aBits);
+        else
+            MakePhotoImage(nWidth, nHeight, nStride, aBits);
+
+        for(nMode=0; nMode<2; nMode++)
+        {
+            PngEncodeParams Params;
+            Params.m_nThreads = 1;
+            if(nMode==1)
+                Params.SetFastLossless();
+
+            FILE* f = tmpfile();
+            BENCH_CHECK(f!=NULL);
+
+            CBenchTimer timer;
+            bool bWrite = image_write_png(f, &aBits[0], nWidth, nHeight, nStride, Params);
+            double dTime = timer.GetMs();
+            long lSize = ftell(f);
+            fclose(f);
+
+            BENCH_CHECK(bWrite && lSize>0);
+
+            printf("   %s, %s: %ld bytes, %.0f ms\n", aszSamples[nSample],
+                nMode==0 ? "default" : "fast", lSize, dTime);
+        }
+    }
+
+    return true;
+}
+
+REGISTER_BENCHMARK( Bench_png_encode, "PNG size and encoding time of sample screenshots" );
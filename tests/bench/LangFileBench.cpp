@@ -0,0 +1,137 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+#include "Bench.h"
+#include "../../reporting/crashsender/LangFile.h"
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+// Reads the whole file into memory.
+static bool ReadFileData(const std::string& sFileName, std::vector<unsigned char>& aData)
+{
+    FILE* f = fopen(sFileName.c_str(), "rb");
+    if(f==NULL)
+        return false;
+
+    unsigned char Buf[4096];
+    size_t n;
+    aData.clear();
+    while((n = fread(Buf, 1, sizeof(Buf), f))!=0)
+        aData.insert(aData.end(), Buf, Buf+n);
+    fclose(f);
+    return true;
+}
+
+// Lists "section", "name" pairs of a UTF-16LE INI file. Lang files
+// have ASCII names only, so every character is taken from the low byte.
+// Trailing blanks of names are dropped, as GetPrivateProfileString does.
+static void ListNames(const std::vector<unsigned char>& aData,
+                      std::vector<std::pair<std::wstring, std::wstring> >& aNames)
+{
+    std::wstring sSection;
+    std::wstring sLine;
+    size_t i;
+
+    aNames.clear();
+    for(i=2; i+1<aData.size(); i+=2)
+    {
+        wchar_t c = (wchar_t)(aData[i]|(aData[i+1]<<8));
+        if(c!=L'\n')
+        {
+            if(c!=L'\r')
+                sLine += c;
+            if(i+3<aData.size())
+                continue;
+        }
+
+        if(sLine.length()>2 && sLine[0]==L'[' && sLine[sLine.length()-1]==L']')
+            sSection = sLine.substr(1, sLine.length()-2);
+        else if(!sSection.empty() && sLine.find(L'=')!=std::wstring::npos && sLine[0]!=L';')
+        {
+            std::wstring sName = sLine.substr(0, sLine.find(L'='));
+            sName.erase(sName.find_last_not_of(L" \t")+1);
+            aNames.push_back(std::make_pair(sSection, sName));
+        }
+        sLine.clear();
+    }
+}
+
+static bool Bench_lang_file()
+{
+    // Loads every language file shipped with CrashRpt and looks up all
+    // of its strings, as CrashSender does when showing its dialogs. On Windows
+    // the same strings are also read with GetPrivateProfileString.
+
+    const char* aszLang[] = {"CS", "DE", "EN", "ES", "FR", "HI", "IT", "JA",
+        "KO", "PL", "PT", "RU", "SK", "ZH-CN"};
+    const int nLangs = sizeof(aszLang)/sizeof(aszLang[0]);
+    double dParse = 0;
+    double dLookup = 0;
+    double dBinary = 0;
+    double dINI = 0;
+    int nStrings = 0;
+    int i;
+
+    for(i=0; i<nLangs; i++)
+    {
+        std::string sFileName = std::string(CRASHRPT_LANG_FILES_DIR)+"/crashrpt_lang_"+aszLang[i]+".ini";
+        std::vector<unsigned char> aData;
+        std::vector<unsigned char> aBinary;
+        std::vector<std::pair<std::wstring, std::wstring> > aNames;
+        size_t nName;
+
+        BENCH_CHECK(ReadFileData(sFileName, aData));
+        ListNames(aData, aNames);
+        BENCH_CHECK(!aNames.empty());
+        nStrings += (int)aNames.size();
+
+        CBenchTimer timer;
+        CLangFile LangFile;
+        BENCH_CHECK(LangFile.Parse(&aData[0], aData.size()));
+        dParse += timer.GetMs();
+
+        timer.Restart();
+        for(nName=0; nName<aNames.size(); nName++)
+            BENCH_CHECK(LangFile.GetString(aNames[nName].first.c_str(), aNames[nName].second.c_str())!=NULL);
+        dLookup += timer.GetMs();
+
+        LangFile.SaveBinary(aBinary);
+        timer.Restart();
+        CLangFile BinaryFile;
+        BENCH_CHECK(BinaryFile.LoadBinary(&aBinary[0], aBinary.size()));
+        dBinary += timer.GetMs();
+        BENCH_CHECK(BinaryFile.GetStringCount()==LangFile.GetStringCount());
+
+#ifdef _WIN32
+        std::wstring sWideName(sFileName.begin(), sFileName.end());
+        timer.Restart();
+        for(nName=0; nName<aNames.size(); nName++)
+        {
+            wchar_t szValue[4096];
+            GetPrivateProfileStringW(aNames[nName].first.c_str(), aNames[nName].second.c_str(),
+                L"", szValue, 4096, sWideName.c_str());
+        }
+        dINI += timer.GetMs();
+#endif
+    }
+
+    printf("   %d files, %d strings: parse %.2f ms, lookup %.2f ms, load compiled %.2f ms\n",
+        nLangs, nStrings, dParse, dLookup, dBinary);
+#ifdef _WIN32
+    printf("   GetPrivateProfileString %.0f ms\n", dINI);
+#else
+    (void)dINI;
+#endif
+
+    return true;
+}
+
+REGISTER_BENCHMARK( Bench_lang_file, "Loading language files and looking up all strings" );
@@ -0,0 +1,84 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+#include "Bench.h"
+#include "../../reporting/crashsender/LineIndexer.h"
+#include <stdlib.h>
+
+// Finds line starts and the widest line of an 8-bit text character by character.
+static void IndexReference(const std::vector<unsigned char>& aText, int nTabLength,
+                           std::vector<unsigned long long>& aLines, int& nMaxWidth)
+{
+    size_t uLineStart = 0;
+    int nTabs = 0;
+    size_t i;
+
+    aLines.clear();
+    nMaxWidth = 0;
+
+    for(i=0; i<aText.size(); i++)
+    {
+        if(aText[i]=='\t')
+            nTabs++;
+        else if(aText[i]=='\n')
+        {
+            int nWidth = (int)(i+1-uLineStart)+nTabs*(nTabLength-1);
+            if(nWidth>nMaxWidth)
+                nMaxWidth = nWidth;
+            uLineStart = i+1;
+            aLines.push_back(uLineStart);
+            nTabs = 0;
+        }
+    }
+}
+
+static bool Bench_line_indexer()
+{
+    // Indexes a 64 MB log file made of lines of 20-200 characters in 1 MB
+    // blocks, as the file preview does, and with a character by character scan.
+
+    const size_t uSize = 64*1024*1024;
+    const size_t uBlockSize = 1024*1024;
+    const int nTabLength = 4;
+    std::vector<unsigned char> aText(uSize);
+    std::vector<unsigned long long> aExpected, aLines;
+    int nExpectedWidth = 0;
+    size_t i = 0;
+
+    srand(1);
+    while(i<uSize)
+    {
+        size_t uLine = 20+rand()%180;
+        size_t j;
+        for(j=0; j<uLine && i<uSize; j++, i++)
+            aText[i] = (unsigned char)(j==uLine-1 ? '\n' : j==8 ? '\t' : 'a'+j%26);
+    }
+
+    CBenchTimer timer;
+    IndexReference(aText, nTabLength, aExpected, nExpectedWidth);
+    double dReference = timer.GetMs();
+
+    timer.Restart();
+    CLineIndexer Indexer;
+    Indexer.Init(1, false, nTabLength, 0);
+    for(i=0; i<uSize; i+=uBlockSize)
+        Indexer.ScanBlock(&aText[i], uBlockSize, aLines);
+    double dIndexer = timer.GetMs();
+
+    printf("   %d lines: reference %.0f ms, CLineIndexer %.0f ms (%.0f MB/s)\n",
+        (int)aLines.size(), dReference, dIndexer, bench_mb_per_sec(uSize, dIndexer));
+
+    BENCH_CHECK(aLines==aExpected);
+    BENCH_CHECK(Indexer.GetMaxLineWidth()==nExpectedWidth);
+
+    return true;
+}
+
+REGISTER_BENCHMARK( Bench_line_indexer, "Line indexing of a 64 MB log file" );
@@ -0,0 +1,152 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+#include "Bench.h"
+#include "../../reporting/crashsender/RegKeyDump.h"
+#include <string.h>
+#include <stdint.h>
+
+#define BENCH_REG_SUBKEYS 1000 // Count of subkeys of HKEY_CURRENT_USER\Big.
+#define BENCH_REG_VALUES  100  // Count of values in each subkey.
+
+// Registry source generating HKEY_CURRENT_USER\Big with BENCH_REG_SUBKEYS subkeys
+// named KeyN, each having BENCH_REG_VALUES string and binary values. Keys are
+// identified by numbers: 1 is the root, 2 is Big, 3+N is KeyN.
+class CBenchRegKeySource : public CRegKeySource
+{
+public:
+
+    void* OpenKey(void* hParent, const wchar_t* szName, std::string& sError)
+    {
+        uintptr_t uParent = (uintptr_t)hParent;
+        if(uParent==0 && wcscmp(szName, L"HKEY_CURRENT_USER")==0)
+            return (void*)1;
+        if(uParent==1 && wcscmp(szName, L"Big")==0)
+            return (void*)2;
+        if(uParent==2 && wcsncmp(szName, L"Key", 3)==0)
+            return (void*)(uintptr_t)(3+wcstoul(szName+3, NULL, 10));
+
+        sError = "The system cannot find the file specified.";
+        return NULL;
+    }
+
+    void CloseKey(void* hKey)
+    {
+    }
+
+    bool QueryKey(void* hKey, RegKeyInfo& info)
+    {
+        uintptr_t uKey = (uintptr_t)hKey;
+        memset(&info, 0, sizeof(info));
+        if(uKey==1)
+        {
+            info.m_uSubKeys = 1;
+            info.m_uMaxSubKeyLen = 3;
+        }
+        else if(uKey==2)
+        {
+            info.m_uSubKeys = BENCH_REG_SUBKEYS;
+            info.m_uMaxSubKeyLen = 16;
+        }
+        else
+        {
+            info.m_uValues = BENCH_REG_VALUES;
+            info.m_uMaxValueNameLen = 6;
+            info.m_uMaxValueLen = 36;
+        }
+        return true;
+    }
+
+    bool EnumKey(void* hKey, unsigned uIndex, wchar_t* szName, unsigned& uNameLen)
+    {
+        uintptr_t uKey = (uintptr_t)hKey;
+        char szBuf[32];
+        if(uKey==1 && uIndex==0)
+            strcpy(szBuf, "Big");
+        else if(uKey==2 && uIndex<BENCH_REG_SUBKEYS)
+            sprintf(szBuf, "Key%u", uIndex);
+        else
+            return false;
+
+        unsigned uLen = (unsigned)strlen(szBuf);
+        if(uLen+1>uNameLen)
+            return false;
+        unsigned i;
+        for(i=0; i<=uLen; i++)
+            szName[i] = (wchar_t)szBuf[i];
+        uNameLen = uLen;
+        return true;
+    }
+
+    bool EnumValue(void* hKey, unsigned uIndex, wchar_t* szName, unsigned& uNameLen,
+        unsigned& uType, unsigned char* pData, unsigned& uDataSize)
+    {
+        const char* szValue = "Some string value";
+        const char* szValueName = uIndex%2==0 ? "String" : "Binary";
+        unsigned i;
+
+        if((uintptr_t)hKey<3 || uIndex>=BENCH_REG_VALUES || uNameLen<7 || uDataSize<36)
+            return false;
+
+        for(i=0; i<=6; i++)
+            szName[i] = (wchar_t)szValueName[i];
+        uNameLen = 6;
+
+        if(uIndex%2==0)
+        {
+            // UTF-16LE string with zero terminator
+            for(i=0; i<18; i++)
+            {
+                pData[i*2] = (unsigned char)szValue[i];
+                pData[i*2+1] = 0;
+            }
+            uType = REGDUMP_SZ;
+            uDataSize = 36;
+        }
+        else
+        {
+            memset(pData, 0x5A, 32);
+            uType = REGDUMP_BINARY;
+            uDataSize = 32;
+        }
+        return true;
+    }
+};
+
+static bool Bench_reg_key_dump()
+{
+    // Dumps a key with 1000 subkeys of 100 values each to a file, the way
+    // registry keys are added to error reports.
+
+    CBenchRegKeySource source;
+    CRegKeyDumper dumper;
+    FILE* f = tmpfile();
+    BENCH_CHECK(f!=NULL);
+
+    CBenchTimer timer;
+    CXmlWriter xml;
+    xml.Attach(f);
+    int nResult = dumper.Dump(&source, L"HKEY_CURRENT_USER\\Big", xml);
+    bool bFlush = xml.Flush();
+    double dTime = timer.GetMs();
+
+    long lSize = ftell(f);
+    fclose(f);
+
+    BENCH_CHECK(nResult==REGDUMP_OK);
+    BENCH_CHECK(bFlush);
+    BENCH_CHECK(lSize>5000000);
+
+    printf("   %ld bytes: %.1f ms (%.0f MB/s)\n", lSize, dTime, bench_mb_per_sec(lSize, dTime));
+
+    return true;
+}
+
+REGISTER_BENCHMARK( Bench_reg_key_dump, "Dumping a registry key with 100000 values to XML" );
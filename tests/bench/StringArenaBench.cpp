@@ -0,0 +1,114 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+#include "Bench.h"
+#include "../../reporting/crashrpt/StringArena.h"
+#include <stdlib.h>
+
+// Makes a UTF-16 string of the given length. Non-ASCII strings mix
+// 1, 2, 3 and 4 byte UTF-8 characters.
+static void MakeString(int nLength, bool bASCII, std::vector<wchar_t>& aStr)
+{
+    aStr.clear();
+    int i;
+    for(i=0; i<nLength; i++)
+    {
+        unsigned cp = 0x20+rand()%0x5F;
+        int r = rand()%4;
+        if(!bASCII && r==1)
+            cp = 0x80+rand()%0x780;
+        else if(!bASCII && r==2)
+            cp = 0x800+rand()%(0xD800-0x800);
+        else if(!bASCII && r==3)
+            cp = 0x10000+(rand()*(RAND_MAX+1u)+rand())%0x100000;
+
+        if(cp>=0x10000)
+        {
+            aStr.push_back((wchar_t)(0xD800+((cp-0x10000)>>10)));
+            aStr.push_back((wchar_t)(0xDC00+((cp-0x10000)&0x3FF)));
+        }
+        else
+            aStr.push_back((wchar_t)cp);
+    }
+    aStr.push_back(0);
+}
+
+static bool Bench_strconv_arena()
+{
+    // Converts many short UTF-8 strings to UTF-16, as the crash description
+    // reader does, with a heap buffer per string and with the arena. Both
+    // free their strings every 1000 conversions.
+
+    const int nStrings = 200000;
+    std::vector<std::vector<char> > aStrings(64);
+    size_t uHeapTotal = 0;
+    size_t uArenaTotal = 0;
+    size_t i;
+    int n;
+
+    srand(1);
+    for(i=0; i<aStrings.size(); i++)
+    {
+        std::vector<wchar_t> aStr;
+        MakeString(5+rand()%40, i%4!=0, aStr);
+        aStrings[i].resize(aStr.size()*3);
+        size_t uLen = utf16_to_utf8(&aStr[0], aStr.size(), &aStrings[i][0]);
+        aStrings[i].resize(uLen);
+    }
+
+    CBenchTimer timer;
+    {
+        std::vector<wchar_t*> aConverted;
+        for(n=0; n<nStrings; n++)
+        {
+            const std::vector<char>& s = aStrings[n%aStrings.size()];
+            wchar_t* p = new wchar_t[s.size()];
+            uHeapTotal += utf8_to_utf16(&s[0], s.size(), p);
+            aConverted.push_back(p);
+            if(aConverted.size()==1000)
+            {
+                for(i=0; i<aConverted.size(); i++)
+                    delete [] aConverted[i];
+                aConverted.clear();
+            }
+        }
+        for(i=0; i<aConverted.size(); i++)
+            delete [] aConverted[i];
+    }
+    double dHeap = timer.GetMs();
+
+    timer.Restart();
+    {
+        CStringArena* pArena = new CStringArena;
+        for(n=0; n<nStrings; n++)
+        {
+            const std::vector<char>& s = aStrings[n%aStrings.size()];
+            wchar_t* p = (wchar_t*)pArena->Alloc(s.size()*sizeof(wchar_t));
+            size_t uLen = utf8_to_utf16(&s[0], s.size(), p);
+            pArena->Shrink(p, uLen*sizeof(wchar_t));
+            uArenaTotal += uLen;
+            if(n%1000==999)
+            {
+                delete pArena;
+                pArena = new CStringArena;
+            }
+        }
+        delete pArena;
+    }
+    double dArena = timer.GetMs();
+
+    printf("   %d strings: heap buffers %.1f ms, arena %.1f ms\n", nStrings, dHeap, dArena);
+
+    BENCH_CHECK(uHeapTotal==uArenaTotal);
+
+    return true;
+}
+
+REGISTER_BENCHMARK( Bench_strconv_arena, "UTF-8 to UTF-16 conversion into heap buffers and into the string arena" );
@@ -0,0 +1,62 @@
+/*************************************************************************************
+This file is a part of CrashRpt library.
+Copyright (c) 2003-2013 The CrashRpt project authors. All Rights Reserved.
+
+Use of this source code is governed by a BSD-style license
+that can be found in the License.txt file in the root of the source
+tree. All contributing project authors may
+be found in the Authors.txt file in the root of the source tree.
+***************************************************************************************/
+
+#include "Bench.h"
+#include "../../reporting/crashsender/XmlWriter.h"
+
+static bool Bench_xml_writer()
+{
+    // Writes a crash description XML with 100000 custom properties to a file.
+
+    const int nProps = 100000;
+    FILE* f = tmpfile();
+    long lSize = 0;
+    int i;
+    BENCH_CHECK(f!=NULL);
+
+    {
+        CBenchTimer timer;
+        CXmlWriter xml;
+        xml.Attach(f);
+        xml.WriteDeclaration(true);
+        xml.StartElement("CrashRpt");
+        xml.AddAttribute("version", 1500);
+        xml.WriteElement("AppName", "My & \"App\"");
+        xml.WriteElement("ExceptionType", -1);
+        xml.StartElement("CustomProps");
+        for(i=0; i<nProps; i++)
+        {
+            char szName[32];
+            sprintf(szName, "Prop%d", i);
+            xml.StartElement("Prop");
+            xml.AddAttribute("name", szName);
+            xml.AddAttribute("value", "Some value of a property <with markup>");
+            xml.EndElement();
+        }
+        xml.EndElement();
+        xml.StartElement("FileList");
+        xml.EndElement();
+        xml.EndElement();
+        bool bFlush = xml.Flush();
+        double dTime = timer.GetMs();
+
+        lSize = ftell(f);
+        fclose(f);
+
+        BENCH_CHECK(bFlush);
+        BENCH_CHECK(lSize>5000000);
+
+        printf("   %ld bytes: %.1f ms (%.0f MB/s)\n", lSize, dTime, bench_mb_per_sec(lSize, dTime));
+    }
+
+    return true;
+}
+
+REGISTER_BENCHMARK( Bench_xml_writer, "Writing crash description XML with 100000 properties" );